@@ -0,0 +1,243 @@
+/*
+  This file is part of p4est.
+  p4est is a C library to manage a collection (a forest) of multiple
+  connected adaptive quadtrees or octrees in parallel.
+
+  Copyright (C) 2010 The University of Texas System
+  Written by Carsten Burstedde, Lucas C. Wilcox, and Tobin Isaac
+
+  p4est is free software; you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation; either version 2 of the License, or
+  (at your option) any later version.
+
+  p4est is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with p4est; if not, write to the Free Software Foundation, Inc.,
+  51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
+*/
+
+/*
+ * Usage: p4est_benchbits [-l level] [-L level-max] [-n repetitions]
+ *
+ * Microbenchmark for the quadrant primitives that dominate profiles
+ * of linearize, search and balance: quadrant_compare, is_ancestor,
+ * face_neighbor and nearest_common_ancestor.  The workload is the
+ * Morton-sorted leaf array of a fractally refined unit square/cube,
+ * rebuilt for every level in the sweep.
+ */
+
+#ifndef P4_TO_P8
+#include <p4est_bits.h>
+#include <p4est_extended.h>
+#else
+#include <p8est_bits.h>
+#include <p8est_extended.h>
+#endif
+#include <sc_flops.h>
+#include <sc_statistics.h>
+#include <sc_options.h>
+
+enum
+{
+  BENCH_COMPARE,
+  BENCH_IS_ANCESTOR,
+  BENCH_FACE_NEIGHBOR,
+  BENCH_NCA,
+  BENCH_NUM_STATS
+};
+
+static int          refine_level = 0;
+static int          level_shift = 0;
+
+static int
+refine_fractal (p4est_t * p4est, p4est_topidx_t which_tree,
+                p4est_quadrant_t * q)
+{
+  int                 qid;
+
+  if ((int) q->level >= refine_level) {
+    return 0;
+  }
+  if ((int) q->level < refine_level - level_shift) {
+    return 1;
+  }
+
+  qid = p4est_quadrant_child_id (q);
+  return (qid == 0 || qid == 3
+#ifdef P4_TO_P8
+          || qid == 5 || qid == 6
+#endif
+    );
+}
+
+/** Time the four primitives over one Morton-sorted leaf array.
+ * The results of every call are accumulated into a checksum that is
+ * logged afterwards so the loops cannot be optimized away.
+ */
+static void
+bench_level (MPI_Comm mpicomm, int level, int reps)
+{
+  int                 r;
+  int                 face;
+  long                sum;
+  size_t              zz, incount;
+  p4est_connectivity_t *connectivity;
+  p4est_t            *p4est;
+  p4est_tree_t       *tree;
+  sc_array_t         *quadrants;
+  p4est_quadrant_t   *q1, *q2;
+  p4est_quadrant_t   *ancestors;
+  p4est_quadrant_t    s;
+  sc_statinfo_t       stats[BENCH_NUM_STATS];
+  sc_flopinfo_t       fi, snapshot;
+
+  /* build the workload: all leaves of one fractally refined tree */
+  refine_level = level;
+#ifndef P4_TO_P8
+  connectivity = p4est_connectivity_new_unitsquare ();
+#else
+  connectivity = p8est_connectivity_new_unitcube ();
+#endif
+  p4est = p4est_new_ext (mpicomm, connectivity,
+                         0, refine_level - level_shift, 1, 0, NULL, NULL);
+  p4est_refine (p4est, 1, refine_fractal, NULL);
+  tree = p4est_tree_array_index (p4est->trees, 0);
+  quadrants = &tree->quadrants;
+  incount = quadrants->elem_count;
+  P4EST_GLOBAL_STATISTICSF ("Benchmark level %d over %llu quadrants"
+                            " repeated %d times\n", level,
+                            (unsigned long long) incount, reps);
+  /* precompute ancestors at half depth for the is_ancestor timing */
+  ancestors = P4EST_ALLOC (p4est_quadrant_t, incount);
+  for (zz = 0; zz < incount; ++zz) {
+    q1 = p4est_quadrant_array_index (quadrants, zz);
+    p4est_quadrant_ancestor (q1, (int) q1->level / 2, ancestors + zz);
+  }
+
+  sum = 0;
+
+  /* time quadrant_compare over consecutive sorted pairs */
+  sc_flops_snap (&fi, &snapshot);
+  for (r = 0; r < reps; ++r) {
+    for (zz = 0; zz + 1 < incount; ++zz) {
+      q1 = p4est_quadrant_array_index (quadrants, zz);
+      q2 = p4est_quadrant_array_index (quadrants, zz + 1);
+      sum += p4est_quadrant_compare (q1, q2);
+    }
+  }
+  sc_flops_shot (&fi, &snapshot);
+  sc_stats_set1 (&stats[BENCH_COMPARE], snapshot.iwtime, "Compare");
+
+  /* time is_ancestor both for hits and for shifted misses */
+  sc_flops_snap (&fi, &snapshot);
+  for (r = 0; r < reps; ++r) {
+    for (zz = 0; zz < incount; ++zz) {
+      q1 = p4est_quadrant_array_index (quadrants, zz);
+      sum += p4est_quadrant_is_ancestor (ancestors + zz, q1);
+      sum += p4est_quadrant_is_ancestor (ancestors + zz,
+                                         p4est_quadrant_array_index
+                                         (quadrants, (zz + 7) % incount));
+    }
+  }
+  sc_flops_shot (&fi, &snapshot);
+  sc_stats_set1 (&stats[BENCH_IS_ANCESTOR], snapshot.iwtime, "Is_ancestor");
+
+  /* time face_neighbor across all faces of every leaf */
+  sc_flops_snap (&fi, &snapshot);
+  for (r = 0; r < reps; ++r) {
+    for (zz = 0; zz < incount; ++zz) {
+      q1 = p4est_quadrant_array_index (quadrants, zz);
+      for (face = 0; face < P4EST_FACES; ++face) {
+        p4est_quadrant_face_neighbor (q1, face, &s);
+        sum += (long) s.x;
+      }
+    }
+  }
+  sc_flops_shot (&fi, &snapshot);
+  sc_stats_set1 (&stats[BENCH_FACE_NEIGHBOR], snapshot.iwtime,
+                 "Face_neighbor");
+
+  /* time nearest_common_ancestor over strided pairs */
+  sc_flops_snap (&fi, &snapshot);
+  for (r = 0; r < reps; ++r) {
+    for (zz = 0; zz < incount; ++zz) {
+      q1 = p4est_quadrant_array_index (quadrants, zz);
+      q2 = p4est_quadrant_array_index (quadrants, (zz + 17) % incount);
+      p4est_nearest_common_ancestor (q1, q2, &s);
+      sum += (long) s.level;
+    }
+  }
+  sc_flops_shot (&fi, &snapshot);
+  sc_stats_set1 (&stats[BENCH_NCA], snapshot.iwtime,
+                 "Nearest_common_ancestor");
+
+  P4EST_GLOBAL_STATISTICSF ("Benchmark checksum %ld\n", sum);
+
+  sc_stats_compute (mpicomm, BENCH_NUM_STATS, stats);
+  sc_stats_print (p4est_package_id, SC_LP_STATISTICS,
+                  BENCH_NUM_STATS, stats, 1, 1);
+
+  P4EST_FREE (ancestors);
+  p4est_destroy (p4est);
+  p4est_connectivity_destroy (connectivity);
+}
+
+int
+main (int argc, char **argv)
+{
+  int                 mpiret;
+  int                 level, level_max, reps;
+  int                 lv;
+  int                 first_argc;
+  MPI_Comm            mpicomm;
+  sc_options_t       *opt;
+
+  mpiret = MPI_Init (&argc, &argv);
+  SC_CHECK_MPI (mpiret);
+  mpicomm = MPI_COMM_WORLD;
+
+  sc_init (mpicomm, 1, 1, NULL, SC_LP_DEFAULT);
+#ifndef P4EST_DEBUG
+  sc_set_log_defaults (NULL, NULL, SC_LP_STATISTICS);
+#endif
+  p4est_init (NULL, SC_LP_DEFAULT);
+
+  opt = sc_options_new (argv[0]);
+  sc_options_add_int (opt, 'l', "level", &level, 6,
+                      "first refine level in the sweep");
+  sc_options_add_int (opt, 'L', "level-max", &level_max, -1,
+                      "sweep refine levels up to this inclusive bound");
+  sc_options_add_int (opt, 'n', "repetitions", &reps, 10,
+                      "repetitions of every timed loop");
+
+  first_argc = sc_options_parse (p4est_package_id, SC_LP_DEFAULT,
+                                 opt, argc, argv);
+  if (first_argc < 0 || first_argc != argc || level < 1 || reps < 1) {
+    sc_options_print_usage (p4est_package_id, SC_LP_ERROR, opt, NULL);
+    return 1;
+  }
+  sc_options_print_summary (p4est_package_id, SC_LP_PRODUCTION, opt);
+
+  level_shift = 4;
+  if (level_max < level) {
+    level_max = level;
+  }
+
+  for (lv = level; lv <= level_max; ++lv) {
+    bench_level (mpicomm, lv, reps);
+  }
+
+  sc_options_destroy (opt);
+
+  sc_finalize ();
+
+  mpiret = MPI_Finalize ();
+  SC_CHECK_MPI (mpiret);
+
+  return 0;
+}
@@ -0,0 +1,403 @@
+/*
+  This file is part of p4est.
+  p4est is a C library to manage a collection (a forest) of multiple
+  connected adaptive quadtrees or octrees in parallel.
+
+  Copyright (C) 2010 The University of Texas System
+  Written by Carsten Burstedde, Lucas C. Wilcox, and Tobin Isaac
+
+  p4est is free software; you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation; either version 2 of the License, or
+  (at your option) any later version.
+
+  p4est is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with p4est; if not, write to the Free Software Foundation, Inc.,
+  51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
+*/
+
+/*
+ * Usage: p4est_pipeline [-l level] [-L level-max] [-n cycles]
+ *
+ * End-to-end adaptation pipeline benchmark.  A spherical refinement
+ * front moves across the unit square/cube; every cycle runs the full
+ * adapt-balance-partition-ghost-iterate sequence on the same forest,
+ * so the phases see the allocator and cache state their predecessors
+ * leave behind, unlike the isolated timings of p4est_timings.  Where
+ * the Linux perf interface is available, instructions and last-level
+ * cache misses are counted per phase and a roofline-style summary of
+ * time, instruction throughput, and DRAM traffic is reported.
+ */
+
+#ifndef P4_TO_P8
+#include <p4est_bits.h>
+#include <p4est_extended.h>
+#include <p4est_ghost.h>
+#include <p4est_iterate.h>
+#else
+#include <p8est_bits.h>
+#include <p8est_extended.h>
+#include <p8est_ghost.h>
+#include <p8est_iterate.h>
+#endif
+#include <sc_flops.h>
+#include <sc_statistics.h>
+#include <sc_options.h>
+
+#ifdef __linux__
+#include <unistd.h>
+#include <sys/syscall.h>
+#include <linux/perf_event.h>
+#define PIPELINE_HAVE_PERF
+#endif
+
+enum
+{
+  PIPELINE_ADAPT,
+  PIPELINE_BALANCE,
+  PIPELINE_PARTITION,
+  PIPELINE_GHOST,
+  PIPELINE_ITERATE,
+  PIPELINE_NUM_PHASES
+};
+
+static const char  *pipeline_phase_names[PIPELINE_NUM_PHASES] = {
+  "Adapt", "Balance", "Partition", "Ghost", "Iterate"
+};
+
+enum
+{
+  PIPELINE_INSTRUCTIONS,
+  PIPELINE_LLC_MISSES,
+  PIPELINE_NUM_COUNTERS
+};
+
+/* the front is a sphere around this center; the callbacks refine a
+ * band around its surface and coarsen away from it */
+static double       front_center[P4EST_DIM];
+static double       front_radius = .25;
+static int          max_level = 0;
+
+static double       phase_seconds[PIPELINE_NUM_PHASES];
+static long long    phase_counters[PIPELINE_NUM_PHASES]
+  [PIPELINE_NUM_COUNTERS];
+
+#ifdef PIPELINE_HAVE_PERF
+static int          counter_fds[PIPELINE_NUM_COUNTERS] = { -1, -1 };
+#endif
+
+static void
+pipeline_counters_open (void)
+{
+#ifdef PIPELINE_HAVE_PERF
+  int                 i;
+  struct perf_event_attr attr;
+  const uint64_t      configs[PIPELINE_NUM_COUNTERS] = {
+    PERF_COUNT_HW_INSTRUCTIONS, PERF_COUNT_HW_CACHE_MISSES
+  };
+
+  for (i = 0; i < PIPELINE_NUM_COUNTERS; ++i) {
+    memset (&attr, 0, sizeof (attr));
+    attr.type = PERF_TYPE_HARDWARE;
+    attr.size = sizeof (attr);
+    attr.config = configs[i];
+    attr.exclude_kernel = 1;
+    attr.exclude_hv = 1;
+    counter_fds[i] = (int) syscall (SYS_perf_event_open, &attr,
+                                    0, -1, -1, 0);
+  }
+  if (counter_fds[0] < 0) {
+    P4EST_GLOBAL_PRODUCTION
+      ("Hardware counters unavailable; timing only\n");
+  }
+#else
+  P4EST_GLOBAL_PRODUCTION ("No perf interface; timing only\n");
+#endif
+}
+
+static void
+pipeline_counters_read (long long values[PIPELINE_NUM_COUNTERS])
+{
+  int                 i;
+
+  for (i = 0; i < PIPELINE_NUM_COUNTERS; ++i) {
+    values[i] = 0;
+#ifdef PIPELINE_HAVE_PERF
+    if (counter_fds[i] >= 0) {
+      if (read (counter_fds[i], &values[i], sizeof (long long)) !=
+          sizeof (long long)) {
+        values[i] = 0;
+      }
+    }
+#endif
+  }
+}
+
+static void
+pipeline_counters_close (void)
+{
+#ifdef PIPELINE_HAVE_PERF
+  int                 i;
+
+  for (i = 0; i < PIPELINE_NUM_COUNTERS; ++i) {
+    if (counter_fds[i] >= 0) {
+      close (counter_fds[i]);
+      counter_fds[i] = -1;
+    }
+  }
+#endif
+}
+
+/** Distance of a quadrant's center to the front surface in units of
+ * the unit square/cube. */
+static double
+front_distance (p4est_quadrant_t * q)
+{
+  const double        h =
+    (double) P4EST_QUADRANT_LEN (q->level) / (double) P4EST_ROOT_LEN;
+  double              d2, dx;
+  int                 i;
+  double              center[P4EST_DIM];
+
+  center[0] = (double) q->x / (double) P4EST_ROOT_LEN + .5 * h;
+  center[1] = (double) q->y / (double) P4EST_ROOT_LEN + .5 * h;
+#ifdef P4_TO_P8
+  center[2] = (double) q->z / (double) P4EST_ROOT_LEN + .5 * h;
+#endif
+  d2 = 0.;
+  for (i = 0; i < P4EST_DIM; ++i) {
+    dx = center[i] - front_center[i];
+    d2 += dx * dx;
+  }
+  return fabs (sqrt (d2) - front_radius);
+}
+
+static int
+refine_front (p4est_t * p4est, p4est_topidx_t which_tree,
+              p4est_quadrant_t * q)
+{
+  const double        h =
+    (double) P4EST_QUADRANT_LEN (q->level) / (double) P4EST_ROOT_LEN;
+
+  return (int) q->level < max_level && front_distance (q) < h;
+}
+
+static int
+coarsen_front (p4est_t * p4est, p4est_topidx_t which_tree,
+               p4est_quadrant_t * q[])
+{
+  const double        h =
+    (double) P4EST_QUADRANT_LEN (q[0]->level) / (double) P4EST_ROOT_LEN;
+  int                 i;
+
+  for (i = 0; i < P4EST_CHILDREN; ++i) {
+    if (front_distance (q[i]) < 3. * h) {
+      return 0;
+    }
+  }
+  return 1;
+}
+
+static void
+iterate_volume (p4est_iter_volume_info_t * info, void *user_data)
+{
+  *(long *) user_data += (long) info->quad->level;
+}
+
+static void
+iterate_face (p4est_iter_face_info_t * info, void *user_data)
+{
+  *(long *) user_data += (long) info->sides.elem_count;
+}
+
+/** Run one phase, accumulating its time and hardware counters. */
+static void
+pipeline_phase_begin (sc_flopinfo_t * fi, sc_flopinfo_t * snapshot,
+                      long long before[PIPELINE_NUM_COUNTERS])
+{
+  pipeline_counters_read (before);
+  sc_flops_snap (fi, snapshot);
+}
+
+static void
+pipeline_phase_end (int phase, sc_flopinfo_t * fi,
+                    sc_flopinfo_t * snapshot,
+                    long long before[PIPELINE_NUM_COUNTERS])
+{
+  int                 i;
+  long long           after[PIPELINE_NUM_COUNTERS];
+
+  sc_flops_shot (fi, snapshot);
+  pipeline_counters_read (after);
+  phase_seconds[phase] += snapshot->iwtime;
+  for (i = 0; i < PIPELINE_NUM_COUNTERS; ++i) {
+    phase_counters[phase][i] += after[i] - before[i];
+  }
+}
+
+static void
+pipeline_run (MPI_Comm mpicomm, int level, int cycles)
+{
+  const double        cacheline = 64.;
+  int                 mpiret;
+  int                 c, i;
+  long                sum;
+  double              t;
+  double              gins, gbytes;
+  long long           before[PIPELINE_NUM_COUNTERS];
+  long long           global[PIPELINE_NUM_PHASES][PIPELINE_NUM_COUNTERS];
+  double              gtime[PIPELINE_NUM_PHASES];
+  p4est_connectivity_t *connectivity;
+  p4est_t            *p4est;
+  p4est_ghost_t      *ghost;
+  sc_statinfo_t       stats[PIPELINE_NUM_PHASES];
+  sc_flopinfo_t       fi, snapshot;
+
+#ifndef P4_TO_P8
+  connectivity = p4est_connectivity_new_unitsquare ();
+#else
+  connectivity = p8est_connectivity_new_unitcube ();
+#endif
+  p4est = p4est_new_ext (mpicomm, connectivity, 0, level, 1, 0,
+                         NULL, NULL);
+  max_level = level + 4;
+
+  memset (phase_seconds, 0, sizeof (phase_seconds));
+  memset (phase_counters, 0, sizeof (phase_counters));
+  sum = 0;
+
+  for (c = 0; c < cycles; ++c) {
+    /* the front moves along the diagonal over the course of the run */
+    t = cycles > 1 ? (double) c / (double) (cycles - 1) : 0.;
+    for (i = 0; i < P4EST_DIM; ++i) {
+      front_center[i] = .1 + .8 * t;
+    }
+
+    pipeline_phase_begin (&fi, &snapshot, before);
+    p4est_refine (p4est, 0, refine_front, NULL);
+    p4est_coarsen (p4est, 0, coarsen_front, NULL);
+    pipeline_phase_end (PIPELINE_ADAPT, &fi, &snapshot, before);
+
+    pipeline_phase_begin (&fi, &snapshot, before);
+    p4est_balance (p4est, P4EST_CONNECT_FULL, NULL);
+    pipeline_phase_end (PIPELINE_BALANCE, &fi, &snapshot, before);
+
+    pipeline_phase_begin (&fi, &snapshot, before);
+    p4est_partition (p4est, NULL);
+    pipeline_phase_end (PIPELINE_PARTITION, &fi, &snapshot, before);
+
+    pipeline_phase_begin (&fi, &snapshot, before);
+    ghost = p4est_ghost_new (p4est, P4EST_CONNECT_FULL);
+    pipeline_phase_end (PIPELINE_GHOST, &fi, &snapshot, before);
+
+    pipeline_phase_begin (&fi, &snapshot, before);
+    p4est_iterate (p4est, ghost, &sum, iterate_volume, iterate_face,
+#ifdef P4_TO_P8
+                   NULL,
+#endif
+                   NULL);
+    pipeline_phase_end (PIPELINE_ITERATE, &fi, &snapshot, before);
+
+    p4est_ghost_destroy (ghost);
+    P4EST_GLOBAL_VERBOSEF ("Cycle %d global quadrants %lld\n", c,
+                           (long long) p4est->global_num_quadrants);
+  }
+  P4EST_GLOBAL_STATISTICSF ("Pipeline checksum %ld quadrants %lld\n",
+                            sum, (long long) p4est->global_num_quadrants);
+
+  /* the timing statistics run through the usual machinery */
+  for (i = 0; i < PIPELINE_NUM_PHASES; ++i) {
+    sc_stats_set1 (&stats[i], phase_seconds[i], pipeline_phase_names[i]);
+  }
+  sc_stats_compute (mpicomm, PIPELINE_NUM_PHASES, stats);
+  sc_stats_print (p4est_package_id, SC_LP_STATISTICS,
+                  PIPELINE_NUM_PHASES, stats, 1, 1);
+
+  /* the roofline summary sums counters and maximizes time over ranks */
+  mpiret = MPI_Reduce (phase_counters, global,
+                       PIPELINE_NUM_PHASES * PIPELINE_NUM_COUNTERS,
+                       MPI_LONG_LONG_INT, MPI_SUM, 0, mpicomm);
+  SC_CHECK_MPI (mpiret);
+  mpiret = MPI_Reduce (phase_seconds, gtime, PIPELINE_NUM_PHASES,
+                       MPI_DOUBLE, MPI_MAX, 0, mpicomm);
+  SC_CHECK_MPI (mpiret);
+  if (p4est->mpirank == 0 && global[0][PIPELINE_INSTRUCTIONS] > 0) {
+    P4EST_GLOBAL_STATISTICS
+      ("Phase        seconds     Ginsn    DRAM GB      GB/s  insn/byte\n");
+    for (i = 0; i < PIPELINE_NUM_PHASES; ++i) {
+      gins = (double) global[i][PIPELINE_INSTRUCTIONS] * 1e-9;
+      gbytes = (double) global[i][PIPELINE_LLC_MISSES] * cacheline * 1e-9;
+      P4EST_GLOBAL_STATISTICSF
+        ("%-9s %10.3f %9.3f %10.3f %9.3f %10.3f\n",
+         pipeline_phase_names[i], gtime[i], gins, gbytes,
+         gtime[i] > 0. ? gbytes / gtime[i] : 0.,
+         gbytes > 0. ? gins / gbytes : 0.);
+    }
+  }
+
+  p4est_destroy (p4est);
+  p4est_connectivity_destroy (connectivity);
+}
+
+int
+main (int argc, char **argv)
+{
+  int                 mpiret;
+  int                 level, level_max, cycles;
+  int                 lv;
+  int                 first_argc;
+  MPI_Comm            mpicomm;
+  sc_options_t       *opt;
+
+  mpiret = MPI_Init (&argc, &argv);
+  SC_CHECK_MPI (mpiret);
+  mpicomm = MPI_COMM_WORLD;
+
+  sc_init (mpicomm, 1, 1, NULL, SC_LP_DEFAULT);
+#ifndef P4EST_DEBUG
+  sc_set_log_defaults (NULL, NULL, SC_LP_STATISTICS);
+#endif
+  p4est_init (NULL, SC_LP_DEFAULT);
+
+  opt = sc_options_new (argv[0]);
+  sc_options_add_int (opt, 'l', "level", &level, 4,
+                      "first base level in the sweep");
+  sc_options_add_int (opt, 'L', "level-max", &level_max, -1,
+                      "sweep base levels up to this inclusive bound");
+  sc_options_add_int (opt, 'n', "cycles", &cycles, 16,
+                      "adaptation cycles of the moving front");
+
+  first_argc = sc_options_parse (p4est_package_id, SC_LP_DEFAULT,
+                                 opt, argc, argv);
+  if (first_argc < 0 || first_argc != argc || level < 1 || cycles < 1) {
+    sc_options_print_usage (p4est_package_id, SC_LP_ERROR, opt, NULL);
+    return 1;
+  }
+  sc_options_print_summary (p4est_package_id, SC_LP_PRODUCTION, opt);
+
+  if (level_max < level) {
+    level_max = level;
+  }
+
+  pipeline_counters_open ();
+  for (lv = level; lv <= level_max; ++lv) {
+    P4EST_GLOBAL_STATISTICSF ("Pipeline base level %d cycles %d\n",
+                              lv, cycles);
+    pipeline_run (mpicomm, lv, cycles);
+  }
+  pipeline_counters_close ();
+
+  sc_options_destroy (opt);
+
+  sc_finalize ();
+
+  mpiret = MPI_Finalize ();
+  SC_CHECK_MPI (mpiret);
+
+  return 0;
+}
@@ -197,15 +197,106 @@ refine_fractal (p4est_t * p4est, p4est_topidx_t which_tree,
     );
 }
 
-int
-main (int argc, char **argv)
+/** Partition weight that grows with the refinement level. */
+static int
+weight_by_level (p4est_t * p4est, p4est_topidx_t which_tree,
+                 p4est_quadrant_t * quadrant)
+{
+  return 1 + (int) quadrant->level;
+}
+
+/** Append the computed statistics of one benchmark entry to a CSV file.
+ * The format is one line per phase:
+ * configuration,mpisize,level,phase,mean,min,max.
+ */
+static void
+timings_csv_append (const char *csv_name, const char *config_name,
+                    int mpisize, int level, sc_statinfo_t * stats)
+{
+  int                 i;
+  int                 retval;
+  FILE               *csv;
+
+  csv = fopen (csv_name, "ab");
+  SC_CHECK_ABORTF (csv != NULL, "Failed to open %s", csv_name);
+  for (i = 0; i < TIMINGS_NUM_STATS; ++i) {
+    fprintf (csv, "%s,%d,%d,%s,%.16g,%.16g,%.16g\n",
+             config_name, mpisize, level, stats[i].variable,
+             stats[i].average, stats[i].min, stats[i].max);
+  }
+  retval = fclose (csv);
+  SC_CHECK_ABORTF (retval == 0, "Failed to close %s", csv_name);
+}
+
+/** Compare the computed statistics against a baseline CSV file written
+ * by a previous run with the same configuration, size and level.
+ * A phase is flagged as regressed if its mean exceeds the baseline
+ * mean by more than the relative tolerance \a rtol.  Phases missing
+ * from the baseline are ignored.
+ * \return          The number of regressed phases.
+ */
+static int
+timings_baseline_compare (const char *baseline_name,
+                          const char *config_name, int mpisize, int level,
+                          double rtol, sc_statinfo_t * stats)
+{
+  int                 i;
+  int                 retval;
+  int                 num_flagged = 0;
+  int                 bsize, blevel;
+  double              bmean, bmin, bmax;
+  char                line[BUFSIZ];
+  char                bconfig[BUFSIZ], bphase[BUFSIZ];
+  FILE               *baseline;
+
+  baseline = fopen (baseline_name, "rb");
+  SC_CHECK_ABORTF (baseline != NULL, "Failed to open %s", baseline_name);
+  while (fgets (line, BUFSIZ, baseline) != NULL) {
+    if (sscanf (line, "%[^,],%d,%d,%[^,],%lf,%lf,%lf",
+                bconfig, &bsize, &blevel, bphase,
+                &bmean, &bmin, &bmax) != 7) {
+      continue;
+    }
+    if (strcmp (bconfig, config_name) || bsize != mpisize
+        || blevel != level) {
+      continue;
+    }
+    for (i = 0; i < TIMINGS_NUM_STATS; ++i) {
+      if (!strcmp (stats[i].variable, bphase)) {
+        if (stats[i].average > (1. + rtol) * bmean + 1e-6) {
+          P4EST_GLOBAL_PRODUCTIONF
+            ("Regression %s: %g exceeds baseline %g beyond %g%%\n",
+             bphase, stats[i].average, bmean, 100. * rtol);
+          ++num_flagged;
+        }
+        break;
+      }
+    }
+  }
+  retval = fclose (baseline);
+  SC_CHECK_ABORTF (retval == 0, "Failed to close %s", baseline_name);
+  if (num_flagged == 0) {
+    P4EST_GLOBAL_PRODUCTION ("No regressions against baseline\n");
+  }
+  return num_flagged;
+}
+
+/** Run the full sequence of timed phases for one refinement level.
+ * Results are logged through sc_statistics and optionally appended to
+ * a CSV file and compared against a baseline.
+ * \return          The number of phases flagged against the baseline.
+ */
+static int
+timings_run (mpi_context_t * mpi, timings_config_t config,
+             const char *config_name, const char *load_name, int weighted,
+             int overlap, int subtree, int borders, int max_ranges,
+             int use_ranges, int use_ranges_notify, int use_balance_verify,
+             const char *csv_name, const char *baseline_name, double rtol)
 {
   int                 i;
   int                 mpiret;
-  int                 wrongusage;
+  int                 num_flagged;
   unsigned            crc, gcrc;
-  const char         *config_name;
-  const char         *load_name;
   p4est_locidx_t     *quadrant_counts;
   p4est_gloidx_t      count_refined, count_balanced;
   p4est_gloidx_t      prev_quadrant, next_quadrant;
@@ -219,124 +310,8 @@ main (int argc, char **argv)
 #endif
   p4est_lnodes_t     *lnodes;
   const timings_regression_t *r;
-  timings_config_t    config;
   sc_statinfo_t       stats[TIMINGS_NUM_STATS];
   sc_flopinfo_t       fi, snapshot;
-  mpi_context_t       mpi_context, *mpi = &mpi_context;
-  sc_options_t       *opt;
-  int                 overlap;
-  int                 subtree;
-  int                 borders;
-  int                 max_ranges;
-  int                 use_ranges, use_ranges_notify, use_balance_verify;
-  int                 first_argc;
-
-  /* initialize MPI and p4est internals */
-  mpiret = MPI_Init (&argc, &argv);
-  SC_CHECK_MPI (mpiret);
-  mpi->mpicomm = MPI_COMM_WORLD;
-  mpiret = MPI_Comm_size (mpi->mpicomm, &mpi->mpisize);
-  SC_CHECK_MPI (mpiret);
-  mpiret = MPI_Comm_rank (mpi->mpicomm, &mpi->mpirank);
-  SC_CHECK_MPI (mpiret);
-
-  sc_init (mpi->mpicomm, 1, 1, NULL, SC_LP_DEFAULT);
-#ifndef P4EST_DEBUG
-  sc_set_log_defaults (NULL, NULL, SC_LP_STATISTICS);
-#endif
-  p4est_init (NULL, SC_LP_DEFAULT);
-
-  /* process command line arguments */
-  P4EST_GLOBAL_PRODUCTIONF ("Size of %dtant: %lld bytes\n", P4EST_DIM,
-                            (long long) sizeof (p4est_quadrant_t));
-
-  opt = sc_options_new (argv[0]);
-
-  sc_options_add_switch (opt, 'o', "new-balance-overlap", &overlap,
-                         "use the new balance overlap algorithm");
-  sc_options_add_switch (opt, 's', "new-balance-subtree", &subtree,
-                         "use the new balance subtree algorithm");
-  sc_options_add_switch (opt, 'b', "new-balance-borders", &borders,
-                         "use borders in balance");
-  sc_options_add_int (opt, 'm', "max-ranges", &max_ranges, -1,
-                      "override p4est_num_ranges");
-  sc_options_add_switch (opt, 'r', "ranges", &use_ranges,
-                         "use ranges in balance");
-  sc_options_add_switch (opt, 't', "ranges-notify", &use_ranges_notify,
-                         "use both ranges and notify");
-  sc_options_add_switch (opt, 'y', "balance-verify", &use_balance_verify,
-                         "use verifications in balance");
-  sc_options_add_int (opt, 'l', "level", &refine_level, 0,
-                      "initial refine level");
-#ifndef P4_TO_P8
-  sc_options_add_string (opt, 'c', "configuration", &config_name, "unit",
-                         "configuration: unit|periodic|three|moebius|star");
-#else
-  sc_options_add_string (opt, 'c', "configuration", &config_name, "unit",
-                         "configuration: unit|periodic|rotwrap|twocubes|rotcubes|shell");
-#endif
-  sc_options_add_string (opt, 'f', "load-forest", &load_name, NULL,
-                         "load saved " P4EST_STRING);
-
-  first_argc = sc_options_parse (p4est_package_id, SC_LP_DEFAULT,
-                                 opt, argc, argv);
-  if (first_argc < 0 || first_argc != argc) {
-    sc_options_print_usage (p4est_package_id, SC_LP_ERROR, opt, NULL);
-    return 1;
-  }
-  if (max_ranges < -1 || max_ranges == 0) {
-    P4EST_GLOBAL_LERROR ("The -m / --max-ranges option must be positive\n");
-    return 1;
-  }
-  sc_options_print_summary (p4est_package_id, SC_LP_PRODUCTION, opt);
-
-  wrongusage = 0;
-  config = P4EST_CONFIG_NULL;
-  if (!strcmp (config_name, "unit")) {
-    config = P4EST_CONFIG_UNIT;
-  }
-  else if (!strcmp (config_name, "periodic")) {
-    config = P4EST_CONFIG_PERIODIC;
-  }
-#ifndef P4_TO_P8
-  else if (!strcmp (config_name, "three")) {
-    config = P4EST_CONFIG_THREE;
-  }
-  else if (!strcmp (config_name, "moebius")) {
-    config = P4EST_CONFIG_MOEBIUS;
-  }
-  else if (!strcmp (config_name, "star")) {
-    config = P4EST_CONFIG_STAR;
-  }
-#else
-  else if (!strcmp (config_name, "rotwrap")) {
-    config = P4EST_CONFIG_ROTWRAP;
-  }
-  else if (!strcmp (config_name, "twocubes")) {
-    config = P4EST_CONFIG_TWOCUBES;
-  }
-  else if (!strcmp (config_name, "rotcubes")) {
-    config = P4EST_CONFIG_ROTCUBES;
-  }
-  else if (!strcmp (config_name, "shell")) {
-    config = P4EST_CONFIG_SHELL;
-  }
-#endif
-  else if (load_name != NULL) {
-    config_name = load_name;
-  }
-  else {
-    wrongusage = 1;
-  }
-  if (wrongusage) {
-    P4EST_GLOBAL_LERRORF ("Wrong configuration name given: %s\n",
-                          config_name);
-    sc_options_print_usage (p4est_package_id, SC_LP_ERROR, opt, NULL);
-    sc_abort_collective ("Usage error");
-  }
-
-  /* get command line argument: maximum refinement level */
-  level_shift = 4;
 
   /* print general setup information */
   P4EST_GLOBAL_STATISTICSF
@@ -500,9 +475,9 @@ main (int argc, char **argv)
   P4EST_ASSERT (count_balanced == p4est->global_num_quadrants);
   P4EST_ASSERT (crc == p4est_checksum (p4est));
 
-  /* time a uniform partition */
+  /* time a uniform or level-weighted partition */
   sc_flops_snap (&fi, &snapshot);
-  p4est_partition (p4est, NULL);
+  p4est_partition (p4est, weighted ? weight_by_level : NULL);
   sc_flops_shot (&fi, &snapshot);
   sc_stats_set1 (&stats[TIMINGS_PARTITION], snapshot.iwtime, "Partition");
 #ifdef P4EST_TIMINGS_VTK
@@ -592,12 +567,186 @@ main (int argc, char **argv)
   sc_stats_print (p4est_package_id, SC_LP_STATISTICS,
                   TIMINGS_NUM_STATS, stats, 1, 1);
 
+  /* emit machine-readable results and compare against the baseline */
+  num_flagged = 0;
+  if (mpi->mpirank == 0) {
+    if (csv_name != NULL) {
+      timings_csv_append (csv_name, config_name, mpi->mpisize,
+                          refine_level, stats);
+    }
+    if (baseline_name != NULL) {
+      num_flagged = timings_baseline_compare (baseline_name, config_name,
+                                              mpi->mpisize, refine_level,
+                                              rtol, stats);
+    }
+  }
+  mpiret = MPI_Bcast (&num_flagged, 1, MPI_INT, 0, mpi->mpicomm);
+  SC_CHECK_MPI (mpiret);
+
   /* destroy the p4est and its connectivity structure */
   P4EST_FREE (quadrant_counts);
   P4EST_FREE (p4est->inspect);
   p4est_destroy (p4est);
   p4est_connectivity_destroy (connectivity);
 
+  return num_flagged;
+}
+
+int
+main (int argc, char **argv)
+{
+  int                 mpiret;
+  int                 wrongusage;
+  const char         *config_name;
+  const char         *load_name;
+  const char         *csv_name;
+  const char         *baseline_name;
+  timings_config_t    config;
+  mpi_context_t       mpi_context, *mpi = &mpi_context;
+  sc_options_t       *opt;
+  int                 overlap;
+  int                 subtree;
+  int                 borders;
+  int                 max_ranges;
+  int                 use_ranges, use_ranges_notify, use_balance_verify;
+  int                 weighted;
+  int                 level_max;
+  int                 lv;
+  int                 num_flagged;
+  double              rtol;
+  int                 first_argc;
+
+  /* initialize MPI and p4est internals */
+  mpiret = MPI_Init (&argc, &argv);
+  SC_CHECK_MPI (mpiret);
+  mpi->mpicomm = MPI_COMM_WORLD;
+  mpiret = MPI_Comm_size (mpi->mpicomm, &mpi->mpisize);
+  SC_CHECK_MPI (mpiret);
+  mpiret = MPI_Comm_rank (mpi->mpicomm, &mpi->mpirank);
+  SC_CHECK_MPI (mpiret);
+
+  sc_init (mpi->mpicomm, 1, 1, NULL, SC_LP_DEFAULT);
+#ifndef P4EST_DEBUG
+  sc_set_log_defaults (NULL, NULL, SC_LP_STATISTICS);
+#endif
+  p4est_init (NULL, SC_LP_DEFAULT);
+
+  /* process command line arguments */
+  P4EST_GLOBAL_PRODUCTIONF ("Size of %dtant: %lld bytes\n", P4EST_DIM,
+                            (long long) sizeof (p4est_quadrant_t));
+
+  opt = sc_options_new (argv[0]);
+
+  sc_options_add_switch (opt, 'o', "new-balance-overlap", &overlap,
+                         "use the new balance overlap algorithm");
+  sc_options_add_switch (opt, 's', "new-balance-subtree", &subtree,
+                         "use the new balance subtree algorithm");
+  sc_options_add_switch (opt, 'b', "new-balance-borders", &borders,
+                         "use borders in balance");
+  sc_options_add_int (opt, 'm', "max-ranges", &max_ranges, -1,
+                      "override p4est_num_ranges");
+  sc_options_add_switch (opt, 'r', "ranges", &use_ranges,
+                         "use ranges in balance");
+  sc_options_add_switch (opt, 't', "ranges-notify", &use_ranges_notify,
+                         "use both ranges and notify");
+  sc_options_add_switch (opt, 'y', "balance-verify", &use_balance_verify,
+                         "use verifications in balance");
+  sc_options_add_int (opt, 'l', "level", &refine_level, 0,
+                      "initial refine level");
+  sc_options_add_int (opt, 'L', "level-max", &level_max, -1,
+                      "sweep refine levels up to this inclusive bound");
+  sc_options_add_switch (opt, 'w', "weighted", &weighted,
+                         "partition by quadrant level instead of uniformly");
+  sc_options_add_string (opt, 'C', "csv", &csv_name, NULL,
+                         "append per-phase results to this CSV file");
+  sc_options_add_string (opt, 'B', "baseline", &baseline_name, NULL,
+                         "flag regressions against this baseline CSV file");
+  sc_options_add_double (opt, 'T', "tolerance", &rtol, 0.1,
+                         "relative slowdown tolerated in the comparison");
+#ifndef P4_TO_P8
+  sc_options_add_string (opt, 'c', "configuration", &config_name, "unit",
+                         "configuration: unit|periodic|three|moebius|star");
+#else
+  sc_options_add_string (opt, 'c', "configuration", &config_name, "unit",
+                         "configuration: unit|periodic|rotwrap|twocubes|rotcubes|shell");
+#endif
+  sc_options_add_string (opt, 'f', "load-forest", &load_name, NULL,
+                         "load saved " P4EST_STRING);
+
+  first_argc = sc_options_parse (p4est_package_id, SC_LP_DEFAULT,
+                                 opt, argc, argv);
+  if (first_argc < 0 || first_argc != argc) {
+    sc_options_print_usage (p4est_package_id, SC_LP_ERROR, opt, NULL);
+    return 1;
+  }
+  if (max_ranges < -1 || max_ranges == 0) {
+    P4EST_GLOBAL_LERROR ("The -m / --max-ranges option must be positive\n");
+    return 1;
+  }
+  sc_options_print_summary (p4est_package_id, SC_LP_PRODUCTION, opt);
+
+  wrongusage = 0;
+  config = P4EST_CONFIG_NULL;
+  if (!strcmp (config_name, "unit")) {
+    config = P4EST_CONFIG_UNIT;
+  }
+  else if (!strcmp (config_name, "periodic")) {
+    config = P4EST_CONFIG_PERIODIC;
+  }
+#ifndef P4_TO_P8
+  else if (!strcmp (config_name, "three")) {
+    config = P4EST_CONFIG_THREE;
+  }
+  else if (!strcmp (config_name, "moebius")) {
+    config = P4EST_CONFIG_MOEBIUS;
+  }
+  else if (!strcmp (config_name, "star")) {
+    config = P4EST_CONFIG_STAR;
+  }
+#else
+  else if (!strcmp (config_name, "rotwrap")) {
+    config = P4EST_CONFIG_ROTWRAP;
+  }
+  else if (!strcmp (config_name, "twocubes")) {
+    config = P4EST_CONFIG_TWOCUBES;
+  }
+  else if (!strcmp (config_name, "rotcubes")) {
+    config = P4EST_CONFIG_ROTCUBES;
+  }
+  else if (!strcmp (config_name, "shell")) {
+    config = P4EST_CONFIG_SHELL;
+  }
+#endif
+  else if (load_name != NULL) {
+    config_name = load_name;
+  }
+  else {
+    wrongusage = 1;
+  }
+  if (wrongusage) {
+    P4EST_GLOBAL_LERRORF ("Wrong configuration name given: %s\n",
+                          config_name);
+    sc_options_print_usage (p4est_package_id, SC_LP_ERROR, opt, NULL);
+    sc_abort_collective ("Usage error");
+  }
+
+  /* get command line argument: maximum refinement level */
+  level_shift = 4;
+  if (level_max < refine_level) {
+    level_max = refine_level;
+  }
+
+  /* run the benchmark for every refinement level in the sweep */
+  num_flagged = 0;
+  for (lv = refine_level; lv <= level_max; ++lv) {
+    refine_level = lv;
+    num_flagged += timings_run (mpi, config, config_name, load_name,
+                                weighted, overlap, subtree, borders,
+                                max_ranges, use_ranges, use_ranges_notify,
+                                use_balance_verify, csv_name,
+                                baseline_name, rtol);
+  }
+
   sc_options_destroy (opt);
 
   /* clean up and exit */
@@ -606,5 +755,5 @@ main (int argc, char **argv)
   mpiret = MPI_Finalize ();
   SC_CHECK_MPI (mpiret);
 
-  return 0;
+  return num_flagged > 0 ? 1 : 0;
 }
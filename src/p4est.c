@@ -55,12 +55,43 @@
 #include <unistd.h>
 #endif
 
+/* scatter-gather writes let the checkpoint code hand the user data
+ * payload to the kernel straight from the live storage */
+#if defined P4EST_HAVE_SYS_UIO_H && defined P4EST_HAVE_WRITEV && \
+  !defined P4EST_MPIIO_WRITE
+#include <sys/uio.h>
+#include <limits.h>
+#define P4EST_SAVE_WRITEV
+#ifdef IOV_MAX
+#define P4EST_SAVE_IOV_MAX IOV_MAX
+#else
+#define P4EST_SAVE_IOV_MAX 1024
+#endif
+#endif
+
+/* number of quadrants that ride inline with the count message, so the
+ * frequent tiny balance messages complete in one send instead of a
+ * count/load pair */
+#define P4EST_BALANCE_INLINE    4
+
+/* the fixed small header of one balance round: the count is always
+ * valid, and for messages of up to P4EST_BALANCE_INLINE quadrants the
+ * payload is coalesced into the same buffer */
+typedef struct
+{
+  int                 count;
+  p4est_quadrant_t    quads[P4EST_BALANCE_INLINE];
+}
+p4est_balance_header_t;
+
 typedef struct
 {
   int8_t              have_first_count, have_first_load;
   int8_t              have_second_count, have_second_load;
   int                 recv_first_count, recv_second_count;
   int                 send_first_count, send_second_count;
+  p4est_balance_header_t send_first_hdr, send_second_hdr;
+  p4est_balance_header_t recv_first_hdr, recv_second_hdr;
   sc_array_t          send_first, send_second, recv_first, recv_second;
 }
 p4est_balance_peer_t;
@@ -85,6 +116,11 @@ static const int8_t any_face_flag = 0x02;
  * \param [in,out] num_quadrants_in_proc partition that will be corrected
  * \return                               absolute number of moved quadrants
  */
+static void         p4est_record_change (p4est_t * p4est,
+                                         p4est_topidx_t which_tree,
+                                         p4est_locidx_t begin,
+                                         p4est_locidx_t end);
+static void         p4est_record_change_all (p4est_t * p4est);
 static p4est_locidx_t p4est_partition_for_coarsening (p4est_t * p4est,
                                                       p4est_locidx_t *
                                                       num_quadrants_in_proc);
@@ -170,9 +206,13 @@ p4est_memory_used (p4est_t * p4est)
 
   size = sizeof (p4est_t) +
     (mpisize + 1) * (sizeof (p4est_gloidx_t) + sizeof (p4est_quadrant_t));
+  if (p4est->tree_owners != NULL) {
+    size += 2 * p4est->connectivity->num_trees * sizeof (int);
+  }
 
   size += sc_array_memory_used (p4est->trees, 1);
-  for (nt = 0; nt < p4est->connectivity->num_trees; ++nt) {
+  /* trees outside the local range hold no quadrant storage */
+  for (nt = p4est->first_local_tree; nt <= p4est->last_local_tree; ++nt) {
     tree = p4est_tree_array_index (p4est->trees, nt);
     size += sc_array_memory_used (&tree->quadrants, 0);
   }
@@ -180,11 +220,47 @@ p4est_memory_used (p4est_t * p4est)
   if (p4est->data_size > 0) {
     size += sc_mempool_memory_used (p4est->user_data_pool);
   }
+  if (p4est->user_data_arena != NULL) {
+    size += sc_array_memory_used (p4est->user_data_arena, 1);
+    for (nt = 0; nt < p4est->connectivity->num_trees; ++nt) {
+      size += sc_array_memory_used ((sc_array_t *)
+                                    sc_array_index (p4est->user_data_arena,
+                                                    (size_t) nt), 0);
+    }
+  }
   size += sc_mempool_memory_used (p4est->quadrant_pool);
 
   return size;
 }
 
+void
+p4est_inspect_print (p4est_t * p4est)
+{
+  p4est_inspect_t    *in = p4est->inspect;
+
+  if (in == NULL) {
+    return;
+  }
+  P4EST_STATISTICSF ("Inspect balance A %g comm %g B %g"
+                     " sent %llu nzpeers %llu\n",
+                     in->balance_A, in->balance_comm, in->balance_B,
+                     (unsigned long long) in->balance_comm_sent,
+                     (unsigned long long) in->balance_comm_nzpeers);
+  P4EST_STATISTICSF ("Inspect ghost %g sent %llu bytes nzpeers %llu\n",
+                     in->ghost_time,
+                     (unsigned long long) in->ghost_comm_sent,
+                     (unsigned long long) in->ghost_nzpeers);
+  P4EST_STATISTICSF ("Inspect partition %g sent %llu bytes nzpeers %llu\n",
+                     in->partition_time,
+                     (unsigned long long) in->partition_comm_sent,
+                     (unsigned long long) in->partition_nzpeers);
+  P4EST_STATISTICSF ("Inspect iterate %g\n", in->iterate_time);
+  P4EST_STATISTICSF ("Inspect lnodes %g sent %llu bytes nzpeers %llu\n",
+                     in->lnodes_time,
+                     (unsigned long long) in->lnodes_comm_sent,
+                     (unsigned long long) in->lnodes_nzpeers);
+}
+
 p4est_t            *
 p4est_new (MPI_Comm mpicomm, p4est_connectivity_t * connectivity,
            size_t data_size, p4est_init_t init_fn, void *user_pointer)
@@ -193,10 +269,17 @@ p4est_new (MPI_Comm mpicomm, p4est_connectivity_t * connectivity,
                         data_size, init_fn, user_pointer);
 }
 
-p4est_t            *
-p4est_new_ext (MPI_Comm mpicomm, p4est_connectivity_t * connectivity,
-               p4est_locidx_t min_quadrants, int min_level, int fill_uniform,
-               size_t data_size, p4est_init_t init_fn, void *user_pointer)
+/** Implementation of p4est_new_ext with an optional reusable context.
+ * With \a context non-NULL the cached communicator size and rank are
+ * used and retained allocations of previously destroyed forests are
+ * taken over instead of allocating fresh ones.
+ */
+static p4est_t     *
+p4est_new_common (p4est_context_t * context, MPI_Comm mpicomm,
+                  p4est_connectivity_t * connectivity,
+                  p4est_locidx_t min_quadrants, int min_level,
+                  int fill_uniform, size_t data_size, p4est_init_t init_fn,
+                  void *user_pointer)
 {
   int                 mpiret;
   int                 num_procs, rank;
@@ -223,11 +306,18 @@ p4est_new_ext (MPI_Comm mpicomm, p4est_connectivity_t * connectivity,
   P4EST_ASSERT (p4est_connectivity_is_valid (connectivity));
   P4EST_ASSERT (min_level <= P4EST_QMAXLEVEL);
 
-  /* retrieve MPI information */
-  mpiret = MPI_Comm_size (mpicomm, &num_procs);
-  SC_CHECK_MPI (mpiret);
-  mpiret = MPI_Comm_rank (mpicomm, &rank);
-  SC_CHECK_MPI (mpiret);
+  /* retrieve MPI information, cached on the context if one is given */
+  if (context != NULL) {
+    P4EST_ASSERT (mpicomm == context->mpicomm);
+    num_procs = context->mpisize;
+    rank = context->mpirank;
+  }
+  else {
+    mpiret = MPI_Comm_size (mpicomm, &num_procs);
+    SC_CHECK_MPI (mpiret);
+    mpiret = MPI_Comm_rank (mpicomm, &rank);
+    SC_CHECK_MPI (mpiret);
+  }
 
   /* assign some data members */
   p4est = P4EST_ALLOC_ZERO (p4est_t, 1);
@@ -237,16 +327,26 @@ p4est_new_ext (MPI_Comm mpicomm, p4est_connectivity_t * connectivity,
   p4est->data_size = data_size;
   p4est->user_pointer = user_pointer;
   p4est->connectivity = connectivity;
+  p4est->context = context;
   num_trees = connectivity->num_trees;
 
-  /* allocate memory pools */
+  /* allocate memory pools, reusing retained ones from the context */
   if (p4est->data_size > 0) {
     p4est->user_data_pool = sc_mempool_new (p4est->data_size);
   }
   else {
     p4est->user_data_pool = NULL;
   }
-  p4est->quadrant_pool = sc_mempool_new (sizeof (p4est_quadrant_t));
+  if (context != NULL && context->quadrant_pool != NULL) {
+    p4est->quadrant_pool = context->quadrant_pool;
+    context->quadrant_pool = NULL;
+  }
+  else {
+    p4est->quadrant_pool = sc_mempool_new (sizeof (p4est_quadrant_t));
+  }
+  if (context != NULL) {
+    ++context->num_forests;
+  }
 
   /* determine uniform level of initial tree */
   tree_num_quadrants = 1;
@@ -396,8 +496,9 @@ p4est_new_ext (MPI_Comm mpicomm, p4est_connectivity_t * connectivity,
                        (long long) jt, (long long) b.x, (long long) b.y);
 #endif
         /* fill up tree between a and b with coarse quadrants */
-        p4est_complete_region (p4est, &a, 1, &b, !must_remove_last_quadrant,
-                               tree, jt, init_fn);
+        p4est_complete_region_counted (p4est, &a, 1, &b,
+                                       !must_remove_last_quadrant,
+                                       tree, jt, init_fn);
         quad = p4est_quadrant_array_index (tquadrants,
                                            tquadrants->elem_count - 1);
       }
@@ -438,17 +539,18 @@ p4est_new_ext (MPI_Comm mpicomm, p4est_connectivity_t * connectivity,
     p4est->local_num_quadrants += tquadrants->elem_count;
     p4est_quadrant_last_descendant (quad, &tree->last_desc, P4EST_QMAXLEVEL);
   }
-  if (last_tree >= 0) {
-    for (; jt < num_trees; ++jt) {
-      tree = p4est_tree_array_index (p4est->trees, jt);
-      tree->quadrants_offset = p4est->local_num_quadrants;
-    }
-  }
 
   /* compute some member variables */
   p4est->first_local_tree = first_tree;
   p4est->last_local_tree = last_tree;
-  p4est->global_first_quadrant = P4EST_ALLOC (p4est_gloidx_t, num_procs + 1);
+  if (context != NULL && context->global_first_quadrant != NULL) {
+    p4est->global_first_quadrant = context->global_first_quadrant;
+    context->global_first_quadrant = NULL;
+  }
+  else {
+    p4est->global_first_quadrant =
+      P4EST_ALLOC (p4est_gloidx_t, num_procs + 1);
+  }
   if (!fill_uniform && level > 0) {
     /* this performs an allgather to count all quadrants */
     p4est_comm_count_quadrants (p4est);
@@ -463,7 +565,16 @@ p4est_new_ext (MPI_Comm mpicomm, p4est_connectivity_t * connectivity,
   }
 
   /* fill in global partition information */
-  global_first_position = P4EST_ALLOC_ZERO (p4est_quadrant_t, num_procs + 1);
+  if (context != NULL && context->global_first_position != NULL) {
+    global_first_position = context->global_first_position;
+    context->global_first_position = NULL;
+    memset (global_first_position, 0,
+            (num_procs + 1) * sizeof (p4est_quadrant_t));
+  }
+  else {
+    global_first_position =
+      P4EST_ALLOC_ZERO (p4est_quadrant_t, num_procs + 1);
+  }
   for (i = 0; i <= num_procs; ++i) {
     first_quadrant = (global_num_quadrants * i) / num_procs;
     first_tree = first_quadrant / tree_num_quadrants;
@@ -490,6 +601,92 @@ p4est_new_ext (MPI_Comm mpicomm, p4est_connectivity_t * connectivity,
   return p4est;
 }
 
+p4est_t            *
+p4est_new_ext (MPI_Comm mpicomm, p4est_connectivity_t * connectivity,
+               p4est_locidx_t min_quadrants, int min_level, int fill_uniform,
+               size_t data_size, p4est_init_t init_fn, void *user_pointer)
+{
+  return p4est_new_common (NULL, mpicomm, connectivity, min_quadrants,
+                           min_level, fill_uniform, data_size, init_fn,
+                           user_pointer);
+}
+
+p4est_t            *
+p4est_new_brick (MPI_Comm mpicomm, int mi, int ni,
+#ifdef P4_TO_P8
+                 int pi,
+#endif
+                 int periodic_a, int periodic_b,
+#ifdef P4_TO_P8
+                 int periodic_c,
+#endif
+                 int level, size_t data_size,
+                 p4est_init_t init_fn, void *user_pointer)
+{
+  p4est_connectivity_t *conn;
+
+  P4EST_ASSERT (0 <= level && level <= P4EST_QMAXLEVEL);
+
+  conn = p4est_connectivity_new_brick (mi, ni,
+#ifdef P4_TO_P8
+                                       pi,
+#endif
+                                       periodic_a, periodic_b
+#ifdef P4_TO_P8
+                                       , periodic_c
+#endif
+    );
+
+  /* the uniform fill derives every rank's quadrant range from curve
+   * arithmetic, so no refinement or repartition pass follows */
+  return p4est_new_ext (mpicomm, conn, 0, level, 1,
+                        data_size, init_fn, user_pointer);
+}
+
+p4est_context_t    *
+p4est_context_new (MPI_Comm mpicomm)
+{
+  int                 mpiret;
+  p4est_context_t    *context;
+
+  context = P4EST_ALLOC_ZERO (p4est_context_t, 1);
+  context->mpicomm = mpicomm;
+  mpiret = MPI_Comm_size (mpicomm, &context->mpisize);
+  SC_CHECK_MPI (mpiret);
+  mpiret = MPI_Comm_rank (mpicomm, &context->mpirank);
+  SC_CHECK_MPI (mpiret);
+
+  return context;
+}
+
+void
+p4est_context_destroy (p4est_context_t * context)
+{
+  P4EST_ASSERT (context != NULL);
+  P4EST_ASSERT (context->num_forests == 0);
+
+  if (context->quadrant_pool != NULL) {
+    sc_mempool_destroy (context->quadrant_pool);
+  }
+  P4EST_FREE (context->global_first_quadrant);
+  P4EST_FREE (context->global_first_position);
+  P4EST_FREE (context);
+}
+
+p4est_t            *
+p4est_new_context (p4est_context_t * context,
+                   p4est_connectivity_t * connectivity,
+                   p4est_locidx_t min_quadrants, int min_level,
+                   int fill_uniform, size_t data_size, p4est_init_t init_fn,
+                   void *user_pointer)
+{
+  P4EST_ASSERT (context != NULL);
+
+  return p4est_new_common (context, context->mpicomm, connectivity,
+                           min_quadrants, min_level, fill_uniform,
+                           data_size, init_fn, user_pointer);
+}
+
 void
 p4est_destroy (p4est_t * p4est)
 {
@@ -498,8 +695,19 @@ p4est_destroy (p4est_t * p4est)
 #endif
   p4est_topidx_t      jt;
   p4est_tree_t       *tree;
+  p4est_view_t       *view, *next_view;
+
+  /* orphan attached views: freeze their trees and cut the back link */
+  p4est_view_preserve_all (p4est);
+  for (view = p4est->views; view != NULL; view = next_view) {
+    next_view = view->next;
+    view->p4est = NULL;
+    view->next = NULL;
+  }
+  p4est->views = NULL;
 
-  for (jt = 0; jt < p4est->connectivity->num_trees; ++jt) {
+  /* trees outside the local range hold no quadrant storage */
+  for (jt = p4est->first_local_tree; jt <= p4est->last_local_tree; ++jt) {
     tree = p4est_tree_array_index (p4est->trees, jt);
 
 #ifdef P4EST_DEBUG
@@ -517,13 +725,233 @@ p4est_destroy (p4est_t * p4est)
   if (p4est->user_data_pool != NULL) {
     sc_mempool_destroy (p4est->user_data_pool);
   }
-  sc_mempool_destroy (p4est->quadrant_pool);
+  if (p4est->context != NULL && p4est->context->quadrant_pool == NULL) {
+    /* retain the warm pool for the next forest on this context */
+    p4est->context->quadrant_pool = p4est->quadrant_pool;
+  }
+  else {
+    sc_mempool_destroy (p4est->quadrant_pool);
+  }
+
+  if (p4est->user_data_arena != NULL) {
+    for (jt = 0; jt < p4est->connectivity->num_trees; ++jt) {
+      sc_array_reset ((sc_array_t *)
+                      sc_array_index (p4est->user_data_arena, (size_t) jt));
+    }
+    sc_array_destroy (p4est->user_data_arena);
+  }
+
+  if (p4est->changes != NULL) {
+    sc_array_destroy (p4est->changes);
+  }
+
+  if (p4est->context != NULL) {
+    /* return the partition tables for reuse by the next forest */
+    p4est_context_t    *context = p4est->context;
 
-  P4EST_FREE (p4est->global_first_quadrant);
-  P4EST_FREE (p4est->global_first_position);
+    P4EST_ASSERT (context->num_forests > 0);
+    --context->num_forests;
+    if (context->global_first_quadrant == NULL) {
+      context->global_first_quadrant = p4est->global_first_quadrant;
+    }
+    else {
+      P4EST_FREE (p4est->global_first_quadrant);
+    }
+    if (context->global_first_position == NULL) {
+      context->global_first_position = p4est->global_first_position;
+    }
+    else {
+      P4EST_FREE (p4est->global_first_position);
+    }
+  }
+  else {
+    P4EST_FREE (p4est->global_first_quadrant);
+    P4EST_FREE (p4est->global_first_position);
+  }
+  P4EST_FREE (p4est->tree_owners);
   P4EST_FREE (p4est);
 }
 
+long
+p4est_revision (p4est_t * p4est)
+{
+  return p4est->revision;
+}
+
+void
+p4est_changes_begin (p4est_t * p4est)
+{
+  P4EST_ASSERT (p4est->changes == NULL);
+
+  p4est->changes = sc_array_new (sizeof (p4est_change_t));
+}
+
+sc_array_t         *
+p4est_changes_end (p4est_t * p4est)
+{
+  sc_array_t         *changes = p4est->changes;
+
+  P4EST_ASSERT (changes != NULL);
+  p4est->changes = NULL;
+
+  return changes;
+}
+
+/** Append one modified quadrant range to the recorded change set.
+ * This is a noop unless recording has been enabled and merges the
+ * range into the previous entry if it refers to the same tree.
+ */
+static void
+p4est_record_change (p4est_t * p4est, p4est_topidx_t which_tree,
+                     p4est_locidx_t begin, p4est_locidx_t end)
+{
+  p4est_change_t     *ch;
+
+  if (p4est->changes == NULL || begin >= end) {
+    return;
+  }
+  if (p4est->changes->elem_count > 0) {
+    ch = (p4est_change_t *)
+      sc_array_index (p4est->changes, p4est->changes->elem_count - 1);
+    if (ch->which_tree == which_tree) {
+      ch->begin = SC_MIN (ch->begin, begin);
+      ch->end = SC_MAX (ch->end, end);
+      return;
+    }
+  }
+  ch = (p4est_change_t *) sc_array_push (p4est->changes);
+  ch->which_tree = which_tree;
+  ch->begin = begin;
+  ch->end = end;
+}
+
+/** Record every local tree as changed, e.g. after repartitioning. */
+static void
+p4est_record_change_all (p4est_t * p4est)
+{
+  p4est_topidx_t      nt;
+  p4est_tree_t       *tree;
+
+  if (p4est->changes == NULL) {
+    return;
+  }
+  for (nt = p4est->first_local_tree; nt <= p4est->last_local_tree; ++nt) {
+    tree = p4est_tree_array_index (p4est->trees, nt);
+    p4est_record_change (p4est, nt, 0,
+                         (p4est_locidx_t) tree->quadrants.elem_count);
+  }
+}
+
+p4est_view_t       *
+p4est_view_new (p4est_t * p4est)
+{
+  const int           num_procs = p4est->mpisize;
+  p4est_topidx_t      nt;
+  p4est_tree_t       *tree;
+  p4est_view_t       *view;
+
+  P4EST_ASSERT (p4est_is_valid (p4est));
+
+  view = P4EST_ALLOC (p4est_view_t, 1);
+  view->p4est = p4est;
+  view->revision = p4est->revision;
+  view->num_trees = p4est->connectivity->num_trees;
+  view->first_local_tree = p4est->first_local_tree;
+  view->last_local_tree = p4est->last_local_tree;
+  view->local_num_quadrants = p4est->local_num_quadrants;
+  view->global_first_quadrant =
+    P4EST_ALLOC (p4est_gloidx_t, num_procs + 1);
+  memcpy (view->global_first_quadrant, p4est->global_first_quadrant,
+          (num_procs + 1) * sizeof (p4est_gloidx_t));
+  view->tree_quadrants = P4EST_ALLOC (sc_array_t *, view->num_trees);
+  view->owns_tree = P4EST_ALLOC_ZERO (int8_t, view->num_trees);
+  for (nt = 0; nt < view->num_trees; ++nt) {
+    tree = p4est_tree_array_index (p4est->trees, nt);
+    view->tree_quadrants[nt] = &tree->quadrants;
+  }
+
+  view->next = p4est->views;
+  p4est->views = view;
+
+  return view;
+}
+
+sc_array_t         *
+p4est_view_tree (p4est_view_t * view, p4est_topidx_t which_tree)
+{
+  P4EST_ASSERT (0 <= which_tree && which_tree < view->num_trees);
+
+  return view->tree_quadrants[which_tree];
+}
+
+void
+p4est_view_destroy (p4est_view_t * view)
+{
+  p4est_topidx_t      nt;
+  p4est_view_t      **pv;
+
+  /* unlink from the forest if it is still alive */
+  if (view->p4est != NULL) {
+    for (pv = &view->p4est->views; *pv != view; pv = &(*pv)->next) {
+      P4EST_ASSERT (*pv != NULL);
+    }
+    *pv = view->next;
+  }
+
+  for (nt = 0; nt < view->num_trees; ++nt) {
+    if (view->owns_tree[nt]) {
+      sc_array_destroy (view->tree_quadrants[nt]);
+    }
+  }
+  P4EST_FREE (view->owns_tree);
+  P4EST_FREE (view->tree_quadrants);
+  P4EST_FREE (view->global_first_quadrant);
+  P4EST_FREE (view);
+}
+
+void
+p4est_view_preserve (p4est_t * p4est, p4est_topidx_t which_tree)
+{
+  p4est_tree_t       *tree;
+  p4est_view_t       *view;
+  sc_array_t         *copy;
+
+  if (p4est->views == NULL) {
+    return;
+  }
+  P4EST_ASSERT (0 <= which_tree &&
+                which_tree < p4est->connectivity->num_trees);
+
+  tree = p4est_tree_array_index (p4est->trees, which_tree);
+  for (view = p4est->views; view != NULL; view = view->next) {
+    if (view->owns_tree[which_tree]) {
+      continue;
+    }
+    P4EST_ASSERT (view->tree_quadrants[which_tree] == &tree->quadrants);
+    copy = sc_array_new (sizeof (p4est_quadrant_t));
+    sc_array_resize (copy, tree->quadrants.elem_count);
+    memcpy (copy->array, tree->quadrants.array,
+            tree->quadrants.elem_count * sizeof (p4est_quadrant_t));
+
+    /* publish the frozen copy before the original array is modified */
+    view->tree_quadrants[which_tree] = copy;
+    view->owns_tree[which_tree] = 1;
+  }
+}
+
+void
+p4est_view_preserve_all (p4est_t * p4est)
+{
+  p4est_topidx_t      nt;
+
+  if (p4est->views == NULL) {
+    return;
+  }
+  for (nt = 0; nt < p4est->connectivity->num_trees; ++nt) {
+    p4est_view_preserve (p4est, nt);
+  }
+}
+
 p4est_t            *
 p4est_copy (p4est_t * input, int copy_data)
 {
@@ -543,9 +971,15 @@ p4est_copy (p4est_t * input, int copy_data)
   memcpy (p4est, input, sizeof (p4est_t));
   p4est->global_first_quadrant = NULL;
   p4est->global_first_position = NULL;
+  p4est->tree_owners = NULL;
+  p4est->changes = NULL;
+  p4est->views = NULL;
   p4est->trees = NULL;
   p4est->user_data_pool = NULL;
+  p4est->user_data_arena = NULL;
   p4est->quadrant_pool = NULL;
+  p4est->context = NULL;
+  p4est->workspace = NULL;
 
   /* allocate a user data pool if necessary and a quadrant pool */
   if (copy_data && p4est->data_size > 0) {
@@ -619,6 +1053,15 @@ p4est_reset_data (p4est_t * p4est, size_t data_size,
   p4est->data_size = data_size;
   p4est->user_pointer = user_pointer;
 
+  if (doresize && p4est->user_data_arena != NULL) {
+    for (jt = 0; jt < p4est->connectivity->num_trees; ++jt) {
+      sc_array_reset ((sc_array_t *)
+                      sc_array_index (p4est->user_data_arena, (size_t) jt));
+    }
+    sc_array_destroy (p4est->user_data_arena);
+    p4est->user_data_arena = NULL;
+  }
+
   if (doresize) {
     if (p4est->user_data_pool != NULL) {
       sc_mempool_destroy (p4est->user_data_pool);
@@ -652,71 +1095,497 @@ p4est_reset_data (p4est_t * p4est, size_t data_size,
 }
 
 void
-p4est_refine (p4est_t * p4est, int refine_recursive,
-              p4est_refine_t refine_fn, p4est_init_t init_fn)
+p4est_set_data_serializer (p4est_t * p4est, p4est_pack_data_t pack_fn,
+                           p4est_unpack_data_t unpack_fn)
 {
-  p4est_refine_ext (p4est, refine_recursive, -1, refine_fn, NULL, init_fn);
+  /* either both callbacks are given or neither */
+  P4EST_ASSERT ((pack_fn != NULL) == (unpack_fn != NULL));
+
+  p4est->data_pack_fn = pack_fn;
+  p4est->data_unpack_fn = unpack_fn;
 }
 
 void
-p4est_refine_ext (p4est_t * p4est, int refine_recursive, int allowed_level,
-                  p4est_refine_t refine_fn, p4est_refine_ext_t refine_ext_fn,
-                  p4est_init_t init_fn)
+p4est_set_num_threads (p4est_t * p4est, int num_threads)
 {
-#ifdef P4EST_DEBUG
-  size_t              quadrant_pool_size, data_pool_size;
-#endif
-  int                 dorefine;
-  int                 i, maxlevel;
-  p4est_topidx_t      nt;
-  size_t              incount, current, restpos, movecount;
-  sc_list_t          *list;
-  p4est_tree_t       *tree;
-  p4est_quadrant_t   *q, *qalloc, *qpop;
-  p4est_quadrant_t   *c0, *c1, *c2, *c3;
-#ifdef P4_TO_P8
-  p4est_quadrant_t   *c4, *c5, *c6, *c7;
-#endif
-  sc_array_t         *tquadrants;
+  P4EST_ASSERT (num_threads >= 0);
 
-  if (allowed_level == 0 || (refine_fn == NULL && refine_ext_fn == NULL)) {
-    P4EST_GLOBAL_PRODUCTIONF ("Noop " P4EST_STRING
-                              "_refine with %lld total quadrants\n",
-                              (long long) p4est->global_num_quadrants);
-    return;
-  }
+  p4est->num_threads = num_threads;
+}
 
-  if (allowed_level < 0) {
-    allowed_level = P4EST_QMAXLEVEL;
-  }
-  P4EST_GLOBAL_PRODUCTIONF ("Into " P4EST_STRING
-                            "_refine with %lld total quadrants maxlevel %d\n",
-                            (long long) p4est->global_num_quadrants,
-                            allowed_level);
-  P4EST_ASSERT (p4est_is_valid (p4est));
-  P4EST_ASSERT (0 <= allowed_level && allowed_level <= P4EST_QMAXLEVEL);
+void
+p4est_set_balance_chunk (p4est_t * p4est, p4est_locidx_t balance_chunk)
+{
+  P4EST_ASSERT (balance_chunk >= 0);
 
-  if (refine_ext_fn != NULL) {
-    sc_abort_collective ("Extended refinement callback not implemented");
-  }
+  p4est->balance_chunk = balance_chunk;
+}
 
-  /*
-     q points to a quadrant that is an array member
-     qalloc is a quadrant that has been allocated through quadrant_pool
-     qpop is a quadrant that has been allocated through quadrant_pool
-     never mix these two types of quadrant pointers
+void
+p4est_set_profile_hook (p4est_t * p4est, p4est_profile_t profile_fn,
+                        void *user)
+{
+  p4est->profile_fn = profile_fn;
+  p4est->profile_user = user;
+}
 
-     The quadrant->pad8 field of list quadrants is interpreted as boolean
-     and set to true for quadrants that have already been refined.
-   */
-  list = sc_list_new (NULL);
-  p4est->local_num_quadrants = 0;
+void
+p4est_profile_fire (p4est_t * p4est, p4est_profile_phase_t phase,
+                    int is_exit)
+{
+  size_t              bytes_sent, num_peers;
+  p4est_inspect_t    *inspect = p4est->inspect;
 
-  /* loop over all local trees */
-  for (nt = p4est->first_local_tree; nt <= p4est->last_local_tree; ++nt) {
-    tree = p4est_tree_array_index (p4est->trees, nt);
-    tree->quadrants_offset = p4est->local_num_quadrants;
-    tquadrants = &tree->quadrants;
+  if (p4est->profile_fn == NULL) {
+    return;
+  }
+  P4EST_ASSERT (0 <= phase && phase < P4EST_PROFILE_NUM_PHASES);
+
+  bytes_sent = num_peers = 0;
+  if (is_exit && inspect != NULL) {
+    switch (phase) {
+    case P4EST_PROFILE_BALANCE:
+      bytes_sent = inspect->balance_comm_sent;
+      num_peers = inspect->balance_comm_nzpeers;
+      break;
+    case P4EST_PROFILE_PARTITION:
+      bytes_sent = inspect->partition_comm_sent;
+      num_peers = inspect->partition_nzpeers;
+      break;
+    case P4EST_PROFILE_GHOST:
+      bytes_sent = inspect->ghost_comm_sent;
+      num_peers = inspect->ghost_nzpeers;
+      break;
+    case P4EST_PROFILE_LNODES:
+      bytes_sent = inspect->lnodes_comm_sent;
+      num_peers = inspect->lnodes_nzpeers;
+      break;
+    default:
+      /* refinement and iteration do not communicate */
+      break;
+    }
+  }
+  p4est->profile_fn (p4est, phase, is_exit, bytes_sent, num_peers,
+                     p4est->profile_user);
+}
+
+p4est_workspace_t  *
+p4est_workspace_new (void)
+{
+  return P4EST_ALLOC_ZERO (p4est_workspace_t, 1);
+}
+
+void
+p4est_workspace_destroy (p4est_workspace_t * workspace)
+{
+  int                 i;
+
+  for (i = 0; i < P4EST_WORKSPACE_NUM_SLOTS; ++i) {
+    P4EST_ASSERT (!workspace->slot_busy[i]);
+    P4EST_FREE (workspace->slots[i]);
+  }
+  P4EST_FREE (workspace);
+}
+
+void
+p4est_workspace_attach (p4est_t * p4est, p4est_workspace_t * workspace)
+{
+  p4est->workspace = workspace;
+}
+
+void               *
+p4est_workspace_get (p4est_t * p4est, p4est_workspace_slot_t slot,
+                     size_t bytes)
+{
+  p4est_workspace_t  *workspace = p4est->workspace;
+
+  P4EST_ASSERT (0 <= slot && slot < P4EST_WORKSPACE_NUM_SLOTS);
+
+  if (workspace == NULL) {
+    return P4EST_ALLOC (char, bytes);
+  }
+  P4EST_ASSERT (!workspace->slot_busy[slot]);
+  if (workspace->slot_bytes[slot] < bytes) {
+    P4EST_FREE (workspace->slots[slot]);
+    workspace->slots[slot] = P4EST_ALLOC (char, bytes);
+    workspace->slot_bytes[slot] = bytes;
+  }
+  workspace->slot_busy[slot] = 1;
+
+  return workspace->slots[slot];
+}
+
+void
+p4est_workspace_release (p4est_t * p4est, p4est_workspace_slot_t slot,
+                         void *ptr)
+{
+  p4est_workspace_t  *workspace = p4est->workspace;
+
+  P4EST_ASSERT (0 <= slot && slot < P4EST_WORKSPACE_NUM_SLOTS);
+
+  if (workspace == NULL) {
+    P4EST_FREE (ptr);
+    return;
+  }
+  P4EST_ASSERT (ptr == NULL || ptr == workspace->slots[slot]);
+  P4EST_ASSERT (workspace->slot_busy[slot]);
+  workspace->slot_busy[slot] = 0;
+}
+
+void
+p4est_compact_data (p4est_t * p4est)
+{
+  size_t              zz;
+  char               *dest;
+  p4est_topidx_t      jt;
+  p4est_topidx_t      num_trees = p4est->connectivity->num_trees;
+  p4est_tree_t       *tree;
+  p4est_quadrant_t   *q;
+  sc_array_t         *arena, *block;
+
+  if (p4est->data_size == 0) {
+    return;
+  }
+
+  /* gather all quadrant data into fresh contiguous per-tree blocks */
+  arena = sc_array_new (sizeof (sc_array_t));
+  sc_array_resize (arena, (size_t) num_trees);
+  for (jt = 0; jt < num_trees; ++jt) {
+    sc_array_init ((sc_array_t *) sc_array_index (arena, (size_t) jt),
+                   p4est->data_size);
+  }
+  for (jt = p4est->first_local_tree; jt <= p4est->last_local_tree; ++jt) {
+    tree = p4est_tree_array_index (p4est->trees, jt);
+    block = (sc_array_t *) sc_array_index (arena, (size_t) jt);
+    sc_array_resize (block, tree->quadrants.elem_count);
+    for (zz = 0; zz < tree->quadrants.elem_count; ++zz) {
+      q = p4est_quadrant_array_index (&tree->quadrants, zz);
+      dest = block->array + zz * p4est->data_size;
+      memcpy (dest, q->p.user_data, p4est->data_size);
+      q->p.user_data = dest;
+    }
+  }
+
+  /* reclaim all previous allocations wholesale */
+  sc_mempool_destroy (p4est->user_data_pool);
+  p4est->user_data_pool = sc_mempool_new (p4est->data_size);
+  if (p4est->user_data_arena != NULL) {
+    for (jt = 0; jt < num_trees; ++jt) {
+      sc_array_reset ((sc_array_t *)
+                      sc_array_index (p4est->user_data_arena, (size_t) jt));
+    }
+    sc_array_destroy (p4est->user_data_arena);
+  }
+  p4est->user_data_arena = arena;
+}
+
+void
+p4est_compact_data_blocked (p4est_t * p4est)
+{
+  /* a block spans 2^shift cells per axis, so its aligned subtree holds
+   * P4EST_CHILDREN^shift slots; absent cells become padding */
+  const int           shift = 2;
+  const size_t        block_slots =
+    ((size_t) 1) << (P4EST_DIM * 2 /* shift */ );
+  int                 have_root;
+  size_t              zz, filled, base;
+  size_t             *slots;
+  uint64_t            id;
+  char               *dest;
+  p4est_topidx_t      jt;
+  p4est_topidx_t      num_trees = p4est->connectivity->num_trees;
+  p4est_tree_t       *tree;
+  p4est_quadrant_t    root, tmp;
+  p4est_quadrant_t   *q;
+  sc_array_t         *arena, *block;
+
+  if (p4est->data_size == 0) {
+    return;
+  }
+
+  arena = sc_array_new (sizeof (sc_array_t));
+  sc_array_resize (arena, (size_t) num_trees);
+  for (jt = 0; jt < num_trees; ++jt) {
+    sc_array_init ((sc_array_t *) sc_array_index (arena, (size_t) jt),
+                   p4est->data_size);
+  }
+  P4EST_QUADRANT_INIT (&root);
+  P4EST_QUADRANT_INIT (&tmp);
+  for (jt = p4est->first_local_tree; jt <= p4est->last_local_tree; ++jt) {
+    tree = p4est_tree_array_index (p4est->trees, jt);
+    block = (sc_array_t *) sc_array_index (arena, (size_t) jt);
+    slots = P4EST_ALLOC (size_t, tree->quadrants.elem_count);
+
+    /* assign each quadrant the slot of its first cell within the block
+     * rooted at its aligned ancestor subtree.  quadrants deeper than the
+     * block resolution close the block and open a finer one, so every
+     * slot within a block is taken at most once */
+    have_root = 0;
+    filled = base = 0;
+    for (zz = 0; zz < tree->quadrants.elem_count; ++zz) {
+      q = p4est_quadrant_array_index (&tree->quadrants, zz);
+      if (!have_root || (int) q->level > (int) root.level + shift ||
+          !p4est_quadrant_is_ancestor (&root, q)) {
+        if (q->level == 0) {
+          /* the quadrant is the whole tree and roots its own block */
+          root = *q;
+        }
+        else {
+          p4est_quadrant_ancestor (q, SC_MAX ((int) q->level - shift, 0),
+                                   &root);
+        }
+        have_root = 1;
+        base = filled;
+        filled += block_slots;
+      }
+      tmp = *q;
+      tmp.level = (int8_t) ((int) root.level + shift);
+      id = p4est_quadrant_linear_id (&tmp, (int) tmp.level);
+      slots[zz] = base + (size_t) (id & (uint64_t) (block_slots - 1));
+    }
+
+    /* copy the data into its slots; the padding stays uninitialized */
+    sc_array_resize (block, filled);
+    for (zz = 0; zz < tree->quadrants.elem_count; ++zz) {
+      q = p4est_quadrant_array_index (&tree->quadrants, zz);
+      dest = block->array + slots[zz] * p4est->data_size;
+      memcpy (dest, q->p.user_data, p4est->data_size);
+      q->p.user_data = dest;
+    }
+    P4EST_FREE (slots);
+  }
+
+  /* reclaim all previous allocations wholesale */
+  sc_mempool_destroy (p4est->user_data_pool);
+  p4est->user_data_pool = sc_mempool_new (p4est->data_size);
+  if (p4est->user_data_arena != NULL) {
+    for (jt = 0; jt < num_trees; ++jt) {
+      sc_array_reset ((sc_array_t *)
+                      sc_array_index (p4est->user_data_arena, (size_t) jt));
+    }
+    sc_array_destroy (p4est->user_data_arena);
+  }
+  p4est->user_data_arena = arena;
+}
+
+void
+p4est_uncompact_data (p4est_t * p4est)
+{
+  size_t              zz;
+  void               *dest;
+  p4est_topidx_t      jt;
+  p4est_topidx_t      num_trees = p4est->connectivity->num_trees;
+  p4est_tree_t       *tree;
+  p4est_quadrant_t   *q;
+  sc_mempool_t       *pool;
+
+  if (p4est->user_data_arena == NULL) {
+    return;
+  }
+  P4EST_ASSERT (p4est->data_size > 0);
+
+  /* move all quadrant data into a fresh pool, then drop old storage */
+  pool = sc_mempool_new (p4est->data_size);
+  for (jt = p4est->first_local_tree; jt <= p4est->last_local_tree; ++jt) {
+    tree = p4est_tree_array_index (p4est->trees, jt);
+    for (zz = 0; zz < tree->quadrants.elem_count; ++zz) {
+      q = p4est_quadrant_array_index (&tree->quadrants, zz);
+      dest = sc_mempool_alloc (pool);
+      memcpy (dest, q->p.user_data, p4est->data_size);
+      q->p.user_data = dest;
+    }
+  }
+  sc_mempool_destroy (p4est->user_data_pool);
+  p4est->user_data_pool = pool;
+  for (jt = 0; jt < num_trees; ++jt) {
+    sc_array_reset ((sc_array_t *)
+                    sc_array_index (p4est->user_data_arena, (size_t) jt));
+  }
+  sc_array_destroy (p4est->user_data_arena);
+  p4est->user_data_arena = NULL;
+}
+
+void
+p4est_refine (p4est_t * p4est, int refine_recursive,
+              p4est_refine_t refine_fn, p4est_init_t init_fn)
+{
+  p4est_refine_ext (p4est, refine_recursive, -1, refine_fn, NULL, init_fn,
+                    NULL);
+}
+
+/** Refine a tree in one linear sweep without recursion.
+ * The callback is invoked exactly once per input quadrant.  The marked
+ * quadrants are counted first, the quadrant array is resized exactly once,
+ * and the output is written back to front so no list machinery is needed.
+ * \param [in,out] tree   The tree whose quadrants are refined in place.
+ * \return                The number of quadrants that have been refined.
+ */
+static size_t
+p4est_refine_singlepass (p4est_t * p4est, p4est_topidx_t nt,
+                         p4est_tree_t * tree, int allowed_level,
+                         p4est_refine_t refine_fn, p4est_init_t init_fn,
+                         p4est_replace_t replace_fn)
+{
+  int                 i, maxlevel;
+  size_t              zz, incount, outcount, refcount;
+  size_t              read, write;
+  uint8_t            *marks;
+  p4est_quadrant_t    parent, *q, *c[P4EST_CHILDREN];
+  p4est_quadrant_t   *fam[1];
+  sc_array_t         *tquadrants = &tree->quadrants;
+
+  /* first pass: query the callback and count the marked quadrants */
+  incount = tquadrants->elem_count;
+  marks = P4EST_ALLOC (uint8_t, incount);
+  refcount = 0;
+#ifdef P4EST_OPENMP
+#pragma omp parallel for private (q) reduction (+:refcount)
+#endif
+  for (zz = 0; zz < incount; ++zz) {
+    q = p4est_quadrant_array_index (tquadrants, zz);
+    marks[zz] = (uint8_t) (((int) q->level < allowed_level) &&
+                           refine_fn (p4est, nt, q));
+    refcount += (size_t) marks[zz];
+  }
+  if (refcount == 0) {
+    P4EST_FREE (marks);
+    return 0;
+  }
+
+  /* resize the array exactly once and fill it back to front */
+  outcount = incount + (P4EST_CHILDREN - 1) * refcount;
+  sc_array_resize (tquadrants, outcount);
+  read = incount;
+  write = outcount;
+  while (read > 0) {
+    q = p4est_quadrant_array_index (tquadrants, --read);
+    if (marks[read]) {
+      parent = *q;
+      if (replace_fn == NULL) {
+        p4est_quadrant_free_data (p4est, &parent);
+      }
+      tree->quadrants_per_level[parent.level] -= 1;
+      write -= P4EST_CHILDREN;
+      for (i = 0; i < P4EST_CHILDREN; ++i) {
+        c[i] = p4est_quadrant_array_index (tquadrants, write + (size_t) i);
+      }
+#ifdef P4_TO_P8
+      p8est_quadrant_children (&parent, c[0], c[1], c[2], c[3],
+                               c[4], c[5], c[6], c[7]);
+#else
+      p4est_quadrant_children (&parent, c[0], c[1], c[2], c[3]);
+#endif
+      for (i = 0; i < P4EST_CHILDREN; ++i) {
+        p4est_quadrant_init_data (p4est, nt, c[i], init_fn);
+      }
+      if (replace_fn != NULL) {
+        /* the parent's user data stays valid until the callback returns */
+        fam[0] = &parent;
+        replace_fn (p4est, nt, 1, fam, P4EST_CHILDREN, c);
+        p4est_quadrant_free_data (p4est, &parent);
+      }
+      tree->quadrants_per_level[parent.level + 1] += P4EST_CHILDREN;
+    }
+    else {
+      P4EST_ASSERT (write > read);
+      *p4est_quadrant_array_index (tquadrants, --write) = *q;
+    }
+  }
+  P4EST_ASSERT (write == 0);
+  P4EST_FREE (marks);
+
+  /* recompute the maximum level from the per-level counters */
+  maxlevel = 0;
+  for (i = 0; i <= P4EST_QMAXLEVEL; ++i) {
+    P4EST_ASSERT (tree->quadrants_per_level[i] >= 0);
+    if (tree->quadrants_per_level[i] > 0) {
+      maxlevel = i;
+    }
+  }
+  tree->maxlevel = (int8_t) maxlevel;
+
+  return refcount;
+}
+
+/** Implementation of p4est_refine_ext with optional fused local balance.
+ * With \a balance_local true, every tree that gains quadrants is run
+ * through p4est_balance_subtree right after its refinement sweep, while
+ * its quadrant array is still in cache.  The caller is then expected to
+ * complete the 2:1 condition with a balance whose local pass is skipped.
+ */
+static void
+p4est_refine_fused (p4est_t * p4est, int refine_recursive, int allowed_level,
+                    p4est_refine_t refine_fn,
+                    p4est_refine_ext_t refine_ext_fn,
+                    p4est_init_t init_fn, p4est_replace_t replace_fn,
+                    int balance_local, p4est_connect_type_t btype)
+{
+#ifdef P4EST_DEBUG
+  size_t              quadrant_pool_size, data_pool_size;
+#endif
+  int                 dorefine;
+  int                 i, maxlevel;
+  p4est_topidx_t      nt;
+  size_t              incount, current, restpos, movecount;
+  size_t              tread, pcount;
+  sc_array_t          pending, toread;
+  p4est_tree_t       *tree;
+  p4est_quadrant_t    parent, qq;
+  p4est_quadrant_t   *q, *qalloc;
+  p4est_quadrant_t   *c0, *c1, *c2, *c3;
+#ifdef P4_TO_P8
+  p4est_quadrant_t   *c4, *c5, *c6, *c7;
+#endif
+  p4est_quadrant_t   *fam[1], *cview[P4EST_CHILDREN];
+  sc_array_t         *tquadrants;
+
+  p4est_profile_fire (p4est, P4EST_PROFILE_REFINE, 0);
+
+  if (allowed_level == 0 || (refine_fn == NULL && refine_ext_fn == NULL)) {
+    P4EST_GLOBAL_PRODUCTIONF ("Noop " P4EST_STRING
+                              "_refine with %lld total quadrants\n",
+                              (long long) p4est->global_num_quadrants);
+    p4est_profile_fire (p4est, P4EST_PROFILE_REFINE, 1);
+    return;
+  }
+
+  if (allowed_level < 0) {
+    allowed_level = P4EST_QMAXLEVEL;
+  }
+  P4EST_GLOBAL_PRODUCTIONF ("Into " P4EST_STRING
+                            "_refine with %lld total quadrants maxlevel %d\n",
+                            (long long) p4est->global_num_quadrants,
+                            allowed_level);
+  P4EST_ASSERT (p4est_is_valid (p4est));
+  P4EST_ASSERT (0 <= allowed_level && allowed_level <= P4EST_QMAXLEVEL);
+  ++p4est->revision;
+
+  if (refine_ext_fn != NULL) {
+    sc_abort_collective ("Extended refinement callback not implemented");
+  }
+
+  /*
+     q points to a quadrant that is an array member
+     The pending stack and the toread queue hold quadrants by value in
+     two growable buffers: the stack holds freshly created children to
+     be examined next and the queue holds input quadrants copied out of
+     the array to make room for writing.  Pops serve the stack first and
+     the queue in order afterwards, which reproduces the semantics of
+     the former linked list without one allocation per pending quadrant.
+
+     The quadrant->pad8 field of pending quadrants is interpreted as boolean
+     and set to true for quadrants that have already been refined.
+   */
+  sc_array_init (&pending, sizeof (p4est_quadrant_t));
+  sc_array_init (&toread, sizeof (p4est_quadrant_t));
+  p4est->local_num_quadrants = 0;
+
+  /* loop over all local trees */
+  for (nt = p4est->first_local_tree; nt <= p4est->last_local_tree; ++nt) {
+    p4est_view_preserve (p4est, nt);
+    tree = p4est_tree_array_index (p4est->trees, nt);
+    tree->quadrants_offset = p4est->local_num_quadrants;
+    tquadrants = &tree->quadrants;
 #ifdef P4EST_DEBUG
     quadrant_pool_size = p4est->quadrant_pool->elem_count;
     data_pool_size = 0;
@@ -729,6 +1598,34 @@ p4est_refine_ext (p4est_t * p4est, int refine_recursive, int allowed_level,
     P4EST_VERBOSEF ("Into refine tree %lld with %llu\n", (long long) nt,
                     (unsigned long long) tquadrants->elem_count);
 
+    if (!refine_recursive) {
+      /* non-recursive refinement never revisits new children, so the
+         single-pass sweep produces the identical result without lists */
+      incount = tquadrants->elem_count;
+      if (p4est_refine_singlepass (p4est, nt, tree, allowed_level,
+                                   refine_fn, init_fn, replace_fn) > 0) {
+        if (balance_local && !p4est_tree_is_uniform (tree)) {
+          /* a level-homogeneous tree is already balanced internally */
+          p4est_balance_subtree (p4est, btype, nt, init_fn);
+        }
+        p4est_record_change (p4est, nt, 0,
+                             (p4est_locidx_t) tquadrants->elem_count);
+      }
+      p4est->local_num_quadrants += tquadrants->elem_count;
+
+      P4EST_ASSERT (quadrant_pool_size == p4est->quadrant_pool->elem_count);
+      if (p4est->user_data_pool != NULL && p4est->user_data_arena == NULL) {
+        P4EST_ASSERT (data_pool_size + tquadrants->elem_count ==
+                      p4est->user_data_pool->elem_count + incount);
+      }
+      P4EST_ASSERT (p4est_tree_is_sorted (tree));
+      P4EST_ASSERT (p4est_tree_is_complete (tree));
+
+      P4EST_VERBOSEF ("Done refine tree %lld now %llu\n", (long long) nt,
+                      (unsigned long long) tquadrants->elem_count);
+      continue;
+    }
+
     /* reset the quadrant counters */
     maxlevel = 0;
     for (i = 0; i <= P4EST_QMAXLEVEL; ++i) {
@@ -754,45 +1651,61 @@ p4est_refine_ext (p4est_t * p4est, int refine_recursive, int allowed_level,
       continue;
     }
 
-    /* now we have a quadrant to refine, prepend it to the list */
-    qalloc = p4est_quadrant_mempool_alloc (p4est->quadrant_pool);
-    *qalloc = *q;               /* never prepend array members directly */
-    qalloc->pad8 = 0;           /* this quadrant has not been refined yet */
-    sc_list_prepend (list, qalloc);     /* only newly allocated quadrants */
+    /* now we have a quadrant to refine, push it on the pending stack */
+    qq = *q;                    /* never push array members directly */
+    qq.pad8 = 0;                /* this quadrant has not been refined yet */
+    *(p4est_quadrant_t *) sc_array_push (&pending) = qq;
 
     /*
        current points to the next array member to write
        restpos points to the next array member to read
      */
     restpos = current + 1;
-
-    /* run through the list and refine recursively */
-    while (list->elem_count > 0) {
-      qpop = p4est_quadrant_list_pop (list);
+    tread = 0;
+
+    /* run through the pending quadrants and refine recursively */
+    while (pending.elem_count > 0 || tread < toread.elem_count) {
+      if (pending.elem_count > 0) {
+        qq = *(p4est_quadrant_t *)
+          sc_array_index (&pending, pending.elem_count - 1);
+        sc_array_resize (&pending, pending.elem_count - 1);
+      }
+      else {
+        qq = *(p4est_quadrant_t *) sc_array_index (&toread, tread++);
+      }
       if (dorefine ||
-          ((refine_recursive || !qpop->pad8) &&
-           (int) qpop->level < allowed_level &&
-           refine_fn (p4est, nt, qpop))) {
+          ((refine_recursive || !qq.pad8) &&
+           (int) qq.level < allowed_level && refine_fn (p4est, nt, &qq))) {
         dorefine = 0;
         sc_array_resize (tquadrants,
                          tquadrants->elem_count + P4EST_CHILDREN - 1);
 
-        /* compute children and prepend them to the list */
-        p4est_quadrant_free_data (p4est, qpop);
-        c0 = qpop;
-        c1 = p4est_quadrant_mempool_alloc (p4est->quadrant_pool);
-        c2 = p4est_quadrant_mempool_alloc (p4est->quadrant_pool);
-        c3 = p4est_quadrant_mempool_alloc (p4est->quadrant_pool);
+        /* compute children directly into fresh pending slots; the first
+           child goes last so that it is popped first */
+        parent = qq;
+        if (replace_fn == NULL) {
+          p4est_quadrant_free_data (p4est, &parent);
+        }
+        pcount = pending.elem_count;
+        sc_array_resize (&pending, pcount + P4EST_CHILDREN);
+        c0 = (p4est_quadrant_t *)
+          sc_array_index (&pending, pcount + P4EST_CHILDREN - 1);
+        c1 = (p4est_quadrant_t *)
+          sc_array_index (&pending, pcount + P4EST_CHILDREN - 2);
+        c2 = (p4est_quadrant_t *)
+          sc_array_index (&pending, pcount + P4EST_CHILDREN - 3);
+        c3 = (p4est_quadrant_t *)
+          sc_array_index (&pending, pcount + P4EST_CHILDREN - 4);
 
 #ifdef P4_TO_P8
-        c4 = p4est_quadrant_mempool_alloc (p4est->quadrant_pool);
-        c5 = p4est_quadrant_mempool_alloc (p4est->quadrant_pool);
-        c6 = p4est_quadrant_mempool_alloc (p4est->quadrant_pool);
-        c7 = p4est_quadrant_mempool_alloc (p4est->quadrant_pool);
+        c4 = (p4est_quadrant_t *) sc_array_index (&pending, pcount + 3);
+        c5 = (p4est_quadrant_t *) sc_array_index (&pending, pcount + 2);
+        c6 = (p4est_quadrant_t *) sc_array_index (&pending, pcount + 1);
+        c7 = (p4est_quadrant_t *) sc_array_index (&pending, pcount);
 
-        p8est_quadrant_children (qpop, c0, c1, c2, c3, c4, c5, c6, c7);
+        p8est_quadrant_children (&parent, c0, c1, c2, c3, c4, c5, c6, c7);
 #else
-        p4est_quadrant_children (qpop, c0, c1, c2, c3);
+        p4est_quadrant_children (&parent, c0, c1, c2, c3);
 #endif
         p4est_quadrant_init_data (p4est, nt, c0, init_fn);
         p4est_quadrant_init_data (p4est, nt, c1, init_fn);
@@ -806,16 +1719,23 @@ p4est_refine_ext (p4est_t * p4est, int refine_recursive, int allowed_level,
         p4est_quadrant_init_data (p4est, nt, c6, init_fn);
         p4est_quadrant_init_data (p4est, nt, c7, init_fn);
         c4->pad8 = c5->pad8 = c6->pad8 = c7->pad8 = 1;
-
-        sc_list_prepend (list, c7);
-        sc_list_prepend (list, c6);
-        sc_list_prepend (list, c5);
-        sc_list_prepend (list, c4);
 #endif
-        sc_list_prepend (list, c3);
-        sc_list_prepend (list, c2);
-        sc_list_prepend (list, c1);
-        sc_list_prepend (list, c0);
+        if (replace_fn != NULL) {
+          /* the parent's user data stays valid until the callback returns */
+          fam[0] = &parent;
+          cview[0] = c0;
+          cview[1] = c1;
+          cview[2] = c2;
+          cview[3] = c3;
+#ifdef P4_TO_P8
+          cview[4] = c4;
+          cview[5] = c5;
+          cview[6] = c6;
+          cview[7] = c7;
+#endif
+          replace_fn (p4est, nt, 1, fam, P4EST_CHILDREN, cview);
+          p4est_quadrant_free_data (p4est, &parent);
+        }
       }
       else {
         /* need to make room in the array to store this new quadrant */
@@ -823,10 +1743,9 @@ p4est_refine_ext (p4est_t * p4est, int refine_recursive, int allowed_level,
           movecount = SC_MIN (incount - restpos, number_toread_quadrants);
           while (movecount > 0) {
             q = p4est_quadrant_array_index (tquadrants, restpos);
-            qalloc = p4est_quadrant_mempool_alloc (p4est->quadrant_pool);
-            *qalloc = *q;       /* never append array members directly */
+            qalloc = (p4est_quadrant_t *) sc_array_push (&toread);
+            *qalloc = *q;       /* never enqueue array members directly */
             qalloc->pad8 = 0;   /* has not been refined yet */
-            sc_list_append (list, qalloc);      /* only newly allocated quadrants */
             --movecount;
             ++restpos;
           }
@@ -834,21 +1753,32 @@ p4est_refine_ext (p4est_t * p4est, int refine_recursive, int allowed_level,
 
         /* store new quadrant and update counters */
         q = p4est_quadrant_array_index (tquadrants, current);
-        *q = *qpop;
-        maxlevel = SC_MAX (maxlevel, (int) qpop->level);
-        ++tree->quadrants_per_level[qpop->level];
+        *q = qq;
+        maxlevel = SC_MAX (maxlevel, (int) qq.level);
+        ++tree->quadrants_per_level[qq.level];
         ++current;
-        sc_mempool_free (p4est->quadrant_pool, qpop);
       }
     }
+    P4EST_ASSERT (pending.elem_count == 0);
+    P4EST_ASSERT (tread == toread.elem_count);
+    sc_array_resize (&toread, 0);
     tree->maxlevel = (int8_t) maxlevel;
-    p4est->local_num_quadrants += tquadrants->elem_count;
-
     P4EST_ASSERT (restpos == incount);
     P4EST_ASSERT (current == tquadrants->elem_count);
-    P4EST_ASSERT (list->first == NULL && list->last == NULL);
+    if (balance_local && tquadrants->elem_count > incount &&
+        !p4est_tree_is_uniform (tree)) {
+      /* repair the 2:1 condition while the tree is still in cache;
+         a level-homogeneous tree needs no repair */
+      p4est_balance_subtree (p4est, btype, nt, init_fn);
+    }
+    p4est->local_num_quadrants += tquadrants->elem_count;
+    if (tquadrants->elem_count > incount) {
+      p4est_record_change (p4est, nt, 0,
+                           (p4est_locidx_t) tquadrants->elem_count);
+    }
+
     P4EST_ASSERT (quadrant_pool_size == p4est->quadrant_pool->elem_count);
-    if (p4est->user_data_pool != NULL) {
+    if (p4est->user_data_pool != NULL && p4est->user_data_arena == NULL) {
       P4EST_ASSERT (data_pool_size + tquadrants->elem_count ==
                     p4est->user_data_pool->elem_count + incount);
     }
@@ -859,14 +1789,9 @@ p4est_refine_ext (p4est_t * p4est, int refine_recursive, int allowed_level,
     P4EST_VERBOSEF ("Done refine tree %lld now %llu\n", (long long) nt,
                     (unsigned long long) tquadrants->elem_count);
   }
-  if (p4est->last_local_tree >= 0) {
-    for (; nt < p4est->connectivity->num_trees; ++nt) {
-      tree = p4est_tree_array_index (p4est->trees, nt);
-      tree->quadrants_offset = p4est->local_num_quadrants;
-    }
-  }
 
-  sc_list_destroy (list);
+  sc_array_reset (&pending);
+  sc_array_reset (&toread);
 
   /* compute global number of quadrants */
   p4est_comm_count_quadrants (p4est);
@@ -875,24 +1800,64 @@ p4est_refine_ext (p4est_t * p4est, int refine_recursive, int allowed_level,
   P4EST_GLOBAL_PRODUCTIONF ("Done " P4EST_STRING
                             "_refine with %lld total quadrants\n",
                             (long long) p4est->global_num_quadrants);
+  p4est_profile_fire (p4est, P4EST_PROFILE_REFINE, 1);
+}
+
+void
+p4est_refine_ext (p4est_t * p4est, int refine_recursive, int allowed_level,
+                  p4est_refine_t refine_fn, p4est_refine_ext_t refine_ext_fn,
+                  p4est_init_t init_fn, p4est_replace_t replace_fn)
+{
+  p4est_refine_fused (p4est, refine_recursive, allowed_level, refine_fn,
+                      refine_ext_fn, init_fn, replace_fn, 0,
+                      P4EST_CONNECT_FULL);
+}
+
+void
+p4est_refine_balance (p4est_t * p4est, int refine_recursive,
+                      int allowed_level, p4est_connect_type_t btype,
+                      p4est_refine_t refine_fn, p4est_init_t init_fn)
+{
+  int8_t             *changed_trees;
+
+  p4est_refine_fused (p4est, refine_recursive, allowed_level, refine_fn,
+                      NULL, init_fn, NULL, 1, btype);
+
+  /* every local tree is balanced already: with no tree flagged as changed
+   * the incremental balance skips its local pass and only performs the
+   * boundary exchange and cross-tree propagation */
+  changed_trees = P4EST_ALLOC_ZERO (int8_t, p4est->connectivity->num_trees);
+  p4est_balance_incremental (p4est, btype, init_fn, changed_trees);
+  P4EST_FREE (changed_trees);
 }
 
 void
 p4est_coarsen (p4est_t * p4est, int coarsen_recursive,
                p4est_coarsen_t coarsen_fn, p4est_init_t init_fn)
+{
+  p4est_coarsen_ext (p4est, coarsen_recursive, coarsen_fn, init_fn, NULL);
+}
+
+void
+p4est_coarsen_ext (p4est_t * p4est, int coarsen_recursive,
+                   p4est_coarsen_t coarsen_fn, p4est_init_t init_fn,
+                   p4est_replace_t replace_fn)
 {
 #ifdef P4EST_DEBUG
   size_t              data_pool_size;
 #endif
   int                 i, maxlevel;
   int                 couldbegood;
-  size_t              zz;
+  size_t              zz, zorig;
   size_t              incount, removed;
   size_t              window, start, length, cidz;
+  uint8_t            *marks;
   p4est_locidx_t      num_quadrants, prev_offset;
   p4est_topidx_t      jt;
   p4est_tree_t       *tree;
+  p4est_quadrant_t    firstchild;
   p4est_quadrant_t   *c[P4EST_CHILDREN];
+  p4est_quadrant_t   *outg[P4EST_CHILDREN], *inc[1];
   p4est_quadrant_t   *cfirst, *clast;
   sc_array_t         *tquadrants;
 
@@ -900,10 +1865,12 @@ p4est_coarsen (p4est_t * p4est, int coarsen_recursive,
                             "_coarsen with %lld total quadrants\n",
                             (long long) p4est->global_num_quadrants);
   P4EST_ASSERT (p4est_is_valid (p4est));
+  ++p4est->revision;
 
   /* loop over all local trees */
   prev_offset = 0;
   for (jt = p4est->first_local_tree; jt <= p4est->last_local_tree; ++jt) {
+    p4est_view_preserve (p4est, jt);
     tree = p4est_tree_array_index (p4est->trees, jt);
     tquadrants = &tree->quadrants;
 #ifdef P4EST_DEBUG
@@ -918,6 +1885,59 @@ p4est_coarsen (p4est_t * p4est, int coarsen_recursive,
     P4EST_VERBOSEF ("Into coarsen tree %lld with %llu\n", (long long) jt,
                     (unsigned long long) tquadrants->elem_count);
 
+    marks = NULL;
+    zorig = 0;
+    if (!coarsen_recursive) {
+      /* Since siblings are contiguous in Morton order, one linear scan
+         comparing parent prefixes finds every family: a run of
+         P4EST_CHILDREN quadrants of equal level and equal coordinates
+         outside the level bit is exactly the full set of children. */
+      const p4est_quadrant_t *sq = (p4est_quadrant_t *) tquadrants->array;
+      size_t              run;
+      p4est_qcoord_t      pmask;
+
+      incount = tquadrants->elem_count;
+      marks = P4EST_ALLOC_ZERO (uint8_t, incount);
+      run = 1;
+      for (zz = 1; zz < incount; ++zz) {
+        pmask = ~P4EST_QUADRANT_LEN (sq[zz].level);
+        if (sq[zz].level == sq[zz - 1].level &&
+            (((sq[zz].x ^ sq[zz - 1].x) |
+              (sq[zz].y ^ sq[zz - 1].y)
+#ifdef P4_TO_P8
+              | (sq[zz].z ^ sq[zz - 1].z)
+#endif
+             ) & pmask) == 0) {
+          if (++run == P4EST_CHILDREN) {
+            marks[zz + 1 - P4EST_CHILDREN] = 2;
+            run = 1;
+          }
+        }
+        else {
+          run = 1;
+        }
+      }
+
+      /* query the callback for all detected families so the compaction
+         sweep below runs without any callback invocations */
+#ifdef P4EST_OPENMP
+#pragma omp parallel for schedule (static)
+#endif
+      for (zz = 0; zz < incount; ++zz) {
+        int                 k;
+        p4est_quadrant_t   *f[P4EST_CHILDREN];
+
+        if (marks[zz] != 2) {
+          continue;
+        }
+        for (k = 0; k < P4EST_CHILDREN; ++k) {
+          f[k] = p4est_quadrant_array_index (tquadrants, zz + (size_t) k);
+        }
+        P4EST_ASSERT (p4est_quadrant_is_familypv (f));
+        marks[zz] = (uint8_t) (coarsen_fn (p4est, jt, f) != 0);
+      }
+    }
+
     /* state information */
     window = 0;                 /* start position of sliding window in array */
     start = 1;                  /* start position of hole in window/array */
@@ -929,8 +1949,8 @@ p4est_coarsen (p4est_t * p4est, int coarsen_recursive,
       P4EST_ASSERT (window < start);
 
       cidz = incount;
-      couldbegood = 1;
-      for (zz = 0; zz < P4EST_CHILDREN; ++zz) {
+      couldbegood = (marks == NULL || marks[zorig]);
+      for (zz = 0; couldbegood && zz < P4EST_CHILDREN; ++zz) {
         c[zz] = (window + zz < start) ?
           p4est_quadrant_array_index (tquadrants, window + zz) :
           p4est_quadrant_array_index (tquadrants, window + length + zz);
@@ -941,15 +1961,33 @@ p4est_coarsen (p4est_t * p4est, int coarsen_recursive,
         }
       }
       if (couldbegood && p4est_quadrant_is_familypv (c) &&
-          coarsen_fn (p4est, jt, c)) {
+          (marks == NULL ? coarsen_fn (p4est, jt, c) : (int) marks[zorig])) {
         /* coarsen this family of quadrants */
-        for (zz = 0; zz < P4EST_CHILDREN; ++zz) {
-          p4est_quadrant_free_data (p4est, c[zz]);
+        if (replace_fn == NULL) {
+          for (zz = 0; zz < P4EST_CHILDREN; ++zz) {
+            p4est_quadrant_free_data (p4est, c[zz]);
+          }
+        }
+        else {
+          /* keep the first child beyond its overwrite by the parent */
+          firstchild = *c[0];
         }
         tree->quadrants_per_level[c[0]->level] -= P4EST_CHILDREN;
         cfirst = c[0];
         p4est_quadrant_parent (c[0], cfirst);
         p4est_quadrant_init_data (p4est, jt, cfirst, init_fn);
+        if (replace_fn != NULL) {
+          /* the children's user data stays valid until the callback returns */
+          outg[0] = &firstchild;
+          for (zz = 1; zz < P4EST_CHILDREN; ++zz) {
+            outg[zz] = c[zz];
+          }
+          inc[0] = cfirst;
+          replace_fn (p4est, jt, P4EST_CHILDREN, outg, 1, inc);
+          for (zz = 0; zz < P4EST_CHILDREN; ++zz) {
+            p4est_quadrant_free_data (p4est, outg[zz]);
+          }
+        }
         tree->quadrants_per_level[cfirst->level] += 1;
         p4est->local_num_quadrants -= P4EST_CHILDREN - 1;
         removed += P4EST_CHILDREN - 1;
@@ -957,6 +1995,7 @@ p4est_coarsen (p4est_t * p4est, int coarsen_recursive,
         cidz = (size_t) p4est_quadrant_child_id (cfirst);
         start = window + 1;
         length += P4EST_CHILDREN - 1;
+        zorig += P4EST_CHILDREN - 1;
       }
 
       if (cidz <= window && coarsen_recursive) {
@@ -964,6 +2003,7 @@ p4est_coarsen (p4est_t * p4est, int coarsen_recursive,
       }
       else {
         ++window;
+        ++zorig;
         if (window == start && start + length < incount) {
           if (length > 0) {
             cfirst = p4est_quadrant_array_index (tquadrants, start);
@@ -984,6 +2024,10 @@ p4est_coarsen (p4est_t * p4est, int coarsen_recursive,
       }
       sc_array_resize (tquadrants, incount - length);
     }
+    if (removed > 0) {
+      p4est_record_change (p4est, jt, 0,
+                           (p4est_locidx_t) tquadrants->elem_count);
+    }
 
     /* compute maximum level */
     maxlevel = 0;
@@ -1002,23 +2046,21 @@ p4est_coarsen (p4est_t * p4est, int coarsen_recursive,
     /* do some sanity checks */
     P4EST_ASSERT (num_quadrants == (p4est_locidx_t) tquadrants->elem_count);
     P4EST_ASSERT (tquadrants->elem_count == incount - removed);
-    if (p4est->user_data_pool != NULL) {
+    if (p4est->user_data_pool != NULL && p4est->user_data_arena == NULL) {
       P4EST_ASSERT (data_pool_size - removed ==
                     p4est->user_data_pool->elem_count);
     }
     P4EST_ASSERT (p4est_tree_is_sorted (tree));
     P4EST_ASSERT (p4est_tree_is_complete (tree));
 
+    if (marks != NULL) {
+      P4EST_FREE (marks);
+    }
+
     /* final log message for this tree */
     P4EST_VERBOSEF ("Done coarsen tree %lld now %llu\n", (long long) jt,
                     (unsigned long long) tquadrants->elem_count);
   }
-  if (p4est->last_local_tree >= 0) {
-    for (; jt < p4est->connectivity->num_trees; ++jt) {
-      tree = p4est_tree_array_index (p4est->trees, jt);
-      tree->quadrants_offset = p4est->local_num_quadrants;
-    }
-  }
 
   /* compute global number of quadrants */
   p4est_comm_count_quadrants (p4est);
@@ -1132,9 +2174,59 @@ p4est_balance_response (p4est_t * p4est, p4est_balance_peer_t * peer,
   }
 }
 
+/** Merge one batch of received quadrants into borders or the local trees.
+ * Quadrants whose tree lies outside the local range are ignored; these
+ * are corner/edge quadrants from the second pass of balance.
+ * Calling this as the loads arrive overlaps the merge with communication.
+ */
+static void
+p4est_balance_merge (p4est_t * p4est, sc_array_t * incoming,
+                     sc_array_t * borders, p4est_init_t init_fn)
+{
+  const p4est_topidx_t first_tree = p4est->first_local_tree;
+  const p4est_topidx_t last_tree = p4est->last_local_tree;
+  size_t              zz;
+  p4est_topidx_t      qtree;
+  p4est_tree_t       *tree;
+  p4est_quadrant_t   *q, *s;
+  sc_array_t         *qarray;
+
+  for (zz = 0; zz < incoming->elem_count; ++zz) {
+    s = p4est_quadrant_array_index (incoming, zz);
+    P4EST_ASSERT (p4est_quadrant_is_extended (s));
+    qtree = s->p.piggy2.which_tree;
+    if (qtree < first_tree || qtree > last_tree) {
+      continue;
+    }
+    if (borders == NULL) {
+      tree = p4est_tree_array_index (p4est->trees, qtree);
+      q = p4est_quadrant_array_push (&tree->quadrants);
+      *q = *s;
+      ++tree->quadrants_per_level[q->level];
+      tree->maxlevel = (int8_t) SC_MAX (tree->maxlevel, q->level);
+      ++p4est->local_num_quadrants;
+      p4est_quadrant_init_data (p4est, qtree, q, init_fn);
+    }
+    else {
+      qarray = (sc_array_t *) sc_array_index (borders,
+                                              (int) (qtree - first_tree));
+      q = p4est_quadrant_array_push (qarray);
+      *q = *s;
+    }
+  }
+}
+
 void
 p4est_balance (p4est_t * p4est, p4est_connect_type_t btype,
                p4est_init_t init_fn)
+{
+  p4est_balance_incremental (p4est, btype, init_fn, NULL);
+}
+
+void
+p4est_balance_incremental (p4est_t * p4est, p4est_connect_type_t btype,
+                           p4est_init_t init_fn,
+                           const int8_t * changed_trees)
 {
   const int           rank = p4est->mpirank;
   const int           num_procs = p4est->mpisize;
@@ -1154,6 +2246,7 @@ p4est_balance (p4est_t * p4est, p4est_connect_type_t btype,
   p4est_topidx_t      qtree, nt;
   p4est_topidx_t      first_tree, last_tree;
   p4est_locidx_t      skipped;
+  p4est_locidx_t     *precount = NULL;
   p4est_balance_peer_t *peers, *peer;
   p4est_tree_t       *tree;
   p4est_quadrant_t    mylow, nextlow;
@@ -1205,6 +2298,8 @@ p4est_balance (p4est_t * p4est, p4est_connect_type_t btype,
   int                 is_ranges_primary, is_balance_verify;
   int                 is_ranges_active, is_notify_active;
   int                 max_ranges;
+  size_t              hbytes;
+  p4est_balance_header_t *hdr;
   MPI_Request        *requests_first, *requests_second;
   MPI_Request        *send_requests_first_count, *send_requests_first_load;
   MPI_Request        *send_requests_second_count, *send_requests_second_load;
@@ -1215,7 +2310,19 @@ p4est_balance (p4est_t * p4est, p4est_connect_type_t btype,
                             "_balance %s with %lld total quadrants\n",
                             p4est_connect_type_string (btype),
                             (long long) p4est->global_num_quadrants);
+  p4est_profile_fire (p4est, P4EST_PROFILE_BALANCE, 0);
   P4EST_ASSERT (p4est_is_valid (p4est));
+  ++p4est->revision;
+  p4est_view_preserve_all (p4est);
+  if (p4est->changes != NULL && p4est->last_local_tree >= 0) {
+    /* balance only adds quadrants, so an unchanged count after the
+     * fact proves a tree was not modified */
+    precount = P4EST_ALLOC (p4est_locidx_t, p4est->connectivity->num_trees);
+    for (nt = p4est->first_local_tree; nt <= p4est->last_local_tree; ++nt) {
+      tree = p4est_tree_array_index (p4est->trees, nt);
+      precount[nt] = (p4est_locidx_t) tree->quadrants.elem_count;
+    }
+  }
 #ifndef P4_TO_P8
   P4EST_ASSERT (btype == P4EST_CONNECT_FACE || btype == P4EST_CONNECT_CORNER);
 #else
@@ -1251,13 +2358,17 @@ p4est_balance (p4est_t * p4est, p4est_connect_type_t btype,
   }
 
 #ifdef P4EST_MPI
-  requests_first = P4EST_ALLOC (MPI_Request, 6 * num_procs);
+  requests_first = (MPI_Request *)
+    p4est_workspace_get (p4est, P4EST_WORKSPACE_BALANCE_REQUESTS,
+                         6 * num_procs * sizeof (MPI_Request));
   requests_second = requests_first + 1 * num_procs;
   send_requests_first_count = requests_first + 2 * num_procs;
   send_requests_first_load = requests_first + 3 * num_procs;
   send_requests_second_count = requests_first + 4 * num_procs;
   send_requests_second_load = requests_first + 5 * num_procs;
-  recv_statuses = P4EST_ALLOC (MPI_Status, num_procs);
+  recv_statuses = (MPI_Status *)
+    p4est_workspace_get (p4est, P4EST_WORKSPACE_BALANCE_STATUSES,
+                         num_procs * sizeof (MPI_Status));
   for (j = 0; j < num_procs; ++j) {
     requests_first[j] = requests_second[j] = MPI_REQUEST_NULL;
     send_requests_first_count[j] = MPI_REQUEST_NULL;
@@ -1265,14 +2376,18 @@ p4est_balance (p4est_t * p4est, p4est_connect_type_t btype,
     send_requests_second_count[j] = MPI_REQUEST_NULL;
     send_requests_second_load[j] = MPI_REQUEST_NULL;
   }
-  wait_indices = P4EST_ALLOC (int, num_procs);
+  wait_indices = (int *)
+    p4est_workspace_get (p4est, P4EST_WORKSPACE_BALANCE_INDICES,
+                         num_procs * sizeof (int));
 #ifdef P4EST_DEBUG
   sc_array_init (&checkarray, 4);
 #endif /* P4EST_DEBUG */
 #endif /* P4EST_MPI */
 
   /* allocate per peer storage and initialize requests */
-  peers = P4EST_ALLOC (p4est_balance_peer_t, num_procs);
+  peers = (p4est_balance_peer_t *)
+    p4est_workspace_get (p4est, P4EST_WORKSPACE_BALANCE_PEERS,
+                         num_procs * sizeof (p4est_balance_peer_t));
   for (j = 0; j < num_procs; ++j) {
     peer = peers + j;
     sc_array_init (&peer->send_first, sizeof (p4est_quadrant_t));
@@ -1340,8 +2455,13 @@ p4est_balance (p4est_t * p4est, p4est_connect_type_t btype,
     P4EST_VERBOSEF ("Into balance tree %lld with %llu\n", (long long) nt,
                     (unsigned long long) tquadrants->elem_count);
 
-    /* local balance first pass */
-    p4est_balance_subtree (p4est, btype, nt, init_fn);
+    /* local balance first pass; trees without new quadrants are already
+       balanced locally and are only scanned for boundary information,
+       and so are level-homogeneous trees */
+    if ((changed_trees == NULL || changed_trees[nt]) &&
+        !p4est_tree_is_uniform (tree)) {
+      p4est_balance_subtree (p4est, btype, nt, init_fn);
+    }
     treecount = tquadrants->elem_count;
     P4EST_VERBOSEF ("Balance tree %lld A %llu\n",
                     (long long) nt, (unsigned long long) treecount);
@@ -1835,15 +2955,11 @@ p4est_balance (p4est_t * p4est, p4est_connect_type_t btype,
       ++send_zero[0];
     }
     peer->send_first_count = (int) qcount;
-    mpiret = MPI_Isend (&peer->send_first_count, 1, MPI_INT,
-                        j, P4EST_COMM_BALANCE_FIRST_COUNT,
-                        p4est->mpicomm, &send_requests_first_count[j]);
-    SC_CHECK_MPI (mpiret);
-    ++request_send_count;
 
-    /* sort and send the actual quadrants and post receive for reply */
+    /* sort the quadrants and coalesce small payloads into the header,
+     * so the frequent tiny messages complete in a single send */
     if (qcount > 0) {
-      sc_array_sort (&peer->send_first, p4est_quadrant_compare_piggy);
+      p4est_quadrant_array_sort_piggy (&peer->send_first);
 
 #ifdef P4EST_DEBUG
       checksum = p4est_quadrant_checksum (&peer->send_first, &checkarray, 0);
@@ -1851,13 +2967,34 @@ p4est_balance (p4est_t * p4est, p4est_connect_type_t btype,
 #endif /* P4EST_DEBUG */
 
       total_send_count += qcount;
+    }
+    hdr = &peer->send_first_hdr;
+    hdr->count = (int) qcount;
+    hbytes = offsetof (p4est_balance_header_t, quads);
+    if (qcount > 0 && qcount <= P4EST_BALANCE_INLINE) {
+      memcpy (hdr->quads, peer->send_first.array,
+              qcount * sizeof (p4est_quadrant_t));
+      hbytes += qcount * sizeof (p4est_quadrant_t);
+    }
+    mpiret = MPI_Isend (hdr, (int) hbytes, MPI_BYTE,
+                        j, P4EST_COMM_BALANCE_FIRST_COUNT,
+                        p4est->mpicomm, &send_requests_first_count[j]);
+    SC_CHECK_MPI (mpiret);
+    ++request_send_count;
+
+    /* send the payloads too large for the header and post the receive
+     * for the reply */
+    if (qcount > P4EST_BALANCE_INLINE) {
       qbytes = qcount * sizeof (p4est_quadrant_t);
       mpiret = MPI_Isend (peer->send_first.array, (int) qbytes, MPI_BYTE,
                           j, P4EST_COMM_BALANCE_FIRST_LOAD,
                           p4est->mpicomm, &send_requests_first_load[j]);
       SC_CHECK_MPI (mpiret);
       ++request_send_count;
-      mpiret = MPI_Irecv (&peer->recv_second_count, 1, MPI_INT,
+    }
+    if (qcount > 0) {
+      mpiret = MPI_Irecv (&peer->recv_second_hdr,
+                          (int) sizeof (p4est_balance_header_t), MPI_BYTE,
                           j, P4EST_COMM_BALANCE_SECOND_COUNT,
                           p4est->mpicomm, &requests_second[j]);
       SC_CHECK_MPI (mpiret);
@@ -1873,7 +3010,8 @@ p4est_balance (p4est_t * p4est, p4est_connect_type_t btype,
   for (k = 0; k < num_senders; ++k) {
     j = sender_ranks[k];
     ++request_first_count;
-    mpiret = MPI_Irecv (&peers[j].recv_first_count, 1, MPI_INT,
+    mpiret = MPI_Irecv (&peers[j].recv_first_hdr,
+                        (int) sizeof (p4est_balance_header_t), MPI_BYTE,
                         j, P4EST_COMM_BALANCE_FIRST_COUNT,
                         p4est->mpicomm, &requests_first[j]);
     SC_CHECK_MPI (mpiret);
@@ -1902,17 +3040,21 @@ p4est_balance (p4est_t * p4est, p4est_connect_type_t btype,
       peer = peers + j;
       P4EST_ASSERT (!peer->have_first_load);
       if (!peer->have_first_count) {
-        /* verify message size */
+        /* verify message size: the header carries the count and, for
+         * small messages, the payload itself */
         P4EST_ASSERT (jstatus->MPI_TAG == P4EST_COMM_BALANCE_FIRST_COUNT);
-        mpiret = MPI_Get_count (jstatus, MPI_INT, &rcount);
+        mpiret = MPI_Get_count (jstatus, MPI_BYTE, &rcount);
         SC_CHECK_MPI (mpiret);
-        SC_CHECK_ABORTF (rcount == 1, "Receive count mismatch A %d", rcount);
+        SC_CHECK_ABORTF (rcount >=
+                         (int) offsetof (p4est_balance_header_t, quads),
+                         "Receive count mismatch A %d", rcount);
 
         /* process the count information received */
         peer->have_first_count = 1;
+        peer->recv_first_count = peer->recv_first_hdr.count;
         qcount = (size_t) peer->recv_first_count;
-        if (qcount > 0) {
-          /* received nonzero count, post receive for load */
+        if (qcount > (size_t) P4EST_BALANCE_INLINE) {
+          /* payload too large for the header, post receive for load */
           P4EST_LDEBUGF ("Balance A recv %llu quadrants from %d\n",
                          (unsigned long long) qcount, j);
           P4EST_ASSERT (peer->recv_first.elem_count == 0);
@@ -1926,6 +3068,26 @@ p4est_balance (p4est_t * p4est, p4est_connect_type_t btype,
           SC_CHECK_MPI (mpiret);
           ++recv_load[0];
         }
+        else if (qcount > 0) {
+          /* the payload arrived coalesced with the count */
+          SC_CHECK_ABORTF (rcount ==
+                           (int) (offsetof (p4est_balance_header_t, quads) +
+                                  qcount * sizeof (p4est_quadrant_t)),
+                           "Receive inline mismatch A %d %dx%llu", rcount,
+                           peer->recv_first_count,
+                           (unsigned long long) sizeof (p4est_quadrant_t));
+          P4EST_LDEBUGF ("Balance A recv %llu quadrants inline from %d\n",
+                         (unsigned long long) qcount, j);
+          P4EST_ASSERT (peer->recv_first.elem_count == 0);
+          sc_array_resize (&peer->recv_first, qcount);
+          memcpy (peer->recv_first.array, peer->recv_first_hdr.quads,
+                  qcount * sizeof (p4est_quadrant_t));
+          total_recv_count += qcount;
+          peer->have_first_load = 1;
+          P4EST_ASSERT (requests_first[j] == MPI_REQUEST_NULL);
+          --request_first_count;
+          ++recv_load[0];
+        }
         else {
           /* will not receive load, close this request */
           P4EST_ASSERT (qcount == 0);
@@ -1951,7 +3113,9 @@ p4est_balance (p4est_t * p4est, p4est_connect_type_t btype,
         peer->have_first_load = 1;
         P4EST_ASSERT (requests_first[j] == MPI_REQUEST_NULL);
         --request_first_count;
+      }
 
+      if (peer->have_first_load) {
 #ifdef P4EST_DEBUG
         checksum =
           p4est_quadrant_checksum (&peer->recv_first, &checkarray, 0);
@@ -1966,17 +3130,6 @@ p4est_balance (p4est_t * p4est, p4est_connect_type_t btype,
           P4EST_LDEBUGF ("Balance B send %llu quadrants to %d\n",
                          (unsigned long long) qcount, j);
           ++send_load[1];
-        }
-        else {
-          ++send_zero[1];
-        }
-        peer->send_second_count = (int) qcount;
-        mpiret = MPI_Isend (&peer->send_second_count, 1, MPI_INT,
-                            j, P4EST_COMM_BALANCE_SECOND_COUNT,
-                            p4est->mpicomm, &send_requests_second_count[j]);
-        SC_CHECK_MPI (mpiret);
-        ++request_send_count;
-        if (qcount > 0) {
 
 #ifdef P4EST_DEBUG
           checksum =
@@ -1986,6 +3139,25 @@ p4est_balance (p4est_t * p4est, p4est_connect_type_t btype,
 #endif /* P4EST_DEBUG */
 
           total_send_count += qcount;
+        }
+        else {
+          ++send_zero[1];
+        }
+        peer->send_second_count = (int) qcount;
+        hdr = &peer->send_second_hdr;
+        hdr->count = (int) qcount;
+        hbytes = offsetof (p4est_balance_header_t, quads);
+        if (qcount > 0 && qcount <= P4EST_BALANCE_INLINE) {
+          memcpy (hdr->quads, peer->send_second.array,
+                  qcount * sizeof (p4est_quadrant_t));
+          hbytes += qcount * sizeof (p4est_quadrant_t);
+        }
+        mpiret = MPI_Isend (hdr, (int) hbytes, MPI_BYTE,
+                            j, P4EST_COMM_BALANCE_SECOND_COUNT,
+                            p4est->mpicomm, &send_requests_second_count[j]);
+        SC_CHECK_MPI (mpiret);
+        ++request_send_count;
+        if (qcount > P4EST_BALANCE_INLINE) {
           qbytes = qcount * sizeof (p4est_quadrant_t);
           mpiret = MPI_Isend (peer->send_second.array, (int) qbytes, MPI_BYTE,
                               j, P4EST_COMM_BALANCE_SECOND_LOAD,
@@ -2003,7 +3175,7 @@ p4est_balance (p4est_t * p4est, p4est_connect_type_t btype,
 
   /* simulate send and receive with myself across tree boundaries */
   peer = peers + rank;
-  sc_array_sort (&peer->send_first, p4est_quadrant_compare_piggy);
+  p4est_quadrant_array_sort_piggy (&peer->send_first);
   qcount = peer->send_first.elem_count;
   peer->recv_first_count = peer->send_first_count = (int) qcount;
   qbytes = qcount * sizeof (p4est_quadrant_t);
@@ -2018,6 +3190,15 @@ p4est_balance (p4est_t * p4est, p4est_connect_type_t btype,
   sc_array_resize (qarray, qcount);
   memcpy (qarray->array, peer->send_second.array, qbytes);
 
+  /* merge what is complete already: the first round loads have all been
+     received and the self communication has been simulated above; the
+     second round loads are merged below as they arrive, so this local
+     work overlaps the second round communication */
+  for (j = 0; j < num_procs; ++j) {
+    p4est_balance_merge (p4est, &peers[j].recv_first, borders, init_fn);
+  }
+  p4est_balance_merge (p4est, &peers[rank].recv_second, borders, init_fn);
+
 #ifdef P4EST_MPI
   /* receive second round appending to the same receive buffer */
   while (request_second_count > 0) {
@@ -2039,17 +3220,21 @@ p4est_balance (p4est_t * p4est, p4est_connect_type_t btype,
       peer = peers + j;
       P4EST_ASSERT (!peer->have_second_load);
       if (!peer->have_second_count) {
-        /* verify message size */
+        /* verify message size: the header carries the count and, for
+         * small messages, the payload itself */
         P4EST_ASSERT (jstatus->MPI_TAG == P4EST_COMM_BALANCE_SECOND_COUNT);
-        mpiret = MPI_Get_count (jstatus, MPI_INT, &rcount);
+        mpiret = MPI_Get_count (jstatus, MPI_BYTE, &rcount);
         SC_CHECK_MPI (mpiret);
-        SC_CHECK_ABORTF (rcount == 1, "Receive count mismatch B %d", rcount);
+        SC_CHECK_ABORTF (rcount >=
+                         (int) offsetof (p4est_balance_header_t, quads),
+                         "Receive count mismatch B %d", rcount);
 
         /* process the count information received */
         peer->have_second_count = 1;
+        peer->recv_second_count = peer->recv_second_hdr.count;
         qcount = (size_t) peer->recv_second_count;
-        if (qcount > 0) {
-          /* received nonzero count, post receive for load */
+        if (qcount > (size_t) P4EST_BALANCE_INLINE) {
+          /* payload too large for the header, post receive for load */
           P4EST_LDEBUGF ("Balance B recv %llu quadrants from %d\n",
                          (unsigned long long) qcount, j);
           P4EST_ASSERT (peer->recv_second.elem_count == 0);
@@ -2063,6 +3248,26 @@ p4est_balance (p4est_t * p4est, p4est_connect_type_t btype,
           SC_CHECK_MPI (mpiret);
           ++recv_load[1];
         }
+        else if (qcount > 0) {
+          /* the payload arrived coalesced with the count */
+          SC_CHECK_ABORTF (rcount ==
+                           (int) (offsetof (p4est_balance_header_t, quads) +
+                                  qcount * sizeof (p4est_quadrant_t)),
+                           "Receive inline mismatch B %d %dx%llu", rcount,
+                           peer->recv_second_count,
+                           (unsigned long long) sizeof (p4est_quadrant_t));
+          P4EST_LDEBUGF ("Balance B recv %llu quadrants inline from %d\n",
+                         (unsigned long long) qcount, j);
+          P4EST_ASSERT (peer->recv_second.elem_count == 0);
+          sc_array_resize (&peer->recv_second, qcount);
+          memcpy (peer->recv_second.array, peer->recv_second_hdr.quads,
+                  qcount * sizeof (p4est_quadrant_t));
+          total_recv_count += qcount;
+          peer->have_second_load = 1;
+          P4EST_ASSERT (requests_second[j] == MPI_REQUEST_NULL);
+          --request_second_count;
+          ++recv_load[1];
+        }
         else {
           /* will not receive load, close this request */
           P4EST_ASSERT (qcount == 0);
@@ -2088,13 +3293,18 @@ p4est_balance (p4est_t * p4est, p4est_connect_type_t btype,
         peer->have_second_load = 1;
         P4EST_ASSERT (requests_second[j] == MPI_REQUEST_NULL);
         --request_second_count;
+      }
 
+      if (peer->have_second_load) {
 #ifdef P4EST_DEBUG
         checksum =
           p4est_quadrant_checksum (&peer->recv_second, &checkarray, 0);
         P4EST_LDEBUGF ("Balance B recv checksum 0x%08x from %d\n", checksum,
                        j);
 #endif /* P4EST_DEBUG */
+
+        /* merge immediately to overlap with outstanding receives */
+        p4est_balance_merge (p4est, &peer->recv_second, borders, init_fn);
       }
     }
   }
@@ -2137,51 +3347,18 @@ p4est_balance (p4est_t * p4est, p4est_connect_type_t btype,
 #endif
   }
 
-  /* merge received quadrants */
+  /* all received quadrants have been merged on the fly above */
+#ifdef P4EST_DEBUG
   for (j = 0; j < num_procs; ++j) {
-    size_t              fcount;
-
-    /* access peer information */
     peer = peers + j;
-    fcount = peer->recv_first.elem_count;
-    qcount = fcount + peer->recv_second.elem_count;
     P4EST_ASSERT (peer->send_first_count ==
                   (int) peer->send_first.elem_count);
     P4EST_ASSERT (peer->send_second_count ==
                   (int) peer->send_second.elem_count);
     P4EST_ASSERT (peer->recv_second_count ==
                   (int) peer->recv_second.elem_count);
-    if (qcount == 0) {
-      continue;
-    }
-
-    /* merge received quadrants into correct tree */
-    for (zz = 0; zz < qcount; ++zz) {
-      s = zz < fcount ? p4est_quadrant_array_index (&peer->recv_first, zz) :
-        p4est_quadrant_array_index (&peer->recv_second, zz - fcount);
-      P4EST_ASSERT (p4est_quadrant_is_extended (s));
-      qtree = s->p.piggy2.which_tree;
-      if (qtree < first_tree || qtree > last_tree) {
-        /* this is a corner/edge quadrant from the second pass of balance */
-        continue;
-      }
-      if (borders == NULL) {
-        tree = p4est_tree_array_index (p4est->trees, qtree);
-        q = p4est_quadrant_array_push (&tree->quadrants);
-        *q = *s;
-        ++tree->quadrants_per_level[q->level];
-        tree->maxlevel = (int8_t) SC_MAX (tree->maxlevel, q->level);
-        ++p4est->local_num_quadrants;
-        p4est_quadrant_init_data (p4est, qtree, q, init_fn);
-      }
-      else {
-        qarray = (sc_array_t *) sc_array_index (borders,
-                                                (int) (qtree - first_tree));
-        q = p4est_quadrant_array_push (qarray);
-        *q = *s;
-      }
-    }
   }
+#endif
 
   /* rebalance and clamp result back to original tree boundaries */
   p4est->local_num_quadrants = 0;
@@ -2204,12 +3381,6 @@ p4est_balance (p4est_t * p4est, p4est_connect_type_t btype,
     p4est->local_num_quadrants += tquadrants->elem_count;
     tquadrants = NULL;          /* safeguard */
   }
-  if (last_tree >= 0) {
-    for (; nt < conn->num_trees; ++nt) {
-      tree = p4est_tree_array_index (p4est->trees, nt);
-      tree->quadrants_offset = p4est->local_num_quadrants;
-    }
-  }
 
   /* end balance_B */
   if (p4est->inspect != NULL) {
@@ -2249,6 +3420,29 @@ p4est_balance (p4est_t * p4est, p4est_connect_type_t btype,
                     (unsigned long long) tree->quadrants.elem_count);
   }
 
+  /* record the memory peak while the peer buffers still coexist
+   * with the grown quadrant arrays */
+  if (p4est_mempeak_active ()) {
+    size_t              peak_bytes;
+
+    peak_bytes = p4est_memory_used (p4est);
+    for (j = 0; j < num_procs; ++j) {
+      peer = peers + j;
+      peak_bytes += sc_array_memory_used (&peer->send_first, 0);
+      peak_bytes += sc_array_memory_used (&peer->send_second, 0);
+      peak_bytes += sc_array_memory_used (&peer->recv_first, 0);
+      peak_bytes += sc_array_memory_used (&peer->recv_second, 0);
+    }
+    if (borders != NULL) {
+      peak_bytes += sc_array_memory_used (borders, 1);
+      for (zz = 0; zz < localcount; zz++) {
+        qarray = (sc_array_t *) sc_array_index (borders, zz);
+        peak_bytes += sc_array_memory_used (qarray, 0);
+      }
+    }
+    p4est_mempeak_sample (P4EST_STRING "_balance", peak_bytes);
+  }
+
   /* cleanup temporary storage */
   P4EST_FREE (tree_flags);
   for (j = 0; j < num_procs; ++j) {
@@ -2258,7 +3452,7 @@ p4est_balance (p4est_t * p4est, p4est_connect_type_t btype,
     sc_array_reset (&peer->recv_first);
     sc_array_reset (&peer->recv_second);
   }
-  P4EST_FREE (peers);
+  p4est_workspace_release (p4est, P4EST_WORKSPACE_BALANCE_PEERS, peers);
 
   if (borders != NULL) {
     for (zz = 0; zz < localcount; zz++) {
@@ -2274,9 +3468,13 @@ p4est_balance (p4est_t * p4est, p4est_connect_type_t btype,
   sc_array_reset (cta);
 
 #ifdef P4EST_MPI
-  P4EST_FREE (requests_first);  /* includes allocation for requests_second */
-  P4EST_FREE (recv_statuses);
-  P4EST_FREE (wait_indices);
+  /* the first slot includes the allocation for requests_second */
+  p4est_workspace_release (p4est, P4EST_WORKSPACE_BALANCE_REQUESTS,
+                           requests_first);
+  p4est_workspace_release (p4est, P4EST_WORKSPACE_BALANCE_STATUSES,
+                           recv_statuses);
+  p4est_workspace_release (p4est, P4EST_WORKSPACE_BALANCE_INDICES,
+                           wait_indices);
 #ifdef P4EST_DEBUG
   sc_array_reset (&checkarray);
 #endif /* P4EST_DEBUG */
@@ -2288,16 +3486,28 @@ p4est_balance (p4est_t * p4est, p4est_connect_type_t btype,
   /* some sanity checks */
   P4EST_ASSERT ((p4est_locidx_t) all_outcount == p4est->local_num_quadrants);
   P4EST_ASSERT (all_outcount >= all_incount);
-  if (p4est->user_data_pool != NULL) {
+  if (p4est->user_data_pool != NULL && p4est->user_data_arena == NULL) {
     P4EST_ASSERT (data_pool_size + all_outcount - all_incount ==
                   p4est->user_data_pool->elem_count);
   }
+  if (precount != NULL) {
+    for (nt = p4est->first_local_tree; nt <= p4est->last_local_tree; ++nt) {
+      tree = p4est_tree_array_index (p4est->trees, nt);
+      if ((p4est_locidx_t) tree->quadrants.elem_count != precount[nt]) {
+        p4est_record_change (p4est, nt, 0,
+                             (p4est_locidx_t) tree->quadrants.elem_count);
+      }
+    }
+    P4EST_FREE (precount);
+  }
+
   P4EST_ASSERT (p4est_is_valid (p4est));
   P4EST_ASSERT (p4est_is_balanced (p4est, btype));
   P4EST_VERBOSEF ("Balance skipped %lld\n", (long long) skipped);
   P4EST_GLOBAL_PRODUCTIONF ("Done " P4EST_STRING
                             "_balance with %lld total quadrants\n",
                             (long long) p4est->global_num_quadrants);
+  p4est_profile_fire (p4est, P4EST_PROFILE_BALANCE, 1);
 }
 
 void
@@ -2306,21 +3516,32 @@ p4est_partition (p4est_t * p4est, p4est_weight_t weight_fn)
   (void) p4est_partition_ext (p4est, 0, weight_fn);
 }
 
-p4est_gloidx_t
-p4est_partition_ext (p4est_t * p4est, int partition_for_coarsening,
-                     p4est_weight_t weight_fn)
+/** Compute and apply a new partition, optionally driven by weights.
+ * At most one of \a weight_fn, \a weight64_fn, and \a bytes_fn may be
+ * non-NULL; the channel callback is evaluated once per channel and
+ * blended at runtime, and the bytes callback is augmented by the fixed
+ * per-quadrant storage so that empty quadrants still carry weight.
+ */
+static p4est_gloidx_t
+p4est_partition_work (p4est_t * p4est, int partition_for_coarsening,
+                      p4est_weight_t weight_fn,
+                      p4est_weight_channel_t weight64_fn,
+                      int num_channels, const double *blend,
+                      p4est_data_bytes_t bytes_fn)
 {
   p4est_gloidx_t      global_shipped = 0;
   const p4est_gloidx_t global_num_quadrants = p4est->global_num_quadrants;
 #ifdef P4EST_MPI
   int                 mpiret;
-  int                 low_source, high_source;
+  int                 c;
+  double              dw;
   const int           num_procs = p4est->mpisize;
   const int           rank = p4est->mpirank;
   const p4est_topidx_t first_tree = p4est->first_local_tree;
   const p4est_topidx_t last_tree = p4est->last_local_tree;
   const p4est_locidx_t local_num_quadrants = p4est->local_num_quadrants;
   int                 i, p;
+  int                 ilow, ihigh, imid;
   int                 send_lowest, send_highest;
   int                 num_sends, rcount, base_index;
   size_t              lz;
@@ -2332,9 +3553,9 @@ p4est_partition_ext (p4est_t * p4est, int partition_for_coarsening,
   p4est_gloidx_t      send_index, recv_low, recv_high, qcount;
   p4est_gloidx_t     *send_array;
   int64_t             weight, weight_sum;
+  int64_t             weight_offset, total_weight;
   int64_t             cut, my_lowcut, my_highcut;
   int64_t            *local_weights;    /* cumulative weights by quadrant */
-  int64_t            *global_weight_sums;
   p4est_quadrant_t   *q;
   p4est_tree_t       *tree;
   MPI_Request        *send_requests, recv_requests[2];
@@ -2347,10 +3568,22 @@ p4est_partition_ext (p4est_t * p4est, int partition_for_coarsening,
     ("Into " P4EST_STRING
      "_partition with %lld total quadrants\n",
      (long long) p4est->global_num_quadrants);
+  p4est_profile_fire (p4est, P4EST_PROFILE_PARTITION, 0);
+
+  /* start timing and reset the communication counters */
+  if (p4est->inspect != NULL) {
+    p4est->inspect->partition_time = -MPI_Wtime ();
+    p4est->inspect->partition_comm_sent = 0;
+    p4est->inspect->partition_nzpeers = 0;
+  }
 
   /* this function does nothing in a serial setup */
   if (p4est->mpisize == 1) {
     P4EST_GLOBAL_PRODUCTION ("Done " P4EST_STRING "_partition no shipping\n");
+    if (p4est->inspect != NULL) {
+      p4est->inspect->partition_time += MPI_Wtime ();
+    }
+    p4est_profile_fire (p4est, P4EST_PROFILE_PARTITION, 1);
     return global_shipped;
   }
 
@@ -2358,7 +3591,7 @@ p4est_partition_ext (p4est_t * p4est, int partition_for_coarsening,
   /* allocate new quadrant distribution counts */
   num_quadrants_in_proc = P4EST_ALLOC (p4est_locidx_t, num_procs);
 
-  if (weight_fn == NULL) {
+  if (weight_fn == NULL && weight64_fn == NULL && bytes_fn == NULL) {
     /* Divide up the quadants equally */
     for (p = 0, next_quadrant = 0; p < num_procs; ++p) {
       prev_quadrant = next_quadrant;
@@ -2372,7 +3605,6 @@ p4est_partition_ext (p4est_t * p4est, int partition_for_coarsening,
   else {
     /* do a weighted partition */
     local_weights = P4EST_ALLOC (int64_t, local_num_quadrants + 1);
-    global_weight_sums = P4EST_ALLOC (int64_t, num_procs + 1);
     P4EST_VERBOSEF ("local quadrant count %lld\n",
                     (long long) local_num_quadrants);
 
@@ -2383,7 +3615,22 @@ p4est_partition_ext (p4est_t * p4est, int partition_for_coarsening,
       tree = p4est_tree_array_index (p4est->trees, nt);
       for (lz = 0; lz < tree->quadrants.elem_count; ++lz, ++kl) {
         q = p4est_quadrant_array_index (&tree->quadrants, lz);
-        weight = (int64_t) weight_fn (p4est, nt, q);
+        if (weight_fn != NULL) {
+          weight = (int64_t) weight_fn (p4est, nt, q);
+        }
+        else if (bytes_fn != NULL) {
+          /* migration volume: quadrant storage plus attached payload */
+          weight = (int64_t) (sizeof (p4est_quadrant_t) + p4est->data_size)
+            + (int64_t) bytes_fn (p4est, nt, q);
+        }
+        else {
+          /* blend the 64-bit weight channels at runtime */
+          dw = 0.;
+          for (c = 0; c < num_channels; ++c) {
+            dw += blend[c] * (double) weight64_fn (p4est, nt, q, c);
+          }
+          weight = (int64_t) (dw + .5);
+        }
         P4EST_ASSERT (weight >= 0);
         local_weights[kl + 1] = local_weights[kl] + weight;
       }
@@ -2392,54 +3639,85 @@ p4est_partition_ext (p4est_t * p4est, int partition_for_coarsening,
     weight_sum = local_weights[local_num_quadrants];
     P4EST_VERBOSEF ("local weight sum %lld\n", (long long) weight_sum);
 
-    /* distribute local weight sums */
-    global_weight_sums[0] = 0;
-    mpiret = MPI_Allgather (&weight_sum, 1, MPI_LONG_LONG_INT,
-                            &global_weight_sums[1], 1, MPI_LONG_LONG_INT,
-                            p4est->mpicomm);
+    /* determine the weight offset of this processor by a prefix scan */
+    weight_offset = 0;
+    mpiret = MPI_Exscan (&weight_sum, &weight_offset, 1, MPI_LONG_LONG_INT,
+                         MPI_SUM, p4est->mpicomm);
     SC_CHECK_MPI (mpiret);
-
-    /* adjust all arrays to reflect the global weight */
-    for (i = 0; i < num_procs; ++i) {
-      global_weight_sums[i + 1] += global_weight_sums[i];
+    if (rank == 0) {
+      /* the standard leaves the receive buffer undefined on rank 0 */
+      weight_offset = 0;
     }
+
+    /* the last processor knows the global sum and broadcasts it */
+    total_weight = weight_offset + weight_sum;
+    mpiret = MPI_Bcast (&total_weight, 1, MPI_LONG_LONG_INT,
+                        num_procs - 1, p4est->mpicomm);
+    SC_CHECK_MPI (mpiret);
+    P4EST_GLOBAL_VERBOSEF ("Global weight sum %lld\n",
+                           (long long) total_weight);
+
+    /* adjust the local prefix to reflect the global offset */
     if (rank > 0) {
-      weight_sum = global_weight_sums[rank];
       for (kl = 0; kl <= local_num_quadrants; ++kl) {
-        local_weights[kl] += weight_sum;
+        local_weights[kl] += weight_offset;
       }
     }
-    P4EST_ASSERT (local_weights[0] == global_weight_sums[rank]);
+    P4EST_ASSERT (local_weights[0] == weight_offset);
     P4EST_ASSERT (local_weights[local_num_quadrants] ==
-                  global_weight_sums[rank + 1]);
-    weight_sum = global_weight_sums[num_procs];
-
-    if (rank == 0) {
-      for (i = 0; i <= num_procs; ++i) {
-        P4EST_GLOBAL_VERBOSEF ("Global weight sum [%d] %lld\n",
-                               i, (long long) global_weight_sums[i]);
-      }
-    }
+                  weight_offset + weight_sum);
 
     /* if all quadrants have zero weight we do nothing */
-    if (weight_sum == 0) {
+    if (total_weight == 0) {
       P4EST_FREE (local_weights);
-      P4EST_FREE (global_weight_sums);
       P4EST_FREE (num_quadrants_in_proc);
       P4EST_GLOBAL_PRODUCTION ("Done " P4EST_STRING
                                "_partition no shipping\n");
+      if (p4est->inspect != NULL) {
+        p4est->inspect->partition_time += MPI_Wtime ();
+      }
+      p4est_profile_fire (p4est, P4EST_PROFILE_PARTITION, 1);
       return global_shipped;
     }
 
-    /* determine processor ids to send to */
+    /* Determine processor ids to send to by bisection on the cut
+     * formula; the cuts are nondecreasing in i so the targets whose
+     * cut falls into this processor's weight range form an interval.
+     */
     send_lowest = num_procs;
     send_highest = 0;
-    for (i = 1; i <= num_procs; ++i) {
-      cut = (weight_sum * i) / num_procs;
-      if (global_weight_sums[rank] < cut &&
-          cut <= global_weight_sums[rank + 1]) {
-        send_lowest = SC_MIN (send_lowest, i);
-        send_highest = SC_MAX (send_highest, i);
+    if (weight_sum > 0) {
+      /* find the smallest i in 1..num_procs whose cut exceeds the
+       * local offset; it exists since the cut of num_procs does */
+      ilow = 1;
+      ihigh = num_procs;
+      while (ilow < ihigh) {
+        imid = (ilow + ihigh) / 2;
+        cut = (total_weight * imid) / num_procs;
+        if (cut > weight_offset) {
+          ihigh = imid;
+        }
+        else {
+          ilow = imid + 1;
+        }
+      }
+      cut = (total_weight * ilow) / num_procs;
+      if (cut <= weight_offset + weight_sum) {
+        send_lowest = ilow;
+
+        /* find the largest i whose cut this processor still owns */
+        ihigh = num_procs;
+        while (ilow < ihigh) {
+          imid = (ilow + ihigh + 1) / 2;
+          cut = (total_weight * imid) / num_procs;
+          if (cut <= weight_offset + weight_sum) {
+            ilow = imid;
+          }
+          else {
+            ihigh = imid - 1;
+          }
+        }
+        send_highest = ilow;
       }
     }
     /*
@@ -2462,7 +3740,7 @@ p4est_partition_ext (p4est_t * p4est, int partition_for_coarsening,
         base_index = 2 * (i - send_lowest);
         if (i < num_procs) {
           /* do binary search in the weight array */
-          lowers = sc_search_lower_bound64 ((weight_sum * i) / num_procs,
+          lowers = sc_search_lower_bound64 ((total_weight * i) / num_procs,
                                             local_weights,
                                             (size_t) local_num_quadrants + 1,
                                             (size_t) lowers);
@@ -2500,57 +3778,37 @@ p4est_partition_ext (p4est_t * p4est, int partition_for_coarsening,
       }
     }
 
-    /* determine processor ids to receive from and post irecv */
-    i = 0;
-    my_lowcut = (weight_sum * rank) / num_procs;
+    /* Post receives for the cut points; the sending processor is the
+     * one that owns the cut in its weight range, which is not known
+     * here without the global prefix, so we receive from any source.
+     */
+    my_lowcut = (total_weight * rank) / num_procs;
     if (my_lowcut == 0) {
       recv_low = 0;
       recv_requests[0] = MPI_REQUEST_NULL;
-      low_source = -1;
     }
     else {
-      for (; i < num_procs; ++i) {
-        if (global_weight_sums[i] < my_lowcut &&
-            my_lowcut <= global_weight_sums[i + 1]) {
-          P4EST_LDEBUGF ("recv A from %d\n", i);
-          mpiret = MPI_Irecv (&recv_low, 1, P4EST_MPI_GLOIDX, i,
-                              P4EST_COMM_PARTITION_WEIGHTED_LOW,
-                              p4est->mpicomm, &recv_requests[0]);
-          SC_CHECK_MPI (mpiret);
-          break;
-        }
-      }
-      P4EST_ASSERT (i < num_procs);
-      low_source = i;
+      mpiret = MPI_Irecv (&recv_low, 1, P4EST_MPI_GLOIDX, MPI_ANY_SOURCE,
+                          P4EST_COMM_PARTITION_WEIGHTED_LOW,
+                          p4est->mpicomm, &recv_requests[0]);
+      SC_CHECK_MPI (mpiret);
     }
-    my_highcut = (weight_sum * (rank + 1)) / num_procs;
+    my_highcut = (total_weight * (rank + 1)) / num_procs;
     if (my_highcut == 0) {
       recv_high = 0;
       recv_requests[1] = MPI_REQUEST_NULL;
-      high_source = -1;
     }
     else {
-      for (; i < num_procs; ++i) {
-        if (global_weight_sums[i] < my_highcut &&
-            my_highcut <= global_weight_sums[i + 1]) {
-          P4EST_LDEBUGF ("recv B from %d\n", i);
-          mpiret = MPI_Irecv (&recv_high, 1, P4EST_MPI_GLOIDX, i,
-                              P4EST_COMM_PARTITION_WEIGHTED_HIGH,
-                              p4est->mpicomm, &recv_requests[1]);
-          SC_CHECK_MPI (mpiret);
-          break;
-        }
-      }
-      P4EST_ASSERT (i < num_procs);
-      high_source = i;
+      mpiret = MPI_Irecv (&recv_high, 1, P4EST_MPI_GLOIDX, MPI_ANY_SOURCE,
+                          P4EST_COMM_PARTITION_WEIGHTED_HIGH,
+                          p4est->mpicomm, &recv_requests[1]);
+      SC_CHECK_MPI (mpiret);
     }
-    P4EST_LDEBUGF ("my recv peers %d %d cuts %lld %lld\n",
-                   low_source, high_source,
+    P4EST_LDEBUGF ("my recv cuts %lld %lld\n",
                    (long long) my_lowcut, (long long) my_highcut);
 
     /* free temporary memory */
     P4EST_FREE (local_weights);
-    P4EST_FREE (global_weight_sums);
 
     /* wait for sends and receives to complete */
     if (num_sends > 0) {
@@ -2562,8 +3820,6 @@ p4est_partition_ext (p4est_t * p4est, int partition_for_coarsening,
     mpiret = MPI_Waitall (2, recv_requests, recv_statuses);
     SC_CHECK_MPI (mpiret);
     if (my_lowcut != 0) {
-      SC_CHECK_ABORT (recv_statuses[0].MPI_SOURCE == low_source,
-                      "Wait low source");
       SC_CHECK_ABORT (recv_statuses[0].MPI_TAG ==
                       P4EST_COMM_PARTITION_WEIGHTED_LOW, "Wait low tag");
       mpiret = MPI_Get_count (&recv_statuses[0], P4EST_MPI_GLOIDX, &rcount);
@@ -2571,8 +3827,6 @@ p4est_partition_ext (p4est_t * p4est, int partition_for_coarsening,
       SC_CHECK_ABORTF (rcount == 1, "Wait low count %d", rcount);
     }
     if (my_highcut != 0) {
-      SC_CHECK_ABORT (recv_statuses[1].MPI_SOURCE == high_source,
-                      "Wait high source");
       SC_CHECK_ABORT (recv_statuses[1].MPI_TAG ==
                       P4EST_COMM_PARTITION_WEIGHTED_HIGH, "Wait high tag");
       mpiret = MPI_Get_count (&recv_statuses[1], P4EST_MPI_GLOIDX, &rcount);
@@ -2635,715 +3889,2637 @@ p4est_partition_ext (p4est_t * p4est, int partition_for_coarsening,
   P4EST_ASSERT (p4est_is_valid (p4est));
 #endif /* P4EST_MPI */
 
+  if (global_shipped > 0) {
+    p4est_record_change_all (p4est);
+  }
+
+  if (p4est->inspect != NULL) {
+    p4est->inspect->partition_time += MPI_Wtime ();
+  }
+
   P4EST_GLOBAL_PRODUCTIONF
     ("Done " P4EST_STRING "_partition shipped %lld quadrants %.3g%%\n",
      (long long) global_shipped,
      global_shipped * 100. / global_num_quadrants);
+  p4est_profile_fire (p4est, P4EST_PROFILE_PARTITION, 1);
 
   return global_shipped;
 }
 
-#ifdef P4EST_MPI
+p4est_gloidx_t
+p4est_partition_ext (p4est_t * p4est, int partition_for_coarsening,
+                     p4est_weight_t weight_fn)
+{
+  return p4est_partition_work (p4est, partition_for_coarsening,
+                               weight_fn, NULL, 0, NULL, NULL);
+}
 
-static              p4est_locidx_t
-p4est_partition_for_coarsening (p4est_t * p4est,
-                                p4est_locidx_t * num_quadrants_in_proc)
+p4est_gloidx_t
+p4est_partition_weighted (p4est_t * p4est, int partition_for_coarsening,
+                          p4est_weight_channel_t weight_fn,
+                          int num_channels, const double *blend)
 {
-  int                 num_procs = p4est->mpisize;
-  int                 rank = p4est->mpirank;
-  int                 mpiret;
-  p4est_gloidx_t      global_num_quadrants = p4est->global_num_quadrants;
-  int                 i, send_lowest, send_highest, num_sends;
-  int                 parent_index;
-  p4est_quadrant_t   *q;
-  p4est_tree_t       *tree;
-  p4est_locidx_t      num_quadrants_in_tree;
-  p4est_topidx_t      it, tree_index;
-  p4est_gloidx_t      iq, quad_id_near_cut;
-  p4est_gloidx_t      min_quad_id, max_quad_id;
-  int8_t              quad_near_cut_level;
-  p4est_gloidx_t     *partition_now = p4est->global_first_quadrant;
-  p4est_gloidx_t     *partition_new;
-  p4est_quadrant_t   *parent_send;
-  MPI_Request        *send_requests;
-  MPI_Request        *receive_requests;
-  int                 receive_lowest, receive_highest, num_receives;
-  int                 process_with_cut, process_with_cut_recv_id;
-  p4est_quadrant_t   *parent_receive;
-  int                *receive_process;
-  int                *correction, correction_local;
-  int                 current_proc, next_proc;
-  p4est_locidx_t      num_moved_quadrants;
+#ifdef P4EST_DEBUG
+  int                 c;
 
-  /* create array with first quadrants of new partition */
-  partition_new = P4EST_ALLOC (p4est_gloidx_t, num_procs + 1);
-  partition_new[0] = 0;
-  for (i = 1; i < num_procs; i++) {     /* loop over all processes */
-    partition_new[i] = partition_new[i - 1] + num_quadrants_in_proc[i - 1];
+  P4EST_ASSERT (weight_fn != NULL);
+  P4EST_ASSERT (num_channels > 0);
+  for (c = 0; c < num_channels; ++c) {
+    P4EST_ASSERT (blend[c] >= 0.);
   }
-  partition_new[num_procs] = global_num_quadrants;
+#endif
 
-  /* BEGIN: send */
-  if (partition_now[rank] < partition_now[rank + 1]) {
-    /* if this process has quadrants */
-    /* determine number and min/max process ids to send to */
-    num_sends = 0;              /* number of sends */
-    send_lowest = num_procs;    /* lowest process id */
-    send_highest = 0;           /* highest process id */
-    for (i = 1; i < num_procs; i++) {
-      /* loop over all processes (without first) */
-      if (partition_new[i] < partition_new[i + 1] &&
-          partition_now[rank] <= partition_new[i] + P4EST_CHILDREN - 2 &&
-          partition_new[i] - P4EST_CHILDREN + 1 < partition_now[rank + 1]) {
-        /* if this process has relevant quadrants for process `i` */
-        num_sends++;
-        send_lowest = SC_MIN (send_lowest, i);
-        send_highest = SC_MAX (send_highest, i);
-      }
-    }
-  }
-  else {
-    /* set number of messages to send */
-    num_sends = 0;
-  }
+  return p4est_partition_work (p4est, partition_for_coarsening,
+                               NULL, weight_fn, num_channels, blend, NULL);
+}
 
-  if (num_sends > 0) {          /* if this process sends messages */
-    /* allocate send messages */
-    send_requests = P4EST_ALLOC (MPI_Request, num_sends);
-    parent_send = P4EST_ALLOC (p4est_quadrant_t, num_sends);
+p4est_gloidx_t
+p4est_partition_bytes (p4est_t * p4est, int partition_for_coarsening,
+                       p4est_data_bytes_t bytes_fn)
+{
+  P4EST_ASSERT (bytes_fn != NULL);
 
-    /* array index of send messages */
-    parent_index = 0;
+  return p4est_partition_work (p4est, partition_for_coarsening,
+                               NULL, NULL, 0, NULL, bytes_fn);
+}
 
-    for (i = send_lowest; i <= send_highest; i++) {
-      /* loop over all process candidates to send to */
-      if (!(partition_new[i] < partition_new[i + 1] &&
-            partition_now[rank] <= partition_new[i] + P4EST_CHILDREN - 2 &&
-            partition_new[i] - P4EST_CHILDREN + 1 <
-            partition_now[rank + 1])) {
-        /* if this process has no relevant quadrants for process `i` */
-        continue;
-      }
+p4est_t            *
+p4est_shrink (p4est_t * p4est, int num_ranks)
+{
+  const int           num_procs = p4est->mpisize;
+  const int           rank = p4est->mpirank;
+  int                 p;
+#ifdef P4EST_MPI
+  int                 mpiret;
+#endif
+  MPI_Comm            subcomm;
+  p4est_gloidx_t      prev_quadrant, next_quadrant;
+  p4est_locidx_t     *num_quadrants_in_proc;
+  p4est_t            *shrunk;
 
-      /* get nearest quadrant `quad_id_near_cut` to cut `partition_new[i]` */
-      if (partition_now[rank] <= partition_new[i] &&
-          partition_new[i] < partition_now[rank + 1]) {
-        /* if cut is owned by this process */
-        quad_id_near_cut = partition_new[i];
+  P4EST_ASSERT (p4est_is_valid (p4est));
+  P4EST_ASSERT (0 < num_ranks && num_ranks <= num_procs);
+  P4EST_GLOBAL_PRODUCTIONF ("Into " P4EST_STRING
+                            "_shrink onto %d of %d ranks\n",
+                            num_ranks, num_procs);
+
+  /* concentrate the quadrants on the first num_ranks processes */
+  num_quadrants_in_proc = P4EST_ALLOC (p4est_locidx_t, num_procs);
+  next_quadrant = 0;
+  for (p = 0; p < num_procs; ++p) {
+    prev_quadrant = next_quadrant;
+    if (p < num_ranks) {
+      next_quadrant = (p4est->global_num_quadrants * (p + 1)) / num_ranks;
+    }
+    num_quadrants_in_proc[p] =
+      (p4est_locidx_t) (next_quadrant - prev_quadrant);
+  }
+  (void) p4est_partition_given (p4est, num_quadrants_in_proc);
+  P4EST_FREE (num_quadrants_in_proc);
+
+  /* split off the prefix communicator; the key preserves rank order */
+#ifdef P4EST_MPI
+  mpiret = MPI_Comm_split (p4est->mpicomm,
+                           rank < num_ranks ? 0 : MPI_UNDEFINED, rank,
+                           &subcomm);
+  SC_CHECK_MPI (mpiret);
+#else
+  subcomm = p4est->mpicomm;
+#endif
+  if (rank >= num_ranks) {
+    P4EST_ASSERT (p4est->local_num_quadrants == 0);
+    return NULL;
+  }
+
+  /* duplicate the forest and rebase it on the subcommunicator */
+  shrunk = p4est_copy (p4est, 1);
+  shrunk->mpicomm = subcomm;
+  shrunk->mpisize = num_ranks;
+  P4EST_ASSERT (shrunk->mpirank == rank);
+  P4EST_FREE (shrunk->global_first_quadrant);
+  shrunk->global_first_quadrant =
+    P4EST_ALLOC (p4est_gloidx_t, num_ranks + 1);
+  p4est_comm_count_quadrants (shrunk);
+  P4EST_FREE (shrunk->global_first_position);
+  shrunk->global_first_position =
+    P4EST_ALLOC (p4est_quadrant_t, num_ranks + 1);
+  p4est_comm_global_partition (shrunk, NULL);
+  P4EST_ASSERT (p4est_is_valid (shrunk));
+
+  P4EST_GLOBAL_PRODUCTIONF ("Done " P4EST_STRING
+                            "_shrink with %lld total quadrants\n",
+                            (long long) shrunk->global_num_quadrants);
+  return shrunk;
+}
+
+p4est_t            *
+p4est_expand (p4est_t * small, MPI_Comm mpicomm,
+              p4est_connectivity_t * connectivity, void *user_pointer)
+{
+  int                 i;
+  int                 mpiret;
+  int                 num_procs, rank;
+  p4est_topidx_t      num_trees, jt;
+  p4est_gloidx_t      header;
+  size_t              dsize;
+  p4est_t            *expanded;
+  p4est_tree_t       *tree;
+
+  mpiret = MPI_Comm_size (mpicomm, &num_procs);
+  SC_CHECK_MPI (mpiret);
+  mpiret = MPI_Comm_rank (mpicomm, &rank);
+  SC_CHECK_MPI (mpiret);
+  P4EST_ASSERT (rank > 0 || small != NULL);
+  P4EST_ASSERT (small == NULL || p4est_is_valid (small));
+  P4EST_GLOBAL_PRODUCTIONF ("Into " P4EST_STRING
+                            "_expand onto %d ranks\n", num_procs);
+
+  /* the joining ranks learn the data size from the first rank */
+  header = (small == NULL) ? 0 : (p4est_gloidx_t) small->data_size;
+  mpiret = MPI_Bcast (&header, 1, P4EST_MPI_GLOIDX, 0, mpicomm);
+  SC_CHECK_MPI (mpiret);
+  dsize = (size_t) header;
+
+  if (small != NULL) {
+    /* duplicate the surviving forest and rebase it on the full
+       communicator; the quadrants stay on the prefix ranks */
+    P4EST_ASSERT (small->data_size == dsize);
+    P4EST_ASSERT (small->mpirank == rank && small->mpisize <= num_procs);
+    expanded = p4est_copy (small, 1);
+    expanded->mpicomm = mpicomm;
+    expanded->mpisize = num_procs;
+    P4EST_FREE (expanded->global_first_quadrant);
+    P4EST_FREE (expanded->global_first_position);
+  }
+  else {
+    /* this rank joins with an empty partition */
+    expanded = P4EST_ALLOC_ZERO (p4est_t, 1);
+    expanded->mpicomm = mpicomm;
+    expanded->mpisize = num_procs;
+    expanded->mpirank = rank;
+    expanded->data_size = dsize;
+    expanded->user_pointer = user_pointer;
+    expanded->connectivity = connectivity;
+    expanded->first_local_tree = -1;
+    expanded->last_local_tree = -2;
+    if (dsize > 0) {
+      expanded->user_data_pool = sc_mempool_new (dsize);
+    }
+    expanded->quadrant_pool = sc_mempool_new (sizeof (p4est_quadrant_t));
+    num_trees = connectivity->num_trees;
+    expanded->trees = sc_array_new_size (sizeof (p4est_tree_t), num_trees);
+    for (jt = 0; jt < num_trees; ++jt) {
+      tree = p4est_tree_array_index (expanded->trees, jt);
+      sc_array_init (&tree->quadrants, sizeof (p4est_quadrant_t));
+      P4EST_QUADRANT_INIT (&tree->first_desc);
+      P4EST_QUADRANT_INIT (&tree->last_desc);
+      tree->quadrants_offset = 0;
+      for (i = 0; i <= P4EST_QMAXLEVEL; ++i) {
+        tree->quadrants_per_level[i] = 0;
       }
-      else {
-        if (abs (partition_new[i] - partition_now[rank]) <
-            abs (partition_new[i] - partition_now[rank + 1] + 1)) {
-          quad_id_near_cut = partition_now[rank];
-        }
-        else {
-          quad_id_near_cut = partition_now[rank + 1] - 1;
-        }
+      for (; i <= P4EST_MAXLEVEL; ++i) {
+        tree->quadrants_per_level[i] = -1;
       }
+      tree->maxlevel = 0;
+    }
+  }
+  P4EST_ASSERT (expanded->connectivity == connectivity);
 
-      /* get tree `tree` of quadrant `quad_id_near_cut` */
-      num_quadrants_in_tree = partition_now[rank + 1] - partition_now[rank];
-      for (it = p4est->first_local_tree; it <= p4est->last_local_tree; it++) {
-        /* loop over all local trees */
-        tree = p4est_tree_array_index (p4est->trees, it);
-        if (tree->quadrants_offset <= quad_id_near_cut - partition_now[rank]) {
-          tree_index = it;
-        }
-        else {
-          num_quadrants_in_tree = tree->quadrants_offset;
-          break;
-        }
-      }
-      tree = p4est_tree_array_index (p4est->trees, tree_index);
-      num_quadrants_in_tree -= tree->quadrants_offset;
+  /* recompute the communicator-dependent partition information */
+  expanded->global_first_quadrant =
+    P4EST_ALLOC (p4est_gloidx_t, num_procs + 1);
+  p4est_comm_count_quadrants (expanded);
+  expanded->global_first_position =
+    P4EST_ALLOC (p4est_quadrant_t, num_procs + 1);
+  p4est_comm_global_partition (expanded, NULL);
+  P4EST_ASSERT (p4est_is_valid (expanded));
 
-      /* get quadrant with index `quad_id_near_cut` */
-      q = p4est_quadrant_array_index (&tree->quadrants,
-                                      quad_id_near_cut - partition_now[rank] -
-                                      tree->quadrants_offset);
+  P4EST_GLOBAL_PRODUCTIONF ("Done " P4EST_STRING
+                            "_expand with %lld total quadrants\n",
+                            (long long) expanded->global_num_quadrants);
+  return expanded;
+}
 
-      /* get level of quadrant near cut */
-      quad_near_cut_level = q->level;
+/* operation codes of one journal entry */
+#define P4EST_JOURNAL_REFINE    0
+#define P4EST_JOURNAL_COARSEN   1
+#define P4EST_JOURNAL_BALANCE   2
+#define P4EST_JOURNAL_PARTITION 3
 
-      if (quad_near_cut_level > 0) {
-        /* if quadrant near cut is not root of tree, i.e. level is not zero */
-        /* get parent of quadrant near cut */
-        p4est_quadrant_parent (q, &parent_send[parent_index]);
+/** One recorded adaptation pass.  The decision bits of a refine or
+ * coarsen pass live in the shared bit pool of the journal, in callback
+ * invocation order, which retraces Morton order per sweep.
+ */
+typedef struct p4est_journal_entry
+{
+  int8_t              op;
+  int8_t              recursive;        /* refine and coarsen passes */
+  int8_t              btype;    /* balance passes */
+  size_t              first_bit;        /* byte aligned into the bit pool */
+  size_t              num_bits; /* also the count of partition counts */
+  size_t              first_count;      /* into the count pool */
+}
+p4est_journal_entry_t;
 
-        /* get min quadrant with same parent */
-        min_quad_id = quad_id_near_cut;
-        for (iq = quad_id_near_cut;
-             iq >= SC_MAX (partition_now[rank] + tree->quadrants_offset,
-                           partition_new[i] - P4EST_CHILDREN + 1); iq--) {
-          /* loop over eligible quadrants */
-          /* get quadrant with index `iq` */
-          q = p4est_quadrant_array_index (&tree->quadrants,
-                                          iq - partition_now[rank] -
-                                          tree->quadrants_offset);
+struct p4est_journal
+{
+  sc_array_t         *entries;  /* p4est_journal_entry_t */
+  sc_array_t         *bits;     /* uint8_t bit pool */
+  sc_array_t         *counts;   /* p4est_locidx_t partition counts */
+  /* transient state of the pass being captured or replayed */
+  p4est_journal_entry_t *cur;
+  size_t              cursor;
+  p4est_refine_t      refine_fn;
+  p4est_coarsen_t     coarsen_fn;
+  void               *user_pointer;     /* the caller's, while swapped out */
+};
 
-          /* check quadrant `iq` */
-          if (q->level == quad_near_cut_level) {        /* if same level */
-            if (p4est_quadrant_is_parent (&parent_send[parent_index], q)) {
-              /* if same parent */
-              min_quad_id = iq;
-            }
-            else {
-              break;
-            }
-          }
-          else {
-            break;
-          }
-        }
+static void
+p4est_journal_push_bit (p4est_journal_t * journal, int bit)
+{
+  const size_t        zb = journal->cur->first_bit + journal->cur->num_bits;
+  uint8_t            *byte;
 
-        /* get max quadrant with same parent */
-        max_quad_id = quad_id_near_cut;
-        for (iq = quad_id_near_cut;
-             iq <=
-             SC_MIN (partition_now[rank] + tree->quadrants_offset +
-                     num_quadrants_in_tree - 1,
-                     partition_new[i] + P4EST_CHILDREN - 2); iq++) {
-          /* loop over eligible quadrants */
+  if (zb % 8 == 0) {
+    byte = (uint8_t *) sc_array_push (journal->bits);
+    *byte = 0;
+  }
+  else {
+    byte = (uint8_t *) sc_array_index (journal->bits, zb / 8);
+  }
+  if (bit) {
+    *byte |= (uint8_t) (1 << (zb % 8));
+  }
+  ++journal->cur->num_bits;
+}
 
-          /* get quadrant `iq` */
-          q = p4est_quadrant_array_index (&tree->quadrants,
-                                          iq - partition_now[rank] -
-                                          tree->quadrants_offset);
+static int
+p4est_journal_take_bit (p4est_journal_t * journal)
+{
+  size_t              zb;
+  const uint8_t      *byte;
 
-          /* check quadrant `iq` */
-          if (q->level == quad_near_cut_level) {        /* if same level */
-            if (p4est_quadrant_is_parent (&parent_send[parent_index], q)) {
-              /* if same parent */
-              max_quad_id = iq;
-            }
-            else {
-              break;
-            }
-          }
-          else {
-            break;
-          }
-        }
+  P4EST_ASSERT (journal->cursor < journal->cur->num_bits);
+  zb = journal->cur->first_bit + journal->cursor++;
+  byte = (const uint8_t *) sc_array_index (journal->bits, zb / 8);
 
-        /* write tree */
-        parent_send[parent_index].p.piggy3.which_tree = tree_index;
+  return (*byte >> (zb % 8)) & 1;
+}
 
-        if (quad_id_near_cut == partition_new[i]) {
-          /* if this process has cut */
-          /* encode number of quadrants with same parent before and after
-           * `partition_new[i]` into one integer */
-          parent_send[parent_index].p.piggy3.local_num =
-            (partition_new[i] - min_quad_id) * P4EST_CHILDREN +
-            (max_quad_id - partition_new[i]);
-        }
-        else {
-          /* write number of quadrants with same parent */
-          parent_send[parent_index].p.piggy3.local_num =
-            max_quad_id - min_quad_id + 1;
-        }
+static p4est_journal_entry_t *
+p4est_journal_push_entry (p4est_journal_t * journal, int op)
+{
+  p4est_journal_entry_t *entry;
 
-        /* MPI send: parent */
-        mpiret = MPI_Isend (&parent_send[parent_index],
-                            sizeof (p4est_quadrant_t), MPI_BYTE,
-                            i,
-                            P4EST_COMM_PARTITION_CORRECTION, p4est->mpicomm,
-                            &send_requests[parent_index]);
-        SC_CHECK_MPI (mpiret);
-      }
-      else {                    /* if quadrant near cut is root of tree, i.e. level is zero */
-        /* set parent as tree root `q` */
-        parent_send[parent_index].level = q->level;
-        parent_send[parent_index].x = q->x;
-        parent_send[parent_index].y = q->y;
-#ifdef P4_TO_P8
-        parent_send[parent_index].z = q->z;
-#endif
+  entry = (p4est_journal_entry_t *) sc_array_push (journal->entries);
+  entry->op = (int8_t) op;
+  entry->recursive = 0;
+  entry->btype = -1;
+  entry->first_bit = 8 * journal->bits->elem_count;
+  entry->num_bits = 0;
+  entry->first_count = journal->counts->elem_count;
 
-        /* write tree */
-        parent_send[parent_index].p.piggy3.which_tree = tree_index;
+  return entry;
+}
 
-        /* write number of quadrants with same "parent" */
-        parent_send[parent_index].p.piggy3.local_num = 1;
+static int
+p4est_journal_capture_refine (p4est_t * p4est, p4est_topidx_t which_tree,
+                              p4est_quadrant_t * quadrant)
+{
+  p4est_journal_t    *journal = (p4est_journal_t *) p4est->user_pointer;
+  int                 decision;
 
-        /* MPI send: root of tree */
-        mpiret = MPI_Isend (&parent_send[parent_index],
-                            sizeof (p4est_quadrant_t), MPI_BYTE,
-                            i,
-                            P4EST_COMM_PARTITION_CORRECTION, p4est->mpicomm,
-                            &send_requests[parent_index]);
-        SC_CHECK_MPI (mpiret);
-      }
+  /* evaluate the user callback under its own user pointer */
+  p4est->user_pointer = journal->user_pointer;
+  decision = journal->refine_fn (p4est, which_tree, quadrant);
+  p4est->user_pointer = journal;
+  p4est_journal_push_bit (journal, decision);
 
-      /* increment parent index */
-      parent_index++;
-    }
-  }
-  /* END: send */
+  return decision;
+}
 
-  /* BEGIN: receive */
-  if (rank != 0 && partition_new[rank] < partition_new[rank + 1]) {
-    /* if this process should get quadrants */
-    /* determine process ids to receive from */
-    num_receives = 0;           /* number of receives */
-    receive_lowest = num_procs; /* lowest process id */
-    receive_highest = 0;        /* highest process id */
-    for (i = 0; i < num_procs; i++) {   /* loop over all processes */
-      if (partition_now[i] < partition_now[i + 1] &&
-          partition_now[i] <= partition_new[rank] + P4EST_CHILDREN - 2 &&
-          partition_new[rank] - P4EST_CHILDREN + 1 < partition_now[i + 1]) {
-        /* if process `i` has relevant quadrants for this process */
-        num_receives++;
-        receive_lowest = SC_MIN (receive_lowest, i);
-        receive_highest = SC_MAX (receive_highest, i);
+static int
+p4est_journal_capture_coarsen (p4est_t * p4est, p4est_topidx_t which_tree,
+                               p4est_quadrant_t * quadrants[])
+{
+  p4est_journal_t    *journal = (p4est_journal_t *) p4est->user_pointer;
+  int                 decision;
 
-        if (partition_now[i] <= partition_new[rank] &&
-            partition_new[rank] < partition_now[i + 1]) {
-          /* if cut is owned by process `i` */
-          /* process id that sends parent of cut quadrant */
-          process_with_cut = i;
+  p4est->user_pointer = journal->user_pointer;
+  decision = journal->coarsen_fn (p4est, which_tree, quadrants);
+  p4est->user_pointer = journal;
+  p4est_journal_push_bit (journal, decision);
 
-          /* array index of receive messages of process with cut  */
-          process_with_cut_recv_id = num_receives - 1;
-        }
-      }
-    }
-  }
-  else {
-    /* set number of messages to receive */
-    num_receives = 0;
+  return decision;
+}
 
-    /* set correction */
-    correction_local = 0;
-  }
+static int
+p4est_journal_replay_refine (p4est_t * p4est, p4est_topidx_t which_tree,
+                             p4est_quadrant_t * quadrant)
+{
+  return p4est_journal_take_bit ((p4est_journal_t *) p4est->user_pointer);
+}
 
-  if (num_receives > 0) {       /* if this process receives messages */
-    /* allocate receive messages */
-    receive_requests = P4EST_ALLOC (MPI_Request, num_receives);
-    parent_receive = P4EST_ALLOC (p4est_quadrant_t, num_receives);
-    receive_process = P4EST_ALLOC (int, num_receives);
+static int
+p4est_journal_replay_coarsen (p4est_t * p4est, p4est_topidx_t which_tree,
+                              p4est_quadrant_t * quadrants[])
+{
+  return p4est_journal_take_bit ((p4est_journal_t *) p4est->user_pointer);
+}
 
-    /* array index of receive messages */
-    parent_index = 0;
+p4est_journal_t    *
+p4est_journal_new (void)
+{
+  p4est_journal_t    *journal;
 
-    for (i = receive_lowest; i <= receive_highest; i++) {
-      /* loop over all process candidates to receive from */
-      if (!(partition_now[i] < partition_now[i + 1] &&
-            partition_now[i] <= partition_new[rank] + P4EST_CHILDREN - 2 &&
-            partition_new[rank] - P4EST_CHILDREN + 1 <
-            partition_now[i + 1])) {
-        /* if process `i` has no relevant quadrants for this process */
-        continue;
+  journal = P4EST_ALLOC_ZERO (p4est_journal_t, 1);
+  journal->entries = sc_array_new (sizeof (p4est_journal_entry_t));
+  journal->bits = sc_array_new (sizeof (uint8_t));
+  journal->counts = sc_array_new (sizeof (p4est_locidx_t));
+
+  return journal;
+}
+
+void
+p4est_journal_destroy (p4est_journal_t * journal)
+{
+  sc_array_destroy (journal->entries);
+  sc_array_destroy (journal->bits);
+  sc_array_destroy (journal->counts);
+  P4EST_FREE (journal);
+}
+
+void
+p4est_refine_journal (p4est_t * p4est, int refine_recursive,
+                      p4est_refine_t refine_fn, p4est_init_t init_fn,
+                      p4est_journal_t * journal)
+{
+  p4est_journal_entry_t *entry;
+
+  entry = p4est_journal_push_entry (journal, P4EST_JOURNAL_REFINE);
+  entry->recursive = (int8_t) (refine_recursive != 0);
+  journal->cur = entry;
+  journal->refine_fn = refine_fn;
+  journal->user_pointer = p4est->user_pointer;
+  p4est->user_pointer = journal;
+  p4est_refine (p4est, refine_recursive, p4est_journal_capture_refine,
+                init_fn);
+  p4est->user_pointer = journal->user_pointer;
+  journal->cur = NULL;
+}
+
+void
+p4est_coarsen_journal (p4est_t * p4est, int coarsen_recursive,
+                       p4est_coarsen_t coarsen_fn, p4est_init_t init_fn,
+                       p4est_journal_t * journal)
+{
+  p4est_journal_entry_t *entry;
+
+  entry = p4est_journal_push_entry (journal, P4EST_JOURNAL_COARSEN);
+  entry->recursive = (int8_t) (coarsen_recursive != 0);
+  journal->cur = entry;
+  journal->coarsen_fn = coarsen_fn;
+  journal->user_pointer = p4est->user_pointer;
+  p4est->user_pointer = journal;
+  p4est_coarsen (p4est, coarsen_recursive, p4est_journal_capture_coarsen,
+                 init_fn);
+  p4est->user_pointer = journal->user_pointer;
+  journal->cur = NULL;
+}
+
+void
+p4est_balance_journal (p4est_t * p4est, p4est_connect_type_t btype,
+                       p4est_init_t init_fn, p4est_journal_t * journal)
+{
+  p4est_journal_entry_t *entry;
+
+  /* the balance needs no decisions beyond its connect type */
+  entry = p4est_journal_push_entry (journal, P4EST_JOURNAL_BALANCE);
+  entry->btype = (int8_t) btype;
+  p4est_balance (p4est, btype, init_fn);
+}
+
+p4est_gloidx_t
+p4est_partition_journal (p4est_t * p4est, int partition_for_coarsening,
+                         p4est_weight_t weight_fn,
+                         p4est_journal_t * journal)
+{
+  int                 i;
+  p4est_gloidx_t      shipped;
+  p4est_locidx_t     *count;
+  p4est_journal_entry_t *entry;
+
+  shipped = p4est_partition_ext (p4est, partition_for_coarsening, weight_fn);
+
+  /* record the resulting quadrant counts, not the weights: the replay
+   * then reproduces the partition without evaluating any weights */
+  entry = p4est_journal_push_entry (journal, P4EST_JOURNAL_PARTITION);
+  entry->num_bits = (size_t) p4est->mpisize;
+  for (i = 0; i < p4est->mpisize; ++i) {
+    count = (p4est_locidx_t *) sc_array_push (journal->counts);
+    *count = (p4est_locidx_t) (p4est->global_first_quadrant[i + 1] -
+                               p4est->global_first_quadrant[i]);
+  }
+
+  return shipped;
+}
+
+void
+p4est_journal_replay (p4est_t * p4est, p4est_journal_t * journal,
+                      p4est_init_t init_fn)
+{
+  size_t              zz;
+  void               *save_user_pointer;
+  p4est_journal_entry_t *entry;
+
+  for (zz = 0; zz < journal->entries->elem_count; ++zz) {
+    entry = (p4est_journal_entry_t *) sc_array_index (journal->entries, zz);
+    switch (entry->op) {
+    case P4EST_JOURNAL_REFINE:
+    case P4EST_JOURNAL_COARSEN:
+      journal->cur = entry;
+      journal->cursor = 0;
+      save_user_pointer = p4est->user_pointer;
+      p4est->user_pointer = journal;
+      if (entry->op == P4EST_JOURNAL_REFINE) {
+        p4est_refine (p4est, entry->recursive,
+                      p4est_journal_replay_refine, init_fn);
       }
-      /* store process index */
-      receive_process[parent_index] = i;
+      else {
+        p4est_coarsen (p4est, entry->recursive,
+                       p4est_journal_replay_coarsen, init_fn);
+      }
+      p4est->user_pointer = save_user_pointer;
+      /* every recorded decision must have been consumed: otherwise the
+       * replay did not start from the captured forest sequence */
+      SC_CHECK_ABORT (journal->cursor == entry->num_bits,
+                      P4EST_STRING "_journal_replay: forest mismatch");
+      journal->cur = NULL;
+      break;
+    case P4EST_JOURNAL_BALANCE:
+      p4est_balance (p4est, (p4est_connect_type_t) entry->btype, init_fn);
+      break;
+    case P4EST_JOURNAL_PARTITION:
+      SC_CHECK_ABORT ((size_t) p4est->mpisize == entry->num_bits,
+                      P4EST_STRING "_journal_replay: mpisize mismatch");
+      (void) p4est_partition_given (p4est, (p4est_locidx_t *)
+                                    sc_array_index (journal->counts,
+                                                    entry->first_count));
+      break;
+    default:
+      SC_ABORT_NOT_REACHED ();
+    }
+  }
+}
 
-      /* MPI receive */
-      mpiret = MPI_Irecv (&parent_receive[parent_index],
-                          sizeof (p4est_quadrant_t), MPI_BYTE,
-                          i,
-                          P4EST_COMM_PARTITION_CORRECTION, p4est->mpicomm,
-                          &receive_requests[parent_index]);
-      SC_CHECK_MPI (mpiret);
+/** Telemetry that drives the repartition recommendation.
+ * The calibration state must stay identical on all processors, which
+ * holds as long as the advisor calls are made collectively.
+ */
+struct p4est_partition_advisor
+{
+  double              sec_per_quadrant;     /**< compute cost, calibrated */
+  double              mig_sec_per_quadrant; /**< migration cost, calibrated */
+  int                 have_step;        /**< a step has been recorded */
+  int                 have_partition;   /**< a partition has been recorded */
+};
+
+/** EWMA decay applied when folding a new sample into the calibration. */
+#define P4EST_ADVISOR_DECAY .5
+
+/** Return the maximum over all processors of a local duration. */
+static double
+p4est_advisor_time_max (p4est_t * p4est, double seconds)
+{
+#ifdef P4EST_MPI
+  int                 mpiret;
+  double              gmax;
 
-      /* increment parent index */
-      parent_index++;
+  mpiret = MPI_Allreduce (&seconds, &gmax, 1, MPI_DOUBLE, MPI_MAX,
+                          p4est->mpicomm);
+  SC_CHECK_MPI (mpiret);
+  return gmax;
+#else
+  return seconds;
+#endif
+}
+
+/** Compute the heaviest rank's count and the excess above the mean.
+ * Both are derived from global_first_quadrant and thus identical on
+ * all processors without communication.
+ */
+static void
+p4est_advisor_imbalance (p4est_t * p4est, double *max_count,
+                         double *excess_count)
+{
+  const int           num_procs = p4est->mpisize;
+  const p4est_gloidx_t *gfq = p4est->global_first_quadrant;
+  int                 p;
+  double              local, avg;
+
+  avg = (double) p4est->global_num_quadrants / (double) num_procs;
+  *max_count = 0.;
+  *excess_count = 0.;
+  for (p = 0; p < num_procs; ++p) {
+    local = (double) (gfq[p + 1] - gfq[p]);
+    *max_count = SC_MAX (*max_count, local);
+    if (local > avg) {
+      *excess_count += local - avg;
     }
   }
-  /* END: receive */
+}
 
-  /* BEGIN: wait for MPI communication to complete */
-  if (num_sends > 0) {
-    /* wait for sends to complete */
-    mpiret = MPI_Waitall (num_sends, send_requests, MPI_STATUSES_IGNORE);
+p4est_partition_advisor_t *
+p4est_partition_advisor_new (void)
+{
+  p4est_partition_advisor_t *adv;
+
+  adv = P4EST_ALLOC_ZERO (p4est_partition_advisor_t, 1);
+  return adv;
+}
+
+void
+p4est_partition_advisor_destroy (p4est_partition_advisor_t * adv)
+{
+  P4EST_FREE (adv);
+}
+
+void
+p4est_partition_advisor_step (p4est_partition_advisor_t * adv,
+                              p4est_t * p4est, double step_seconds)
+{
+  double              tmax, maxq, excess, spq;
+
+  /* the slowest rank determines the duration of a synchronized step */
+  tmax = p4est_advisor_time_max (p4est, step_seconds);
+  p4est_advisor_imbalance (p4est, &maxq, &excess);
+  if (maxq <= 0.) {
+    return;
+  }
+  spq = tmax / maxq;
+  if (!adv->have_step) {
+    adv->sec_per_quadrant = spq;
+    adv->have_step = 1;
+  }
+  else {
+    adv->sec_per_quadrant = P4EST_ADVISOR_DECAY * adv->sec_per_quadrant
+      + (1. - P4EST_ADVISOR_DECAY) * spq;
+  }
+}
+
+void
+p4est_partition_advisor_record (p4est_partition_advisor_t * adv,
+                                p4est_t * p4est,
+                                double partition_seconds,
+                                p4est_gloidx_t global_shipped)
+{
+  double              tmax, mspq;
+
+  if (global_shipped <= 0) {
+    /* nothing moved, so this run carries no migration cost signal */
+    return;
+  }
+  tmax = p4est_advisor_time_max (p4est, partition_seconds);
+  mspq = tmax / (double) global_shipped;
+  if (!adv->have_partition) {
+    adv->mig_sec_per_quadrant = mspq;
+    adv->have_partition = 1;
+  }
+  else {
+    adv->mig_sec_per_quadrant =
+      P4EST_ADVISOR_DECAY * adv->mig_sec_per_quadrant
+      + (1. - P4EST_ADVISOR_DECAY) * mspq;
+  }
+}
+
+int
+p4est_partition_advisor_recommend (p4est_partition_advisor_t * adv,
+                                   p4est_t * p4est, int lookahead_steps)
+{
+  double              maxq, excess, avg;
+  double              savings, cost;
+
+  P4EST_ASSERT (lookahead_steps > 0);
+
+  if (!adv->have_step || !adv->have_partition) {
+    /* stay put until both cost models are calibrated from this run */
+    return 0;
+  }
+
+  p4est_advisor_imbalance (p4est, &maxq, &excess);
+  avg = (double) p4est->global_num_quadrants / (double) p4est->mpisize;
+
+  /* per step the slowest rank overshoots the balanced time by this much */
+  savings = (double) lookahead_steps *
+    adv->sec_per_quadrant * (maxq - avg);
+
+  /* restoring balance ships at least the excess above the mean */
+  cost = adv->mig_sec_per_quadrant * excess;
+
+  return savings > cost;
+}
+
+p4est_gloidx_t
+p4est_partition_diffusive (p4est_t * p4est, int partition_for_coarsening,
+                           double imbalance_tol, p4est_locidx_t max_move,
+                           p4est_weight_t weight_fn)
+{
+  p4est_gloidx_t      global_shipped = 0;
+#ifdef P4EST_MPI
+  const int           num_procs = p4est->mpisize;
+  const int           rank = p4est->mpirank;
+  const int           max_iterations = 64;
+  int                 mpiret;
+  int                 iter, p;
+  size_t              lz;
+  p4est_topidx_t      nt;
+  p4est_locidx_t      kl, local_num, nsend, moved_any;
+  p4est_locidx_t      gives[2], *all_gives;
+  p4est_locidx_t     *num_quadrants_in_proc;
+  p4est_gloidx_t      shipped;
+  p4est_locidx_t      num_corrected;
+  int64_t             weight, weight_sum, total_weight, max_load, flow;
+  int64_t             accum;
+  int64_t            *local_weights, *loads;
+  p4est_quadrant_t   *q;
+  p4est_tree_t       *tree;
+#endif
+
+  P4EST_ASSERT (p4est_is_valid (p4est));
+  P4EST_ASSERT (imbalance_tol >= 1.);
+  P4EST_GLOBAL_PRODUCTIONF
+    ("Into " P4EST_STRING
+     "_partition_diffusive with %lld total quadrants\n",
+     (long long) p4est->global_num_quadrants);
+
+  /* this function does nothing in a serial setup */
+  if (p4est->mpisize == 1) {
+    P4EST_GLOBAL_PRODUCTION ("Done " P4EST_STRING
+                             "_partition_diffusive no shipping\n");
+    return global_shipped;
+  }
+
+#ifdef P4EST_MPI
+  loads = P4EST_ALLOC (int64_t, num_procs);
+  all_gives = P4EST_ALLOC (p4est_locidx_t, 2 * num_procs);
+  num_quadrants_in_proc = P4EST_ALLOC (p4est_locidx_t, num_procs);
+
+  for (iter = 0; iter < max_iterations; ++iter) {
+    /* sum the local weights linearly across all trees */
+    local_num = p4est->local_num_quadrants;
+    local_weights = P4EST_ALLOC (int64_t, local_num + 1);
+    kl = 0;
+    local_weights[0] = 0;
+    for (nt = p4est->first_local_tree; nt <= p4est->last_local_tree; ++nt) {
+      tree = p4est_tree_array_index (p4est->trees, nt);
+      for (lz = 0; lz < tree->quadrants.elem_count; ++lz, ++kl) {
+        if (weight_fn == NULL) {
+          weight = 1;
+        }
+        else {
+          q = p4est_quadrant_array_index (&tree->quadrants, lz);
+          weight = (int64_t) weight_fn (p4est, nt, q);
+          P4EST_ASSERT (weight >= 0);
+        }
+        local_weights[kl + 1] = local_weights[kl] + weight;
+      }
+    }
+    P4EST_ASSERT (kl == local_num);
+    weight_sum = local_weights[local_num];
+
+    mpiret = MPI_Allgather (&weight_sum, 1, MPI_LONG_LONG_INT,
+                            loads, 1, MPI_LONG_LONG_INT, p4est->mpicomm);
     SC_CHECK_MPI (mpiret);
+    total_weight = 0;
+    max_load = 0;
+    for (p = 0; p < num_procs; ++p) {
+      total_weight += loads[p];
+      max_load = SC_MAX (max_load, loads[p]);
+    }
+    if (total_weight == 0 ||
+        (double) max_load * num_procs <=
+        imbalance_tol * (double) total_weight) {
+      P4EST_FREE (local_weights);
+      if (partition_for_coarsening && iter == 0) {
+        /* align the existing cut points with family boundaries anyway */
+        for (p = 0; p < num_procs; ++p) {
+          num_quadrants_in_proc[p] = (p4est_locidx_t)
+            (p4est->global_first_quadrant[p + 1] -
+             p4est->global_first_quadrant[p]);
+        }
+        num_corrected =
+          p4est_partition_for_coarsening (p4est, num_quadrants_in_proc);
+        if (num_corrected != 0) {
+          global_shipped +=
+            p4est_partition_given (p4est, num_quadrants_in_proc);
+        }
+      }
+      break;
+    }
 
-    /* free send memory */
-    P4EST_FREE (parent_send);
-    P4EST_FREE (send_requests);
+    /* first-order diffusion: ship half the load difference across each
+     * boundary between space-filling-curve neighbors */
+    gives[0] = gives[1] = 0;
+    if (rank < num_procs - 1 && loads[rank] > loads[rank + 1]) {
+      flow = (loads[rank] - loads[rank + 1]) / 2;
+      accum = 0;
+      nsend = 0;
+      while (nsend < local_num - gives[0] &&
+             (max_move <= 0 || nsend < max_move)) {
+        weight = local_weights[local_num - nsend] -
+          local_weights[local_num - nsend - 1];
+        if (2 * accum + weight > 2 * flow) {
+          break;
+        }
+        accum += weight;
+        ++nsend;
+      }
+      gives[1] = nsend;
+    }
+    if (rank > 0 && loads[rank - 1] < loads[rank]) {
+      flow = (loads[rank] - loads[rank - 1]) / 2;
+      accum = 0;
+      nsend = 0;
+      while (nsend < local_num - gives[1] &&
+             (max_move <= 0 || nsend < max_move)) {
+        weight = local_weights[nsend + 1] - local_weights[nsend];
+        if (2 * accum + weight > 2 * flow) {
+          break;
+        }
+        accum += weight;
+        ++nsend;
+      }
+      gives[0] = nsend;
+    }
+    P4EST_FREE (local_weights);
+
+    /* agree on the new quadrant counts */
+    mpiret = MPI_Allgather (gives, 2, P4EST_MPI_LOCIDX,
+                            all_gives, 2, P4EST_MPI_LOCIDX, p4est->mpicomm);
+    SC_CHECK_MPI (mpiret);
+    moved_any = 0;
+    for (p = 0; p < num_procs; ++p) {
+      num_quadrants_in_proc[p] = (p4est_locidx_t)
+        (p4est->global_first_quadrant[p + 1] -
+         p4est->global_first_quadrant[p])
+        - all_gives[2 * p] - all_gives[2 * p + 1];
+      if (p > 0) {
+        num_quadrants_in_proc[p] += all_gives[2 * (p - 1) + 1];
+      }
+      if (p < num_procs - 1) {
+        num_quadrants_in_proc[p] += all_gives[2 * (p + 1)];
+      }
+      moved_any |= all_gives[2 * p] || all_gives[2 * p + 1];
+    }
+
+    /* round the moved cut points to family boundaries */
+    if (partition_for_coarsening) {
+      num_corrected =
+        p4est_partition_for_coarsening (p4est, num_quadrants_in_proc);
+      moved_any |= (num_corrected != 0);
+      P4EST_GLOBAL_INFOF
+        ("Designated partition for coarsening %lld quadrants moved\n",
+         (long long) num_corrected);
+    }
+    if (!moved_any) {
+      break;
+    }
+
+    shipped = p4est_partition_given (p4est, num_quadrants_in_proc);
+    global_shipped += shipped;
+    P4EST_GLOBAL_VERBOSEF ("Diffusion iteration %d shipped %lld\n",
+                           iter, (long long) shipped);
+  }
+
+  P4EST_FREE (loads);
+  P4EST_FREE (all_gives);
+  P4EST_FREE (num_quadrants_in_proc);
+
+  /* check validity of the p4est */
+  P4EST_ASSERT (p4est_is_valid (p4est));
+#endif /* P4EST_MPI */
+
+  if (global_shipped > 0) {
+    p4est_record_change_all (p4est);
+  }
+
+  P4EST_GLOBAL_PRODUCTIONF
+    ("Done " P4EST_STRING "_partition_diffusive shipped %lld quadrants"
+     " %.3g%%\n", (long long) global_shipped,
+     global_shipped * 100. / p4est->global_num_quadrants);
+
+  return global_shipped;
+}
+
+#ifdef P4EST_MPI
+
+static              p4est_locidx_t
+p4est_partition_for_coarsening (p4est_t * p4est,
+                                p4est_locidx_t * num_quadrants_in_proc)
+{
+  int                 num_procs = p4est->mpisize;
+  int                 rank = p4est->mpirank;
+  int                 mpiret;
+  p4est_gloidx_t      global_num_quadrants = p4est->global_num_quadrants;
+  int                 i, send_lowest, send_highest, num_sends;
+  int                 parent_index;
+  p4est_quadrant_t   *q;
+  p4est_tree_t       *tree;
+  p4est_locidx_t      num_quadrants_in_tree;
+  p4est_topidx_t      it, tree_index;
+  p4est_gloidx_t      iq, quad_id_near_cut;
+  p4est_gloidx_t      min_quad_id, max_quad_id;
+  int8_t              quad_near_cut_level;
+  p4est_gloidx_t     *partition_now = p4est->global_first_quadrant;
+  p4est_gloidx_t     *partition_new;
+  p4est_quadrant_t   *parent_send;
+  MPI_Request        *send_requests;
+  MPI_Request        *receive_requests;
+  int                 receive_lowest, receive_highest, num_receives;
+  int                 process_with_cut, process_with_cut_recv_id;
+  p4est_quadrant_t   *parent_receive;
+  int                *receive_process;
+  int                *correction, correction_local;
+  int                 current_proc, next_proc;
+  p4est_locidx_t      num_moved_quadrants;
+
+  /* create array with first quadrants of new partition */
+  partition_new = P4EST_ALLOC (p4est_gloidx_t, num_procs + 1);
+  partition_new[0] = 0;
+  for (i = 1; i < num_procs; i++) {     /* loop over all processes */
+    partition_new[i] = partition_new[i - 1] + num_quadrants_in_proc[i - 1];
+  }
+  partition_new[num_procs] = global_num_quadrants;
+
+  /* BEGIN: send */
+  if (partition_now[rank] < partition_now[rank + 1]) {
+    /* if this process has quadrants */
+    /* determine number and min/max process ids to send to */
+    num_sends = 0;              /* number of sends */
+    send_lowest = num_procs;    /* lowest process id */
+    send_highest = 0;           /* highest process id */
+    for (i = 1; i < num_procs; i++) {
+      /* loop over all processes (without first) */
+      if (partition_new[i] < partition_new[i + 1] &&
+          partition_now[rank] <= partition_new[i] + P4EST_CHILDREN - 2 &&
+          partition_new[i] - P4EST_CHILDREN + 1 < partition_now[rank + 1]) {
+        /* if this process has relevant quadrants for process `i` */
+        num_sends++;
+        send_lowest = SC_MIN (send_lowest, i);
+        send_highest = SC_MAX (send_highest, i);
+      }
+    }
   }
+  else {
+    /* set number of messages to send */
+    num_sends = 0;
+  }
+
+  if (num_sends > 0) {          /* if this process sends messages */
+    /* allocate send messages */
+    send_requests = P4EST_ALLOC (MPI_Request, num_sends);
+    parent_send = P4EST_ALLOC (p4est_quadrant_t, num_sends);
+
+    /* array index of send messages */
+    parent_index = 0;
+
+    for (i = send_lowest; i <= send_highest; i++) {
+      /* loop over all process candidates to send to */
+      if (!(partition_new[i] < partition_new[i + 1] &&
+            partition_now[rank] <= partition_new[i] + P4EST_CHILDREN - 2 &&
+            partition_new[i] - P4EST_CHILDREN + 1 <
+            partition_now[rank + 1])) {
+        /* if this process has no relevant quadrants for process `i` */
+        continue;
+      }
+
+      /* get nearest quadrant `quad_id_near_cut` to cut `partition_new[i]` */
+      if (partition_now[rank] <= partition_new[i] &&
+          partition_new[i] < partition_now[rank + 1]) {
+        /* if cut is owned by this process */
+        quad_id_near_cut = partition_new[i];
+      }
+      else {
+        if (abs (partition_new[i] - partition_now[rank]) <
+            abs (partition_new[i] - partition_now[rank + 1] + 1)) {
+          quad_id_near_cut = partition_now[rank];
+        }
+        else {
+          quad_id_near_cut = partition_now[rank + 1] - 1;
+        }
+      }
+
+      /* get tree `tree` of quadrant `quad_id_near_cut` */
+      num_quadrants_in_tree = partition_now[rank + 1] - partition_now[rank];
+      for (it = p4est->first_local_tree; it <= p4est->last_local_tree; it++) {
+        /* loop over all local trees */
+        tree = p4est_tree_array_index (p4est->trees, it);
+        if (tree->quadrants_offset <= quad_id_near_cut - partition_now[rank]) {
+          tree_index = it;
+        }
+        else {
+          num_quadrants_in_tree = tree->quadrants_offset;
+          break;
+        }
+      }
+      tree = p4est_tree_array_index (p4est->trees, tree_index);
+      num_quadrants_in_tree -= tree->quadrants_offset;
+
+      /* get quadrant with index `quad_id_near_cut` */
+      q = p4est_quadrant_array_index (&tree->quadrants,
+                                      quad_id_near_cut - partition_now[rank] -
+                                      tree->quadrants_offset);
+
+      /* get level of quadrant near cut */
+      quad_near_cut_level = q->level;
+
+      if (quad_near_cut_level > 0) {
+        /* if quadrant near cut is not root of tree, i.e. level is not zero */
+        /* get parent of quadrant near cut */
+        p4est_quadrant_parent (q, &parent_send[parent_index]);
+
+        /* get min quadrant with same parent */
+        min_quad_id = quad_id_near_cut;
+        for (iq = quad_id_near_cut;
+             iq >= SC_MAX (partition_now[rank] + tree->quadrants_offset,
+                           partition_new[i] - P4EST_CHILDREN + 1); iq--) {
+          /* loop over eligible quadrants */
+          /* get quadrant with index `iq` */
+          q = p4est_quadrant_array_index (&tree->quadrants,
+                                          iq - partition_now[rank] -
+                                          tree->quadrants_offset);
+
+          /* check quadrant `iq` */
+          if (q->level == quad_near_cut_level) {        /* if same level */
+            if (p4est_quadrant_is_parent (&parent_send[parent_index], q)) {
+              /* if same parent */
+              min_quad_id = iq;
+            }
+            else {
+              break;
+            }
+          }
+          else {
+            break;
+          }
+        }
+
+        /* get max quadrant with same parent */
+        max_quad_id = quad_id_near_cut;
+        for (iq = quad_id_near_cut;
+             iq <=
+             SC_MIN (partition_now[rank] + tree->quadrants_offset +
+                     num_quadrants_in_tree - 1,
+                     partition_new[i] + P4EST_CHILDREN - 2); iq++) {
+          /* loop over eligible quadrants */
+
+          /* get quadrant `iq` */
+          q = p4est_quadrant_array_index (&tree->quadrants,
+                                          iq - partition_now[rank] -
+                                          tree->quadrants_offset);
+
+          /* check quadrant `iq` */
+          if (q->level == quad_near_cut_level) {        /* if same level */
+            if (p4est_quadrant_is_parent (&parent_send[parent_index], q)) {
+              /* if same parent */
+              max_quad_id = iq;
+            }
+            else {
+              break;
+            }
+          }
+          else {
+            break;
+          }
+        }
+
+        /* write tree */
+        parent_send[parent_index].p.piggy3.which_tree = tree_index;
+
+        if (quad_id_near_cut == partition_new[i]) {
+          /* if this process has cut */
+          /* encode number of quadrants with same parent before and after
+           * `partition_new[i]` into one integer */
+          parent_send[parent_index].p.piggy3.local_num =
+            (partition_new[i] - min_quad_id) * P4EST_CHILDREN +
+            (max_quad_id - partition_new[i]);
+        }
+        else {
+          /* write number of quadrants with same parent */
+          parent_send[parent_index].p.piggy3.local_num =
+            max_quad_id - min_quad_id + 1;
+        }
+
+        /* MPI send: parent */
+        mpiret = MPI_Isend (&parent_send[parent_index],
+                            sizeof (p4est_quadrant_t), MPI_BYTE,
+                            i,
+                            P4EST_COMM_PARTITION_CORRECTION, p4est->mpicomm,
+                            &send_requests[parent_index]);
+        SC_CHECK_MPI (mpiret);
+      }
+      else {                    /* if quadrant near cut is root of tree, i.e. level is zero */
+        /* set parent as tree root `q` */
+        parent_send[parent_index].level = q->level;
+        parent_send[parent_index].x = q->x;
+        parent_send[parent_index].y = q->y;
+#ifdef P4_TO_P8
+        parent_send[parent_index].z = q->z;
+#endif
+
+        /* write tree */
+        parent_send[parent_index].p.piggy3.which_tree = tree_index;
+
+        /* write number of quadrants with same "parent" */
+        parent_send[parent_index].p.piggy3.local_num = 1;
+
+        /* MPI send: root of tree */
+        mpiret = MPI_Isend (&parent_send[parent_index],
+                            sizeof (p4est_quadrant_t), MPI_BYTE,
+                            i,
+                            P4EST_COMM_PARTITION_CORRECTION, p4est->mpicomm,
+                            &send_requests[parent_index]);
+        SC_CHECK_MPI (mpiret);
+      }
+
+      /* increment parent index */
+      parent_index++;
+    }
+  }
+  /* END: send */
+
+  /* BEGIN: receive */
+  if (rank != 0 && partition_new[rank] < partition_new[rank + 1]) {
+    /* if this process should get quadrants */
+    /* determine process ids to receive from */
+    num_receives = 0;           /* number of receives */
+    receive_lowest = num_procs; /* lowest process id */
+    receive_highest = 0;        /* highest process id */
+    for (i = 0; i < num_procs; i++) {   /* loop over all processes */
+      if (partition_now[i] < partition_now[i + 1] &&
+          partition_now[i] <= partition_new[rank] + P4EST_CHILDREN - 2 &&
+          partition_new[rank] - P4EST_CHILDREN + 1 < partition_now[i + 1]) {
+        /* if process `i` has relevant quadrants for this process */
+        num_receives++;
+        receive_lowest = SC_MIN (receive_lowest, i);
+        receive_highest = SC_MAX (receive_highest, i);
+
+        if (partition_now[i] <= partition_new[rank] &&
+            partition_new[rank] < partition_now[i + 1]) {
+          /* if cut is owned by process `i` */
+          /* process id that sends parent of cut quadrant */
+          process_with_cut = i;
+
+          /* array index of receive messages of process with cut  */
+          process_with_cut_recv_id = num_receives - 1;
+        }
+      }
+    }
+  }
+  else {
+    /* set number of messages to receive */
+    num_receives = 0;
+
+    /* set correction */
+    correction_local = 0;
+  }
+
+  if (num_receives > 0) {       /* if this process receives messages */
+    /* allocate receive messages */
+    receive_requests = P4EST_ALLOC (MPI_Request, num_receives);
+    parent_receive = P4EST_ALLOC (p4est_quadrant_t, num_receives);
+    receive_process = P4EST_ALLOC (int, num_receives);
+
+    /* array index of receive messages */
+    parent_index = 0;
+
+    for (i = receive_lowest; i <= receive_highest; i++) {
+      /* loop over all process candidates to receive from */
+      if (!(partition_now[i] < partition_now[i + 1] &&
+            partition_now[i] <= partition_new[rank] + P4EST_CHILDREN - 2 &&
+            partition_new[rank] - P4EST_CHILDREN + 1 <
+            partition_now[i + 1])) {
+        /* if process `i` has no relevant quadrants for this process */
+        continue;
+      }
+      /* store process index */
+      receive_process[parent_index] = i;
+
+      /* MPI receive */
+      mpiret = MPI_Irecv (&parent_receive[parent_index],
+                          sizeof (p4est_quadrant_t), MPI_BYTE,
+                          i,
+                          P4EST_COMM_PARTITION_CORRECTION, p4est->mpicomm,
+                          &receive_requests[parent_index]);
+      SC_CHECK_MPI (mpiret);
+
+      /* increment parent index */
+      parent_index++;
+    }
+  }
+  /* END: receive */
+
+  /* BEGIN: wait for MPI communication to complete */
+  if (num_sends > 0) {
+    /* wait for sends to complete */
+    mpiret = MPI_Waitall (num_sends, send_requests, MPI_STATUSES_IGNORE);
+    SC_CHECK_MPI (mpiret);
+
+    /* free send memory */
+    P4EST_FREE (parent_send);
+    P4EST_FREE (send_requests);
+  }
+
+  if (num_receives > 0) {
+    /* wait for receives to complete */
+    mpiret =
+      MPI_Waitall (num_receives, receive_requests, MPI_STATUSES_IGNORE);
+    SC_CHECK_MPI (mpiret);
+
+    /* free receive memory */
+    P4EST_FREE (receive_requests);
+  }
+  /* END: wait for MPI communication to complete */
+
+  /* BEGIN: compute correction with received quadrants */
+  if (num_receives > 0) {
+    /* if this process received quadrants */
+    min_quad_id = partition_new[rank];  /* min quadrant id with same parent */
+    max_quad_id = partition_new[rank];  /* max quadrant id with same parent */
+
+    for (i = 0; i < num_receives; i++) {
+      /* loop over all received (parent or tree root) quadrants */
+      if (parent_receive[i].p.piggy3.which_tree ==
+          parent_receive[process_with_cut_recv_id].p.piggy3.which_tree
+          &&
+          p4est_quadrant_is_equal (&parent_receive[i],
+                                   &parent_receive[process_with_cut_recv_id]
+          )) {
+        /* if trees and parents are equal */
+        /* decrease/increase min/max quadrant with same parent */
+        if (receive_process[i] < process_with_cut) {
+          /* if before process with cut */
+          /* decrease min quadrant */
+          min_quad_id -= parent_receive[i].p.piggy3.local_num;
+        }
+        else if (receive_process[i] > process_with_cut) {
+          /* if after process with cut */
+          /* increase max quadrant */
+          max_quad_id += parent_receive[i].p.piggy3.local_num;
+        }
+        else {
+          /* decrease min quadrant */
+          min_quad_id -=
+            parent_receive[i].p.piggy3.local_num / P4EST_CHILDREN;
+
+          /* increase max quadrant */
+          max_quad_id +=
+            parent_receive[i].p.piggy3.local_num % P4EST_CHILDREN;
+        }
+      }
+    }
+
+    /* compute correction */
+    correction_local =
+      (int) p4est_partition_correction (partition_new, num_procs, rank,
+                                        min_quad_id, max_quad_id);
+
+    /* free receive memory */
+    P4EST_FREE (parent_receive);
+    P4EST_FREE (receive_process);
+  }
+  /* END: compute correction with received parent quadrants */
+
+  /* free memory */
+  P4EST_FREE (partition_new);
+
+  /* communicate corrections */
+  correction = P4EST_ALLOC (int, num_procs);
+  mpiret = MPI_Allgather (&correction_local, 1, MPI_INT,
+                          correction, 1, MPI_INT, p4est->mpicomm);
+  SC_CHECK_MPI (mpiret);
+
+  /* correct partition */
+  current_proc =
+    p4est_next_nonempty_process (0, num_procs, num_quadrants_in_proc);
+  next_proc =
+    p4est_next_nonempty_process (current_proc + 1, num_procs,
+                                 num_quadrants_in_proc);
+  num_moved_quadrants = 0;
+  while (current_proc < num_procs) {
+    /* loop over all non empty processes */
+    /* compute correct partition for process `current_proc` */
+    if (0 < current_proc && current_proc < num_procs) {
+      /* if any process but first */
+      num_quadrants_in_proc[current_proc] += correction[current_proc];
+      num_moved_quadrants += (p4est_locidx_t) abs (correction[current_proc]);
+    }
+    if (current_proc == 0 || next_proc < num_procs) {
+      /* if first process or next process is feasible */
+      num_quadrants_in_proc[current_proc] -= correction[next_proc];
+    }
+
+    /* increase process ids */
+    current_proc = next_proc;
+    next_proc =
+      p4est_next_nonempty_process (next_proc + 1, num_procs,
+                                   num_quadrants_in_proc);
+  }
+
+  /* free memory */
+  P4EST_FREE (correction);
+
+  /* return absolute number of moved quadrants */
+  return num_moved_quadrants;
+}
+
+#endif
+
+unsigned
+p4est_checksum (p4est_t * p4est)
+{
+  uLong               treecrc, crc;
+  size_t              scount, ssum;
+  p4est_topidx_t      nt;
+  p4est_tree_t       *tree;
+  sc_array_t          checkarray;
+
+  P4EST_ASSERT (p4est_is_valid (p4est));
+
+  sc_array_init (&checkarray, 4);
+  crc = adler32 (0, Z_NULL, 0);
+  ssum = 0;
+  for (nt = p4est->first_local_tree; nt <= p4est->last_local_tree; ++nt) {
+    tree = p4est_tree_array_index (p4est->trees, nt);
+    treecrc =
+      (uLong) p4est_quadrant_checksum (&tree->quadrants, &checkarray, 0);
+    scount = 4 * checkarray.elem_count;
+    ssum += scount;
+    crc = adler32_combine (crc, treecrc, (z_off_t) scount);
+  }
+  sc_array_reset (&checkarray);
+  P4EST_ASSERT ((p4est_locidx_t) ssum ==
+                p4est->local_num_quadrants * 4 * (P4EST_DIM + 1));
+
+  return p4est_comm_checksum (p4est, (unsigned) crc, ssum);
+}
+
+p4est_checksum_cache_t *
+p4est_checksum_cache_new (p4est_t * p4est)
+{
+  p4est_checksum_cache_t *cache;
+  const p4est_topidx_t num_trees = p4est->connectivity->num_trees;
+
+  cache = P4EST_ALLOC (p4est_checksum_cache_t, 1);
+  cache->num_trees = num_trees;
+  cache->tree_crcs = P4EST_ALLOC (unsigned, num_trees);
+  cache->tree_counts = P4EST_ALLOC (p4est_locidx_t, num_trees);
+  cache->dirty = P4EST_ALLOC (int8_t, num_trees);
+  memset (cache->dirty, 1, (size_t) num_trees * sizeof (int8_t));
+
+  return cache;
+}
+
+void
+p4est_checksum_cache_mark (p4est_checksum_cache_t * cache,
+                           p4est_topidx_t which_tree)
+{
+  P4EST_ASSERT (0 <= which_tree && which_tree < cache->num_trees);
+
+  cache->dirty[which_tree] = 1;
+}
+
+unsigned
+p4est_checksum_cached (p4est_t * p4est, p4est_checksum_cache_t * cache)
+{
+  uLong               crc;
+  size_t              scount, ssum;
+  p4est_topidx_t      nt;
+  p4est_tree_t       *tree;
+  sc_array_t          checkarray;
+
+  P4EST_ASSERT (p4est_is_valid (p4est));
+  P4EST_ASSERT (cache->num_trees == p4est->connectivity->num_trees);
+
+  sc_array_init (&checkarray, 4);
+  crc = adler32 (0, Z_NULL, 0);
+  ssum = 0;
+  for (nt = p4est->first_local_tree; nt <= p4est->last_local_tree; ++nt) {
+    tree = p4est_tree_array_index (p4est->trees, nt);
+    if (cache->dirty[nt] || cache->tree_counts[nt] !=
+        (p4est_locidx_t) tree->quadrants.elem_count) {
+      cache->tree_crcs[nt] =
+        p4est_quadrant_checksum (&tree->quadrants, &checkarray, 0);
+      cache->tree_counts[nt] = (p4est_locidx_t) tree->quadrants.elem_count;
+      cache->dirty[nt] = 0;
+    }
+    scount = 4 * (P4EST_DIM + 1) * (size_t) cache->tree_counts[nt];
+    ssum += scount;
+    crc = adler32_combine (crc, (uLong) cache->tree_crcs[nt],
+                           (z_off_t) scount);
+  }
+  sc_array_reset (&checkarray);
+  P4EST_ASSERT ((p4est_locidx_t) ssum ==
+                p4est->local_num_quadrants * 4 * (P4EST_DIM + 1));
+
+  return p4est_comm_checksum (p4est, (unsigned) crc, ssum);
+}
+
+void
+p4est_checksum_cache_destroy (p4est_checksum_cache_t * cache)
+{
+  P4EST_FREE (cache->tree_crcs);
+  P4EST_FREE (cache->tree_counts);
+  P4EST_FREE (cache->dirty);
+  P4EST_FREE (cache);
+}
+
+void
+p4est_save (const char *filename, p4est_t * p4est, int save_data)
+{
+  p4est_save_ext (filename, p4est, save_data, 1);
+}
+
+/** Write connectivity and header information for a forest checkpoint.
+ * The header is written by processor zero only; this call is collective
+ * since all processors compute the cumulative per-tree quadrant counts.
+ * When \a num_fields is positive, \a save_data must be 2 and a block of
+ * field descriptors follows the per-tree counts so a loader can undo
+ * the per-field precision conversion.
+ * \param [out] fpos    On processor zero the aligned file position where
+ *                      the quadrant storage begins.
+ * \return              In sequential write mode the file left open on
+ *                      processor zero, NULL otherwise.
+ */
+static FILE        *
+p4est_save_header (const char *filename, p4est_t * p4est,
+                   size_t data_size, int save_data, int save_partition,
+                   int num_fields, const size_t *field_sizes,
+                   const int *field_double, long *fpos)
+{
+  const int           headc = 6;
+  const int           align = 32;
+  int                 retval;
+  int                 num_procs, save_num_procs, rank;
+  int                 i;
+  long                fp = -1;
+  size_t              head_count, zi;
+  uint64_t           *u64a;
+  FILE               *file;
+  p4est_topidx_t      jt, num_trees;
+  p4est_gloidx_t     *pertree;
+
+  P4EST_ASSERT (num_fields == 0 || save_data == 2);
+
+  /* other parameters */
+  num_trees = p4est->connectivity->num_trees;
+  num_procs = p4est->mpisize;
+  save_num_procs = save_partition ? num_procs : 1;
+  head_count = (size_t) (headc + save_num_procs) + (size_t) num_trees +
+    (num_fields > 0 ? (size_t) (1 + 2 * num_fields) : 0);
+  rank = p4est->mpirank;
+  pertree = P4EST_ALLOC (p4est_gloidx_t, num_trees + 1);
+  /* only the writing rank consumes the counts below */
+  p4est_comm_count_pertree_root (p4est, 0, pertree);
+
+  if (rank == 0) {
+    p4est_connectivity_save (filename, p4est->connectivity);
+
+    /* open file after writing connectivity to it */
+    file = fopen (filename, "ab");
+    SC_CHECK_ABORT (file != NULL, "file open");
+
+    /* align the start of the header */
+    fp = ftell (file);
+    SC_CHECK_ABORT (fp > 0, "first file tell");
+    while (fp % align != 0) {
+      retval = fputc ('\0', file);
+      SC_CHECK_ABORT (retval == 0, "first file align");
+      ++fp;
+    }
+
+    /* write format and partition information */
+    u64a = P4EST_ALLOC (uint64_t, head_count);
+    u64a[0] = P4EST_ONDISK_FORMAT;
+    u64a[1] = (uint64_t) sizeof (p4est_qcoord_t);
+    u64a[2] = (uint64_t) sizeof (p4est_quadrant_t);
+    u64a[3] = (uint64_t) data_size;
+    u64a[4] = (uint64_t) save_data;
+    u64a[5] = (uint64_t) save_num_procs;
+    if (save_partition) {
+      P4EST_ASSERT (save_num_procs == num_procs);
+      for (i = 0; i < num_procs; ++i) {
+        u64a[headc + i] = (uint64_t) p4est->global_first_quadrant[i + 1];
+      }
+    }
+    else {
+      P4EST_ASSERT (save_num_procs == 1);
+      u64a[headc] = (uint64_t) p4est->global_first_quadrant[num_procs];
+    }
+    for (jt = 0; jt < num_trees; ++jt) {
+      u64a[headc + save_num_procs + jt] = (uint64_t) pertree[jt + 1];
+    }
+    if (num_fields > 0) {
+      /* describe the user data fields and their storage precision */
+      zi = (size_t) (headc + save_num_procs) + (size_t) num_trees;
+      u64a[zi++] = (uint64_t) num_fields;
+      for (i = 0; i < num_fields; ++i) {
+        u64a[zi++] = (uint64_t) field_sizes[i];
+        u64a[zi++] = (uint64_t) field_double[i];
+      }
+      P4EST_ASSERT (zi == head_count);
+    }
+    sc_fwrite (u64a, sizeof (uint64_t), head_count,
+               file, "write header information");
+    P4EST_FREE (u64a);
+    fp += head_count * sizeof (uint64_t);
+
+    /* align the start of the quadrants */
+    fp = ftell (file);
+    SC_CHECK_ABORT (fp > 0, "second file tell");
+    while (fp % align != 0) {
+      retval = fputc ('\0', file);
+      SC_CHECK_ABORT (retval == 0, "second file align");
+      ++fp;
+    }
+
+#ifdef P4EST_MPIIO_WRITE
+    /* We will close the sequential access to the file */
+    /* best attempt to flush file to disk */
+    retval = fflush (file);
+    SC_CHECK_ABORT (retval == 0, "file flush");
+#ifdef P4EST_HAVE_FSYNC
+    retval = fsync (fileno (file));
+    SC_CHECK_ABORT (retval == 0, "file fsync");
+#endif
+    retval = fclose (file);
+    SC_CHECK_ABORT (retval == 0, "file close");
+    file = NULL;
+#else
+    /* file is still open for sequential write mode */
+#endif
+  }
+  else {
+    file = NULL;
+  }
+  P4EST_FREE (pertree);
+  *fpos = fp;
+
+  return file;
+}
+
+/** Compute the on-disk byte count of one quadrant's user data when
+ * fields flagged as double arrays are stored in float precision.
+ */
+static size_t
+p4est_save_fields_size (int num_fields, const size_t *field_sizes,
+                        const int *field_double)
+{
+  int                 i;
+  size_t              store_size = 0;
+
+  for (i = 0; i < num_fields; ++i) {
+    if (field_double[i]) {
+      P4EST_ASSERT (field_sizes[i] % sizeof (double) == 0);
+      store_size += (field_sizes[i] / sizeof (double)) * sizeof (float);
+    }
+    else {
+      store_size += field_sizes[i];
+    }
+  }
+  return store_size;
+}
+
+/** Convert one quadrant's user data to storage precision.
+ * Fields flagged as double arrays are written as floats.
+ */
+static void
+p4est_save_fields_down (const char *src, char *dest, int num_fields,
+                        const size_t *field_sizes, const int *field_double)
+{
+  int                 i;
+  size_t              zz, n;
+  const double       *in;
+  float              *out;
+
+  for (i = 0; i < num_fields; ++i) {
+    if (field_double[i]) {
+      n = field_sizes[i] / sizeof (double);
+      in = (const double *) src;
+      out = (float *) dest;
+      for (zz = 0; zz < n; ++zz) {
+        out[zz] = (float) in[zz];
+      }
+      dest += n * sizeof (float);
+    }
+    else {
+      memcpy (dest, src, field_sizes[i]);
+      dest += field_sizes[i];
+    }
+    src += field_sizes[i];
+  }
+}
+
+/** Convert one quadrant's user data back to memory precision.
+ * Fields flagged as double arrays are read from floats.
+ */
+static void
+p4est_save_fields_up (const char *src, char *dest, int num_fields,
+                      const size_t *field_sizes, const int *field_double)
+{
+  int                 i;
+  size_t              zz, n;
+  const float        *in;
+  double             *out;
+
+  for (i = 0; i < num_fields; ++i) {
+    if (field_double[i]) {
+      n = field_sizes[i] / sizeof (double);
+      in = (const float *) src;
+      out = (double *) dest;
+      for (zz = 0; zz < n; ++zz) {
+        out[zz] = (double) in[zz];
+      }
+      src += n * sizeof (float);
+    }
+    else {
+      memcpy (dest, src, field_sizes[i]);
+      src += field_sizes[i];
+    }
+    dest += field_sizes[i];
+  }
+}
+
+#ifdef P4EST_SAVE_WRITEV
+
+/** Write \a count io vectors to \a fd, retrying after short writes.
+ * The vector array is modified while partial writes are consumed.
+ */
+static void
+p4est_save_writev (int fd, struct iovec *iov, size_t count)
+{
+  int                 nvec;
+  size_t              zz = 0;
+  ssize_t             nw;
+
+  while (zz < count) {
+    nvec = (int) SC_MIN (count - zz, (size_t) P4EST_SAVE_IOV_MAX);
+    nw = writev (fd, iov + zz, nvec);
+    SC_CHECK_ABORT (nw >= 0, "writev quadrants");
+    while (nw > 0) {
+      if ((size_t) nw >= iov[zz].iov_len) {
+        nw -= (ssize_t) iov[zz].iov_len;
+        ++zz;
+      }
+      else {
+        iov[zz].iov_base = (char *) iov[zz].iov_base + nw;
+        iov[zz].iov_len -= (size_t) nw;
+        nw = 0;
+      }
+    }
+  }
+}
+
+#endif /* P4EST_SAVE_WRITEV */
+
+#ifdef P4EST_MPIIO_WRITE
+
+/** Pack all local quadrant coordinates and data interleaved into \a lbuf.
+ * The buffer must provide comb_size bytes for each local quadrant.
+ */
+static void
+p4est_save_pack (p4est_t * p4est, size_t data_size, int save_data,
+                 size_t comb_size, char *lbuf)
+{
+  size_t              zz;
+  p4est_topidx_t      jt;
+  p4est_tree_t       *tree;
+  p4est_quadrant_t   *q;
+  char               *bp;
+  p4est_qcoord_t     *qpos;
+  sc_array_t         *tquadrants;
+
+  bp = lbuf;
+  for (jt = p4est->first_local_tree; jt <= p4est->last_local_tree; ++jt) {
+    tree = p4est_tree_array_index (p4est->trees, jt);
+    tquadrants = &tree->quadrants;
+    for (zz = 0; zz < tquadrants->elem_count; ++zz) {
+      qpos = (p4est_locidx_t *) bp;
+      q = p4est_quadrant_array_index (tquadrants, zz);
+      *qpos++ = q->x;
+      *qpos++ = q->y;
+#ifdef P4_TO_P8
+      *qpos++ = q->z;
+#endif
+      *qpos++ = (p4est_qcoord_t) q->level;
+      if (save_data) {
+        memcpy (qpos, q->p.user_data, data_size);
+      }
+      bp += comb_size;
+    }
+  }
+  P4EST_ASSERT (bp ==
+                lbuf + comb_size * (size_t) p4est->local_num_quadrants);
+}
+
+/** Pack all local quadrants with field-wise precision conversion.
+ * The buffer must provide comb_size bytes for each local quadrant.
+ */
+static void
+p4est_save_pack_mixed (p4est_t * p4est, size_t comb_size, int num_fields,
+                       const size_t *field_sizes, const int *field_double,
+                       char *lbuf)
+{
+  const size_t        qbuf_size =
+    (P4EST_DIM + 1) * sizeof (p4est_qcoord_t);
+  size_t              zz;
+  p4est_topidx_t      jt;
+  p4est_tree_t       *tree;
+  p4est_quadrant_t   *q;
+  char               *bp;
+  p4est_qcoord_t     *qpos;
+  sc_array_t         *tquadrants;
+
+  bp = lbuf;
+  for (jt = p4est->first_local_tree; jt <= p4est->last_local_tree; ++jt) {
+    tree = p4est_tree_array_index (p4est->trees, jt);
+    tquadrants = &tree->quadrants;
+    for (zz = 0; zz < tquadrants->elem_count; ++zz) {
+      qpos = (p4est_locidx_t *) bp;
+      q = p4est_quadrant_array_index (tquadrants, zz);
+      *qpos++ = q->x;
+      *qpos++ = q->y;
+#ifdef P4_TO_P8
+      *qpos++ = q->z;
+#endif
+      *qpos++ = (p4est_qcoord_t) q->level;
+      p4est_save_fields_down ((const char *) q->p.user_data,
+                              bp + qbuf_size, num_fields,
+                              field_sizes, field_double);
+      bp += comb_size;
+    }
+  }
+  P4EST_ASSERT (bp ==
+                lbuf + comb_size * (size_t) p4est->local_num_quadrants);
+}
+
+#endif /* P4EST_MPIIO_WRITE */
+
+void
+p4est_save_ext (const char *filename, p4est_t * p4est,
+                int save_data, int save_partition)
+{
+#ifdef P4EST_MPI
+  int                 mpiret;
+  MPI_Status          mpistatus;
+#endif
+  int                 retval;
+  int                 num_procs, rank;
+  long                fpos = -1;
+  size_t              data_size, qbuf_size, comb_size;
+  size_t              zcount;
+  size_t              zz;
+  p4est_topidx_t      jt;
+  p4est_tree_t       *tree;
+  p4est_quadrant_t   *q;
+  p4est_qcoord_t     *qpos;
+  sc_array_t         *tquadrants;
+  FILE               *file;
+#ifdef P4EST_MPIIO_WRITE
+  MPI_File            mpifile;
+  MPI_Offset          mpipos;
+  MPI_Offset          mpithis;
+  int                *blens;
+  MPI_Aint           *displs;
+  MPI_Datatype        ftype;
+  p4est_qcoord_t     *qbuf;
+  size_t              zq;
+#else
+  long                foffset, fthis;
+  char               *bp;
+#ifdef P4EST_SAVE_WRITEV
+  int                 fd;
+  off_t               fret;
+  p4est_qcoord_t     *qbuf;
+  struct iovec       *iov;
+#endif
+#endif
+  char               *lbuf;
+
+  P4EST_GLOBAL_PRODUCTIONF ("Into " P4EST_STRING "_save %s\n", filename);
+
+  P4EST_ASSERT (p4est_connectivity_is_valid (p4est->connectivity));
+  P4EST_ASSERT (p4est_is_valid (p4est));
+
+  /* when data is not saved the size is set to zero */
+  data_size = save_data ? p4est->data_size : 0;
+
+  /* zero data size is effectively not saved */
+  if (data_size == 0) {
+    save_data = 0;
+  }
+
+  /* other parameters */
+  num_procs = p4est->mpisize;
+  rank = p4est->mpirank;
+  qbuf_size = (P4EST_DIM + 1) * sizeof (p4est_qcoord_t);
+  comb_size = qbuf_size + data_size;
+
+  /* processor zero creates the file and writes the header */
+  file = p4est_save_header (filename, p4est, data_size, save_data,
+                            save_partition, 0, NULL, NULL, &fpos);
+
+#ifndef P4EST_MPIIO_WRITE
+  if (rank > 0) {
+    /* wait for sequential synchronization */
+#ifdef P4EST_MPI
+    mpiret = MPI_Recv (&fpos, 1, MPI_LONG, rank - 1, P4EST_COMM_SAVE,
+                       p4est->mpicomm, &mpistatus);
+    SC_CHECK_MPI (mpiret);
+#endif
+
+    /* open file after all previous processors have written to it */
+    file = fopen (filename, "rb+");
+    SC_CHECK_ABORT (file != NULL, "file open");
+  }
+#else
+  P4EST_ASSERT (file == NULL);
+  /* Every core opens the file in append mode */
+  mpiret = MPI_File_open (p4est->mpicomm, (char *) filename,
+                          MPI_MODE_WRONLY | MPI_MODE_APPEND |
+                          MPI_MODE_UNIQUE_OPEN, MPI_INFO_NULL, &mpifile);
+  SC_CHECK_MPI (mpiret);
+  mpiret = MPI_File_get_position (mpifile, &mpipos);
+  SC_CHECK_MPI (mpiret);
+#endif
+
+#ifndef P4EST_MPIIO_WRITE
+  if (rank > 0) {
+    /* seek to the beginning of this processor's storage */
+    foffset = (long) (p4est->global_first_quadrant[rank] * comb_size);
+    fthis = fpos + foffset;
+    retval = fseek (file, fthis, SEEK_SET);
+    SC_CHECK_ABORT (retval == 0, "seek data");
+  }
+
+#ifdef P4EST_SAVE_WRITEV
+  if (save_data) {
+    /* only the coordinates are staged; the data payload is handed to
+       the kernel straight from the quadrants' live storage */
+    fd = fileno (file);
+    SC_CHECK_ABORT (fd >= 0, "file descriptor");
+    retval = fflush (file);
+    SC_CHECK_ABORT (retval == 0, "flush before writev");
+    if (rank > 0) {
+      fret = lseek (fd, (off_t) fthis, SEEK_SET);
+      SC_CHECK_ABORT (fret == (off_t) fthis, "seek before writev");
+    }
+    for (jt = p4est->first_local_tree; jt <= p4est->last_local_tree; ++jt) {
+      tree = p4est_tree_array_index (p4est->trees, jt);
+      tquadrants = &tree->quadrants;
+      zcount = tquadrants->elem_count;
+
+      qpos = qbuf = P4EST_ALLOC (p4est_qcoord_t,
+                                 (P4EST_DIM + 1) * zcount);
+      iov = P4EST_ALLOC (struct iovec, 2 * zcount);
+      for (zz = 0; zz < zcount; ++zz) {
+        q = p4est_quadrant_array_index (tquadrants, zz);
+        iov[2 * zz].iov_base = qpos;
+        iov[2 * zz].iov_len = qbuf_size;
+        *qpos++ = q->x;
+        *qpos++ = q->y;
+#ifdef P4_TO_P8
+        *qpos++ = q->z;
+#endif
+        *qpos++ = (p4est_qcoord_t) q->level;
+        iov[2 * zz + 1].iov_base = q->p.user_data;
+        iov[2 * zz + 1].iov_len = data_size;
+      }
+      p4est_save_writev (fd, iov, 2 * zcount);
+      P4EST_FREE (iov);
+      P4EST_FREE (qbuf);
+    }
+  }
+  else
+#endif
+  /* write quadrant coordinates and data interleaved */
+  for (jt = p4est->first_local_tree; jt <= p4est->last_local_tree; ++jt) {
+    tree = p4est_tree_array_index (p4est->trees, jt);
+    tquadrants = &tree->quadrants;
+    zcount = tquadrants->elem_count;
+
+    /* storage that will be written for this tree */
+    bp = lbuf = P4EST_ALLOC (char, comb_size * zcount);
+    for (zz = 0; zz < zcount; ++zz) {
+      qpos = (p4est_locidx_t *) bp;
+      q = p4est_quadrant_array_index (tquadrants, zz);
+      *qpos++ = q->x;
+      *qpos++ = q->y;
+#ifdef P4_TO_P8
+      *qpos++ = q->z;
+#endif
+      *qpos++ = (p4est_qcoord_t) q->level;
+      if (save_data) {
+        memcpy (qpos, q->p.user_data, data_size);
+      }
+      bp += comb_size;
+    }
+    sc_fwrite (lbuf, comb_size, zcount, file, "write quadrants");
+    P4EST_FREE (lbuf);
+  }
+#else
+  zcount = (size_t) p4est->local_num_quadrants;
+  mpithis = mpipos +
+    (MPI_Offset) (p4est->global_first_quadrant[rank] * comb_size);
+  if (save_data) {
+    /* describe the interleaved layout with a derived datatype so the
+       data payload is read straight from the quadrants' live storage */
+    qpos = qbuf = P4EST_ALLOC (p4est_qcoord_t, (P4EST_DIM + 1) * zcount);
+    blens = P4EST_ALLOC (int, 2 * zcount);
+    displs = P4EST_ALLOC (MPI_Aint, 2 * zcount);
+    zz = 0;
+    for (jt = p4est->first_local_tree; jt <= p4est->last_local_tree; ++jt) {
+      tree = p4est_tree_array_index (p4est->trees, jt);
+      tquadrants = &tree->quadrants;
+      for (zq = 0; zq < tquadrants->elem_count; ++zq) {
+        q = p4est_quadrant_array_index (tquadrants, zq);
+        mpiret = MPI_Get_address (qpos, &displs[2 * zz]);
+        SC_CHECK_MPI (mpiret);
+        blens[2 * zz] = (int) qbuf_size;
+        *qpos++ = q->x;
+        *qpos++ = q->y;
+#ifdef P4_TO_P8
+        *qpos++ = q->z;
+#endif
+        *qpos++ = (p4est_qcoord_t) q->level;
+        mpiret = MPI_Get_address (q->p.user_data, &displs[2 * zz + 1]);
+        SC_CHECK_MPI (mpiret);
+        blens[2 * zz + 1] = (int) data_size;
+        ++zz;
+      }
+    }
+    P4EST_ASSERT (zz == (size_t) p4est->local_num_quadrants);
+    mpiret = MPI_Type_create_hindexed ((int) (2 * zz), blens, displs,
+                                       MPI_BYTE, &ftype);
+    SC_CHECK_MPI (mpiret);
+    mpiret = MPI_Type_commit (&ftype);
+    SC_CHECK_MPI (mpiret);
+    mpiret = MPI_File_write_at_all (mpifile, mpithis, MPI_BOTTOM, 1,
+                                    ftype, &mpistatus);
+    SC_CHECK_MPI (mpiret);
+    mpiret = MPI_Type_free (&ftype);
+    SC_CHECK_MPI (mpiret);
+    P4EST_FREE (displs);
+    P4EST_FREE (blens);
+    P4EST_FREE (qbuf);
+  }
+  else {
+    /* pack all local quadrants and write them in one collective call
+       at this processor's offset derived from global_first_quadrant */
+    lbuf = P4EST_ALLOC (char, comb_size * zcount);
+    p4est_save_pack (p4est, data_size, save_data, comb_size, lbuf);
+    mpiret = MPI_File_write_at_all (mpifile, mpithis, lbuf,
+                                    (int) (comb_size * zcount), MPI_BYTE,
+                                    &mpistatus);
+    SC_CHECK_MPI (mpiret);
+    P4EST_FREE (lbuf);
+  }
+#endif
+
+#ifndef P4EST_MPIIO_WRITE
+  /* best attempt to flush file to disk */
+  retval = fflush (file);
+  SC_CHECK_ABORT (retval == 0, "file flush");
+#ifdef P4EST_HAVE_FSYNC
+  retval = fsync (fileno (file));
+  SC_CHECK_ABORT (retval == 0, "file fsync");
+#endif
+  retval = fclose (file);
+  SC_CHECK_ABORT (retval == 0, "file close");
+  file = NULL;
+
+  /* initiate sequential synchronization */
+#ifdef P4EST_MPI
+  if (rank < num_procs - 1) {
+    mpiret = MPI_Send (&fpos, 1, MPI_LONG, rank + 1, P4EST_COMM_SAVE,
+                       p4est->mpicomm);
+    SC_CHECK_MPI (mpiret);
+  }
+#endif
+#else
+  mpiret = MPI_File_close (&mpifile);
+  SC_CHECK_MPI (mpiret);
+#endif
+
+  P4EST_GLOBAL_PRODUCTION ("Done " P4EST_STRING "_save\n");
+}
+
+void
+p4est_save_mixed (const char *filename, p4est_t * p4est,
+                  int save_partition, int num_fields,
+                  const size_t *field_sizes, const int *field_double)
+{
+#ifdef P4EST_MPI
+  int                 mpiret;
+  MPI_Status          mpistatus;
+#endif
+  int                 i;
+  int                 retval;
+  int                 num_procs, rank;
+  long                fpos = -1;
+  size_t              data_size, store_size, qbuf_size, comb_size;
+  size_t              zcount;
+  FILE               *file;
+#ifdef P4EST_MPIIO_WRITE
+  MPI_File            mpifile;
+  MPI_Offset          mpipos;
+  MPI_Offset          mpithis;
+#else
+  long                foffset, fthis;
+  size_t              zz;
+  p4est_topidx_t      jt;
+  p4est_tree_t       *tree;
+  p4est_quadrant_t   *q;
+  char               *bp;
+  p4est_qcoord_t     *qpos;
+  sc_array_t         *tquadrants;
+#endif
+  char               *lbuf;
+
+  P4EST_GLOBAL_PRODUCTIONF ("Into " P4EST_STRING "_save_mixed %s\n",
+                            filename);
+
+  P4EST_ASSERT (p4est_connectivity_is_valid (p4est->connectivity));
+  P4EST_ASSERT (p4est_is_valid (p4est));
+  P4EST_ASSERT (num_fields > 0);
+
+  /* the field layout must tile the in-memory data exactly */
+  data_size = 0;
+  for (i = 0; i < num_fields; ++i) {
+    P4EST_ASSERT (!field_double[i] ||
+                  field_sizes[i] % sizeof (double) == 0);
+    data_size += field_sizes[i];
+  }
+  SC_CHECK_ABORT (data_size == p4est->data_size, "field sizes mismatch");
+  store_size = p4est_save_fields_size (num_fields, field_sizes,
+                                       field_double);
+
+  /* other parameters */
+  num_procs = p4est->mpisize;
+  rank = p4est->mpirank;
+  qbuf_size = (P4EST_DIM + 1) * sizeof (p4est_qcoord_t);
+  comb_size = qbuf_size + store_size;
+
+  /* processor zero creates the file and writes the header */
+  file = p4est_save_header (filename, p4est, store_size, 2,
+                            save_partition, num_fields, field_sizes,
+                            field_double, &fpos);
+
+#ifndef P4EST_MPIIO_WRITE
+  if (rank > 0) {
+    /* wait for sequential synchronization */
+#ifdef P4EST_MPI
+    mpiret = MPI_Recv (&fpos, 1, MPI_LONG, rank - 1, P4EST_COMM_SAVE,
+                       p4est->mpicomm, &mpistatus);
+    SC_CHECK_MPI (mpiret);
+#endif
+
+    /* open file after all previous processors have written to it */
+    file = fopen (filename, "rb+");
+    SC_CHECK_ABORT (file != NULL, "file open");
+
+    /* seek to the beginning of this processor's storage */
+    foffset = (long) (p4est->global_first_quadrant[rank] * comb_size);
+    fthis = fpos + foffset;
+    retval = fseek (file, fthis, SEEK_SET);
+    SC_CHECK_ABORT (retval == 0, "seek data");
+  }
+
+  /* write quadrant coordinates and converted data tree by tree */
+  for (jt = p4est->first_local_tree; jt <= p4est->last_local_tree; ++jt) {
+    tree = p4est_tree_array_index (p4est->trees, jt);
+    tquadrants = &tree->quadrants;
+    zcount = tquadrants->elem_count;
+
+    /* storage that will be written for this tree */
+    bp = lbuf = P4EST_ALLOC (char, comb_size * zcount);
+    for (zz = 0; zz < zcount; ++zz) {
+      qpos = (p4est_locidx_t *) bp;
+      q = p4est_quadrant_array_index (tquadrants, zz);
+      *qpos++ = q->x;
+      *qpos++ = q->y;
+#ifdef P4_TO_P8
+      *qpos++ = q->z;
+#endif
+      *qpos++ = (p4est_qcoord_t) q->level;
+      p4est_save_fields_down ((const char *) q->p.user_data, (char *) qpos,
+                              num_fields, field_sizes, field_double);
+      bp += comb_size;
+    }
+    sc_fwrite (lbuf, comb_size, zcount, file, "write quadrants");
+    P4EST_FREE (lbuf);
+  }
+
+  /* best attempt to flush file to disk */
+  retval = fflush (file);
+  SC_CHECK_ABORT (retval == 0, "file flush");
+#ifdef P4EST_HAVE_FSYNC
+  retval = fsync (fileno (file));
+  SC_CHECK_ABORT (retval == 0, "file fsync");
+#endif
+  retval = fclose (file);
+  SC_CHECK_ABORT (retval == 0, "file close");
+  file = NULL;
+
+  /* initiate sequential synchronization */
+#ifdef P4EST_MPI
+  if (rank < num_procs - 1) {
+    mpiret = MPI_Send (&fpos, 1, MPI_LONG, rank + 1, P4EST_COMM_SAVE,
+                       p4est->mpicomm);
+    SC_CHECK_MPI (mpiret);
+  }
+#endif
+#else
+  P4EST_ASSERT (file == NULL);
+  /* every core opens the file in append mode */
+  mpiret = MPI_File_open (p4est->mpicomm, (char *) filename,
+                          MPI_MODE_WRONLY | MPI_MODE_APPEND |
+                          MPI_MODE_UNIQUE_OPEN, MPI_INFO_NULL, &mpifile);
+  SC_CHECK_MPI (mpiret);
+  mpiret = MPI_File_get_position (mpifile, &mpipos);
+  SC_CHECK_MPI (mpiret);
+
+  /* pack all local quadrants and write them in one collective call */
+  zcount = (size_t) p4est->local_num_quadrants;
+  lbuf = P4EST_ALLOC (char, comb_size * zcount);
+  p4est_save_pack_mixed (p4est, comb_size, num_fields,
+                         field_sizes, field_double, lbuf);
+  mpithis = mpipos +
+    (MPI_Offset) (p4est->global_first_quadrant[rank] * comb_size);
+  mpiret = MPI_File_write_at_all (mpifile, mpithis, lbuf,
+                                  (int) (comb_size * zcount), MPI_BYTE,
+                                  &mpistatus);
+  SC_CHECK_MPI (mpiret);
+  P4EST_FREE (lbuf);
+
+  mpiret = MPI_File_close (&mpifile);
+  SC_CHECK_MPI (mpiret);
+#endif
+
+  P4EST_GLOBAL_PRODUCTION ("Done " P4EST_STRING "_save_mixed\n");
+}
+
+/** A checkpoint in progress between begin and end. */
+struct p4est_checkpoint
+{
+  char               *buffer;   /* staging copy of the local quadrants */
+  size_t              byte_count;       /* size of the staging buffer */
+#ifdef P4EST_MPIIO_WRITE
+  MPI_File            mpifile;  /* file with the split collective pending */
+#endif
+};
+
+p4est_checkpoint_t *
+p4est_checkpoint_begin (const char *filename, p4est_t * p4est,
+                        int save_data)
+{
+  size_t              data_size;
+  p4est_checkpoint_t *cp;
+#ifdef P4EST_MPIIO_WRITE
+  int                 mpiret;
+  long                fpos;
+  size_t              comb_size;
+  FILE               *file;
+  MPI_Offset          mpipos;
+  MPI_Offset          mpithis;
+#endif
+
+  P4EST_GLOBAL_PRODUCTIONF ("Into " P4EST_STRING "_checkpoint_begin %s\n",
+                            filename);
+
+  P4EST_ASSERT (p4est_connectivity_is_valid (p4est->connectivity));
+  P4EST_ASSERT (p4est_is_valid (p4est));
+
+  /* when data is not saved the size is set to zero */
+  data_size = save_data ? p4est->data_size : 0;
+
+  /* zero data size is effectively not saved */
+  if (data_size == 0) {
+    save_data = 0;
+  }
+
+  cp = P4EST_ALLOC (p4est_checkpoint_t, 1);
+
+#ifdef P4EST_MPIIO_WRITE
+  comb_size = (P4EST_DIM + 1) * sizeof (p4est_qcoord_t) + data_size;
+
+  /* processor zero creates the file and writes the header */
+  file = p4est_save_header (filename, p4est, data_size, save_data, 1,
+                            0, NULL, NULL, &fpos);
+  P4EST_ASSERT (file == NULL);
+
+  /* snapshot the local quadrants into the staging buffer */
+  cp->byte_count = comb_size * (size_t) p4est->local_num_quadrants;
+  cp->buffer = P4EST_ALLOC (char, cp->byte_count);
+  p4est_save_pack (p4est, data_size, save_data, comb_size, cp->buffer);
+
+  /* start the split collective write; the forest is free to change now */
+  mpiret = MPI_File_open (p4est->mpicomm, (char *) filename,
+                          MPI_MODE_WRONLY | MPI_MODE_APPEND |
+                          MPI_MODE_UNIQUE_OPEN, MPI_INFO_NULL,
+                          &cp->mpifile);
+  SC_CHECK_MPI (mpiret);
+  mpiret = MPI_File_get_position (cp->mpifile, &mpipos);
+  SC_CHECK_MPI (mpiret);
+  mpithis = mpipos +
+    (MPI_Offset) (p4est->global_first_quadrant[p4est->mpirank] *
+                  comb_size);
+  mpiret = MPI_File_write_at_all_begin (cp->mpifile, mpithis, cp->buffer,
+                                        (int) cp->byte_count, MPI_BYTE);
+  SC_CHECK_MPI (mpiret);
+#else
+  /* without MPI-IO the file is written before this call returns */
+  p4est_save_ext (filename, p4est, save_data, 1);
+  cp->buffer = NULL;
+  cp->byte_count = 0;
+#endif
+
+  P4EST_GLOBAL_PRODUCTION ("Done " P4EST_STRING "_checkpoint_begin\n");
+
+  return cp;
+}
+
+void
+p4est_checkpoint_end (p4est_checkpoint_t * cp)
+{
+#ifdef P4EST_MPIIO_WRITE
+  int                 mpiret;
+  MPI_Status          mpistatus;
+
+  mpiret = MPI_File_write_at_all_end (cp->mpifile, cp->buffer, &mpistatus);
+  SC_CHECK_MPI (mpiret);
+  mpiret = MPI_File_close (&cp->mpifile);
+  SC_CHECK_MPI (mpiret);
+  P4EST_FREE (cp->buffer);
+#else
+  P4EST_ASSERT (cp->buffer == NULL);
+#endif
+  P4EST_FREE (cp);
+
+  P4EST_GLOBAL_PRODUCTION ("Done " P4EST_STRING "_checkpoint_end\n");
+}
+
+p4est_t            *
+p4est_load (const char *filename, MPI_Comm mpicomm, size_t data_size,
+            int load_data, void *user_pointer,
+            p4est_connectivity_t ** connectivity)
+{
+  return p4est_load_ext (filename, mpicomm, data_size, load_data,
+                         0, 0, user_pointer, connectivity);
+}
+
+p4est_t            *
+p4est_load_ext (const char *filename, MPI_Comm mpicomm, size_t data_size,
+                int load_data, int autopartition, int broadcasthead,
+                void *user_pointer, p4est_connectivity_t ** connectivity)
+{
+  const int           headc = 6;
+  const int           align = 32;
+  int                 retval;
+  int                 mpiret;
+  int                 num_procs, rank;
+  int                 save_num_procs;
+  int                 save_data;
+  int                 i;
+  uint64_t           *u64a, u64int;
+  size_t              save_data_size;
+  size_t              qbuf_size, comb_size, head_count;
+  size_t              zz, zcount, zpadding;
+  FILE               *file;
+#ifdef P4EST_MPIIO
+  long                fpos;
+  MPI_File            mpifile;
+  MPI_Offset          mpithis;
+  MPI_Status          mpistatus;
+  char               *bp;
+#endif
+  p4est_topidx_t      jt, num_trees;
+  p4est_gloidx_t     *gfq;
+  p4est_gloidx_t     *pertree;
+  p4est_qcoord_t     *qap;
+  p4est_connectivity_t *conn;
+  p4est_t            *p4est;
+  sc_array_t         *qarr, *darr;
+  sc_io_source_t     *src;
+  char               *dap, *lbuf;
+
+  P4EST_GLOBAL_PRODUCTIONF ("Into " P4EST_STRING "_load %s\n", filename);
+
+  SC_CHECK_ABORT (!broadcasthead, "Header broadcast not implemented");
+
+  /* retrieve MPI information */
+  mpiret = MPI_Comm_size (mpicomm, &num_procs);
+  SC_CHECK_MPI (mpiret);
+  mpiret = MPI_Comm_rank (mpicomm, &rank);
+  SC_CHECK_MPI (mpiret);
+
+  /* open file on all processors */
+  file = fopen (filename, "rb");
+  SC_CHECK_ABORT (file != NULL, "file open");
+
+  /* read connectivity */
+  src = sc_io_source_new (SC_IO_TYPE_FILEFILE, SC_IO_ENCODE_NONE, file);
+  SC_CHECK_ABORT (src != NULL, "file source");
+  conn = *connectivity = p4est_connectivity_source (src);
+  SC_CHECK_ABORT (conn != NULL, "connectivity source");
+  retval = sc_io_source_complete (src, NULL, &zcount);
+  SC_CHECK_ABORT (!retval, "source complete");
+  zpadding = (align - zcount % align) % align;
+  retval = sc_io_source_read (src, NULL, zpadding, NULL);
+  SC_CHECK_ABORT (!retval, "source padding");
+  retval = sc_io_source_destroy (src);
+  SC_CHECK_ABORT (!retval, "source destroy");
+
+  /* set some parameters */
+  if (data_size == 0) {
+    load_data = 0;
+  }
+  num_trees = conn->num_trees;
+  qbuf_size = (P4EST_DIM + 1) * sizeof (p4est_qcoord_t);
+
+  /* read format and partition information */
+  u64a = P4EST_ALLOC (uint64_t, headc);
+  sc_fread (u64a, sizeof (uint64_t), (size_t) headc, file, "read format");
+  SC_CHECK_ABORT (u64a[0] == P4EST_ONDISK_FORMAT, "invalid format");
+  SC_CHECK_ABORT (u64a[1] == (uint64_t) sizeof (p4est_qcoord_t),
+                  "invalid coordinate size");
+  SC_CHECK_ABORT (u64a[2] == (uint64_t) sizeof (p4est_quadrant_t),
+                  "invalid quadrant size");
+  save_data_size = (size_t) u64a[3];
+  save_data = (int) u64a[4];
+  if (load_data) {
+    SC_CHECK_ABORT (save_data_size == data_size, "invalid data size");
+    SC_CHECK_ABORT (save_data, "quadrant data not saved");
+  }
+  save_num_procs = (int) u64a[5];
+  comb_size = qbuf_size + save_data_size;
+  SC_CHECK_ABORT (autopartition || num_procs == save_num_procs,
+                  "num procs mismatch");
+
+  /* create partition data */
+  gfq = P4EST_ALLOC (p4est_gloidx_t, num_procs + 1);
+  if (!autopartition) {
+    P4EST_ASSERT (num_procs == save_num_procs);
+    u64a = P4EST_REALLOC (u64a, uint64_t, num_procs);
+    sc_fread (u64a, sizeof (uint64_t), (size_t) num_procs, file,
+              "read quadrant partition");
+    gfq[0] = 0;
+    for (i = 0; i < num_procs; ++i) {
+      gfq[i + 1] = (p4est_gloidx_t) u64a[i];
+    }
+  }
+  else {
+    /* ignore saved partition and compute a new uniform one */
+    retval = fseek (file, (long) ((save_num_procs - 1) * sizeof (uint64_t)),
+                    SEEK_CUR);
+    SC_CHECK_ABORT (!retval, "seek over ignored partition");
+    sc_fread (&u64int, sizeof (uint64_t), 1, file, "read quadrant count");
+    for (i = 0; i <= num_procs; ++i) {
+      gfq[i] = (p4est_gloidx_t) ((i * u64int) / (uint64_t) num_procs);
+    }
+  }
+  zcount = (size_t) (gfq[rank + 1] - gfq[rank]);
+
+  /* read pertree data */
+  u64a = P4EST_REALLOC (u64a, uint64_t, num_trees);
+  sc_fread (u64a, sizeof (uint64_t), (size_t) num_trees, file,
+            "read pertree information");
+  pertree = P4EST_ALLOC (p4est_gloidx_t, num_trees + 1);
+  pertree[0] = 0;
+  for (jt = 0; jt < num_trees; ++jt) {
+    pertree[jt + 1] = (p4est_gloidx_t) u64a[jt];
+  }
+  SC_CHECK_ABORT (gfq[num_procs] == pertree[num_trees], "pertree mismatch");
+  P4EST_FREE (u64a);
 
-  if (num_receives > 0) {
-    /* wait for receives to complete */
-    mpiret =
-      MPI_Waitall (num_receives, receive_requests, MPI_STATUSES_IGNORE);
-    SC_CHECK_MPI (mpiret);
+  head_count = (size_t) (headc + save_num_procs) + (size_t) num_trees;
+  zpadding = (align - (head_count * sizeof (uint64_t)) % align) % align;
 
-    /* free receive memory */
-    P4EST_FREE (receive_requests);
+  /* prepare the storage filled from this processor's quadrant range */
+  qarr =
+    sc_array_new_size (sizeof (p4est_qcoord_t), (P4EST_DIM + 1) * zcount);
+  qap = (p4est_qcoord_t *) qarr->array;
+  darr = NULL;
+  dap = NULL;
+  lbuf = NULL;
+  if (load_data) {
+    P4EST_ASSERT (data_size == save_data_size && data_size > 0);
+    darr = sc_array_new_size (data_size, zcount);
+    dap = darr->array;
   }
-  /* END: wait for MPI communication to complete */
-
-  /* BEGIN: compute correction with received quadrants */
-  if (num_receives > 0) {
-    /* if this process received quadrants */
-    min_quad_id = partition_new[rank];  /* min quadrant id with same parent */
-    max_quad_id = partition_new[rank];  /* max quadrant id with same parent */
 
-    for (i = 0; i < num_receives; i++) {
-      /* loop over all received (parent or tree root) quadrants */
-      if (parent_receive[i].p.piggy3.which_tree ==
-          parent_receive[process_with_cut_recv_id].p.piggy3.which_tree
-          &&
-          p4est_quadrant_is_equal (&parent_receive[i],
-                                   &parent_receive[process_with_cut_recv_id]
-          )) {
-        /* if trees and parents are equal */
-        /* decrease/increase min/max quadrant with same parent */
-        if (receive_process[i] < process_with_cut) {
-          /* if before process with cut */
-          /* decrease min quadrant */
-          min_quad_id -= parent_receive[i].p.piggy3.local_num;
-        }
-        else if (receive_process[i] > process_with_cut) {
-          /* if after process with cut */
-          /* increase max quadrant */
-          max_quad_id += parent_receive[i].p.piggy3.local_num;
-        }
-        else {
-          /* decrease min quadrant */
-          min_quad_id -=
-            parent_receive[i].p.piggy3.local_num / P4EST_CHILDREN;
+#ifndef P4EST_MPIIO
+  /* seek to the beginning of this processor's storage */
+  if (zpadding > 0 || rank > 0) {
+    retval =
+      fseek (file, (long) (zpadding + gfq[rank] * comb_size), SEEK_CUR);
+    SC_CHECK_ABORT (retval == 0, "seek data");
+  }
 
-          /* increase max quadrant */
-          max_quad_id +=
-            parent_receive[i].p.piggy3.local_num % P4EST_CHILDREN;
-        }
+  /* read quadrant coordinates and data interleaved */
+  if (load_data) {
+    lbuf = P4EST_ALLOC (char, comb_size);
+  }
+  for (zz = 0; zz < zcount; ++zz) {
+    if (load_data) {
+      sc_fread (lbuf, comb_size, 1, file, "read quadrant with data");
+      memcpy (qap, lbuf, qbuf_size);
+      memcpy (dap, lbuf + qbuf_size, data_size);
+    }
+    else {
+      sc_fread (qap, qbuf_size, 1, file, "read quadrant with data");
+      if (save_data_size > 0) {
+        retval = fseek (file, save_data_size, SEEK_CUR);
+        SC_CHECK_ABORT (retval == 0, "seek over data");
       }
     }
-
-    /* compute correction */
-    correction_local =
-      (int) p4est_partition_correction (partition_new, num_procs, rank,
-                                        min_quad_id, max_quad_id);
-
-    /* free receive memory */
-    P4EST_FREE (parent_receive);
-    P4EST_FREE (receive_process);
+    qap += P4EST_DIM + 1;
+    dap += data_size;
   }
-  /* END: compute correction with received parent quadrants */
+  P4EST_FREE (lbuf);
 
-  /* free memory */
-  P4EST_FREE (partition_new);
+  /* close file */
+  retval = fclose (file);
+  SC_CHECK_ABORT (retval == 0, "file close");
+  file = NULL;
+#else
+  /* remember where the quadrant storage begins and leave sequential mode */
+  fpos = ftell (file);
+  SC_CHECK_ABORT (fpos > 0, "quadrant file tell");
+  fpos += (long) zpadding;
+  retval = fclose (file);
+  SC_CHECK_ABORT (retval == 0, "file close");
+  file = NULL;
 
-  /* communicate corrections */
-  correction = P4EST_ALLOC (int, num_procs);
-  mpiret = MPI_Allgather (&correction_local, 1, MPI_INT,
-                          correction, 1, MPI_INT, p4est->mpicomm);
+  /* read this processor's quadrant range in one collective call */
+  mpiret = MPI_File_open (mpicomm, (char *) filename, MPI_MODE_RDONLY,
+                          MPI_INFO_NULL, &mpifile);
+  SC_CHECK_MPI (mpiret);
+  lbuf = P4EST_ALLOC (char, comb_size * zcount);
+  mpithis = (MPI_Offset) fpos + (MPI_Offset) (gfq[rank] * comb_size);
+  mpiret = MPI_File_read_at_all (mpifile, mpithis, lbuf,
+                                 (int) (comb_size * zcount), MPI_BYTE,
+                                 &mpistatus);
+  SC_CHECK_MPI (mpiret);
+  mpiret = MPI_File_close (&mpifile);
   SC_CHECK_MPI (mpiret);
 
-  /* correct partition */
-  current_proc =
-    p4est_next_nonempty_process (0, num_procs, num_quadrants_in_proc);
-  next_proc =
-    p4est_next_nonempty_process (current_proc + 1, num_procs,
-                                 num_quadrants_in_proc);
-  num_moved_quadrants = 0;
-  while (current_proc < num_procs) {
-    /* loop over all non empty processes */
-    /* compute correct partition for process `current_proc` */
-    if (0 < current_proc && current_proc < num_procs) {
-      /* if any process but first */
-      num_quadrants_in_proc[current_proc] += correction[current_proc];
-      num_moved_quadrants += (p4est_locidx_t) abs (correction[current_proc]);
-    }
-    if (current_proc == 0 || next_proc < num_procs) {
-      /* if first process or next process is feasible */
-      num_quadrants_in_proc[current_proc] -= correction[next_proc];
+  /* unpack quadrant coordinates and data interleaved */
+  bp = lbuf;
+  for (zz = 0; zz < zcount; ++zz) {
+    memcpy (qap, bp, qbuf_size);
+    qap += P4EST_DIM + 1;
+    if (load_data) {
+      memcpy (dap, bp + qbuf_size, data_size);
+      dap += data_size;
     }
-
-    /* increase process ids */
-    current_proc = next_proc;
-    next_proc =
-      p4est_next_nonempty_process (next_proc + 1, num_procs,
-                                   num_quadrants_in_proc);
+    bp += comb_size;
   }
-
-  /* free memory */
-  P4EST_FREE (correction);
-
-  /* return absolute number of moved quadrants */
-  return num_moved_quadrants;
-}
-
+  P4EST_FREE (lbuf);
 #endif
 
-unsigned
-p4est_checksum (p4est_t * p4est)
-{
-  uLong               treecrc, crc;
-  size_t              scount, ssum;
-  p4est_topidx_t      nt;
-  p4est_tree_t       *tree;
-  sc_array_t          checkarray;
-
-  P4EST_ASSERT (p4est_is_valid (p4est));
-
-  sc_array_init (&checkarray, 4);
-  crc = adler32 (0, Z_NULL, 0);
-  ssum = 0;
-  for (nt = p4est->first_local_tree; nt <= p4est->last_local_tree; ++nt) {
-    tree = p4est_tree_array_index (p4est->trees, nt);
-    treecrc =
-      (uLong) p4est_quadrant_checksum (&tree->quadrants, &checkarray, 0);
-    scount = 4 * checkarray.elem_count;
-    ssum += scount;
-    crc = adler32_combine (crc, treecrc, (z_off_t) scount);
+  /* create p4est from accumulated information */
+  p4est = p4est_inflate (mpicomm, conn, gfq, pertree,
+                         qarr, darr, user_pointer);
+  sc_array_destroy (qarr);
+  if (darr != NULL) {
+    sc_array_destroy (darr);
   }
-  sc_array_reset (&checkarray);
-  P4EST_ASSERT ((p4est_locidx_t) ssum ==
-                p4est->local_num_quadrants * 4 * (P4EST_DIM + 1));
+  P4EST_FREE (pertree);
+  P4EST_FREE (gfq);
 
-  return p4est_comm_checksum (p4est, (unsigned) crc, ssum);
-}
+  /* assert that we loaded a valid forest and return */
+  SC_CHECK_ABORT (p4est_is_valid (p4est), "invalid forest");
+  P4EST_GLOBAL_PRODUCTIONF
+    ("Done " P4EST_STRING "_load with %lld total quadrants\n",
+     (long long) p4est->global_num_quadrants);
 
-void
-p4est_save (const char *filename, p4est_t * p4est, int save_data)
-{
-  p4est_save_ext (filename, p4est, save_data, 1);
+  return p4est;
 }
 
-void
-p4est_save_ext (const char *filename, p4est_t * p4est,
-                int save_data, int save_partition)
+p4est_t            *
+p4est_load_window (const char *filename, MPI_Comm mpicomm,
+                   size_t data_size, int load_data,
+                   p4est_topidx_t first_tree, p4est_topidx_t last_tree,
+                   void *user_pointer,
+                   p4est_connectivity_t ** connectivity)
 {
   const int           headc = 6;
   const int           align = 32;
-#ifdef P4EST_MPI
-  int                 mpiret;
-#ifndef P4EST_MPIIO_WRITE
-  MPI_Status          mpistatus;
-#endif
-#endif
   int                 retval;
-  int                 num_procs, save_num_procs, rank;
+  int                 mpiret;
+  int                 num_procs, rank;
+  int                 save_num_procs;
+  int                 save_data;
   int                 i;
-  long                fpos = -1, foffset;
-  size_t              data_size, qbuf_size, comb_size, head_count;
-  size_t              zz, zcount;
+  int                 seeked;
   uint64_t           *u64a;
+  size_t              save_data_size;
+  size_t              qbuf_size, comb_size, head_count;
+  size_t              zcount, zpadding;
+  long                fpos;
   FILE               *file;
-#ifdef P4EST_MPIIO_WRITE
-  MPI_File            mpifile;
-  MPI_Offset          mpipos;
-  MPI_Offset          mpithis;
-#else
-  long                fthis;
-#endif
   p4est_topidx_t      jt, num_trees;
-  p4est_gloidx_t     *pertree;
-  p4est_tree_t       *tree;
-  p4est_quadrant_t   *gfpos, *q;
-  char               *lbuf, *bp;
-  p4est_qcoord_t     *qpos;
-  sc_array_t         *tquadrants;
-
-  P4EST_GLOBAL_PRODUCTIONF ("Into " P4EST_STRING "_save %s\n", filename);
-
-  P4EST_ASSERT (p4est_connectivity_is_valid (p4est->connectivity));
-  P4EST_ASSERT (p4est_is_valid (p4est));
-
-  /* when data is not saved the size is set to zero */
-  data_size = save_data ? p4est->data_size : 0;
-
-  /* zero data size is effectively not saved */
-  if (data_size == 0) {
-    save_data = 0;
-  }
-
-  /* other parameters */
-  num_trees = p4est->connectivity->num_trees;
-  num_procs = p4est->mpisize;
-  save_num_procs = save_partition ? num_procs : 1;
-  head_count = (size_t) (headc + save_num_procs) + (size_t) num_trees;
-  rank = p4est->mpirank;
-  gfpos = p4est->global_first_position;
-  qbuf_size = (P4EST_DIM + 1) * sizeof (p4est_qcoord_t);
-  comb_size = qbuf_size + data_size;
-  pertree = P4EST_ALLOC (p4est_gloidx_t, num_trees + 1);
-  p4est_comm_count_pertree (p4est, pertree);
-
-  if (rank == 0) {
-    p4est_connectivity_save (filename, p4est->connectivity);
+  p4est_gloidx_t      wbegin, wend, nbefore, total;
+  p4est_gloidx_t      gg;
+  p4est_gloidx_t     *gfq;
+  p4est_gloidx_t     *pertree, *wpertree;
+  p4est_qcoord_t     *qap;
+  p4est_connectivity_t *conn;
+  p4est_t            *p4est;
+  sc_array_t         *qarr, *darr;
+  sc_io_source_t     *src;
+  char               *dap, *lbuf;
 
-    /* open file after writing connectivity to it */
-    file = fopen (filename, "ab");
-    SC_CHECK_ABORT (file != NULL, "file open");
+  P4EST_GLOBAL_PRODUCTIONF ("Into " P4EST_STRING "_load_window %s\n",
+                            filename);
 
-    /* align the start of the header */
-    fpos = ftell (file);
-    SC_CHECK_ABORT (fpos > 0, "first file tell");
-    while (fpos % align != 0) {
-      retval = fputc ('\0', file);
-      SC_CHECK_ABORT (retval == 0, "first file align");
-      ++fpos;
-    }
+  /* retrieve MPI information */
+  mpiret = MPI_Comm_size (mpicomm, &num_procs);
+  SC_CHECK_MPI (mpiret);
+  mpiret = MPI_Comm_rank (mpicomm, &rank);
+  SC_CHECK_MPI (mpiret);
 
-    /* write format and partition information */
-    u64a = P4EST_ALLOC (uint64_t, head_count);
-    u64a[0] = P4EST_ONDISK_FORMAT;
-    u64a[1] = (uint64_t) sizeof (p4est_qcoord_t);
-    u64a[2] = (uint64_t) sizeof (p4est_quadrant_t);
-    u64a[3] = (uint64_t) data_size;
-    u64a[4] = (uint64_t) save_data;
-    u64a[5] = (uint64_t) save_num_procs;
-    if (save_partition) {
-      P4EST_ASSERT (save_num_procs == num_procs);
-      for (i = 0; i < num_procs; ++i) {
-        u64a[headc + i] = (uint64_t) p4est->global_first_quadrant[i + 1];
-      }
-    }
-    else {
-      P4EST_ASSERT (save_num_procs == 1);
-      u64a[headc] = (uint64_t) p4est->global_first_quadrant[num_procs];
-    }
-    for (jt = 0; jt < num_trees; ++jt) {
-      u64a[headc + save_num_procs + jt] = (uint64_t) pertree[jt + 1];
-    }
-    sc_fwrite (u64a, sizeof (uint64_t), head_count,
-               file, "write header information");
-    P4EST_FREE (u64a);
-    fpos += head_count * sizeof (uint64_t);
+  /* open file on all processors */
+  file = fopen (filename, "rb");
+  SC_CHECK_ABORT (file != NULL, "file open");
 
-    /* align the start of the quadrants */
-    fpos = ftell (file);
-    SC_CHECK_ABORT (fpos > 0, "second file tell");
-    while (fpos % align != 0) {
-      retval = fputc ('\0', file);
-      SC_CHECK_ABORT (retval == 0, "second file align");
-      ++fpos;
-    }
+  /* read connectivity */
+  src = sc_io_source_new (SC_IO_TYPE_FILEFILE, SC_IO_ENCODE_NONE, file);
+  SC_CHECK_ABORT (src != NULL, "file source");
+  conn = *connectivity = p4est_connectivity_source (src);
+  SC_CHECK_ABORT (conn != NULL, "connectivity source");
+  retval = sc_io_source_complete (src, NULL, &zcount);
+  SC_CHECK_ABORT (!retval, "source complete");
+  zpadding = (align - zcount % align) % align;
+  retval = sc_io_source_read (src, NULL, zpadding, NULL);
+  SC_CHECK_ABORT (!retval, "source padding");
+  retval = sc_io_source_destroy (src);
+  SC_CHECK_ABORT (!retval, "source destroy");
 
-#ifdef P4EST_MPIIO_WRITE
-    /* We will close the sequential access to the file */
-    /* best attempt to flush file to disk */
-    retval = fflush (file);
-    SC_CHECK_ABORT (retval == 0, "file flush");
-#ifdef P4EST_HAVE_FSYNC
-    retval = fsync (fileno (file));
-    SC_CHECK_ABORT (retval == 0, "file fsync");
-#endif
-    retval = fclose (file);
-    SC_CHECK_ABORT (retval == 0, "file close");
-    file = NULL;
-#else
-    /* file is still open for sequential write mode */
-#endif
+  /* set some parameters */
+  if (data_size == 0) {
+    load_data = 0;
   }
-  else {
-    file = NULL;
+  num_trees = conn->num_trees;
+  qbuf_size = (P4EST_DIM + 1) * sizeof (p4est_qcoord_t);
+  SC_CHECK_ABORT (0 <= first_tree && first_tree <= last_tree &&
+                  last_tree < num_trees, "invalid tree window");
+
+  /* read format information */
+  u64a = P4EST_ALLOC (uint64_t, headc);
+  sc_fread (u64a, sizeof (uint64_t), (size_t) headc, file, "read format");
+  SC_CHECK_ABORT (u64a[0] == P4EST_ONDISK_FORMAT, "invalid format");
+  SC_CHECK_ABORT (u64a[1] == (uint64_t) sizeof (p4est_qcoord_t),
+                  "invalid coordinate size");
+  SC_CHECK_ABORT (u64a[2] == (uint64_t) sizeof (p4est_quadrant_t),
+                  "invalid quadrant size");
+  save_data_size = (size_t) u64a[3];
+  save_data = (int) u64a[4];
+  if (load_data) {
+    SC_CHECK_ABORT (save_data_size == data_size, "invalid data size");
+    SC_CHECK_ABORT (save_data, "quadrant data not saved");
   }
-  P4EST_FREE (pertree);
+  save_num_procs = (int) u64a[5];
+  comb_size = qbuf_size + save_data_size;
 
-#ifndef P4EST_MPIIO_WRITE
-  if (rank > 0) {
-    /* wait for sequential synchronization */
-#ifdef P4EST_MPI
-    mpiret = MPI_Recv (&fpos, 1, MPI_LONG, rank - 1, P4EST_COMM_SAVE,
-                       p4est->mpicomm, &mpistatus);
-    SC_CHECK_MPI (mpiret);
-#endif
+  /* the saved partition is ignored; the window is partitioned afresh */
+  retval = fseek (file, (long) (save_num_procs * sizeof (uint64_t)),
+                  SEEK_CUR);
+  SC_CHECK_ABORT (retval == 0, "seek over saved partition");
 
-    /* open file after all previous processors have written to it */
-    file = fopen (filename, "rb+");
-    SC_CHECK_ABORT (file != NULL, "file open");
+  /* read pertree data */
+  u64a = P4EST_REALLOC (u64a, uint64_t, num_trees);
+  sc_fread (u64a, sizeof (uint64_t), (size_t) num_trees, file,
+            "read pertree information");
+  pertree = P4EST_ALLOC (p4est_gloidx_t, num_trees + 1);
+  pertree[0] = 0;
+  for (jt = 0; jt < num_trees; ++jt) {
+    pertree[jt + 1] = (p4est_gloidx_t) u64a[jt];
   }
-#else
-  /* Every core opens the file in append mode */
-  mpiret = MPI_File_open (p4est->mpicomm, (char *) filename,
-                          MPI_MODE_WRONLY | MPI_MODE_APPEND |
-                          MPI_MODE_UNIQUE_OPEN, MPI_INFO_NULL, &mpifile);
-  SC_CHECK_MPI (mpiret);
-  mpiret = MPI_File_get_position (mpifile, &mpipos);
-  SC_CHECK_MPI (mpiret);
-#endif
+  P4EST_FREE (u64a);
 
-  if (rank > 0) {
-    /* seek to the beginning of this processor's storage */
-    foffset = (long) (p4est->global_first_quadrant[rank] * comb_size);
+  head_count = (size_t) (headc + save_num_procs) + (size_t) num_trees;
+  zpadding = (align - (head_count * sizeof (uint64_t)) % align) % align;
 
-#ifndef P4EST_MPIIO_WRITE
-    fthis = fpos + foffset;
-    retval = fseek (file, fthis, SEEK_SET);
-    SC_CHECK_ABORT (retval == 0, "seek data");
-#else
-    mpithis = mpipos + (MPI_Offset) foffset;
-    mpiret = MPI_File_seek (mpifile, mpithis, MPI_SEEK_SET);
-    SC_CHECK_MPI (mpiret);
-#endif
+  /* remember where the quadrant storage begins */
+  fpos = ftell (file);
+  SC_CHECK_ABORT (fpos > 0, "quadrant file tell");
+  fpos += (long) zpadding;
+
+  /* trees outside the window contribute one root quadrant each */
+  nbefore = (p4est_gloidx_t) first_tree;
+  wbegin = pertree[first_tree];
+  wend = pertree[last_tree + 1];
+  total = nbefore + (wend - wbegin) +
+    (p4est_gloidx_t) (num_trees - 1 - last_tree);
+  wpertree = P4EST_ALLOC (p4est_gloidx_t, num_trees + 1);
+  wpertree[0] = 0;
+  for (jt = 0; jt < num_trees; ++jt) {
+    wpertree[jt + 1] = wpertree[jt] +
+      ((jt < first_tree || jt > last_tree) ?
+       1 : pertree[jt + 1] - pertree[jt]);
   }
+  P4EST_ASSERT (wpertree[num_trees] == total);
 
-  /* write quadrant coordinates and data interleaved */
-  for (jt = p4est->first_local_tree; jt <= p4est->last_local_tree; ++jt) {
-    tree = p4est_tree_array_index (p4est->trees, jt);
-    tquadrants = &tree->quadrants;
-    zcount = tquadrants->elem_count;
+  /* partition the windowed forest uniformly */
+  gfq = P4EST_ALLOC (p4est_gloidx_t, num_procs + 1);
+  for (i = 0; i <= num_procs; ++i) {
+    gfq[i] = ((p4est_gloidx_t) i * total) / (p4est_gloidx_t) num_procs;
+  }
+  zcount = (size_t) (gfq[rank + 1] - gfq[rank]);
 
-    /* storage that will be written for this tree */
-    bp = lbuf = P4EST_ALLOC (char, comb_size * zcount);
-    for (zz = 0; zz < zcount; ++zz) {
-      qpos = (p4est_locidx_t *) bp;
-      q = p4est_quadrant_array_index (tquadrants, zz);
-      *qpos++ = q->x;
-      *qpos++ = q->y;
-#ifdef P4_TO_P8
-      *qpos++ = q->z;
-#endif
-      *qpos++ = (p4est_qcoord_t) q->level;
-      if (save_data) {
-        memcpy (qpos, q->p.user_data, data_size);
+  /* prepare the storage filled from this processor's quadrant range */
+  qarr =
+    sc_array_new_size (sizeof (p4est_qcoord_t), (P4EST_DIM + 1) * zcount);
+  qap = (p4est_qcoord_t *) qarr->array;
+  darr = NULL;
+  dap = NULL;
+  lbuf = NULL;
+  if (load_data) {
+    P4EST_ASSERT (data_size == save_data_size && data_size > 0);
+    darr = sc_array_new_size (data_size, zcount);
+    dap = darr->array;
+    lbuf = P4EST_ALLOC (char, comb_size);
+  }
+
+  /* synthesize placeholder roots and seek into the window's storage */
+  seeked = 0;
+  for (gg = gfq[rank]; gg < gfq[rank + 1]; ++gg) {
+    if (gg < nbefore || gg >= nbefore + (wend - wbegin)) {
+      /* a root quadrant of some tree outside the window */
+      memset (qap, 0, qbuf_size);
+      if (load_data) {
+        memset (dap, 0, data_size);
       }
-      bp += comb_size;
+      seeked = 0;
     }
-#ifndef P4EST_MPIIO_WRITE
-    sc_fwrite (lbuf, comb_size, zcount, file, "write quadrants");
-#else
-    sc_mpi_write (mpifile, lbuf, comb_size * zcount, MPI_BYTE,
-                  "write quadrants");
-#endif
-    P4EST_FREE (lbuf);
+    else {
+      if (!seeked) {
+        retval = fseek (file, fpos +
+                        (long) ((wbegin + (gg - nbefore)) * comb_size),
+                        SEEK_SET);
+        SC_CHECK_ABORT (retval == 0, "seek window data");
+        seeked = 1;
+      }
+      if (load_data) {
+        sc_fread (lbuf, comb_size, 1, file, "read quadrant with data");
+        memcpy (qap, lbuf, qbuf_size);
+        memcpy (dap, lbuf + qbuf_size, data_size);
+      }
+      else {
+        sc_fread (qap, qbuf_size, 1, file, "read quadrant");
+        if (save_data_size > 0) {
+          retval = fseek (file, (long) save_data_size, SEEK_CUR);
+          SC_CHECK_ABORT (retval == 0, "seek over data");
+        }
+      }
+    }
+    qap += P4EST_DIM + 1;
+    dap += data_size;
   }
+  P4EST_FREE (lbuf);
+  P4EST_FREE (pertree);
 
-#ifndef P4EST_MPIIO_WRITE
-  /* best attempt to flush file to disk */
-  retval = fflush (file);
-  SC_CHECK_ABORT (retval == 0, "file flush");
-#ifdef P4EST_HAVE_FSYNC
-  retval = fsync (fileno (file));
-  SC_CHECK_ABORT (retval == 0, "file fsync");
-#endif
+  /* close file */
   retval = fclose (file);
   SC_CHECK_ABORT (retval == 0, "file close");
   file = NULL;
 
-  /* initiate sequential synchronization */
-#ifdef P4EST_MPI
-  if (rank < num_procs - 1) {
-    mpiret = MPI_Send (&fpos, 1, MPI_LONG, rank + 1, P4EST_COMM_SAVE,
-                       p4est->mpicomm);
-    SC_CHECK_MPI (mpiret);
+  /* create p4est from accumulated information */
+  p4est = p4est_inflate (mpicomm, conn, gfq, wpertree,
+                         qarr, darr, user_pointer);
+  sc_array_destroy (qarr);
+  if (darr != NULL) {
+    sc_array_destroy (darr);
   }
-#endif
-#else
-  mpiret = MPI_File_close (&mpifile);
-  SC_CHECK_MPI (mpiret);
-#endif
+  P4EST_FREE (wpertree);
+  P4EST_FREE (gfq);
 
-  P4EST_GLOBAL_PRODUCTION ("Done " P4EST_STRING "_save\n");
-}
+  /* assert that we loaded a valid forest and return */
+  SC_CHECK_ABORT (p4est_is_valid (p4est), "invalid forest");
+  P4EST_GLOBAL_PRODUCTIONF
+    ("Done " P4EST_STRING "_load_window with %lld total quadrants\n",
+     (long long) p4est->global_num_quadrants);
 
-p4est_t            *
-p4est_load (const char *filename, MPI_Comm mpicomm, size_t data_size,
-            int load_data, void *user_pointer,
-            p4est_connectivity_t ** connectivity)
-{
-  return p4est_load_ext (filename, mpicomm, data_size, load_data,
-                         0, 0, user_pointer, connectivity);
+  return p4est;
 }
 
 p4est_t            *
-p4est_load_ext (const char *filename, MPI_Comm mpicomm, size_t data_size,
-                int load_data, int autopartition, int broadcasthead,
-                void *user_pointer, p4est_connectivity_t ** connectivity)
+p4est_load_mixed (const char *filename, MPI_Comm mpicomm,
+                  size_t data_size, int load_data, int autopartition,
+                  void *user_pointer,
+                  p4est_connectivity_t ** connectivity)
 {
   const int           headc = 6;
   const int           align = 32;
@@ -3352,11 +6528,14 @@ p4est_load_ext (const char *filename, MPI_Comm mpicomm, size_t data_size,
   int                 num_procs, rank;
   int                 save_num_procs;
   int                 save_data;
+  int                 num_fields;
   int                 i;
+  int                *field_double;
   uint64_t           *u64a, u64int;
   size_t              save_data_size;
   size_t              qbuf_size, comb_size, head_count;
   size_t              zz, zcount, zpadding;
+  size_t             *field_sizes;
   FILE               *file;
   p4est_topidx_t      jt, num_trees;
   p4est_gloidx_t     *gfq;
@@ -3368,9 +6547,8 @@ p4est_load_ext (const char *filename, MPI_Comm mpicomm, size_t data_size,
   sc_io_source_t     *src;
   char               *dap, *lbuf;
 
-  P4EST_GLOBAL_PRODUCTIONF ("Into " P4EST_STRING "_load %s\n", filename);
-
-  SC_CHECK_ABORT (!broadcasthead, "Header broadcast not implemented");
+  P4EST_GLOBAL_PRODUCTIONF ("Into " P4EST_STRING "_load_mixed %s\n",
+                            filename);
 
   /* retrieve MPI information */
   mpiret = MPI_Comm_size (mpicomm, &num_procs);
@@ -3402,7 +6580,7 @@ p4est_load_ext (const char *filename, MPI_Comm mpicomm, size_t data_size,
   num_trees = conn->num_trees;
   qbuf_size = (P4EST_DIM + 1) * sizeof (p4est_qcoord_t);
 
-  /* read format and partition information */
+  /* read format information */
   u64a = P4EST_ALLOC (uint64_t, headc);
   sc_fread (u64a, sizeof (uint64_t), (size_t) headc, file, "read format");
   SC_CHECK_ABORT (u64a[0] == P4EST_ONDISK_FORMAT, "invalid format");
@@ -3412,10 +6590,7 @@ p4est_load_ext (const char *filename, MPI_Comm mpicomm, size_t data_size,
                   "invalid quadrant size");
   save_data_size = (size_t) u64a[3];
   save_data = (int) u64a[4];
-  if (load_data) {
-    SC_CHECK_ABORT (save_data_size == data_size, "invalid data size");
-    SC_CHECK_ABORT (save_data, "quadrant data not saved");
-  }
+  SC_CHECK_ABORT (save_data == 2, "not a mixed-precision checkpoint");
   save_num_procs = (int) u64a[5];
   comb_size = qbuf_size + save_data_size;
   SC_CHECK_ABORT (autopartition || num_procs == save_num_procs,
@@ -3455,47 +6630,74 @@ p4est_load_ext (const char *filename, MPI_Comm mpicomm, size_t data_size,
     pertree[jt + 1] = (p4est_gloidx_t) u64a[jt];
   }
   SC_CHECK_ABORT (gfq[num_procs] == pertree[num_trees], "pertree mismatch");
+
+  /* read the field descriptors and verify them against the caller */
+  sc_fread (&u64int, sizeof (uint64_t), 1, file, "read field count");
+  num_fields = (int) u64int;
+  SC_CHECK_ABORT (num_fields > 0, "invalid field count");
+  u64a = P4EST_REALLOC (u64a, uint64_t, 2 * num_fields);
+  sc_fread (u64a, sizeof (uint64_t), (size_t) (2 * num_fields), file,
+            "read field descriptors");
+  field_sizes = P4EST_ALLOC (size_t, num_fields);
+  field_double = P4EST_ALLOC (int, num_fields);
+  zz = 0;
+  for (i = 0; i < num_fields; ++i) {
+    field_sizes[i] = (size_t) u64a[2 * i];
+    field_double[i] = (int) u64a[2 * i + 1];
+    zz += field_sizes[i];
+  }
   P4EST_FREE (u64a);
+  SC_CHECK_ABORT (p4est_save_fields_size (num_fields, field_sizes,
+                                          field_double) == save_data_size,
+                  "inconsistent field descriptors");
+  if (load_data) {
+    SC_CHECK_ABORT (zz == data_size, "invalid data size");
+  }
 
-  /* seek to the beginning of this processor's storage */
-  head_count = (size_t) (headc + save_num_procs) + (size_t) num_trees;
+  head_count = (size_t) (headc + save_num_procs) + (size_t) num_trees +
+    (size_t) (1 + 2 * num_fields);
   zpadding = (align - (head_count * sizeof (uint64_t)) % align) % align;
-  if (zpadding > 0 || rank > 0) {
-    retval =
-      fseek (file, (long) (zpadding + gfq[rank] * comb_size), SEEK_CUR);
-    SC_CHECK_ABORT (retval == 0, "seek data");
-  }
 
-  /* read quadrant coordinates and data interleaved */
+  /* prepare the storage filled from this processor's quadrant range */
   qarr =
     sc_array_new_size (sizeof (p4est_qcoord_t), (P4EST_DIM + 1) * zcount);
   qap = (p4est_qcoord_t *) qarr->array;
   darr = NULL;
   dap = NULL;
-  lbuf = NULL;
   if (load_data) {
-    P4EST_ASSERT (data_size == save_data_size && data_size > 0);
     darr = sc_array_new_size (data_size, zcount);
     dap = darr->array;
-    lbuf = P4EST_ALLOC (char, comb_size);
   }
+
+  /* seek to the beginning of this processor's storage */
+  if (zpadding > 0 || rank > 0) {
+    retval =
+      fseek (file, (long) (zpadding + gfq[rank] * comb_size), SEEK_CUR);
+    SC_CHECK_ABORT (retval == 0, "seek data");
+  }
+
+  /* read quadrant coordinates and up-convert the data */
+  lbuf = P4EST_ALLOC (char, comb_size);
   for (zz = 0; zz < zcount; ++zz) {
     if (load_data) {
       sc_fread (lbuf, comb_size, 1, file, "read quadrant with data");
       memcpy (qap, lbuf, qbuf_size);
-      memcpy (dap, lbuf + qbuf_size, data_size);
+      p4est_save_fields_up (lbuf + qbuf_size, dap, num_fields,
+                            field_sizes, field_double);
+      dap += data_size;
     }
     else {
-      sc_fread (qap, qbuf_size, 1, file, "read quadrant with data");
+      sc_fread (qap, qbuf_size, 1, file, "read quadrant");
       if (save_data_size > 0) {
-        retval = fseek (file, save_data_size, SEEK_CUR);
+        retval = fseek (file, (long) save_data_size, SEEK_CUR);
         SC_CHECK_ABORT (retval == 0, "seek over data");
       }
     }
     qap += P4EST_DIM + 1;
-    dap += data_size;
   }
   P4EST_FREE (lbuf);
+  P4EST_FREE (field_sizes);
+  P4EST_FREE (field_double);
 
   /* close file */
   retval = fclose (file);
@@ -3515,7 +6717,7 @@ p4est_load_ext (const char *filename, MPI_Comm mpicomm, size_t data_size,
   /* assert that we loaded a valid forest and return */
   SC_CHECK_ABORT (p4est_is_valid (p4est), "invalid forest");
   P4EST_GLOBAL_PRODUCTIONF
-    ("Done " P4EST_STRING "_load with %lld total quadrants\n",
+    ("Done " P4EST_STRING "_load_mixed with %lld total quadrants\n",
      (long long) p4est->global_num_quadrants);
 
   return p4est;
@@ -81,6 +81,13 @@ typedef struct p4est_quadrant
 }
 p4est_quadrant_t;
 
+/** The metadata members below the quadrant array are kept up to date only
+ * for trees inside [first_local_tree, last_local_tree]; for all other trees
+ * the quadrant array is empty and the metadata may be stale from an earlier
+ * partition, so per-tree work scales with the local tree count and not with
+ * the global number of trees.  Use \ref p4est_tree_quadrants_offset to read
+ * the cumulative quadrant count of an arbitrary tree.
+ */
 typedef struct p4est_tree
 {
   sc_array_t          quadrants;        /* locally stored quadrants */
@@ -111,6 +118,14 @@ typedef struct p4est_inspect
   int                 use_balance_verify;
   /** If positive and smaller than p4est_num ranges, overrides it */
   int                 balance_max_ranges;
+  /** If true and the MPI implementation provides distributed graph
+   * communicators, the ghost layer exchange uses neighborhood collectives.
+   * The graph communicator below is cached and reused until the peer set
+   * changes; call p4est_ghost_neighborhood_release to free it. */
+  int                 use_ghost_neighborhood;
+  int                 ghost_graph_num_peers;    /**< internal cache state */
+  int                *ghost_graph_peers;        /**< internal cache state */
+  MPI_Comm            ghost_graph_comm;         /**< internal cache state */
   size_t              balance_A_count_in;
   size_t              balance_A_count_out;
   size_t              balance_comm_sent;
@@ -126,9 +141,75 @@ typedef struct p4est_inspect
   /** time spent in sc_notify_allgather */
   double              balance_notify_allgather;
   int                 use_B;
+  /** Wall times and communication counters for the other algorithms.
+   * Each is reset on entry of the respective function whenever an
+   * inspect structure is present in p4est.  The byte counts cover the
+   * payload messages, not the preceding count exchanges. */
+  double              ghost_time;       /**< time in p4est_ghost_new */
+  size_t              ghost_comm_sent;  /**< bytes of ghosts sent */
+  size_t              ghost_nzpeers;    /**< peers sent to in ghost_new */
+  double              partition_time;   /**< time in p4est_partition */
+  size_t              partition_comm_sent;      /**< bytes of quadrants
+                                                     and data sent */
+  size_t              partition_nzpeers;        /**< peers sent to */
+  double              iterate_time;     /**< time in p4est_iterate */
+  double              lnodes_time;      /**< time in p4est_lnodes_new */
+  size_t              lnodes_comm_sent; /**< bytes of node data sent */
+  size_t              lnodes_nzpeers;   /**< peers sent to */
 }
 p4est_inspect_t;
 
+/** Identify the instrumented entry routines for profiling hooks. */
+typedef enum p4est_profile_phase
+{
+  P4EST_PROFILE_REFINE,         /**< p4est_refine and variants */
+  P4EST_PROFILE_BALANCE,        /**< p4est_balance and variants */
+  P4EST_PROFILE_PARTITION,      /**< p4est_partition and variants */
+  P4EST_PROFILE_GHOST,          /**< p4est_ghost_new and variants */
+  P4EST_PROFILE_ITERATE,        /**< p4est_iterate */
+  P4EST_PROFILE_LNODES,         /**< p4est_lnodes_new and variants */
+  P4EST_PROFILE_NUM_PHASES
+}
+p4est_profile_phase_t;
+
+/** Callback fired at entry and exit of the instrumented routines.
+ * \param [in] p4est        The forest the routine operates on.
+ * \param [in] phase        Identifies the routine, see the phase enum.
+ * \param [in] is_exit      False on entry, true on exit of the routine.
+ * \param [in] bytes_sent   On exit, the payload bytes this process sent
+ *                          in the routine's communication, taken from
+ *                          the inspect counters; zero when no inspect
+ *                          structure is attached or the phase does not
+ *                          communicate.
+ * \param [in] num_peers    On exit, the number of processes sent to,
+ *                          under the same conditions as \a bytes_sent.
+ * \param [in] user         The pointer registered with the hook.
+ */
+typedef void        (*p4est_profile_t) (struct p4est * p4est,
+                                        p4est_profile_phase_t phase,
+                                        int is_exit, size_t bytes_sent,
+                                        size_t num_peers, void *user);
+
+/* forward declaration of the read-only forest view, see below */
+typedef struct p4est_view p4est_view_t;
+
+/** Callback function prototype to serialize a quadrant's user data for
+ * migration.  It must write exactly data_size bytes to \a dest.
+ */
+typedef void        (*p4est_pack_data_t) (struct p4est * p4est,
+                                          p4est_topidx_t which_tree,
+                                          p4est_quadrant_t * quadrant,
+                                          void *dest);
+
+/** Callback function prototype to deserialize a quadrant's migrated user
+ * data.  It must read exactly data_size bytes from \a src and fill the
+ * quadrant's freshly allocated user_data.
+ */
+typedef void        (*p4est_unpack_data_t) (struct p4est * p4est,
+                                            p4est_topidx_t which_tree,
+                                            p4est_quadrant_t * quadrant,
+                                            const void *src);
+
 typedef struct p4est
 {
   MPI_Comm            mpicomm;
@@ -138,6 +219,14 @@ typedef struct p4est
   void               *user_pointer;     /* convenience pointer for users,
                                            will never be touched by p4est */
 
+  long                revision;         /* number of times the local forest
+                                           has changed through refinement,
+                                           coarsening, balance, or partition;
+                                           used to invalidate caches */
+  sc_array_t         *changes;          /* of p4est_change_t; records which
+                                           quadrant ranges were modified while
+                                           non-NULL, see p4est_changes_begin */
+
   p4est_topidx_t      first_local_tree; /* 0-based index of first local tree,
                                            must be -1 for an empty processor */
   p4est_topidx_t      last_local_tree;  /* 0-based index of last local tree,
@@ -152,6 +241,15 @@ typedef struct p4est
   p4est_quadrant_t   *global_first_position;    /* first smallest possible quad
                                                    for each proc and 1 beyond
                                                  */
+  int                 find_owner_cache; /* last owner determined by
+                                           p4est_comm_find_owner, always a
+                                           valid processor id */
+  int                *tree_owners;      /* first and last owner rank per tree,
+                                           built lazily by
+                                           p4est_comm_tree_owner_range;
+                                           NULL until first use */
+  long                tree_owners_revision;     /* revision the cached owner
+                                                   rank intervals match */
   p4est_connectivity_t *connectivity;   /* connectivity structure, not owned */
   sc_array_t         *trees;    /* list of all trees */
 
@@ -159,12 +257,121 @@ typedef struct p4est
                                          * WARNING: This is NULL if data size
                                          *          equals zero.
                                          */
+  sc_array_t         *user_data_arena;  /* if not NULL, one contiguous data
+                                         * block per tree created by
+                                         * p4est_compact_data; quadrants
+                                         * created afterwards still draw
+                                         * from user_data_pool */
   sc_mempool_t       *quadrant_pool;    /* memory allocator
                                            for temporary quadrants */
   p4est_inspect_t    *inspect;  /* algorithmic switches */
+  p4est_view_t       *views;    /* list of attached read-only views,
+                                   see p4est_view_new */
+  struct p4est_context *context;        /* reusable communicator context
+                                           this forest was created on,
+                                           see p4est_context_new;
+                                           NULL for standalone forests */
+  p4est_pack_data_t   data_pack_fn;     /* optional user data serializers
+                                           for migrating quadrants, see
+                                           p4est_set_data_serializer;
+                                           NULL means plain memcpy */
+  p4est_unpack_data_t data_unpack_fn;
+  p4est_profile_t     profile_fn;       /* optional entry/exit hook for
+                                           external profilers, see
+                                           p4est_set_profile_hook;
+                                           NULL disables instrumentation */
+  void               *profile_user;     /* passed to profile_fn unchanged */
+  int                 num_threads;      /* hybrid execution width set by
+                                           p4est_set_num_threads; the
+                                           threaded local phases accept 0
+                                           for their thread count to use
+                                           this value; below two means
+                                           serial execution */
+  p4est_locidx_t      balance_chunk;    /* border quadrants processed per
+                                           balance batch, set by
+                                           p4est_set_balance_chunk;
+                                           zero means all at once */
+  struct p4est_workspace *workspace;    /* optional caller-owned scratch
+                                           buffers reused across calls,
+                                           see p4est_workspace_attach;
+                                           NULL allocates per call */
 }
 p4est_t;
 
+/** A lightweight read-only view of the forest for analysis passes.
+ * The view references the per-tree quadrant arrays of the forest
+ * without copying them.  Whenever a mutating operation (refinement,
+ * coarsening, balance, partition) is about to modify a tree, the
+ * library first copies that tree's quadrant array into the view, so
+ * the view continues to present the mesh exactly as it was when the
+ * view was created.  The replacement pointer is stored before the
+ * original array is modified; on architectures where aligned pointer
+ * stores are atomic, a reader on another thread therefore observes
+ * either the unmodified original or the frozen copy.
+ * The quadrant user_data pointers inside a view follow the lifetime
+ * rules of the forest: data of quadrants that the forest has since
+ * removed is no longer valid.
+ * Views must be destroyed before the forest's connectivity; a view
+ * that outlives its forest keeps only the quadrant copies made when
+ * the forest was destroyed.
+ */
+struct p4est_view
+{
+  p4est_t            *p4est;    /**< viewed forest, not owned;
+                                     NULL once the forest is destroyed */
+  long                revision; /**< forest revision at view creation */
+  p4est_topidx_t      num_trees;        /**< trees in the connectivity */
+  p4est_topidx_t      first_local_tree; /**< frozen local tree range */
+  p4est_topidx_t      last_local_tree;  /**< frozen local tree range */
+  p4est_locidx_t      local_num_quadrants;      /**< frozen local count */
+  p4est_gloidx_t     *global_first_quadrant;    /**< deep copy, owned */
+  sc_array_t        **tree_quadrants;   /**< per-tree quadrant arrays;
+                                             borrowed from the forest
+                                             until the tree mutates */
+  int8_t             *owns_tree;        /**< nonzero where the view has
+                                             its own frozen copy */
+  struct p4est_view  *next;     /**< forest-internal list linkage */
+};
+
+/** Create a read-only view of the forest's current state.
+ * This is cheap: only the partition table is copied up front.
+ * Must be called by the thread that owns the forest.
+ * \return          A view that stays consistent across later
+ *                  refine/coarsen/balance/partition calls.
+ */
+p4est_view_t       *p4est_view_new (p4est_t * p4est);
+
+/** Access the frozen quadrant array of one tree.
+ * \param [in] which_tree   Tree index in [0, num_trees).
+ * \return      Array of p4est_quadrant_t as of view creation.
+ */
+sc_array_t         *p4est_view_tree (p4est_view_t * view,
+                                     p4est_topidx_t which_tree);
+
+/** Destroy a view and the tree copies it owns.
+ * Must be called by the thread that owns the forest.
+ */
+void                p4est_view_destroy (p4est_view_t * view);
+
+/** Freeze one tree in all attached views before it is modified.
+ * Called internally by the mutating operations; applications only
+ * need it when they modify tree quadrant arrays directly.
+ */
+void                p4est_view_preserve (p4est_t * p4est,
+                                         p4est_topidx_t which_tree);
+
+/** Freeze every tree in all attached views.
+ * Called internally before operations that rewrite the forest
+ * wholesale, such as partition.
+ */
+void                p4est_view_preserve_all (p4est_t * p4est);
+
+/** Log all counters and timings gathered in an inspect structure.
+ * One line per instrumented algorithm is printed at statistics priority
+ * on every process.  Does nothing if p4est->inspect is NULL.
+ */
+void                p4est_inspect_print (p4est_t * p4est);
+
 /** Calculate memory usage of a forest structure.
  * The connectivity structure is not counted since it is not owned;
  * use p4est_connectivity_memory_usage (p4est->connectivity).
@@ -279,11 +486,161 @@ void                p4est_reset_data (p4est_t * p4est, size_t data_size,
                                       p4est_init_t init_fn,
                                       void *user_pointer);
 
+/** Register optional pack/unpack callbacks for quadrant user data.
+ * When set, the partition invokes \a pack_fn once for every quadrant
+ * shipped to another process and \a unpack_fn once for every quadrant
+ * received, so payloads containing pointers can be flattened on the fly
+ * instead of in a full pass over all local quadrants before and after.
+ * Quadrants that stay on their process are never passed through the
+ * callbacks.  Both callbacks operate on exactly data_size bytes.
+ * Pass NULL for both to return to the default memcpy.
+ */
+void                p4est_set_data_serializer (p4est_t * p4est,
+                                               p4est_pack_data_t pack_fn,
+                                               p4est_unpack_data_t unpack_fn);
+
+/** Configure the hybrid MPI+threads execution width of a forest.
+ * In a hybrid run with one process per compute node, create a single
+ * forest per process and set \a num_threads to the number of worker
+ * threads of that node.  The threaded local phases --
+ * p4est_iterate_threaded, p4est_lnodes_new, p4est_lnodes_new_threaded,
+ * and p4est_numa_first_touch -- then interpret a thread count of zero
+ * as this width, so one setting covers all call sites.  Compared to
+ * one process per core this keeps a single connectivity and ghost
+ * layer per node and turns intra-node messages into shared memory
+ * access.  Inter-process communication is unaffected.  Values below
+ * two select serial execution, which is also the default.
+ */
+void                p4est_set_num_threads (p4est_t * p4est,
+                                           int num_threads);
+
+/** Bound the transient memory of the balance border phase.
+ * By default the border phase of p4est_balance rebuilds each affected
+ * tree in one pass, holding the old tree, the rebuilt copy, and the
+ * complete balance closure of all received border quadrants at the
+ * same time.  With a nonzero \a balance_chunk the border is consumed
+ * in batches of at most that many border quadrants, and each batch's
+ * insertions are merged into the tree before the next batch starts.
+ * The transient peak is then one tree copy plus one batch's closure
+ * instead of the full closure, at the cost of one tree copy per
+ * batch.  The result is identical to the unchunked phase.
+ * \param [in] balance_chunk   Border quadrants to process per batch,
+ *                             or zero to process each tree in one pass.
+ */
+void                p4est_set_balance_chunk (p4est_t * p4est,
+                                             p4est_locidx_t balance_chunk);
+
+/** Register a callback fired at entry and exit of the main algorithms.
+ * The hook covers refinement, balance, partition, ghost layer
+ * construction, iteration, and lnodes construction, so
+ * external profilers and dashboards can bracket the phases without
+ * recompiling the library.  On exit the hook additionally receives the
+ * communication volume and peer count of the phase when an inspect
+ * structure is attached to the forest.  The instrumentation costs one
+ * predicted branch per phase while no hook is registered.
+ * \param [in] p4est        The forest to instrument.
+ * \param [in] profile_fn   The callback, or NULL to unregister.
+ * \param [in] user         Passed to \a profile_fn unchanged.
+ */
+void                p4est_set_profile_hook (p4est_t * p4est,
+                                            p4est_profile_t profile_fn,
+                                            void *user);
+
+/** Invoke the registered profiling hook for one phase boundary.
+ * Called internally by the instrumented routines; it does nothing when
+ * no hook is registered and reads the phase's byte and peer counters
+ * from the inspect structure when one is attached.
+ */
+void                p4est_profile_fire (p4est_t * p4est,
+                                        p4est_profile_phase_t phase,
+                                        int is_exit);
+
+/** Identify one transient buffer kept alive by the workspace.
+ * Each slot corresponds to one scratch allocation of an instrumented
+ * routine; buffers of different slots may be in use at the same time.
+ */
+typedef enum p4est_workspace_slot
+{
+  P4EST_WORKSPACE_BALANCE_REQUESTS,
+  P4EST_WORKSPACE_BALANCE_STATUSES,
+  P4EST_WORKSPACE_BALANCE_INDICES,
+  P4EST_WORKSPACE_BALANCE_PEERS,
+  P4EST_WORKSPACE_GHOST_RECV_REQUESTS,
+  P4EST_WORKSPACE_GHOST_RECV_STATUSES,
+  P4EST_WORKSPACE_GHOST_SEND_REQUESTS,
+  P4EST_WORKSPACE_GHOST_SEND_STATUSES,
+  P4EST_WORKSPACE_GHOST_COUNTS,
+  P4EST_WORKSPACE_GHOST_HEADERS,
+  P4EST_WORKSPACE_NODES_STATUS,
+  P4EST_WORKSPACE_NODES_PROCS,
+  P4EST_WORKSPACE_NODES_PEERS,
+  P4EST_WORKSPACE_NUM_SLOTS
+}
+p4est_workspace_slot_t;
+
+/** Persistent scratch buffers reused across library calls.
+ * Every invocation of p4est_balance, p4est_ghost_new, and
+ * p4est_nodes_new allocates and frees the same set of transient
+ * arrays -- peer records, message requests and statuses, node flags.
+ * A workspace attached to the forest retains those buffers between
+ * calls at their high-water marks, so a time loop that rebalances
+ * and rebuilds the ghost layer every step stops cycling the
+ * allocator and keeps operating on warmed memory.
+ * The workspace is owned by the caller, may be attached to one
+ * forest at a time, and is not thread-safe.
+ */
+typedef struct p4est_workspace
+{
+  char               *slots[P4EST_WORKSPACE_NUM_SLOTS];
+  size_t              slot_bytes[P4EST_WORKSPACE_NUM_SLOTS];
+  int                 slot_busy[P4EST_WORKSPACE_NUM_SLOTS];
+}
+p4est_workspace_t;
+
+/** Create an empty workspace.  No memory is retained until the first
+ * instrumented call of a forest the workspace is attached to.
+ */
+p4est_workspace_t  *p4est_workspace_new (void);
+
+/** Free a workspace and all buffers it retains.
+ * Must not be called while the workspace is attached to a forest.
+ */
+void                p4est_workspace_destroy (p4est_workspace_t * workspace);
+
+/** Attach a workspace to a forest, or detach with NULL.
+ * The forest does not take ownership; p4est_destroy leaves the
+ * workspace and its buffers untouched, and p4est_copy starts the
+ * copy without a workspace.  A workspace may serve several forests
+ * as long as their library calls do not overlap in time.
+ */
+void                p4est_workspace_attach (p4est_t * p4est,
+                                            p4est_workspace_t * workspace);
+
+/** Acquire the scratch buffer of one slot, growing it as needed.
+ * Called internally by the instrumented routines; without an attached
+ * workspace this is a plain allocation of \a bytes.
+ * \return          A buffer of at least \a bytes bytes, uninitialized.
+ */
+void               *p4est_workspace_get (p4est_t * p4est,
+                                         p4est_workspace_slot_t slot,
+                                         size_t bytes);
+
+/** Return a buffer obtained from p4est_workspace_get.
+ * Without an attached workspace the buffer is freed; otherwise it is
+ * retained for the next acquisition of the same slot.
+ */
+void                p4est_workspace_release (p4est_t * p4est,
+                                             p4est_workspace_slot_t slot,
+                                             void *ptr);
+
 /** Refine a forest.
  * \param [in] refine_fn Callback function that returns true
  *                       if a quadrant shall be refined
  * \param [in] init_fn   Callback function to initialize the user_data
  *                       which is already allocated automatically.
+ * \note If p4est was configured --enable-openmp and refinement is not
+ *       recursive, refine_fn is invoked from multiple threads and
+ *       must be thread-safe; init_fn is always called serially.
  */
 void                p4est_refine (p4est_t * p4est,
                                   int refine_recursive,
@@ -295,6 +652,9 @@ void                p4est_refine (p4est_t * p4est,
  *                        family of quadrants shall be coarsened
  * \param [in] init_fn    Callback function to initialize the user_data
  *                        which is already allocated automatically.
+ * \note If p4est was configured --enable-openmp and coarsening is not
+ *       recursive, coarsen_fn is invoked from multiple threads and
+ *       must be thread-safe; init_fn is always called serially.
  */
 void                p4est_coarsen (p4est_t * p4est,
                                    int coarsen_recursive,
@@ -323,16 +683,138 @@ void                p4est_balance (p4est_t * p4est,
 void                p4est_partition (p4est_t * p4est,
                                      p4est_weight_t weight_fn);
 
+/** Migrate a forest onto a prefix subcommunicator.
+ * When coarsening has left most processes nearly empty, this call
+ * concentrates the quadrants on the first \a num_ranks processes and
+ * rebuilds the forest on a communicator spanning only those ranks, so
+ * that subsequent collectives cost what the active ranks warrant.
+ * This function is collective over the forest's communicator.  The
+ * input forest remains valid; it is repartitioned in place such that
+ * all ranks at and beyond \a num_ranks hold no quadrants.
+ * \param [in,out] p4est      A valid forest; its partition is changed.
+ * \param [in] num_ranks      Number of prefix ranks to migrate onto;
+ *                            must be positive and at most mpisize.
+ * \return  On the first \a num_ranks processes, a new forest on a
+ *          communicator created by MPI_Comm_split; the caller owns
+ *          both and frees the communicator after destroying the
+ *          forest.  Returns NULL on all other processes.
+ */
+p4est_t            *p4est_shrink (p4est_t * p4est, int num_ranks);
+
+/** Rebase a forest from a prefix subcommunicator onto a larger one.
+ * This is the inverse of \ref p4est_shrink: the quadrants stay on the
+ * prefix ranks and the remaining ranks join with an empty partition;
+ * a subsequent \ref p4est_partition spreads the load if desired.
+ * This function is collective over \a mpicomm.  The prefix ranks must
+ * pass their forest and all other ranks must pass NULL; rank p of the
+ * forest's communicator must be rank p of \a mpicomm.
+ * \param [in] small          The forest to expand on the prefix ranks
+ *                            of \a mpicomm, unchanged by this call;
+ *                            NULL on all other ranks.
+ * \param [in] mpicomm        The communicator to expand onto.
+ * \param [in] connectivity   The same connectivity the forest uses,
+ *                            also valid on the joining ranks.
+ * \param [in] user_pointer   Installed on the joining ranks; the
+ *                            prefix ranks keep the forest's pointer.
+ * \return  Returns a new forest on \a mpicomm on every process.
+ */
+p4est_t            *p4est_expand (p4est_t * small, MPI_Comm mpicomm,
+                                  p4est_connectivity_t * connectivity,
+                                  void *user_pointer);
+
 /** Compute the checksum for a forest.
  * Based on quadrant arrays only. It is independent of partition and mpisize.
- * \return  Returns the checksum on processor 0 only. 0 on other processors.
+ * \return  Returns the checksum on all processors.
  */
 unsigned            p4est_checksum (p4est_t * p4est);
 
+/** Caches per-tree checksum pieces between calls to p4est_checksum_cached. */
+typedef struct p4est_checksum_cache
+{
+  p4est_topidx_t      num_trees;        /**< trees in the connectivity */
+  unsigned           *tree_crcs;        /**< cached checksum per tree */
+  p4est_locidx_t     *tree_counts;      /**< quadrant count when cached */
+  int8_t             *dirty;    /**< nonzero forces recomputation */
+}
+p4est_checksum_cache_t;
+
+/** Allocate a checksum cache with all trees marked for computation.
+ * \param [in] p4est    Its number of trees sizes the cache; the cache
+ *                      stays usable while this number does not change.
+ * \return              The cache, to be freed with
+ *                      p4est_checksum_cache_destroy.
+ */
+p4est_checksum_cache_t *p4est_checksum_cache_new (p4est_t * p4est);
+
+/** Mark one tree to be recomputed on the next cached checksum.
+ * Trees whose quadrant count changed are recomputed automatically;
+ * this call is required after modifications that keep the count, such
+ * as overwriting quadrants in place.
+ * \param [in,out] cache        The cache to be marked.
+ * \param [in] which_tree       The tree whose quadrants changed.
+ */
+void                p4est_checksum_cache_mark (p4est_checksum_cache_t *
+                                               cache,
+                                               p4est_topidx_t which_tree);
+
+/** Compute the forest checksum, reusing cached per-tree pieces.
+ * This returns the same value as p4est_checksum while recomputing only
+ * the trees that are marked dirty or changed their quadrant count.
+ * \param [in] p4est    The forest to be checksummed.
+ * \param [in,out] cache        The cache carried between calls.
+ * \return  Returns the checksum on all processors.
+ */
+unsigned            p4est_checksum_cached (p4est_t * p4est,
+                                           p4est_checksum_cache_t * cache);
+
+/** Free a checksum cache.
+ * \param [in,out] cache        The cache to be freed.
+ */
+void                p4est_checksum_cache_destroy (p4est_checksum_cache_t *
+                                                  cache);
+
+/** Query the local modification count of a forest.
+ * The revision is advanced by refinement, coarsening, balance and
+ * partition, so dependent structures can compare it against the value
+ * seen when they were built.
+ * \param [in] p4est    The forest to be queried.
+ * \return              The current revision number.
+ */
+long                p4est_revision (p4est_t * p4est);
+
+/** One contiguous range of quadrants modified within a tree. */
+typedef struct p4est_change
+{
+  p4est_topidx_t      which_tree;       /**< the tree that was modified */
+  p4est_locidx_t      begin;    /**< first quadrant of the range */
+  p4est_locidx_t      end;      /**< one past the last quadrant */
+}
+p4est_change_t;
+
+/** Start recording which quadrant ranges the forest operations touch.
+ * Until the matching p4est_changes_end, refinement, coarsening,
+ * balance and partition append p4est_change_t entries in ascending
+ * tree order, merging adjacent entries of the same tree.  The ranges
+ * refer to the quadrant numbering after the respective operation;
+ * partition conservatively records all local trees when quadrants
+ * moved.  Recording is local and adds no communication.
+ * \param [in,out] p4est        The forest to be tracked.
+ */
+void                p4est_changes_begin (p4est_t * p4est);
+
+/** Stop recording and hand the change set to the caller.
+ * \param [in,out] p4est        The forest being tracked.
+ * \return      Array of p4est_change_t to be destroyed by the caller
+ *              with sc_array_destroy.
+ */
+sc_array_t         *p4est_changes_end (p4est_t * p4est);
+
 /** Save the complete connectivity/p4est data to disk.  This is a collective
  * operation that all MPI processes need to call.  All processes write
  * into the same file, so the filename given needs to be identical over
- * all parallel invocations.
+ * all parallel invocations.  When compiled against MPI-IO, all processes
+ * write their quadrant range collectively in a single call at an offset
+ * derived from the partition; otherwise they write one after another.
  * \param [in] filename    Name of the file to write.
  * \param [in] p4est       Valid forest structure.
  * \param [in] save_data   If true, the element data is saved.
@@ -342,6 +824,36 @@ unsigned            p4est_checksum (p4est_t * p4est);
 void                p4est_save (const char *filename, p4est_t * p4est,
                                 int save_data);
 
+/** A checkpoint of a forest that is still being written to disk. */
+typedef struct p4est_checkpoint p4est_checkpoint_t;
+
+/** Begin saving the complete connectivity/p4est data asynchronously.
+ * The connectivity and header are written immediately and the local
+ * quadrants are snapshot into a staging buffer, so the forest may be
+ * modified or destroyed freely once this call returns.  The buffer is
+ * written by a split collective MPI-IO call that can progress in the
+ * background while the solver continues; p4est_checkpoint_end completes
+ * the write.  Without MPI-IO support the file is written synchronously
+ * before this call returns.  The file is identical to the one written
+ * by p4est_save, so it is restored with p4est_load.
+ * At most one checkpoint per file may be in progress at any time.
+ * \param [in] filename    Name of the file to write.
+ * \param [in] p4est       Valid forest structure.
+ * \param [in] save_data   If true, the element data is saved.
+ *                         Otherwise, a data size of 0 is saved.
+ * \return                 Checkpoint to pass to p4est_checkpoint_end.
+ * \note            Aborts on file errors.
+ */
+p4est_checkpoint_t *p4est_checkpoint_begin (const char *filename,
+                                            p4est_t * p4est,
+                                            int save_data);
+
+/** Complete an asynchronous checkpoint and free its staging buffer.
+ * This is a collective call that blocks until the file data is written.
+ * \param [in,out] cp      Checkpoint from p4est_checkpoint_begin; freed.
+ */
+void                p4est_checkpoint_end (p4est_checkpoint_t * cp);
+
 /** Load the complete connectivity/p4est structure from disk.
  * \param [in] filename         Name of the file to read.
  * \param [in] mpicomm          A valid MPI communicator.
@@ -378,6 +890,27 @@ p4est_tree_array_index (sc_array_t * array, p4est_topidx_t it)
                            sizeof (p4est_tree_t) * (size_t) it);
 }
 
+/** Return the number of local quadrants in all trees before \a which_tree.
+ * Unlike reading tree->quadrants_offset directly, this is well defined for
+ * every tree: the offset stored in trees outside the local tree range is
+ * not kept up to date since those trees hold no quadrants.
+ */
+/*@unused@*/
+static inline p4est_locidx_t
+p4est_tree_quadrants_offset (p4est_t * p4est, p4est_topidx_t which_tree)
+{
+  P4EST_ASSERT (0 <= which_tree &&
+                which_tree < p4est->connectivity->num_trees);
+
+  if (which_tree < p4est->first_local_tree) {
+    return 0;
+  }
+  if (which_tree > p4est->last_local_tree) {
+    return p4est->local_num_quadrants;
+  }
+  return p4est_tree_array_index (p4est->trees, which_tree)->quadrants_offset;
+}
+
 /** Return a pointer to a quadrant array element indexed by a size_t. */
 /*@unused@*/
 static inline p4est_quadrant_t *
@@ -389,6 +922,49 @@ p4est_quadrant_array_index (sc_array_t * array, size_t it)
   return (p4est_quadrant_t *) (array->array + sizeof (p4est_quadrant_t) * it);
 }
 
+/** Return the base pointer of a tree's contiguous quadrant storage.
+ * Together with \ref p4est_tree_num_quadrants this permits pointer
+ * iteration over [base, base + count), which keeps the unit access
+ * stride visible to the compiler and the hardware prefetcher.
+ * The pointer is invalidated by any change to the tree's quadrants.
+ */
+/*@unused@*/
+static inline p4est_quadrant_t *
+p4est_tree_quadrants_base (p4est_tree_t * tree)
+{
+  P4EST_ASSERT (tree->quadrants.elem_size == sizeof (p4est_quadrant_t));
+
+  return (p4est_quadrant_t *) tree->quadrants.array;
+}
+
+/** Return the number of quadrants stored in a tree. */
+/*@unused@*/
+static inline p4est_locidx_t
+p4est_tree_num_quadrants (p4est_tree_t * tree)
+{
+  P4EST_ASSERT (tree->quadrants.elem_size == sizeof (p4est_quadrant_t));
+  P4EST_ASSERT (tree->quadrants.elem_count <= (size_t) P4EST_LOCIDX_MAX);
+
+  return (p4est_locidx_t) tree->quadrants.elem_count;
+}
+
+/** Return true if all local quadrants of a tree share one level.
+ * The per-level histogram tracks this exactly under refinement,
+ * coarsening, balance, and partition, so no separate flag is needed.
+ * A level-homogeneous tree contains no hanging interfaces and is
+ * internally 2:1 balanced by construction.
+ */
+/*@unused@*/
+static inline int
+p4est_tree_is_uniform (p4est_tree_t * tree)
+{
+  P4EST_ASSERT (tree->quadrants.elem_size == sizeof (p4est_quadrant_t));
+
+  return tree->quadrants.elem_count > 0 &&
+    tree->quadrants_per_level[tree->maxlevel] ==
+    (p4est_locidx_t) tree->quadrants.elem_count;
+}
+
 /** Call sc_array_push for a quadrant array. */
 /*@unused@*/
 static inline p4est_quadrant_t *
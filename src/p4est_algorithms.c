@@ -93,7 +93,8 @@ p4est_quadrant_free_data (p4est_t * p4est, p4est_quadrant_t * quad)
 {
   P4EST_ASSERT (p4est_quadrant_is_extended (quad));
 
-  if (p4est->data_size > 0) {
+  /* in arena mode storage is reclaimed wholesale by p4est_compact_data */
+  if (p4est->data_size > 0 && p4est->user_data_arena == NULL) {
     sc_mempool_free (p4est->user_data_pool, quad->p.user_data);
   }
   quad->p.user_data = NULL;
@@ -417,6 +418,215 @@ p4est_is_equal (p4est_t * p4est1, p4est_t * p4est2, int compare_data)
   return 1;
 }
 
+void
+p4est_diff (p4est_t * p4est1, p4est_t * p4est2,
+            p4est_diff_t diff_fn, void *user)
+{
+  int                 in1, in2;
+  size_t              z1, z2, j1, j2, n1, n2;
+  p4est_topidx_t      jt, first_tree, last_tree;
+  p4est_tree_t       *tree1, *tree2;
+  p4est_quadrant_t   *q1, *q2;
+  sc_array_t         *tqs1, *tqs2;
+
+  P4EST_ASSERT (diff_fn != NULL);
+  P4EST_ASSERT (p4est1->connectivity->num_trees ==
+                p4est2->connectivity->num_trees);
+
+  first_tree = SC_MIN (p4est1->first_local_tree, p4est2->first_local_tree);
+  last_tree = SC_MAX (p4est1->last_local_tree, p4est2->last_local_tree);
+  for (jt = first_tree; jt <= last_tree; ++jt) {
+    in1 = (jt >= p4est1->first_local_tree && jt <= p4est1->last_local_tree);
+    in2 = (jt >= p4est2->first_local_tree && jt <= p4est2->last_local_tree);
+    if (!in1 && !in2) {
+      continue;
+    }
+    tree1 = in1 ? p4est_tree_array_index (p4est1->trees, jt) : NULL;
+    tree2 = in2 ? p4est_tree_array_index (p4est2->trees, jt) : NULL;
+    tqs1 = in1 ? &tree1->quadrants : NULL;
+    tqs2 = in2 ? &tree2->quadrants : NULL;
+    n1 = in1 ? tqs1->elem_count : 0;
+    n2 = in2 ? tqs2->elem_count : 0;
+
+    /* a tree local to only one forest has moved across processors */
+    if (!in2) {
+      if (n1 > 0) {
+        diff_fn (p4est1, p4est2, jt, P4EST_DIFF_MOVED,
+                 0, (p4est_locidx_t) n1, 0, 0, user);
+      }
+      continue;
+    }
+    if (!in1) {
+      if (n2 > 0) {
+        diff_fn (p4est1, p4est2, jt, P4EST_DIFF_MOVED,
+                 0, 0, 0, (p4est_locidx_t) n2, user);
+      }
+      continue;
+    }
+
+    /* merge the two Morton-sorted quadrant sequences */
+    z1 = z2 = 0;
+    while (z1 < n1 && z2 < n2) {
+      q1 = p4est_quadrant_array_index (tqs1, z1);
+      q2 = p4est_quadrant_array_index (tqs2, z2);
+      if (p4est_quadrant_is_equal (q1, q2)) {
+        ++z1;
+        ++z2;
+      }
+      else if (p4est_quadrant_is_ancestor (q1, q2)) {
+        /* the quadrant of the first forest was refined */
+        j2 = z2 + 1;
+        while (j2 < n2 &&
+               p4est_quadrant_is_ancestor
+               (q1, p4est_quadrant_array_index (tqs2, j2))) {
+          ++j2;
+        }
+        diff_fn (p4est1, p4est2, jt, P4EST_DIFF_REFINED,
+                 (p4est_locidx_t) z1, (p4est_locidx_t) (z1 + 1),
+                 (p4est_locidx_t) z2, (p4est_locidx_t) j2, user);
+        ++z1;
+        z2 = j2;
+      }
+      else if (p4est_quadrant_is_ancestor (q2, q1)) {
+        /* a family of the first forest was coarsened */
+        j1 = z1 + 1;
+        while (j1 < n1 &&
+               p4est_quadrant_is_ancestor
+               (q2, p4est_quadrant_array_index (tqs1, j1))) {
+          ++j1;
+        }
+        diff_fn (p4est1, p4est2, jt, P4EST_DIFF_COARSENED,
+                 (p4est_locidx_t) z1, (p4est_locidx_t) j1,
+                 (p4est_locidx_t) z2, (p4est_locidx_t) (z2 + 1), user);
+        z1 = j1;
+        ++z2;
+      }
+      else if (p4est_quadrant_compare (q1, q2) < 0) {
+        /* only at shifted partition boundaries can ranges disagree */
+        diff_fn (p4est1, p4est2, jt, P4EST_DIFF_MOVED,
+                 (p4est_locidx_t) z1, (p4est_locidx_t) (z1 + 1),
+                 (p4est_locidx_t) z2, (p4est_locidx_t) z2, user);
+        ++z1;
+      }
+      else {
+        diff_fn (p4est1, p4est2, jt, P4EST_DIFF_MOVED,
+                 (p4est_locidx_t) z1, (p4est_locidx_t) z1,
+                 (p4est_locidx_t) z2, (p4est_locidx_t) (z2 + 1), user);
+        ++z2;
+      }
+    }
+
+    /* a leftover tail exists in at most one of the forests */
+    if (z1 < n1) {
+      diff_fn (p4est1, p4est2, jt, P4EST_DIFF_MOVED,
+               (p4est_locidx_t) z1, (p4est_locidx_t) n1,
+               (p4est_locidx_t) n2, (p4est_locidx_t) n2, user);
+    }
+    if (z2 < n2) {
+      diff_fn (p4est1, p4est2, jt, P4EST_DIFF_MOVED,
+               (p4est_locidx_t) n1, (p4est_locidx_t) n1,
+               (p4est_locidx_t) z2, (p4est_locidx_t) n2, user);
+    }
+  }
+}
+
+p4est_locidx_t     *
+p4est_traversal_level_order (p4est_t * p4est)
+{
+  int                 l;
+  size_t              zz;
+  p4est_topidx_t      jt;
+  p4est_locidx_t      sum, count;
+  p4est_locidx_t      offsets[P4EST_MAXLEVEL + 1];
+  p4est_locidx_t     *perm;
+  p4est_tree_t       *tree;
+  p4est_quadrant_t   *q;
+
+  perm = P4EST_ALLOC (p4est_locidx_t, p4est->local_num_quadrants);
+
+  /* the level bucket sizes are already tracked per tree */
+  sum = 0;
+  for (l = 0; l <= P4EST_QMAXLEVEL; ++l) {
+    offsets[l] = sum;
+    for (jt = p4est->first_local_tree; jt <= p4est->last_local_tree; ++jt) {
+      tree = p4est_tree_array_index (p4est->trees, jt);
+      sum += tree->quadrants_per_level[l];
+    }
+  }
+  P4EST_ASSERT (sum == p4est->local_num_quadrants);
+
+  /* stable counting sort: within a level the (tree, Morton) order holds */
+  for (jt = p4est->first_local_tree; jt <= p4est->last_local_tree; ++jt) {
+    tree = p4est_tree_array_index (p4est->trees, jt);
+    count = p4est_tree_num_quadrants (tree);
+    q = p4est_tree_quadrants_base (tree);
+    for (zz = 0; zz < (size_t) count; ++zz, ++q) {
+      perm[offsets[q->level]++] =
+        tree->quadrants_offset + (p4est_locidx_t) zz;
+    }
+  }
+
+  return perm;
+}
+
+/** Key and original position of one quadrant during the key sort. */
+typedef struct p4est_traversal_pair
+{
+  uint64_t            key;
+  p4est_locidx_t      index;
+}
+p4est_traversal_pair_t;
+
+static int
+p4est_traversal_pair_compare (const void *v1, const void *v2)
+{
+  const p4est_traversal_pair_t *p1 = (const p4est_traversal_pair_t *) v1;
+  const p4est_traversal_pair_t *p2 = (const p4est_traversal_pair_t *) v2;
+
+  if (p1->key != p2->key) {
+    return p1->key < p2->key ? -1 : 1;
+  }
+  /* break ties by the original (tree, Morton) position */
+  return p1->index < p2->index ? -1 : (p1->index > p2->index ? 1 : 0);
+}
+
+p4est_locidx_t     *
+p4est_traversal_key_order (p4est_t * p4est,
+                           p4est_traversal_key_t key_fn, void *user)
+{
+  size_t              zz;
+  p4est_topidx_t      jt;
+  p4est_locidx_t      il, lcount;
+  p4est_locidx_t     *perm;
+  p4est_tree_t       *tree;
+  p4est_quadrant_t   *q;
+  p4est_traversal_pair_t *pairs;
+
+  P4EST_ASSERT (key_fn != NULL);
+
+  lcount = p4est->local_num_quadrants;
+  pairs = P4EST_ALLOC (p4est_traversal_pair_t, lcount);
+  for (jt = p4est->first_local_tree; jt <= p4est->last_local_tree; ++jt) {
+    tree = p4est_tree_array_index (p4est->trees, jt);
+    q = p4est_tree_quadrants_base (tree);
+    for (zz = 0; zz < tree->quadrants.elem_count; ++zz, ++q) {
+      il = tree->quadrants_offset + (p4est_locidx_t) zz;
+      pairs[il].key = key_fn (p4est, jt, q, user);
+      pairs[il].index = il;
+    }
+  }
+  qsort (pairs, (size_t) lcount, sizeof (p4est_traversal_pair_t),
+         p4est_traversal_pair_compare);
+
+  perm = P4EST_ALLOC (p4est_locidx_t, lcount);
+  for (il = 0; il < lcount; ++il) {
+    perm[il] = pairs[il].index;
+  }
+  P4EST_FREE (pairs);
+
+  return perm;
+}
+
 int
 p4est_is_valid (p4est_t * p4est)
 {
@@ -548,10 +758,19 @@ p4est_is_valid (p4est_t * p4est)
     }
   }
 
-  /* check individual trees */
+  /* check individual trees; the metadata of trees outside the local
+   * range is not kept up to date and thus exempt from inspection */
   lquadrants = 0;
   for (jt = 0; jt < (p4est_topidx_t) p4est->trees->elem_count; ++jt) {
     tree = p4est_tree_array_index (p4est->trees, jt);
+    if (jt < p4est->first_local_tree || jt > p4est->last_local_tree) {
+      if (tree->quadrants.elem_count > 0) {
+        P4EST_NOTICE ("p4est invalid outside count\n");
+        failed = 1;
+        goto failtest;
+      }
+      continue;
+    }
     if (tree->quadrants_offset != lquadrants) {
       P4EST_NOTICE ("p4est invalid quadrants offset\n");
       failed = 1;
@@ -563,11 +782,6 @@ p4est_is_valid (p4est_t * p4est)
       goto failtest;
     }
     if (tree->quadrants.elem_count > 0) {
-      if (jt < p4est->first_local_tree || jt > p4est->last_local_tree) {
-        P4EST_NOTICE ("p4est invalid outside count\n");
-        failed = 1;
-        goto failtest;
-      }
       q = p4est_quadrant_array_index (&tree->quadrants, 0);
       p4est_quadrant_first_descendant (q, &s, P4EST_QMAXLEVEL);
       if (!p4est_quadrant_is_equal (&s, &tree->first_desc)) {
@@ -641,6 +855,115 @@ failtest:
   return !p4est_comm_sync_flag (p4est, failed, MPI_BOR);
 }
 
+int
+p4est_is_coherent (p4est_t * p4est)
+{
+  const int           rank = p4est->mpirank;
+  const p4est_topidx_t first_tree = p4est->first_local_tree;
+  const p4est_topidx_t last_tree = p4est->last_local_tree;
+  size_t              count;
+  p4est_topidx_t      jt;
+  p4est_locidx_t      lquadrants;
+  p4est_quadrant_t   *q, *r;
+  p4est_quadrant_t    s;
+  p4est_tree_t       *tree;
+
+  /* All checks below are local and run in constant time per local tree
+   * without visiting the quadrants in between, so the whole pass stays
+   * negligible next to any operation that touched the quadrants. */
+
+  if (p4est->connectivity->num_trees !=
+      (p4est_topidx_t) p4est->trees->elem_count) {
+    P4EST_NOTICE ("p4est incoherent tree count\n");
+    return 0;
+  }
+  if (first_tree < 0 || last_tree < first_tree) {
+    if (!(first_tree == -1 && last_tree == -2) ||
+        p4est->local_num_quadrants != 0) {
+      P4EST_NOTICE ("p4est incoherent empty tree range\n");
+      return 0;
+    }
+  }
+
+  /* the local count must agree with the global partition counters */
+  if (p4est->global_first_quadrant[0] != 0 ||
+      p4est->global_first_quadrant[p4est->mpisize] !=
+      p4est->global_num_quadrants ||
+      p4est->global_first_quadrant[rank + 1] -
+      p4est->global_first_quadrant[rank] !=
+      (p4est_gloidx_t) p4est->local_num_quadrants) {
+    P4EST_NOTICE ("p4est incoherent global quadrant counts\n");
+    return 0;
+  }
+
+  lquadrants = 0;
+  for (jt = first_tree; jt >= 0 && jt <= last_tree; ++jt) {
+    tree = p4est_tree_array_index (p4est->trees, jt);
+    if (tree->quadrants_offset != lquadrants) {
+      P4EST_NOTICE ("p4est incoherent quadrants offset\n");
+      return 0;
+    }
+    count = tree->quadrants.elem_count;
+    if (count > 0) {
+      if ((int) tree->maxlevel > P4EST_QMAXLEVEL ||
+          tree->quadrants_per_level[tree->maxlevel] <= 0) {
+        P4EST_NOTICE ("p4est incoherent level histogram\n");
+        return 0;
+      }
+
+      /* spot check the Morton order at the tree boundaries */
+      q = p4est_quadrant_array_index (&tree->quadrants, 0);
+      r = p4est_quadrant_array_index (&tree->quadrants, count - 1);
+      if (!p4est_quadrant_is_valid (q) || !p4est_quadrant_is_valid (r)) {
+        P4EST_NOTICE ("p4est incoherent boundary quadrant\n");
+        return 0;
+      }
+      if (count > 1 && p4est_quadrant_compare (q, r) >= 0) {
+        P4EST_NOTICE ("p4est incoherent tree order\n");
+        return 0;
+      }
+      p4est_quadrant_first_descendant (q, &s, P4EST_QMAXLEVEL);
+      if (!p4est_quadrant_is_equal (&s, &tree->first_desc)) {
+        P4EST_NOTICE ("p4est incoherent first tree descendant\n");
+        return 0;
+      }
+      p4est_quadrant_last_descendant (r, &s, P4EST_QMAXLEVEL);
+      if (!p4est_quadrant_is_equal (&s, &tree->last_desc)) {
+        P4EST_NOTICE ("p4est incoherent last tree descendant\n");
+        return 0;
+      }
+    }
+    lquadrants += (p4est_locidx_t) count;
+  }
+  if (lquadrants != p4est->local_num_quadrants) {
+    P4EST_NOTICE ("p4est incoherent local quadrant count\n");
+    return 0;
+  }
+
+  /* the first local quadrant must sit at the partition boundary */
+  if (first_tree >= 0) {
+    if (p4est->global_first_position[rank].p.which_tree != first_tree) {
+      P4EST_NOTICE ("p4est incoherent first tree\n");
+      return 0;
+    }
+    tree = p4est_tree_array_index (p4est->trees, first_tree);
+    if (tree->quadrants.elem_count > 0) {
+      q = p4est_quadrant_array_index (&tree->quadrants, 0);
+      if (q->x != p4est->global_first_position[rank].x ||
+          q->y != p4est->global_first_position[rank].y ||
+#ifdef P4_TO_P8
+          q->z != p4est->global_first_position[rank].z ||
+#endif
+          0) {
+        P4EST_NOTICE ("p4est incoherent low quadrant\n");
+        return 0;
+      }
+    }
+  }
+
+  return 1;
+}
+
 /* here come the heavyweight algorithms */
 #ifndef P4_TO_P8
 /* which face of the center quad touches this insul */
@@ -1083,7 +1406,7 @@ p4est_tree_uniqify_overlap (sc_array_t * out)
   }
 
   /* sort array and remove duplicates */
-  sc_array_sort (out, p4est_quadrant_compare_piggy);
+  p4est_quadrant_array_sort_piggy (out);
   dupcount = olcount = 0;
   iz = 0;                       /* read counter */
   jz = 0;                       /* write counter */
@@ -1206,8 +1529,8 @@ p4est_tree_remove_nonowned (p4est_t * p4est, p4est_topidx_t which_tree)
   sc_array_resize (quadrants, incount);
 
   tree->maxlevel = 0;
-  for (zz = 0; zz < incount; ++zz) {
-    q1 = p4est_quadrant_array_index (quadrants, zz);
+  q1 = p4est_tree_quadrants_base (tree);
+  for (zz = 0; zz < incount; ++zz, ++q1) {
     P4EST_ASSERT (p4est_quadrant_is_valid (q1));
     tree->maxlevel = (int8_t) SC_MAX (tree->maxlevel, q1->level);
   }
@@ -1250,6 +1573,7 @@ p4est_complete_region (p4est_t * p4est,
 
   int                 comp;
   int                 maxlevel = 0;
+  uint64_t            akey, bkey, wkey;
   p4est_locidx_t     *quadrants_per_level;
 
   P4EST_QUADRANT_INIT (&Afinest);
@@ -1286,6 +1610,10 @@ p4est_complete_region (p4est_t * p4est,
   }
 
   if (comp < 0) {
+    /* the keys carry the SFC order and ancestor relation of a and b */
+    akey = p4est_quadrant_morton_key (&a);
+    bkey = p4est_quadrant_morton_key (&b);
+
     /* W <- C(A_{finest}(a,b)) */
     p4est_nearest_common_ancestor (&a, &b, &Afinest);
 
@@ -1318,12 +1646,11 @@ p4est_complete_region (p4est_t * p4est,
     /* for each w in W */
     while (W->elem_count > 0) {
       w = p4est_quadrant_list_pop (W);
+      wkey = p4est_quadrant_morton_key (w);
 
       /* if (a < w < b) and (w not in {A(b)}) */
-      if (((p4est_quadrant_compare (&a, w) < 0) &&
-           (p4est_quadrant_compare (w, &b) < 0)
-          ) && !p4est_quadrant_is_ancestor (w, &b)
-        ) {
+      if (akey < wkey && wkey < bkey &&
+          !p4est_morton_key_is_ancestor (wkey, bkey)) {
         /* R <- R + w */
         r = p4est_quadrant_array_push (quadrants);
         *r = *w;
@@ -1332,8 +1659,8 @@ p4est_complete_region (p4est_t * p4est,
         ++quadrants_per_level[r->level];
       }
       /* else if (w in {{A(a)}, {A(b)}}) */
-      else if (p4est_quadrant_is_ancestor (w, &a)
-               || p4est_quadrant_is_ancestor (w, &b)) {
+      else if (p4est_morton_key_is_ancestor (wkey, akey) ||
+               p4est_morton_key_is_ancestor (wkey, bkey)) {
         /* W <- W + C(w) */
         c0 = p4est_quadrant_mempool_alloc (quadrant_pool);
         c1 = p4est_quadrant_mempool_alloc (quadrant_pool);
@@ -1383,7 +1710,148 @@ p4est_complete_region (p4est_t * p4est,
 
   P4EST_ASSERT (p4est_tree_is_complete (R));
   P4EST_ASSERT (quadrant_pool_size == p4est->quadrant_pool->elem_count);
+  if (p4est->user_data_pool != NULL && p4est->user_data_arena == NULL) {
+    P4EST_ASSERT (data_pool_size + quadrants->elem_count ==
+                  p4est->user_data_pool->elem_count);
+  }
+}
+
+void
+p4est_complete_region_counted (p4est_t * p4est,
+                               const p4est_quadrant_t * q1, int include_q1,
+                               const p4est_quadrant_t * q2, int include_q2,
+                               p4est_tree_t * tree,
+                               p4est_topidx_t which_tree,
+                               p4est_init_t init_fn)
+{
+#ifdef P4EST_DEBUG
+  size_t              data_pool_size;
+#endif
+  int                 l, t, id, top_id;
+  int                 maxlevel = 0;
+  size_t              ncount, zz;
+  sc_array_t         *quadrants;
+  p4est_locidx_t     *quadrants_per_level;
+  p4est_quadrant_t    a = *q1;
+  p4est_quadrant_t    b = *q2;
+  p4est_quadrant_t    afinest, anc;
+  p4est_quadrant_t   *r;
+
+  P4EST_QUADRANT_INIT (&afinest);
+
+  quadrants = &tree->quadrants;
+  quadrants_per_level = tree->quadrants_per_level;
+
+  /* Assert that we have an empty tree */
+  P4EST_ASSERT (quadrants->elem_count == 0);
+
+  /* Assert that a<b */
+  P4EST_ASSERT (p4est_quadrant_compare (&a, &b) < 0);
+
+#ifdef P4EST_DEBUG
+  data_pool_size = 0;
   if (p4est->user_data_pool != NULL) {
+    data_pool_size = p4est->user_data_pool->elem_count;
+  }
+#endif
+
+  p4est_nearest_common_ancestor (&a, &b, &afinest);
+  t = (int) afinest.level + 1;
+  P4EST_ASSERT ((int) b.level >= t);
+
+  /* The output is determined by the child id ladders of a and b above
+   * their nearest common ancestor, so its size is known beforehand. */
+  ncount = (include_q1 ? 1 : 0) + (include_q2 ? 1 : 0);
+  top_id = p4est_quadrant_ancestor_id (&b, t);
+  if ((int) a.level >= t) {
+    for (l = t + 1; l <= (int) a.level; ++l) {
+      ncount += P4EST_CHILDREN - 1 - p4est_quadrant_ancestor_id (&a, l);
+    }
+    ncount += top_id - p4est_quadrant_ancestor_id (&a, t) - 1;
+  }
+  else {
+    /* a is the common ancestor and contributes no sibling ladder */
+    P4EST_ASSERT (p4est_quadrant_is_ancestor (&a, &b));
+    ncount += top_id;
+  }
+  for (l = t + 1; l <= (int) b.level; ++l) {
+    ncount += p4est_quadrant_ancestor_id (&b, l);
+  }
+
+  /* reserve the quadrant array once and fill it in Morton order */
+  sc_array_resize (quadrants, ncount);
+  zz = 0;
+
+  /* R <- R + a */
+  if (include_q1) {
+    r = p4est_quadrant_array_index (quadrants, zz++);
+    *r = a;
+    p4est_quadrant_init_data (p4est, which_tree, r, init_fn);
+    maxlevel = SC_MAX ((int) r->level, maxlevel);
+    ++quadrants_per_level[r->level];
+  }
+
+  /* climb from a to the common ancestor emitting trailing siblings */
+  if ((int) a.level >= t) {
+    anc = a;
+    for (l = (int) a.level; l >= t; --l) {
+      id = p4est_quadrant_child_id (&anc);
+      while (++id < (l > t ? P4EST_CHILDREN : top_id)) {
+        r = p4est_quadrant_array_index (quadrants, zz++);
+        p4est_quadrant_sibling (&anc, r, id);
+        p4est_quadrant_init_data (p4est, which_tree, r, init_fn);
+        maxlevel = SC_MAX ((int) r->level, maxlevel);
+        ++quadrants_per_level[r->level];
+      }
+      if (l > t) {
+        p4est_quadrant_parent (&anc, &anc);
+      }
+    }
+  }
+  else {
+    /* the run of children of a preceding the child containing b */
+    p4est_quadrant_ancestor (&b, t, &anc);
+    for (id = 0; id < top_id; ++id) {
+      r = p4est_quadrant_array_index (quadrants, zz++);
+      p4est_quadrant_sibling (&anc, r, id);
+      p4est_quadrant_init_data (p4est, which_tree, r, init_fn);
+      maxlevel = SC_MAX ((int) r->level, maxlevel);
+      ++quadrants_per_level[r->level];
+    }
+  }
+
+  /* descend towards b emitting the leading siblings on each level */
+  for (l = t + 1; l <= (int) b.level; ++l) {
+    if (l < (int) b.level) {
+      p4est_quadrant_ancestor (&b, l, &anc);
+    }
+    else {
+      anc = b;
+    }
+    top_id = p4est_quadrant_child_id (&anc);
+    for (id = 0; id < top_id; ++id) {
+      r = p4est_quadrant_array_index (quadrants, zz++);
+      p4est_quadrant_sibling (&anc, r, id);
+      p4est_quadrant_init_data (p4est, which_tree, r, init_fn);
+      maxlevel = SC_MAX ((int) r->level, maxlevel);
+      ++quadrants_per_level[r->level];
+    }
+  }
+
+  /* R <- R + b */
+  if (include_q2) {
+    r = p4est_quadrant_array_index (quadrants, zz++);
+    *r = b;
+    p4est_quadrant_init_data (p4est, which_tree, r, init_fn);
+    maxlevel = SC_MAX ((int) r->level, maxlevel);
+    ++quadrants_per_level[r->level];
+  }
+
+  P4EST_ASSERT (zz == ncount);
+  tree->maxlevel = (int8_t) maxlevel;
+
+  P4EST_ASSERT (p4est_tree_is_complete (tree));
+  if (p4est->user_data_pool != NULL && p4est->user_data_arena == NULL) {
     P4EST_ASSERT (data_pool_size + quadrants->elem_count ==
                   p4est->user_data_pool->elem_count);
   }
@@ -1785,7 +2253,7 @@ p4est_complete_or_balance_kernel (sc_array_t * inlist,
 
   /* sort inlist */
   if (inlist->elem_count > incount) {
-    sc_array_sort (inlist, p4est_quadrant_compare);
+    p4est_quadrant_array_sort (inlist);
   }
 
   /* step through inlist and fill in the gaps in out */
@@ -2027,6 +2495,9 @@ p4est_complete_or_balance (p4est_t * p4est, p4est_topidx_t which_tree,
   inlist = sc_array_new (sizeof (p4est_quadrant_t));
   outlist = sc_array_new (sizeof (p4est_quadrant_t));
 
+  /* the balanced tree contains at least as many quadrants as the input */
+  p4est_quadrant_array_reserve (outlist, tcount);
+
   /* get the reduced representation of the tree */
   q = (p4est_quadrant_t *) sc_array_push (inlist);
   p = p4est_quadrant_array_index (tquadrants, 0);
@@ -2106,12 +2577,11 @@ p4est_complete_or_balance (p4est_t * p4est, p4est_topidx_t which_tree,
     p4est_quadrant_init_data (p4est, which_tree, p, init_fn);
   }
 
-  /* resize tquadrants and copy */
-  sc_array_resize (tquadrants, ocount);
-  memcpy (tquadrants->array, outlist->array, outlist->elem_size * ocount);
+  /* hand the balanced array to the tree without copying */
+  p4est_quadrant_array_swap (tquadrants, outlist);
 
   /* sanity check */
-  if (p4est->user_data_pool != NULL) {
+  if (p4est->user_data_pool != NULL && p4est->user_data_arena == NULL) {
     P4EST_ASSERT (data_pool_size + (ocount - tcount) ==
                   p4est->user_data_pool->elem_count);
   }
@@ -2164,7 +2634,8 @@ p4est_balance_border (p4est_t * p4est, p4est_connect_type_t btype,
   size_t              num_added, num_this_added;
   int                 bound;
   ssize_t             tqindex;
-  size_t              tqorig;
+  size_t              tqorig, tqfirst;
+  size_t              chunk, batch_used;
   sc_mempool_t       *list_alloc, *qpool;
   /* get this tree's border */
   sc_array_t         *qarray = (sc_array_t *) sc_array_index (borders,
@@ -2198,10 +2669,7 @@ p4est_balance_border (p4est_t * p4est, p4est_connect_type_t btype,
 
   tree = p4est_tree_array_index (p4est->trees, which_tree);
   tquadrants = &(tree->quadrants);
-  tqorig = tquadrants->elem_count;
-  tqoffset = 0;
-  sc_array_init_view (&tqview, tquadrants, tqoffset,
-                      tquadrants->elem_count - tqoffset);
+  tqfirst = tquadrants->elem_count;
 
   qpool = p4est->quadrant_pool;
 
@@ -2223,7 +2691,7 @@ p4est_balance_border (p4est_t * p4est, p4est_connect_type_t btype,
   flist = sc_array_new (sizeof (p4est_quadrant_t));
 
   /* sort the border and remove duplicates */
-  sc_array_sort (qarray, p4est_quadrant_compare);
+  p4est_quadrant_array_sort (qarray);
   jz = 1;                       /* number included */
   kz = 0;                       /* number skipped */
   p = p4est_quadrant_array_index (qarray, 0);
@@ -2246,8 +2714,37 @@ p4est_balance_border (p4est_t * p4est, p4est_connect_type_t btype,
   sc_array_resize (qarray, jz);
   qcount = jz;
 
+  /* a bounded chunk caps the closure held in flist at any one time */
+  chunk = p4est->balance_chunk > 0 ? (size_t) p4est->balance_chunk : qcount;
+
+  tqorig = tquadrants->elem_count;
+  tqoffset = 0;
+  sc_array_init_view (&tqview, tquadrants, tqoffset, tqorig - tqoffset);
+
+  /* the rebuilt tree keeps all original quadrants plus the insertions */
+  p4est_quadrant_array_reserve (flist, tqorig);
+  batch_used = 0;
+
   /* step through border */
   for (iz = 0; iz < qcount; iz++) {
+    if (batch_used >= chunk) {
+      /* the batch budget is spent: merge flist into the tree and
+       * start the next bounded rebuild from the merged state */
+      if (tqoffset < tqorig) {
+        fcount = flist->elem_count;
+        sc_array_resize (flist, fcount + tqorig - tqoffset);
+        memcpy (sc_array_index (flist, fcount),
+                tqview.array, (tqorig - tqoffset) * sizeof (p4est_quadrant_t));
+      }
+      p4est_quadrant_array_swap (tquadrants, flist);
+      sc_array_resize (flist, 0);
+      tqorig = tquadrants->elem_count;
+      tqoffset = 0;
+      sc_array_init_view (&tqview, tquadrants, tqoffset, tqorig - tqoffset);
+      p4est_quadrant_array_reserve (flist, tqorig);
+      batch_used = 0;
+    }
+
     p = p4est_quadrant_array_index (qarray, iz);
 
     if (p4est_quadrant_compare (p, &(tree->first_desc)) < 0 &&
@@ -2352,6 +2849,7 @@ p4est_balance_border (p4est_t * p4est, p4est_connect_type_t btype,
     }
 
     /* skip over the quadrants that we just operated on */
+    batch_used += kz - iz;
     iz = kz - 1;
   }
 
@@ -2363,13 +2861,11 @@ p4est_balance_border (p4est_t * p4est, p4est_connect_type_t btype,
             tqview.array, (tqorig - tqoffset) * sizeof (p4est_quadrant_t));
   }
 
-  /* copy flist into tquadrants */
-  sc_array_resize (tquadrants, flist->elem_count);
-  memcpy (tquadrants->array, flist->array,
-          flist->elem_count * flist->elem_size);
+  /* hand the rebuilt array to the tree without copying */
+  p4est_quadrant_array_swap (tquadrants, flist);
 
   sc_mempool_destroy (list_alloc);
-  P4EST_ASSERT (tqorig + num_added == tquadrants->elem_count);
+  P4EST_ASSERT (tqfirst + num_added == tquadrants->elem_count);
 
   /* print more statistics */
   P4EST_VERBOSEF
@@ -2416,6 +2912,7 @@ p4est_linearize_tree (p4est_t * p4est, p4est_tree_t * tree)
   size_t              current, rest;
   p4est_locidx_t      num_quadrants;
   int                 i, maxlevel;
+  uint64_t           *keys;
   p4est_quadrant_t   *q1, *q2;
   sc_array_t         *tquadrants = &tree->quadrants;
 
@@ -2433,32 +2930,40 @@ p4est_linearize_tree (p4est_t * p4est, p4est_tree_t * tree)
 #endif
   removed = 0;
 
-  /* run through the array and remove ancestors */
+  /* run through the key array and remove ancestors.  Since the array is
+   * sorted, a kept quadrant is redundant exactly if its key equals or
+   * is an ancestor key of the next key. */
+  keys = p4est_quadrant_array_morton_keys (tquadrants);
   current = 0;
-  rest = current + 1;
   q1 = p4est_quadrant_array_index (tquadrants, current);
-  while (rest < incount) {
+  for (rest = 1; rest < incount; ++rest) {
     q2 = p4est_quadrant_array_index (tquadrants, rest);
-    if (p4est_quadrant_is_equal (q1, q2) ||
-        p4est_quadrant_is_ancestor (q1, q2)) {
+    P4EST_ASSERT ((keys[current] == keys[rest] ||
+                   p4est_morton_key_is_ancestor (keys[current],
+                                                 keys[rest])) ==
+                  (p4est_quadrant_is_equal (q1, q2) ||
+                   p4est_quadrant_is_ancestor (q1, q2)));
+    if (keys[current] == keys[rest] ||
+        p4est_morton_key_is_ancestor (keys[current], keys[rest])) {
       --tree->quadrants_per_level[q1->level];
       p4est_quadrant_free_data (p4est, q1);
       *q1 = *q2;
+      keys[current] = keys[rest];
       ++removed;
-      ++rest;
     }
     else {
       ++current;
       if (current < rest) {
         q1 = p4est_quadrant_array_index (tquadrants, current);
         *q1 = *q2;
+        keys[current] = keys[rest];
       }
       else {
         q1 = q2;
       }
-      ++rest;
     }
   }
+  P4EST_FREE (keys);
 
   /* resize array */
   sc_array_resize (tquadrants, current + 1);
@@ -2478,7 +2983,7 @@ p4est_linearize_tree (p4est_t * p4est, p4est_tree_t * tree)
   /* sanity checks */
   P4EST_ASSERT (num_quadrants == (p4est_locidx_t) tquadrants->elem_count);
   P4EST_ASSERT (tquadrants->elem_count == incount - removed);
-  if (p4est->user_data_pool != NULL) {
+  if (p4est->user_data_pool != NULL && p4est->user_data_arena == NULL) {
     P4EST_ASSERT (data_pool_size - removed ==
                   p4est->user_data_pool->elem_count);
   }
@@ -2488,6 +2993,304 @@ p4est_linearize_tree (p4est_t * p4est, p4est_tree_t * tree)
   return removed;
 }
 
+void
+p4est_quadrant_array_reserve (sc_array_t * quadrants, size_t count)
+{
+  size_t              bytes;
+
+  P4EST_ASSERT (quadrants->elem_size == sizeof (p4est_quadrant_t));
+  /* a view has no storage of its own to grow */
+  P4EST_ASSERT (SC_ARRAY_IS_OWNER (quadrants));
+
+  bytes = count * sizeof (p4est_quadrant_t);
+  if (bytes > (size_t) quadrants->byte_alloc) {
+    /* grow the allocation without changing the element count;
+       subsequent pushes up to the capacity will not reallocate */
+    quadrants->byte_alloc = (ssize_t) bytes;
+    quadrants->array = SC_REALLOC (quadrants->array, char, bytes);
+  }
+}
+
+void
+p4est_quadrant_array_swap (sc_array_t * a, sc_array_t * b)
+{
+  sc_array_t          tmp;
+
+  P4EST_ASSERT (a->elem_size == sizeof (p4est_quadrant_t));
+  P4EST_ASSERT (b->elem_size == sizeof (p4est_quadrant_t));
+  /* both arrays must own their storage; views cannot change owners */
+  P4EST_ASSERT (SC_ARRAY_IS_OWNER (a));
+  P4EST_ASSERT (SC_ARRAY_IS_OWNER (b));
+
+  tmp = *a;
+  *a = *b;
+  *b = tmp;
+}
+
+size_t
+p4est_quadrant_array_compress (sc_array_t * quadrants, sc_array_t * runs)
+{
+  size_t              zz, incount;
+  p4est_quadrant_t   *q, *prev;
+  p4est_quadrant_run_t *run;
+
+  P4EST_ASSERT (quadrants->elem_size == sizeof (p4est_quadrant_t));
+  P4EST_ASSERT (runs->elem_size == sizeof (p4est_quadrant_run_t));
+  P4EST_ASSERT (sc_array_is_sorted (quadrants, p4est_quadrant_compare));
+
+  sc_array_resize (runs, 0);
+  run = NULL;
+  prev = NULL;
+  incount = quadrants->elem_count;
+  q = (p4est_quadrant_t *) quadrants->array;
+  for (zz = 0; zz < incount; ++zz, ++q) {
+    if (prev != NULL && q->level == prev->level &&
+        p4est_quadrant_is_next (prev, q)) {
+      /* extend the current uniform-level run */
+      ++run->count;
+    }
+    else {
+      run = (p4est_quadrant_run_t *) sc_array_push (runs);
+      run->first = *q;
+      run->first.p.user_data = NULL;
+      run->count = 1;
+    }
+    prev = q;
+  }
+
+  return runs->elem_count;
+}
+
+void
+p4est_quadrant_array_uncompress (sc_array_t * runs, sc_array_t * quadrants)
+{
+  size_t              zz, zcount, pos;
+  p4est_locidx_t      il;
+  uint64_t            id;
+  p4est_quadrant_t   *q;
+  p4est_quadrant_run_t *run;
+
+  P4EST_ASSERT (quadrants->elem_size == sizeof (p4est_quadrant_t));
+  P4EST_ASSERT (runs->elem_size == sizeof (p4est_quadrant_run_t));
+
+  /* count the expanded size */
+  zcount = 0;
+  for (zz = 0; zz < runs->elem_count; ++zz) {
+    run = (p4est_quadrant_run_t *) sc_array_index (runs, zz);
+    P4EST_ASSERT (run->count > 0);
+    zcount += (size_t) run->count;
+  }
+  sc_array_resize (quadrants, zcount);
+
+  /* recreate the quadrants of each run by consecutive Morton indices */
+  pos = 0;
+  for (zz = 0; zz < runs->elem_count; ++zz) {
+    run = (p4est_quadrant_run_t *) sc_array_index (runs, zz);
+    id = p4est_quadrant_linear_id (&run->first, (int) run->first.level);
+    for (il = 0; il < run->count; ++il) {
+      q = p4est_quadrant_array_index (quadrants, pos++);
+      P4EST_QUADRANT_INIT (q);
+      p4est_quadrant_set_morton (q, (int) run->first.level,
+                                 id + (uint64_t) il);
+      q->p.user_data = NULL;
+    }
+  }
+  P4EST_ASSERT (pos == zcount);
+  P4EST_ASSERT (sc_array_is_sorted (quadrants, p4est_quadrant_compare));
+}
+
+/* below this count the constant per-pass cost outweighs the comparisons */
+#define P4EST_RADIX_CUTOFF 256
+
+/* significant bytes of the interleaved key above the low 64-bit word */
+#ifndef P4_TO_P8
+#define P4EST_RADIX_HI_BYTES 1
+#else
+#define P4EST_RADIX_HI_BYTES 5
+#endif
+
+/** Sort key of one quadrant: the bit-interleaved unsigned coordinates
+ * shifted up by one byte that holds the level as the tiebreaker, plus
+ * the owner tree for the piggy variant.  The coordinate bias of
+ * p4est_quadrant_compare for extended quadrants equals reading the
+ * coordinates as unsigned, and its choice of the dimension with the
+ * most significant differing bit equals interleaving with z above y
+ * above x at each bit position.
+ */
+typedef struct p4est_radix_item
+{
+  uint64_t            hi, lo;
+  uint32_t            tree;
+  uint32_t            idx;
+}
+p4est_radix_item_t;
+
+#ifndef P4_TO_P8
+
+/** Spread the 32 bits of \a a over the even bit positions. */
+static inline uint64_t
+p4est_radix_spread2 (uint32_t a)
+{
+  uint64_t            x = (uint64_t) a;
+
+  x = (x | (x << 16)) & 0x0000FFFF0000FFFFULL;
+  x = (x | (x << 8)) & 0x00FF00FF00FF00FFULL;
+  x = (x | (x << 4)) & 0x0F0F0F0F0F0F0F0FULL;
+  x = (x | (x << 2)) & 0x3333333333333333ULL;
+  x = (x | (x << 1)) & 0x5555555555555555ULL;
+
+  return x;
+}
+
+#else
+
+/** Spread the low 21 bits of \a a over every third bit position. */
+static inline uint64_t
+p8est_radix_spread3 (uint32_t a)
+{
+  uint64_t            x = (uint64_t) a & 0x1FFFFFULL;
+
+  x = (x | (x << 32)) & 0x001F00000000FFFFULL;
+  x = (x | (x << 16)) & 0x001F0000FF0000FFULL;
+  x = (x | (x << 8)) & 0x100F00F00F00F00FULL;
+  x = (x | (x << 4)) & 0x10C30C30C30C30C3ULL;
+  x = (x | (x << 2)) & 0x1249249249249249ULL;
+
+  return x;
+}
+
+#endif /* P4_TO_P8 */
+
+/** Compute the radix sort key of one quadrant. */
+static inline void
+p4est_radix_key (const p4est_quadrant_t * q, p4est_radix_item_t * item)
+{
+  uint64_t            klo, khi;
+#ifndef P4_TO_P8
+  klo = p4est_radix_spread2 ((uint32_t) q->x) |
+    (p4est_radix_spread2 ((uint32_t) q->y) << 1);
+  khi = 0;
+#else
+  uint64_t            s;
+
+  klo = p8est_radix_spread3 ((uint32_t) q->x) |
+    (p8est_radix_spread3 ((uint32_t) q->y) << 1) |
+    (p8est_radix_spread3 ((uint32_t) q->z) << 2);
+  s = p8est_radix_spread3 ((uint32_t) q->x >> 21);
+  klo |= s << 63;
+  khi = s >> 1;
+  khi |= p8est_radix_spread3 ((uint32_t) q->y >> 21);
+  khi |= p8est_radix_spread3 ((uint32_t) q->z >> 21) << 1;
+#endif
+  /* the level breaks ties between equal anchors, ancestors first */
+  item->hi = (khi << 8) | (klo >> 56);
+  item->lo = (klo << 8) | (uint64_t) (uint8_t) q->level;
+}
+
+/** Extract byte \a pass of the key, counting from least significant. */
+static inline unsigned
+p4est_radix_digit (const p4est_radix_item_t * item, int pass)
+{
+  if (pass < 8) {
+    return (unsigned) (item->lo >> (8 * pass)) & 0xFF;
+  }
+  if (pass < 8 + P4EST_RADIX_HI_BYTES) {
+    return (unsigned) (item->hi >> (8 * (pass - 8))) & 0xFF;
+  }
+
+  return (unsigned)
+    (item->tree >> (8 * (pass - 8 - P4EST_RADIX_HI_BYTES))) & 0xFF;
+}
+
+/** Least significant digit radix sort of a quadrant array.
+ * \param [in] with_tree    If true, sort by p.which_tree first as
+ *                          p4est_quadrant_compare_piggy does.
+ */
+static void
+p4est_quadrant_array_radix_sort (sc_array_t * quadrants, int with_tree)
+{
+  const size_t        n = quadrants->elem_count;
+  size_t              zz, count[256];
+  int                 pass, npasses;
+  unsigned            d;
+  p4est_quadrant_t   *q, *qtemp;
+  p4est_radix_item_t *items, *temp, *swap, *it;
+
+  P4EST_ASSERT (quadrants->elem_size == sizeof (p4est_quadrant_t));
+
+  if (n < P4EST_RADIX_CUTOFF) {
+    sc_array_sort (quadrants, with_tree ?
+                   p4est_quadrant_compare_piggy : p4est_quadrant_compare);
+    return;
+  }
+
+  items = P4EST_ALLOC (p4est_radix_item_t, n);
+  temp = P4EST_ALLOC (p4est_radix_item_t, n);
+  q = (p4est_quadrant_t *) quadrants->array;
+  for (zz = 0; zz < n; ++zz) {
+    p4est_radix_key (q + zz, items + zz);
+    P4EST_ASSERT (!with_tree || q[zz].p.which_tree >= 0);
+    items[zz].tree = with_tree ? (uint32_t) q[zz].p.which_tree : 0;
+    items[zz].idx = (uint32_t) zz;
+  }
+
+  npasses = 8 + P4EST_RADIX_HI_BYTES + (with_tree ? 4 : 0);
+  for (pass = 0; pass < npasses; ++pass) {
+    memset (count, 0, 256 * sizeof (size_t));
+    for (zz = 0; zz < n; ++zz) {
+      ++count[p4est_radix_digit (items + zz, pass)];
+    }
+    d = p4est_radix_digit (items, pass);
+    if (count[d] == n) {
+      /* all keys share this byte; nothing would move */
+      continue;
+    }
+    /* exclusive prefix sum turns the histogram into scatter offsets */
+    {
+      size_t              sum = 0, c;
+
+      for (d = 0; d < 256; ++d) {
+        c = count[d];
+        count[d] = sum;
+        sum += c;
+      }
+    }
+    for (zz = 0; zz < n; ++zz) {
+      it = items + zz;
+      temp[count[p4est_radix_digit (it, pass)]++] = *it;
+    }
+    swap = items;
+    items = temp;
+    temp = swap;
+  }
+
+  /* apply the final permutation to the quadrants in one gather */
+  qtemp = P4EST_ALLOC (p4est_quadrant_t, n);
+  for (zz = 0; zz < n; ++zz) {
+    qtemp[zz] = q[items[zz].idx];
+  }
+  memcpy (q, qtemp, n * sizeof (p4est_quadrant_t));
+  P4EST_FREE (qtemp);
+  P4EST_FREE (items);
+  P4EST_FREE (temp);
+
+  P4EST_ASSERT (sc_array_is_sorted (quadrants, with_tree ?
+                                    p4est_quadrant_compare_piggy :
+                                    p4est_quadrant_compare));
+}
+
+void
+p4est_quadrant_array_sort (sc_array_t * quadrants)
+{
+  p4est_quadrant_array_radix_sort (quadrants, 0);
+}
+
+void
+p4est_quadrant_array_sort_piggy (sc_array_t * quadrants)
+{
+  p4est_quadrant_array_radix_sort (quadrants, 1);
+}
+
 p4est_locidx_t
 p4est_partition_correction (p4est_gloidx_t * partition,
                             int num_procs, int rank,
@@ -2554,17 +3357,46 @@ p4est_next_nonempty_process (int rank, int num_procs,
   return rank;
 }
 
-p4est_gloidx_t
-p4est_partition_given (p4est_t * p4est,
-                       const p4est_locidx_t * new_num_quadrants_in_proc)
+/** Everything the second half of the split quadrant migration needs to
+ * know about the first half.  Allocated by p4est_partition_given_begin
+ * and consumed by p4est_partition_given_end.
+ */
+struct p4est_partition_context
+{
+  p4est_t            *p4est;
+  int                 num_proc_recv_from, num_proc_send_to;
+  p4est_locidx_t     *num_recv_from, *num_send_to;
+  p4est_gloidx_t     *begin_send_to;
+  p4est_locidx_t     *num_per_tree_local;
+  p4est_gloidx_t     *local_tree_last_quad_index;
+  p4est_gloidx_t     *global_last_quad_index;
+  p4est_gloidx_t     *new_global_last_quad_index;
+  p4est_gloidx_t      total_quadrants_shipped;
+  char              **recv_buf, **send_buf;
+#ifdef P4EST_MPI
+  MPI_Request        *recv_request, *send_request;
+  MPI_Status         *recv_status, *send_status;
+#endif
+#ifdef P4EST_DEBUG
+  unsigned            crc;
+#endif
+};
+
+p4est_partition_context_t *
+p4est_partition_given_begin (p4est_t * p4est,
+                             const p4est_locidx_t *
+                             new_num_quadrants_in_proc)
 {
   const int           num_procs = p4est->mpisize;
   const int           rank = p4est->mpirank;
   const p4est_topidx_t first_local_tree = p4est->first_local_tree;
   const p4est_topidx_t last_local_tree = p4est->last_local_tree;
   const size_t        data_size = p4est->data_size;
-  const size_t        quad_plus_data_size = sizeof (p4est_quadrant_t)
-    + data_size;
+  /* only coordinates and level travel; the piggy union is dead weight
+   * in tree-local arrays and the user data is shipped separately */
+  const size_t        quad_pack_size = (P4EST_DIM + 1)
+    * sizeof (p4est_qcoord_t);
+  const size_t        quad_plus_data_size = quad_pack_size + data_size;
   sc_array_t         *trees = p4est->trees;
 
   /* *INDENT-OFF* horrible indent bug */
@@ -2577,25 +3409,16 @@ p4est_partition_given (p4est_t * p4est,
   int                 from_proc, to_proc;
   int                 num_proc_recv_from, num_proc_send_to;
   char               *user_data_send_buf;
-  char               *user_data_recv_buf;
   char              **recv_buf, **send_buf;
-  size_t              recv_size, send_size, zz, zoffset;
-  p4est_topidx_t      it;
+  size_t              recv_size, send_size;
+  size_t              peak_bytes = 0;
   p4est_topidx_t      which_tree;
-  p4est_topidx_t      first_tree, last_tree;
   p4est_topidx_t      num_recv_trees;
-  p4est_topidx_t      new_first_local_tree, new_last_local_tree;
-  p4est_topidx_t      first_from_tree, last_from_tree, from_tree;
   p4est_locidx_t      il;
   p4est_locidx_t      num_copy;
-  p4est_locidx_t      num_quadrants;
-  p4est_locidx_t      new_local_num_quadrants;
   p4est_locidx_t     *num_recv_from, *num_send_to;
-  p4est_locidx_t     *new_local_tree_elem_count;
-  p4est_locidx_t     *new_local_tree_elem_count_before;
   p4est_locidx_t     *num_per_tree_local;
   p4est_locidx_t     *num_per_tree_send_buf;
-  p4est_locidx_t     *num_per_tree_recv_buf;
   p4est_gloidx_t     *begin_send_to;
   p4est_gloidx_t      tree_from_begin, tree_from_end, num_copy_global;
   p4est_gloidx_t      from_begin, from_end;
@@ -2605,11 +3428,10 @@ p4est_partition_given (p4est_t * p4est,
   p4est_gloidx_t     *new_global_last_quad_index;
   p4est_gloidx_t     *local_tree_last_quad_index;
   p4est_gloidx_t      diff64, total_quadrants_shipped;
-  sc_array_t         *quadrants;
-  p4est_quadrant_t   *quad_send_buf;
-  p4est_quadrant_t   *quad_recv_buf;
-  p4est_quadrant_t   *quad;
+  p4est_qcoord_t     *quad_send_buf;
+  p4est_quadrant_t   *q;
   p4est_tree_t       *tree;
+  p4est_partition_context_t *ctx;
 #ifdef P4EST_MPI
   int                 mpiret;
   MPI_Comm            comm = p4est->mpicomm;
@@ -2625,6 +3447,9 @@ p4est_partition_given (p4est_t * p4est,
     ("Into " P4EST_STRING "_partition_given with %lld total quadrants\n",
      (long long) p4est->global_num_quadrants);
 
+  /* the partition rewrites every tree, so freeze all attached views */
+  p4est_view_preserve_all (p4est);
+
 #ifdef P4EST_DEBUG
   /* Save a checksum of the original forest */
   crc = p4est_checksum (p4est);
@@ -2762,7 +3587,8 @@ p4est_partition_given (p4est_t * p4est,
       recv_size = num_recv_trees * sizeof (p4est_locidx_t)
         + quad_plus_data_size * num_recv_from[from_proc];
 
-      recv_buf[from_proc] = P4EST_ALLOC (char, recv_size);
+      recv_buf[from_proc] = (char *) p4est_staging_acquire (recv_size);
+      peak_bytes += recv_size;
 
       /* Post receives for the quadrants and their data */
 #ifdef P4EST_MPI
@@ -2866,18 +3692,23 @@ p4est_partition_given (p4est_t * p4est,
       send_size = num_send_trees * sizeof (p4est_locidx_t)
         + quad_plus_data_size * num_send_to[to_proc];
 
-      send_buf[to_proc] = P4EST_ALLOC (char, send_size);
+      send_buf[to_proc] = (char *) p4est_staging_acquire (send_size);
+      peak_bytes += send_size;
+      if (p4est->inspect != NULL) {
+        p4est->inspect->partition_comm_sent += send_size;
+        ++p4est->inspect->partition_nzpeers;
+      }
 
       num_per_tree_send_buf = (p4est_locidx_t *) send_buf[to_proc];
       memset (num_per_tree_send_buf, 0,
               num_send_trees * sizeof (p4est_locidx_t));
-      quad_send_buf = (p4est_quadrant_t *) (send_buf[to_proc]
-                                            +
-                                            num_send_trees *
-                                            sizeof (p4est_locidx_t));
+      quad_send_buf = (p4est_qcoord_t *) (send_buf[to_proc]
+                                          +
+                                          num_send_trees *
+                                          sizeof (p4est_locidx_t));
       user_data_send_buf =
         send_buf[to_proc] + num_send_trees * sizeof (p4est_locidx_t)
-        + num_send_to[to_proc] * sizeof (p4est_quadrant_t);
+        + num_send_to[to_proc] * quad_pack_size;
 
       /* Pack in the data to be sent */
 
@@ -2901,26 +3732,33 @@ p4est_partition_given (p4est_t * p4est,
 
           num_per_tree_send_buf[which_tree - first_local_tree] = num_copy;
 
-          /* copy quads to send buf */
-          memcpy (quad_send_buf, tree->quadrants.array +
-                  tree_from_begin * sizeof (p4est_quadrant_t),
-                  num_copy * sizeof (p4est_quadrant_t));
-
-          /* set tree in send buf and copy user data */
+          /* pack quadrant coordinates and user data into the send buf */
           P4EST_LDEBUGF ("partition send %lld [%lld,%lld] quadrants"
                          " from tree %lld to proc %d\n",
                          (long long) num_copy, (long long) tree_from_begin,
                          (long long) tree_from_end, (long long) which_tree,
                          to_proc);
-          for (il = 0; il < num_copy; ++il) {
-            memcpy (user_data_send_buf + il * data_size,
-                    quad_send_buf[il].p.user_data, data_size);
-            quad_send_buf[il].p.user_data = NULL;
+          q = (p4est_quadrant_t *) tree->quadrants.array + tree_from_begin;
+          for (il = 0; il < num_copy; ++il, ++q) {
+            *quad_send_buf++ = q->x;
+            *quad_send_buf++ = q->y;
+#ifdef P4_TO_P8
+            *quad_send_buf++ = q->z;
+#endif
+            *quad_send_buf++ = (p4est_qcoord_t) q->level;
+            if (data_size > 0 && p4est->data_pack_fn != NULL) {
+              /* only quadrants leaving the process pay serialization */
+              p4est->data_pack_fn (p4est, which_tree, q,
+                                   user_data_send_buf + il * data_size);
+            }
+            else {
+              memcpy (user_data_send_buf + il * data_size,
+                      q->p.user_data, data_size);
+            }
           }
 
           /* move pointer to beginning of quads that need to be copied */
           my_begin += num_copy;
-          quad_send_buf += num_copy;
           user_data_send_buf += num_copy * data_size;
         }
       }
@@ -2944,6 +3782,99 @@ p4est_partition_given (p4est_t * p4est,
   for (; sk < num_proc_send_to; ++sk) {
     send_request[sk] = MPI_REQUEST_NULL;
   }
+#endif
+
+  /* record the memory peak while all send and receive buffers
+   * coexist with the not yet modified quadrant arrays */
+  if (p4est_mempeak_active ()) {
+    p4est_mempeak_sample (P4EST_STRING "_partition_given",
+                          peak_bytes + p4est_memory_used (p4est));
+  }
+
+  /* Package up what the completion step needs to know */
+  ctx = P4EST_ALLOC (p4est_partition_context_t, 1);
+  ctx->p4est = p4est;
+  ctx->num_proc_recv_from = num_proc_recv_from;
+  ctx->num_proc_send_to = num_proc_send_to;
+  ctx->num_recv_from = num_recv_from;
+  ctx->num_send_to = num_send_to;
+  ctx->begin_send_to = begin_send_to;
+  ctx->num_per_tree_local = num_per_tree_local;
+  ctx->local_tree_last_quad_index = local_tree_last_quad_index;
+  ctx->global_last_quad_index = global_last_quad_index;
+  ctx->new_global_last_quad_index = new_global_last_quad_index;
+  ctx->total_quadrants_shipped = total_quadrants_shipped;
+  ctx->recv_buf = recv_buf;
+  ctx->send_buf = send_buf;
+#ifdef P4EST_MPI
+  ctx->recv_request = recv_request;
+  ctx->send_request = send_request;
+  ctx->recv_status = recv_status;
+  ctx->send_status = send_status;
+#endif
+#ifdef P4EST_DEBUG
+  ctx->crc = crc;
+#endif
+
+  return ctx;
+}
+
+p4est_gloidx_t
+p4est_partition_given_end (p4est_partition_context_t * ctx)
+{
+  p4est_t            *p4est = ctx->p4est;
+  const int           num_procs = p4est->mpisize;
+  const int           rank = p4est->mpirank;
+  const p4est_topidx_t first_local_tree = p4est->first_local_tree;
+  const p4est_topidx_t last_local_tree = p4est->last_local_tree;
+  const size_t        data_size = p4est->data_size;
+  /* must match the wire format of p4est_partition_given_begin */
+  const size_t        quad_pack_size = (P4EST_DIM + 1)
+    * sizeof (p4est_qcoord_t);
+  sc_array_t         *trees = p4est->trees;
+  char              **recv_buf = ctx->recv_buf;
+  char              **send_buf = ctx->send_buf;
+  p4est_locidx_t     *num_recv_from = ctx->num_recv_from;
+  p4est_locidx_t     *num_send_to = ctx->num_send_to;
+  p4est_gloidx_t     *begin_send_to = ctx->begin_send_to;
+  p4est_locidx_t     *num_per_tree_local = ctx->num_per_tree_local;
+  p4est_gloidx_t     *local_tree_last_quad_index =
+    ctx->local_tree_last_quad_index;
+  p4est_gloidx_t     *global_last_quad_index = ctx->global_last_quad_index;
+  p4est_gloidx_t     *new_global_last_quad_index =
+    ctx->new_global_last_quad_index;
+  p4est_gloidx_t      total_quadrants_shipped = ctx->total_quadrants_shipped;
+  int                 i;
+  int                 from_proc;
+  char               *user_data_recv_buf;
+  size_t              zz, zoffset;
+  p4est_topidx_t      it;
+  p4est_topidx_t      which_tree;
+  p4est_topidx_t      first_tree, last_tree;
+  p4est_topidx_t      num_recv_trees;
+  p4est_topidx_t      new_first_local_tree, new_last_local_tree;
+  p4est_topidx_t      first_from_tree, last_from_tree, from_tree;
+  p4est_locidx_t      num_copy;
+  p4est_locidx_t      num_quadrants;
+  p4est_locidx_t      new_local_num_quadrants;
+  p4est_locidx_t     *new_local_tree_elem_count;
+  p4est_locidx_t     *new_local_tree_elem_count_before;
+  p4est_locidx_t     *num_per_tree_recv_buf;
+  p4est_gloidx_t      tree_from_begin, tree_from_end;
+  p4est_gloidx_t      from_begin, from_end;
+  p4est_gloidx_t      my_base, my_begin, my_end;
+  sc_array_t         *quadrants;
+  p4est_qcoord_t     *quad_recv_buf;
+  p4est_quadrant_t   *quad;
+  p4est_tree_t       *tree;
+#ifdef P4EST_MPI
+  int                 mpiret;
+  const int           num_proc_recv_from = ctx->num_proc_recv_from;
+  const int           num_proc_send_to = ctx->num_proc_send_to;
+  MPI_Request        *recv_request = ctx->recv_request;
+  MPI_Request        *send_request = ctx->send_request;
+  MPI_Status         *recv_status = ctx->recv_status;
+  MPI_Status         *send_status = ctx->send_status;
 
   /* Fill in forest */
   mpiret = MPI_Waitall (num_proc_recv_from, recv_request, recv_status);
@@ -3134,12 +4065,12 @@ p4est_partition_given (p4est_t * p4est,
         (from_proc == rank) ? num_per_tree_local :
         (p4est_locidx_t *) recv_buf[from_proc];
 
-      quad_recv_buf = (p4est_quadrant_t *) (recv_buf[from_proc]
-                                            + num_recv_trees *
-                                            sizeof (p4est_locidx_t));
+      quad_recv_buf = (p4est_qcoord_t *) (recv_buf[from_proc]
+                                          + num_recv_trees *
+                                          sizeof (p4est_locidx_t));
       user_data_recv_buf =
         recv_buf[from_proc] + num_recv_trees * sizeof (p4est_locidx_t)
-        + num_recv_from[from_proc] * sizeof (p4est_quadrant_t);
+        + num_recv_from[from_proc] * quad_pack_size;
 
       for (it = 0; it < num_recv_trees; ++it) {
         from_tree = first_from_tree + it;       /* same type */
@@ -3158,25 +4089,33 @@ p4est_partition_given (p4est_t * p4est,
           num_quadrants = new_local_tree_elem_count[from_tree];
           sc_array_resize (quadrants, num_quadrants);
 
-          /* copy quadrants */
+          /* unpack quadrant coordinates and user data */
           P4EST_LDEBUGF ("copying %lld remote quads to tree %lld"
                          " with %lld quads from proc %d\n",
                          (long long) num_copy, (long long) from_tree,
                          (long long) num_quadrants, from_proc);
-          memcpy (quadrants->array +
-                  new_local_tree_elem_count_before[from_tree]
-                  * sizeof (p4est_quadrant_t), quad_recv_buf,
-                  num_copy * sizeof (p4est_quadrant_t));
-
-          /* copy user data */
           zoffset = (size_t) new_local_tree_elem_count_before[from_tree];
           for (zz = 0; zz < (size_t) num_copy; ++zz) {
             quad = p4est_quadrant_array_index (quadrants, zz + zoffset);
+            P4EST_QUADRANT_INIT (quad);
+            quad->x = quad_recv_buf[(P4EST_DIM + 1) * zz + 0];
+            quad->y = quad_recv_buf[(P4EST_DIM + 1) * zz + 1];
+#ifdef P4_TO_P8
+            quad->z = quad_recv_buf[(P4EST_DIM + 1) * zz + 2];
+#endif
+            quad->level =
+              (int8_t) quad_recv_buf[(P4EST_DIM + 1) * zz + P4EST_DIM];
 
             if (data_size > 0) {
               quad->p.user_data = sc_mempool_alloc (p4est->user_data_pool);
-              memcpy (quad->p.user_data, user_data_recv_buf + zz * data_size,
-                      data_size);
+              if (p4est->data_unpack_fn != NULL) {
+                p4est->data_unpack_fn (p4est, from_tree, quad,
+                                       user_data_recv_buf + zz * data_size);
+              }
+              else {
+                memcpy (quad->p.user_data,
+                        user_data_recv_buf + zz * data_size, data_size);
+              }
             }
             else {
               quad->p.user_data = NULL;
@@ -3192,11 +4131,11 @@ p4est_partition_given (p4est_t * p4est,
         }
 
         /* increment the recv quadrant pointers */
-        quad_recv_buf += num_copy;
+        quad_recv_buf += (size_t) num_copy * (P4EST_DIM + 1);
         user_data_recv_buf += num_copy * data_size;
       }
       if (recv_buf[from_proc] != NULL) {
-        P4EST_FREE (recv_buf[from_proc]);
+        p4est_staging_release (recv_buf[from_proc]);
         recv_buf[from_proc] = NULL;
       }
     }
@@ -3219,14 +4158,10 @@ p4est_partition_given (p4est_t * p4est,
   p4est->first_local_tree = new_first_local_tree;
   p4est->last_local_tree = new_last_local_tree;
 
+  /* only trees in the new local range carry valid metadata */
   new_local_num_quadrants = 0;
-  for (which_tree = 0; which_tree < new_first_local_tree; ++which_tree) {
-    tree = p4est_tree_array_index (trees, which_tree);
-    tree->quadrants_offset = 0;
-    P4EST_QUADRANT_INIT (&tree->first_desc);
-    P4EST_QUADRANT_INIT (&tree->last_desc);
-  }
-  for (; which_tree <= new_last_local_tree; ++which_tree) {
+  for (which_tree = new_first_local_tree; which_tree <= new_last_local_tree;
+       ++which_tree) {
     tree = p4est_tree_array_index (trees, which_tree);
     tree->quadrants_offset = new_local_num_quadrants;
     quadrants = &tree->quadrants;
@@ -3239,8 +4174,8 @@ p4est_partition_given (p4est_t * p4est,
       tree->quadrants_per_level[i] = 0;
     }
     tree->maxlevel = 0;
-    for (zz = 0; zz < quadrants->elem_count; ++zz) {
-      quad = p4est_quadrant_array_index (quadrants, zz);
+    quad = p4est_tree_quadrants_base (tree);
+    for (zz = 0; zz < quadrants->elem_count; ++zz, ++quad) {
       ++tree->quadrants_per_level[quad->level];
       tree->maxlevel = (int8_t) SC_MAX (quad->level, tree->maxlevel);
     }
@@ -3251,12 +4186,6 @@ p4est_partition_given (p4est_t * p4est,
     quad = p4est_quadrant_array_index (quadrants, quadrants->elem_count - 1);
     p4est_quadrant_last_descendant (quad, &tree->last_desc, P4EST_QMAXLEVEL);
   }
-  for (; which_tree < p4est->connectivity->num_trees; ++which_tree) {
-    tree = p4est_tree_array_index (trees, which_tree);
-    tree->quadrants_offset = new_local_num_quadrants;
-    P4EST_QUADRANT_INIT (&tree->first_desc);
-    P4EST_QUADRANT_INIT (&tree->last_desc);
-  }
   p4est->local_num_quadrants = new_local_num_quadrants;
 
   /* Clean up */
@@ -3281,9 +4210,9 @@ p4est_partition_given (p4est_t * p4est,
 
   for (i = 0; i < num_procs; ++i) {
     if (recv_buf[i] != NULL)
-      P4EST_FREE (recv_buf[i]);
+      p4est_staging_release (recv_buf[i]);
     if (send_buf[i] != NULL)
-      P4EST_FREE (send_buf[i]);
+      p4est_staging_release (send_buf[i]);
   }
 
   P4EST_FREE (num_per_tree_local);
@@ -3298,8 +4227,12 @@ p4est_partition_given (p4est_t * p4est,
 
   p4est_comm_global_partition (p4est, NULL);
 
+  /* the partition has changed; invalidate revision-keyed caches */
+  ++p4est->revision;
+
   /* Assert that we have a valid partition */
-  P4EST_ASSERT (crc == p4est_checksum (p4est));
+  P4EST_ASSERT (ctx->crc == p4est_checksum (p4est));
+  P4EST_FREE (ctx);
   P4EST_GLOBAL_INFOF
     ("Done " P4EST_STRING
      "_partition_given shipped %lld quadrants %.3g%%\n",
@@ -3308,3 +4241,11 @@ p4est_partition_given (p4est_t * p4est,
 
   return total_quadrants_shipped;
 }
+
+p4est_gloidx_t
+p4est_partition_given (p4est_t * p4est,
+                       const p4est_locidx_t * new_num_quadrants_in_proc)
+{
+  return p4est_partition_given_end
+    (p4est_partition_given_begin (p4est, new_num_quadrants_in_proc));
+}
@@ -105,6 +105,94 @@ void                p4est_tree_print (int log_priority, p4est_tree_t * tree);
 int                 p4est_is_equal (p4est_t * p4est1, p4est_t * p4est2,
                                     int compare_data);
 
+/** The kinds of change reported by p4est_diff. */
+typedef enum p4est_diff_type
+{
+  P4EST_DIFF_REFINED,   /**< one quadrant replaced by descendants */
+  P4EST_DIFF_COARSENED, /**< several quadrants replaced by an ancestor */
+  P4EST_DIFF_MOVED      /**< present in only one forest, e.g. after
+                             a shifted partition boundary */
+}
+p4est_diff_type_t;
+
+/** Callback reporting one changed range between two forests.
+ * The ranges index into the respective tree's quadrant array; one of
+ * them may be empty for P4EST_DIFF_MOVED.
+ * \param [in] which_tree   The tree containing the change.
+ * \param [in] type         The kind of change; see p4est_diff_type_t.
+ * \param [in] begin1, end1 Changed quadrants [begin1, end1) in the
+ *                          tree of \a p4est1.
+ * \param [in] begin2, end2 Corresponding range in \a p4est2.
+ * \param [in] user         Pointer passed through unchanged.
+ */
+typedef void        (*p4est_diff_t) (p4est_t * p4est1, p4est_t * p4est2,
+                                     p4est_topidx_t which_tree,
+                                     p4est_diff_type_t type,
+                                     p4est_locidx_t begin1,
+                                     p4est_locidx_t end1,
+                                     p4est_locidx_t begin2,
+                                     p4est_locidx_t end2, void *user);
+
+/** Report the differences between two Morton-sorted forests.
+ * Both local quadrant sequences are walked in a single merge pass;
+ * runs of identical quadrants are passed over silently and each
+ * refined, coarsened or moved range triggers one callback, so the
+ * cost is one sweep plus work proportional to the changes.  Both
+ * forests must be defined on connectivities with the same tree count;
+ * quadrant data is not compared.
+ * \param [in] p4est1   The earlier forest, e.g. before p4est_balance.
+ * \param [in] p4est2   The later forest.
+ * \param [in] diff_fn  Called once per changed range, in Morton order.
+ * \param [in] user     Passed to the callback unchanged.
+ */
+void                p4est_diff (p4est_t * p4est1, p4est_t * p4est2,
+                                p4est_diff_t diff_fn, void *user);
+
+/** Callback returning a traversal sort key for a local quadrant.
+ * \param [in] p4est       The forest being indexed.
+ * \param [in] which_tree  The tree containing \a quadrant.
+ * \param [in] quadrant    A local quadrant of \a which_tree.
+ * \param [in] user        Passed through from the index builder.
+ * \return                 Key to order the traversal by, ascending.
+ */
+typedef uint64_t    (*p4est_traversal_key_t) (p4est_t * p4est,
+                                              p4est_topidx_t which_tree,
+                                              const p4est_quadrant_t *
+                                              quadrant, void *user);
+
+/** Build a traversal index over the local quadrants in level order.
+ *
+ * The index orders quadrants by (level, tree, Morton) using a counting
+ * sort over the per-tree \a quadrants_per_level bucket sizes, so no
+ * comparisons are made.  Build it once per adaptation and iterate the
+ * local quadrants through it for wavefront-style sweeps.
+ *
+ * \param [in] p4est    The forest to be indexed.
+ * \return              Array of \a local_num_quadrants cumulative local
+ *                      quadrant indices, allocated with P4EST_ALLOC;
+ *                      it is owned by the caller and freed with
+ *                      P4EST_FREE.  Stale after the forest changes.
+ */
+p4est_locidx_t     *p4est_traversal_level_order (p4est_t * p4est);
+
+/** Build a traversal index over the local quadrants by a user key.
+ *
+ * Like \ref p4est_traversal_level_order with the order given by a
+ * caller-provided key, e.g. a diagonal sweep direction.  Ties keep the
+ * (tree, Morton) order.
+ *
+ * \param [in] p4est    The forest to be indexed.
+ * \param [in] key_fn   Called once per local quadrant.
+ * \param [in] user     Passed to \a key_fn unchanged.
+ * \return              Array of \a local_num_quadrants cumulative local
+ *                      quadrant indices, allocated with P4EST_ALLOC;
+ *                      it is owned by the caller and freed with
+ *                      P4EST_FREE.  Stale after the forest changes.
+ */
+p4est_locidx_t     *p4est_traversal_key_order (p4est_t * p4est,
+                                               p4est_traversal_key_t key_fn,
+                                               void *user);
+
 /** Check a forest for validity and allreduce the result.
  * Some properties of a valid forest are:
  *    the quadrant counters are consistent
@@ -115,6 +203,20 @@ int                 p4est_is_equal (p4est_t * p4est1, p4est_t * p4est2,
  */
 int                 p4est_is_valid (p4est_t * p4est);
 
+/** Check the cheap structural invariants of a forest.
+ * This is the production companion of p4est_is_valid: it verifies the
+ * counters against global_first_quadrant, the tree offsets, the level
+ * histogram at maxlevel, and the Morton order and descendants at the
+ * tree boundaries, in constant time per local tree and without
+ * communication or a pass over the quadrants.  Calling it after every
+ * step costs a negligible fraction of a checksum while catching the
+ * common corruption classes; a false result on any process indicates
+ * a damaged forest even though the other processes may return true.
+ * \param [in] p4est    The forest to be tested.
+ * \return              Returns true if the invariants hold locally.
+ */
+int                 p4est_is_coherent (p4est_t * p4est);
+
 /** Compute the overlap of a number of insulation layers with a tree.
  * Every quadrant out of the insulation layer of the quadrants in \a in
  * except the quadrant itself is checked for overlap of quadrants
@@ -181,6 +283,36 @@ void                p4est_complete_region (p4est_t * p4est,
                                            p4est_topidx_t which_tree,
                                            p4est_init_t init_fn);
 
+/** Constructs a minimal linear octree between two octants, counted.
+ *
+ * Produces exactly the same tree as \ref p4est_complete_region.
+ * The output count is computed analytically from the child id ladders
+ * of \a q1 and \a q2 above their nearest common ancestor, the quadrant
+ * array is resized once, and the quadrants are generated in level runs
+ * without touching the quadrant mempool or a work list.
+ *
+ * \pre \a q1 < \a q2 in the Morton ordering.
+ *
+ * \param [in]  p4est      Used for the memory pools and quadrant init.
+ * \param [in]  q1         First input quadrant.  Data init'ed if included.
+ * \param [in]  include_q1 Flag to specify whether q1 is included.
+ * \param [in]  q2         Second input quadrant.  Data init'ed if included.
+ * \param [in]  include_q2 Flag to specify whether q2 is included.
+ * \param [out] tree       Initialized tree with zero elements.
+ * \param [in]  which_tree The 0-based index of \a tree which is needed for
+ *                         the \c p4est_quadrant_init_data routine.
+ * \param [in]  init_fn    Callback function to initialize the user_data
+ *                         which is already allocated automatically.
+ */
+void                p4est_complete_region_counted (p4est_t * p4est,
+                                                   const p4est_quadrant_t *
+                                                   q1, int include_q1,
+                                                   const p4est_quadrant_t *
+                                                   q2, int include_q2,
+                                                   p4est_tree_t * tree,
+                                                   p4est_topidx_t which_tree,
+                                                   p4est_init_t init_fn);
+
 /** Completes a sorted tree within a p4est. It may have exterior quadrants.
  * The completed tree will have only owned quadrants and no overlap.
  * \param [in,out] p4est      The p4est to work on.
@@ -223,6 +355,80 @@ void                p4est_balance_border (p4est_t * p4est,
 size_t              p4est_linearize_tree (p4est_t * p4est,
                                           p4est_tree_t * tree);
 
+/** A maximal run of same-level quadrants consecutive in Morton order. */
+typedef struct p4est_quadrant_run
+{
+  p4est_quadrant_t    first;    /**< first quadrant of the run */
+  p4est_locidx_t      count;    /**< number of quadrants in the run */
+}
+p4est_quadrant_run_t;
+
+/** Compress a sorted quadrant array into uniform-level Morton runs.
+ * Uniformly refined regions collapse into one run each, so large
+ * inactive portions of a forest can be held or stored at a small
+ * fraction of their expanded size.  The user data pointers are not
+ * represented; they must be reestablished after uncompressing.
+ *
+ * \param [in] quadrants   Sorted array of p4est_quadrant_t.
+ * \param [in,out] runs    Array of p4est_quadrant_run_t.  Its previous
+ *                         contents are overwritten with the encoding.
+ * \return                 The number of runs created.
+ */
+size_t              p4est_quadrant_array_compress (sc_array_t * quadrants,
+                                                   sc_array_t * runs);
+
+/** Expand an array of Morton runs back into individual quadrants.
+ * This is the inverse of \ref p4est_quadrant_array_compress.
+ *
+ * \param [in] runs        Array of p4est_quadrant_run_t.
+ * \param [in,out] quadrants    Array of p4est_quadrant_t.  Its previous
+ *                         contents are overwritten with the expansion;
+ *                         all user data pointers are set to NULL.
+ */
+void                p4est_quadrant_array_uncompress (sc_array_t * runs,
+                                                     sc_array_t * quadrants);
+
+/** Preallocate storage for a quadrant array without changing its count.
+ * Callers that know the final number of quadrants up front can use this
+ * to replace the doubling reallocations of repeated pushes with a single
+ * allocation.  Shrinking requests are ignored.
+ *
+ * \param [in,out] quadrants    Array of p4est_quadrant_t owning its
+ *                              storage; must not be a view.
+ * \param [in] count       Number of quadrants to make room for.
+ */
+void                p4est_quadrant_array_reserve (sc_array_t * quadrants,
+                                                  size_t count);
+
+/** Exchange the contents of two quadrant arrays in constant time.
+ * This transfers ownership of the storage instead of copying elements,
+ * so a freshly built array can be handed to a tree for the price of a
+ * struct assignment.
+ *
+ * \param [in,out] a       Array of p4est_quadrant_t owning its storage.
+ * \param [in,out] b       Array of p4est_quadrant_t owning its storage.
+ */
+void                p4est_quadrant_array_swap (sc_array_t * a,
+                                               sc_array_t * b);
+
+/** Sort a quadrant array into the order of p4est_quadrant_compare.
+ * Large arrays go through a radix sort on the interleaved Morton key
+ * instead of a comparison sort, which removes the indirect call per
+ * comparison at the price of temporary storage proportional to the
+ * array; small arrays fall back to sc_array_sort.
+ *
+ * \param [in,out] quadrants    Array of p4est_quadrant_t.
+ */
+void                p4est_quadrant_array_sort (sc_array_t * quadrants);
+
+/** Sort a quadrant array as p4est_quadrant_compare_piggy does.
+ * Same algorithm as \ref p4est_quadrant_array_sort with the owner tree
+ * p.piggy3.which_tree, which must be valid, as the primary key.
+ *
+ * \param [in,out] quadrants    Array of p4est_quadrant_t.
+ */
+void                p4est_quadrant_array_sort_piggy (sc_array_t * quadrants);
+
 /** Compute correction of partition for a process.
  *
  * The correction denotes how many quadrants the process with id \a rank takes
@@ -280,6 +486,41 @@ p4est_gloidx_t      p4est_partition_given (p4est_t * p4est,
                                            const p4est_locidx_t *
                                            num_quadrants_in_proc);
 
+/** Transient state of a split quadrant migration.
+ * Created by p4est_partition_given_begin and destroyed by
+ * p4est_partition_given_end; its contents are private.
+ */
+typedef struct p4est_partition_context p4est_partition_context_t;
+
+/** Start the quadrant migration of p4est_partition_given.
+ *
+ * This posts the receives and sends for the quadrants and their user
+ * data and returns without waiting for them, so computation that does
+ * not touch the forest contents can overlap the message transfer.
+ * The forest may be read but must not be modified until
+ * p4est_partition_given_end has completed the migration.
+ *
+ * \param [in,out] p4est the forest that is partitioned.
+ * \param [in]     num_quadrants_in_proc  an integer array of the number of
+ *                                        quadrants desired per processor.
+ * \return  Returns a context to pass to p4est_partition_given_end.
+ */
+p4est_partition_context_t *p4est_partition_given_begin (p4est_t * p4est,
+                                                        const p4est_locidx_t
+                                                        *
+                                                        num_quadrants_in_proc);
+
+/** Finish the quadrant migration begun by p4est_partition_given_begin.
+ *
+ * Waits for the posted messages, fills the received quadrants and their
+ * user data into the forest and frees the context.
+ *
+ * \param [in] context   created by p4est_partition_given_begin.
+ * \return  Returns the global count of shipped quadrants.
+ */
+p4est_gloidx_t      p4est_partition_given_end (p4est_partition_context_t *
+                                               context);
+
 SC_EXTERN_C_END;
 
 #endif /* !P4EST_ALGORITHMS_H */
@@ -31,6 +31,215 @@
 #include <p4est_search.h>
 #endif /* !P4_TO_P8 */
 
+/* The kernels below reduce scaled distances to a level drop.  For the
+ * small distances that dominate after near-balance, the drop is read
+ * from the following compile-time tables; larger distances fall through
+ * to the arithmetic path.  Entry [d] of the 1d table is LOG2 (d + 1);
+ * the others tabulate the respective kernel over the capped domain. */
+#define P4EST_BAL_LUT_1D 32
+#define P4EST_BAL_LUT_2D 16
+#ifdef P4_TO_P8
+#define P8EST_BAL_LUT_3D 8
+#endif
+
+/* *INDENT-OFF* */
+static const int8_t p4est_balance_drop_1d[P4EST_BAL_LUT_1D] =
+{ 0, 1, 1, 2, 2, 2, 2, 3, 3, 3, 3, 3, 3, 3, 3, 4,
+  4, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4, 5 };
+
+static const int8_t p4est_balance_drop_2d[P4EST_BAL_LUT_2D][P4EST_BAL_LUT_2D] =
+{
+  { 0, 1, 1, 2, 2, 2, 2, 3, 3, 3, 3, 3, 3, 3, 3, 4 },
+  { 1, 2, 2, 2, 2, 3, 3, 3, 3, 3, 3, 3, 3, 4, 4, 4 },
+  { 1, 2, 2, 2, 2, 3, 3, 3, 3, 3, 3, 3, 3, 4, 4, 4 },
+  { 2, 2, 2, 3, 3, 3, 3, 3, 3, 3, 3, 4, 4, 4, 4, 4 },
+  { 2, 2, 2, 3, 3, 3, 3, 3, 3, 3, 3, 4, 4, 4, 4, 4 },
+  { 2, 3, 3, 3, 3, 3, 3, 3, 3, 4, 4, 4, 4, 4, 4, 4 },
+  { 2, 3, 3, 3, 3, 3, 3, 3, 3, 4, 4, 4, 4, 4, 4, 4 },
+  { 3, 3, 3, 3, 3, 3, 3, 4, 4, 4, 4, 4, 4, 4, 4, 4 },
+  { 3, 3, 3, 3, 3, 3, 3, 4, 4, 4, 4, 4, 4, 4, 4, 4 },
+  { 3, 3, 3, 3, 3, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4 },
+  { 3, 3, 3, 3, 3, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4 },
+  { 3, 3, 3, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4 },
+  { 3, 3, 3, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4 },
+  { 3, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4 },
+  { 3, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4 },
+  { 4, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4, 5 }
+};
+
+#ifdef P4_TO_P8
+static const int8_t p8est_balance_drop_3d_edge
+  [P8EST_BAL_LUT_3D][P8EST_BAL_LUT_3D][P8EST_BAL_LUT_3D] =
+{
+  {
+    { 0, 1, 1, 2, 2, 2, 2, 3 },
+    { 1, 1, 1, 2, 2, 2, 2, 3 },
+    { 1, 1, 1, 2, 2, 2, 2, 3 },
+    { 2, 2, 2, 2, 2, 2, 2, 3 },
+    { 2, 2, 2, 2, 2, 2, 2, 3 },
+    { 2, 2, 2, 2, 2, 2, 2, 3 },
+    { 2, 2, 2, 2, 2, 2, 2, 3 },
+    { 3, 3, 3, 3, 3, 3, 3, 3 }
+  },
+  {
+    { 1, 1, 1, 2, 2, 2, 2, 3 },
+    { 1, 2, 2, 2, 2, 2, 2, 3 },
+    { 1, 2, 2, 2, 2, 2, 2, 3 },
+    { 2, 2, 2, 2, 2, 2, 2, 3 },
+    { 2, 2, 2, 2, 2, 2, 2, 3 },
+    { 2, 2, 2, 2, 2, 3, 3, 3 },
+    { 2, 2, 2, 2, 2, 3, 3, 3 },
+    { 3, 3, 3, 3, 3, 3, 3, 3 }
+  },
+  {
+    { 1, 1, 1, 2, 2, 2, 2, 3 },
+    { 1, 2, 2, 2, 2, 2, 2, 3 },
+    { 1, 2, 2, 2, 2, 2, 2, 3 },
+    { 2, 2, 2, 2, 2, 2, 2, 3 },
+    { 2, 2, 2, 2, 2, 2, 2, 3 },
+    { 2, 2, 2, 2, 2, 3, 3, 3 },
+    { 2, 2, 2, 2, 2, 3, 3, 3 },
+    { 3, 3, 3, 3, 3, 3, 3, 3 }
+  },
+  {
+    { 2, 2, 2, 2, 2, 2, 2, 3 },
+    { 2, 2, 2, 2, 2, 2, 2, 3 },
+    { 2, 2, 2, 2, 2, 2, 2, 3 },
+    { 2, 2, 2, 3, 3, 3, 3, 3 },
+    { 2, 2, 2, 3, 3, 3, 3, 3 },
+    { 2, 2, 2, 3, 3, 3, 3, 3 },
+    { 2, 2, 2, 3, 3, 3, 3, 3 },
+    { 3, 3, 3, 3, 3, 3, 3, 3 }
+  },
+  {
+    { 2, 2, 2, 2, 2, 2, 2, 3 },
+    { 2, 2, 2, 2, 2, 2, 2, 3 },
+    { 2, 2, 2, 2, 2, 2, 2, 3 },
+    { 2, 2, 2, 3, 3, 3, 3, 3 },
+    { 2, 2, 2, 3, 3, 3, 3, 3 },
+    { 2, 2, 2, 3, 3, 3, 3, 3 },
+    { 2, 2, 2, 3, 3, 3, 3, 3 },
+    { 3, 3, 3, 3, 3, 3, 3, 3 }
+  },
+  {
+    { 2, 2, 2, 2, 2, 2, 2, 3 },
+    { 2, 2, 2, 2, 2, 3, 3, 3 },
+    { 2, 2, 2, 2, 2, 3, 3, 3 },
+    { 2, 2, 2, 3, 3, 3, 3, 3 },
+    { 2, 2, 2, 3, 3, 3, 3, 3 },
+    { 2, 3, 3, 3, 3, 3, 3, 3 },
+    { 2, 3, 3, 3, 3, 3, 3, 3 },
+    { 3, 3, 3, 3, 3, 3, 3, 3 }
+  },
+  {
+    { 2, 2, 2, 2, 2, 2, 2, 3 },
+    { 2, 2, 2, 2, 2, 3, 3, 3 },
+    { 2, 2, 2, 2, 2, 3, 3, 3 },
+    { 2, 2, 2, 3, 3, 3, 3, 3 },
+    { 2, 2, 2, 3, 3, 3, 3, 3 },
+    { 2, 3, 3, 3, 3, 3, 3, 3 },
+    { 2, 3, 3, 3, 3, 3, 3, 3 },
+    { 3, 3, 3, 3, 3, 3, 3, 3 }
+  },
+  {
+    { 3, 3, 3, 3, 3, 3, 3, 3 },
+    { 3, 3, 3, 3, 3, 3, 3, 3 },
+    { 3, 3, 3, 3, 3, 3, 3, 3 },
+    { 3, 3, 3, 3, 3, 3, 3, 3 },
+    { 3, 3, 3, 3, 3, 3, 3, 3 },
+    { 3, 3, 3, 3, 3, 3, 3, 3 },
+    { 3, 3, 3, 3, 3, 3, 3, 3 },
+    { 3, 3, 3, 3, 3, 3, 3, 4 }
+  }
+};
+
+static const int8_t p8est_balance_drop_3d_face
+  [P8EST_BAL_LUT_3D][P8EST_BAL_LUT_3D][P8EST_BAL_LUT_3D] =
+{
+  {
+    { 0, 1, 1, 2, 2, 2, 2, 3 },
+    { 1, 2, 2, 2, 2, 3, 3, 3 },
+    { 1, 2, 2, 2, 2, 3, 3, 3 },
+    { 2, 2, 2, 3, 3, 3, 3, 3 },
+    { 2, 2, 2, 3, 3, 3, 3, 3 },
+    { 2, 3, 3, 3, 3, 3, 3, 3 },
+    { 2, 3, 3, 3, 3, 3, 3, 3 },
+    { 3, 3, 3, 3, 3, 3, 3, 4 }
+  },
+  {
+    { 1, 2, 2, 2, 2, 3, 3, 3 },
+    { 2, 3, 3, 3, 3, 3, 3, 3 },
+    { 2, 3, 3, 3, 3, 3, 3, 3 },
+    { 2, 3, 3, 3, 3, 3, 3, 3 },
+    { 2, 3, 3, 3, 3, 3, 3, 3 },
+    { 3, 3, 3, 3, 3, 4, 4, 4 },
+    { 3, 3, 3, 3, 3, 4, 4, 4 },
+    { 3, 3, 3, 3, 3, 4, 4, 4 }
+  },
+  {
+    { 1, 2, 2, 2, 2, 3, 3, 3 },
+    { 2, 3, 3, 3, 3, 3, 3, 3 },
+    { 2, 3, 3, 3, 3, 3, 3, 3 },
+    { 2, 3, 3, 3, 3, 3, 3, 3 },
+    { 2, 3, 3, 3, 3, 3, 3, 3 },
+    { 3, 3, 3, 3, 3, 4, 4, 4 },
+    { 3, 3, 3, 3, 3, 4, 4, 4 },
+    { 3, 3, 3, 3, 3, 4, 4, 4 }
+  },
+  {
+    { 2, 2, 2, 3, 3, 3, 3, 3 },
+    { 2, 3, 3, 3, 3, 3, 3, 3 },
+    { 2, 3, 3, 3, 3, 3, 3, 3 },
+    { 3, 3, 3, 4, 4, 4, 4, 4 },
+    { 3, 3, 3, 4, 4, 4, 4, 4 },
+    { 3, 3, 3, 4, 4, 4, 4, 4 },
+    { 3, 3, 3, 4, 4, 4, 4, 4 },
+    { 3, 3, 3, 4, 4, 4, 4, 4 }
+  },
+  {
+    { 2, 2, 2, 3, 3, 3, 3, 3 },
+    { 2, 3, 3, 3, 3, 3, 3, 3 },
+    { 2, 3, 3, 3, 3, 3, 3, 3 },
+    { 3, 3, 3, 4, 4, 4, 4, 4 },
+    { 3, 3, 3, 4, 4, 4, 4, 4 },
+    { 3, 3, 3, 4, 4, 4, 4, 4 },
+    { 3, 3, 3, 4, 4, 4, 4, 4 },
+    { 3, 3, 3, 4, 4, 4, 4, 4 }
+  },
+  {
+    { 2, 3, 3, 3, 3, 3, 3, 3 },
+    { 3, 3, 3, 3, 3, 4, 4, 4 },
+    { 3, 3, 3, 3, 3, 4, 4, 4 },
+    { 3, 3, 3, 4, 4, 4, 4, 4 },
+    { 3, 3, 3, 4, 4, 4, 4, 4 },
+    { 3, 4, 4, 4, 4, 4, 4, 4 },
+    { 3, 4, 4, 4, 4, 4, 4, 4 },
+    { 3, 4, 4, 4, 4, 4, 4, 4 }
+  },
+  {
+    { 2, 3, 3, 3, 3, 3, 3, 3 },
+    { 3, 3, 3, 3, 3, 4, 4, 4 },
+    { 3, 3, 3, 3, 3, 4, 4, 4 },
+    { 3, 3, 3, 4, 4, 4, 4, 4 },
+    { 3, 3, 3, 4, 4, 4, 4, 4 },
+    { 3, 4, 4, 4, 4, 4, 4, 4 },
+    { 3, 4, 4, 4, 4, 4, 4, 4 },
+    { 3, 4, 4, 4, 4, 4, 4, 4 }
+  },
+  {
+    { 3, 3, 3, 3, 3, 3, 3, 4 },
+    { 3, 3, 3, 3, 3, 4, 4, 4 },
+    { 3, 3, 3, 3, 3, 4, 4, 4 },
+    { 3, 3, 3, 4, 4, 4, 4, 4 },
+    { 3, 3, 3, 4, 4, 4, 4, 4 },
+    { 3, 4, 4, 4, 4, 4, 4, 4 },
+    { 3, 4, 4, 4, 4, 4, 4, 4 },
+    { 4, 4, 4, 4, 4, 4, 4, 5 }
+  }
+};
+#endif /* P4_TO_P8 */
+/* *INDENT-ON* */
+
 /* We have a location, and a \a level quadrant that must be shifted by
  * \a distance (>= 0) to be at the location.  This returns the largest quadrant
  * that can exist at \a location and be in balance with the \a level quadrant.
@@ -45,6 +254,9 @@ p4est_balance_kernel_1d (p4est_qcoord_t distance, int level)
   P4EST_ASSERT (distance >= 0);
   P4EST_ASSERT (!(distance & (~(((p4est_qcoord_t) - 1) << shift))));
   distance >>= shift;
+  if (distance < P4EST_BAL_LUT_1D) {
+    return SC_MAX (0, level - p4est_balance_drop_1d[distance]);
+  }
   /* The theory says we should use ((distance + 1)&(~1) + 1), but
    * using distance + 1 is equivalent for all distance >= 0 */
   distance++;
@@ -68,10 +280,13 @@ p4est_balance_kernel_2d (p4est_qcoord_t dx, p4est_qcoord_t dy, int level)
   P4EST_ASSERT (!(dy & (~(((p4est_qcoord_t) - 1) << shift))));
 
   dx >>= shift;
+  dy >>= shift;
+  if (dx < P4EST_BAL_LUT_2D && dy < P4EST_BAL_LUT_2D) {
+    return SC_MAX (0, level - p4est_balance_drop_2d[dx][dy]);
+  }
+
   /* get the smallest even number greater than or equal to dx */
   dx = (dx + 1) & (~((p4est_qcoord_t) 0x1));
-
-  dy >>= shift;
   /* get the smallest even number greater than or equal to dy */
   dy = (dy + 1) & (~((p4est_qcoord_t) 0x1));
 
@@ -105,14 +320,17 @@ p8est_balance_kernel_3d_edge (p4est_qcoord_t dx, p4est_qcoord_t dy,
   }
 
   dx >>= shift;
+  dy >>= shift;
+  dz >>= shift;
+  if (dx < P8EST_BAL_LUT_3D && dy < P8EST_BAL_LUT_3D &&
+      dz < P8EST_BAL_LUT_3D) {
+    return SC_MAX (0, level - p8est_balance_drop_3d_edge[dx][dy][dz]);
+  }
+
   /* get the smallest even number greater than or equal to dx */
   dx = (dx + 1) & (~((p4est_qcoord_t) 0x1));
-
-  dy >>= shift;
   /* get the smallest even number greater than or equal to dy */
   dy = (dy + 1) & (~((p4est_qcoord_t) 0x1));
-
-  dz >>= shift;
   /* get the smallest even number greater than or equal to dz */
   dz = (dz + 1) & (~((p4est_qcoord_t) 0x1));
 
@@ -158,14 +376,17 @@ p8est_balance_kernel_3d_face (p4est_qcoord_t dx, p4est_qcoord_t dy,
   }
 
   dx >>= shift;
+  dy >>= shift;
+  dz >>= shift;
+  if (dx < P8EST_BAL_LUT_3D && dy < P8EST_BAL_LUT_3D &&
+      dz < P8EST_BAL_LUT_3D) {
+    return SC_MAX (0, level - p8est_balance_drop_3d_face[dx][dy][dz]);
+  }
+
   /* get the smallest even number greater than or equal to dx */
   dx = (dx + 1) & (~((p4est_qcoord_t) 0x1));
-
-  dy >>= shift;
   /* get the smallest even number greater than or equal to dy */
   dy = (dy + 1) & (~((p4est_qcoord_t) 0x1));
-
-  dz >>= shift;
   /* get the smallest even number greater than or equal to dz */
   dz = (dz + 1) & (~((p4est_qcoord_t) 0x1));
 
@@ -871,20 +1092,52 @@ p8est_balance_seeds_edge (p4est_quadrant_t * q,
 }
 #endif
 
+/** Classify one coordinate axis for p4est_balance_seeds.
+ * \param [out] outside  Set to -1, 0, 1 for q below, inside, above p.
+ * \return               False if q lies outside p's insulation layer.
+ */
+static inline int
+p4est_balance_seeds_axis (p4est_qcoord_t qc, p4est_qcoord_t pc,
+                          p4est_qcoord_t qdist, p4est_qcoord_t pdist,
+                          int *outside)
+{
+  p4est_qcoord_t      diff;
+
+  *outside = 0;
+  if (qc < pc) {
+    diff = pc - qc;
+    /* insulation layer comparison */
+    if (diff > pdist) {
+      return 0;
+    }
+    *outside = -1;
+  }
+  else {
+    diff = (qc + qdist) - (pc + pdist);
+    /* insulation layer comparison */
+    if (diff > pdist) {
+      return 0;
+    }
+    if (diff > 0) {
+      *outside = 1;
+    }
+  }
+
+  return 1;
+}
+
 int
 p4est_balance_seeds (p4est_quadrant_t * q, p4est_quadrant_t * p,
                      p4est_connect_type_t balance, sc_array_t * seeds)
 {
   int                 outside[P4EST_DIM];
-  int                 i;
-  int                 type = 0;
-  p4est_qcoord_t      diff;
-  p4est_qcoord_t      qc, pc;
+  int                 type;
   p4est_qcoord_t      pdist = P4EST_QUADRANT_LEN (p->level);
   p4est_qcoord_t      qdist = P4EST_QUADRANT_LEN (q->level);
   p4est_quadrant_t   *s;
   int                 f, c;
 #ifdef P4_TO_P8
+  int                 i;
   int                 e;
 #endif
 
@@ -897,47 +1150,21 @@ p4est_balance_seeds (p4est_quadrant_t * q, p4est_quadrant_t * p,
     return 0;
   }
 
-  for (i = 0; i < P4EST_DIM; i++) {
-    switch (i) {
-    case 0:
-      qc = q->x;
-      pc = p->x;
-      break;
-    case 1:
-      qc = q->y;
-      pc = p->y;
-      break;
+  /* one straight-line classification per axis: the per-axis loop with a
+   * coordinate switch in its body resisted unrolling */
+  if (!p4est_balance_seeds_axis (q->x, p->x, qdist, pdist, &outside[0]) ||
+      !p4est_balance_seeds_axis (q->y, p->y, qdist, pdist, &outside[1])
 #ifdef P4_TO_P8
-    case 2:
-      qc = q->z;
-      pc = p->z;
-      break;
+      || !p4est_balance_seeds_axis (q->z, p->z, qdist, pdist, &outside[2])
 #endif
-    default:
-      SC_ABORT_NOT_REACHED ();
-      break;
-    }
-    outside[i] = 0;
-    if (qc < pc) {
-      diff = pc - qc;
-      /* insulation layer comparison */
-      if (diff > pdist) {
-        return 0;
-      }
-      outside[i] = -1;
-    }
-    else {
-      diff = (qc + qdist) - (pc + pdist);
-      /* insulation layer comparison */
-      if (diff > pdist) {
-        return 0;
-      }
-      if (diff > 0) {
-        outside[i] = 1;
-      }
-    }
-    type += (outside[i] ? 1 : 0);
+    ) {
+    return 0;
   }
+  type = (outside[0] != 0) + (outside[1] != 0)
+#ifdef P4_TO_P8
+    + (outside[2] != 0)
+#endif
+    ;
 
   switch (type) {
   case 0:
@@ -947,19 +1174,27 @@ p4est_balance_seeds (p4est_quadrant_t * q, p4est_quadrant_t * p,
     *s = *q;
     return 1;
   case 1:
-    for (i = 0; i < P4EST_DIM; i++) {
-      if (outside[i]) {
-        f = 2 * i + (outside[i] > 0 ? 1 : 0);
-        return p4est_balance_seeds_face (q, p, f, balance, seeds);
-      }
+    if (outside[0]) {
+      f = (outside[0] > 0 ? 1 : 0);
     }
-    SC_ABORT_NOT_REACHED ();
-    return -1;
-  case P4EST_DIM:
-    c = 0;
-    for (i = 0; i < P4EST_DIM; i++) {
-      c += (outside[i] > 0 ? (1 << i) : 0);
+    else if (outside[1]) {
+      f = 2 + (outside[1] > 0 ? 1 : 0);
     }
+#ifdef P4_TO_P8
+    else if (outside[2]) {
+      f = 4 + (outside[2] > 0 ? 1 : 0);
+    }
+#endif
+    else {
+      SC_ABORT_NOT_REACHED ();
+    }
+    return p4est_balance_seeds_face (q, p, f, balance, seeds);
+  case P4EST_DIM:
+    c = (outside[0] > 0 ? 1 : 0) + (outside[1] > 0 ? 2 : 0)
+#ifdef P4_TO_P8
+      + (outside[2] > 0 ? 4 : 0)
+#endif
+      ;
     return p4est_balance_seeds_corner (q, p, c, balance, seeds);
 #ifdef P4_TO_P8
   case 2:
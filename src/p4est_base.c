@@ -44,6 +44,222 @@ p4est_init (sc_log_handler_t log_handler, int log_threshold)
   P4EST_GLOBAL_PRODUCTIONF ("%-*s %s\n", w, "LIBS", P4EST_LIBS);
 }
 
+/** A named memory high-water mark.  The table below is append-only
+ * between p4est_mempeak_start calls and small enough for linear search.
+ */
+typedef struct p4est_mempeak
+{
+  const char         *phase;
+  size_t              peak;
+}
+p4est_mempeak_t;
+
+#define P4EST_MEMPEAK_MAX 32
+
+static int          p4est_mempeak_recording = 0;
+static int          p4est_mempeak_count = 0;
+static p4est_mempeak_t p4est_mempeaks[P4EST_MEMPEAK_MAX];
+
+void
+p4est_mempeak_start (void)
+{
+  p4est_mempeak_count = 0;
+  p4est_mempeak_recording = 1;
+}
+
+void
+p4est_mempeak_stop (void)
+{
+  p4est_mempeak_recording = 0;
+}
+
+int
+p4est_mempeak_active (void)
+{
+  return p4est_mempeak_recording;
+}
+
+void
+p4est_mempeak_sample (const char *phase, size_t bytes)
+{
+  int                 i;
+
+  if (!p4est_mempeak_recording) {
+    return;
+  }
+  for (i = 0; i < p4est_mempeak_count; ++i) {
+    if (!strcmp (p4est_mempeaks[i].phase, phase)) {
+      p4est_mempeaks[i].peak = SC_MAX (p4est_mempeaks[i].peak, bytes);
+      return;
+    }
+  }
+  if (p4est_mempeak_count == P4EST_MEMPEAK_MAX) {
+    return;
+  }
+  p4est_mempeaks[p4est_mempeak_count].phase = phase;
+  p4est_mempeaks[p4est_mempeak_count].peak = bytes;
+  ++p4est_mempeak_count;
+}
+
+size_t
+p4est_mempeak_get (const char *phase)
+{
+  int                 i;
+
+  for (i = 0; i < p4est_mempeak_count; ++i) {
+    if (!strcmp (p4est_mempeaks[i].phase, phase)) {
+      return p4est_mempeaks[i].peak;
+    }
+  }
+  return 0;
+}
+
+void
+p4est_mempeak_report (void)
+{
+  int                 i;
+
+  for (i = 0; i < p4est_mempeak_count; ++i) {
+    P4EST_STATISTICSF ("Memory peak %s %llu bytes\n",
+                       p4est_mempeaks[i].phase,
+                       (unsigned long long) p4est_mempeaks[i].peak);
+  }
+}
+
+/** One pooled staging buffer.  The table is small enough for linear
+ * search; the ghost and partition exchanges check out at most a few
+ * buffers at a time.
+ */
+typedef struct p4est_staging_slot
+{
+  void               *ptr;
+  size_t              size;
+  int                 checked_out;
+}
+p4est_staging_slot_t;
+
+#define P4EST_STAGING_MAX 32
+
+static p4est_staging_slot_t p4est_staging_slots[P4EST_STAGING_MAX];
+static p4est_staging_alloc_t p4est_staging_alloc_fn = NULL;
+static p4est_staging_free_t p4est_staging_free_fn = NULL;
+static void        *p4est_staging_user = NULL;
+
+static void        *
+p4est_staging_default_alloc (size_t num_bytes, void *user)
+{
+  return sc_malloc (p4est_package_id, num_bytes);
+}
+
+static void
+p4est_staging_default_free (void *ptr, void *user)
+{
+  sc_free (p4est_package_id, ptr);
+}
+
+void
+p4est_staging_set_allocators (p4est_staging_alloc_t alloc_fn,
+                              p4est_staging_free_t free_fn, void *user)
+{
+  p4est_staging_cleanup ();
+  p4est_staging_alloc_fn =
+    alloc_fn != NULL ? alloc_fn : p4est_staging_default_alloc;
+  p4est_staging_free_fn =
+    free_fn != NULL ? free_fn : p4est_staging_default_free;
+  p4est_staging_user = user;
+}
+
+void               *
+p4est_staging_acquire (size_t num_bytes)
+{
+  int                 i;
+  int                 best, empty;
+  p4est_staging_slot_t *slot;
+
+  if (p4est_staging_alloc_fn == NULL) {
+    p4est_staging_set_allocators (NULL, NULL, NULL);
+  }
+
+  /* prefer the smallest pooled buffer that is already big enough */
+  best = empty = -1;
+  for (i = 0; i < P4EST_STAGING_MAX; ++i) {
+    slot = &p4est_staging_slots[i];
+    if (slot->checked_out) {
+      continue;
+    }
+    if (slot->ptr == NULL) {
+      empty = empty == -1 ? i : empty;
+      continue;
+    }
+    if (slot->size >= num_bytes &&
+        (best == -1 || slot->size < p4est_staging_slots[best].size)) {
+      best = i;
+    }
+  }
+  if (best == -1) {
+    /* grow the largest free buffer to the new high-water size */
+    for (i = 0; i < P4EST_STAGING_MAX; ++i) {
+      slot = &p4est_staging_slots[i];
+      if (!slot->checked_out && slot->ptr != NULL &&
+          (best == -1 || slot->size > p4est_staging_slots[best].size)) {
+        best = i;
+      }
+    }
+    if (best == -1) {
+      best = empty;
+    }
+    if (best == -1) {
+      /* every slot is checked out: hand out an untracked buffer */
+      return p4est_staging_alloc_fn (num_bytes, p4est_staging_user);
+    }
+    slot = &p4est_staging_slots[best];
+    if (slot->ptr != NULL) {
+      p4est_staging_free_fn (slot->ptr, p4est_staging_user);
+    }
+    slot->ptr = p4est_staging_alloc_fn (num_bytes, p4est_staging_user);
+    slot->size = num_bytes;
+  }
+  slot = &p4est_staging_slots[best];
+  slot->checked_out = 1;
+
+  return slot->ptr;
+}
+
+void
+p4est_staging_release (void *ptr)
+{
+  int                 i;
+
+  if (ptr == NULL) {
+    return;
+  }
+  for (i = 0; i < P4EST_STAGING_MAX; ++i) {
+    if (p4est_staging_slots[i].ptr == ptr) {
+      P4EST_ASSERT (p4est_staging_slots[i].checked_out);
+      p4est_staging_slots[i].checked_out = 0;
+      return;
+    }
+  }
+  /* an untracked buffer handed out when all slots were checked out */
+  p4est_staging_free_fn (ptr, p4est_staging_user);
+}
+
+void
+p4est_staging_cleanup (void)
+{
+  int                 i;
+
+  for (i = 0; i < P4EST_STAGING_MAX; ++i) {
+    P4EST_ASSERT (!p4est_staging_slots[i].checked_out);
+    if (p4est_staging_slots[i].ptr != NULL) {
+      p4est_staging_free_fn (p4est_staging_slots[i].ptr,
+                             p4est_staging_user);
+      p4est_staging_slots[i].ptr = NULL;
+      p4est_staging_slots[i].size = 0;
+    }
+  }
+}
+
 #ifndef __cplusplus
 #undef P4EST_GLOBAL_LOGF
 #undef P4EST_LOGF
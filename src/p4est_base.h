@@ -65,13 +65,24 @@ typedef int32_t     p4est_topidx_t;     /**< must not be larger than int */
 #define P4EST_TOPIDX_FITS_32 1
 #define P4EST_TOPIDX_1   ((p4est_topidx_t) 1)
 
-/** Typedef for processor-local indexing of quadrants and nodes. */
+/** Typedef for processor-local indexing of quadrants and nodes.
+ * Configuring --enable-locidx64 widens this type to 64 bits for runs
+ * that exceed 2^31 - 1 entities on a single process. */
+#ifdef P4EST_LOCIDX64
+typedef int64_t     p4est_locidx_t;
+#define p4est_locidx_compare sc_int64_compare
+#define P4EST_MPI_LOCIDX MPI_LONG_LONG_INT
+#define P4EST_VTK_LOCIDX "Int64"
+#define P4EST_LOCIDX_MIN INT64_MIN
+#define P4EST_LOCIDX_MAX INT64_MAX
+#else
 typedef int32_t     p4est_locidx_t;
 #define p4est_locidx_compare sc_int32_compare
 #define P4EST_MPI_LOCIDX MPI_INT
 #define P4EST_VTK_LOCIDX "Int32"
 #define P4EST_LOCIDX_MIN INT32_MIN
 #define P4EST_LOCIDX_MAX INT32_MAX
+#endif
 #define P4EST_LOCIDX_1   ((p4est_locidx_t) 1)
 
 /** Typedef for globally unique indexing of quadrants. */
@@ -83,6 +94,44 @@ typedef int64_t     p4est_gloidx_t;
 #define P4EST_GLOIDX_MAX INT64_MAX
 #define P4EST_GLOIDX_1   ((p4est_gloidx_t) 1)
 
+/** Convert a global count into p4est_locidx_t, aborting on overflow.
+ * Use this at API boundaries where a count that is 64 bits by nature
+ * enters processor-local indexing; a plain cast wraps around silently.
+ */
+/*@unused@*/
+static inline p4est_locidx_t
+p4est_locidx_from_gloidx (p4est_gloidx_t gidx)
+{
+  SC_CHECK_ABORT (0 <= gidx && gidx <= (p4est_gloidx_t) P4EST_LOCIDX_MAX,
+                  "p4est_locidx_t overflow");
+
+  return (p4est_locidx_t) gidx;
+}
+
+/** Convert an array or byte count into p4est_locidx_t, aborting on
+ * overflow.  See \ref p4est_locidx_from_gloidx.
+ */
+/*@unused@*/
+static inline p4est_locidx_t
+p4est_locidx_from_size (size_t zz)
+{
+  SC_CHECK_ABORT (zz <= (size_t) P4EST_LOCIDX_MAX,
+                  "p4est_locidx_t overflow");
+
+  return (p4est_locidx_t) zz;
+}
+
+/** Multiply two local counts, aborting if the product does not fit.
+ * The multiplication is carried out in 64 bits regardless of the
+ * configured width of p4est_locidx_t.
+ */
+/*@unused@*/
+static inline p4est_locidx_t
+p4est_locidx_mult (p4est_locidx_t a, p4est_locidx_t b)
+{
+  return p4est_locidx_from_gloidx ((p4est_gloidx_t) a * (p4est_gloidx_t) b);
+}
+
 /* some error checking possibly specific to p4est */
 #ifdef P4EST_DEBUG
 #define P4EST_ASSERT(c) SC_CHECK_ABORT ((c), "Assertion '" #c "'")
@@ -222,6 +271,93 @@ extern int          p4est_package_id;
 void                p4est_init (sc_log_handler_t log_handler,
                                 int log_threshold);
 
+/** Start recording per-phase memory high-water marks.
+ * While recording is active, instrumented code paths report the bytes
+ * that are live at their point of maximal coexistence, for example when
+ * the communication buffers of a balance or partition overlap with the
+ * quadrant arrays.  Recording is off by default and per-process; the
+ * marks are not communicated.  Starting resets all previous marks.
+ */
+void                p4est_mempeak_start (void);
+
+/** Stop recording memory high-water marks.
+ * The marks collected so far remain queryable.
+ */
+void                p4est_mempeak_stop (void);
+
+/** Query whether memory high-water mark recording is active.
+ * Instrumented code paths use this to skip the byte accounting entirely
+ * when nothing is recorded.
+ * \return          True if recording is active.
+ */
+int                 p4est_mempeak_active (void);
+
+/** Report a number of live bytes against a named phase.
+ * The phase's high-water mark is raised to \a bytes if it is larger.
+ * This is a no-op unless recording is active.
+ * \param [in] phase  Static string naming the phase; compared by content.
+ * \param [in] bytes  Bytes live at the calling point.
+ */
+void                p4est_mempeak_sample (const char *phase, size_t bytes);
+
+/** Retrieve the high-water mark recorded for a phase.
+ * \param [in] phase  Phase name as passed to p4est_mempeak_sample.
+ * \return            The largest sampled byte count, or 0 if the phase
+ *                    has not been sampled.
+ */
+size_t              p4est_mempeak_get (const char *phase);
+
+/** Log the high-water marks of all sampled phases.
+ * One line per phase is printed at statistics priority.
+ */
+void                p4est_mempeak_report (void);
+
+/** Allocate one staging buffer of \a num_bytes bytes.
+ * \see p4est_staging_set_allocators.
+ */
+typedef void       *(*p4est_staging_alloc_t) (size_t num_bytes, void *user);
+
+/** Free a staging buffer obtained from a p4est_staging_alloc_t. */
+typedef void        (*p4est_staging_free_t) (void *ptr, void *user);
+
+/** Install the allocators backing the staging buffer pool.
+ * The pool hands out persistent buffers for the transient MPI payloads
+ * of the ghost and partition exchanges, so the same memory is reused
+ * call after call and the MPI library's registration cache stays warm.
+ * Installing cudaHostAlloc/cudaFreeHost or the HIP equivalents here
+ * makes the buffers pinned without the library depending on a device
+ * runtime; by default the sc allocators are used.  Must be called
+ * before the first exchange and drops all currently pooled buffers.
+ * \param [in] alloc_fn  Buffer allocator, or NULL for the default.
+ * \param [in] free_fn   Matching deallocator, or NULL for the default.
+ * \param [in] user      Passed to both callbacks unchanged.
+ */
+void                p4est_staging_set_allocators (p4est_staging_alloc_t
+                                                  alloc_fn,
+                                                  p4est_staging_free_t
+                                                  free_fn, void *user);
+
+/** Check out a staging buffer of at least \a num_bytes bytes.
+ * The buffers are pooled: a released buffer is handed out again and is
+ * only ever grown, so after a few calls the pool settles at the
+ * high-water sizes of the exchanges and no allocation happens at all.
+ * \param [in] num_bytes    Required capacity in bytes; may be 0.
+ * \return                  A buffer to return via p4est_staging_release.
+ */
+void               *p4est_staging_acquire (size_t num_bytes);
+
+/** Return a buffer obtained from p4est_staging_acquire to the pool.
+ * \param [in] ptr      May be NULL, in which case nothing happens.
+ */
+void                p4est_staging_release (void *ptr);
+
+/** Free all pooled staging buffers.
+ * No buffer may be checked out when this is called.  Optional; useful
+ * before MPI_Finalize or to release pinned memory to the device
+ * runtime.
+ */
+void                p4est_staging_cleanup (void);
+
 /** Compute hash value for two p4est_topidx_t integers.
  * \param [in] tt     Array of (at least) two values.
  * \return            An unsigned hash value.
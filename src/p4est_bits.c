@@ -27,6 +27,10 @@
 #include <p4est_bits.h>
 #endif /* !P4_TO_P8 */
 
+#if defined (__AVX2__) || defined (__BMI2__)
+#include <immintrin.h>
+#endif
+
 void
 p4est_quadrant_print (int log_priority, const p4est_quadrant_t * q)
 {
@@ -837,13 +841,57 @@ p4est_quadrant_face_neighbor (const p4est_quadrant_t * q,
   P4EST_ASSERT (p4est_quadrant_is_extended (r));
 }
 
+void
+p4est_quadrant_face_neighbors_batch (const p4est_quadrant_t qs[],
+                                     size_t num_quadrants, int face,
+                                     p4est_qcoord_t nx[], p4est_qcoord_t ny[],
+#ifdef P4_TO_P8
+                                     p4est_qcoord_t nz[],
+#endif
+                                     int8_t nlevel[], int8_t outside[])
+{
+  const p4est_qcoord_t dx = (face == 0) ? -1 : (face == 1) ? 1 : 0;
+  const p4est_qcoord_t dy = (face == 2) ? -1 : (face == 3) ? 1 : 0;
+#ifdef P4_TO_P8
+  const p4est_qcoord_t dz = (face == 4) ? -1 : (face == 5) ? 1 : 0;
+#endif
+  size_t              zz;
+  p4est_qcoord_t      qh;
+
+  P4EST_ASSERT (0 <= face && face < P4EST_FACES);
+
+  for (zz = 0; zz < num_quadrants; ++zz) {
+    P4EST_ASSERT (p4est_quadrant_is_valid (&qs[zz]));
+    qh = P4EST_QUADRANT_LEN (qs[zz].level);
+    nx[zz] = qs[zz].x + dx * qh;
+    ny[zz] = qs[zz].y + dy * qh;
+#ifdef P4_TO_P8
+    nz[zz] = qs[zz].z + dz * qh;
+#endif
+    nlevel[zz] = qs[zz].level;
+  }
+
+  if (outside != NULL) {
+    /* Only the coordinate normal to the face can leave the unit tree,
+     * so one comparison replaces the full inside_root test. */
+    const p4est_qcoord_t *nc =
+#ifdef P4_TO_P8
+      (face / 2 == 2) ? nz :
+#endif
+      (face / 2 == 1) ? ny : nx;
+
+    for (zz = 0; zz < num_quadrants; ++zz) {
+      outside[zz] = (int8_t) (nc[zz] < 0 || nc[zz] >= P4EST_ROOT_LEN);
+    }
+  }
+}
+
 p4est_locidx_t
 p4est_quadrant_face_neighbor_extra (const p4est_quadrant_t * q, p4est_locidx_t
                                     t, int face, p4est_quadrant_t * r,
                                     p4est_connectivity_t * conn)
 {
   p4est_quadrant_t    temp;
-  int                 transform[9];
   p4est_topidx_t      flag;
 
   p4est_quadrant_face_neighbor (q, face, r);
@@ -852,14 +900,13 @@ p4est_quadrant_face_neighbor_extra (const p4est_quadrant_t * q, p4est_locidx_t
   }
 
   temp = *r;
-  flag = p4est_find_face_transform (conn, t, face, transform);
+  flag = p4est_quadrant_transform_face_fast (conn, t, face, &temp, r);
   if (flag == -1) {
     if (r != q) {
       *r = *q;
     }
     return -1;
   }
-  p4est_quadrant_transform_face (&temp, r, transform);
 
   return flag;
 }
@@ -985,6 +1032,49 @@ p4est_quadrant_corner_neighbor (const p4est_quadrant_t * q,
   P4EST_ASSERT (p4est_quadrant_is_extended (r));
 }
 
+void
+p4est_quadrant_corner_neighbors_batch (const p4est_quadrant_t qs[],
+                                       size_t num_quadrants, int corner,
+                                       p4est_qcoord_t nx[],
+                                       p4est_qcoord_t ny[],
+#ifdef P4_TO_P8
+                                       p4est_qcoord_t nz[],
+#endif
+                                       int8_t nlevel[], int8_t outside[])
+{
+  const p4est_qcoord_t dx = 2 * (corner & 0x01) - 1;
+  const p4est_qcoord_t dy = (corner & 0x02) - 1;
+#ifdef P4_TO_P8
+  const p4est_qcoord_t dz = (corner & 0x04) / 2 - 1;
+#endif
+  size_t              zz;
+  p4est_qcoord_t      qh;
+
+  P4EST_ASSERT (0 <= corner && corner < P4EST_CHILDREN);
+
+  for (zz = 0; zz < num_quadrants; ++zz) {
+    P4EST_ASSERT (p4est_quadrant_is_valid (&qs[zz]));
+    qh = P4EST_QUADRANT_LEN (qs[zz].level);
+    nx[zz] = qs[zz].x + dx * qh;
+    ny[zz] = qs[zz].y + dy * qh;
+#ifdef P4_TO_P8
+    nz[zz] = qs[zz].z + dz * qh;
+#endif
+    nlevel[zz] = qs[zz].level;
+  }
+
+  if (outside != NULL) {
+    for (zz = 0; zz < num_quadrants; ++zz) {
+      outside[zz] = (int8_t)
+        (nx[zz] < 0 || nx[zz] >= P4EST_ROOT_LEN ||
+#ifdef P4_TO_P8
+         nz[zz] < 0 || nz[zz] >= P4EST_ROOT_LEN ||
+#endif
+         ny[zz] < 0 || ny[zz] >= P4EST_ROOT_LEN);
+    }
+  }
+}
+
 void
 p4est_quadrant_corner_neighbor_extra (const p4est_quadrant_t * q,
                                       p4est_locidx_t t, int corner,
@@ -1457,6 +1547,241 @@ p4est_quadrant_transform_face (const p4est_quadrant_t * q,
 #endif
 }
 
+/** Precompiled inter-tree face transform.  For each target coordinate d
+ * the transformed value is sign[d] * q[src[d]] + broot[d] * P4EST_ROOT_LEN
+ * + bh[d] * h, where h is the quadrant length (0 for a node).
+ */
+typedef struct p4est_face_rule
+{
+  int8_t              src[P4EST_DIM];
+  int8_t              sign[P4EST_DIM];
+  int8_t              broot[P4EST_DIM];
+  int8_t              bh[P4EST_DIM];
+}
+p4est_face_rule_t;
+
+static int          p4est_face_rules_built = 0;
+static p4est_face_rule_t p4est_face_rules[P4EST_FACES][P4EST_FACES]
+  [P4EST_HALF];
+
+/** Fill the dense (face, target face, orientation) transform table by
+ * replicating the axis and reversal logic of p4est_find_face_transform
+ * and folding it with the coordinate cases of
+ * p4est_quadrant_transform_face.
+ */
+static void
+p4est_face_rules_build (void)
+{
+  int                 iface, tface, o, i, d;
+  int                 ft[9];
+#ifdef P4_TO_P8
+  int                 reverse;
+#endif
+  p4est_face_rule_t  *rule;
+
+  for (iface = 0; iface < P4EST_FACES; ++iface) {
+    for (tface = 0; tface < P4EST_FACES; ++tface) {
+      for (o = 0; o < P4EST_HALF; ++o) {
+#ifdef P4_TO_P8
+        ft[0] = iface < 2 ? 1 : 0;
+        ft[1] = iface < 4 ? 2 : 1;
+        ft[2] = iface / 2;
+        reverse =
+          p8est_face_permutation_refs[0][iface] ^
+          p8est_face_permutation_refs[0][tface] ^ (o == 0 || o == 3);
+        ft[3 + reverse] = tface < 2 ? 1 : 0;
+        ft[3 + !reverse] = tface < 4 ? 2 : 1;
+        ft[5] = tface / 2;
+        reverse = (p8est_face_permutation_refs[iface][tface] == 1);
+        ft[6 + reverse] = (o & 1);
+        ft[6 + !reverse] = (o >> 1);
+        ft[8] = 2 * (iface & 1) + (tface & 1);
+#else
+        ft[2] = iface / 2;
+        ft[1] = 0;
+        ft[0] = 1 - ft[2];
+        ft[5] = tface / 2;
+        ft[4] = 0;
+        ft[3] = 1 - ft[5];
+        ft[6] = o;
+        ft[7] = 0;
+        ft[8] = 2 * (iface & 1) + (tface & 1);
+#endif
+        rule = &p4est_face_rules[iface][tface][o];
+
+        /* tangential directions with optional reversal */
+        for (i = 0; i < P4EST_DIM - 1; ++i) {
+          d = ft[3 + i];
+          rule->src[d] = (int8_t) ft[i];
+          if (!ft[6 + i]) {
+            rule->sign[d] = 1;
+            rule->broot[d] = 0;
+            rule->bh[d] = 0;
+          }
+          else {
+            rule->sign[d] = -1;
+            rule->broot[d] = 1;
+            rule->bh[d] = -1;
+          }
+        }
+
+        /* normal direction according to the face code */
+        d = ft[5];
+        rule->src[d] = (int8_t) ft[2];
+        switch (ft[8]) {
+        case 0:
+          rule->sign[d] = -1;
+          rule->broot[d] = 0;
+          rule->bh[d] = -1;
+          break;
+        case 1:
+          rule->sign[d] = 1;
+          rule->broot[d] = 1;
+          rule->bh[d] = 0;
+          break;
+        case 2:
+          rule->sign[d] = 1;
+          rule->broot[d] = -1;
+          rule->bh[d] = 0;
+          break;
+        case 3:
+          rule->sign[d] = -1;
+          rule->broot[d] = 2;
+          rule->bh[d] = -1;
+          break;
+        default:
+          SC_ABORT_NOT_REACHED ();
+        }
+      }
+    }
+  }
+}
+
+p4est_topidx_t
+p4est_quadrant_transform_face_fast (p4est_connectivity_t * conn,
+                                    p4est_topidx_t itree, int iface,
+                                    const p4est_quadrant_t * q,
+                                    p4est_quadrant_t * r)
+{
+  int                 target_code, target_face, orientation;
+  p4est_topidx_t      target_tree;
+  const p4est_face_rule_t *rule;
+  p4est_qcoord_t      h;
+  p4est_qcoord_t      qxyz[P4EST_DIM];
+
+  P4EST_ASSERT (itree >= 0 && itree < conn->num_trees);
+  P4EST_ASSERT (iface >= 0 && iface < P4EST_FACES);
+  P4EST_ASSERT (q != r);
+
+  if (conn->brick != NULL) {
+    target_tree = p4est_brick_face_neighbor (conn, itree, iface,
+                                             &target_face);
+    if (target_tree == -1) {
+      return -1;
+    }
+    orientation = 0;
+  }
+  else {
+    target_tree = conn->tree_to_tree[P4EST_FACES * itree + iface];
+    target_code = (int) conn->tree_to_face[P4EST_FACES * itree + iface];
+    target_face = target_code % P4EST_FACES;
+    orientation = target_code / P4EST_FACES;
+
+    P4EST_ASSERT (0 <= target_face && target_face < P4EST_FACES);
+    P4EST_ASSERT (0 <= orientation && orientation < P4EST_HALF);
+
+    if (target_tree == itree && target_face == iface) {
+      P4EST_ASSERT (orientation == 0);
+      return -1;
+    }
+  }
+
+  if (target_tree == itree && target_face == (iface ^ 1) &&
+      orientation == 0) {
+    /* a face joined periodically to its opposite face of the same tree
+     * is a pure translation: shift the normal coordinate by one root
+     * length instead of consulting the transform rules */
+    *r = *q;
+    switch (iface / 2) {
+    case 0:
+      r->x += (iface & 1) ? -P4EST_ROOT_LEN : P4EST_ROOT_LEN;
+      break;
+    case 1:
+      r->y += (iface & 1) ? -P4EST_ROOT_LEN : P4EST_ROOT_LEN;
+      break;
+#ifdef P4_TO_P8
+    case 2:
+      r->z += (iface & 1) ? -P4EST_ROOT_LEN : P4EST_ROOT_LEN;
+      break;
+#endif
+    default:
+      SC_ABORT_NOT_REACHED ();
+    }
+#ifdef P4EST_DEBUG
+    {
+      /* cross-check against the general two-step transform */
+      int                 ftransform[9];
+      p4est_quadrant_t    s;
+      p4est_topidx_t      tt;
+
+      tt = p4est_find_face_transform (conn, itree, iface, ftransform);
+      P4EST_ASSERT (tt == target_tree);
+      p4est_quadrant_transform_face (q, &s, ftransform);
+      P4EST_ASSERT (s.x == r->x && s.y == r->y && s.level == r->level);
+#ifdef P4_TO_P8
+      P4EST_ASSERT (s.z == r->z);
+#endif
+    }
+#endif
+    return target_tree;
+  }
+
+  if (!p4est_face_rules_built) {
+    p4est_face_rules_build ();
+    p4est_face_rules_built = 1;
+  }
+  rule = &p4est_face_rules[iface][target_face][orientation];
+
+  h = (q->level == P4EST_MAXLEVEL) ? 0 : P4EST_QUADRANT_LEN (q->level);
+  qxyz[0] = q->x;
+  qxyz[1] = q->y;
+#ifdef P4_TO_P8
+  qxyz[2] = q->z;
+#endif
+
+  r->x = (p4est_qcoord_t) rule->sign[0] * qxyz[rule->src[0]] +
+    (p4est_qcoord_t) rule->broot[0] * P4EST_ROOT_LEN +
+    (p4est_qcoord_t) rule->bh[0] * h;
+  r->y = (p4est_qcoord_t) rule->sign[1] * qxyz[rule->src[1]] +
+    (p4est_qcoord_t) rule->broot[1] * P4EST_ROOT_LEN +
+    (p4est_qcoord_t) rule->bh[1] * h;
+#ifdef P4_TO_P8
+  r->z = (p4est_qcoord_t) rule->sign[2] * qxyz[rule->src[2]] +
+    (p4est_qcoord_t) rule->broot[2] * P4EST_ROOT_LEN +
+    (p4est_qcoord_t) rule->bh[2] * h;
+#endif
+  r->level = q->level;
+
+#ifdef P4EST_DEBUG
+  {
+    /* cross-check against the general two-step transform */
+    int                 ftransform[9];
+    p4est_quadrant_t    s;
+    p4est_topidx_t      tt;
+
+    tt = p4est_find_face_transform (conn, itree, iface, ftransform);
+    P4EST_ASSERT (tt == target_tree);
+    p4est_quadrant_transform_face (q, &s, ftransform);
+    P4EST_ASSERT (s.x == r->x && s.y == r->y && s.level == r->level);
+#ifdef P4_TO_P8
+    P4EST_ASSERT (s.z == r->z);
+#endif
+  }
+#endif
+
+  return target_tree;
+}
+
 int
 p4est_quadrant_touches_corner (const p4est_quadrant_t * q,
                                int corner, int inside)
@@ -1691,3 +2016,363 @@ p4est_quadrant_set_morton (p4est_quadrant_t * quadrant,
 
   P4EST_ASSERT (p4est_quadrant_is_extended (quadrant));
 }
+
+uint64_t
+p4est_quadrant_morton_key (const p4est_quadrant_t * q)
+{
+  uint64_t            id;
+#ifndef __BMI2__
+  int                 i;
+#endif
+  uint64_t            x, y;
+#ifdef P4_TO_P8
+  uint64_t            z;
+#endif
+
+  P4EST_ASSERT (p4est_quadrant_is_node (q, 1) || p4est_quadrant_is_valid (q));
+
+  /* valid quadrants and inside nodes have non-negative coordinates */
+  x = (uint64_t) q->x >> (P4EST_MAXLEVEL - P4EST_QMAXLEVEL);
+  y = (uint64_t) q->y >> (P4EST_MAXLEVEL - P4EST_QMAXLEVEL);
+#ifdef P4_TO_P8
+  z = (uint64_t) q->z >> (P4EST_MAXLEVEL - P4EST_QMAXLEVEL);
+#endif
+
+#ifdef __BMI2__
+#ifndef P4_TO_P8
+  id = _pdep_u64 (x, 0x5555555555555555ULL)
+    | _pdep_u64 (y, 0xAAAAAAAAAAAAAAAAULL);
+#else
+  id = _pdep_u64 (x, 0x1249249249249249ULL)
+    | _pdep_u64 (y, 0x2492492492492492ULL)
+    | _pdep_u64 (z, 0x4924924924924924ULL);
+#endif
+#else
+  id = 0;
+  for (i = 0; i < P4EST_QMAXLEVEL; ++i) {
+    id |= ((x & ((uint64_t) 1 << i)) << ((P4EST_DIM - 1) * i));
+    id |= ((y & ((uint64_t) 1 << i)) << ((P4EST_DIM - 1) * i + 1));
+#ifdef P4_TO_P8
+    id |= ((z & ((uint64_t) 1 << i)) << ((P4EST_DIM - 1) * i + 2));
+#endif
+  }
+#endif
+
+  return (id << 6) | (uint64_t) q->level;
+}
+
+uint64_t *
+p4est_quadrant_array_morton_keys (sc_array_t * quadrants)
+{
+  const size_t        count = quadrants->elem_count;
+  size_t              zz;
+  uint64_t           *keys;
+
+  P4EST_ASSERT (quadrants->elem_size == sizeof (p4est_quadrant_t));
+
+  keys = P4EST_ALLOC (uint64_t, count);
+  for (zz = 0; zz < count; ++zz) {
+    keys[zz] =
+      p4est_quadrant_morton_key (p4est_quadrant_array_index (quadrants, zz));
+  }
+
+  return keys;
+}
+
+int
+p4est_morton_key_is_ancestor (uint64_t akey, uint64_t rkey)
+{
+  const int           alevel = (int) (akey & 0x3F);
+  const int           rlevel = (int) (rkey & 0x3F);
+
+  P4EST_ASSERT (alevel <= P4EST_QMAXLEVEL && rlevel <= P4EST_MAXLEVEL);
+
+  /* the root case is answered by the levels alone: its shift amount
+   * would be the full key width in 2D, which is undefined behavior */
+  return alevel < rlevel &&
+    (alevel == 0 ||
+     ((akey ^ rkey) >> (P4EST_DIM * (P4EST_QMAXLEVEL - alevel) + 6)) == 0);
+}
+
+size_t
+p4est_morton_key_lower_bound (const uint64_t * keys, size_t count,
+                              uint64_t key)
+{
+  size_t              lo = 0;
+  size_t              half, i, n;
+
+  /* each step halves the window without leaving the pipeline */
+  while (count > 8) {
+    half = count >> 1;
+    lo += (keys[lo + half - 1] < key) ? half : 0;
+    count -= half;
+  }
+
+#ifdef __AVX2__
+  if (count == 8) {
+    const __m256i       bias = _mm256_set1_epi64x ((long long) (1ULL << 63));
+    __m256i             vkey, v, lt;
+    int                 m;
+
+    /* flip the top bit so that signed compares give unsigned order */
+    vkey = _mm256_xor_si256 (_mm256_set1_epi64x ((long long) key), bias);
+    v = _mm256_xor_si256 (_mm256_loadu_si256 ((const __m256i *)
+                                              (keys + lo)), bias);
+    lt = _mm256_cmpgt_epi64 (vkey, v);
+    m = _mm256_movemask_epi8 (lt);
+    v = _mm256_xor_si256 (_mm256_loadu_si256 ((const __m256i *)
+                                              (keys + lo + 4)), bias);
+    lt = _mm256_cmpgt_epi64 (vkey, v);
+    n = (size_t) (__builtin_popcount ((unsigned) m) +
+                  __builtin_popcount ((unsigned)
+                                      _mm256_movemask_epi8 (lt))) / 8;
+    return lo + n;
+  }
+#endif
+
+  /* count the remaining keys below the search key */
+  n = 0;
+  for (i = 0; i < count; ++i) {
+    n += (keys[lo + i] < key) ? 1 : 0;
+  }
+
+  return lo + n;
+}
+
+/* read the inclusive atom range of one interval of a set */
+static void
+p4est_interval_bounds (sc_array_t * set, size_t zz, uint64_t * lo,
+                       uint64_t * hi)
+{
+  p4est_interval_t   *iv = (p4est_interval_t *) sc_array_index (set, zz);
+
+  *lo = p4est_quadrant_linear_id (&iv->first, P4EST_QMAXLEVEL);
+  *hi = p4est_quadrant_linear_id (&iv->last, P4EST_QMAXLEVEL);
+  P4EST_ASSERT (*lo <= *hi);
+}
+
+/* append one interval given by its inclusive atom range */
+static void
+p4est_interval_push (sc_array_t * result, uint64_t lo, uint64_t hi)
+{
+  p4est_interval_t   *iv = (p4est_interval_t *) sc_array_push (result);
+
+  P4EST_ASSERT (lo <= hi);
+  p4est_quadrant_set_morton (&iv->first, P4EST_QMAXLEVEL, lo);
+  p4est_quadrant_set_morton (&iv->last, P4EST_QMAXLEVEL, hi);
+}
+
+void
+p4est_interval_from_quadrant (const p4est_quadrant_t * q,
+                              p4est_interval_t * iv)
+{
+  P4EST_ASSERT (p4est_quadrant_is_extended (q));
+
+  p4est_quadrant_first_descendant (q, &iv->first, P4EST_QMAXLEVEL);
+  p4est_quadrant_last_descendant (q, &iv->last, P4EST_QMAXLEVEL);
+}
+
+int
+p4est_interval_set_is_valid (sc_array_t * set)
+{
+  size_t              zz;
+  uint64_t            lo, hi, phi;
+  p4est_interval_t   *iv;
+
+  if (set->elem_size != sizeof (p4est_interval_t)) {
+    return 0;
+  }
+  phi = 0;
+  for (zz = 0; zz < set->elem_count; zz++) {
+    iv = (p4est_interval_t *) sc_array_index (set, zz);
+    if ((int) iv->first.level != P4EST_QMAXLEVEL ||
+        (int) iv->last.level != P4EST_QMAXLEVEL ||
+        !p4est_quadrant_is_valid (&iv->first) ||
+        !p4est_quadrant_is_valid (&iv->last)) {
+      return 0;
+    }
+    lo = p4est_quadrant_linear_id (&iv->first, P4EST_QMAXLEVEL);
+    hi = p4est_quadrant_linear_id (&iv->last, P4EST_QMAXLEVEL);
+    if (lo > hi || (zz > 0 && lo <= phi + 1)) {
+      return 0;
+    }
+    phi = hi;
+  }
+  return 1;
+}
+
+void
+p4est_interval_set_union (sc_array_t * a, sc_array_t * b,
+                          sc_array_t * result)
+{
+  int                 have;
+  size_t              ia, ib;
+  uint64_t            alo, ahi, blo, bhi;
+  uint64_t            lo, hi, clo, chi;
+
+  P4EST_ASSERT (p4est_interval_set_is_valid (a));
+  P4EST_ASSERT (p4est_interval_set_is_valid (b));
+  P4EST_ASSERT (result != a && result != b);
+
+  sc_array_resize (result, 0);
+  ia = ib = 0;
+  have = 0;
+  clo = chi = 0;
+  while (ia < a->elem_count || ib < b->elem_count) {
+    /* take the interval with the smaller begin from either input */
+    alo = blo = ahi = bhi = 0;
+    if (ia < a->elem_count) {
+      p4est_interval_bounds (a, ia, &alo, &ahi);
+    }
+    if (ib < b->elem_count) {
+      p4est_interval_bounds (b, ib, &blo, &bhi);
+    }
+    if (ib == b->elem_count || (ia < a->elem_count && alo <= blo)) {
+      lo = alo;
+      hi = ahi;
+      ++ia;
+    }
+    else {
+      lo = blo;
+      hi = bhi;
+      ++ib;
+    }
+
+    /* extend the open output interval or flush it on a gap */
+    if (!have) {
+      clo = lo;
+      chi = hi;
+      have = 1;
+    }
+    else if (lo <= chi + 1) {
+      chi = SC_MAX (chi, hi);
+    }
+    else {
+      p4est_interval_push (result, clo, chi);
+      clo = lo;
+      chi = hi;
+    }
+  }
+  if (have) {
+    p4est_interval_push (result, clo, chi);
+  }
+  P4EST_ASSERT (p4est_interval_set_is_valid (result));
+}
+
+void
+p4est_interval_set_intersection (sc_array_t * a, sc_array_t * b,
+                                 sc_array_t * result)
+{
+  size_t              ia, ib;
+  uint64_t            alo, ahi, blo, bhi;
+  uint64_t            lo, hi;
+
+  P4EST_ASSERT (p4est_interval_set_is_valid (a));
+  P4EST_ASSERT (p4est_interval_set_is_valid (b));
+  P4EST_ASSERT (result != a && result != b);
+
+  sc_array_resize (result, 0);
+  ia = ib = 0;
+  while (ia < a->elem_count && ib < b->elem_count) {
+    p4est_interval_bounds (a, ia, &alo, &ahi);
+    p4est_interval_bounds (b, ib, &blo, &bhi);
+    lo = SC_MAX (alo, blo);
+    hi = SC_MIN (ahi, bhi);
+    if (lo <= hi) {
+      p4est_interval_push (result, lo, hi);
+    }
+    /* advance the input ending first; the other may overlap its next */
+    if (ahi < bhi) {
+      ++ia;
+    }
+    else {
+      ++ib;
+    }
+  }
+  P4EST_ASSERT (p4est_interval_set_is_valid (result));
+}
+
+void
+p4est_interval_set_difference (sc_array_t * a, sc_array_t * b,
+                               sc_array_t * result)
+{
+  int                 done;
+  size_t              ia, ib;
+  uint64_t            alo, ahi, blo, bhi;
+  uint64_t            cur;
+
+  P4EST_ASSERT (p4est_interval_set_is_valid (a));
+  P4EST_ASSERT (p4est_interval_set_is_valid (b));
+  P4EST_ASSERT (result != a && result != b);
+
+  sc_array_resize (result, 0);
+  ib = 0;
+  for (ia = 0; ia < a->elem_count; ++ia) {
+    p4est_interval_bounds (a, ia, &alo, &ahi);
+    cur = alo;
+    done = 0;
+    while (!done && ib < b->elem_count) {
+      p4est_interval_bounds (b, ib, &blo, &bhi);
+      if (bhi < cur) {
+        /* this subtrahend lies entirely before the remaining piece */
+        ++ib;
+        continue;
+      }
+      if (blo > ahi) {
+        break;
+      }
+      if (blo > cur) {
+        p4est_interval_push (result, cur, blo - 1);
+      }
+      if (bhi >= ahi) {
+        /* nothing of this interval remains; the subtrahend may still
+         * clip the next one, so it is not consumed */
+        done = 1;
+      }
+      else {
+        cur = bhi + 1;
+        ++ib;
+      }
+    }
+    if (!done && cur <= ahi) {
+      p4est_interval_push (result, cur, ahi);
+    }
+  }
+  P4EST_ASSERT (p4est_interval_set_is_valid (result));
+}
+
+int
+p4est_interval_set_contains (sc_array_t * set, const p4est_quadrant_t * q)
+{
+  size_t              zlo, zhi, mid;
+  uint64_t            qlo, qhi, ilo, ihi;
+  p4est_quadrant_t    fd, ld;
+
+  P4EST_ASSERT (p4est_interval_set_is_valid (set));
+  P4EST_ASSERT (p4est_quadrant_is_extended (q));
+
+  p4est_quadrant_first_descendant (q, &fd, P4EST_QMAXLEVEL);
+  p4est_quadrant_last_descendant (q, &ld, P4EST_QMAXLEVEL);
+  qlo = p4est_quadrant_linear_id (&fd, P4EST_QMAXLEVEL);
+  qhi = p4est_quadrant_linear_id (&ld, P4EST_QMAXLEVEL);
+
+  /* find the last interval beginning at or before the quadrant */
+  zlo = 0;
+  zhi = set->elem_count;
+  while (zlo < zhi) {
+    mid = (zlo + zhi) / 2;
+    p4est_interval_bounds (set, mid, &ilo, &ihi);
+    if (ilo <= qlo) {
+      zlo = mid + 1;
+    }
+    else {
+      zhi = mid;
+    }
+  }
+  if (zlo == 0) {
+    return 0;
+  }
+  p4est_interval_bounds (set, zlo - 1, &ilo, &ihi);
+
+  return qhi <= ihi;
+}
@@ -323,6 +323,35 @@ void                p4est_quadrant_face_neighbor (const p4est_quadrant_t * q,
                                                   int face,
                                                   p4est_quadrant_t * r);
 
+/** Compute the same-size face neighbors of an array of quadrants.
+ *
+ * The face direction is fixed for the whole batch, so the per-face
+ * coordinate offsets are hoisted out of the loop and the coordinate
+ * arithmetic is free of branches.  Since quadrants crossing a tree face
+ * leave the root only in the coordinate normal to \a face, the boundary
+ * test reduces to one comparison per neighbor.
+ *
+ * \param [in]  qs     Array of \a num_quadrants valid input quadrants.
+ * \param [in]  num_quadrants  Number of quadrants in \a qs.
+ * \param [in]  face   The face across which to generate the neighbors.
+ * \param [out] nx     Preallocated array filled with the neighbor
+ *                     x coordinates, at least \a num_quadrants entries.
+ * \param [out] ny     Same for the neighbor y coordinates.
+ * \param [out] nlevel Same for the neighbor levels.
+ * \param [out] outside If not NULL, the entry for each neighbor is set
+ *                     to nonzero if it lies outside of the unit tree.
+ */
+void                p4est_quadrant_face_neighbors_batch (const
+                                                         p4est_quadrant_t
+                                                         qs[],
+                                                         size_t
+                                                         num_quadrants,
+                                                         int face,
+                                                         p4est_qcoord_t nx[],
+                                                         p4est_qcoord_t ny[],
+                                                         int8_t nlevel[],
+                                                         int8_t outside[]);
+
 /** Compute the face neighbor of a quadrant, transforming across tree
  * boundaries if necessary.
  * \param [in]     q      Input quadrant, must be valid.
@@ -392,6 +421,35 @@ void                p4est_quadrant_corner_neighbor (const p4est_quadrant_t *
                                                     q, int corner,
                                                     p4est_quadrant_t * r);
 
+/** Compute the same-size corner neighbors of an array of quadrants.
+ *
+ * Batch version of p4est_quadrant_corner_neighbor analogous to
+ * \ref p4est_quadrant_face_neighbors_batch: the corner offsets are
+ * hoisted out of the loop and the output is written in SoA form.
+ *
+ * \param [in]  qs     Array of \a num_quadrants valid input quadrants.
+ * \param [in]  num_quadrants  Number of quadrants in \a qs.
+ * \param [in]  corner The corner across which to generate the neighbors.
+ * \param [out] nx     Preallocated array filled with the neighbor
+ *                     x coordinates, at least \a num_quadrants entries.
+ * \param [out] ny     Same for the neighbor y coordinates.
+ * \param [out] nlevel Same for the neighbor levels.
+ * \param [out] outside If not NULL, the entry for each neighbor is set
+ *                     to nonzero if it lies outside of the unit tree.
+ */
+void                p4est_quadrant_corner_neighbors_batch (const
+                                                           p4est_quadrant_t
+                                                           qs[],
+                                                           size_t
+                                                           num_quadrants,
+                                                           int corner,
+                                                           p4est_qcoord_t
+                                                           nx[],
+                                                           p4est_qcoord_t
+                                                           ny[],
+                                                           int8_t nlevel[],
+                                                           int8_t outside[]);
+
 /** Compute the corner neighbors of a quadrant, transforming across tree
  * boundaries if necessary.  Only computes neighbors that are not face or edge
  * neighbors.
@@ -532,6 +590,31 @@ void                p4est_quadrant_transform_face (const p4est_quadrant_t * q,
                                                    p4est_quadrant_t * r,
                                                    const int ftransform[]);
 
+/** Transforms a quadrant/node across a face between trees in one call.
+ *
+ * Fuses \ref p4est_find_face_transform and
+ * \ref p4est_quadrant_transform_face.  The coordinate maps for all
+ * (face, target face, orientation) combinations are precomputed into a
+ * dense table on first use, so each crossing is straight-line
+ * arithmetic without the general axis permutation logic.
+ *
+ * \param [in]     conn     The connectivity structure for the forest.
+ * \param [in]     itree    The tree containing \a q.
+ * \param [in]     iface    The face of \a itree across which to transform.
+ * \param [in]     q        Input quadrant/non-clamped node.
+ * \param [in,out] r        Quadrant/node whose Morton index will be filled.
+ * \return Returns the tree across \a iface, or -1 if there is none,
+ *         in which case \a r is not touched.
+ * \note \a q and \a r may NOT point to the same quadrant structure.
+ */
+p4est_topidx_t      p4est_quadrant_transform_face_fast (p4est_connectivity_t *
+                                                        conn,
+                                                        p4est_topidx_t itree,
+                                                        int iface,
+                                                        const p4est_quadrant_t
+                                                        * q,
+                                                        p4est_quadrant_t * r);
+
 /** Checks if a quadrant touches a corner (diagonally inside or outside).
  */
 int                 p4est_quadrant_touches_corner (const p4est_quadrant_t * q,
@@ -572,6 +655,119 @@ uint64_t            p4est_quadrant_linear_id (const p4est_quadrant_t *
 void                p4est_quadrant_set_morton (p4est_quadrant_t * quadrant,
                                                int level, uint64_t id);
 
+/** Computes the 64-bit interleaved Morton key of a quadrant.
+ * The key stores the linear position at P4EST_QMAXLEVEL in its high bits
+ * and the level in its low 6 bits, so comparing two keys as unsigned
+ * integers is equivalent to p4est_quadrant_compare for valid quadrants of
+ * the same tree.  Keys are meant to be precomputed alongside sorted
+ * quadrant arrays to turn searches into plain integer compares.
+ * \param [in] q    A valid quadrant or a node inside the unit tree.
+ * \return Returns the Morton key of \a q.
+ */
+uint64_t            p4est_quadrant_morton_key (const p4est_quadrant_t * q);
+
+/** Materialize the Morton keys of a sorted quadrant array.
+ * The keys are stored separately to keep p4est_quadrant_t small and stay
+ * valid until the array is modified.
+ * \param [in] quadrants  Array of quadrants, each valid or an inside node.
+ * \return Returns an array of one key per quadrant, allocated with
+ *         P4EST_ALLOC; it is owned by the caller and freed with P4EST_FREE.
+ */
+uint64_t           *p4est_quadrant_array_morton_keys (sc_array_t * quadrants);
+
+/** Test the ancestor relation on two Morton keys.
+ * \param [in] akey  Key of the candidate ancestor.
+ * \param [in] rkey  Key of the candidate descendant.
+ * \return true if the quadrant of \a akey is a strict ancestor of the
+ *         quadrant of \a rkey.
+ */
+int                 p4est_morton_key_is_ancestor (uint64_t akey,
+                                                  uint64_t rkey);
+
+/** Find the insertion point of a key in a sorted array of Morton keys.
+ * The search is branch-free and, when compiled for AVX2, compares the key
+ * against several array entries at once.
+ * \param [in] keys   Array of \a count keys sorted in ascending order.
+ * \param [in] count  Number of keys in \a keys.
+ * \param [in] key    The key searched for.
+ * \return Returns the index of the first entry that is not smaller than
+ *         \a key, which is \a count if no such entry exists.
+ */
+size_t              p4est_morton_key_lower_bound (const uint64_t * keys,
+                                                  size_t count,
+                                                  uint64_t key);
+
+/** One inclusive range of the Morton curve inside a tree.
+ * Both endpoints are quadrants of level P4EST_QMAXLEVEL, so an interval
+ * covers exactly the atoms between the first descendant and the last
+ * descendant of any quadrant it was built from.  Sets of intervals are
+ * kept in sc_arrays sorted ascending with pairwise disjoint,
+ * non-adjacent members; all set operations preserve this normal form.
+ */
+typedef struct p4est_interval
+{
+  p4est_quadrant_t    first;    /**< first atom, level P4EST_QMAXLEVEL */
+  p4est_quadrant_t    last;     /**< last atom, inclusive */
+}
+p4est_interval_t;
+
+/** Initialize an interval to the descendant range of one quadrant.
+ * \param [in] q    A valid quadrant of the tree.
+ * \param [out] iv  Covers exactly the atoms inside \a q.
+ */
+void                p4est_interval_from_quadrant (const p4est_quadrant_t *
+                                                  q, p4est_interval_t * iv);
+
+/** Check the normal form of an interval set.
+ * \param [in] set  Array of p4est_interval_t.
+ * \return          true if sorted ascending with disjoint, non-adjacent
+ *                  intervals of level P4EST_QMAXLEVEL endpoints.
+ */
+int                 p4est_interval_set_is_valid (sc_array_t * set);
+
+/** Compute the union of two interval sets with one linear merge.
+ * Overlapping and adjacent intervals are coalesced.
+ * \param [in] a        Valid interval set.
+ * \param [in] b        Valid interval set.
+ * \param [in,out] result  Resized and overwritten with the union;
+ *                      must be distinct from \a a and \a b.
+ */
+void                p4est_interval_set_union (sc_array_t * a,
+                                              sc_array_t * b,
+                                              sc_array_t * result);
+
+/** Compute the intersection of two interval sets with one linear merge.
+ * \param [in] a        Valid interval set.
+ * \param [in] b        Valid interval set.
+ * \param [in,out] result  Resized and overwritten with the intersection;
+ *                      must be distinct from \a a and \a b.
+ */
+void                p4est_interval_set_intersection (sc_array_t * a,
+                                                     sc_array_t * b,
+                                                     sc_array_t * result);
+
+/** Compute the difference a minus b with one linear merge.
+ * \param [in] a        Valid interval set.
+ * \param [in] b        Valid interval set.
+ * \param [in,out] result  Resized and overwritten with the atoms of
+ *                      \a a not in \a b; distinct from \a a and \a b.
+ */
+void                p4est_interval_set_difference (sc_array_t * a,
+                                                   sc_array_t * b,
+                                                   sc_array_t * result);
+
+/** Test whether a quadrant is entirely covered by an interval set.
+ * Since valid sets hold no adjacent intervals, a quadrant is covered
+ * if and only if its descendant range lies inside a single interval,
+ * which one binary search finds.
+ * \param [in] set  Valid interval set.
+ * \param [in] q    A valid quadrant of the tree.
+ * \return          true if every atom of \a q is in \a set.
+ */
+int                 p4est_interval_set_contains (sc_array_t * set,
+                                                 const p4est_quadrant_t *
+                                                 q);
+
 SC_EXTERN_C_END;
 
 #endif /* !P4EST_BITS_H */
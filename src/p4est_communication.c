@@ -28,13 +28,195 @@
 #include <p4est_communication.h>
 #include <p4est_bits.h>
 #endif /* !P4_TO_P8 */
+#include <sc_notify.h>
 #include <sc_zlib.h>
+#include <float.h>
 
 #ifdef SC_ALLGATHER
 #include <sc_allgather.h>
 #define MPI_Allgather sc_allgather
 #endif
 
+#if defined P4EST_MPI && defined P4EST_HAVE_MPI_COMM_SPLIT_TYPE
+#define P4EST_COMM_HIERARCHICAL
+#endif
+
+#ifdef P4EST_COMM_HIERARCHICAL
+
+/** Cached node hierarchy for two-level collectives.
+ * The allgathers that establish the global quadrant counts and the
+ * partition markers send one small item per process.  On fat nodes it
+ * is cheaper to gather these within the shared-memory node first and
+ * let only the node leaders talk across the network.  The hierarchy
+ * is derived once per communicator and reused; since both dimensions
+ * compile this file separately, each has its own private cache.
+ */
+typedef struct p4est_comm_hierarchy
+{
+  MPI_Comm            mpicomm;    /**< parent communicator this is keyed to */
+  MPI_Comm            intranode;  /**< shared-memory node communicator */
+  MPI_Comm            internode;  /**< node leaders; MPI_COMM_NULL otherwise */
+  int                 intrarank;  /**< rank within \a intranode */
+  int                 intrasize;  /**< size of \a intranode */
+  int                 num_nodes;  /**< number of nodes in \a mpicomm */
+  int                 node_id;    /**< index of this node, 0-based */
+  int                *node_counts;   /**< per-node process counts */
+  int                *node_offsets;  /**< per-node first parent rank */
+  int                 usable;     /**< false if ranks not node-contiguous */
+}
+p4est_comm_hierarchy_t;
+
+static p4est_comm_hierarchy_t p4est_comm_hier = {
+  MPI_COMM_NULL, MPI_COMM_NULL, MPI_COMM_NULL, 0, 0, 0, 0, NULL, NULL, 0
+};
+
+static void
+p4est_comm_hierarchy_reset (p4est_comm_hierarchy_t * h)
+{
+  int                 mpiret;
+
+  if (h->intranode != MPI_COMM_NULL) {
+    mpiret = MPI_Comm_free (&h->intranode);
+    SC_CHECK_MPI (mpiret);
+  }
+  if (h->internode != MPI_COMM_NULL) {
+    mpiret = MPI_Comm_free (&h->internode);
+    SC_CHECK_MPI (mpiret);
+  }
+  P4EST_FREE (h->node_counts);
+  P4EST_FREE (h->node_offsets);
+  memset (h, 0, sizeof (p4est_comm_hierarchy_t));
+  h->mpicomm = h->intranode = h->internode = MPI_COMM_NULL;
+}
+
+/** Establish the node hierarchy for \a mpicomm, rebuilding the cache
+ * if it is keyed to a different communicator.
+ * \return Returns the cache; its \c usable flag is false when the
+ *         parent ranks are not contiguous and ordered within nodes,
+ *         in which case the caller falls back to the flat collective.
+ */
+static p4est_comm_hierarchy_t *
+p4est_comm_hierarchy_get (MPI_Comm mpicomm, int num_procs, int rank)
+{
+  int                 mpiret;
+  int                 leader_rank, contiguous, allcontiguous;
+  int                 i;
+  p4est_comm_hierarchy_t *h = &p4est_comm_hier;
+
+  if (h->mpicomm == mpicomm) {
+    return h;
+  }
+  p4est_comm_hierarchy_reset (h);
+  h->mpicomm = mpicomm;
+
+  mpiret = MPI_Comm_split_type (mpicomm, MPI_COMM_TYPE_SHARED, 0,
+                                MPI_INFO_NULL, &h->intranode);
+  SC_CHECK_MPI (mpiret);
+  mpiret = MPI_Comm_rank (h->intranode, &h->intrarank);
+  SC_CHECK_MPI (mpiret);
+  mpiret = MPI_Comm_size (h->intranode, &h->intrasize);
+  SC_CHECK_MPI (mpiret);
+
+  /* the hierarchy only pays off with more than one rank per node and
+     more than one node, and the two-level gather relies on each node
+     owning a contiguous, ordered block of parent ranks.  These
+     conditions are rank-local, so every rank must run the same
+     collectives and agree on the combined verdict before branching;
+     otherwise mixed placements deadlock here */
+  leader_rank = rank;
+  mpiret = MPI_Bcast (&leader_rank, 1, MPI_INT, 0, h->intranode);
+  SC_CHECK_MPI (mpiret);
+  contiguous = (h->intrasize > 1 && h->intrasize < num_procs &&
+                rank == leader_rank + h->intrarank);
+  mpiret = MPI_Allreduce (&contiguous, &allcontiguous, 1, MPI_INT,
+                          MPI_LAND, mpicomm);
+  SC_CHECK_MPI (mpiret);
+  if (!allcontiguous) {
+    h->usable = 0;
+    return h;
+  }
+
+  mpiret = MPI_Comm_split (mpicomm,
+                           h->intrarank == 0 ? 0 : MPI_UNDEFINED, rank,
+                           &h->internode);
+  SC_CHECK_MPI (mpiret);
+  if (h->intrarank == 0) {
+    P4EST_ASSERT (h->internode != MPI_COMM_NULL);
+    mpiret = MPI_Comm_size (h->internode, &h->num_nodes);
+    SC_CHECK_MPI (mpiret);
+    mpiret = MPI_Comm_rank (h->internode, &h->node_id);
+    SC_CHECK_MPI (mpiret);
+    h->node_counts = P4EST_ALLOC (int, h->num_nodes);
+    h->node_offsets = P4EST_ALLOC (int, h->num_nodes + 1);
+    mpiret = MPI_Allgather (&h->intrasize, 1, MPI_INT,
+                            h->node_counts, 1, MPI_INT, h->internode);
+    SC_CHECK_MPI (mpiret);
+    h->node_offsets[0] = 0;
+    for (i = 0; i < h->num_nodes; ++i) {
+      h->node_offsets[i + 1] = h->node_offsets[i] + h->node_counts[i];
+    }
+    P4EST_ASSERT (h->node_offsets[h->num_nodes] == num_procs);
+    P4EST_ASSERT (h->node_offsets[h->node_id] == rank);
+  }
+  h->usable = 1;
+  return h;
+}
+
+/** Allgather one \a typesize -byte item per parent rank in two levels.
+ * \param [in] sendbuf    The local item, \a typesize bytes.
+ * \param [out] recvbuf   On all ranks, \a num_procs items in parent
+ *                        rank order.
+ * \param [in] typesize   Size of one item in bytes.
+ * \return                True if the hierarchy was used; false means
+ *                        the caller must run the flat allgather.
+ */
+static int
+p4est_comm_allgather_hierarchical (p4est_t * p4est, void *sendbuf,
+                                   void *recvbuf, size_t typesize)
+{
+  int                 mpiret;
+  int                 i;
+  int                *bcounts, *boffsets;
+  p4est_comm_hierarchy_t *h;
+
+  h = p4est_comm_hierarchy_get (p4est->mpicomm, p4est->mpisize,
+                                p4est->mpirank);
+  if (!h->usable) {
+    return 0;
+  }
+
+  /* gather the node's items onto the leader at their final position */
+  mpiret = MPI_Gather (sendbuf, (int) typesize, MPI_BYTE,
+                       (char *) recvbuf +
+                       (size_t) (p4est->mpirank - h->intrarank) * typesize,
+                       (int) typesize, MPI_BYTE, 0, h->intranode);
+  SC_CHECK_MPI (mpiret);
+
+  /* exchange the per-node blocks among the leaders */
+  if (h->intrarank == 0) {
+    bcounts = P4EST_ALLOC (int, 2 * h->num_nodes);
+    boffsets = bcounts + h->num_nodes;
+    for (i = 0; i < h->num_nodes; ++i) {
+      bcounts[i] = h->node_counts[i] * (int) typesize;
+      boffsets[i] = h->node_offsets[i] * (int) typesize;
+    }
+    mpiret = MPI_Allgatherv (MPI_IN_PLACE, 0, MPI_DATATYPE_NULL,
+                             recvbuf, bcounts, boffsets, MPI_BYTE,
+                             h->internode);
+    SC_CHECK_MPI (mpiret);
+    P4EST_FREE (bcounts);
+  }
+
+  /* fan the complete array out within the node */
+  mpiret = MPI_Bcast (recvbuf, p4est->mpisize * (int) typesize, MPI_BYTE,
+                      0, h->intranode);
+  SC_CHECK_MPI (mpiret);
+
+  return 1;
+}
+
+#endif /* P4EST_COMM_HIERARCHICAL */
+
 void
 p4est_comm_count_quadrants (p4est_t * p4est)
 {
@@ -45,10 +227,17 @@ p4est_comm_count_quadrants (p4est_t * p4est)
   const int           num_procs = p4est->mpisize;
 
   global_first_quadrant[0] = 0;
-  mpiret = MPI_Allgather (&qlocal, 1, P4EST_MPI_GLOIDX,
-                          global_first_quadrant + 1, 1, P4EST_MPI_GLOIDX,
-                          p4est->mpicomm);
-  SC_CHECK_MPI (mpiret);
+#ifdef P4EST_COMM_HIERARCHICAL
+  if (!p4est_comm_allgather_hierarchical (p4est, &qlocal,
+                                          global_first_quadrant + 1,
+                                          sizeof (p4est_gloidx_t)))
+#endif
+  {
+    mpiret = MPI_Allgather (&qlocal, 1, P4EST_MPI_GLOIDX,
+                            global_first_quadrant + 1, 1, P4EST_MPI_GLOIDX,
+                            p4est->mpicomm);
+    SC_CHECK_MPI (mpiret);
+  }
 
   for (i = 0; i < num_procs; ++i) {
     global_first_quadrant[i + 1] += global_first_quadrant[i];
@@ -100,11 +289,18 @@ p4est_comm_global_partition (p4est_t * p4est, p4est_quadrant_t * first_quad)
   }
   input.level = P4EST_QMAXLEVEL;
   input.p.which_tree = first_tree;
-  mpiret = MPI_Allgather (&input, (int) sizeof (p4est_quadrant_t), MPI_BYTE,
-                          p4est->global_first_position,
-                          (int) sizeof (p4est_quadrant_t), MPI_BYTE,
-                          p4est->mpicomm);
-  SC_CHECK_MPI (mpiret);
+#ifdef P4EST_COMM_HIERARCHICAL
+  if (!p4est_comm_allgather_hierarchical (p4est, &input,
+                                          p4est->global_first_position,
+                                          sizeof (p4est_quadrant_t)))
+#endif
+  {
+    mpiret = MPI_Allgather (&input, (int) sizeof (p4est_quadrant_t),
+                            MPI_BYTE, p4est->global_first_position,
+                            (int) sizeof (p4est_quadrant_t), MPI_BYTE,
+                            p4est->mpicomm);
+    SC_CHECK_MPI (mpiret);
+  }
 
   /* correct for processors that don't have any quadrants */
   for (i = num_procs - 1; i >= 0; --i) {
@@ -124,8 +320,17 @@ p4est_comm_global_partition (p4est_t * p4est, p4est_quadrant_t * first_quad)
   }
 }
 
-void
-p4est_comm_count_pertree (p4est_t * p4est, p4est_gloidx_t * pertree)
+/** Count quadrants per tree as a segmented parallel prefix.
+ * Each rank counts only the trees whose first quadrant it owns, makes
+ * its segment cumulative with the offset implied by the partition, and
+ * exchanges at most one point-to-point contribution for a tree split
+ * across ranks.  With \a root < 0 the segments are allgathered so all
+ * ranks hold the result; otherwise only rank \a root receives it and
+ * the cost of the other ranks scales with their own counted trees.
+ */
+static void
+p4est_comm_count_pertree_work (p4est_t * p4est, p4est_gloidx_t * pertree,
+                               int root)
 {
   const int           num_procs = p4est->mpisize;
   const int           rank = p4est->mpirank;
@@ -138,6 +343,7 @@ p4est_comm_count_pertree (p4est_t * p4est, p4est_gloidx_t * pertree)
   int                *treecount, *treeoffset;
   p4est_topidx_t      t;
   p4est_locidx_t      recvbuf, sendbuf;
+  p4est_gloidx_t      base;
   p4est_gloidx_t     *mypertree;
   MPI_Request         req_recv, req_send;
   MPI_Status          status;
@@ -147,7 +353,9 @@ p4est_comm_count_pertree (p4est_t * p4est, p4est_gloidx_t * pertree)
 #endif
 
   /* Tip off valgrind in case input array is too small */
-  pertree[num_trees] = 0;
+  if (root < 0 || rank == root) {
+    pertree[num_trees] = 0;
+  }
 
   /*
    * Determine which trees each rank will be counting.
@@ -268,49 +476,125 @@ p4est_comm_count_pertree (p4est_t * p4est, p4est_gloidx_t * pertree)
     SC_CHECK_MPI (mpiret);
   }
 
-  /* Complete MPI operations and cumulative count */
+  /* Complete the sparse contribution exchange */
   if (addtomytree >= 0) {
     mpiret = MPI_Wait (&req_recv, &status);
     SC_CHECK_MPI (mpiret);
     mypertree[addtomytree] += (p4est_gloidx_t) recvbuf;
   }
-  pertree[0] = 0;
-  mpiret = MPI_Allgatherv (mypertree, mycount, P4EST_MPI_GLOIDX, pertree + 1,
-                           treecount, treeoffset, P4EST_MPI_GLOIDX,
-                           p4est->mpicomm);
-  SC_CHECK_MPI (mpiret);
-  for (c = 0; c < (int) num_trees; ++c) {
-     pertree[c + 1] += pertree[c];
+
+  /* Make the segment cumulative; the partition array already provides
+   * the global prefix before this rank's first counted tree, so the
+   * gathered segments concatenate into the result without another pass */
+  base = gfq[rank] + (sendbuf >= 0 ? (p4est_gloidx_t) sendbuf : 0);
+  for (c = 0; c < mycount; ++c) {
+    base += mypertree[c];
+    mypertree[c] = base;
+  }
+
+  if (root < 0) {
+    pertree[0] = 0;
+    mpiret = MPI_Allgatherv (mypertree, mycount, P4EST_MPI_GLOIDX,
+                             pertree + 1, treecount, treeoffset,
+                             P4EST_MPI_GLOIDX, p4est->mpicomm);
+    SC_CHECK_MPI (mpiret);
+    P4EST_ASSERT (pertree[num_trees] == p4est->global_num_quadrants);
+  }
+  else {
+    if (rank == root) {
+      pertree[0] = 0;
+    }
+    mpiret = MPI_Gatherv (mypertree, mycount, P4EST_MPI_GLOIDX,
+                          rank == root ? pertree + 1 : NULL,
+                          treecount, treeoffset, P4EST_MPI_GLOIDX,
+                          root, p4est->mpicomm);
+    SC_CHECK_MPI (mpiret);
+    P4EST_ASSERT (rank != root ||
+                  pertree[num_trees] == p4est->global_num_quadrants);
   }
   if (sendbuf >= 0) {
     mpiret = MPI_Wait (&req_send, &status);
     SC_CHECK_MPI (mpiret);
   }
-  
+
   /* Clean up */
   P4EST_FREE (treecount);
   P4EST_FREE (treeoffset);
   P4EST_FREE (mypertree);
 }
 
+void
+p4est_comm_count_pertree (p4est_t * p4est, p4est_gloidx_t * pertree)
+{
+  p4est_comm_count_pertree_work (p4est, pertree, -1);
+}
+
+void
+p4est_comm_count_pertree_root (p4est_t * p4est, int root,
+                               p4est_gloidx_t * pertree)
+{
+  P4EST_ASSERT (0 <= root && root < p4est->mpisize);
+
+  p4est_comm_count_pertree_work (p4est, pertree, root);
+}
+
+/** Check a Morton index against the first position of a processor.
+ * A quadrant coordinate-equal to the first position counts as inside.
+ * The index is the high part of p4est_quadrant_morton_key, which drops
+ * the level and thereby the coordinate-equal exclusion comes for free.
+ * \return  True if the index \a id in \a which_tree sorts strictly below
+ *          the first position of \a proc, false otherwise.
+ */
+static int
+p4est_comm_below_first_position (p4est_t * p4est, p4est_topidx_t which_tree,
+                                 uint64_t id, int proc)
+{
+  const p4est_quadrant_t *fp = &p4est->global_first_position[proc];
+
+  if (which_tree != fp->p.which_tree) {
+    return which_tree < fp->p.which_tree;
+  }
+  return id < (p4est_quadrant_morton_key (fp) >> 6);
+}
+
 int
 p4est_comm_find_owner (p4est_t * p4est, p4est_locidx_t which_tree,
                        const p4est_quadrant_t * q, int guess)
 {
   const int           num_procs = p4est->mpisize;
-  const p4est_quadrant_t *global_first_position =
-    p4est->global_first_position;
   int                 proc_low, proc_high;
-  p4est_topidx_t      ctree;
-  p4est_quadrant_t    cur;
+  int                 cached;
+  uint64_t            qid;
 
   P4EST_ASSERT (0 <= which_tree &&
                 which_tree < p4est->connectivity->num_trees);
   P4EST_ASSERT (p4est_quadrant_is_node (q, 1) || p4est_quadrant_is_valid (q));
 
-  proc_low = 0;
-  proc_high = num_procs - 1;
-  cur.level = P4EST_QMAXLEVEL;
+  /* derive the Morton index once so every probe is an integer compare */
+  qid = p4est_quadrant_morton_key (q) >> 6;
+
+  /* Probe the previous result first: search keys are usually spatially
+   * correlated, so most queries repeat the last owner.  The probe fails
+   * for an empty processor since its range contains no quadrant, so a
+   * hit is always a valid result.  A stale value is merely a miss.
+   */
+  cached = p4est->find_owner_cache;
+  P4EST_ASSERT (0 <= cached && cached < num_procs);
+  if (!p4est_comm_below_first_position (p4est, which_tree, qid, cached) &&
+      p4est_comm_below_first_position (p4est, which_tree, qid,
+                                      cached + 1)) {
+    return cached;
+  }
+
+  /* restrict the search to the processors that own part of this tree;
+   * between repartitions the intervals come from the lazily built cache */
+  p4est_comm_tree_owner_range (p4est, which_tree, &proc_low, &proc_high);
+  if (proc_low == proc_high) {
+    /* a single processor owns the whole tree: no search is needed */
+    p4est->find_owner_cache = proc_low;
+    return proc_low;
+  }
+  guess = SC_MAX (proc_low, SC_MIN (guess, proc_high));
 
   for (;;) {
     P4EST_ASSERT (proc_low <= proc_high);
@@ -319,40 +603,15 @@ p4est_comm_find_owner (p4est_t * p4est, p4est_locidx_t which_tree,
     P4EST_ASSERT (proc_low <= guess && guess <= proc_high);
 
     /* check if q is on a lower processor than guess */
-    ctree = global_first_position[guess].p.which_tree;
-    cur.x = global_first_position[guess].x;
-    cur.y = global_first_position[guess].y;
-#ifdef P4_TO_P8
-    cur.z = global_first_position[guess].z;
-#endif
-    if (which_tree < ctree ||
-        (which_tree == ctree &&
-         (p4est_quadrant_compare (q, &cur) < 0 &&
-          (q->x != cur.x || q->y != cur.y
-#ifdef P4_TO_P8
-           || q->z != cur.z
-#endif
-          )))) {
+    if (p4est_comm_below_first_position (p4est, which_tree, qid, guess)) {
       proc_high = guess - 1;
       guess = (proc_low + proc_high + 1) / 2;
       continue;
     }
 
     /* check if q is on a higher processor than guess */
-    ctree = global_first_position[guess + 1].p.which_tree;
-    cur.x = global_first_position[guess + 1].x;
-    cur.y = global_first_position[guess + 1].y;
-#ifdef P4_TO_P8
-    cur.z = global_first_position[guess + 1].z;
-#endif
-    if (which_tree > ctree ||
-        (which_tree == ctree &&
-         (p4est_quadrant_compare (&cur, q) <= 0 ||
-          (q->x == cur.x && q->y == cur.y
-#ifdef P4_TO_P8
-           && q->z == cur.z
-#endif
-          )))) {
+    if (!p4est_comm_below_first_position (p4est, which_tree, qid,
+                                          guess + 1)) {
       proc_low = guess + 1;
       guess = (proc_low + proc_high) / 2;
       continue;
@@ -364,12 +623,71 @@ p4est_comm_find_owner (p4est_t * p4est, p4est_locidx_t which_tree,
 
   /* make sure we found a valid processor with nonzero quadrant count */
   P4EST_ASSERT (0 <= guess && guess < num_procs);
-  P4EST_ASSERT (memcmp (&global_first_position[guess],
-                        &global_first_position[guess + 1],
+  P4EST_ASSERT (memcmp (&p4est->global_first_position[guess],
+                        &p4est->global_first_position[guess + 1],
                         sizeof (p4est_quadrant_t)) != 0);
+  p4est->find_owner_cache = guess;
   return guess;
 }
 
+void
+p4est_comm_tree_owner_range (p4est_t * p4est, p4est_topidx_t which_tree,
+                             int *first_owner, int *last_owner)
+{
+  const int           num_procs = p4est->mpisize;
+  const p4est_topidx_t num_trees = p4est->connectivity->num_trees;
+  int                 p;
+  int                *range;
+  p4est_topidx_t      tt, tfirst, tlast;
+  const p4est_quadrant_t *fp, *np;
+
+  P4EST_ASSERT (0 <= which_tree && which_tree < num_trees);
+
+  if (p4est->tree_owners == NULL ||
+      p4est->tree_owners_revision != p4est->revision) {
+    /* derive the owner rank interval of every tree from the partition
+     * markers in one merge sweep; the total work is O (#trees + #procs) */
+    range = p4est->tree_owners;
+    if (range == NULL) {
+      range = p4est->tree_owners = P4EST_ALLOC (int, 2 * num_trees);
+    }
+    for (tt = 0; tt < num_trees; ++tt) {
+      range[2 * tt + 0] = range[2 * tt + 1] = -1;
+    }
+    for (p = 0; p < num_procs; ++p) {
+      fp = &p4est->global_first_position[p];
+      np = &p4est->global_first_position[p + 1];
+      if (memcmp (fp, np, sizeof (p4est_quadrant_t)) == 0) {
+        /* this processor is empty */
+        continue;
+      }
+      tfirst = fp->p.which_tree;
+      tlast = np->p.which_tree;
+      if (np->x == 0 && np->y == 0
+#ifdef P4_TO_P8
+          && np->z == 0
+#endif
+        ) {
+        /* the next processor begins at the start of its first tree */
+        --tlast;
+      }
+      P4EST_ASSERT (0 <= tfirst && tfirst <= tlast && tlast < num_trees);
+      for (tt = tfirst; tt <= tlast; ++tt) {
+        if (range[2 * tt + 0] == -1) {
+          range[2 * tt + 0] = p;
+        }
+        range[2 * tt + 1] = p;
+      }
+    }
+    p4est->tree_owners_revision = p4est->revision;
+  }
+
+  *first_owner = p4est->tree_owners[2 * which_tree + 0];
+  *last_owner = p4est->tree_owners[2 * which_tree + 1];
+  P4EST_ASSERT (0 <= *first_owner && *first_owner <= *last_owner &&
+                *last_owner < num_procs);
+}
+
 void
 p4est_comm_tree_info (p4est_t * p4est, p4est_locidx_t which_tree,
                       int full_tree[], int tree_contact[],
@@ -497,6 +815,230 @@ p4est_comm_sync_flag (p4est_t * p4est, int flag, MPI_Op operation)
   return (int) gbyte;
 }
 
+/** A flag reduction in progress between begin and end. */
+struct p4est_comm_flag_context
+{
+  int8_t              lbyte;    /**< local contribution kept alive */
+  int8_t              gbyte;    /**< global result filled on completion */
+#if defined P4EST_MPI && defined P4EST_HAVE_MPI_IALLREDUCE
+  MPI_Request         request;  /**< outstanding nonblocking reduction */
+#endif
+};
+
+p4est_comm_flag_context_t *
+p4est_comm_sync_flag_begin (p4est_t * p4est, int flag, MPI_Op operation)
+{
+  p4est_comm_flag_context_t *ctx;
+#if defined P4EST_MPI && defined P4EST_HAVE_MPI_IALLREDUCE
+  int                 mpiret;
+#endif
+
+  P4EST_ASSERT (operation == MPI_BAND || operation == MPI_BOR);
+
+  ctx = P4EST_ALLOC (p4est_comm_flag_context_t, 1);
+  ctx->lbyte = (int8_t) (flag ? 1 : 0);
+#if defined P4EST_MPI && defined P4EST_HAVE_MPI_IALLREDUCE
+  mpiret = MPI_Iallreduce (&ctx->lbyte, &ctx->gbyte, 1, MPI_BYTE,
+                           operation, p4est->mpicomm, &ctx->request);
+  SC_CHECK_MPI (mpiret);
+#else
+  /* without a nonblocking reduction the result is computed here */
+  ctx->gbyte = (int8_t) p4est_comm_sync_flag (p4est, flag, operation);
+#endif
+
+  return ctx;
+}
+
+int
+p4est_comm_sync_flag_end (p4est_comm_flag_context_t * ctx)
+{
+  int                 result;
+#if defined P4EST_MPI && defined P4EST_HAVE_MPI_IALLREDUCE
+  int                 mpiret;
+  MPI_Status          mpistatus;
+
+  mpiret = MPI_Wait (&ctx->request, &mpistatus);
+  SC_CHECK_MPI (mpiret);
+#endif
+
+  result = (int) ctx->gbyte;
+  P4EST_FREE (ctx);
+
+  return result;
+}
+
+void
+p4est_comm_notify_payload (MPI_Comm mpicomm, int num_receivers,
+                           const int *receiver_ranks,
+                           sc_array_t * send_bufs,
+                           int *num_senders, int **sender_ranks,
+                           sc_array_t * recv_bufs)
+{
+  int                 i;
+  int                 mpiret;
+  int                 count, ns;
+  int                 rank;
+  int                *ranks;
+  sc_array_t         *sbuf, *rbuf;
+  MPI_Status          status;
+  MPI_Request        *send_requests;
+#if defined P4EST_MPI && defined P4EST_HAVE_MPI_IBARRIER
+  static int          notify_round = 0;
+  int                 j;
+  int                 flag, barrier_active;
+  int                 tag;
+  sc_array_t          tbuf;
+  sc_array_t          found_ranks;
+  MPI_Request         barrier_request;
+#else
+  int                 mpisize;
+  int                *all_senders;
+#endif
+
+  P4EST_ASSERT (num_receivers >= 0);
+  P4EST_ASSERT (send_bufs->elem_size == sizeof (sc_array_t));
+  P4EST_ASSERT (send_bufs->elem_count == (size_t) num_receivers);
+  P4EST_ASSERT (recv_bufs->elem_size == sizeof (sc_array_t));
+  P4EST_ASSERT (recv_bufs->elem_count == 0);
+
+  send_requests = P4EST_ALLOC (MPI_Request, num_receivers);
+
+#if defined P4EST_MPI && defined P4EST_HAVE_MPI_IBARRIER
+  /* the payloads themselves serve as the discovery messages: a
+   * synchronous send completes only once it is matched, so when the
+   * barrier entered after local send completion finishes globally,
+   * every message of the exchange has been received.  A peer whose
+   * barrier completes early may legally start the next notify round,
+   * so consecutive rounds alternate between two tags to keep their
+   * messages out of this round's wildcard probe */
+  tag = (notify_round++ & 1) ? P4EST_COMM_NOTIFY_PAYLOAD2 :
+    P4EST_COMM_NOTIFY_PAYLOAD;
+  for (i = 0; i < num_receivers; ++i) {
+    sbuf = (sc_array_t *) sc_array_index_int (send_bufs, i);
+    P4EST_ASSERT (sbuf->elem_size == 1);
+    P4EST_ASSERT (i == 0 || receiver_ranks[i - 1] < receiver_ranks[i]);
+    mpiret = MPI_Issend (sbuf->array, (int) sbuf->elem_count, MPI_BYTE,
+                         receiver_ranks[i], tag,
+                         mpicomm, &send_requests[i]);
+    SC_CHECK_MPI (mpiret);
+  }
+  sc_array_init (&found_ranks, sizeof (int));
+  barrier_active = 0;
+  for (;;) {
+    mpiret = MPI_Iprobe (MPI_ANY_SOURCE, tag, mpicomm, &flag, &status);
+    SC_CHECK_MPI (mpiret);
+    if (flag) {
+      mpiret = MPI_Get_count (&status, MPI_BYTE, &count);
+      SC_CHECK_MPI (mpiret);
+      rbuf = (sc_array_t *) sc_array_push (recv_bufs);
+      sc_array_init_size (rbuf, 1, (size_t) count);
+      mpiret = MPI_Recv (rbuf->array, count, MPI_BYTE, status.MPI_SOURCE,
+                         tag, mpicomm, MPI_STATUS_IGNORE);
+      SC_CHECK_MPI (mpiret);
+      *(int *) sc_array_push (&found_ranks) = status.MPI_SOURCE;
+    }
+    else if (!barrier_active) {
+      mpiret = MPI_Testall (num_receivers, send_requests, &flag,
+                            MPI_STATUSES_IGNORE);
+      SC_CHECK_MPI (mpiret);
+      if (flag) {
+        mpiret = MPI_Ibarrier (mpicomm, &barrier_request);
+        SC_CHECK_MPI (mpiret);
+        barrier_active = 1;
+      }
+    }
+    else {
+      mpiret = MPI_Test (&barrier_request, &flag, MPI_STATUS_IGNORE);
+      SC_CHECK_MPI (mpiret);
+      if (flag) {
+        break;
+      }
+    }
+  }
+
+  /* the probe order is arbitrary: sort payloads by sender rank */
+  ns = (int) found_ranks.elem_count;
+  ranks = P4EST_ALLOC (int, ns);
+  memcpy (ranks, found_ranks.array, ns * sizeof (int));
+  sc_array_reset (&found_ranks);
+  for (i = 1; i < ns; ++i) {
+    rank = ranks[i];
+    tbuf = *(sc_array_t *) sc_array_index_int (recv_bufs, i);
+    for (j = i; j > 0 && ranks[j - 1] > rank; --j) {
+      ranks[j] = ranks[j - 1];
+      *(sc_array_t *) sc_array_index_int (recv_bufs, j) =
+        *(sc_array_t *) sc_array_index_int (recv_bufs, j - 1);
+    }
+    ranks[j] = rank;
+    *(sc_array_t *) sc_array_index_int (recv_bufs, j) = tbuf;
+  }
+#else
+  /* without a nonblocking barrier fall back to discovery by sc_notify
+   * followed by one point-to-point payload round */
+  mpiret = MPI_Comm_size (mpicomm, &mpisize);
+  SC_CHECK_MPI (mpiret);
+  all_senders = P4EST_ALLOC (int, mpisize);
+  mpiret = sc_notify ((int *) receiver_ranks, num_receivers,
+                      all_senders, &ns, mpicomm);
+  SC_CHECK_MPI (mpiret);
+  for (i = 0; i < num_receivers; ++i) {
+    sbuf = (sc_array_t *) sc_array_index_int (send_bufs, i);
+    P4EST_ASSERT (sbuf->elem_size == 1);
+    P4EST_ASSERT (i == 0 || receiver_ranks[i - 1] < receiver_ranks[i]);
+    mpiret = MPI_Isend (sbuf->array, (int) sbuf->elem_count, MPI_BYTE,
+                        receiver_ranks[i], P4EST_COMM_NOTIFY_PAYLOAD,
+                        mpicomm, &send_requests[i]);
+    SC_CHECK_MPI (mpiret);
+  }
+  ranks = P4EST_ALLOC (int, ns);
+  memcpy (ranks, all_senders, ns * sizeof (int));
+  P4EST_FREE (all_senders);
+  for (i = 0; i < ns; ++i) {
+    rank = ranks[i];
+    mpiret = MPI_Probe (rank, P4EST_COMM_NOTIFY_PAYLOAD, mpicomm, &status);
+    SC_CHECK_MPI (mpiret);
+    mpiret = MPI_Get_count (&status, MPI_BYTE, &count);
+    SC_CHECK_MPI (mpiret);
+    rbuf = (sc_array_t *) sc_array_push (recv_bufs);
+    sc_array_init_size (rbuf, 1, (size_t) count);
+    mpiret = MPI_Recv (rbuf->array, count, MPI_BYTE, rank,
+                       P4EST_COMM_NOTIFY_PAYLOAD, mpicomm,
+                       MPI_STATUS_IGNORE);
+    SC_CHECK_MPI (mpiret);
+  }
+  mpiret = MPI_Waitall (num_receivers, send_requests, MPI_STATUSES_IGNORE);
+  SC_CHECK_MPI (mpiret);
+#endif
+  P4EST_FREE (send_requests);
+
+  *num_senders = ns;
+  *sender_ranks = ranks;
+}
+
+#ifdef P4EST_MPI
+
+/** Reduce (adler32 checksum, byte count) pairs in ascending rank order.
+ * The user function sees the lower ranked operand in \a invec, so the
+ * pair already accumulated in \a inoutvec is appended to it.
+ */
+static void
+p4est_comm_checksum_op (void *invec, void *inoutvec, int *len,
+                        MPI_Datatype * datatype)
+{
+  int                 i;
+  const uint64_t     *in = (const uint64_t *) invec;
+  uint64_t           *inout = (uint64_t *) inoutvec;
+
+  for (i = 0; i < *len; ++i) {
+    inout[2 * i + 0] = (uint64_t)
+      adler32_combine ((uLong) in[2 * i + 0], (uLong) inout[2 * i + 0],
+                       (z_off_t) inout[2 * i + 1]);
+    inout[2 * i + 1] += in[2 * i + 1];
+  }
+}
+
+#endif /* P4EST_MPI */
+
 unsigned
 p4est_comm_checksum (p4est_t * p4est, unsigned local_crc, size_t local_bytes)
 {
@@ -504,31 +1046,112 @@ p4est_comm_checksum (p4est_t * p4est, unsigned local_crc, size_t local_bytes)
 
 #ifdef P4EST_MPI
   int                 mpiret;
-  int                 p;
   uint64_t            send[2];
-  uint64_t           *gather;
+  uint64_t            recv[2];
+  MPI_Datatype        ctype;
+  MPI_Op              cop;
 
   send[0] = (uint64_t) local_crc;
   send[1] = (uint64_t) local_bytes;
-  gather = NULL;
-  if (p4est->mpirank == 0) {
-    gather = P4EST_ALLOC (uint64_t, 2 * p4est->mpisize);
-  }
-  mpiret = MPI_Gather (send, 2, MPI_LONG_LONG_INT,
-                       gather, 2, MPI_LONG_LONG_INT, 0, p4est->mpicomm);
+
+  /* adler32_combine is associative but not commutative, so the operator
+   * is registered as non-commutative and combines in rank order */
+  mpiret = MPI_Type_contiguous (2, MPI_LONG_LONG_INT, &ctype);
+  SC_CHECK_MPI (mpiret);
+  mpiret = MPI_Type_commit (&ctype);
+  SC_CHECK_MPI (mpiret);
+  mpiret = MPI_Op_create (p4est_comm_checksum_op, 0, &cop);
+  SC_CHECK_MPI (mpiret);
+  mpiret = MPI_Allreduce (send, recv, 1, ctype, cop, p4est->mpicomm);
+  SC_CHECK_MPI (mpiret);
+  mpiret = MPI_Op_free (&cop);
+  SC_CHECK_MPI (mpiret);
+  mpiret = MPI_Type_free (&ctype);
   SC_CHECK_MPI (mpiret);
 
-  if (p4est->mpirank == 0) {
-    for (p = 1; p < p4est->mpisize; ++p) {
-      crc = adler32_combine (crc, (uLong) gather[2 * p + 0],
-                             (z_off_t) gather[2 * p + 1]);
+  crc = (uLong) recv[0];
+#endif
+
+  return (unsigned) crc;
+}
+
+void
+p4est_comm_reduce_channels (p4est_t * p4est, int num_channels,
+                            const p4est_reduce_op_t * ops,
+                            p4est_reduce_fold_t fold_fn, void *user,
+                            double results[])
+{
+  int                 c;
+  size_t              zz;
+  p4est_topidx_t      jt;
+  p4est_tree_t       *tree;
+  p4est_quadrant_t   *q;
+  double             *accum;
+#ifdef P4EST_MPI
+  int                 mpiret, iop, npacked;
+  MPI_Op              mop;
+  double             *send, *recv;
+#endif
+
+  P4EST_ASSERT (num_channels > 0);
+  P4EST_ASSERT (ops != NULL && fold_fn != NULL && results != NULL);
+
+  /* initialize every channel to the identity of its operator */
+  accum = P4EST_ALLOC (double, num_channels);
+  for (c = 0; c < num_channels; ++c) {
+    switch (ops[c]) {
+    case P4EST_REDUCE_SUM:
+      accum[c] = 0.;
+      break;
+    case P4EST_REDUCE_MIN:
+      accum[c] = DBL_MAX;
+      break;
+    case P4EST_REDUCE_MAX:
+      accum[c] = -DBL_MAX;
+      break;
+    default:
+      SC_ABORT_NOT_REACHED ();
     }
-    P4EST_FREE (gather);
   }
-  else {
-    crc = 0;
+
+  /* one cache-friendly pass over the contiguous tree arrays */
+  for (jt = p4est->first_local_tree; jt <= p4est->last_local_tree; ++jt) {
+    tree = p4est_tree_array_index (p4est->trees, jt);
+    for (zz = 0; zz < tree->quadrants.elem_count; ++zz) {
+      q = p4est_quadrant_array_index (&tree->quadrants, zz);
+      fold_fn (p4est, jt, q, accum, user);
+    }
   }
-#endif
 
-  return (unsigned) crc;
+  memcpy (results, accum, (size_t) num_channels * sizeof (double));
+#ifdef P4EST_MPI
+  /* channels sharing an operator complete in one typed reduction */
+  send = P4EST_ALLOC (double, num_channels);
+  recv = P4EST_ALLOC (double, num_channels);
+  for (iop = 0; iop < 3; ++iop) {
+    npacked = 0;
+    for (c = 0; c < num_channels; ++c) {
+      if ((int) ops[c] == iop) {
+        send[npacked++] = accum[c];
+      }
+    }
+    if (npacked == 0) {
+      continue;
+    }
+    mop = (iop == (int) P4EST_REDUCE_SUM) ? MPI_SUM :
+      (iop == (int) P4EST_REDUCE_MIN) ? MPI_MIN : MPI_MAX;
+    mpiret = MPI_Allreduce (send, recv, npacked, MPI_DOUBLE, mop,
+                            p4est->mpicomm);
+    SC_CHECK_MPI (mpiret);
+    npacked = 0;
+    for (c = 0; c < num_channels; ++c) {
+      if ((int) ops[c] == iop) {
+        results[c] = recv[npacked++];
+      }
+    }
+  }
+  P4EST_FREE (send);
+  P4EST_FREE (recv);
+#endif
+  P4EST_FREE (accum);
 }
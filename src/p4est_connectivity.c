@@ -27,9 +27,16 @@
 #include <p4est_connectivity.h>
 #endif
 #include <sc_io.h>
+#include <float.h>
 #ifdef P4EST_METIS
 #include <metis.h>
 #endif
+#ifdef P4EST_HAVE_MMAP
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
 
 #ifndef P4_TO_P8
 
@@ -64,7 +71,20 @@ const int           p4est_child_corner_faces[4][4] =
 size_t
 p4est_connectivity_memory_used (p4est_connectivity_t * conn)
 {
-  return sizeof (p4est_connectivity_t) +
+  size_t              brick_bytes = 0;
+
+  if (conn->brick != NULL) {
+    p4est_topidx_t      n_iter = 1;
+    int                 i;
+
+    for (i = 0; i < P4EST_DIM; i++) {
+      n_iter *= (p4est_topidx_t) 1 << conn->brick->logx[i];
+    }
+    brick_bytes = sizeof (p4est_brick_t) +
+      (size_t) (n_iter + conn->num_trees) * sizeof (p4est_topidx_t);
+  }
+
+  return brick_bytes + sizeof (p4est_connectivity_t) +
     (conn->num_vertices > 0 ?
      (conn->num_vertices * 3 * sizeof (double) +
       conn->num_trees * P4EST_CHILDREN * sizeof (p4est_topidx_t)) : 0) +
@@ -215,9 +235,320 @@ p4est_connectivity_new (p4est_topidx_t num_vertices, p4est_topidx_t num_trees,
   return conn;
 }
 
+/* require the complete MPI-3 shared window machinery for sharing */
+#ifdef P4EST_MPI
+#if defined P4EST_HAVE_MPI_WIN_ALLOCATE_SHARED && \
+  defined P4EST_HAVE_MPI_COMM_SPLIT_TYPE
+#define P4EST_CONNECTIVITY_SHARED
+#endif
+#endif
+
+#ifdef P4EST_CONNECTIVITY_SHARED
+
+/** Bookkeeping behind the shared_win member of a shared connectivity. */
+typedef struct p4est_connectivity_shared
+{
+  MPI_Win             win;      /* window holding all connectivity arrays */
+  MPI_Comm            intranode;        /* node-local communicator */
+}
+p4est_connectivity_shared_t;
+
+#endif /* P4EST_CONNECTIVITY_SHARED */
+
+/** Bookkeeping behind the mapped member of a mapped connectivity. */
+typedef struct p4est_connectivity_mapped
+{
+  char               *map_base; /* start of the file contents in memory */
+  size_t              map_length;       /* size of the file in bytes */
+}
+p4est_connectivity_mapped_t;
+
+/** Lay out all connectivity arrays back to back in one memory block.
+ * Doubles come first, then p4est_topidx_t and last int8_t arrays, so
+ * every array is naturally aligned.  The counts inside \a conn must be
+ * set on input.  With \a base == NULL only the size is computed and
+ * the array pointers are left untouched.
+ * \return          Total number of bytes required for the block.
+ */
+static size_t
+p4est_connectivity_block_layout (p4est_connectivity_t * conn,
+#ifdef P4_TO_P8
+                                  p4est_topidx_t num_ett,
+#endif
+                                  p4est_topidx_t num_ctt, int have_attr,
+                                  char *base)
+{
+  size_t              zb = 0;
+
+  if (conn->num_vertices > 0) {
+    if (base != NULL) {
+      conn->vertices = (double *) (base + zb);
+    }
+    zb += 3 * (size_t) conn->num_vertices * sizeof (double);
+    if (base != NULL) {
+      conn->tree_to_vertex = (p4est_topidx_t *) (base + zb);
+    }
+    zb += P4EST_CHILDREN * (size_t) conn->num_trees *
+      sizeof (p4est_topidx_t);
+  }
+  if (base != NULL) {
+    conn->tree_to_tree = (p4est_topidx_t *) (base + zb);
+  }
+  zb += P4EST_FACES * (size_t) conn->num_trees * sizeof (p4est_topidx_t);
+#ifdef P4_TO_P8
+  if (conn->num_edges > 0) {
+    if (base != NULL) {
+      conn->tree_to_edge = (p4est_topidx_t *) (base + zb);
+    }
+    zb += P8EST_EDGES * (size_t) conn->num_trees * sizeof (p4est_topidx_t);
+    if (base != NULL) {
+      conn->edge_to_tree = (p4est_topidx_t *) (base + zb);
+    }
+    zb += (size_t) num_ett * sizeof (p4est_topidx_t);
+  }
+  if (base != NULL) {
+    conn->ett_offset = (p4est_topidx_t *) (base + zb);
+  }
+  zb += ((size_t) conn->num_edges + 1) * sizeof (p4est_topidx_t);
+#endif
+  if (conn->num_corners > 0) {
+    if (base != NULL) {
+      conn->tree_to_corner = (p4est_topidx_t *) (base + zb);
+    }
+    zb += P4EST_CHILDREN * (size_t) conn->num_trees *
+      sizeof (p4est_topidx_t);
+    if (base != NULL) {
+      conn->corner_to_tree = (p4est_topidx_t *) (base + zb);
+    }
+    zb += (size_t) num_ctt * sizeof (p4est_topidx_t);
+  }
+  if (base != NULL) {
+    conn->ctt_offset = (p4est_topidx_t *) (base + zb);
+  }
+  zb += ((size_t) conn->num_corners + 1) * sizeof (p4est_topidx_t);
+  if (base != NULL) {
+    conn->tree_to_face = (int8_t *) (base + zb);
+  }
+  zb += P4EST_FACES * (size_t) conn->num_trees * sizeof (int8_t);
+#ifdef P4_TO_P8
+  if (conn->num_edges > 0) {
+    if (base != NULL) {
+      conn->edge_to_edge = (int8_t *) (base + zb);
+    }
+    zb += (size_t) num_ett * sizeof (int8_t);
+  }
+#endif
+  if (conn->num_corners > 0) {
+    if (base != NULL) {
+      conn->corner_to_corner = (int8_t *) (base + zb);
+    }
+    zb += (size_t) num_ctt * sizeof (int8_t);
+  }
+  if (have_attr) {
+    if (base != NULL) {
+      conn->tree_to_attr = (int8_t *) (base + zb);
+    }
+    zb += (size_t) conn->num_trees * sizeof (int8_t);
+  }
+
+  return zb;
+}
+
+p4est_connectivity_t *
+p4est_connectivity_share (p4est_connectivity_t * conn, MPI_Comm mpicomm)
+{
+#ifdef P4EST_CONNECTIVITY_SHARED
+  int                 mpiret;
+  int                 intrarank, mysource, source;
+  char               *base;
+  size_t              zb;
+  MPI_Comm            intranode;
+  MPI_Win             win;
+  MPI_Aint            querysize;
+  int                 querydisp;
+  p4est_topidx_t      counts[7];
+  p4est_connectivity_shared_t *sh;
+  p4est_connectivity_t *shared;
+
+  P4EST_ASSERT (conn == NULL || conn->shared_win == NULL);
+  P4EST_ASSERT (conn == NULL || p4est_connectivity_is_valid (conn));
+
+  mpiret = MPI_Comm_split_type (mpicomm, MPI_COMM_TYPE_SHARED, 0,
+                                MPI_INFO_NULL, &intranode);
+  SC_CHECK_MPI (mpiret);
+  mpiret = MPI_Comm_rank (intranode, &intrarank);
+  SC_CHECK_MPI (mpiret);
+
+  /* the lowest node-local rank holding the connectivity provides it */
+  mysource = (conn != NULL) ? intrarank : INT_MAX;
+  mpiret = MPI_Allreduce (&mysource, &source, 1, MPI_INT, MPI_MIN,
+                          intranode);
+  SC_CHECK_MPI (mpiret);
+  SC_CHECK_ABORT (source != INT_MAX, P4EST_STRING
+                  "_connectivity_share needs one provider per node");
+
+  /* agree on the array sizes within the node */
+  if (intrarank == source) {
+    counts[0] = conn->num_vertices;
+    counts[1] = conn->num_trees;
+    counts[2] = conn->num_corners;
+    counts[3] = conn->ctt_offset[conn->num_corners];
+    counts[4] = (p4est_topidx_t) (conn->tree_to_attr != NULL);
+#ifdef P4_TO_P8
+    counts[5] = conn->num_edges;
+    counts[6] = conn->ett_offset[conn->num_edges];
+#else
+    counts[5] = counts[6] = 0;
+#endif
+  }
+  mpiret = MPI_Bcast (counts, 7, P4EST_MPI_TOPIDX, source, intranode);
+  SC_CHECK_MPI (mpiret);
+
+  shared = P4EST_ALLOC_ZERO (p4est_connectivity_t, 1);
+  shared->num_vertices = counts[0];
+  shared->num_trees = counts[1];
+  shared->num_corners = counts[2];
+#ifdef P4_TO_P8
+  shared->num_edges = counts[5];
+#endif
+
+  /* allocate one segment per node on the providing rank */
+  zb = p4est_connectivity_block_layout (shared,
+#ifdef P4_TO_P8
+                                         counts[6],
+#endif
+                                         counts[3], (int) counts[4], NULL);
+  mpiret = MPI_Win_allocate_shared ((MPI_Aint)
+                                    (intrarank == source ? zb : 0), 1,
+                                    MPI_INFO_NULL, intranode, &base, &win);
+  SC_CHECK_MPI (mpiret);
+  mpiret = MPI_Win_shared_query (win, source, &querysize, &querydisp,
+                                 &base);
+  SC_CHECK_MPI (mpiret);
+  P4EST_ASSERT ((size_t) querysize == zb);
+  (void) p4est_connectivity_block_layout (shared,
+#ifdef P4_TO_P8
+                                           counts[6],
+#endif
+                                           counts[3], (int) counts[4],
+                                           base);
+
+  /* the providing rank fills the segment */
+  mpiret = MPI_Win_fence (0, win);
+  SC_CHECK_MPI (mpiret);
+  if (intrarank == source) {
+    if (counts[0] > 0) {
+      memcpy (shared->vertices, conn->vertices,
+              3 * (size_t) counts[0] * sizeof (double));
+      memcpy (shared->tree_to_vertex, conn->tree_to_vertex,
+              P4EST_CHILDREN * (size_t) counts[1] *
+              sizeof (p4est_topidx_t));
+    }
+    memcpy (shared->tree_to_tree, conn->tree_to_tree,
+            P4EST_FACES * (size_t) counts[1] * sizeof (p4est_topidx_t));
+    memcpy (shared->tree_to_face, conn->tree_to_face,
+            P4EST_FACES * (size_t) counts[1] * sizeof (int8_t));
+#ifdef P4_TO_P8
+    if (counts[5] > 0) {
+      memcpy (shared->tree_to_edge, conn->tree_to_edge,
+              P8EST_EDGES * (size_t) counts[1] * sizeof (p4est_topidx_t));
+      memcpy (shared->edge_to_tree, conn->edge_to_tree,
+              (size_t) counts[6] * sizeof (p4est_topidx_t));
+      memcpy (shared->edge_to_edge, conn->edge_to_edge,
+              (size_t) counts[6] * sizeof (int8_t));
+    }
+    memcpy (shared->ett_offset, conn->ett_offset,
+            ((size_t) counts[5] + 1) * sizeof (p4est_topidx_t));
+#endif
+    if (counts[2] > 0) {
+      memcpy (shared->tree_to_corner, conn->tree_to_corner,
+              P4EST_CHILDREN * (size_t) counts[1] *
+              sizeof (p4est_topidx_t));
+      memcpy (shared->corner_to_tree, conn->corner_to_tree,
+              (size_t) counts[3] * sizeof (p4est_topidx_t));
+      memcpy (shared->corner_to_corner, conn->corner_to_corner,
+              (size_t) counts[3] * sizeof (int8_t));
+    }
+    memcpy (shared->ctt_offset, conn->ctt_offset,
+            ((size_t) counts[2] + 1) * sizeof (p4est_topidx_t));
+    if (counts[4]) {
+      memcpy (shared->tree_to_attr, conn->tree_to_attr,
+              (size_t) counts[1] * sizeof (int8_t));
+    }
+  }
+  mpiret = MPI_Win_fence (0, win);
+  SC_CHECK_MPI (mpiret);
+
+  sh = P4EST_ALLOC (p4est_connectivity_shared_t, 1);
+  sh->win = win;
+  sh->intranode = intranode;
+  shared->shared_win = sh;
+
+  if (conn != NULL) {
+    p4est_connectivity_destroy (conn);
+  }
+  P4EST_ASSERT (p4est_connectivity_is_valid (shared));
+
+  return shared;
+#else
+  /* without MPI-3 windows every process keeps its own copy */
+  SC_CHECK_ABORT (conn != NULL, P4EST_STRING
+                  "_connectivity_share without MPI-3 requires"
+                  " a connectivity on every process");
+
+  return conn;
+#endif
+}
+
+/** Free the implicit brick description of a connectivity if present. */
+static void
+brick_descriptor_reset (p4est_connectivity_t * conn)
+{
+  if (conn->brick != NULL) {
+    P4EST_FREE (conn->brick->linear_to_tree);
+    P4EST_FREE (conn->brick->tree_to_linear);
+    P4EST_FREE (conn->brick);
+    conn->brick = NULL;
+  }
+}
+
 void
 p4est_connectivity_destroy (p4est_connectivity_t * conn)
 {
+#ifdef P4EST_CONNECTIVITY_SHARED
+  if (conn->shared_win != NULL) {
+    int                 mpiret;
+    p4est_connectivity_shared_t *sh =
+      (p4est_connectivity_shared_t *) conn->shared_win;
+
+    /* all arrays live inside the window and are freed along with it */
+    mpiret = MPI_Win_free (&sh->win);
+    SC_CHECK_MPI (mpiret);
+    mpiret = MPI_Comm_free (&sh->intranode);
+    SC_CHECK_MPI (mpiret);
+    P4EST_FREE (sh);
+    P4EST_FREE (conn);
+    return;
+  }
+#endif
+  P4EST_ASSERT (conn->shared_win == NULL);
+
+  if (conn->mapped != NULL) {
+    p4est_connectivity_mapped_t *m =
+      (p4est_connectivity_mapped_t *) conn->mapped;
+
+    /* all arrays live inside the mapping and are released along with it */
+#ifdef P4EST_HAVE_MMAP
+    SC_CHECK_ABORT (munmap (m->map_base, m->map_length) == 0,
+                    "munmap connectivity");
+#else
+    P4EST_FREE (m->map_base);
+#endif
+    P4EST_FREE (m);
+    P4EST_FREE (conn);
+    return;
+  }
+
   P4EST_FREE (conn->vertices);
   P4EST_FREE (conn->tree_to_vertex);
 
@@ -236,6 +567,8 @@ p4est_connectivity_destroy (p4est_connectivity_t * conn)
   P4EST_FREE (conn->corner_to_tree);
   P4EST_FREE (conn->corner_to_corner);
 
+  brick_descriptor_reset (conn);
+
   p4est_connectivity_set_attr (conn, 0);
 
   P4EST_FREE (conn);
@@ -771,6 +1104,136 @@ p4est_connectivity_save (const char *filename, p4est_connectivity_t * conn)
   return retval;
 }
 
+/** Write a connectivity in the memory-mappable layout to a sink.
+ * The arrays follow the header in the exact order and packing computed
+ * by p4est_connectivity_block_layout, so the file body is bytewise
+ * identical to the in-memory block used for shared memory.
+ * \return              0 on success, nonzero on error.
+ */
+static int
+p4est_connectivity_sink_mapped (p4est_connectivity_t * conn,
+                                sc_io_sink_t * sink)
+{
+  int                 retval;
+  int                 has_tree_attr;
+  char                magic8[8 + 1];
+  char                pkgversion24[24 + 1];
+  size_t              u64z, topsize, int8size;
+  size_t              tcount;
+  uint64_t            array10[10];
+  p4est_topidx_t      num_vertices, num_trees;
+  p4est_topidx_t      num_edges, num_ett, num_corners, num_ctt;
+
+  P4EST_ASSERT (p4est_connectivity_is_valid (conn));
+
+  retval = 0;
+  num_vertices = conn->num_vertices;
+  num_trees = conn->num_trees;
+#ifdef P4_TO_P8
+  num_edges = conn->num_edges;
+  num_ett = conn->ett_offset[num_edges];
+#else
+  num_edges = num_ett = 0;
+#endif
+  num_corners = conn->num_corners;
+  num_ctt = conn->ctt_offset[num_corners];
+  has_tree_attr = (conn->tree_to_attr != NULL);
+
+  strncpy (magic8, P4EST_STRING, 8);
+  magic8[8] = '\0';
+  retval = retval || sc_io_sink_write (sink, magic8, 8);
+
+  strncpy (pkgversion24, P4EST_PACKAGE_VERSION, 24);
+  pkgversion24[24] = '\0';
+  retval = retval || sc_io_sink_write (sink, pkgversion24, 24);
+
+  u64z = sizeof (uint64_t);
+  topsize = sizeof (p4est_topidx_t);
+  int8size = sizeof (int8_t);
+  array10[0] = P4EST_ONDISK_FORMAT_MAPPED;
+  array10[1] = (uint64_t) topsize;
+  array10[2] = (uint64_t) num_vertices;
+  array10[3] = (uint64_t) num_trees;
+  array10[4] = (uint64_t) num_edges;
+  array10[5] = (uint64_t) num_ett;
+  array10[6] = (uint64_t) num_corners;
+  array10[7] = (uint64_t) num_ctt;
+  array10[8] = (uint64_t) has_tree_attr;
+  array10[9] = (uint64_t) 0;
+  retval = retval || sc_io_sink_write (sink, array10, 10 * u64z);
+
+  /* doubles first, then p4est_topidx_t and last int8_t arrays */
+  if (num_vertices > 0) {
+    tcount = (size_t) (3 * num_vertices);
+    retval = retval ||
+      sc_io_sink_write (sink, conn->vertices, tcount * sizeof (double));
+    tcount = (size_t) (P4EST_CHILDREN * num_trees);
+    retval = retval ||
+      sc_io_sink_write (sink, conn->tree_to_vertex, tcount * topsize);
+  }
+  tcount = (size_t) (P4EST_FACES * num_trees);
+  retval = retval ||
+    sc_io_sink_write (sink, conn->tree_to_tree, tcount * topsize);
+#ifdef P4_TO_P8
+  if (num_edges > 0) {
+    tcount = (size_t) (P8EST_EDGES * num_trees);
+    retval = retval ||
+      sc_io_sink_write (sink, conn->tree_to_edge, tcount * topsize) ||
+      sc_io_sink_write (sink, conn->edge_to_tree, topsize * num_ett);
+  }
+  retval = retval || sc_io_sink_write (sink, conn->ett_offset,
+                                       topsize * (num_edges + 1));
+#endif
+  if (num_corners > 0) {
+    tcount = (size_t) (P4EST_CHILDREN * num_trees);
+    retval = retval ||
+      sc_io_sink_write (sink, conn->tree_to_corner, tcount * topsize) ||
+      sc_io_sink_write (sink, conn->corner_to_tree, topsize * num_ctt);
+  }
+  retval = retval || sc_io_sink_write (sink, conn->ctt_offset,
+                                       topsize * (num_corners + 1));
+  tcount = (size_t) (P4EST_FACES * num_trees);
+  retval = retval ||
+    sc_io_sink_write (sink, conn->tree_to_face, tcount * int8size);
+#ifdef P4_TO_P8
+  if (num_edges > 0) {
+    retval = retval ||
+      sc_io_sink_write (sink, conn->edge_to_edge, int8size * num_ett);
+  }
+#endif
+  if (num_corners > 0) {
+    retval = retval ||
+      sc_io_sink_write (sink, conn->corner_to_corner, int8size * num_ctt);
+  }
+  if (has_tree_attr) {
+    tcount = (size_t) num_trees;
+    retval = retval ||
+      sc_io_sink_write (sink, conn->tree_to_attr, tcount * int8size);
+  }
+
+  return retval;
+}
+
+int
+p4est_connectivity_save_mapped (const char *filename,
+                                p4est_connectivity_t * conn)
+{
+  int                 retval;
+  sc_io_sink_t       *sink;
+
+  sink = sc_io_sink_new (SC_IO_TYPE_FILENAME, SC_IO_MODE_WRITE,
+                         SC_IO_ENCODE_NONE, filename);
+  if (sink == NULL) {
+    return -1;
+  }
+
+  /* Close file even on earlier write error */
+  retval = p4est_connectivity_sink_mapped (conn, sink);
+  retval = sc_io_sink_destroy (sink) || retval;
+
+  return retval;
+}
+
 p4est_connectivity_t *
 p4est_connectivity_source (sc_io_source_t * source)
 {
@@ -1043,6 +1506,386 @@ p4est_connectivity_load (const char *filename, size_t * bytes)
   return conn;
 }
 
+p4est_connectivity_t *
+p4est_connectivity_load_mapped (const char *filename)
+{
+  const size_t        header_size = 8 + 24 + 10 * sizeof (uint64_t);
+  int                 has_tree_attr;
+  char               *base;
+  size_t              length, zb;
+  uint64_t            array10[10];
+  p4est_topidx_t      num_vertices, num_trees;
+  p4est_topidx_t      num_edges, num_ett, num_corners, num_ctt;
+  p4est_connectivity_mapped_t *m;
+  p4est_connectivity_t *conn;
+#ifdef P4EST_HAVE_MMAP
+  int                 fd;
+  struct stat         st;
+
+  fd = open (filename, O_RDONLY);
+  if (fd < 0) {
+    return NULL;
+  }
+  if (fstat (fd, &st) != 0 || (size_t) st.st_size < header_size) {
+    close (fd);
+    return NULL;
+  }
+  length = (size_t) st.st_size;
+  base = (char *) mmap (NULL, length, PROT_READ, MAP_SHARED, fd, 0);
+  close (fd);
+  if (base == (char *) MAP_FAILED) {
+    return NULL;
+  }
+#else
+  long                fsize;
+  FILE               *file;
+
+  file = fopen (filename, "rb");
+  if (file == NULL) {
+    return NULL;
+  }
+  if (fseek (file, 0, SEEK_END) != 0 || (fsize = ftell (file)) < 0 ||
+      (size_t) fsize < header_size || fseek (file, 0, SEEK_SET) != 0) {
+    fclose (file);
+    return NULL;
+  }
+  length = (size_t) fsize;
+  base = P4EST_ALLOC (char, length);
+  if (fread (base, 1, length, file) != length) {
+    P4EST_FREE (base);
+    fclose (file);
+    return NULL;
+  }
+  fclose (file);
+#endif
+
+  /* verify the header against this configuration */
+  memcpy (array10, base + 8 + 24, 10 * sizeof (uint64_t));
+  if (!strncmp (base, P4EST_STRING, 8) &&
+      array10[0] == P4EST_ONDISK_FORMAT_MAPPED &&
+      array10[1] == (uint64_t) sizeof (p4est_topidx_t)) {
+    num_vertices = (p4est_topidx_t) array10[2];
+    num_trees = (p4est_topidx_t) array10[3];
+    num_edges = (p4est_topidx_t) array10[4];
+    num_ett = (p4est_topidx_t) array10[5];
+    num_corners = (p4est_topidx_t) array10[6];
+    num_ctt = (p4est_topidx_t) array10[7];
+    has_tree_attr = (int) (array10[8] & 1);
+    if (num_vertices >= 0 && num_trees >= 0 &&
+        num_corners >= 0 && num_ctt >= 0 &&
+#ifdef P4_TO_P8
+        num_edges >= 0 && num_ett >= 0
+#else
+        num_edges == 0 && num_ett == 0
+#endif
+      ) {
+      conn = P4EST_ALLOC_ZERO (p4est_connectivity_t, 1);
+      conn->num_vertices = num_vertices;
+      conn->num_trees = num_trees;
+      conn->num_corners = num_corners;
+#ifdef P4_TO_P8
+      conn->num_edges = num_edges;
+#endif
+      zb = p4est_connectivity_block_layout (conn,
+#ifdef P4_TO_P8
+                                            num_ett,
+#endif
+                                            num_ctt, has_tree_attr, NULL);
+      if (header_size + zb == length) {
+        /* the arrays point into the read-only file contents */
+        (void) p4est_connectivity_block_layout (conn,
+#ifdef P4_TO_P8
+                                                num_ett,
+#endif
+                                                num_ctt, has_tree_attr,
+                                                base + header_size);
+        m = P4EST_ALLOC (p4est_connectivity_mapped_t, 1);
+        m->map_base = base;
+        m->map_length = length;
+        conn->mapped = m;
+
+        P4EST_ASSERT (p4est_connectivity_is_valid (conn));
+        return conn;
+      }
+      /* "file length mismatch" */
+      P4EST_FREE (conn);
+    }
+  }
+
+  /* the header did not check out: release the file contents */
+#ifdef P4EST_HAVE_MMAP
+  (void) munmap (base, length);
+#else
+  P4EST_FREE (base);
+#endif
+  return NULL;
+}
+
+/* one cached record of a tree outside the resident window */
+typedef struct p4est_connectivity_window_slot
+{
+  p4est_topidx_t      tree;     /* cached tree number or -1 */
+  long                stamp;    /* last access for LRU eviction */
+  p4est_topidx_t      tree_to_tree[P4EST_FACES];
+  p4est_topidx_t      tree_to_vertex[P4EST_CHILDREN];
+  int8_t              tree_to_face[P4EST_FACES];
+}
+p4est_connectivity_window_slot_t;
+
+struct p4est_connectivity_window
+{
+  FILE               *file;
+  p4est_topidx_t      num_trees;
+  p4est_topidx_t      num_vertices;
+  size_t              offset_ttv;       /* 0 when the file has no vertices */
+  size_t              offset_ttt;
+  size_t              offset_ttf;
+  p4est_topidx_t      first_tree;       /* resident window, inclusive */
+  p4est_topidx_t      last_tree;
+  p4est_topidx_t     *window_ttt;
+  p4est_topidx_t     *window_ttv;       /* NULL without vertices */
+  int8_t             *window_ttf;
+  int                 num_slots;
+  long                stamp;
+  p4est_connectivity_window_slot_t *slots;
+};
+
+/* read one tree's face and vertex records from the file */
+static int
+p4est_connectivity_window_read (p4est_connectivity_window_t * w,
+                                p4est_topidx_t tree,
+                                p4est_topidx_t * ttt, int8_t * ttf,
+                                p4est_topidx_t * ttv)
+{
+  const size_t        topsize = sizeof (p4est_topidx_t);
+
+  if (fseek (w->file, (long) (w->offset_ttt +
+                              P4EST_FACES * (size_t) tree * topsize),
+             SEEK_SET) != 0 ||
+      fread (ttt, topsize, P4EST_FACES, w->file) != P4EST_FACES) {
+    return -1;
+  }
+  if (fseek (w->file, (long) (w->offset_ttf +
+                              P4EST_FACES * (size_t) tree *
+                              sizeof (int8_t)), SEEK_SET) != 0 ||
+      fread (ttf, sizeof (int8_t), P4EST_FACES, w->file) != P4EST_FACES) {
+    return -1;
+  }
+  if (ttv != NULL) {
+    if (fseek (w->file, (long) (w->offset_ttv +
+                                P4EST_CHILDREN * (size_t) tree * topsize),
+               SEEK_SET) != 0 ||
+        fread (ttv, topsize, P4EST_CHILDREN, w->file) != P4EST_CHILDREN) {
+      return -1;
+    }
+  }
+  return 0;
+}
+
+p4est_connectivity_window_t *
+p4est_connectivity_window_open (const char *filename,
+                                p4est_topidx_t first_tree,
+                                p4est_topidx_t last_tree, int num_slots)
+{
+  const size_t        header_size = 8 + 24 + 10 * sizeof (uint64_t);
+  const size_t        topsize = sizeof (p4est_topidx_t);
+  int                 i;
+  int                 has_tree_attr;
+  char                head[8 + 24];
+  size_t              off;
+  uint64_t            array10[10];
+  p4est_topidx_t      num_vertices, num_trees;
+  p4est_topidx_t      num_edges, num_ett, num_corners, num_ctt;
+  p4est_topidx_t      wcount;
+  p4est_connectivity_window_t *w;
+  FILE               *file;
+
+  file = fopen (filename, "rb");
+  if (file == NULL) {
+    return NULL;
+  }
+  if (fread (head, 1, 8 + 24, file) != 8 + 24 ||
+      fread (array10, sizeof (uint64_t), 10, file) != 10 ||
+      strncmp (head, P4EST_STRING, 8) ||
+      array10[0] != P4EST_ONDISK_FORMAT_MAPPED ||
+      array10[1] != (uint64_t) topsize) {
+    fclose (file);
+    return NULL;
+  }
+  num_vertices = (p4est_topidx_t) array10[2];
+  num_trees = (p4est_topidx_t) array10[3];
+  num_edges = (p4est_topidx_t) array10[4];
+  num_ett = (p4est_topidx_t) array10[5];
+  num_corners = (p4est_topidx_t) array10[6];
+  num_ctt = (p4est_topidx_t) array10[7];
+  has_tree_attr = (int) (array10[8] & 1);
+  (void) has_tree_attr;
+  if (num_trees <= 0 || first_tree < 0 || last_tree >= num_trees ||
+      first_tree > last_tree) {
+    fclose (file);
+    return NULL;
+  }
+
+  w = P4EST_ALLOC_ZERO (p4est_connectivity_window_t, 1);
+  w->file = file;
+  w->num_trees = num_trees;
+  w->num_vertices = num_vertices;
+
+  /* walk the mapped block layout up to the arrays we serve */
+  off = header_size;
+  if (num_vertices > 0) {
+    off += 3 * (size_t) num_vertices * sizeof (double);
+    w->offset_ttv = off;
+    off += P4EST_CHILDREN * (size_t) num_trees * topsize;
+  }
+  w->offset_ttt = off;
+  off += P4EST_FACES * (size_t) num_trees * topsize;
+#ifdef P4_TO_P8
+  if (num_edges > 0) {
+    off += P8EST_EDGES * (size_t) num_trees * topsize;
+    off += (size_t) num_ett * topsize;
+  }
+  off += ((size_t) num_edges + 1) * topsize;
+#else
+  (void) num_edges;
+  (void) num_ett;
+#endif
+  if (num_corners > 0) {
+    off += P4EST_CHILDREN * (size_t) num_trees * topsize;
+    off += (size_t) num_ctt * topsize;
+  }
+  off += ((size_t) num_corners + 1) * topsize;
+  w->offset_ttf = off;
+
+  /* the resident window is read in bulk, once */
+  w->first_tree = first_tree;
+  w->last_tree = last_tree;
+  wcount = last_tree - first_tree + 1;
+  w->window_ttt = P4EST_ALLOC (p4est_topidx_t, P4EST_FACES * wcount);
+  w->window_ttf = P4EST_ALLOC (int8_t, P4EST_FACES * wcount);
+  w->window_ttv = num_vertices > 0 ?
+    P4EST_ALLOC (p4est_topidx_t, P4EST_CHILDREN * wcount) : NULL;
+  if (fseek (file, (long) (w->offset_ttt +
+                           P4EST_FACES * (size_t) first_tree * topsize),
+             SEEK_SET) != 0 ||
+      fread (w->window_ttt, topsize, P4EST_FACES * (size_t) wcount,
+             file) != P4EST_FACES * (size_t) wcount ||
+      fseek (file, (long) (w->offset_ttf +
+                           P4EST_FACES * (size_t) first_tree *
+                           sizeof (int8_t)), SEEK_SET) != 0 ||
+      fread (w->window_ttf, sizeof (int8_t),
+             P4EST_FACES * (size_t) wcount, file) !=
+      P4EST_FACES * (size_t) wcount ||
+      (w->window_ttv != NULL &&
+       (fseek (file, (long) (w->offset_ttv +
+                             P4EST_CHILDREN * (size_t) first_tree *
+                             topsize), SEEK_SET) != 0 ||
+        fread (w->window_ttv, topsize,
+               P4EST_CHILDREN * (size_t) wcount, file) !=
+        P4EST_CHILDREN * (size_t) wcount))) {
+    p4est_connectivity_window_close (w);
+    return NULL;
+  }
+
+  /* a small pool of slots caches trees fetched outside the window */
+  w->num_slots = num_slots > 0 ? num_slots : 64;
+  w->stamp = 0;
+  w->slots = P4EST_ALLOC (p4est_connectivity_window_slot_t, w->num_slots);
+  for (i = 0; i < w->num_slots; ++i) {
+    w->slots[i].tree = -1;
+    w->slots[i].stamp = -1;
+  }
+
+  P4EST_VERBOSEF ("Connectivity window %lld trees of %lld cache %d\n",
+                  (long long) wcount, (long long) num_trees, w->num_slots);
+
+  return w;
+}
+
+/* serve a tree from the window or the cache, fetching it on a miss */
+static p4est_connectivity_window_slot_t *
+p4est_connectivity_window_fetch (p4est_connectivity_window_t * w,
+                                 p4est_topidx_t tree)
+{
+  int                 i, victim;
+  p4est_connectivity_window_slot_t *slot;
+
+  P4EST_ASSERT (tree < w->first_tree || tree > w->last_tree);
+
+  victim = 0;
+  for (i = 0; i < w->num_slots; ++i) {
+    if (w->slots[i].tree == tree) {
+      w->slots[i].stamp = ++w->stamp;
+      return &w->slots[i];
+    }
+    if (w->slots[i].stamp < w->slots[victim].stamp) {
+      victim = i;
+    }
+  }
+
+  /* evict the least recently used slot */
+  slot = &w->slots[victim];
+  slot->tree = tree;
+  slot->stamp = ++w->stamp;
+  SC_CHECK_ABORT (p4est_connectivity_window_read
+                  (w, tree, slot->tree_to_tree, slot->tree_to_face,
+                   w->num_vertices > 0 ? slot->tree_to_vertex : NULL) == 0,
+                  "connectivity window read");
+
+  return slot;
+}
+
+const p4est_topidx_t *
+p4est_connectivity_window_tree_to_tree (p4est_connectivity_window_t * w,
+                                        p4est_topidx_t tree)
+{
+  P4EST_ASSERT (0 <= tree && tree < w->num_trees);
+
+  if (w->first_tree <= tree && tree <= w->last_tree) {
+    return w->window_ttt + P4EST_FACES * (size_t) (tree - w->first_tree);
+  }
+  return p4est_connectivity_window_fetch (w, tree)->tree_to_tree;
+}
+
+const int8_t       *
+p4est_connectivity_window_tree_to_face (p4est_connectivity_window_t * w,
+                                        p4est_topidx_t tree)
+{
+  P4EST_ASSERT (0 <= tree && tree < w->num_trees);
+
+  if (w->first_tree <= tree && tree <= w->last_tree) {
+    return w->window_ttf + P4EST_FACES * (size_t) (tree - w->first_tree);
+  }
+  return p4est_connectivity_window_fetch (w, tree)->tree_to_face;
+}
+
+const p4est_topidx_t *
+p4est_connectivity_window_tree_to_vertex (p4est_connectivity_window_t * w,
+                                          p4est_topidx_t tree)
+{
+  P4EST_ASSERT (0 <= tree && tree < w->num_trees);
+
+  if (w->num_vertices == 0) {
+    return NULL;
+  }
+  if (w->first_tree <= tree && tree <= w->last_tree) {
+    return w->window_ttv +
+      P4EST_CHILDREN * (size_t) (tree - w->first_tree);
+  }
+  return p4est_connectivity_window_fetch (w, tree)->tree_to_vertex;
+}
+
+void
+p4est_connectivity_window_close (p4est_connectivity_window_t * w)
+{
+  fclose (w->file);
+  P4EST_FREE (w->window_ttt);
+  P4EST_FREE (w->window_ttf);
+  P4EST_FREE (w->window_ttv);
+  P4EST_FREE (w->slots);
+  P4EST_FREE (w);
+}
+
 #ifndef P4_TO_P8
 
 p4est_connectivity_t *
@@ -1506,6 +2349,8 @@ p8est_connectivity_new_brick (int mi, int ni, int pi, int periodic_a,
   p4est_topidx_t      tf[P4EST_FACES], tc[P4EST_CHILDREN];
   p4est_topidx_t      coord[P4EST_DIM], coord2[P4EST_DIM], ttemp;
   p4est_topidx_t     *linear_to_tree;
+  p4est_topidx_t     *tree_to_linear;
+  p4est_brick_t      *brick;
   p4est_topidx_t     *tree_to_corner2;
   p4est_topidx_t      vcount = 0, vicount = 0;
   int                 c[P4EST_DIM];
@@ -1592,6 +2437,7 @@ p8est_connectivity_new_brick (int mi, int ni, int pi, int periodic_a,
 #endif
 
   linear_to_tree = P4EST_ALLOC (p4est_topidx_t, n_iter);
+  tree_to_linear = P4EST_ALLOC (p4est_topidx_t, num_trees);
   tree_to_corner2 = P4EST_ALLOC (p4est_topidx_t, num_trees);
 #ifdef P4_TO_P8
   tree_to_edge2 = P4EST_ALLOC (p4est_topidx_t, 3 * num_trees);
@@ -1615,6 +2461,7 @@ p8est_connectivity_new_brick (int mi, int ni, int pi, int periodic_a,
 #endif
         1) {
       linear_to_tree[ti] = tj;
+      tree_to_linear[tj] = ti;
       if ((tx < m - 1 || periodic_a) && (ty < n - 1 || periodic_b) &&
 #ifdef P4_TO_P8
           (tz < p - 1 || periodic_c) &&
@@ -1874,17 +2721,99 @@ p8est_connectivity_new_brick (int mi, int ni, int pi, int periodic_a,
 
   P4EST_ASSERT (vcount == num_vertices);
 
-  P4EST_FREE (linear_to_tree);
   P4EST_FREE (tree_to_corner2);
 #ifdef P4_TO_P8
   P4EST_FREE (tree_to_edge2);
 #endif
 
+  /* hand the lookup arrays to the implicit topology descriptor */
+  brick = P4EST_ALLOC (p4est_brick_t, 1);
+  brick->nxyz[0] = m;
+  brick->nxyz[1] = n;
+#ifdef P4_TO_P8
+  brick->nxyz[2] = p;
+#endif
+  for (i = 0; i < P4EST_DIM; i++) {
+    brick->periodic[i] = periodic[i];
+    brick->logx[i] = logx[i];
+    brick->rankx[i] = rankx[i];
+  }
+  brick->linear_to_tree = linear_to_tree;
+  brick->tree_to_linear = tree_to_linear;
+  conn->brick = brick;
+
   P4EST_ASSERT (p4est_connectivity_is_valid (conn));
 
   return conn;
 }
 
+void
+p4est_brick_tree_coordinates (const p4est_connectivity_t * conn,
+                              p4est_topidx_t itree,
+                              p4est_topidx_t coord[P4EST_DIM])
+{
+  const p4est_brick_t *brick = conn->brick;
+
+  P4EST_ASSERT (brick != NULL);
+  P4EST_ASSERT (0 <= itree && itree < conn->num_trees);
+
+  brick_linear_to_xyz (brick->tree_to_linear[itree],
+                       brick->logx, brick->rankx, coord);
+}
+
+p4est_topidx_t
+p4est_brick_tree_index (const p4est_connectivity_t * conn,
+                        const p4est_topidx_t coord[P4EST_DIM])
+{
+  const p4est_brick_t *brick = conn->brick;
+  p4est_topidx_t      ti, itree;
+#ifdef P4EST_DEBUG
+  int                 i;
+#endif
+
+  P4EST_ASSERT (brick != NULL);
+#ifdef P4EST_DEBUG
+  for (i = 0; i < P4EST_DIM; i++) {
+    P4EST_ASSERT (0 <= coord[i] && coord[i] < brick->nxyz[i]);
+  }
+#endif
+
+  ti = brick_xyz_to_linear (coord, brick->logx, brick->rankx);
+  itree = brick->linear_to_tree[ti];
+  P4EST_ASSERT (0 <= itree && itree < conn->num_trees);
+
+  return itree;
+}
+
+p4est_topidx_t
+p4est_brick_face_neighbor (const p4est_connectivity_t * conn,
+                           p4est_topidx_t itree, int iface, int *nface)
+{
+  const p4est_brick_t *brick = conn->brick;
+  int                 i, j;
+  p4est_topidx_t      coord[P4EST_DIM];
+
+  P4EST_ASSERT (brick != NULL);
+  P4EST_ASSERT (0 <= itree && itree < conn->num_trees);
+  P4EST_ASSERT (0 <= iface && iface < P4EST_FACES);
+
+  i = iface / 2;
+  j = iface & 1;
+  p4est_brick_tree_coordinates (conn, itree, coord);
+  if (!brick->periodic[i] &&
+      ((coord[i] == 0 && j == 0) ||
+       (coord[i] == brick->nxyz[i] - 1 && j == 1))) {
+    /* this face lies on the physical domain boundary */
+    return -1;
+  }
+  coord[i] = (coord[i] + (2 * j - 1) + brick->nxyz[i]) % brick->nxyz[i];
+  if (nface != NULL) {
+    *nface = iface ^ 1;
+  }
+
+  return p4est_brick_tree_index (conn, coord);
+}
+
 typedef struct
 {
   p4est_topidx_t      key[P4EST_HALF];
@@ -1988,17 +2917,29 @@ p4est_find_face_transform (p4est_connectivity_t * connectivity,
   P4EST_ASSERT (itree >= 0 && itree < connectivity->num_trees);
   P4EST_ASSERT (iface >= 0 && iface < P4EST_FACES);
 
-  target_tree = connectivity->tree_to_tree[P4EST_FACES * itree + iface];
-  target_code = (int) connectivity->tree_to_face[P4EST_FACES * itree + iface];
-  target_face = target_code % P4EST_FACES;
-  orientation = target_code / P4EST_FACES;
-
-  P4EST_ASSERT (0 <= target_face && target_face < P4EST_FACES);
-  P4EST_ASSERT (0 <= orientation && orientation < P4EST_HALF);
-
-  if (target_tree == itree && target_face == iface) {
-    P4EST_ASSERT (orientation == 0);
-    return -1;
+  if (connectivity->brick != NULL) {
+    /* compute the neighbor arithmetically without touching the tables */
+    target_tree = p4est_brick_face_neighbor (connectivity, itree, iface,
+                                             &target_face);
+    if (target_tree == -1) {
+      return -1;
+    }
+    orientation = 0;
+  }
+  else {
+    target_tree = connectivity->tree_to_tree[P4EST_FACES * itree + iface];
+    target_code =
+      (int) connectivity->tree_to_face[P4EST_FACES * itree + iface];
+    target_face = target_code % P4EST_FACES;
+    orientation = target_code / P4EST_FACES;
+
+    P4EST_ASSERT (0 <= target_face && target_face < P4EST_FACES);
+    P4EST_ASSERT (0 <= orientation && orientation < P4EST_HALF);
+
+    if (target_tree == itree && target_face == iface) {
+      P4EST_ASSERT (orientation == 0);
+      return -1;
+    }
   }
 
 #ifdef P4_TO_P8
@@ -2224,26 +3165,64 @@ p4est_find_corner_transform (p4est_connectivity_t * conn,
   /* check if this corner exists at all */
   ci->icorner = (int8_t) icorner;
   sc_array_resize (cta, 0);
-  if (conn->num_corners == 0) {
-    return;
-  }
-  acorner = conn->tree_to_corner[P4EST_CHILDREN * itree + icorner];
-  if (acorner == -1) {
-    return;
-  }
-  P4EST_ASSERT (0 <= acorner && acorner < conn->num_corners);
+  if (conn->brick != NULL) {
+    const p4est_brick_t *brick = conn->brick;
+    int                 i, k;
+    p4est_topidx_t      coord[P4EST_DIM], vert[P4EST_DIM];
+    p4est_topidx_t      ncoord[P4EST_DIM];
+    p4est_topidx_t      bctt[P4EST_CHILDREN];
+    int8_t              bctc[P4EST_CHILDREN];
+
+    /* determine the grid vertex underneath this tree corner */
+    p4est_brick_tree_coordinates (conn, itree, coord);
+    for (i = 0; i < P4EST_DIM; i++) {
+      vert[i] = coord[i] + ((icorner >> i) & 1);
+      if (!brick->periodic[i] &&
+          (vert[i] == 0 || vert[i] == brick->nxyz[i])) {
+        /* this corner lies on the physical domain boundary */
+        return;
+      }
+    }
 
-  /* retrieve connectivity information for this corner */
-  cttac = conn->ctt_offset[acorner];
-  corner_trees = conn->ctt_offset[acorner + 1] - cttac;
-  P4EST_ASSERT (0 <= cttac && 1 <= corner_trees);
+    /* enumerate the trees around the vertex in corner_to_tree order */
+    for (k = 0; k < P4EST_CHILDREN; k++) {
+      for (i = 0; i < P4EST_DIM; i++) {
+        ncoord[i] = (vert[i] - 1 + ((k >> i) & 1) +
+                     brick->nxyz[i]) % brick->nxyz[i];
+      }
+      bctt[k] = p4est_brick_tree_index (conn, ncoord);
+      bctc[k] = (int8_t) ((P4EST_CHILDREN - 1) ^ k);
+    }
+    corner_trees = P4EST_CHILDREN;
 
-  /* loop through all corner neighbors and find corner connections */
-  ignored = p4est_find_corner_transform_internal (conn, itree, icorner, ci,
-                                                  conn->corner_to_tree +
-                                                  cttac,
-                                                  conn->corner_to_corner +
-                                                  cttac, corner_trees, ntree);
+    /* loop through all corner neighbors and find corner connections */
+    ignored = p4est_find_corner_transform_internal (conn, itree, icorner, ci,
+                                                    bctt, bctc, corner_trees,
+                                                    ntree);
+  }
+  else {
+    if (conn->num_corners == 0) {
+      return;
+    }
+    acorner = conn->tree_to_corner[P4EST_CHILDREN * itree + icorner];
+    if (acorner == -1) {
+      return;
+    }
+    P4EST_ASSERT (0 <= acorner && acorner < conn->num_corners);
+
+    /* retrieve connectivity information for this corner */
+    cttac = conn->ctt_offset[acorner];
+    corner_trees = conn->ctt_offset[acorner + 1] - cttac;
+    P4EST_ASSERT (0 <= cttac && 1 <= corner_trees);
+
+    /* loop through all corner neighbors and find corner connections */
+    ignored = p4est_find_corner_transform_internal (conn, itree, icorner, ci,
+                                                    conn->corner_to_tree +
+                                                    cttac,
+                                                    conn->corner_to_corner +
+                                                    cttac, corner_trees,
+                                                    ntree);
+  }
 #ifdef P4EST_DEBUG
   expected_count = cta->elem_count + 1 + (ntree[0] != -1) + (ntree[1] != -1);
 #ifdef P4_TO_P8
@@ -2299,6 +3278,9 @@ p4est_connectivity_complete (p4est_connectivity_t * conn)
 
   P4EST_ASSERT (p4est_connectivity_is_valid (conn));
 
+  /* reconnecting the trees invalidates the implicit brick description */
+  brick_descriptor_reset (conn);
+
   /* prepare data structures and remove previous connectivity information */
   face_ha = sc_hash_array_new (sizeof (p4est_conn_face_info_t),
                                p4est_conn_face_hash, p4est_conn_face_equal,
@@ -2711,6 +3693,9 @@ p4est_connectivity_permute (p4est_connectivity_t * conn, sc_array_t * inperm,
   sc_array_t          array_view;
   int                 j;
 
+  /* renumbering the trees invalidates the implicit brick description */
+  brick_descriptor_reset (conn);
+
   /* we want the permutation to be the current to new map, not
    * the new to current map */
   if (is_current_to_new) {
@@ -2797,6 +3782,104 @@ p4est_connectivity_permute (p4est_connectivity_t * conn, sc_array_t * inperm,
   }
 }
 
+static int
+reorder_sfc_comp (const void *a, const void *b)
+{
+  const uint64_t     *A = (const uint64_t *) a;
+  const uint64_t     *B = (const uint64_t *) b;
+
+  if (A[0] < B[0]) {
+    return -1;
+  }
+  else if (B[0] < A[0]) {
+    return 1;
+  }
+  else {
+    /* equal keys are ordered by the original tree number */
+    return A[1] < B[1] ? -1 : A[1] > B[1] ? 1 : 0;
+  }
+}
+
+void
+p4est_connectivity_reorder_sfc (p4est_connectivity_t * conn)
+{
+  /* per-axis resolution of the coarse curve; the keys stay within 63 bits */
+  const int           bits = 63 / P4EST_DIM;
+  int                 b, d, j;
+  size_t             *zp;
+  double              lo[3], hi[3], range, frac;
+  double              centroid[3];
+  uint64_t            coord, key;
+  uint64_t           *up;
+  const double       *vp;
+  p4est_topidx_t      ti, vt, ntrees = conn->num_trees;
+  sc_array_t         *sorter, *newid;
+
+  P4EST_ASSERT (p4est_connectivity_is_valid (conn));
+  SC_CHECK_ABORT (conn->num_vertices > 0 && conn->vertices != NULL,
+                  P4EST_STRING
+                  "_connectivity_reorder_sfc requires vertex information");
+
+  /* compute tree centroids and their bounding box */
+  sorter = sc_array_new_size (2 * sizeof (uint64_t), (size_t) ntrees);
+  lo[0] = lo[1] = lo[2] = DBL_MAX;
+  hi[0] = hi[1] = hi[2] = -DBL_MAX;
+  for (ti = 0; ti < ntrees; ti++) {
+    for (j = 0; j < P4EST_CHILDREN; j++) {
+      vt = conn->tree_to_vertex[P4EST_CHILDREN * ti + j];
+      vp = conn->vertices + 3 * vt;
+      for (d = 0; d < P4EST_DIM; d++) {
+        lo[d] = SC_MIN (lo[d], vp[d]);
+        hi[d] = SC_MAX (hi[d], vp[d]);
+      }
+    }
+  }
+
+  /* quantize each centroid and interleave the bits into a Morton key */
+  for (ti = 0; ti < ntrees; ti++) {
+    centroid[0] = centroid[1] = centroid[2] = 0.;
+    for (j = 0; j < P4EST_CHILDREN; j++) {
+      vt = conn->tree_to_vertex[P4EST_CHILDREN * ti + j];
+      vp = conn->vertices + 3 * vt;
+      for (d = 0; d < P4EST_DIM; d++) {
+        centroid[d] += vp[d];
+      }
+    }
+    key = 0;
+    for (d = 0; d < P4EST_DIM; d++) {
+      centroid[d] /= (double) P4EST_CHILDREN;
+      range = hi[d] - lo[d];
+      if (range > 0.) {
+        frac = (centroid[d] - lo[d]) / range;
+        coord = (uint64_t) (frac * (double) (((uint64_t) 1 << bits) - 1));
+      }
+      else {
+        coord = 0;
+      }
+      for (b = 0; b < bits; b++) {
+        key |= ((coord >> b) & 1) << (P4EST_DIM * b + d);
+      }
+    }
+    up = (uint64_t *) sc_array_index (sorter, ti);
+    up[0] = key;
+    up[1] = (uint64_t) ti;
+  }
+
+  /* sort the trees along the curve and build the current to new map */
+  sc_array_sort (sorter, reorder_sfc_comp);
+  newid = sc_array_new_size (sizeof (size_t), (size_t) ntrees);
+  for (ti = 0; ti < ntrees; ti++) {
+    up = (uint64_t *) sc_array_index (sorter, ti);
+    zp = (size_t *) sc_array_index (newid, (size_t) up[1]);
+    *zp = (size_t) ti;
+  }
+  sc_array_destroy (sorter);
+
+  p4est_connectivity_permute (conn, newid, 1);
+
+  sc_array_destroy (newid);
+}
+
 #ifdef P4EST_METIS
 static int
 reorder_comp (const void *a, const void *b)
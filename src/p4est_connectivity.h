@@ -53,6 +53,11 @@ SC_EXTERN_C_BEGIN;
  */
 #define P4EST_ONDISK_FORMAT 0x2000009
 
+/* Format number for the memory-mappable connectivity file layout.
+ * The file body matches the in-memory array layout byte for byte.
+ */
+#define P4EST_ONDISK_FORMAT_MAPPED 0x2100001
+
 /* Several functions involve relationships between neighboring trees and/or
  * quadrants, and their behavior depends on how one defines adjacency:
  * 1) entities are adjacent if they share a face, or
@@ -129,6 +134,29 @@ const char         *p4est_connect_type_string (p4est_connect_type_t btype);
  *
  * The *_to_attr arrays may have arbitrary contents defined by the user.
  */
+
+/** Implicit description of a brick of trees as created by
+ * \ref p4est_connectivity_new_brick.
+ * The trees form a regular nxyz[0] by nxyz[1] grid whose inter-tree
+ * neighbor relations can be computed arithmetically in O(1), so the
+ * accessor functions do not need to read the tree_to_* tables.
+ * The trees are numbered along a coordinatewise bit-interleaved curve;
+ * the two arrays below translate between tree numbers and positions
+ * on that curve padded to powers of two.
+ * This descriptor is not written by p4est_connectivity_save; a
+ * connectivity read back from disk falls back to the explicit tables.
+ */
+typedef struct p4est_brick
+{
+  p4est_topidx_t      nxyz[P4EST_DIM];  /**< number of trees per direction */
+  int                 periodic[P4EST_DIM];      /**< periodicity flags */
+  int                 logx[P4EST_DIM];  /**< bits used per direction */
+  int                 rankx[P4EST_DIM]; /**< directions ordered by bits */
+  p4est_topidx_t     *linear_to_tree;   /**< padded index to tree or -1 */
+  p4est_topidx_t     *tree_to_linear;   /**< tree to padded index */
+}
+p4est_brick_t;
+
 typedef struct p4est_connectivity
 {
   p4est_topidx_t      num_vertices;
@@ -146,6 +174,18 @@ typedef struct p4est_connectivity
   p4est_topidx_t     *ctt_offset;
   p4est_topidx_t     *corner_to_tree;
   int8_t             *corner_to_corner;
+
+  void               *shared_win;       /* if not NULL, all arrays live in
+                                           an MPI-3 shared memory window
+                                           described by this handle and the
+                                           connectivity is read-only */
+  void               *mapped;   /* if not NULL, all arrays point into a
+                                   read-only memory-mapped file described
+                                   by this handle */
+  p4est_brick_t      *brick;    /* if not NULL, the connectivity describes
+                                   a regular brick of trees and neighbor
+                                   relations are computed arithmetically
+                                   from this descriptor */
 }
 p4est_connectivity_t;
 
@@ -221,10 +261,33 @@ p4est_connectivity_t *p4est_connectivity_new_copy (p4est_topidx_t
                                                    const int8_t * ctc);
 
 /** Destroy a connectivity structure.  Also destroy all attributes.
+ * For a connectivity created by p4est_connectivity_share this call is
+ * collective over the communicator that was passed for sharing.
  */
 void                p4est_connectivity_destroy (p4est_connectivity_t *
                                                 connectivity);
 
+/** Move a connectivity into shared memory, one copy per compute node.
+ *
+ * This is a collective call over \a mpicomm.  The connectivity arrays
+ * are placed into an MPI-3 shared memory window so that all processes
+ * on a node read the same physical copy, which reduces the per-node
+ * footprint by the number of ranks per node.  Processes that do not
+ * hold the connectivity, e.g. after only one rank per node loaded it
+ * from disk, may pass NULL; at least one process per node must pass a
+ * valid connectivity and all non-NULL inputs must be identical.
+ * The input connectivity is destroyed and replaced by the shared view,
+ * which must be treated read-only and be destroyed collectively.
+ * Without MPI-3 shared window support the input connectivity is
+ * returned unchanged and must be valid on every process.
+ *
+ * \param [in] conn     A connectivity, or NULL on secondary processes.
+ * \param [in] mpicomm  Communicator whose processes share the result.
+ * \return              Connectivity backed by node-shared memory.
+ */
+p4est_connectivity_t *p4est_connectivity_share (p4est_connectivity_t * conn,
+                                                MPI_Comm mpicomm);
+
 /** Allocate or free the attribute fields in a connectivity.
  * \param [in,out] conn         The conn->*_to_attr fields must either be NULL
  *                              or previously be allocated by this function.
@@ -293,6 +356,82 @@ p4est_connectivity_t *p4est_connectivity_inflate (sc_array_t * buffer);
 p4est_connectivity_t *p4est_connectivity_load (const char *filename,
                                                size_t * bytes);
 
+/** Save a connectivity structure in the memory-mappable file layout.
+ * After a fixed-size header the arrays follow back to back in the order
+ * established for shared memory so the file body can be used in place.
+ * \param [in] filename         Name of the file to write.
+ * \param [in] connectivity     Valid connectivity structure.
+ * \return                      Returns 0 on success, nonzero on file error.
+ */
+int                 p4est_connectivity_save_mapped (const char *filename,
+                                                    p4est_connectivity_t *
+                                                    connectivity);
+
+/** Load a connectivity written by p4est_connectivity_save_mapped.
+ * Where the mmap system call is available the file is mapped read-only
+ * and the arrays point directly into the mapping, so all processes on a
+ * node share one physical copy through the page cache and no data is
+ * copied on load.  Otherwise the file is read into one memory block.
+ * The connectivity must not be modified and is destroyed as usual.
+ * Only the header is verified; the array contents are checked against
+ * p4est_connectivity_is_valid in debug mode only.
+ * \param [in] filename         Name of the file to map.
+ * \return              Returns valid connectivity, or NULL on file error.
+ */
+p4est_connectivity_t *p4est_connectivity_load_mapped (const char *filename);
+
+/** An opaque windowed reader over a file written by
+ * p4est_connectivity_save_mapped.  Only a contiguous window of tree
+ * records is resident in memory; trees outside the window are fetched
+ * from the file on demand through a small least-recently-used cache.
+ * Intended for connectivities too large to replicate on every rank:
+ * a rank opens its space-filling-curve window and pays file reads only
+ * for the occasional neighbor tree beyond it. */
+typedef struct p4est_connectivity_window p4est_connectivity_window_t;
+
+/** Open a windowed reader on a memory-mappable connectivity file.
+ * Reads the header and the tree records of [first_tree, last_tree]
+ * in bulk; everything else stays on disk.
+ * \param [in] filename     File from p4est_connectivity_save_mapped.
+ * \param [in] first_tree   First resident tree, inclusive.
+ * \param [in] last_tree    Last resident tree, inclusive.
+ * \param [in] num_slots    Cache slots for trees outside the window,
+ *                          or 0 for a default.
+ * \return      The reader, or NULL on file or header error.
+ */
+p4est_connectivity_window_t *p4est_connectivity_window_open (const char
+                                                             *filename,
+                                                             p4est_topidx_t
+                                                             first_tree,
+                                                             p4est_topidx_t
+                                                             last_tree,
+                                                             int num_slots);
+
+/** The face neighbor trees of one tree, P4EST_FACES entries.
+ * The pointer stays valid until the next access to a tree outside the
+ * resident window evicts the record from the cache.
+ */
+const p4est_topidx_t *p4est_connectivity_window_tree_to_tree
+  (p4est_connectivity_window_t * w, p4est_topidx_t tree);
+
+/** The face and orientation codes of one tree, P4EST_FACES entries.
+ * Same lifetime as p4est_connectivity_window_tree_to_tree.
+ */
+const int8_t       *p4est_connectivity_window_tree_to_face
+  (p4est_connectivity_window_t * w, p4est_topidx_t tree);
+
+/** The vertex numbers of one tree, P4EST_CHILDREN entries.
+ * Same lifetime as p4est_connectivity_window_tree_to_tree.
+ * \return      NULL if the file stores no vertex information.
+ */
+const p4est_topidx_t *p4est_connectivity_window_tree_to_vertex
+  (p4est_connectivity_window_t * w, p4est_topidx_t tree);
+
+/** Close a windowed reader and free its window and cache.
+ */
+void                p4est_connectivity_window_close
+  (p4est_connectivity_window_t * w);
+
 /** Create a connectivity structure for the unit square.
  */
 p4est_connectivity_t *p4est_connectivity_new_unitsquare (void);
@@ -329,6 +468,41 @@ p4est_connectivity_t *p4est_connectivity_new_brick (int mi, int ni,
                                                     int periodic_a,
                                                     int periodic_b);
 
+/** Compute the grid position of a tree in a brick connectivity.
+ * \param [in]  conn    Connectivity with a valid brick member.
+ * \param [in]  itree   The number of the tree.
+ * \param [out] coord   Grid coordinates, 0 <= coord[i] < brick->nxyz[i].
+ */
+void                p4est_brick_tree_coordinates (const p4est_connectivity_t
+                                                  * conn,
+                                                  p4est_topidx_t itree,
+                                                  p4est_topidx_t
+                                                  coord[P4EST_DIM]);
+
+/** Compute the tree number at a grid position of a brick connectivity.
+ * \param [in] conn     Connectivity with a valid brick member.
+ * \param [in] coord    Grid coordinates, 0 <= coord[i] < brick->nxyz[i].
+ * \return              The number of the tree at this position.
+ */
+p4est_topidx_t      p4est_brick_tree_index (const p4est_connectivity_t *
+                                            conn,
+                                            const p4est_topidx_t
+                                            coord[P4EST_DIM]);
+
+/** Compute the face neighbor of a tree in a brick connectivity in O(1).
+ * No tree_to_* table is accessed; the result is computed arithmetically.
+ * \param [in]  conn    Connectivity with a valid brick member.
+ * \param [in]  itree   The number of the originating tree.
+ * \param [in]  iface   The number of the originating face.
+ * \param [out] nface   If not NULL, filled with the neighbor's face number
+ *                      when a neighbor exists, left alone otherwise.
+ *                      Brick faces always meet with orientation 0.
+ * \return              The face neighbor tree if it exists, -1 otherwise.
+ */
+p4est_topidx_t      p4est_brick_face_neighbor (const p4est_connectivity_t *
+                                               conn, p4est_topidx_t itree,
+                                               int iface, int *nface);
+
 /** Fills arrays encoding the axis combinations for a face transform.
  * \param [in]  itree       The number of the originating tree.
  * \param [in]  iface       The number of the originating face.
@@ -383,6 +557,21 @@ void                p4est_connectivity_complete (p4est_connectivity_t * conn);
 void                p4est_connectivity_permute (p4est_connectivity_t * conn,
                                                 sc_array_t * perm,
                                                 int is_current_to_new);
+
+/** Renumber the trees along a coarse space-filling curve.
+ * The centroid of each tree is quantized onto a uniform grid spanning the
+ * bounding box of the vertices and the trees are sorted by the Morton key
+ * of their centroid, so trees that are close in space receive nearby
+ * numbers.  This improves partition contiguity and the cache behavior of
+ * inter-tree lookups for connectivities imported in mesh-generator order.
+ * The reordering is deterministic and identical on all processes.
+ * This should be done BEFORE a p4est is created using the connectivity.
+ * \param [in,out] conn     Valid connectivity with vertex information;
+ *                          reordered in place via
+ *                          p4est_connectivity_permute.
+ */
+void                p4est_connectivity_reorder_sfc (p4est_connectivity_t *
+                                                    conn);
 #ifdef P4EST_METIS
 
 /** p4est_connectivity_reorder
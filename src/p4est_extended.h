@@ -46,6 +46,29 @@ typedef int         (*p4est_refine_ext_t) (p4est_t * p4est,
                                            p4est_quadrant_t * quadrant,
                                            p4est_quadrant_t * children[]);
 
+/** Callback function prototype to transfer data during adaptation.
+ * It is invoked whenever refinement replaces one quadrant with its
+ * P4EST_CHILDREN children or coarsening replaces a family with its
+ * parent.  The incoming quadrants' user data is already allocated and
+ * initialized by init_fn; the outgoing quadrants' user data remains
+ * valid until this callback returns and is freed by the library
+ * afterwards, so solution data can be interpolated or projected in
+ * place without external staging.
+ * \param [in] num_outgoing The number of quadrants being replaced:
+ *                          1 for refinement, P4EST_CHILDREN for
+ *                          coarsening.
+ * \param [in] outgoing     The quadrants being removed, with their
+ *                          user data still attached.
+ * \param [in] num_incoming The number of replacement quadrants.
+ * \param [in,out] incoming The quadrants taking their place.
+ */
+typedef void        (*p4est_replace_t) (p4est_t * p4est,
+                                        p4est_topidx_t which_tree,
+                                        int num_outgoing,
+                                        p4est_quadrant_t * outgoing[],
+                                        int num_incoming,
+                                        p4est_quadrant_t * incoming[]);
+
 /** Create a new forest.
  * This is a more general form of p4est_new.
  * See the documentation of p4est_new for basic usage.
@@ -65,6 +88,27 @@ p4est_t            *p4est_new_ext (MPI_Comm mpicomm,
                                    size_t data_size, p4est_init_t init_fn,
                                    void *user_pointer);
 
+/** Create a uniform forest on a brick of trees in one shot.
+ * This fuses p4est_connectivity_new_brick and the uniform fill of
+ * p4est_new_ext.  Every rank derives its exact quadrant range from
+ * space-filling curve arithmetic and instantiates only those
+ * quadrants, so construction needs no communication and no initial
+ * refinement or repartition pass.
+ * The connectivity is created internally and can be reached as
+ * p4est->connectivity; destroy it after the forest as usual.
+ *
+ * \param [in] mi, ni   Number of trees in the coordinate directions.
+ * \param [in] periodic_a, periodic_b   Per-direction periodicity flags.
+ * \param [in] level    Uniform refinement level of the initial mesh.
+ * \return              Valid forest to free with p4est_destroy; free
+ *                      p4est->connectivity afterwards.
+ */
+p4est_t            *p4est_new_brick (MPI_Comm mpicomm, int mi, int ni,
+                                     int periodic_a, int periodic_b,
+                                     int level, size_t data_size,
+                                     p4est_init_t init_fn,
+                                     void *user_pointer);
+
 /** Refine a forest with a bounded maximum refinement level.
  * A quadrant is refined if either callback returns true.
  * \param [in] refine_fn Callback function that returns true
@@ -75,12 +119,158 @@ p4est_t            *p4est_new_ext (MPI_Comm mpicomm,
  *                       which is guaranteed to be allocated, may be NULL.
  * \param [in] maxlevel  Maximum allowed refinement level (inclusive).
  *                       If this is negative the level is unrestricted.
+ * \param [in] replace_fn   Callback function to transfer data from a
+ *                       refined quadrant to its children, may be NULL.
  */
 void                p4est_refine_ext (p4est_t * p4est,
                                       int refine_recursive, int maxlevel,
                                       p4est_refine_t refine_fn,
                                       p4est_refine_ext_t refine_ext_fn,
-                                      p4est_init_t init_fn);
+                                      p4est_init_t init_fn,
+                                      p4est_replace_t replace_fn);
+
+/** Coarsen a forest with a data transfer callback.
+ * This is identical to p4est_coarsen except that \a replace_fn is
+ * called for every coarsened family before its data is freed.
+ * \param [in] coarsen_fn Callback function that returns true if a
+ *                        family of quadrants shall be coarsened.
+ * \param [in] init_fn    Callback function to initialize the user_data
+ *                        which is already allocated automatically.
+ * \param [in] replace_fn Callback function to transfer data from a
+ *                        coarsened family to its parent, may be NULL.
+ */
+void                p4est_coarsen_ext (p4est_t * p4est,
+                                       int coarsen_recursive,
+                                       p4est_coarsen_t coarsen_fn,
+                                       p4est_init_t init_fn,
+                                       p4est_replace_t replace_fn);
+
+/** Move all quadrant user data into one contiguous arena per tree.
+ * Data for consecutive quadrants becomes consecutive in memory, which
+ * improves cache locality for linear sweeps over the quadrants.
+ * After the forest is adapted or partitioned, newly created quadrants
+ * draw their data from the regular memory pool again; call this function
+ * another time to recompact everything and reclaim that pool wholesale.
+ * While the arena is active, data of removed quadrants is reclaimed only
+ * by the next call to this function or to p4est_uncompact_data.
+ * This is a no-op if the data size is zero.
+ */
+void                p4est_compact_data (p4est_t * p4est);
+
+/** Move all quadrant user data into per-tree arenas of Morton blocks.
+ * This is a variant of p4est_compact_data that lays the data out in
+ * blocks of 4x4 cells: each block corresponds to an aligned subtree two
+ * levels above its quadrants, holds one slot per potential cell, and
+ * leaves the slots of absent cells as padding.  Face neighbors within a
+ * block thus keep a fixed small stride regardless of the refinement
+ * pattern, which benefits stencil kernels that miss on neighbor loads
+ * at block boundaries under the purely linear layout.
+ * The maintenance rules of p4est_compact_data apply unchanged: adapt or
+ * partition the forest, then call this function again to reblock; undo
+ * with p4est_uncompact_data.  The slot of each quadrant is published by
+ * p4est_mesh in its quad_to_arena member.
+ * This is a no-op if the data size is zero.
+ */
+void                p4est_compact_data_blocked (p4est_t * p4est);
+
+/** Return all quadrant user data to individual memory pool allocations.
+ * This undoes p4est_compact_data and frees the per-tree arenas.
+ */
+void                p4est_uncompact_data (p4est_t * p4est);
+
+/** Balance a forest incrementally after localized refinement.
+ * This is identical to p4est_balance except that the local balancing
+ * pass is skipped for trees that are known to contain no new quadrants.
+ * The communication and the cross-tree propagation of 2:1 constraints
+ * are unchanged, so refinements induced from neighboring trees and
+ * processors are still applied everywhere.
+ * \param [in] btype          Balance type (face, corner or default, full).
+ * \param [in] init_fn        Callback function to initialize the user_data
+ *                            which is already allocated automatically.
+ * \param [in] changed_trees  Array of num_trees flags where nonzero marks
+ *                            a tree in which quadrants have been created
+ *                            or removed since the forest was last balanced.
+ *                            Flagging too many trees is safe; flagging too
+ *                            few leaves the forest unbalanced.
+ *                            Passing NULL balances all trees.
+ */
+void                p4est_balance_incremental (p4est_t * p4est,
+                                               p4est_connect_type_t btype,
+                                               p4est_init_t init_fn,
+                                               const int8_t * changed_trees);
+
+/** Refine a forest and establish the 2:1 balance in one pass.
+ * This is equivalent to p4est_refine followed by p4est_balance, but the
+ * local balancing of each tree is fused into the refinement sweep while
+ * the tree's quadrant array is still in cache, so the forest is rewritten
+ * once instead of twice.  The subsequent balance then only performs the
+ * boundary exchange and the cross-tree propagation of 2:1 constraints.
+ * \param [in] refine_recursive Boolean to decide on recursive refinement.
+ * \param [in] allowed_level    Maximum allowed refinement level of quadrants.
+ *                              A negative value proceeds to P4EST_QMAXLEVEL.
+ * \param [in] btype            Balance type (face, corner or default, full).
+ * \param [in] refine_fn        Callback function that must return true if
+ *                              a quadrant shall be refined.
+ * \param [in] init_fn          Callback function to initialize the user_data
+ *                              which is already allocated automatically.
+ */
+void                p4est_refine_balance (p4est_t * p4est,
+                                          int refine_recursive,
+                                          int allowed_level,
+                                          p4est_connect_type_t btype,
+                                          p4est_refine_t refine_fn,
+                                          p4est_init_t init_fn);
+
+/** A reusable communicator context for frequent forest rebuilds.
+ * The context caches the communicator size and rank, so forests created
+ * on it skip the MPI queries, and it retains the temporary quadrant pool
+ * and the partition tables of the most recently destroyed forest, which
+ * the next p4est_new_context call takes over instead of allocating anew.
+ * Any number of forests may be alive on the same context at a time.
+ */
+typedef struct p4est_context
+{
+  MPI_Comm            mpicomm;  /**< communicator of all attached forests */
+  int                 mpisize;  /**< cached size of \a mpicomm */
+  int                 mpirank;  /**< cached rank in \a mpicomm */
+  sc_mempool_t       *quadrant_pool;    /**< warm temporary quadrant pool
+                                             retained between forests */
+  p4est_gloidx_t     *global_first_quadrant;    /**< spare partition table
+                                                     of mpisize + 1 entries */
+  p4est_quadrant_t   *global_first_position;    /**< spare partition markers
+                                                     of mpisize + 1 entries */
+  int                 num_forests;      /**< forests currently attached */
+}
+p4est_context_t;
+
+/** Create a reusable context on a communicator.
+ * The size and rank queries are performed once here.
+ * \param [in] mpicomm    Communicator for all forests on this context.
+ * \return                A context ready for p4est_new_context.
+ */
+p4est_context_t    *p4est_context_new (MPI_Comm mpicomm);
+
+/** Destroy a context and its retained allocations.
+ * All forests created on the context must be destroyed beforehand.
+ */
+void                p4est_context_destroy (p4est_context_t * context);
+
+/** Create a new forest on a reusable context.
+ * This is identical to p4est_new_ext except that the communicator is
+ * taken from \a context and warm allocations retained from previously
+ * destroyed forests on the context are reused.
+ * \param [in] context    Context from p4est_context_new; must outlive
+ *                        the forest.
+ * \return                A valid forest; pass to p4est_destroy, which
+ *                        returns reusable allocations to the context.
+ */
+p4est_t            *p4est_new_context (p4est_context_t * context,
+                                       p4est_connectivity_t * connectivity,
+                                       p4est_locidx_t min_quadrants,
+                                       int min_level, int fill_uniform,
+                                       size_t data_size,
+                                       p4est_init_t init_fn,
+                                       void *user_pointer);
 
 /** Repartition the forest.
  *
@@ -98,6 +288,216 @@ p4est_gloidx_t      p4est_partition_ext (p4est_t * p4est,
                                          int partition_for_coarsening,
                                          p4est_weight_t weight_fn);
 
+/** Callback to compute 64-bit per-quadrant weights in channels.
+ * Each channel models one cost phase of the application, for example
+ * flux evaluation versus chemistry.  The returned weight must be
+ * nonnegative; the 64-bit range avoids the overflow that the integer
+ * valued p4est_weight_t suffers on deep levels.
+ * \param [in] channel   The weight channel to evaluate, 0-based.
+ * \return               Nonnegative weight of this quadrant.
+ */
+typedef int64_t     (*p4est_weight_channel_t) (p4est_t * p4est,
+                                               p4est_topidx_t which_tree,
+                                               p4est_quadrant_t * quadrant,
+                                               int channel);
+
+/** Repartition the forest by a runtime blend of weight channels.
+ *
+ * The effective weight of a quadrant is the blend-weighted sum of its
+ * channel weights, rounded to the nearest integer.  Changing the blend
+ * rebalances for a different dominant phase without keeping a separate
+ * forest copy per cost model.
+ *
+ * \param [in,out] p4est      The forest that will be partitioned.
+ * \param [in]     partition_for_coarsening     If true, the partition
+ *                            is modified to allow one level of coarsening.
+ * \param [in]     weight_fn  The channel weighting function, not NULL.
+ * \param [in]     num_channels  Number of weight channels, at least 1.
+ * \param [in]     blend      Nonnegative blend coefficient per channel.
+ * \return         The global number of shipped quadrants
+ */
+p4est_gloidx_t      p4est_partition_weighted (p4est_t * p4est,
+                                              int partition_for_coarsening,
+                                              p4est_weight_channel_t
+                                              weight_fn, int num_channels,
+                                              const double *blend);
+
+/** Callback to report the attached payload of a quadrant in bytes.
+ * The count covers data the application migrates with the quadrant
+ * beyond the fixed-size user data, for example a variable number of
+ * particles; it may be zero.
+ * \return               Payload bytes attached to this quadrant.
+ */
+typedef size_t      (*p4est_data_bytes_t) (p4est_t * p4est,
+                                           p4est_topidx_t which_tree,
+                                           p4est_quadrant_t * quadrant);
+
+/** Repartition the forest to balance migrated bytes per process.
+ *
+ * The weight of a quadrant is its total storage: the quadrant struct,
+ * the fixed user data, and the payload reported by \a bytes_fn.  The
+ * partition remains a Morton-contiguous split of the space-filling
+ * curve; it only moves the cut points so that memory-heavy regions
+ * spread out instead of concentrating on one process.  The fixed
+ * per-quadrant share keeps payload-free regions from collapsing onto a
+ * single process.
+ *
+ * \param [in,out] p4est      The forest that will be partitioned.
+ * \param [in]     partition_for_coarsening     If true, the partition
+ *                            is modified to allow one level of coarsening.
+ * \param [in]     bytes_fn   The payload callback, not NULL.
+ * \return         The global number of shipped quadrants
+ */
+p4est_gloidx_t      p4est_partition_bytes (p4est_t * p4est,
+                                           int partition_for_coarsening,
+                                           p4est_data_bytes_t bytes_fn);
+
+/** Tracks load imbalance and partition cost to advise on rebalancing.
+ * The contents are private; see p4est_partition_advisor_new.
+ */
+typedef struct p4est_partition_advisor p4est_partition_advisor_t;
+
+/** Create an uncalibrated repartition advisor.
+ * Feed it one call to p4est_partition_advisor_step per solver step and
+ * one call to p4est_partition_advisor_record per partition; then
+ * p4est_partition_advisor_recommend compares the projected imbalance
+ * cost against the measured migration cost.  All advisor calls are
+ * collective over the forest's communicator.
+ * \return          Advisor to destroy with p4est_partition_advisor_destroy.
+ */
+p4est_partition_advisor_t *p4est_partition_advisor_new (void);
+
+/** Destroy a repartition advisor. */
+void                p4est_partition_advisor_destroy
+  (p4est_partition_advisor_t * adv);
+
+/** Record the duration of one synchronized solver step.
+ * Calibrates the per-quadrant compute cost from the slowest rank's
+ * time and the current partition.
+ * \param [in] step_seconds   This processor's time spent in the step.
+ */
+void                p4est_partition_advisor_step
+  (p4est_partition_advisor_t * adv, p4est_t * p4est, double step_seconds);
+
+/** Record the cost of a completed repartition.
+ * Calibrates the per-quadrant migration cost; a run that shipped no
+ * quadrants is ignored.
+ * \param [in] partition_seconds  This processor's time spent in the
+ *                                partition call.
+ * \param [in] global_shipped     Return value of the partition call.
+ */
+void                p4est_partition_advisor_record
+  (p4est_partition_advisor_t * adv, p4est_t * p4est,
+   double partition_seconds, p4est_gloidx_t global_shipped);
+
+/** Decide whether repartitioning now is projected to pay off.
+ * \param [in] lookahead_steps  Number of steps the new partition is
+ *                              expected to stay in place.
+ * \return          True if the projected savings over the lookahead
+ *                  exceed the calibrated migration cost; always false
+ *                  while the advisor is uncalibrated.
+ */
+int                 p4est_partition_advisor_recommend
+  (p4est_partition_advisor_t * adv, p4est_t * p4est, int lookahead_steps);
+
+/** Repartition the forest diffusively.
+ *
+ * Instead of computing a fresh global partition, quadrants are shipped
+ * only between processors adjacent along the space-filling curve, half
+ * the load difference at a time, until the heaviest processor is within
+ * \a imbalance_tol of the average or nothing moves anymore.  For mild
+ * imbalance this migrates far less data than p4est_partition at the
+ * price of a less exact result.
+ *
+ * \param [in,out] p4est      The forest that will be partitioned.
+ * \param [in] partition_for_coarsening   If true, each moved cut point
+ *                            is rounded to a family boundary so complete
+ *                            sibling families stay on one processor and
+ *                            one level of coarsening can proceed.
+ * \param [in] imbalance_tol  Acceptable ratio of the maximum processor
+ *                            load to the average load, at least 1.
+ * \param [in] max_move       Bound on the quadrants any processor sends
+ *                            across one partition boundary per iteration,
+ *                            or 0 for no bound.
+ * \param [in] weight_fn      A weighting function or NULL
+ *                            for uniform partitioning.
+ * \return         The global number of shipped quadrants
+ */
+p4est_gloidx_t      p4est_partition_diffusive (p4est_t * p4est,
+                                               int partition_for_coarsening,
+                                               double imbalance_tol,
+                                               p4est_locidx_t max_move,
+                                               p4est_weight_t weight_fn);
+
+/** Records a sequence of adaptation passes for deterministic replay.
+ * The contents are private; see p4est_journal_new.
+ */
+typedef struct p4est_journal p4est_journal_t;
+
+/** Create an empty adaptation journal.
+ * Run the expensive adaptation once through p4est_refine_journal,
+ * p4est_coarsen_journal, p4est_balance_journal and
+ * p4est_partition_journal; the journal then stores every callback
+ * decision as one bit per invocation, in callback order, plus the
+ * resulting partition counts.  p4est_journal_replay rebuilds the
+ * identical forest sequence from a forest equal to the captured
+ * starting point without calling any user callbacks.
+ * The journal is local to each process and must be replayed on the
+ * same number of processes that captured it.
+ * \return          Journal to destroy with p4est_journal_destroy.
+ */
+p4est_journal_t    *p4est_journal_new (void);
+
+/** Destroy an adaptation journal. */
+void                p4est_journal_destroy (p4est_journal_t * journal);
+
+/** Refine as p4est_refine does and log every callback decision.
+ * While the pass runs, the forest's user_pointer is replaced, so \a
+ * refine_fn and \a init_fn see the caller's pointer only during their
+ * own invocation.
+ */
+void                p4est_refine_journal (p4est_t * p4est,
+                                          int refine_recursive,
+                                          p4est_refine_t refine_fn,
+                                          p4est_init_t init_fn,
+                                          p4est_journal_t * journal);
+
+/** Coarsen as p4est_coarsen does and log every callback decision. */
+void                p4est_coarsen_journal (p4est_t * p4est,
+                                           int coarsen_recursive,
+                                           p4est_coarsen_t coarsen_fn,
+                                           p4est_init_t init_fn,
+                                           p4est_journal_t * journal);
+
+/** Balance as p4est_balance does and log the pass.
+ * Balance is deterministic given the forest, so only the connect type
+ * is recorded.
+ */
+void                p4est_balance_journal (p4est_t * p4est,
+                                           p4est_connect_type_t btype,
+                                           p4est_init_t init_fn,
+                                           p4est_journal_t * journal);
+
+/** Partition as p4est_partition_ext does and log the result.
+ * The journal stores the resulting per-process quadrant counts, so the
+ * replay reproduces the partition without evaluating \a weight_fn.
+ * \return         The global number of shipped quadrants
+ */
+p4est_gloidx_t      p4est_partition_journal (p4est_t * p4est,
+                                             int partition_for_coarsening,
+                                             p4est_weight_t weight_fn,
+                                             p4est_journal_t * journal);
+
+/** Re-execute a journal's recorded passes in order.
+ * \a p4est must equal the forest the capture started from and run on
+ * the capturing number of processes; a mismatch aborts.
+ * \param [in] init_fn   Callback to initialize the user data of created
+ *                       quadrants, or NULL.
+ */
+void                p4est_journal_replay (p4est_t * p4est,
+                                          p4est_journal_t * journal,
+                                          p4est_init_t init_fn);
+
 /** Save the complete connectivity/p4est data to disk.  This is a collective
  * operation that all MPI processes need to call.  All processes write
  * into the same file, so the filename given needs to be identical over
@@ -118,6 +518,31 @@ p4est_gloidx_t      p4est_partition_ext (p4est_t * p4est,
 void                p4est_save_ext (const char *filename, p4est_t * p4est,
                                     int save_data, int save_partition);
 
+/** Save the forest with per-field precision conversion of the data.
+ * The user data of each quadrant is described as a sequence of fields;
+ * fields flagged as double arrays are down-converted to float on the
+ * fly, roughly halving the checkpoint volume for double-dominated
+ * payloads without touching the in-memory representation.  The field
+ * layout is recorded in the file header so p4est_load_mixed can undo
+ * the conversion; such files cannot be read by p4est_load.
+ * \param [in] filename     Name of the file to write.
+ * \param [in] p4est        Valid forest structure.
+ * \param [in] save_partition   As in p4est_save_ext.
+ * \param [in] num_fields   Number of user data fields, at least 1.
+ * \param [in] field_sizes  In-memory byte count of each field; the
+ *                          sizes must add up to p4est->data_size.
+ * \param [in] field_double Per field, nonzero if it is an array of
+ *                          doubles to be stored in float precision.
+ *                          Such fields must be a multiple of
+ *                          sizeof (double) in size.
+ * \note            Aborts on file errors.
+ */
+void                p4est_save_mixed (const char *filename,
+                                      p4est_t * p4est, int save_partition,
+                                      int num_fields,
+                                      const size_t *field_sizes,
+                                      const int *field_double);
+
 /** Load the complete connectivity/p4est structure from disk.
  * It is possible to load the file with a different number of processors
  * than has been used to write it.  The partition will then be uniform.
@@ -145,6 +570,63 @@ p4est_t            *p4est_load_ext (const char *filename, MPI_Comm mpicomm,
                                     void *user_pointer,
                                     p4est_connectivity_t ** connectivity);
 
+/** Load only a window of trees from a forest checkpoint.
+ * The per-tree counts stored in the file are used to seek directly to
+ * the window's quadrants, so the cost scales with the window and not
+ * with the checkpoint.  Trees outside [\a first_tree, \a last_tree]
+ * are instantiated as a single root quadrant each to keep the forest
+ * complete; their data, if loaded, is zero-initialized.  The window
+ * is partitioned uniformly regardless of the saved partition.
+ * \param [in] filename         Name of the file to read.
+ * \param [in] mpicomm          A valid MPI communicator.
+ * \param [in] data_size        Size of data for each quadrant which can be
+ *                              zero.  Then user_data_pool is set to NULL.
+ *                              If data_size is zero, load_data is ignored.
+ * \param [in] load_data        If true, the element data is loaded.  This is
+ *                              only permitted if the saved data size matches.
+ *                              If false, the stored data size is ignored.
+ * \param [in] first_tree       First tree of the window to load.
+ * \param [in] last_tree        Last tree of the window, inclusive.
+ * \param [in] user_pointer     Assign to the user_pointer member of the p4est
+ *                              before init_fn is called the first time.
+ * \param [out] connectivity    Connectivity must be destroyed separately.
+ * \return          Returns a valid forest structure. A pointer to a valid
+ *                  connectivity structure is returned through the last
+ *                  argument.
+ * \note            Aborts on file errors or invalid file contents.
+ */
+p4est_t            *p4est_load_window (const char *filename,
+                                       MPI_Comm mpicomm,
+                                       size_t data_size, int load_data,
+                                       p4est_topidx_t first_tree,
+                                       p4est_topidx_t last_tree,
+                                       void *user_pointer,
+                                       p4est_connectivity_t **
+                                       connectivity);
+
+/** Load a forest written by p4est_save_mixed.
+ * The field descriptors stored in the file drive the up-conversion of
+ * float-stored fields back to double precision.
+ * \param [in] filename         Name of the file to read.
+ * \param [in] mpicomm          A valid MPI communicator.
+ * \param [in] data_size        In-memory size of the quadrant data; it
+ *                              must match the sum of the stored field
+ *                              sizes when load_data is true.
+ * \param [in] load_data        If true, the element data is loaded.
+ * \param [in] autopartition    Ignore saved partition and make it uniform.
+ * \param [in] user_pointer     Assign to the user_pointer member of the p4est
+ *                              before init_fn is called the first time.
+ * \param [out] connectivity    Connectivity must be destroyed separately.
+ * \return          Returns a valid forest structure.
+ * \note            Aborts on file errors or invalid file contents.
+ */
+p4est_t            *p4est_load_mixed (const char *filename,
+                                      MPI_Comm mpicomm, size_t data_size,
+                                      int load_data, int autopartition,
+                                      void *user_pointer,
+                                      p4est_connectivity_t **
+                                      connectivity);
+
 SC_EXTERN_C_END;
 
 #endif /* !P4EST_EXTENDED_H */
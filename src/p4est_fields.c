@@ -0,0 +1,444 @@
+/*
+  This file is part of p4est.
+  p4est is a C library to manage a collection (a forest) of multiple
+  connected adaptive quadtrees or octrees in parallel.
+
+  Copyright (C) 2010 The University of Texas System
+  Written by Carsten Burstedde, Lucas C. Wilcox, and Tobin Isaac
+
+  p4est is free software; you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation; either version 2 of the License, or
+  (at your option) any later version.
+
+  p4est is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with p4est; if not, write to the Free Software Foundation, Inc.,
+  51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
+*/
+
+#ifndef P4_TO_P8
+#include <p4est_bits.h>
+#include <p4est_communication.h>
+#include <p4est_fields.h>
+#else
+#include <p8est_bits.h>
+#include <p8est_communication.h>
+#include <p8est_fields.h>
+#endif
+
+/** Advance \a q to the leaf starting right behind it on level \a l. */
+static void
+p4est_fields_successor (p4est_quadrant_t * q, int l)
+{
+  uint64_t            id;
+  p4est_quadrant_t    ld;
+
+  p4est_quadrant_last_descendant (q, &ld, P4EST_QMAXLEVEL);
+  id = p4est_quadrant_linear_id (&ld, P4EST_QMAXLEVEL) + 1;
+  p4est_quadrant_set_morton (q, l,
+                             id >> (P4EST_DIM * (P4EST_QMAXLEVEL - l)));
+}
+
+static void
+p4est_fields_snapshot_reset (p4est_fields_t * fields)
+{
+  P4EST_FREE (fields->tree_offsets);
+  P4EST_FREE (fields->first_quads);
+  P4EST_FREE (fields->levels);
+  P4EST_FREE (fields->global_first_quadrant);
+  fields->tree_offsets = NULL;
+  fields->first_quads = NULL;
+  fields->levels = NULL;
+  fields->global_first_quadrant = NULL;
+}
+
+/** Record the leaves and the partition the field arrays match. */
+static void
+p4est_fields_snapshot (p4est_fields_t * fields)
+{
+  p4est_t            *p4est = fields->p4est;
+  size_t              zz;
+  p4est_topidx_t      tt, k, num_local_trees;
+  p4est_locidx_t      il;
+  p4est_tree_t       *tree;
+  p4est_quadrant_t   *q;
+
+  fields->num_quadrants = p4est->local_num_quadrants;
+  fields->first_local_tree = p4est->first_local_tree;
+  fields->last_local_tree = p4est->last_local_tree;
+  num_local_trees = fields->last_local_tree - fields->first_local_tree + 1;
+  if (num_local_trees < 0) {
+    num_local_trees = 0;
+  }
+  fields->tree_offsets = P4EST_ALLOC (p4est_locidx_t, num_local_trees + 1);
+  fields->first_quads = P4EST_ALLOC (p4est_quadrant_t, num_local_trees);
+  fields->levels = P4EST_ALLOC (int8_t, fields->num_quadrants);
+  fields->global_first_quadrant =
+    P4EST_ALLOC (p4est_gloidx_t, p4est->mpisize + 1);
+  memcpy (fields->global_first_quadrant, p4est->global_first_quadrant,
+          (p4est->mpisize + 1) * sizeof (p4est_gloidx_t));
+
+  il = 0;
+  fields->tree_offsets[0] = 0;
+  k = 0;
+  for (tt = fields->first_local_tree; tt <= fields->last_local_tree;
+       ++tt, ++k) {
+    tree = p4est_tree_array_index (p4est->trees, tt);
+    for (zz = 0; zz < tree->quadrants.elem_count; ++zz) {
+      q = p4est_quadrant_array_index (&tree->quadrants, zz);
+      if (zz == 0) {
+        fields->first_quads[k] = *q;
+      }
+      fields->levels[il++] = (int8_t) q->level;
+    }
+    fields->tree_offsets[k + 1] = il;
+  }
+  P4EST_ASSERT (il == fields->num_quadrants);
+}
+
+p4est_fields_t     *
+p4est_fields_new (p4est_t * p4est)
+{
+  p4est_fields_t     *fields;
+
+  fields = P4EST_ALLOC_ZERO (p4est_fields_t, 1);
+  fields->p4est = p4est;
+  p4est_fields_snapshot (fields);
+
+  return fields;
+}
+
+int
+p4est_fields_register (p4est_fields_t * fields, const char *name,
+                       size_t type_size, int count)
+{
+  const int           fid = fields->num_fields;
+  p4est_field_t      *f;
+
+  P4EST_ASSERT (type_size > 0 && count > 0);
+  P4EST_ASSERT (p4est_fields_lookup (fields, name) == -1);
+  P4EST_ASSERT (fields->num_quadrants ==
+                fields->p4est->local_num_quadrants);
+
+  fields->fields = P4EST_REALLOC (fields->fields, p4est_field_t, fid + 1);
+  f = &fields->fields[fid];
+  f->name = P4EST_STRDUP (name);
+  f->type_size = type_size;
+  f->count = count;
+  f->data = P4EST_ALLOC_ZERO (char, (size_t) fields->num_quadrants *
+                              type_size * (size_t) count);
+  fields->num_fields = fid + 1;
+
+  return fid;
+}
+
+int
+p4est_fields_lookup (p4est_fields_t * fields, const char *name)
+{
+  int                 fid;
+
+  for (fid = 0; fid < fields->num_fields; ++fid) {
+    if (!strcmp (fields->fields[fid].name, name)) {
+      return fid;
+    }
+  }
+  return -1;
+}
+
+void               *
+p4est_fields_view (p4est_fields_t * fields, int fid)
+{
+  P4EST_ASSERT (0 <= fid && fid < fields->num_fields);
+
+  return fields->fields[fid].data;
+}
+
+void               *
+p4est_fields_quadrant (p4est_fields_t * fields, int fid,
+                       p4est_locidx_t local_quad)
+{
+  p4est_field_t      *f;
+
+  P4EST_ASSERT (0 <= fid && fid < fields->num_fields);
+  P4EST_ASSERT (0 <= local_quad && local_quad < fields->num_quadrants);
+
+  f = &fields->fields[fid];
+  return f->data + (size_t) local_quad * f->type_size * (size_t) f->count;
+}
+
+void
+p4est_fields_adapt (p4est_fields_t * fields)
+{
+  p4est_t            *p4est = fields->p4est;
+  int                 i;
+  size_t              sz, zz;
+  p4est_topidx_t      tt, k;
+  p4est_locidx_t      n_new, n_old, oz, il, offset;
+  p4est_locidx_t     *old_of_new;
+  p4est_tree_t       *tree;
+  p4est_quadrant_t    oq;
+  p4est_quadrant_t   *nq;
+  p4est_field_t      *f;
+  char               *data;
+
+  /* refine, coarsen and balance do not move the partition boundaries */
+  P4EST_ASSERT (fields->first_local_tree == p4est->first_local_tree);
+  P4EST_ASSERT (fields->last_local_tree == p4est->last_local_tree);
+
+  /* map every new leaf to the previous leaf whose values it inherits;
+   * both leaf sequences cover the same region of each tree, so any new
+   * leaf is equal to, a descendant of, or an ancestor of exactly one
+   * run of previous leaves */
+  n_new = p4est->local_num_quadrants;
+  old_of_new = P4EST_ALLOC (p4est_locidx_t, n_new);
+  k = 0;
+  for (tt = p4est->first_local_tree; tt <= p4est->last_local_tree;
+       ++tt, ++k) {
+    tree = p4est_tree_array_index (p4est->trees, tt);
+    offset = fields->tree_offsets[k];
+    n_old = fields->tree_offsets[k + 1] - offset;
+    oz = 0;
+    if (n_old > 0) {
+      oq = fields->first_quads[k];
+    }
+    for (zz = 0; zz < tree->quadrants.elem_count;) {
+      nq = p4est_quadrant_array_index (&tree->quadrants, zz);
+      P4EST_ASSERT (oz < n_old);
+      if (nq->level == oq.level) {
+        /* the leaf is unchanged */
+        P4EST_ASSERT (p4est_quadrant_is_equal (nq, &oq));
+        old_of_new[tree->quadrants_offset + (p4est_locidx_t) zz] =
+          offset + oz;
+        ++zz;
+        if (++oz < n_old) {
+          p4est_fields_successor (&oq, (int) fields->levels[offset + oz]);
+        }
+      }
+      else if (nq->level > oq.level) {
+        /* the previous leaf was refined: replicate to its children */
+        P4EST_ASSERT (p4est_quadrant_is_ancestor (&oq, nq));
+        do {
+          old_of_new[tree->quadrants_offset + (p4est_locidx_t) zz] =
+            offset + oz;
+          ++zz;
+        } while (zz < tree->quadrants.elem_count &&
+                 p4est_quadrant_is_ancestor
+                 (&oq, p4est_quadrant_array_index (&tree->quadrants, zz)));
+        if (++oz < n_old) {
+          p4est_fields_successor (&oq, (int) fields->levels[offset + oz]);
+        }
+      }
+      else {
+        /* a previous family was coarsened: keep the first child */
+        P4EST_ASSERT (p4est_quadrant_is_ancestor (nq, &oq));
+        old_of_new[tree->quadrants_offset + (p4est_locidx_t) zz] =
+          offset + oz;
+        do {
+          if (++oz >= n_old) {
+            break;
+          }
+          p4est_fields_successor (&oq, (int) fields->levels[offset + oz]);
+        } while (p4est_quadrant_is_ancestor (nq, &oq));
+        ++zz;
+      }
+    }
+    P4EST_ASSERT (oz == n_old);
+  }
+
+  /* gather each field through the map in one contiguous pass */
+  for (i = 0; i < fields->num_fields; ++i) {
+    f = &fields->fields[i];
+    sz = f->type_size * (size_t) f->count;
+    data = P4EST_ALLOC (char, (size_t) n_new * sz);
+    for (il = 0; il < n_new; ++il) {
+      memcpy (data + (size_t) il * sz,
+              f->data + (size_t) old_of_new[il] * sz, sz);
+    }
+    P4EST_FREE (f->data);
+    f->data = data;
+  }
+  P4EST_FREE (old_of_new);
+
+  /* the arrays now match the adapted forest */
+  p4est_fields_snapshot_reset (fields);
+  p4est_fields_snapshot (fields);
+}
+
+void
+p4est_fields_partition (p4est_fields_t * fields)
+{
+  p4est_t            *p4est = fields->p4est;
+  const int           num_procs = p4est->mpisize;
+  const int           rank = p4est->mpirank;
+  const p4est_gloidx_t *gfq_new = p4est->global_first_quadrant;
+  const p4est_gloidx_t *gfq_old = fields->global_first_quadrant;
+  int                 i, q;
+  int                 num_peers;
+#ifdef P4EST_MPI
+  int                 mpiret;
+  int                 num_requests;
+  MPI_Request        *requests;
+#endif
+  size_t              sz;
+  p4est_gloidx_t      begin, end;
+  p4est_locidx_t      loffset, lcount, lfrom;
+  p4est_field_t      *f;
+  char              **new_data;
+
+  P4EST_ASSERT (gfq_new[num_procs] == gfq_old[num_procs]);
+
+  /* count the processes exchanged with to size the request array */
+  num_peers = 0;
+  for (q = 0; q < num_procs; ++q) {
+    if (q != rank &&
+        SC_MAX (gfq_new[rank], gfq_old[q]) <
+        SC_MIN (gfq_new[rank + 1], gfq_old[q + 1])) {
+      ++num_peers;
+    }
+    if (q != rank &&
+        SC_MAX (gfq_old[rank], gfq_new[q]) <
+        SC_MIN (gfq_old[rank + 1], gfq_new[q + 1])) {
+      ++num_peers;
+    }
+  }
+#ifdef P4EST_MPI
+  requests = P4EST_ALLOC (MPI_Request, num_peers * fields->num_fields);
+  num_requests = 0;
+#else
+  SC_CHECK_ABORT (num_peers == 0, "fields partition without MPI");
+#endif
+
+  new_data = P4EST_ALLOC (char *, fields->num_fields);
+  for (i = 0; i < fields->num_fields; ++i) {
+    f = &fields->fields[i];
+    sz = f->type_size * (size_t) f->count;
+    new_data[i] =
+      P4EST_ALLOC (char, (size_t) p4est->local_num_quadrants * sz);
+  }
+
+  /* receive every slice of the new local range from its previous owner */
+  for (q = 0; q < num_procs; ++q) {
+    begin = SC_MAX (gfq_new[rank], gfq_old[q]);
+    end = SC_MIN (gfq_new[rank + 1], gfq_old[q + 1]);
+    if (begin >= end) {
+      continue;
+    }
+    loffset = (p4est_locidx_t) (begin - gfq_new[rank]);
+    lcount = (p4est_locidx_t) (end - begin);
+    if (q == rank) {
+      lfrom = (p4est_locidx_t) (begin - gfq_old[rank]);
+      for (i = 0; i < fields->num_fields; ++i) {
+        f = &fields->fields[i];
+        sz = f->type_size * (size_t) f->count;
+        memcpy (new_data[i] + (size_t) loffset * sz,
+                f->data + (size_t) lfrom * sz, (size_t) lcount * sz);
+      }
+    }
+    else {
+#ifdef P4EST_MPI
+      for (i = 0; i < fields->num_fields; ++i) {
+        f = &fields->fields[i];
+        sz = f->type_size * (size_t) f->count;
+        mpiret = MPI_Irecv (new_data[i] + (size_t) loffset * sz,
+                            (int) ((size_t) lcount * sz), MPI_BYTE, q,
+                            P4EST_COMM_FIELDS, p4est->mpicomm,
+                            &requests[num_requests++]);
+        SC_CHECK_MPI (mpiret);
+      }
+#else
+      SC_ABORT_NOT_REACHED ();
+#endif
+    }
+  }
+
+  /* send every slice of the previous local range to its new owner */
+  for (q = 0; q < num_procs; ++q) {
+    if (q == rank) {
+      continue;
+    }
+    begin = SC_MAX (gfq_old[rank], gfq_new[q]);
+    end = SC_MIN (gfq_old[rank + 1], gfq_new[q + 1]);
+    if (begin >= end) {
+      continue;
+    }
+    loffset = (p4est_locidx_t) (begin - gfq_old[rank]);
+    lcount = (p4est_locidx_t) (end - begin);
+#ifdef P4EST_MPI
+    for (i = 0; i < fields->num_fields; ++i) {
+      f = &fields->fields[i];
+      sz = f->type_size * (size_t) f->count;
+      mpiret = MPI_Isend (f->data + (size_t) loffset * sz,
+                          (int) ((size_t) lcount * sz), MPI_BYTE, q,
+                          P4EST_COMM_FIELDS, p4est->mpicomm,
+                          &requests[num_requests++]);
+      SC_CHECK_MPI (mpiret);
+    }
+#else
+    SC_ABORT_NOT_REACHED ();
+#endif
+  }
+
+#ifdef P4EST_MPI
+  P4EST_ASSERT (num_requests == num_peers * fields->num_fields);
+  mpiret = MPI_Waitall (num_requests, requests, MPI_STATUSES_IGNORE);
+  SC_CHECK_MPI (mpiret);
+  P4EST_FREE (requests);
+#endif
+
+  for (i = 0; i < fields->num_fields; ++i) {
+    f = &fields->fields[i];
+    P4EST_FREE (f->data);
+    f->data = new_data[i];
+  }
+  P4EST_FREE (new_data);
+
+  /* the arrays now match the repartitioned forest */
+  p4est_fields_snapshot_reset (fields);
+  p4est_fields_snapshot (fields);
+}
+
+void
+p4est_fields_destroy (p4est_fields_t * fields)
+{
+  int                 i;
+
+  for (i = 0; i < fields->num_fields; ++i) {
+    P4EST_FREE (fields->fields[i].name);
+    P4EST_FREE (fields->fields[i].data);
+  }
+  P4EST_FREE (fields->fields);
+  p4est_fields_snapshot_reset (fields);
+  P4EST_FREE (fields);
+}
+
+size_t
+p4est_fields_memory_used (p4est_fields_t * fields)
+{
+  int                 i;
+  size_t              size;
+  p4est_topidx_t      num_local_trees;
+  p4est_field_t      *f;
+
+  num_local_trees = fields->last_local_tree - fields->first_local_tree + 1;
+  if (num_local_trees < 0) {
+    num_local_trees = 0;
+  }
+  size = sizeof (p4est_fields_t) +
+    (size_t) fields->num_fields * sizeof (p4est_field_t) +
+    (num_local_trees + 1) * sizeof (p4est_locidx_t) +
+    num_local_trees * sizeof (p4est_quadrant_t) +
+    (size_t) fields->num_quadrants * sizeof (int8_t) +
+    (fields->p4est->mpisize + 1) * sizeof (p4est_gloidx_t);
+  for (i = 0; i < fields->num_fields; ++i) {
+    f = &fields->fields[i];
+    size += strlen (f->name) + 1 +
+      (size_t) fields->num_quadrants * f->type_size * (size_t) f->count;
+  }
+
+  return size;
+}
@@ -31,6 +31,7 @@
 #include <p8est_ghost.h>
 #include <p8est_search.h>
 #endif
+#include <sc_notify.h>
 #include <sc_search.h>
 
 /* htonl is in either of these two */
@@ -49,13 +50,223 @@ typedef enum
 }
 p4est_ghost_tolerance_t;
 
+#ifdef P4EST_MPI
+
+/* number of quadrants that ride inline with the count message, so a
+ * small ghost payload completes in one send instead of a count/load
+ * pair */
+#define P4EST_GHOST_INLINE      4
+
+/* the fixed small header of the ghost exchange: the count is always
+ * valid, and for payloads of up to P4EST_GHOST_INLINE quadrants the
+ * quadrants are coalesced into the same buffer */
+typedef struct
+{
+  p4est_locidx_t      count;
+  p4est_quadrant_t    quads[P4EST_GHOST_INLINE];
+}
+p4est_ghost_header_t;
+
+#endif /* P4EST_MPI */
+
+/* the optional neighborhood collective backend needs MPI-3 support */
+#if defined P4EST_MPI && \
+  defined P4EST_HAVE_MPI_DIST_GRAPH_CREATE_ADJACENT && \
+  defined P4EST_HAVE_MPI_NEIGHBOR_ALLTOALL && \
+  defined P4EST_HAVE_MPI_NEIGHBOR_ALLTOALLV
+#define P4EST_GHOST_NEIGHBORHOOD
+#endif
+
 size_t
 p4est_ghost_memory_used (p4est_ghost_t * ghost)
 {
   return sizeof (p4est_ghost_t) +
     sc_array_memory_used (&ghost->ghosts, 0) +
     (ghost->mpisize + 1) * sizeof (p4est_locidx_t) +
-    (ghost->num_trees + 1) * sizeof (p4est_locidx_t);
+    (ghost->num_trees + 1) * sizeof (p4est_locidx_t) +
+    (ghost->mirror_proc_offsets == NULL ? 0 :
+     (ghost->mpisize + 1 +
+      ghost->mirror_proc_offsets[ghost->mpisize]) * sizeof (p4est_locidx_t)) +
+    (ghost->mirror_proc_run_offsets == NULL ? 0 :
+     (ghost->mpisize + 1 +
+      2 * ghost->mirror_proc_run_offsets[ghost->mpisize]) *
+     sizeof (p4est_locidx_t)) +
+    (ghost->ghost_to_ghost_offsets == NULL ? 0 :
+     (ghost->ghosts.elem_count + 1 +
+      ghost->ghost_to_ghost_offsets[ghost->ghosts.elem_count]) *
+     sizeof (p4est_locidx_t));
+}
+
+p4est_ghost_compact_t *
+p4est_ghost_compact_new (p4est_ghost_t * ghost)
+{
+  size_t              zz, zcount;
+  p4est_quadrant_t   *q;
+  p4est_ghost_packed_t *pq;
+  p4est_ghost_compact_t *gc;
+
+  zcount = ghost->ghosts.elem_count;
+  P4EST_ASSERT (zcount <= (size_t) P4EST_LOCIDX_MAX);
+
+  gc = P4EST_ALLOC (p4est_ghost_compact_t, 1);
+  gc->mpisize = ghost->mpisize;
+  gc->num_trees = ghost->num_trees;
+  gc->num_ghosts = (p4est_locidx_t) zcount;
+  gc->ghosts = P4EST_ALLOC (p4est_ghost_packed_t, zcount);
+  gc->local_num = P4EST_ALLOC (p4est_locidx_t, zcount);
+  for (zz = 0; zz < zcount; ++zz) {
+    q = p4est_quadrant_array_index (&ghost->ghosts, zz);
+    pq = gc->ghosts + zz;
+    pq->x = q->x;
+    pq->y = q->y;
+#ifdef P4_TO_P8
+    pq->z = q->z;
+#endif
+    pq->level = q->level;
+    gc->local_num[zz] = q->p.piggy3.local_num;
+  }
+  gc->tree_offsets = P4EST_ALLOC (p4est_locidx_t, gc->num_trees + 1);
+  memcpy (gc->tree_offsets, ghost->tree_offsets,
+          (gc->num_trees + 1) * sizeof (p4est_locidx_t));
+  gc->proc_offsets = P4EST_ALLOC (p4est_locidx_t, gc->mpisize + 1);
+  memcpy (gc->proc_offsets, ghost->proc_offsets,
+          (gc->mpisize + 1) * sizeof (p4est_locidx_t));
+
+  return gc;
+}
+
+p4est_ghost_t      *
+p4est_ghost_compact_restore (p4est_ghost_compact_t * gc)
+{
+  size_t              zz;
+  p4est_topidx_t      nt;
+  p4est_quadrant_t   *q;
+  p4est_ghost_packed_t *pq;
+  p4est_ghost_t      *ghost;
+
+  ghost = P4EST_ALLOC (p4est_ghost_t, 1);
+  ghost->mpisize = gc->mpisize;
+  ghost->num_trees = gc->num_trees;
+  sc_array_init_size (&ghost->ghosts, sizeof (p4est_quadrant_t),
+                      (size_t) gc->num_ghosts);
+
+  /* the owner tree is interned in the tree offset ranges */
+  nt = 0;
+  for (zz = 0; zz < (size_t) gc->num_ghosts; ++zz) {
+    while (nt < gc->num_trees &&
+           gc->tree_offsets[nt + 1] <= (p4est_locidx_t) zz) {
+      ++nt;
+    }
+    q = p4est_quadrant_array_index (&ghost->ghosts, zz);
+    P4EST_QUADRANT_INIT (q);
+    pq = gc->ghosts + zz;
+    q->x = pq->x;
+    q->y = pq->y;
+#ifdef P4_TO_P8
+    q->z = pq->z;
+#endif
+    q->level = pq->level;
+    q->p.piggy3.which_tree = nt;
+    q->p.piggy3.local_num = gc->local_num[zz];
+    P4EST_ASSERT (p4est_quadrant_is_valid (q));
+  }
+
+  ghost->tree_offsets = P4EST_ALLOC (p4est_locidx_t, gc->num_trees + 1);
+  memcpy (ghost->tree_offsets, gc->tree_offsets,
+          (gc->num_trees + 1) * sizeof (p4est_locidx_t));
+  ghost->proc_offsets = P4EST_ALLOC (p4est_locidx_t, gc->mpisize + 1);
+  memcpy (ghost->proc_offsets, gc->proc_offsets,
+          (gc->mpisize + 1) * sizeof (p4est_locidx_t));
+
+  /* the pack plan and adjacency caches are rebuilt on demand; the
+   * mirror runs are lost since only p4est_ghost_new records them */
+  ghost->mirror_indices = NULL;
+  ghost->mirror_proc_offsets = NULL;
+  ghost->mirror_runs = NULL;
+  ghost->mirror_proc_run_offsets = NULL;
+  ghost->ghost_to_ghost_offsets = NULL;
+  ghost->ghost_to_ghost = NULL;
+
+  return ghost;
+}
+
+size_t
+p4est_ghost_compact_memory_used (p4est_ghost_compact_t * gc)
+{
+  return sizeof (p4est_ghost_compact_t) +
+    (size_t) gc->num_ghosts * (sizeof (p4est_ghost_packed_t) +
+                               sizeof (p4est_locidx_t)) +
+    (gc->num_trees + 1) * sizeof (p4est_locidx_t) +
+    (gc->mpisize + 1) * sizeof (p4est_locidx_t);
+}
+
+void
+p4est_ghost_compact_destroy (p4est_ghost_compact_t * gc)
+{
+  P4EST_FREE (gc->ghosts);
+  P4EST_FREE (gc->local_num);
+  P4EST_FREE (gc->tree_offsets);
+  P4EST_FREE (gc->proc_offsets);
+  P4EST_FREE (gc);
+}
+
+#ifdef P4EST_GHOST_NEIGHBORHOOD
+
+/** Return a distributed graph communicator over the given peer set.
+ * The communicator is cached in p4est->inspect and reused as long as
+ * the peer set is unchanged; otherwise it is rebuilt.
+ * \param [in] peers     Sorted array of peer ranks, symmetric by design
+ *                       of the ghost exchange.
+ */
+static MPI_Comm
+p4est_ghost_graph_comm (p4est_t * p4est, const int *peers, int num_peers)
+{
+  int                 mpiret;
+  p4est_inspect_t    *inspect = p4est->inspect;
+
+  P4EST_ASSERT (inspect != NULL);
+
+  if (inspect->ghost_graph_peers == NULL ||
+      inspect->ghost_graph_num_peers != num_peers ||
+      memcmp (inspect->ghost_graph_peers, peers,
+              num_peers * sizeof (int))) {
+    if (inspect->ghost_graph_peers != NULL) {
+      mpiret = MPI_Comm_free (&inspect->ghost_graph_comm);
+      SC_CHECK_MPI (mpiret);
+      P4EST_FREE (inspect->ghost_graph_peers);
+    }
+    inspect->ghost_graph_peers = P4EST_ALLOC (int, num_peers);
+    memcpy (inspect->ghost_graph_peers, peers, num_peers * sizeof (int));
+    inspect->ghost_graph_num_peers = num_peers;
+    mpiret = MPI_Dist_graph_create_adjacent (p4est->mpicomm,
+                                             num_peers, peers,
+                                             MPI_UNWEIGHTED,
+                                             num_peers, peers,
+                                             MPI_UNWEIGHTED, MPI_INFO_NULL,
+                                             0, &inspect->ghost_graph_comm);
+    SC_CHECK_MPI (mpiret);
+  }
+
+  return inspect->ghost_graph_comm;
+}
+
+#endif /* P4EST_GHOST_NEIGHBORHOOD */
+
+void
+p4est_ghost_neighborhood_release (p4est_t * p4est)
+{
+#ifdef P4EST_GHOST_NEIGHBORHOOD
+  int                 mpiret;
+  p4est_inspect_t    *inspect = p4est->inspect;
+
+  if (inspect != NULL && inspect->ghost_graph_peers != NULL) {
+    mpiret = MPI_Comm_free (&inspect->ghost_graph_comm);
+    SC_CHECK_MPI (mpiret);
+    P4EST_FREE (inspect->ghost_graph_peers);
+    inspect->ghost_graph_peers = NULL;
+    inspect->ghost_graph_num_peers = 0;
+  }
+#endif
 }
 
 #ifdef P4EST_MPI
@@ -81,7 +292,6 @@ p4est_quadrant_find_owner (p4est_t * p4est, p4est_topidx_t treeid,
 #ifdef P4EST_DEBUG
   int                 dims;
 #endif
-  int                 ftransform[P4EST_FTRANSFORM];
   p4est_topidx_t      ntreeid, ntreeid2;
   p4est_quadrant_t    nq;
 
@@ -142,9 +352,8 @@ p4est_quadrant_find_owner (p4est_t * p4est, p4est_topidx_t treeid,
     P4EST_ASSERT (face < P4EST_FACES && ntreeid >= 0);
   }
 
-  ntreeid2 = p4est_find_face_transform (conn, treeid, face, ftransform);
+  ntreeid2 = p4est_quadrant_transform_face_fast (conn, treeid, face, q, &nq);
   P4EST_ASSERT (ntreeid2 == ntreeid);
-  p4est_quadrant_transform_face (q, &nq, ftransform);
 
   return p4est_comm_find_owner (p4est, ntreeid, &nq, rank);
 }
@@ -883,6 +1092,54 @@ p4est_add_ghost_to_buf (sc_array_t * buf, p4est_topidx_t treeid,
   qnew->p.piggy3.local_num = number;
 }
 
+/** Record the mirror lists from the filled send buffers.
+ * Within a buffer the owner-local numbers ascend strictly, so runs of
+ * consecutive numbers collapse into (first, length) pairs.  Frontier
+ * quadrants cluster along the space-filling curve, which makes the
+ * compressed lists much smaller than the expanded pack plan.
+ */
+static void
+p4est_ghost_record_mirror_runs (p4est_ghost_t * gl, sc_array_t * send_bufs)
+{
+  const int           num_procs = gl->mpisize;
+  int                 i;
+  size_t              zz;
+  p4est_locidx_t      lnum;
+  p4est_locidx_t     *run;
+  p4est_quadrant_t   *q;
+  sc_array_t         *buf;
+  sc_array_t          runs;
+
+  P4EST_ASSERT (gl->mirror_runs == NULL &&
+                gl->mirror_proc_run_offsets == NULL);
+
+  sc_array_init (&runs, 2 * sizeof (p4est_locidx_t));
+  gl->mirror_proc_run_offsets = P4EST_ALLOC (p4est_locidx_t, num_procs + 1);
+  gl->mirror_proc_run_offsets[0] = 0;
+  for (i = 0; i < num_procs; ++i) {
+    buf = p4est_ghost_array_index (send_bufs, i);
+    run = NULL;
+    for (zz = 0; zz < buf->elem_count; ++zz) {
+      q = p4est_quadrant_array_index (buf, zz);
+      lnum = q->p.piggy3.local_num;
+      P4EST_ASSERT (run == NULL || lnum >= run[0] + run[1]);
+      if (run != NULL && lnum == run[0] + run[1]) {
+        ++run[1];
+      }
+      else {
+        run = (p4est_locidx_t *) sc_array_push (&runs);
+        run[0] = lnum;
+        run[1] = 1;
+      }
+    }
+    gl->mirror_proc_run_offsets[i + 1] = (p4est_locidx_t) runs.elem_count;
+  }
+  gl->mirror_runs = P4EST_ALLOC (p4est_locidx_t, 2 * runs.elem_count);
+  memcpy (gl->mirror_runs, runs.array,
+          2 * runs.elem_count * sizeof (p4est_locidx_t));
+  sc_array_reset (&runs);
+}
+
 #endif /* P4EST_MPI */
 
 int
@@ -1182,6 +1439,38 @@ ghost_tree_type (sc_array_t * array, size_t zindex, void *data)
   return (size_t) q->p.which_tree;
 }
 
+/** Recompute the tree offsets of a ghost layer from its quadrants. */
+static void
+p4est_ghost_calculate_tree_offsets (p4est_ghost_t * gl,
+                                    p4est_topidx_t num_trees)
+{
+  size_t             *ppz;
+  sc_array_t          split;
+  p4est_topidx_t      nt;
+
+  sc_array_init (&split, sizeof (size_t));
+  sc_array_split (&gl->ghosts, &split,
+                  (size_t) num_trees, ghost_tree_type, NULL);
+  P4EST_ASSERT (split.elem_count == (size_t) num_trees + 1);
+  for (nt = 0; nt <= num_trees; ++nt) {
+    ppz = (size_t *) sc_array_index (&split, (size_t) nt);
+    gl->tree_offsets[nt] = *ppz;
+#ifdef P4EST_DEBUG
+    if (nt > 0) {
+      p4est_locidx_t      lk;
+      p4est_quadrant_t   *q3;
+
+      for (lk = gl->tree_offsets[nt - 1]; lk < gl->tree_offsets[nt]; ++lk) {
+        q3 = p4est_quadrant_array_index (&gl->ghosts, (size_t) lk);
+        SC_CHECK_ABORT (q3->p.which_tree == nt - 1, "Ghost tree offset");
+      }
+    }
+#endif
+  }
+  sc_array_reset (&split);
+  P4EST_ASSERT (gl->tree_offsets[0] == 0);
+}
+
 #ifdef P4EST_MPI
 
 static void
@@ -1269,46 +1558,307 @@ p4est_ghost_test_add (p4est_t * p4est, p4est_quadrant_t * q, p4est_topidx_t t,
   }
 }
 
-#endif /* P4EST_MPI */
+/** Count the remote owners of the same-size face neighbor \a nq of the
+ * local quadrant \a q.  This is p4est_ghost_test_add with the buffer
+ * fill replaced by a per-rank counter, so the set of ranks counted for
+ * (\a q, \a nq) equals the set the ghost construction would send to.
+ */
+static void
+p4est_boundary_summary_count (p4est_t * p4est, p4est_quadrant_t * q,
+                              p4est_quadrant_t * nq, p4est_topidx_t nt,
+                              int32_t touch, int rank,
+                              p4est_locidx_t * counts)
+{
+  p4est_quadrant_t    temp;
+  p4est_quadrant_t   *lq, *uq;
+  int64_t             next_lid, uid;
+  int                 n0_proc, n1_proc, proc;
+  p4est_quadrant_t   *gfp = p4est->global_first_position;
+  int32_t             rb;
 
-static p4est_ghost_t *
-p4est_ghost_new_check (p4est_t * p4est, p4est_connect_type_t btype,
-                       p4est_ghost_tolerance_t tol)
+  P4EST_ASSERT (q->level == nq->level);
+  n0_proc = p4est_comm_find_owner (p4est, nt, nq, rank);
+  P4EST_ASSERT (n0_proc >= 0);
+  if (q->level == P4EST_QMAXLEVEL) {
+    if (n0_proc != rank) {
+      ++counts[n0_proc];
+    }
+    return;
+  }
+  p4est_quadrant_last_descendant (nq, &temp, P4EST_QMAXLEVEL);
+  n1_proc = p4est_comm_find_owner (p4est, nt, &temp, n0_proc);
+  P4EST_ASSERT (n1_proc >= n0_proc);
+  if (n0_proc == n1_proc) {
+    if (n0_proc != rank) {
+      ++counts[n0_proc];
+    }
+    return;
+  }
+  for (proc = n0_proc; proc <= n1_proc; proc++) {
+    if (proc == rank) {
+      continue;
+    }
+    lq = &(gfp[proc]);
+    uq = &(gfp[proc + 1]);
+    /* check for empty processor */
+    if (p4est_quadrant_is_equal_piggy (lq, uq)) {
+      continue;
+    }
+    if (proc == n0_proc) {
+      lq = NULL;
+    }
+    if (proc == n1_proc) {
+      uq = NULL;
+    }
+    else {
+      next_lid = p4est_quadrant_linear_id (uq, P4EST_QMAXLEVEL);
+      P4EST_ASSERT (next_lid > 0);
+      uid = next_lid - 1;
+      uq = &temp;
+      p4est_quadrant_set_morton (uq, P4EST_QMAXLEVEL, uid);
+    }
+    rb = p4est_find_range_boundaries (lq, uq, (int) q->level,
+#ifdef P4_TO_P8
+                                      NULL,
+#endif
+                                      NULL, NULL);
+    if (rb & touch) {
+      ++counts[proc];
+    }
+  }
+}
+
+/** Collect the indices of quadrants whose 3x3 neighborhood may reach
+ * beyond the locally owned range.  The sweep compares each quadrant's
+ * lowest and highest possible neighbor directly against the first and
+ * next owned position of this tree, so interior quadrants are skipped
+ * with two quadrant comparisons and no owner searches at all.  The
+ * result is equivalent to the per-quadrant test in
+ * p4est_comm_neighborhood_owned.
+ * \param [in] quadrants      The sorted quadrants of the local tree \a nt.
+ * \param [in] nt             A local tree number.
+ * \param [in] full_tree      Flags as computed by p4est_comm_tree_info.
+ * \param [in] tree_contact   Flags as computed by p4est_comm_tree_info.
+ * \param [in] first_pos      First owned position from p4est_comm_tree_info.
+ * \param [in] next_pos       First position of the next processor.
+ * \param [in,out] frontier   Array of size_t, resized to hold the indices
+ *                            of the frontier quadrants in \a quadrants.
+ * \return                    The number of frontier quadrants.
+ */
+static size_t
+p4est_ghost_tree_frontier (sc_array_t * quadrants, p4est_topidx_t nt,
+                           const int full_tree[2], const int tree_contact[],
+                           const p4est_quadrant_t * first_pos,
+                           const p4est_quadrant_t * next_pos,
+                           sc_array_t * frontier)
+{
+  const int           whole_tree = full_tree[0] && full_tree[1];
+  int                 owned;
+  size_t              zz;
+  p4est_qcoord_t      qh;
+  p4est_quadrant_t   *q;
+  p4est_quadrant_t    n0, n1;
+
+  P4EST_ASSERT (quadrants->elem_size == sizeof (p4est_quadrant_t));
+  P4EST_ASSERT (frontier->elem_size == sizeof (size_t));
+  P4EST_ASSERT (first_pos->level == P4EST_QMAXLEVEL);
+  P4EST_ASSERT (next_pos->level == P4EST_QMAXLEVEL);
+
+  P4EST_QUADRANT_INIT (&n0);
+  P4EST_QUADRANT_INIT (&n1);
+
+  sc_array_resize (frontier, 0);
+  for (zz = 0; zz < quadrants->elem_count; ++zz) {
+    q = p4est_quadrant_array_index (quadrants, zz);
+    qh = P4EST_QUADRANT_LEN (q->level);
+
+    if (whole_tree) {
+      /* the local range covers this tree: only tree boundary quadrants
+       * can have remote neighbors */
+      owned = !((tree_contact[0] && q->x == 0) ||
+                (tree_contact[1] && q->x == P4EST_ROOT_LEN - qh) ||
+                (tree_contact[2] && q->y == 0) ||
+                (tree_contact[3] && q->y == P4EST_ROOT_LEN - qh) ||
+#ifdef P4_TO_P8
+                (tree_contact[4] && q->z == 0) ||
+                (tree_contact[5] && q->z == P4EST_ROOT_LEN - qh) ||
+#endif
+                0);
+    }
+    else if (q->x - qh < 0 || q->y - qh < 0 ||
+             q->x + qh + qh > P4EST_ROOT_LEN ||
+             q->y + qh + qh > P4EST_ROOT_LEN ||
+#ifdef P4_TO_P8
+             q->z - qh < 0 || q->z + qh + qh > P4EST_ROOT_LEN ||
+#endif
+             0) {
+      /* the neighborhood pokes out of the tree */
+      owned = 0;
+    }
+    else {
+      /* the ownership range is a contiguous interval of positions, so
+       * it covers the neighborhood iff it contains the first descendant
+       * of the lowest and the last descendant of the highest neighbor */
+      n0.x = q->x - qh;
+      n0.y = q->y - qh;
+#ifdef P4_TO_P8
+      n0.z = q->z - qh;
+#endif
+      n0.level = P4EST_QMAXLEVEL;
+      n1.x = q->x + qh;
+      n1.y = q->y + qh;
+#ifdef P4_TO_P8
+      n1.z = q->z + qh;
+#endif
+      n1.level = q->level;
+      p4est_quadrant_last_descendant (&n1, &n1, P4EST_QMAXLEVEL);
+      owned =
+        (nt > first_pos->p.which_tree ||
+         p4est_quadrant_compare (first_pos, &n0) <= 0) &&
+        (nt < next_pos->p.which_tree ||
+         p4est_quadrant_compare (&n1, next_pos) < 0);
+    }
+
+    if (!owned) {
+      *(size_t *) sc_array_push (frontier) = zz;
+    }
+  }
+
+  return frontier->elem_count;
+}
+
+#ifdef P4EST_GHOST_NEIGHBORHOOD
+
+/** Exchange the ghost quadrants through MPI-3 neighborhood collectives.
+ * The peer set of the ghost exchange is symmetric, so the send buffers
+ * determine both directions of the graph topology.
+ */
+static void
+p4est_ghost_exchange_neighborhood (p4est_t * p4est, p4est_ghost_t * gl,
+                                   sc_array_t * ghost_layer,
+                                   sc_array_t * send_bufs, int num_peers)
 {
-  const p4est_topidx_t num_trees = p4est->connectivity->num_trees;
   const int           num_procs = p4est->mpisize;
-#ifdef P4EST_MPI
+  int                 i, peer;
+  int                 mpiret;
+  int                *peers, *bcnt_send, *bcnt_recv, *sdispls, *rdispls;
+  char               *sendbuf;
+  size_t              sbytes;
+  sc_array_t         *buf;
+  p4est_locidx_t     *recv_counts, *send_counts;
+  p4est_locidx_t      num_ghosts, ghost_offset;
+  MPI_Comm            graphcomm;
+
+  peers = P4EST_ALLOC (int, num_peers);
+  recv_counts = P4EST_ALLOC (p4est_locidx_t, 2 * num_peers);
+  send_counts = recv_counts + num_peers;
+  for (i = 0, peer = 0; i < num_procs; ++i) {
+    buf = p4est_ghost_array_index (send_bufs, i);
+    if (buf->elem_count > 0) {
+      P4EST_ASSERT (i != p4est->mpirank);
+      peers[peer] = i;
+      send_counts[peer] = (p4est_locidx_t) buf->elem_count;
+      ++peer;
+    }
+  }
+  P4EST_ASSERT (peer == num_peers);
+  graphcomm = p4est_ghost_graph_comm (p4est, peers, num_peers);
+
+  /* Exchange the counts of ghosts */
+  mpiret = MPI_Neighbor_alltoall (send_counts, 1, P4EST_MPI_LOCIDX,
+                                  recv_counts, 1, P4EST_MPI_LOCIDX,
+                                  graphcomm);
+  SC_CHECK_MPI (mpiret);
+
+  /* Allocate space for the ghosts */
+  for (peer = 0, num_ghosts = 0; peer < num_peers; ++peer) {
+    P4EST_ASSERT (recv_counts[peer] > 0);
+    num_ghosts += recv_counts[peer];    /* same type */
+  }
+  sc_array_resize (ghost_layer, (size_t) num_ghosts);
+
+  /* Pack the sends contiguously and set up byte counts and displacements */
+  bcnt_send = P4EST_ALLOC (int, 4 * num_peers);
+  bcnt_recv = bcnt_send + num_peers;
+  sdispls = bcnt_send + 2 * num_peers;
+  rdispls = bcnt_send + 3 * num_peers;
+  sbytes = 0;
+  for (peer = 0; peer < num_peers; ++peer) {
+    sbytes += (size_t) send_counts[peer] * sizeof (p4est_quadrant_t);
+  }
+  sendbuf = (char *) p4est_staging_acquire (sbytes);
+  sbytes = 0;
+  for (i = 0, peer = 0, ghost_offset = 0; i < num_procs; ++i) {
+    buf = p4est_ghost_array_index (send_bufs, i);
+    if (buf->elem_count > 0) {
+      bcnt_send[peer] = (int) (send_counts[peer] * sizeof (p4est_quadrant_t));
+      sdispls[peer] = (int) sbytes;
+      memcpy (sendbuf + sbytes, buf->array, (size_t) bcnt_send[peer]);
+      sbytes += (size_t) bcnt_send[peer];
+      bcnt_recv[peer] = (int) (recv_counts[peer] * sizeof (p4est_quadrant_t));
+      rdispls[peer] = (int) (ghost_offset * sizeof (p4est_quadrant_t));
+      ghost_offset += recv_counts[peer];        /* same type */
+      ++peer;
+    }
+    /* proc_offsets[0] is set by the caller */
+    gl->proc_offsets[i + 1] = ghost_offset;
+  }
+  P4EST_ASSERT (ghost_offset == num_ghosts);
+
+  /* Exchange the ghosts */
+  mpiret = MPI_Neighbor_alltoallv (sendbuf, bcnt_send, sdispls, MPI_BYTE,
+                                   ghost_layer->array, bcnt_recv, rdispls,
+                                   MPI_BYTE, graphcomm);
+  SC_CHECK_MPI (mpiret);
+
+  p4est_staging_release (sendbuf);
+  P4EST_FREE (bcnt_send);
+  P4EST_FREE (recv_counts);
+  P4EST_FREE (peers);
+}
+
+#endif /* P4EST_GHOST_NEIGHBORHOOD */
+
+/** Fill the per-processor send buffers with the local border quadrants.
+ * Interior quadrants are skipped through the frontier sweep; neighbor
+ * generation runs on the remaining boundary quadrants and appends each
+ * one to the buffers of the smaller remote neighbor owners.
+ * \param [in] p4est          The forest.
+ * \param [in] btype          Connection type to consider.
+ * \param [in] tol            Tolerance towards unbalanced neighbors.
+ * \param [in,out] send_bufs  Array of one quadrant buffer per processor.
+ * \param [out] pskipped      Number of quadrants skipped as interior.
+ * \return                    True if an owner inconsistency was found;
+ *                            this is only checked for tolerances below
+ *                            P4EST_GHOST_UNBALANCED_ALLOW.
+ */
+static int
+p4est_ghost_fill_send_bufs (p4est_t * p4est, p4est_connect_type_t btype,
+                            p4est_ghost_tolerance_t tol,
+                            sc_array_t * send_bufs,
+                            p4est_locidx_t * pskipped)
+{
   const int           rank = p4est->mpirank;
-  MPI_Comm            comm = p4est->mpicomm;
   p4est_connectivity_t *conn = p4est->connectivity;
   int                 face, corner;
   int                 nface, ncheck, ncount;
   int                 i;
   int                 n0_proc, n0ur_proc, n1_proc;
-  int                 num_peers, peer, peer_proc;
-  int                 mpiret;
   int                 maxed, failed;
   int                 full_tree[2], tree_contact[2 * P4EST_DIM];
   int                 urg[P4EST_DIM - 1];
-  size_t              pz, zz;
+  size_t              pz, zz, fz, frontier_count;
   p4est_topidx_t      first_local_tree = p4est->first_local_tree;
   p4est_topidx_t      last_local_tree = p4est->last_local_tree;
-#ifdef P4EST_DEBUG
-  p4est_locidx_t      li;
-#endif
+  const p4est_quadrant_t *first_pos, *next_pos;
   p4est_locidx_t      local_num;
-  p4est_locidx_t      num_ghosts, ghost_offset, skipped;
-  p4est_locidx_t     *send_counts, *recv_counts;
+  p4est_locidx_t      skipped;
   p4est_tree_t       *tree;
   p4est_quadrant_t   *q;
   p4est_quadrant_t    n[P4EST_HALF], nur[P4EST_HALF];
-  sc_array_t          send_bufs;
+  sc_array_t          frontier;
   sc_array_t          procs[P4EST_DIM - 1];
   sc_array_t         *buf, *quadrants;
-  MPI_Request        *recv_request, *send_request;
-  MPI_Status         *recv_status, *send_status;
-  MPI_Request        *recv_load_request, *send_load_request;
-  MPI_Status         *recv_load_status, *send_load_status;
 #ifdef P4_TO_P8
   int                 edge, nedge;
   p8est_edge_info_t   ei;
@@ -1320,40 +1870,18 @@ p4est_ghost_new_check (p4est_t * p4est, p4est_connect_type_t btype,
   int                 nc0, nc1;
   int                 oppedge;
   int                 n1ur_proc;
-#endif
-#ifdef P4EST_DEBUG
-  p4est_quadrant_t   *q2;
 #endif
   int32_t             touch;
   p4est_topidx_t      nnt;
+  p4est_topidx_t      nt;
   int                 ftransform[P4EST_FTRANSFORM];
   p4est_corner_info_t ci;
   p4est_corner_transform_t *ct;
   sc_array_t         *cta;
   size_t              ctree;
-#endif
-  size_t             *ppz;
-  sc_array_t          split;
-  sc_array_t         *ghost_layer;
-  p4est_topidx_t      nt;
-  p4est_ghost_t      *gl;
-
-  P4EST_GLOBAL_PRODUCTIONF ("Into " P4EST_STRING "_ghost_new %s\n",
-                            p4est_connect_type_string (btype));
-
-  gl = P4EST_ALLOC (p4est_ghost_t, 1);
-  gl->mpisize = num_procs;
-  gl->num_trees = num_trees;
-  ghost_layer = &gl->ghosts;
-  sc_array_init (ghost_layer, sizeof (p4est_quadrant_t));
-  gl->tree_offsets = P4EST_ALLOC (p4est_locidx_t, num_trees + 1);
-  gl->proc_offsets = P4EST_ALLOC (p4est_locidx_t, num_procs + 1);
-  gl->proc_offsets[0] = 0;
-#ifndef P4EST_MPI
-  gl->proc_offsets[1] = 0;
-#else
-#ifdef P4_TO_P8
-  eta = &ei.edge_transforms;
+
+#ifdef P4_TO_P8
+  eta = &ei.edge_transforms;
 #endif
   cta = &ci.corner_transforms;
 
@@ -1366,33 +1894,29 @@ p4est_ghost_new_check (p4est_t * p4est, p4est_connect_type_t btype,
   for (i = 0; i < P4EST_DIM - 1; ++i) {
     sc_array_init (&procs[i], sizeof (int));
   }
+  sc_array_init (&frontier, sizeof (size_t));
   skipped = 0;
 
-  /* allocate empty send buffers */
-  sc_array_init (&send_bufs, sizeof (sc_array_t));
-  sc_array_resize (&send_bufs, (size_t) num_procs);
-  for (i = 0; i < num_procs; ++i) {
-    buf = p4est_ghost_array_index (&send_bufs, i);
-    sc_array_init (buf, sizeof (p4est_quadrant_t));
-  }
-
   /* loop over all local trees */
-  local_num = 0;
   for (nt = first_local_tree; nt <= last_local_tree; ++nt) {
     tree = p4est_tree_array_index (p4est->trees, nt);
     quadrants = &tree->quadrants;
-    p4est_comm_tree_info (p4est, nt, full_tree, tree_contact, NULL, NULL);
-
-    /* Find the smaller neighboring processors of each quadrant */
-    for (zz = 0; zz < quadrants->elem_count; ++local_num, ++zz) {
+    p4est_comm_tree_info (p4est, nt, full_tree, tree_contact,
+                          &first_pos, &next_pos);
+
+    /* extract the boundary quadrants in one cheap sweep so that all
+     * neighbor generation below runs on the frontier only */
+    frontier_count = p4est_ghost_tree_frontier (quadrants, nt,
+                                                full_tree, tree_contact,
+                                                first_pos, next_pos,
+                                                &frontier);
+    skipped += (p4est_locidx_t) (quadrants->elem_count - frontier_count);
+
+    /* Find the smaller neighboring processors of each frontier quadrant */
+    for (fz = 0; fz < frontier_count; ++fz) {
+      zz = *(size_t *) sc_array_index (&frontier, fz);
       q = p4est_quadrant_array_index (quadrants, zz);
-
-      if (p4est_comm_neighborhood_owned
-          (p4est, nt, full_tree, tree_contact, q)) {
-        /* The 3x3 neighborhood of q is owned by this processor */
-        ++skipped;
-        continue;
-      }
+      local_num = tree->quadrants_offset + (p4est_locidx_t) zz;
 
       /* Find smaller face neighbors */
       for (face = 0; face < 2 * P4EST_DIM; ++face) {
@@ -1424,7 +1948,7 @@ p4est_ghost_new_check (p4est_t * p4est, p4est_connect_type_t btype,
             }
 
             if (n0_proc != rank && n0_proc >= 0 && n0_proc != n1_proc) {
-              buf = p4est_ghost_array_index (&send_bufs, n0_proc);
+              buf = p4est_ghost_array_index (send_bufs, n0_proc);
               p4est_add_ghost_to_buf (buf, nt, local_num, q);
               n1_proc = n0_proc;
             }
@@ -1436,19 +1960,19 @@ p4est_ghost_new_check (p4est_t * p4est, p4est_connect_type_t btype,
             nface = face ^ 1;
             touch = ((int32_t) 1 << nface);
             p4est_ghost_test_add (p4est, q, nt, &n[0], nt, touch, rank,
-                                  &send_bufs, local_num);
+                                  send_bufs, local_num);
           }
           else {
-            nnt = p4est_find_face_transform (conn, nt, face, ftransform);
+            nnt = p4est_quadrant_transform_face_fast (conn, nt, face,
+                                                      &n[0], &n[1]);
             if (nnt < 0) {
               continue;
             }
             nface = (int) conn->tree_to_face[nt * P4EST_FACES + face];
             nface %= P4EST_FACES;
             touch = ((int32_t) 1 << nface);
-            p4est_quadrant_transform_face (&n[0], &n[1], ftransform);
             p4est_ghost_test_add (p4est, q, nt, &n[1], nnt, touch, rank,
-                                  &send_bufs, local_num);
+                                  send_bufs, local_num);
           }
         }
       }
@@ -1495,7 +2019,7 @@ p4est_ghost_new_check (p4est_t * p4est, p4est_connect_type_t btype,
               n0_proc = *((int *) sc_array_index (&procs[0], pz));
 
               if (n0_proc != rank) {
-                buf = p4est_ghost_array_index (&send_bufs, n0_proc);
+                buf = p4est_ghost_array_index (send_bufs, n0_proc);
                 p4est_add_ghost_to_buf (buf, nt, local_num, q);
               }
 
@@ -1503,7 +2027,7 @@ p4est_ghost_new_check (p4est_t * p4est, p4est_connect_type_t btype,
                 n1_proc = *((int *) sc_array_index (&procs[1], pz));
 
                 if (n1_proc != n0_proc && n1_proc != rank) {
-                  buf = p4est_ghost_array_index (&send_bufs, n1_proc);
+                  buf = p4est_ghost_array_index (send_bufs, n1_proc);
                   p4est_add_ghost_to_buf (buf, nt, local_num, q);
                 }
               }
@@ -1531,12 +2055,12 @@ p4est_ghost_new_check (p4est_t * p4est, p4est_connect_type_t btype,
             }
 
             if (n0_proc != rank && n0_proc >= 0) {
-              buf = p4est_ghost_array_index (&send_bufs, n0_proc);
+              buf = p4est_ghost_array_index (send_bufs, n0_proc);
               p4est_add_ghost_to_buf (buf, nt, local_num, q);
             }
 
             if (n1_proc != n0_proc && n1_proc != rank && n1_proc >= 0) {
-              buf = p4est_ghost_array_index (&send_bufs, n1_proc);
+              buf = p4est_ghost_array_index (send_bufs, n1_proc);
               p4est_add_ghost_to_buf (buf, nt, local_num, q);
             }
           }
@@ -1547,7 +2071,7 @@ p4est_ghost_new_check (p4est_t * p4est, p4est_connect_type_t btype,
             nedge = edge ^ 3;
             touch = ((int32_t) 1 << (6 + nedge));
             p4est_ghost_test_add (p4est, q, nt, &n[0], nt, touch, rank,
-                                  &send_bufs, local_num);
+                                  send_bufs, local_num);
           }
           else if (p4est_quadrant_is_outside_face (&n[0])) {
             P4EST_ASSERT (p4est_quadrant_is_extended (&n[0]));
@@ -1593,7 +2117,7 @@ p4est_ghost_new_check (p4est_t * p4est, p4est_connect_type_t btype,
             touch = ((int32_t) 1 << (6 + nedge));
             p4est_quadrant_transform_face (&n[0], &n[1], ftransform);
             p4est_ghost_test_add (p4est, q, nt, &n[1], nnt, touch, rank,
-                                  &send_bufs, local_num);
+                                  send_bufs, local_num);
           }
           else {
             P4EST_ASSERT (p8est_quadrant_is_outside_edge (&n[0]));
@@ -1606,7 +2130,7 @@ p4est_ghost_new_check (p4est_t * p4est, p4est_connect_type_t btype,
               nedge = (int) et->nedge;
               touch = ((int32_t) 1 << (6 + nedge));
               p4est_ghost_test_add (p4est, q, nt, &n[1], nnt, touch, rank,
-                                    &send_bufs, local_num);
+                                    send_bufs, local_num);
             }
             sc_array_reset (eta);
           }
@@ -1645,7 +2169,7 @@ p4est_ghost_new_check (p4est_t * p4est, p4est_connect_type_t btype,
               n0_proc = *((int *) sc_array_index (&procs[0], pz));
 
               if (n0_proc != rank) {
-                buf = p4est_ghost_array_index (&send_bufs, n0_proc);
+                buf = p4est_ghost_array_index (send_bufs, n0_proc);
                 p4est_add_ghost_to_buf (buf, nt, local_num, q);
               }
             }
@@ -1666,7 +2190,7 @@ p4est_ghost_new_check (p4est_t * p4est, p4est_connect_type_t btype,
               n0_proc = *((int *) sc_array_index (&procs[0], pz));
 
               if (n0_proc != rank) {
-                buf = p4est_ghost_array_index (&send_bufs, n0_proc);
+                buf = p4est_ghost_array_index (send_bufs, n0_proc);
                 p4est_add_ghost_to_buf (buf, nt, local_num, q);
               }
             }
@@ -1691,7 +2215,7 @@ p4est_ghost_new_check (p4est_t * p4est, p4est_connect_type_t btype,
             }
 
             if (n0_proc != rank && n0_proc >= 0) {
-              buf = p4est_ghost_array_index (&send_bufs, n0_proc);
+              buf = p4est_ghost_array_index (send_bufs, n0_proc);
               p4est_add_ghost_to_buf (buf, nt, local_num, q);
             }
           }
@@ -1704,7 +2228,7 @@ p4est_ghost_new_check (p4est_t * p4est, p4est_connect_type_t btype,
             n0_proc = p4est_comm_find_owner (p4est, nt, &n[0], rank);
             P4EST_ASSERT (n0_proc >= 0);
             if (n0_proc != rank) {
-              buf = p4est_ghost_array_index (&send_bufs, n0_proc);
+              buf = p4est_ghost_array_index (send_bufs, n0_proc);
               p4est_add_ghost_to_buf (buf, nt, local_num, q);
             }
           }
@@ -1720,14 +2244,14 @@ p4est_ghost_new_check (p4est_t * p4est, p4est_connect_type_t btype,
             else {
               face = p4est_corner_faces[corner][P4EST_DIM - 1];
             }
-            nnt = p4est_find_face_transform (conn, nt, face, ftransform);
+            nnt = p4est_quadrant_transform_face_fast (conn, nt, face,
+                                                      &n[0], &n[1]);
             if (nnt < 0) {
               continue;
             }
-            p4est_quadrant_transform_face (&n[0], &n[1], ftransform);
             n0_proc = p4est_comm_find_owner (p4est, nnt, &n[1], rank);
             if (n0_proc != rank) {
-              buf = p4est_ghost_array_index (&send_bufs, n0_proc);
+              buf = p4est_ghost_array_index (send_bufs, n0_proc);
               p4est_add_ghost_to_buf (buf, nt, local_num, q);
             }
           }
@@ -1741,7 +2265,7 @@ p4est_ghost_new_check (p4est_t * p4est, p4est_connect_type_t btype,
               nnt = et->ntree;
               n0_proc = p4est_comm_find_owner (p4est, nnt, &n[1], rank);
               if (n0_proc != rank) {
-                buf = p4est_ghost_array_index (&send_bufs, n0_proc);
+                buf = p4est_ghost_array_index (send_bufs, n0_proc);
                 p4est_add_ghost_to_buf (buf, nt, local_num, q);
               }
             }
@@ -1757,7 +2281,7 @@ p4est_ghost_new_check (p4est_t * p4est, p4est_connect_type_t btype,
               nnt = ct->ntree;
               n0_proc = p4est_comm_find_owner (p4est, nnt, &n[0], rank);
               if (n0_proc != rank) {
-                buf = p4est_ghost_array_index (&send_bufs, n0_proc);
+                buf = p4est_ghost_array_index (send_bufs, n0_proc);
                 p4est_add_ghost_to_buf (buf, nt, local_num, q);
               }
             }
@@ -1769,9 +2293,187 @@ p4est_ghost_new_check (p4est_t * p4est, p4est_connect_type_t btype,
       P4EST_ASSERT (btype == P4EST_CONNECT_FULL);
     }
   }
-  P4EST_ASSERT (local_num == p4est->local_num_quadrants);
 
 failtest:
+  for (i = 0; i < P4EST_DIM - 1; ++i) {
+    sc_array_reset (&procs[i]);
+  }
+  sc_array_reset (&frontier);
+
+  *pskipped = skipped;
+  return failed;
+}
+
+#endif /* P4EST_MPI */
+
+p4est_boundary_summary_t *
+p4est_boundary_summary_new (p4est_t * p4est)
+{
+  const int           num_procs = p4est->mpisize;
+  int                 proc;
+  p4est_locidx_t     *counts;
+  p4est_boundary_summary_t *bs;
+#ifdef P4EST_MPI
+  const int           rank = p4est->mpirank;
+  p4est_connectivity_t *conn = p4est->connectivity;
+  int                 face, nface;
+  int                 full_tree[2], tree_contact[P4EST_FACES];
+  int32_t             touch;
+  size_t              fz, zz, frontier_count;
+  p4est_topidx_t      nt, nnt;
+  const p4est_quadrant_t *first_pos, *next_pos;
+  p4est_quadrant_t   *q;
+  p4est_quadrant_t    nq, tq;
+  p4est_tree_t       *tree;
+  sc_array_t         *quadrants;
+  sc_array_t          frontier;
+#endif
+
+  counts = P4EST_ALLOC_ZERO (p4est_locidx_t, num_procs);
+
+#ifdef P4EST_MPI
+  P4EST_QUADRANT_INIT (&nq);
+  P4EST_QUADRANT_INIT (&tq);
+  sc_array_init (&frontier, sizeof (size_t));
+
+  for (nt = p4est->first_local_tree; nt <= p4est->last_local_tree; ++nt) {
+    tree = p4est_tree_array_index (p4est->trees, nt);
+    quadrants = &tree->quadrants;
+    p4est_comm_tree_info (p4est, nt, full_tree, tree_contact,
+                          &first_pos, &next_pos);
+    frontier_count = p4est_ghost_tree_frontier (quadrants, nt,
+                                                full_tree, tree_contact,
+                                                first_pos, next_pos,
+                                                &frontier);
+    for (fz = 0; fz < frontier_count; ++fz) {
+      zz = *(size_t *) sc_array_index (&frontier, fz);
+      q = p4est_quadrant_array_index (quadrants, zz);
+      for (face = 0; face < P4EST_FACES; ++face) {
+        p4est_quadrant_face_neighbor (q, face, &nq);
+        if (p4est_quadrant_is_inside_root (&nq)) {
+          touch = ((int32_t) 1 << (face ^ 1));
+          p4est_boundary_summary_count (p4est, q, &nq, nt, touch, rank,
+                                        counts);
+        }
+        else {
+          nnt = p4est_quadrant_transform_face_fast (conn, nt, face,
+                                                    &nq, &tq);
+          if (nnt < 0) {
+            /* the face neighbor is outside the physical domain */
+            continue;
+          }
+          nface = (int) conn->tree_to_face[nt * P4EST_FACES + face];
+          nface %= P4EST_FACES;
+          touch = ((int32_t) 1 << nface);
+          p4est_boundary_summary_count (p4est, q, &tq, nnt, touch, rank,
+                                        counts);
+        }
+      }
+    }
+  }
+  sc_array_reset (&frontier);
+#endif /* P4EST_MPI */
+
+  bs = P4EST_ALLOC (p4est_boundary_summary_t, 1);
+  bs->num_peers = 0;
+  for (proc = 0; proc < num_procs; ++proc) {
+    bs->num_peers += (counts[proc] > 0);
+  }
+  bs->peer_ranks = P4EST_ALLOC (int, bs->num_peers);
+  bs->peer_counts = P4EST_ALLOC (p4est_locidx_t, bs->num_peers);
+  bs->num_peers = 0;
+  for (proc = 0; proc < num_procs; ++proc) {
+    if (counts[proc] > 0) {
+      bs->peer_ranks[bs->num_peers] = proc;
+      bs->peer_counts[bs->num_peers] = counts[proc];
+      ++bs->num_peers;
+    }
+  }
+  P4EST_FREE (counts);
+
+  return bs;
+}
+
+void
+p4est_boundary_summary_destroy (p4est_boundary_summary_t * bs)
+{
+  P4EST_FREE (bs->peer_ranks);
+  P4EST_FREE (bs->peer_counts);
+  P4EST_FREE (bs);
+}
+
+static p4est_ghost_t *
+p4est_ghost_new_check (p4est_t * p4est, p4est_connect_type_t btype,
+                       p4est_ghost_tolerance_t tol)
+{
+  const p4est_topidx_t num_trees = p4est->connectivity->num_trees;
+  const int           num_procs = p4est->mpisize;
+#ifdef P4EST_MPI
+  const int           rank = p4est->mpirank;
+  MPI_Comm            comm = p4est->mpicomm;
+  int                 i;
+  int                 num_peers, peer, peer_proc;
+  int                 mpiret;
+  int                 failed;
+#ifdef P4EST_DEBUG
+  p4est_locidx_t      li;
+  p4est_quadrant_t   *q2;
+#endif
+  p4est_locidx_t      num_ghosts, ghost_offset, skipped;
+  p4est_locidx_t     *send_counts, *recv_counts;
+  p4est_ghost_header_t *recv_hdrs, *send_hdrs;
+  size_t              hbytes;
+  p4est_quadrant_t   *q;
+  sc_array_t          send_bufs;
+  sc_array_t         *buf;
+  MPI_Request        *recv_request, *send_request;
+  MPI_Status         *recv_status, *send_status;
+  MPI_Request        *recv_load_request, *send_load_request;
+  MPI_Status         *recv_load_status, *send_load_status;
+#endif
+  sc_array_t         *ghost_layer;
+  p4est_ghost_t      *gl;
+
+  P4EST_GLOBAL_PRODUCTIONF ("Into " P4EST_STRING "_ghost_new %s\n",
+                            p4est_connect_type_string (btype));
+  p4est_profile_fire (p4est, P4EST_PROFILE_GHOST, 0);
+
+  /* start timing and reset the communication counters */
+  if (p4est->inspect != NULL) {
+    p4est->inspect->ghost_time = -MPI_Wtime ();
+    p4est->inspect->ghost_comm_sent = 0;
+    p4est->inspect->ghost_nzpeers = 0;
+  }
+
+  gl = P4EST_ALLOC (p4est_ghost_t, 1);
+  gl->mpisize = num_procs;
+  gl->num_trees = num_trees;
+  ghost_layer = &gl->ghosts;
+  sc_array_init (ghost_layer, sizeof (p4est_quadrant_t));
+  gl->tree_offsets = P4EST_ALLOC (p4est_locidx_t, num_trees + 1);
+  gl->proc_offsets = P4EST_ALLOC (p4est_locidx_t, num_procs + 1);
+  gl->mirror_indices = NULL;
+  gl->mirror_proc_offsets = NULL;
+  gl->mirror_runs = NULL;
+  gl->mirror_proc_run_offsets = NULL;
+  gl->ghost_to_ghost_offsets = NULL;
+  gl->ghost_to_ghost = NULL;
+  gl->proc_offsets[0] = 0;
+#ifndef P4EST_MPI
+  gl->proc_offsets[1] = 0;
+#else
+  /* allocate empty send buffers */
+  sc_array_init (&send_bufs, sizeof (sc_array_t));
+  sc_array_resize (&send_bufs, (size_t) num_procs);
+  for (i = 0; i < num_procs; ++i) {
+    buf = p4est_ghost_array_index (&send_bufs, i);
+    sc_array_init (buf, sizeof (p4est_quadrant_t));
+  }
+
+  /* collect the border quadrants into the per-processor send buffers */
+  failed = p4est_ghost_fill_send_bufs (p4est, btype, tol,
+                                       &send_bufs, &skipped);
+
   if (tol == P4EST_GHOST_UNBALANCED_FAIL) {
     if (p4est_comm_sync_flag (p4est, failed, MPI_BOR)) {
       for (i = 0; i < num_procs; ++i) {
@@ -1779,11 +2481,12 @@ failtest:
         sc_array_reset (buf);
       }
       sc_array_reset (&send_bufs);
-      for (i = 0; i < P4EST_DIM - 1; ++i) {
-        sc_array_reset (&procs[i]);
-      }
       p4est_ghost_destroy (gl);
 
+      if (p4est->inspect != NULL) {
+        p4est->inspect->ghost_time += MPI_Wtime ();
+      }
+      p4est_profile_fire (p4est, P4EST_PROFILE_GHOST, 1);
       return NULL;
     }
   }
@@ -1798,142 +2501,222 @@ failtest:
       ++num_peers;
   }
 
-  recv_request = P4EST_ALLOC (MPI_Request, 2 * num_peers);
-  recv_status = P4EST_ALLOC (MPI_Status, 2 * num_peers);
-
-  send_request = P4EST_ALLOC (MPI_Request, 2 * num_peers);
-  send_status = P4EST_ALLOC (MPI_Status, 2 * num_peers);
-
-  recv_counts = P4EST_ALLOC (p4est_locidx_t, 2 * num_peers);
-  send_counts = recv_counts + num_peers;
+  /* keep the sender side of the layer before the buffers are consumed */
+  p4est_ghost_record_mirror_runs (gl, &send_bufs);
 
-  recv_load_request = recv_request + num_peers;
-  recv_load_status = recv_status + num_peers;
+#ifdef P4EST_GHOST_NEIGHBORHOOD
+  if (p4est->inspect != NULL && p4est->inspect->use_ghost_neighborhood) {
+    p4est_ghost_exchange_neighborhood (p4est, gl, ghost_layer,
+                                       &send_bufs, num_peers);
+    num_ghosts = (p4est_locidx_t) ghost_layer->elem_count;
+    P4EST_VERBOSEF ("Total quadrants skipped %lld ghosts to receive %lld\n",
+                    (long long) skipped, (long long) num_ghosts);
+  }
+  else {
+#endif
+    recv_request = (MPI_Request *)
+      p4est_workspace_get (p4est, P4EST_WORKSPACE_GHOST_RECV_REQUESTS,
+                           2 * num_peers * sizeof (MPI_Request));
+    recv_status = (MPI_Status *)
+      p4est_workspace_get (p4est, P4EST_WORKSPACE_GHOST_RECV_STATUSES,
+                           2 * num_peers * sizeof (MPI_Status));
+
+    send_request = (MPI_Request *)
+      p4est_workspace_get (p4est, P4EST_WORKSPACE_GHOST_SEND_REQUESTS,
+                           2 * num_peers * sizeof (MPI_Request));
+    send_status = (MPI_Status *)
+      p4est_workspace_get (p4est, P4EST_WORKSPACE_GHOST_SEND_STATUSES,
+                           2 * num_peers * sizeof (MPI_Status));
+
+    recv_counts = (p4est_locidx_t *)
+      p4est_workspace_get (p4est, P4EST_WORKSPACE_GHOST_COUNTS,
+                           2 * num_peers * sizeof (p4est_locidx_t));
+    send_counts = recv_counts + num_peers;
+
+    recv_hdrs = (p4est_ghost_header_t *)
+      p4est_workspace_get (p4est, P4EST_WORKSPACE_GHOST_HEADERS,
+                           2 * num_peers * sizeof (p4est_ghost_header_t));
+    send_hdrs = recv_hdrs + num_peers;
+
+    recv_load_request = recv_request + num_peers;
+    recv_load_status = recv_status + num_peers;
+
+    send_load_request = send_request + num_peers;
+    send_load_status = send_status + num_peers;
+
+    /* Post receives for the counts of ghosts to be received */
+    for (i = 0, peer = 0; i < num_procs; ++i) {
+      buf = p4est_ghost_array_index (&send_bufs, i);
+      if (buf->elem_count > 0) {
+        peer_proc = i;
+        P4EST_ASSERT (peer_proc != rank);
+        P4EST_LDEBUGF ("ghost layer post count receive from %d\n", peer_proc);
+        mpiret = MPI_Irecv (recv_hdrs + peer,
+                            (int) sizeof (p4est_ghost_header_t), MPI_BYTE,
+                            peer_proc, P4EST_COMM_GHOST_COUNT, comm,
+                            recv_request + peer);
+        SC_CHECK_MPI (mpiret);
+        ++peer;
+      }
+    }
 
-  send_load_request = send_request + num_peers;
-  send_load_status = send_status + num_peers;
+    /* Send the counts of ghosts that are going to be sent; a small
+     * payload is coalesced into the same message */
+    for (i = 0, peer = 0; i < num_procs; ++i) {
+      buf = p4est_ghost_array_index (&send_bufs, i);
+      if (buf->elem_count > 0) {
+        peer_proc = i;
+        send_counts[peer] = (p4est_locidx_t) buf->elem_count;
+        send_hdrs[peer].count = send_counts[peer];
+        hbytes = offsetof (p4est_ghost_header_t, quads);
+        if (buf->elem_count <= (size_t) P4EST_GHOST_INLINE) {
+          memcpy (send_hdrs[peer].quads, buf->array,
+                  buf->elem_count * sizeof (p4est_quadrant_t));
+          hbytes += buf->elem_count * sizeof (p4est_quadrant_t);
+        }
+        P4EST_LDEBUGF ("ghost layer post count send %lld to %d\n",
+                       (long long) send_counts[peer], peer_proc);
+        mpiret = MPI_Isend (send_hdrs + peer, (int) hbytes, MPI_BYTE,
+                            peer_proc, P4EST_COMM_GHOST_COUNT,
+                            comm, send_request + peer);
+        SC_CHECK_MPI (mpiret);
+        ++peer;
+      }
+    }
 
-  /* Post receives for the counts of ghosts to be received */
-  for (i = 0, peer = 0; i < num_procs; ++i) {
-    buf = p4est_ghost_array_index (&send_bufs, i);
-    if (buf->elem_count > 0) {
-      peer_proc = i;
-      P4EST_ASSERT (peer_proc != rank);
-      P4EST_LDEBUGF ("ghost layer post count receive from %d\n", peer_proc);
-      mpiret = MPI_Irecv (recv_counts + peer, 1, P4EST_MPI_LOCIDX,
-                          peer_proc, P4EST_COMM_GHOST_COUNT, comm,
-                          recv_request + peer);
+    /* Wait for the counts */
+    if (num_peers > 0) {
+      mpiret = MPI_Waitall (num_peers, recv_request, recv_status);
       SC_CHECK_MPI (mpiret);
-      ++peer;
-    }
-  }
 
-  /* Send the counts of ghosts that are going to be sent */
-  for (i = 0, peer = 0; i < num_procs; ++i) {
-    buf = p4est_ghost_array_index (&send_bufs, i);
-    if (buf->elem_count > 0) {
-      peer_proc = i;
-      send_counts[peer] = (p4est_locidx_t) buf->elem_count;
-      P4EST_LDEBUGF ("ghost layer post count send %lld to %d\n",
-                     (long long) send_counts[peer], peer_proc);
-      mpiret = MPI_Isend (send_counts + peer, 1, P4EST_MPI_LOCIDX,
-                          peer_proc, P4EST_COMM_GHOST_COUNT,
-                          comm, send_request + peer);
+      mpiret = MPI_Waitall (num_peers, send_request, send_status);
       SC_CHECK_MPI (mpiret);
-      ++peer;
     }
-  }
-
-  /* Wait for the counts */
-  if (num_peers > 0) {
-    mpiret = MPI_Waitall (num_peers, recv_request, recv_status);
-    SC_CHECK_MPI (mpiret);
-
-    mpiret = MPI_Waitall (num_peers, send_request, send_status);
-    SC_CHECK_MPI (mpiret);
-  }
 
 #ifdef P4EST_DEBUG
-  for (i = 0; i < num_peers; ++i) {
-    P4EST_ASSERT (recv_request[i] == MPI_REQUEST_NULL);
-  }
-  for (i = 0; i < num_peers; ++i) {
-    P4EST_ASSERT (send_request[i] == MPI_REQUEST_NULL);
-  }
+    for (i = 0; i < num_peers; ++i) {
+      P4EST_ASSERT (recv_request[i] == MPI_REQUEST_NULL);
+    }
+    for (i = 0; i < num_peers; ++i) {
+      P4EST_ASSERT (send_request[i] == MPI_REQUEST_NULL);
+    }
 #endif
 
-  /* Count ghosts */
-  for (peer = 0, num_ghosts = 0; peer < num_peers; ++peer) {
-    P4EST_ASSERT (recv_counts[peer] > 0);
-    num_ghosts += recv_counts[peer];    /* same type */
-  }
-  P4EST_VERBOSEF ("Total quadrants skipped %lld ghosts to receive %lld\n",
-                  (long long) skipped, (long long) num_ghosts);
+    /* Count ghosts */
+    for (peer = 0, num_ghosts = 0; peer < num_peers; ++peer) {
+      recv_counts[peer] = recv_hdrs[peer].count;
+      P4EST_ASSERT (recv_counts[peer] > 0);
+      num_ghosts += recv_counts[peer];    /* same type */
+    }
+    P4EST_VERBOSEF ("Total quadrants skipped %lld ghosts to receive %lld\n",
+                    (long long) skipped, (long long) num_ghosts);
+
+    /* Allocate space for the ghosts */
+    sc_array_resize (ghost_layer, (size_t) num_ghosts);
+
+    /* Post receives for the ghosts; inline payloads have arrived with
+     * the counts and are copied out directly */
+    for (i = 0, peer = 0, ghost_offset = 0; i < num_procs; ++i) {
+      buf = p4est_ghost_array_index (&send_bufs, i);
+      if (buf->elem_count > 0) {
+        peer_proc = i;
+        if (recv_counts[peer] <= P4EST_GHOST_INLINE) {
+          P4EST_LDEBUGF
+            ("ghost layer got %lld quadrants inline from %d\n",
+             (long long) recv_counts[peer], peer_proc);
+          memcpy (ghost_layer->array +
+                  ghost_offset * sizeof (p4est_quadrant_t),
+                  recv_hdrs[peer].quads,
+                  (size_t) recv_counts[peer] * sizeof (p4est_quadrant_t));
+          recv_load_request[peer] = MPI_REQUEST_NULL;
+        }
+        else {
+          P4EST_LDEBUGF
+            ("ghost layer post ghost receive %lld quadrants from %d\n",
+             (long long) recv_counts[peer], peer_proc);
+          mpiret =
+            MPI_Irecv (ghost_layer->array +
+                       ghost_offset * sizeof (p4est_quadrant_t),
+                       (int) (recv_counts[peer] * sizeof (p4est_quadrant_t)),
+                       MPI_BYTE, peer_proc, P4EST_COMM_GHOST_LOAD, comm,
+                       recv_load_request + peer);
+          SC_CHECK_MPI (mpiret);
+        }
 
-  /* Allocate space for the ghosts */
-  sc_array_resize (ghost_layer, (size_t) num_ghosts);
+        ghost_offset += recv_counts[peer];        /* same type */
+        ++peer;
+      }
+      /* proc_offsets[0] is set at beginning of this function */
+      gl->proc_offsets[i + 1] = ghost_offset;
+    }
+    P4EST_ASSERT (ghost_offset == num_ghosts);
+
+    /* Send the ghosts too large for the header */
+    for (i = 0, peer = 0; i < num_procs; ++i) {
+      buf = p4est_ghost_array_index (&send_bufs, i);
+      if (buf->elem_count > 0) {
+        peer_proc = i;
+        P4EST_ASSERT ((p4est_locidx_t) buf->elem_count == send_counts[peer]);
+        if (send_counts[peer] <= P4EST_GHOST_INLINE) {
+          send_load_request[peer] = MPI_REQUEST_NULL;
+        }
+        else {
+          P4EST_LDEBUGF
+            ("ghost layer post ghost send %lld quadrants to %d\n",
+             (long long) send_counts[peer], peer_proc);
+          mpiret =
+            MPI_Isend (buf->array,
+                       (int) (send_counts[peer] * sizeof (p4est_quadrant_t)),
+                       MPI_BYTE, peer_proc, P4EST_COMM_GHOST_LOAD, comm,
+                       send_load_request + peer);
+          SC_CHECK_MPI (mpiret);
+        }
+        if (p4est->inspect != NULL) {
+          p4est->inspect->ghost_comm_sent +=
+            (size_t) send_counts[peer] * sizeof (p4est_quadrant_t);
+          ++p4est->inspect->ghost_nzpeers;
+        }
+        ++peer;
+      }
+    }
 
-  /* Post receives for the ghosts */
-  for (i = 0, peer = 0, ghost_offset = 0; i < num_procs; ++i) {
-    buf = p4est_ghost_array_index (&send_bufs, i);
-    if (buf->elem_count > 0) {
-      peer_proc = i;
-      P4EST_LDEBUGF
-        ("ghost layer post ghost receive %lld quadrants from %d\n",
-         (long long) recv_counts[peer], peer_proc);
-      mpiret =
-        MPI_Irecv (ghost_layer->array +
-                   ghost_offset * sizeof (p4est_quadrant_t),
-                   (int) (recv_counts[peer] * sizeof (p4est_quadrant_t)),
-                   MPI_BYTE, peer_proc, P4EST_COMM_GHOST_LOAD, comm,
-                   recv_load_request + peer);
+    /* Wait for everything */
+    if (num_peers > 0) {
+      mpiret = MPI_Waitall (num_peers, recv_load_request, recv_load_status);
       SC_CHECK_MPI (mpiret);
 
-      ghost_offset += recv_counts[peer];        /* same type */
-      ++peer;
-    }
-    /* proc_offsets[0] is set at beginning of this function */
-    gl->proc_offsets[i + 1] = ghost_offset;
-  }
-  P4EST_ASSERT (ghost_offset == num_ghosts);
-
-  /* Send the ghosts */
-  for (i = 0, peer = 0; i < num_procs; ++i) {
-    buf = p4est_ghost_array_index (&send_bufs, i);
-    if (buf->elem_count > 0) {
-      peer_proc = i;
-      P4EST_ASSERT ((p4est_locidx_t) buf->elem_count == send_counts[peer]);
-      P4EST_LDEBUGF ("ghost layer post ghost send %lld quadrants to %d\n",
-                     (long long) send_counts[peer], peer_proc);
-      mpiret =
-        MPI_Isend (buf->array,
-                   (int) (send_counts[peer] * sizeof (p4est_quadrant_t)),
-                   MPI_BYTE, peer_proc, P4EST_COMM_GHOST_LOAD, comm,
-                   send_load_request + peer);
+      mpiret = MPI_Waitall (num_peers, send_load_request, send_load_status);
       SC_CHECK_MPI (mpiret);
-      ++peer;
     }
-  }
 
-  /* Wait for everything */
-  if (num_peers > 0) {
-    mpiret = MPI_Waitall (num_peers, recv_load_request, recv_load_status);
-    SC_CHECK_MPI (mpiret);
+    /* Clean up */
+    p4est_workspace_release (p4est, P4EST_WORKSPACE_GHOST_COUNTS,
+                             recv_counts);
+    p4est_workspace_release (p4est, P4EST_WORKSPACE_GHOST_HEADERS,
+                             recv_hdrs);
 
-    mpiret = MPI_Waitall (num_peers, send_load_request, send_load_status);
-    SC_CHECK_MPI (mpiret);
-  }
+#ifdef P4EST_DEBUG
+    for (i = 0; i < num_peers; ++i) {
+      P4EST_ASSERT (recv_load_request[i] == MPI_REQUEST_NULL);
+    }
+    for (i = 0; i < num_peers; ++i) {
+      P4EST_ASSERT (send_load_request[i] == MPI_REQUEST_NULL);
+    }
+#endif
 
-  /* Clean up */
-  P4EST_FREE (recv_counts);
+    p4est_workspace_release (p4est, P4EST_WORKSPACE_GHOST_RECV_REQUESTS,
+                             recv_request);
+    p4est_workspace_release (p4est, P4EST_WORKSPACE_GHOST_RECV_STATUSES,
+                             recv_status);
+    p4est_workspace_release (p4est, P4EST_WORKSPACE_GHOST_SEND_REQUESTS,
+                             send_request);
+    p4est_workspace_release (p4est, P4EST_WORKSPACE_GHOST_SEND_STATUSES,
+                             send_status);
+#ifdef P4EST_GHOST_NEIGHBORHOOD
+  }
+#endif
 
 #ifdef P4EST_DEBUG
-  for (i = 0; i < num_peers; ++i) {
-    P4EST_ASSERT (recv_load_request[i] == MPI_REQUEST_NULL);
-  }
-  for (i = 0; i < num_peers; ++i) {
-    P4EST_ASSERT (send_load_request[i] == MPI_REQUEST_NULL);
-  }
   q2 = NULL;
   for (li = 0; li < num_ghosts; ++li) {
     q = p4est_quadrant_array_index (ghost_layer, (size_t) li);
@@ -1948,46 +2731,23 @@ failtest:
   }
 #endif
 
-  P4EST_FREE (recv_request);
-  P4EST_FREE (recv_status);
-  P4EST_FREE (send_request);
-  P4EST_FREE (send_status);
-
   for (i = 0; i < num_procs; ++i) {
     buf = p4est_ghost_array_index (&send_bufs, i);
     sc_array_reset (buf);
   }
   sc_array_reset (&send_bufs);
-  for (i = 0; i < P4EST_DIM - 1; ++i) {
-    sc_array_reset (&procs[i]);
-  }
 #endif /* P4EST_MPI */
 
   /* calculate tree offsets */
-  sc_array_init (&split, sizeof (size_t));
-  sc_array_split (ghost_layer, &split,
-                  (size_t) num_trees, ghost_tree_type, NULL);
-  P4EST_ASSERT (split.elem_count == (size_t) num_trees + 1);
-  for (nt = 0; nt <= num_trees; ++nt) {
-    ppz = (size_t *) sc_array_index (&split, (size_t) nt);
-    gl->tree_offsets[nt] = *ppz;
-#ifdef P4EST_DEBUG
-    if (nt > 0) {
-      p4est_locidx_t      lk;
-      p4est_quadrant_t   *q3;
+  p4est_ghost_calculate_tree_offsets (gl, num_trees);
+  P4EST_ASSERT (gl->proc_offsets[0] == 0);
 
-      for (lk = gl->tree_offsets[nt - 1]; lk < gl->tree_offsets[nt]; ++lk) {
-        q3 = p4est_quadrant_array_index (ghost_layer, (size_t) lk);
-        SC_CHECK_ABORT (q3->p.which_tree == nt - 1, "Ghost tree offset");
-      }
-    }
-#endif
+  if (p4est->inspect != NULL) {
+    p4est->inspect->ghost_time += MPI_Wtime ();
   }
-  sc_array_reset (&split);
-  P4EST_ASSERT (gl->tree_offsets[0] == 0);
-  P4EST_ASSERT (gl->proc_offsets[0] == 0);
 
   P4EST_GLOBAL_PRODUCTION ("Done " P4EST_STRING "_ghost_new\n");
+  p4est_profile_fire (p4est, P4EST_PROFILE_GHOST, 1);
   return gl;
 }
 
@@ -1997,6 +2757,842 @@ p4est_ghost_new (p4est_t * p4est, p4est_connect_type_t btype)
   return p4est_ghost_new_check (p4est, btype, P4EST_GHOST_UNBALANCED_ALLOW);
 }
 
+/** Everything the second half of the split ghost construction needs to
+ * know about the first half.  Allocated by p4est_ghost_new_begin and
+ * consumed by p4est_ghost_new_end.
+ */
+struct p4est_ghost_context
+{
+  p4est_t            *p4est;
+  p4est_ghost_t      *gl;
+  p4est_locidx_t      skipped;
+#ifdef P4EST_MPI
+  int                 num_peers;
+  sc_array_t          send_bufs;
+  p4est_locidx_t     *recv_counts, *send_counts;
+  p4est_ghost_header_t *recv_hdrs, *send_hdrs;
+  MPI_Request        *recv_request, *send_request;
+  MPI_Request        *send_load_request;
+#endif
+};
+
+p4est_ghost_context_t *
+p4est_ghost_new_begin (p4est_t * p4est, p4est_connect_type_t btype)
+{
+  const p4est_topidx_t num_trees = p4est->connectivity->num_trees;
+  const int           num_procs = p4est->mpisize;
+#ifdef P4EST_MPI
+  MPI_Comm            comm = p4est->mpicomm;
+  int                 i, peer, peer_proc;
+  int                 num_peers;
+  int                 mpiret;
+  size_t              hbytes;
+  sc_array_t         *buf;
+#endif
+  p4est_ghost_t      *gl;
+  p4est_ghost_context_t *ctx;
+
+  P4EST_GLOBAL_PRODUCTIONF ("Into " P4EST_STRING "_ghost_new_begin %s\n",
+                            p4est_connect_type_string (btype));
+
+  /* start timing and reset the communication counters */
+  if (p4est->inspect != NULL) {
+    p4est->inspect->ghost_time = -MPI_Wtime ();
+    p4est->inspect->ghost_comm_sent = 0;
+    p4est->inspect->ghost_nzpeers = 0;
+  }
+
+  ctx = P4EST_ALLOC_ZERO (p4est_ghost_context_t, 1);
+  ctx->p4est = p4est;
+
+  gl = P4EST_ALLOC (p4est_ghost_t, 1);
+  gl->mpisize = num_procs;
+  gl->num_trees = num_trees;
+  sc_array_init (&gl->ghosts, sizeof (p4est_quadrant_t));
+  gl->tree_offsets = P4EST_ALLOC (p4est_locidx_t, num_trees + 1);
+  gl->proc_offsets = P4EST_ALLOC (p4est_locidx_t, num_procs + 1);
+  gl->mirror_indices = NULL;
+  gl->mirror_proc_offsets = NULL;
+  gl->mirror_runs = NULL;
+  gl->mirror_proc_run_offsets = NULL;
+  gl->ghost_to_ghost_offsets = NULL;
+  gl->ghost_to_ghost = NULL;
+  gl->proc_offsets[0] = 0;
+  ctx->gl = gl;
+#ifndef P4EST_MPI
+  gl->proc_offsets[1] = 0;
+#else
+  /* allocate empty send buffers */
+  sc_array_init (&ctx->send_bufs, sizeof (sc_array_t));
+  sc_array_resize (&ctx->send_bufs, (size_t) num_procs);
+  for (i = 0; i < num_procs; ++i) {
+    buf = p4est_ghost_array_index (&ctx->send_bufs, i);
+    sc_array_init (buf, sizeof (p4est_quadrant_t));
+  }
+
+  /* collect the border quadrants into the per-processor send buffers;
+   * the tolerant mode never reports a failure */
+  (void) p4est_ghost_fill_send_bufs (p4est, btype,
+                                     P4EST_GHOST_UNBALANCED_ALLOW,
+                                     &ctx->send_bufs, &ctx->skipped);
+
+  /* Count the number of peers that I send to and receive from */
+  for (i = 0, num_peers = 0; i < num_procs; ++i) {
+    buf = p4est_ghost_array_index (&ctx->send_bufs, i);
+    if (buf->elem_count > 0)
+      ++num_peers;
+  }
+  ctx->num_peers = num_peers;
+
+  /* keep the sender side of the layer before the buffers are consumed */
+  p4est_ghost_record_mirror_runs (gl, &ctx->send_bufs);
+
+  ctx->recv_request = P4EST_ALLOC (MPI_Request, num_peers);
+  ctx->send_request = P4EST_ALLOC (MPI_Request, num_peers);
+  ctx->send_load_request = P4EST_ALLOC (MPI_Request, num_peers);
+  ctx->recv_counts = P4EST_ALLOC (p4est_locidx_t, 2 * num_peers);
+  ctx->send_counts = ctx->recv_counts + num_peers;
+  ctx->recv_hdrs = P4EST_ALLOC (p4est_ghost_header_t, 2 * num_peers);
+  ctx->send_hdrs = ctx->recv_hdrs + num_peers;
+
+  /* Post all sends right away: both the counts and the payloads are
+   * complete at this point, so the transfers proceed while the caller
+   * overlaps its interior computation until p4est_ghost_new_end.
+   */
+  for (i = 0, peer = 0; i < num_procs; ++i) {
+    buf = p4est_ghost_array_index (&ctx->send_bufs, i);
+    if (buf->elem_count > 0) {
+      peer_proc = i;
+      P4EST_ASSERT (peer_proc != p4est->mpirank);
+      P4EST_LDEBUGF ("ghost layer post count receive from %d\n", peer_proc);
+      mpiret = MPI_Irecv (ctx->recv_hdrs + peer,
+                          (int) sizeof (p4est_ghost_header_t), MPI_BYTE,
+                          peer_proc, P4EST_COMM_GHOST_COUNT, comm,
+                          ctx->recv_request + peer);
+      SC_CHECK_MPI (mpiret);
+
+      ctx->send_counts[peer] = (p4est_locidx_t) buf->elem_count;
+      ctx->send_hdrs[peer].count = ctx->send_counts[peer];
+      hbytes = offsetof (p4est_ghost_header_t, quads);
+      if (buf->elem_count <= (size_t) P4EST_GHOST_INLINE) {
+        /* a small payload is coalesced into the count message */
+        memcpy (ctx->send_hdrs[peer].quads, buf->array,
+                buf->elem_count * sizeof (p4est_quadrant_t));
+        hbytes += buf->elem_count * sizeof (p4est_quadrant_t);
+      }
+      P4EST_LDEBUGF ("ghost layer post count send %lld to %d\n",
+                     (long long) ctx->send_counts[peer], peer_proc);
+      mpiret = MPI_Isend (ctx->send_hdrs + peer, (int) hbytes, MPI_BYTE,
+                          peer_proc, P4EST_COMM_GHOST_COUNT,
+                          comm, ctx->send_request + peer);
+      SC_CHECK_MPI (mpiret);
+
+      if (buf->elem_count <= (size_t) P4EST_GHOST_INLINE) {
+        ctx->send_load_request[peer] = MPI_REQUEST_NULL;
+      }
+      else {
+        P4EST_LDEBUGF ("ghost layer post ghost send %lld quadrants to %d\n",
+                       (long long) ctx->send_counts[peer], peer_proc);
+        mpiret =
+          MPI_Isend (buf->array,
+                     (int) (buf->elem_count * sizeof (p4est_quadrant_t)),
+                     MPI_BYTE, peer_proc, P4EST_COMM_GHOST_LOAD, comm,
+                     ctx->send_load_request + peer);
+        SC_CHECK_MPI (mpiret);
+      }
+      if (p4est->inspect != NULL) {
+        p4est->inspect->ghost_comm_sent +=
+          buf->elem_count * sizeof (p4est_quadrant_t);
+        ++p4est->inspect->ghost_nzpeers;
+      }
+      ++peer;
+    }
+  }
+  P4EST_ASSERT (peer == num_peers);
+#endif /* P4EST_MPI */
+
+  return ctx;
+}
+
+p4est_ghost_t      *
+p4est_ghost_new_end (p4est_ghost_context_t * ctx)
+{
+  p4est_t            *p4est = ctx->p4est;
+  p4est_ghost_t      *gl = ctx->gl;
+#ifdef P4EST_MPI
+  const int           num_procs = p4est->mpisize;
+  const int           num_peers = ctx->num_peers;
+  MPI_Comm            comm = p4est->mpicomm;
+  int                 i, peer, peer_proc;
+  int                 mpiret;
+  p4est_locidx_t      num_ghosts, ghost_offset;
+  sc_array_t         *buf;
+  sc_array_t         *ghost_layer = &gl->ghosts;
+  MPI_Request        *recv_load_request;
+  MPI_Status         *status;
+#ifdef P4EST_DEBUG
+  p4est_locidx_t      li;
+  p4est_quadrant_t   *q, *q2;
+#endif
+
+  recv_load_request = P4EST_ALLOC (MPI_Request, num_peers);
+  status = P4EST_ALLOC (MPI_Status, num_peers);
+
+  /* Wait for the counts */
+  if (num_peers > 0) {
+    mpiret = MPI_Waitall (num_peers, ctx->recv_request, status);
+    SC_CHECK_MPI (mpiret);
+
+    mpiret = MPI_Waitall (num_peers, ctx->send_request, status);
+    SC_CHECK_MPI (mpiret);
+  }
+
+  /* Count ghosts */
+  for (peer = 0, num_ghosts = 0; peer < num_peers; ++peer) {
+    ctx->recv_counts[peer] = ctx->recv_hdrs[peer].count;
+    P4EST_ASSERT (ctx->recv_counts[peer] > 0);
+    num_ghosts += ctx->recv_counts[peer];       /* same type */
+  }
+  P4EST_VERBOSEF ("Total quadrants skipped %lld ghosts to receive %lld\n",
+                  (long long) ctx->skipped, (long long) num_ghosts);
+
+  /* Allocate space for the ghosts and post the receives */
+  sc_array_resize (ghost_layer, (size_t) num_ghosts);
+  for (i = 0, peer = 0, ghost_offset = 0; i < num_procs; ++i) {
+    buf = p4est_ghost_array_index (&ctx->send_bufs, i);
+    if (buf->elem_count > 0) {
+      peer_proc = i;
+      if (ctx->recv_counts[peer] <= P4EST_GHOST_INLINE) {
+        /* the payload arrived coalesced with the count */
+        P4EST_LDEBUGF
+          ("ghost layer got %lld quadrants inline from %d\n",
+           (long long) ctx->recv_counts[peer], peer_proc);
+        memcpy (ghost_layer->array +
+                ghost_offset * sizeof (p4est_quadrant_t),
+                ctx->recv_hdrs[peer].quads,
+                (size_t) ctx->recv_counts[peer] *
+                sizeof (p4est_quadrant_t));
+        recv_load_request[peer] = MPI_REQUEST_NULL;
+      }
+      else {
+        P4EST_LDEBUGF
+          ("ghost layer post ghost receive %lld quadrants from %d\n",
+           (long long) ctx->recv_counts[peer], peer_proc);
+        mpiret =
+          MPI_Irecv (ghost_layer->array +
+                     ghost_offset * sizeof (p4est_quadrant_t),
+                     (int) (ctx->recv_counts[peer] *
+                            sizeof (p4est_quadrant_t)),
+                     MPI_BYTE, peer_proc, P4EST_COMM_GHOST_LOAD, comm,
+                     recv_load_request + peer);
+        SC_CHECK_MPI (mpiret);
+      }
+
+      ghost_offset += ctx->recv_counts[peer];   /* same type */
+      ++peer;
+    }
+    /* proc_offsets[0] is set in p4est_ghost_new_begin */
+    gl->proc_offsets[i + 1] = ghost_offset;
+  }
+  P4EST_ASSERT (ghost_offset == num_ghosts);
+
+  /* Wait for everything */
+  if (num_peers > 0) {
+    mpiret = MPI_Waitall (num_peers, recv_load_request, status);
+    SC_CHECK_MPI (mpiret);
+
+    mpiret = MPI_Waitall (num_peers, ctx->send_load_request, status);
+    SC_CHECK_MPI (mpiret);
+  }
+
+#ifdef P4EST_DEBUG
+  q2 = NULL;
+  for (li = 0; li < num_ghosts; ++li) {
+    q = p4est_quadrant_array_index (ghost_layer, (size_t) li);
+    P4EST_ASSERT (p4est_quadrant_is_valid (q));
+    P4EST_ASSERT (q->p.piggy1.which_tree >= 0 &&
+                  q->p.piggy1.which_tree < gl->num_trees);
+    P4EST_ASSERT (q->p.piggy3.local_num >= 0);
+    if (q2 != NULL) {
+      P4EST_ASSERT (p4est_quadrant_compare_piggy (q2, q) < 0);
+    }
+    q2 = q;
+  }
+#endif
+
+  /* Clean up */
+  P4EST_FREE (recv_load_request);
+  P4EST_FREE (status);
+  P4EST_FREE (ctx->recv_counts);
+  P4EST_FREE (ctx->recv_hdrs);
+  P4EST_FREE (ctx->recv_request);
+  P4EST_FREE (ctx->send_request);
+  P4EST_FREE (ctx->send_load_request);
+  for (i = 0; i < num_procs; ++i) {
+    buf = p4est_ghost_array_index (&ctx->send_bufs, i);
+    sc_array_reset (buf);
+  }
+  sc_array_reset (&ctx->send_bufs);
+#endif /* P4EST_MPI */
+
+  /* calculate tree offsets */
+  p4est_ghost_calculate_tree_offsets (gl, gl->num_trees);
+  P4EST_ASSERT (gl->proc_offsets[0] == 0);
+
+  if (p4est->inspect != NULL) {
+    p4est->inspect->ghost_time += MPI_Wtime ();
+  }
+  P4EST_FREE (ctx);
+
+  P4EST_GLOBAL_PRODUCTION ("Done " P4EST_STRING "_ghost_new_end\n");
+  return gl;
+}
+
+#ifdef P4EST_MPI
+
+/** An element of a ghost expansion message: a candidate quadrant
+ * together with the rank that owns it. */
+typedef struct
+{
+  p4est_quadrant_t    quad;     /**< piggy3 holds owner tree and local number */
+  int                 owner;    /**< rank that owns \a quad */
+}
+p4est_ghost_expand_entry_t;
+
+static int
+p4est_ghost_expand_entry_compare (const void *v1, const void *v2)
+{
+  const p4est_ghost_expand_entry_t *e1 =
+    (const p4est_ghost_expand_entry_t *) v1;
+  const p4est_ghost_expand_entry_t *e2 =
+    (const p4est_ghost_expand_entry_t *) v2;
+
+  if (e1->owner != e2->owner) {
+    return e1->owner - e2->owner;
+  }
+  return p4est_quadrant_compare_piggy (&e1->quad, &e2->quad);
+}
+
+/** Find the owner of the ghost at position \a gidx through proc_offsets. */
+static int
+p4est_ghost_owner_rank (p4est_ghost_t * gl, p4est_locidx_t gidx)
+{
+  int                 lo = 0, hi = gl->mpisize, guess;
+
+  P4EST_ASSERT (0 <= gidx && gidx < gl->proc_offsets[gl->mpisize]);
+
+  while (hi - lo > 1) {
+    guess = (lo + hi) / 2;
+    if (gl->proc_offsets[guess] <= gidx) {
+      lo = guess;
+    }
+    else {
+      hi = guess;
+    }
+  }
+  P4EST_ASSERT (gl->proc_offsets[lo] <= gidx &&
+                gidx < gl->proc_offsets[lo + 1]);
+  return lo;
+}
+
+/** Append all local quadrants and ghosts that overlap the region of
+ * quadrant \a n in tree \a nt to \a out as expansion entries. */
+static void
+p4est_ghost_append_overlaps (p4est_t * p4est, p4est_ghost_t * gl,
+                             const p4est_quadrant_t * n, p4est_topidx_t nt,
+                             sc_array_t * out)
+{
+  const int           rank = p4est->mpirank;
+  ssize_t             lo, hi, anc, is;
+  p4est_quadrant_t    fd, ld;
+  p4est_quadrant_t   *q;
+  p4est_tree_t       *tree;
+  p4est_ghost_expand_entry_t *e;
+  sc_array_t          view;
+
+  p4est_quadrant_first_descendant (n, &fd, P4EST_QMAXLEVEL);
+  p4est_quadrant_last_descendant (n, &ld, P4EST_QMAXLEVEL);
+
+  /* quadrants overlapping n are the elements whose Morton index starts
+   * inside n's index range plus possibly one ancestor just before it */
+  if (nt >= p4est->first_local_tree && nt <= p4est->last_local_tree) {
+    tree = p4est_tree_array_index (p4est->trees, nt);
+    lo = p4est_find_lower_bound (&tree->quadrants, &fd, 0);
+    hi = p4est_find_higher_bound (&tree->quadrants, &ld, 0);
+    anc = (lo == -1) ? (ssize_t) tree->quadrants.elem_count - 1 : lo - 1;
+    if (anc >= 0) {
+      q = p4est_quadrant_array_index (&tree->quadrants, (size_t) anc);
+      if (p4est_quadrant_is_equal (q, n) || p4est_quadrant_is_ancestor (q, n)) {
+        e = (p4est_ghost_expand_entry_t *) sc_array_push (out);
+        e->quad = *q;
+        e->quad.p.piggy3.which_tree = nt;
+        e->quad.p.piggy3.local_num =
+          tree->quadrants_offset + (p4est_locidx_t) anc;
+        e->owner = rank;
+      }
+    }
+    if (lo >= 0) {
+      for (is = lo; is <= hi; ++is) {
+        q = p4est_quadrant_array_index (&tree->quadrants, (size_t) is);
+        e = (p4est_ghost_expand_entry_t *) sc_array_push (out);
+        e->quad = *q;
+        e->quad.p.piggy3.which_tree = nt;
+        e->quad.p.piggy3.local_num =
+          tree->quadrants_offset + (p4est_locidx_t) is;
+        e->owner = rank;
+      }
+    }
+  }
+  if (gl->tree_offsets[nt + 1] > gl->tree_offsets[nt]) {
+    sc_array_init_data (&view, gl->ghosts.array +
+                        (size_t) gl->tree_offsets[nt] *
+                        sizeof (p4est_quadrant_t),
+                        sizeof (p4est_quadrant_t),
+                        (size_t) (gl->tree_offsets[nt + 1] -
+                                  gl->tree_offsets[nt]));
+    lo = p4est_find_lower_bound (&view, &fd, 0);
+    hi = p4est_find_higher_bound (&view, &ld, 0);
+    anc = (lo == -1) ? (ssize_t) view.elem_count - 1 : lo - 1;
+    if (anc >= 0) {
+      q = p4est_quadrant_array_index (&view, (size_t) anc);
+      if (p4est_quadrant_is_equal (q, n) || p4est_quadrant_is_ancestor (q, n)) {
+        e = (p4est_ghost_expand_entry_t *) sc_array_push (out);
+        e->quad = *q;
+        e->owner = p4est_ghost_owner_rank (gl, gl->tree_offsets[nt] +
+                                           (p4est_locidx_t) anc);
+      }
+    }
+    if (lo >= 0) {
+      for (is = lo; is <= hi; ++is) {
+        q = p4est_quadrant_array_index (&view, (size_t) is);
+        e = (p4est_ghost_expand_entry_t *) sc_array_push (out);
+        e->quad = *q;
+        e->owner = p4est_ghost_owner_rank (gl, gl->tree_offsets[nt] +
+                                           (p4est_locidx_t) is);
+      }
+    }
+  }
+}
+
+/** Append the full neighborhood of the local quadrant \a q in tree \a t. */
+static void
+p4est_ghost_expand_quadrant (p4est_t * p4est, p4est_ghost_t * gl,
+                             p4est_connect_type_t btype,
+                             const p4est_quadrant_t * q, p4est_topidx_t t,
+                             sc_array_t * out)
+{
+  const int           ctype_int = p4est_connect_type_int (btype);
+  int                 face, corner;
+#ifdef P4_TO_P8
+  int                 edge;
+#endif
+  size_t              zz;
+  p4est_topidx_t      nt;
+  p4est_quadrant_t    n;
+  sc_array_t          quads, treeids;
+
+  for (face = 0; face < P4EST_FACES; ++face) {
+    nt = (p4est_topidx_t)
+      p4est_quadrant_face_neighbor_extra (q, (p4est_locidx_t) t, face, &n,
+                                          p4est->connectivity);
+    if (nt >= 0) {
+      p4est_ghost_append_overlaps (p4est, gl, &n, nt, out);
+    }
+  }
+  if (ctype_int == 1) {
+    return;
+  }
+  sc_array_init (&quads, sizeof (p4est_quadrant_t));
+  sc_array_init (&treeids, sizeof (p4est_topidx_t));
+#ifdef P4_TO_P8
+  for (edge = 0; edge < P8EST_EDGES; ++edge) {
+    p8est_quadrant_edge_neighbor_extra (q, (p4est_locidx_t) t, edge, &quads,
+                                        &treeids, p4est->connectivity);
+    for (zz = 0; zz < quads.elem_count; ++zz) {
+      p4est_ghost_append_overlaps (p4est, gl,
+                                   p4est_quadrant_array_index (&quads, zz),
+                                   *(p4est_topidx_t *)
+                                   sc_array_index (&treeids, zz), out);
+    }
+    sc_array_reset (&quads);
+    sc_array_reset (&treeids);
+  }
+#endif
+  if (ctype_int == P4EST_DIM) {
+    for (corner = 0; corner < P4EST_CHILDREN; ++corner) {
+      p4est_quadrant_corner_neighbor_extra (q, (p4est_locidx_t) t, corner,
+                                            &quads, &treeids,
+                                            p4est->connectivity);
+      for (zz = 0; zz < quads.elem_count; ++zz) {
+        p4est_ghost_append_overlaps (p4est, gl,
+                                     p4est_quadrant_array_index (&quads, zz),
+                                     *(p4est_topidx_t *)
+                                     sc_array_index (&treeids, zz), out);
+      }
+      sc_array_reset (&quads);
+      sc_array_reset (&treeids);
+    }
+  }
+  sc_array_reset (&quads);
+  sc_array_reset (&treeids);
+}
+
+/** Add one layer to a ghost layer by querying the current ghost owners.
+ *
+ * Each processor asks the owner of every ghost in the newest layer for
+ * that quadrant's neighborhood.  The owner answers from its local
+ * quadrants and its own ghost layer, which together contain every
+ * neighbor of one of its quadrants.  The replies are deduplicated and
+ * merged, and \a newest is replaced by the quadrants added here.
+ */
+static void
+p4est_ghost_expand_once (p4est_t * p4est, p4est_connect_type_t btype,
+                         p4est_ghost_t * gl, sc_array_t * newest)
+{
+  const int           num_procs = p4est->mpisize;
+  const int           rank = p4est->mpirank;
+  int                 i, j;
+  int                 mpiret;
+  int                 num_queried, num_queriers;
+  int                *queried_ranks, *querier_ranks;
+  size_t              zz, zw;
+  size_t             *queried_begin;
+  p4est_topidx_t      nt;
+  p4est_locidx_t      lk, idx;
+  p4est_locidx_t     *in_counts, *out_counts;
+  p4est_locidx_t     *reply_counts_in, *reply_counts_out;
+  p4est_locidx_t     *query_out;
+  p4est_locidx_t    **in_queries;
+  p4est_locidx_t      oldpos, addpos, oldend, addend, written;
+  p4est_locidx_t     *new_proc_offsets;
+  p4est_tree_t       *tree;
+  p4est_quadrant_t   *q, *q2;
+  p4est_ghost_expand_entry_t *e, *e2;
+  sc_array_t         *replies, *recv_entries;
+  sc_array_t          addition, merged, view;
+  MPI_Request        *requests;
+  MPI_Status         *statuses;
+
+  /* the expansion grows the mirror sets symmetrically, so the recorded
+   * runs no longer cover the layer; drop them and let the first data
+   * exchange fall back to querying the peers */
+  P4EST_FREE (gl->mirror_runs);
+  P4EST_FREE (gl->mirror_proc_run_offsets);
+  gl->mirror_runs = NULL;
+  gl->mirror_proc_run_offsets = NULL;
+
+  /* list the owners of the newest layer; newest is sorted by owner */
+  queried_ranks = P4EST_ALLOC (int, num_procs);
+  queried_begin = P4EST_ALLOC (size_t, num_procs + 1);
+  num_queried = 0;
+  for (zz = 0; zz < newest->elem_count; ++zz) {
+    e = (p4est_ghost_expand_entry_t *) sc_array_index (newest, zz);
+    P4EST_ASSERT (e->owner != rank);
+    if (num_queried == 0 || queried_ranks[num_queried - 1] != e->owner) {
+      P4EST_ASSERT (num_queried == 0 ||
+                    queried_ranks[num_queried - 1] < e->owner);
+      queried_ranks[num_queried] = e->owner;
+      queried_begin[num_queried] = zz;
+      ++num_queried;
+    }
+  }
+  queried_begin[num_queried] = newest->elem_count;
+
+  /* learn which processors will query this one */
+  querier_ranks = P4EST_ALLOC (int, num_procs);
+  num_queriers = 0;
+  mpiret = sc_notify (queried_ranks, num_queried,
+                      querier_ranks, &num_queriers, p4est->mpicomm);
+  SC_CHECK_MPI (mpiret);
+
+  requests = P4EST_ALLOC (MPI_Request, num_queried + num_queriers);
+  statuses = P4EST_ALLOC (MPI_Status, num_queried + num_queriers);
+
+  /* exchange the query counts */
+  in_counts = P4EST_ALLOC (p4est_locidx_t, num_queriers);
+  out_counts = P4EST_ALLOC (p4est_locidx_t, num_queried);
+  for (j = 0; j < num_queriers; ++j) {
+    mpiret = MPI_Irecv (in_counts + j, 1, P4EST_MPI_LOCIDX,
+                        querier_ranks[j], P4EST_COMM_GHOST_EXPAND_COUNT,
+                        p4est->mpicomm, requests + j);
+    SC_CHECK_MPI (mpiret);
+  }
+  for (i = 0; i < num_queried; ++i) {
+    out_counts[i] =
+      (p4est_locidx_t) (queried_begin[i + 1] - queried_begin[i]);
+    mpiret = MPI_Isend (out_counts + i, 1, P4EST_MPI_LOCIDX,
+                        queried_ranks[i], P4EST_COMM_GHOST_EXPAND_COUNT,
+                        p4est->mpicomm, requests + num_queriers + i);
+    SC_CHECK_MPI (mpiret);
+  }
+  mpiret = MPI_Waitall (num_queried + num_queriers, requests, statuses);
+  SC_CHECK_MPI (mpiret);
+
+  /* exchange the queried local numbers */
+  query_out = P4EST_ALLOC (p4est_locidx_t, newest->elem_count);
+  for (zz = 0; zz < newest->elem_count; ++zz) {
+    e = (p4est_ghost_expand_entry_t *) sc_array_index (newest, zz);
+    query_out[zz] = e->quad.p.piggy3.local_num;
+  }
+  in_queries = P4EST_ALLOC (p4est_locidx_t *, num_queriers);
+  for (j = 0; j < num_queriers; ++j) {
+    in_queries[j] = P4EST_ALLOC (p4est_locidx_t, in_counts[j]);
+    mpiret = MPI_Irecv (in_queries[j], (int) in_counts[j], P4EST_MPI_LOCIDX,
+                        querier_ranks[j], P4EST_COMM_GHOST_EXPAND_QUERY,
+                        p4est->mpicomm, requests + j);
+    SC_CHECK_MPI (mpiret);
+  }
+  for (i = 0; i < num_queried; ++i) {
+    mpiret = MPI_Isend (query_out + queried_begin[i], (int) out_counts[i],
+                        P4EST_MPI_LOCIDX, queried_ranks[i],
+                        P4EST_COMM_GHOST_EXPAND_QUERY, p4est->mpicomm,
+                        requests + num_queriers + i);
+    SC_CHECK_MPI (mpiret);
+  }
+  mpiret = MPI_Waitall (num_queried + num_queriers, requests, statuses);
+  SC_CHECK_MPI (mpiret);
+
+  /* answer the queries from the local quadrants and the own ghosts */
+  replies = P4EST_ALLOC (sc_array_t, num_queriers);
+  for (j = 0; j < num_queriers; ++j) {
+    sc_array_init (&replies[j], sizeof (p4est_ghost_expand_entry_t));
+    nt = p4est->first_local_tree;
+    for (lk = 0; lk < in_counts[j]; ++lk) {
+      idx = in_queries[j][lk];
+      P4EST_ASSERT (idx >= 0 && idx < p4est->local_num_quadrants);
+      P4EST_ASSERT (lk == 0 || in_queries[j][lk - 1] < idx);
+      tree = p4est_tree_array_index (p4est->trees, nt);
+      while (idx >= tree->quadrants_offset +
+             (p4est_locidx_t) tree->quadrants.elem_count) {
+        tree = p4est_tree_array_index (p4est->trees, ++nt);
+      }
+      q = p4est_quadrant_array_index (&tree->quadrants,
+                                      (size_t) (idx -
+                                                tree->quadrants_offset));
+      p4est_ghost_expand_quadrant (p4est, gl, btype, q, nt, &replies[j]);
+    }
+
+    /* drop duplicates and quadrants the querier owns itself */
+    sc_array_sort (&replies[j], p4est_ghost_expand_entry_compare);
+    zw = 0;
+    for (zz = 0; zz < replies[j].elem_count; ++zz) {
+      e = (p4est_ghost_expand_entry_t *) sc_array_index (&replies[j], zz);
+      if (e->owner == querier_ranks[j]) {
+        continue;
+      }
+      if (zw > 0) {
+        e2 = (p4est_ghost_expand_entry_t *)
+          sc_array_index (&replies[j], zw - 1);
+        if (p4est_ghost_expand_entry_compare (e2, e) == 0) {
+          continue;
+        }
+      }
+      if (zz != zw) {
+        *(p4est_ghost_expand_entry_t *)
+          sc_array_index (&replies[j], zw) = *e;
+      }
+      ++zw;
+    }
+    sc_array_resize (&replies[j], zw);
+  }
+
+  /* exchange the reply counts */
+  reply_counts_in = P4EST_ALLOC (p4est_locidx_t, num_queried);
+  reply_counts_out = P4EST_ALLOC (p4est_locidx_t, num_queriers);
+  for (i = 0; i < num_queried; ++i) {
+    mpiret = MPI_Irecv (reply_counts_in + i, 1, P4EST_MPI_LOCIDX,
+                        queried_ranks[i], P4EST_COMM_GHOST_EXPAND_REPLY_COUNT,
+                        p4est->mpicomm, requests + i);
+    SC_CHECK_MPI (mpiret);
+  }
+  for (j = 0; j < num_queriers; ++j) {
+    reply_counts_out[j] = (p4est_locidx_t) replies[j].elem_count;
+    mpiret = MPI_Isend (reply_counts_out + j, 1, P4EST_MPI_LOCIDX,
+                        querier_ranks[j], P4EST_COMM_GHOST_EXPAND_REPLY_COUNT,
+                        p4est->mpicomm, requests + num_queried + j);
+    SC_CHECK_MPI (mpiret);
+  }
+  mpiret = MPI_Waitall (num_queried + num_queriers, requests, statuses);
+  SC_CHECK_MPI (mpiret);
+
+  /* exchange the reply payloads */
+  recv_entries = P4EST_ALLOC (sc_array_t, num_queried);
+  for (i = 0; i < num_queried; ++i) {
+    sc_array_init (&recv_entries[i], sizeof (p4est_ghost_expand_entry_t));
+    sc_array_resize (&recv_entries[i], (size_t) reply_counts_in[i]);
+    mpiret = MPI_Irecv (recv_entries[i].array,
+                        (int) (reply_counts_in[i] *
+                               sizeof (p4est_ghost_expand_entry_t)),
+                        MPI_BYTE, queried_ranks[i],
+                        P4EST_COMM_GHOST_EXPAND_REPLY, p4est->mpicomm,
+                        requests + i);
+    SC_CHECK_MPI (mpiret);
+  }
+  for (j = 0; j < num_queriers; ++j) {
+    mpiret = MPI_Isend (replies[j].array,
+                        (int) (replies[j].elem_count *
+                               sizeof (p4est_ghost_expand_entry_t)),
+                        MPI_BYTE, querier_ranks[j],
+                        P4EST_COMM_GHOST_EXPAND_REPLY, p4est->mpicomm,
+                        requests + num_queried + j);
+    SC_CHECK_MPI (mpiret);
+  }
+  mpiret = MPI_Waitall (num_queried + num_queriers, requests, statuses);
+  SC_CHECK_MPI (mpiret);
+
+  /* collect all replies and drop what the ghost layer already has */
+  sc_array_init (&addition, sizeof (p4est_ghost_expand_entry_t));
+  for (i = 0; i < num_queried; ++i) {
+    if (recv_entries[i].elem_count > 0) {
+      zw = addition.elem_count;
+      sc_array_resize (&addition, zw + recv_entries[i].elem_count);
+      memcpy (sc_array_index (&addition, zw), recv_entries[i].array,
+              recv_entries[i].elem_count *
+              sizeof (p4est_ghost_expand_entry_t));
+    }
+    sc_array_reset (&recv_entries[i]);
+  }
+  sc_array_sort (&addition, p4est_ghost_expand_entry_compare);
+  zw = 0;
+  for (zz = 0; zz < addition.elem_count; ++zz) {
+    e = (p4est_ghost_expand_entry_t *) sc_array_index (&addition, zz);
+    P4EST_ASSERT (e->owner != rank);
+    if (zw > 0) {
+      e2 = (p4est_ghost_expand_entry_t *) sc_array_index (&addition, zw - 1);
+      if (p4est_ghost_expand_entry_compare (e2, e) == 0) {
+        continue;
+      }
+    }
+    if (gl->proc_offsets[e->owner + 1] > gl->proc_offsets[e->owner]) {
+      sc_array_init_data (&view, gl->ghosts.array +
+                          (size_t) gl->proc_offsets[e->owner] *
+                          sizeof (p4est_quadrant_t),
+                          sizeof (p4est_quadrant_t),
+                          (size_t) (gl->proc_offsets[e->owner + 1] -
+                                    gl->proc_offsets[e->owner]));
+      if (sc_array_bsearch (&view, &e->quad,
+                            p4est_quadrant_compare_piggy) >= 0) {
+        continue;
+      }
+    }
+    if (zz != zw) {
+      *(p4est_ghost_expand_entry_t *) sc_array_index (&addition, zw) = *e;
+    }
+    ++zw;
+  }
+  sc_array_resize (&addition, zw);
+
+  /* merge the new quadrants into the ghost layer owner by owner */
+  sc_array_init (&merged, sizeof (p4est_quadrant_t));
+  sc_array_resize (&merged, gl->ghosts.elem_count + addition.elem_count);
+  new_proc_offsets = P4EST_ALLOC (p4est_locidx_t, num_procs + 1);
+  new_proc_offsets[0] = 0;
+  written = 0;
+  addpos = 0;
+  addend = (p4est_locidx_t) addition.elem_count;
+  for (i = 0; i < num_procs; ++i) {
+    oldpos = gl->proc_offsets[i];
+    oldend = gl->proc_offsets[i + 1];
+    while (oldpos < oldend || (addpos < addend &&
+                               ((p4est_ghost_expand_entry_t *)
+                                sc_array_index (&addition,
+                                                (size_t) addpos))->owner ==
+                               i)) {
+      q2 = p4est_quadrant_array_index (&merged, (size_t) written);
+      e = (addpos < addend) ? (p4est_ghost_expand_entry_t *)
+        sc_array_index (&addition, (size_t) addpos) : NULL;
+      if (oldpos < oldend &&
+          (e == NULL || e->owner != i ||
+           p4est_quadrant_compare_piggy
+           (p4est_quadrant_array_index (&gl->ghosts, (size_t) oldpos),
+            &e->quad) < 0)) {
+        *q2 = *p4est_quadrant_array_index (&gl->ghosts, (size_t) oldpos);
+        ++oldpos;
+      }
+      else {
+        P4EST_ASSERT (e != NULL && e->owner == i);
+        *q2 = e->quad;
+        ++addpos;
+      }
+      ++written;
+    }
+    new_proc_offsets[i + 1] = written;
+  }
+  P4EST_ASSERT ((size_t) written == merged.elem_count);
+  P4EST_ASSERT (addpos == addend);
+  sc_array_reset (&gl->ghosts);
+  memcpy (&gl->ghosts, &merged, sizeof (sc_array_t));
+  memcpy (gl->proc_offsets, new_proc_offsets,
+          (num_procs + 1) * sizeof (p4est_locidx_t));
+  P4EST_FREE (new_proc_offsets);
+  p4est_ghost_calculate_tree_offsets (gl, p4est->connectivity->num_trees);
+
+  /* the quadrants added here form the next newest layer */
+  sc_array_resize (newest, addition.elem_count);
+  if (addition.elem_count > 0) {
+    memcpy (newest->array, addition.array,
+            addition.elem_count * sizeof (p4est_ghost_expand_entry_t));
+  }
+  sc_array_reset (&addition);
+
+  for (j = 0; j < num_queriers; ++j) {
+    sc_array_reset (&replies[j]);
+    P4EST_FREE (in_queries[j]);
+  }
+  P4EST_FREE (replies);
+  P4EST_FREE (recv_entries);
+  P4EST_FREE (in_queries);
+  P4EST_FREE (query_out);
+  P4EST_FREE (in_counts);
+  P4EST_FREE (out_counts);
+  P4EST_FREE (reply_counts_in);
+  P4EST_FREE (reply_counts_out);
+  P4EST_FREE (requests);
+  P4EST_FREE (statuses);
+  P4EST_FREE (queried_ranks);
+  P4EST_FREE (queried_begin);
+  P4EST_FREE (querier_ranks);
+}
+
+#endif /* P4EST_MPI */
+
+p4est_ghost_t      *
+p4est_ghost_new_depth (p4est_t * p4est, p4est_connect_type_t btype,
+                       int depth)
+{
+  p4est_ghost_t      *gl;
+#ifdef P4EST_MPI
+  int                 k;
+  size_t              zz;
+  p4est_ghost_expand_entry_t *e;
+  sc_array_t          newest;
+#endif
+
+  P4EST_ASSERT (depth >= 1);
+
+  gl = p4est_ghost_new (p4est, btype);
+#ifdef P4EST_MPI
+  if (depth > 1) {
+    P4EST_GLOBAL_PRODUCTIONF ("Into " P4EST_STRING
+                              "_ghost_new_depth %d\n", depth);
+    /* the first layer is the entire ghost array */
+    sc_array_init (&newest, sizeof (p4est_ghost_expand_entry_t));
+    sc_array_resize (&newest, gl->ghosts.elem_count);
+    for (zz = 0; zz < newest.elem_count; ++zz) {
+      e = (p4est_ghost_expand_entry_t *) sc_array_index (&newest, zz);
+      e->quad = *p4est_quadrant_array_index (&gl->ghosts, zz);
+      e->owner = p4est_ghost_owner_rank (gl, (p4est_locidx_t) zz);
+    }
+    for (k = 1; k < depth; ++k) {
+      p4est_ghost_expand_once (p4est, btype, gl, &newest);
+    }
+    sc_array_reset (&newest);
+    P4EST_GLOBAL_PRODUCTION ("Done " P4EST_STRING "_ghost_new_depth\n");
+  }
+#endif
+  return gl;
+}
+
 void
 p4est_ghost_destroy (p4est_ghost_t * ghost)
 {
@@ -2004,10 +3600,701 @@ p4est_ghost_destroy (p4est_ghost_t * ghost)
 
   P4EST_FREE (ghost->tree_offsets);
   P4EST_FREE (ghost->proc_offsets);
+  P4EST_FREE (ghost->mirror_indices);
+  P4EST_FREE (ghost->mirror_proc_offsets);
+  P4EST_FREE (ghost->mirror_runs);
+  P4EST_FREE (ghost->mirror_proc_run_offsets);
+  P4EST_FREE (ghost->ghost_to_ghost_offsets);
+  P4EST_FREE (ghost->ghost_to_ghost);
 
   P4EST_FREE (ghost);
 }
 
+void
+p4est_ghost_update (p4est_t * p4est, p4est_connect_type_t btype,
+                    const int8_t * changed_trees, p4est_ghost_t * ghost)
+{
+  int                 changed_local, changed_global;
+#ifdef P4EST_MPI
+  int                 mpiret;
+#endif
+  p4est_topidx_t      nt;
+  p4est_ghost_t      *fresh;
+
+  P4EST_ASSERT (ghost != NULL);
+  P4EST_ASSERT (ghost->mpisize == p4est->mpisize);
+  P4EST_ASSERT (ghost->num_trees == p4est->connectivity->num_trees);
+
+  /* a NULL delta forces the rebuild, e.g. after repartitioning */
+  changed_local = (changed_trees == NULL);
+  if (!changed_local && p4est->first_local_tree >= 0) {
+    for (nt = p4est->first_local_tree; nt <= p4est->last_local_tree; ++nt) {
+      if (changed_trees[nt]) {
+        changed_local = 1;
+        break;
+      }
+    }
+  }
+  changed_global = changed_local;
+#ifdef P4EST_MPI
+  mpiret = MPI_Allreduce (&changed_local, &changed_global, 1, MPI_INT,
+                          MPI_LOR, p4est->mpicomm);
+  SC_CHECK_MPI (mpiret);
+#endif
+  if (!changed_global) {
+    /* no rank has modified its quadrants so the ghost layer stays valid */
+    P4EST_GLOBAL_PRODUCTION ("Skip unchanged " P4EST_STRING
+                             "_ghost_update\n");
+    return;
+  }
+
+  /* The membership of the ghost layer depends on remote adaptation that
+   * cannot be determined without the collective machinery of a rebuild.
+   * Rebuild and splice the result into the existing structure so that
+   * the pointer held by the caller stays valid. */
+  fresh = p4est_ghost_new (p4est, btype);
+  sc_array_reset (&ghost->ghosts);
+  memcpy (&ghost->ghosts, &fresh->ghosts, sizeof (sc_array_t));
+  P4EST_FREE (ghost->tree_offsets);
+  P4EST_FREE (ghost->proc_offsets);
+  ghost->tree_offsets = fresh->tree_offsets;
+  ghost->proc_offsets = fresh->proc_offsets;
+  P4EST_FREE (ghost->mirror_indices);
+  P4EST_FREE (ghost->mirror_proc_offsets);
+  ghost->mirror_indices = NULL;
+  ghost->mirror_proc_offsets = NULL;
+  P4EST_FREE (ghost->mirror_runs);
+  P4EST_FREE (ghost->mirror_proc_run_offsets);
+  ghost->mirror_runs = fresh->mirror_runs;
+  ghost->mirror_proc_run_offsets = fresh->mirror_proc_run_offsets;
+  P4EST_FREE (ghost->ghost_to_ghost_offsets);
+  P4EST_FREE (ghost->ghost_to_ghost);
+  ghost->ghost_to_ghost_offsets = NULL;
+  ghost->ghost_to_ghost = NULL;
+  P4EST_FREE (fresh);
+}
+
+/** Append the indices of all ghosts in tree \a nt that overlap the
+ * region of quadrant \a n, excluding \a self, to \a cand. */
+static void
+p4est_ghost_adjacency_probe (p4est_ghost_t * ghost, p4est_topidx_t nt,
+                             const p4est_quadrant_t * n,
+                             p4est_locidx_t self, sc_array_t * cand)
+{
+  ssize_t             lo, hi, anc, is;
+  p4est_locidx_t      jg;
+  p4est_quadrant_t    fd, ld;
+  p4est_quadrant_t   *g;
+  sc_array_t          view;
+
+  if (ghost->tree_offsets[nt + 1] <= ghost->tree_offsets[nt]) {
+    return;
+  }
+  sc_array_init_data (&view, ghost->ghosts.array +
+                      (size_t) ghost->tree_offsets[nt] *
+                      sizeof (p4est_quadrant_t),
+                      sizeof (p4est_quadrant_t),
+                      (size_t) (ghost->tree_offsets[nt + 1] -
+                                ghost->tree_offsets[nt]));
+  p4est_quadrant_first_descendant (n, &fd, P4EST_QMAXLEVEL);
+  p4est_quadrant_last_descendant (n, &ld, P4EST_QMAXLEVEL);
+
+  /* ghosts overlapping n are the elements whose Morton index starts
+   * inside n's index range plus possibly one ancestor just before it */
+  lo = p4est_find_lower_bound (&view, &fd, 0);
+  hi = p4est_find_higher_bound (&view, &ld, 0);
+  anc = (lo == -1) ? (ssize_t) view.elem_count - 1 : lo - 1;
+  if (anc >= 0) {
+    g = p4est_quadrant_array_index (&view, (size_t) anc);
+    if (p4est_quadrant_is_equal (g, n) || p4est_quadrant_is_ancestor (g, n)) {
+      jg = ghost->tree_offsets[nt] + (p4est_locidx_t) anc;
+      if (jg != self) {
+        *(p4est_locidx_t *) sc_array_push (cand) = jg;
+      }
+    }
+  }
+  if (lo >= 0) {
+    for (is = lo; is <= hi; ++is) {
+      jg = ghost->tree_offsets[nt] + (p4est_locidx_t) is;
+      if (jg != self) {
+        *(p4est_locidx_t *) sc_array_push (cand) = jg;
+      }
+    }
+  }
+}
+
+p4est_locidx_t
+p4est_ghost_adjacency (p4est_t * p4est, p4est_ghost_t * ghost)
+{
+  int                 face, corner;
+#ifdef P4_TO_P8
+  int                 edge;
+#endif
+  size_t              zz;
+  p4est_locidx_t      num_ghosts, ig, cur, prev, nlinks;
+  p4est_topidx_t      t, nt;
+  p4est_quadrant_t    n;
+  p4est_quadrant_t   *g;
+  sc_array_t          links, cand, quads, treeids;
+
+  P4EST_ASSERT (ghost->mpisize == p4est->mpisize);
+  P4EST_ASSERT (ghost->num_trees == p4est->connectivity->num_trees);
+
+  P4EST_FREE (ghost->ghost_to_ghost_offsets);
+  P4EST_FREE (ghost->ghost_to_ghost);
+  num_ghosts = (p4est_locidx_t) ghost->ghosts.elem_count;
+  ghost->ghost_to_ghost_offsets =
+    P4EST_ALLOC (p4est_locidx_t, num_ghosts + 1);
+  ghost->ghost_to_ghost_offsets[0] = 0;
+
+  sc_array_init (&links, sizeof (p4est_locidx_t));
+  sc_array_init (&cand, sizeof (p4est_locidx_t));
+  sc_array_init (&quads, sizeof (p4est_quadrant_t));
+  sc_array_init (&treeids, sizeof (p4est_topidx_t));
+
+  for (ig = 0; ig < num_ghosts; ++ig) {
+    g = p4est_quadrant_array_index (&ghost->ghosts, (size_t) ig);
+    t = g->p.piggy3.which_tree;
+    sc_array_resize (&cand, 0);
+
+    for (face = 0; face < P4EST_FACES; ++face) {
+      nt = (p4est_topidx_t)
+        p4est_quadrant_face_neighbor_extra (g, (p4est_locidx_t) t, face, &n,
+                                            p4est->connectivity);
+      if (nt >= 0) {
+        p4est_ghost_adjacency_probe (ghost, nt, &n, ig, &cand);
+      }
+    }
+#ifdef P4_TO_P8
+    for (edge = 0; edge < P8EST_EDGES; ++edge) {
+      p8est_quadrant_edge_neighbor_extra (g, (p4est_locidx_t) t, edge,
+                                          &quads, &treeids,
+                                          p4est->connectivity);
+      for (zz = 0; zz < quads.elem_count; ++zz) {
+        p4est_ghost_adjacency_probe (ghost, *(p4est_topidx_t *)
+                                     sc_array_index (&treeids, zz),
+                                     p4est_quadrant_array_index (&quads, zz),
+                                     ig, &cand);
+      }
+      sc_array_reset (&quads);
+      sc_array_reset (&treeids);
+    }
+#endif
+    for (corner = 0; corner < P4EST_CHILDREN; ++corner) {
+      p4est_quadrant_corner_neighbor_extra (g, (p4est_locidx_t) t, corner,
+                                            &quads, &treeids,
+                                            p4est->connectivity);
+      for (zz = 0; zz < quads.elem_count; ++zz) {
+        p4est_ghost_adjacency_probe (ghost, *(p4est_topidx_t *)
+                                     sc_array_index (&treeids, zz),
+                                     p4est_quadrant_array_index (&quads, zz),
+                                     ig, &cand);
+      }
+      sc_array_reset (&quads);
+      sc_array_reset (&treeids);
+    }
+
+    /* the probes around a corner may report the same ghost twice */
+    sc_array_sort (&cand, p4est_locidx_compare);
+    prev = -1;
+    for (zz = 0; zz < cand.elem_count; ++zz) {
+      cur = *(p4est_locidx_t *) sc_array_index (&cand, zz);
+      if (cur != prev) {
+        *(p4est_locidx_t *) sc_array_push (&links) = cur;
+        prev = cur;
+      }
+    }
+    ghost->ghost_to_ghost_offsets[ig + 1] = (p4est_locidx_t)
+      links.elem_count;
+  }
+
+  nlinks = (p4est_locidx_t) links.elem_count;
+  ghost->ghost_to_ghost = P4EST_ALLOC (p4est_locidx_t, nlinks);
+  memcpy (ghost->ghost_to_ghost, links.array,
+          (size_t) nlinks * sizeof (p4est_locidx_t));
+
+  sc_array_reset (&links);
+  sc_array_reset (&cand);
+  sc_array_reset (&quads);
+  sc_array_reset (&treeids);
+
+  return nlinks;
+}
+
+/** Exchange ghost data with optional per-peer delivery.
+ * With a NULL \a ready_fn all receives are awaited together; otherwise
+ * each peer's ghost range is handed to the callback as soon as its
+ * receive completes.
+ */
+#ifdef P4EST_MPI
+
+/** Ensure the pack plan of the ghost layer is available.
+ * Expands the run-length mirror lists recorded by p4est_ghost_new or,
+ * failing that, negotiates the plan with the peers; the result is
+ * cached in the ghost structure until the layer is rebuilt.
+ */
+static void
+p4est_ghost_exchange_ensure_plan (p4est_t * p4est, p4est_ghost_t * ghost)
+{
+  const int           num_procs = p4est->mpisize;
+  int                 i, peer, num_peers;
+  int                 mpiret;
+  size_t              zz;
+  p4est_locidx_t      lcount, mcount, lm, idx;
+  p4est_locidx_t     *query_counts, *mirror_counts, *query_indices;
+  p4est_quadrant_t   *q;
+  MPI_Request        *requests;
+  MPI_Status         *statuses;
+
+  if (ghost->mirror_proc_offsets == NULL &&
+      ghost->mirror_proc_run_offsets != NULL) {
+    /* Expand the run-length mirror lists recorded by p4est_ghost_new
+     * into the pack plan; no query round trip is needed. */
+    ghost->mirror_proc_offsets = P4EST_ALLOC (p4est_locidx_t, num_procs + 1);
+    ghost->mirror_proc_offsets[0] = 0;
+    for (i = 0; i < num_procs; ++i) {
+      lcount = 0;
+      for (lm = ghost->mirror_proc_run_offsets[i];
+           lm < ghost->mirror_proc_run_offsets[i + 1]; ++lm) {
+        lcount += ghost->mirror_runs[2 * lm + 1];
+      }
+      ghost->mirror_proc_offsets[i + 1] =
+        ghost->mirror_proc_offsets[i] + lcount;
+    }
+    ghost->mirror_indices =
+      P4EST_ALLOC (p4est_locidx_t, ghost->mirror_proc_offsets[num_procs]);
+    mcount = 0;
+    for (lm = 0; lm < ghost->mirror_proc_run_offsets[num_procs]; ++lm) {
+      for (idx = 0; idx < ghost->mirror_runs[2 * lm + 1]; ++idx) {
+        ghost->mirror_indices[mcount++] = ghost->mirror_runs[2 * lm] + idx;
+      }
+    }
+    P4EST_ASSERT (mcount == ghost->mirror_proc_offsets[num_procs]);
+  }
+  if (ghost->mirror_proc_offsets != NULL) {
+    return;
+  }
+
+  /* Build the pack plan: each peer tells us the local numbers of our
+   * quadrants that it stores as ghosts.  The plan is cached in the
+   * ghost structure and reused until the layer is rebuilt. */
+  for (i = 0, num_peers = 0; i < num_procs; ++i) {
+    if (ghost->proc_offsets[i + 1] > ghost->proc_offsets[i]) {
+      ++num_peers;
+    }
+  }
+  requests = P4EST_ALLOC (MPI_Request, 2 * num_peers);
+  statuses = P4EST_ALLOC (MPI_Status, 2 * num_peers);
+
+  query_counts = P4EST_ALLOC (p4est_locidx_t, num_procs);
+  mirror_counts = P4EST_ALLOC_ZERO (p4est_locidx_t, num_procs);
+  for (i = 0, peer = 0; i < num_procs; ++i) {
+    lcount = ghost->proc_offsets[i + 1] - ghost->proc_offsets[i];
+    query_counts[i] = lcount;
+    if (lcount > 0) {
+      mpiret = MPI_Irecv (mirror_counts + i, 1, P4EST_MPI_LOCIDX, i,
+                          P4EST_COMM_GHOST_DATA_COUNT, p4est->mpicomm,
+                          requests + peer);
+      SC_CHECK_MPI (mpiret);
+      mpiret = MPI_Isend (query_counts + i, 1, P4EST_MPI_LOCIDX, i,
+                          P4EST_COMM_GHOST_DATA_COUNT, p4est->mpicomm,
+                          requests + num_peers + peer);
+      SC_CHECK_MPI (mpiret);
+      ++peer;
+    }
+  }
+  P4EST_ASSERT (peer == num_peers);
+  mpiret = MPI_Waitall (2 * num_peers, requests, statuses);
+  SC_CHECK_MPI (mpiret);
+
+  ghost->mirror_proc_offsets = P4EST_ALLOC (p4est_locidx_t, num_procs + 1);
+  ghost->mirror_proc_offsets[0] = 0;
+  for (i = 0; i < num_procs; ++i) {
+    P4EST_ASSERT ((mirror_counts[i] > 0) == (query_counts[i] > 0));
+    ghost->mirror_proc_offsets[i + 1] =
+      ghost->mirror_proc_offsets[i] + mirror_counts[i];
+  }
+  ghost->mirror_indices =
+    P4EST_ALLOC (p4est_locidx_t, ghost->mirror_proc_offsets[num_procs]);
+
+  /* The local numbers are taken from the piggy3 member filled by
+   * p4est_ghost_new; they count over all local trees. */
+  query_indices = P4EST_ALLOC (p4est_locidx_t,
+                               ghost->proc_offsets[num_procs]);
+  for (zz = 0; zz < ghost->ghosts.elem_count; ++zz) {
+    q = p4est_quadrant_array_index (&ghost->ghosts, zz);
+    query_indices[zz] = q->p.piggy3.local_num;
+  }
+  for (i = 0, peer = 0; i < num_procs; ++i) {
+    if (query_counts[i] > 0) {
+      mpiret = MPI_Irecv (ghost->mirror_indices +
+                          ghost->mirror_proc_offsets[i],
+                          (int) mirror_counts[i], P4EST_MPI_LOCIDX, i,
+                          P4EST_COMM_GHOST_DATA_QUERY, p4est->mpicomm,
+                          requests + peer);
+      SC_CHECK_MPI (mpiret);
+      mpiret = MPI_Isend (query_indices + ghost->proc_offsets[i],
+                          (int) query_counts[i], P4EST_MPI_LOCIDX, i,
+                          P4EST_COMM_GHOST_DATA_QUERY, p4est->mpicomm,
+                          requests + num_peers + peer);
+      SC_CHECK_MPI (mpiret);
+      ++peer;
+    }
+  }
+  P4EST_ASSERT (peer == num_peers);
+  mpiret = MPI_Waitall (2 * num_peers, requests, statuses);
+  SC_CHECK_MPI (mpiret);
+
+  P4EST_FREE (query_indices);
+  P4EST_FREE (query_counts);
+  P4EST_FREE (mirror_counts);
+  P4EST_FREE (requests);
+  P4EST_FREE (statuses);
+}
+
+/** Pack the user data of one peer's mirror quadrants into a buffer.
+ * Within a peer the indices ascend, so a moving tree cursor finds
+ * each quadrant without searching.
+ */
+static void
+p4est_ghost_exchange_pack_peer (p4est_t * p4est, p4est_ghost_t * ghost,
+                                int i, char *sendbuf)
+{
+  const size_t        data_size = p4est->data_size;
+  p4est_topidx_t      nt;
+  p4est_locidx_t      lm, idx;
+  p4est_tree_t       *tree;
+  p4est_quadrant_t   *q;
+
+  nt = p4est->first_local_tree;
+  for (lm = ghost->mirror_proc_offsets[i];
+       lm < ghost->mirror_proc_offsets[i + 1]; ++lm) {
+    idx = ghost->mirror_indices[lm];
+    P4EST_ASSERT (idx >= 0 && idx < p4est->local_num_quadrants);
+    P4EST_ASSERT (lm == ghost->mirror_proc_offsets[i] ||
+                  ghost->mirror_indices[lm - 1] < idx);
+    tree = p4est_tree_array_index (p4est->trees, nt);
+    while (idx >= tree->quadrants_offset +
+           (p4est_locidx_t) tree->quadrants.elem_count) {
+      tree = p4est_tree_array_index (p4est->trees, ++nt);
+    }
+    q = p4est_quadrant_array_index (&tree->quadrants,
+                                    (size_t) (idx -
+                                              tree->quadrants_offset));
+    memcpy (sendbuf + (size_t) lm * data_size, q->p.user_data, data_size);
+  }
+}
+
+#endif /* P4EST_MPI */
+
+static void
+p4est_ghost_exchange_data_internal (p4est_t * p4est, p4est_ghost_t * ghost,
+                                    void *ghost_data,
+                                    p4est_ghost_ready_t ready_fn,
+                                    void *user)
+{
+#ifdef P4EST_MPI
+  const int           num_procs = p4est->mpisize;
+  const size_t        data_size = p4est->data_size;
+  int                 i, peer, num_peers;
+  int                 mpiret;
+  int                 remaining, outcount, k;
+  int                *indices, *peer_ranks;
+  char               *sendbuf;
+  p4est_locidx_t      lcount, mcount;
+  MPI_Request        *requests;
+  MPI_Status         *statuses;
+
+  P4EST_ASSERT (ghost->mpisize == num_procs);
+
+  if (data_size == 0) {
+    if (ready_fn != NULL) {
+      /* there is no payload, so every peer's range is ready at once */
+      for (i = 0; i < num_procs; ++i) {
+        if (ghost->proc_offsets[i + 1] > ghost->proc_offsets[i]) {
+          ready_fn (p4est, ghost, i, ghost->proc_offsets[i],
+                    ghost->proc_offsets[i + 1], user);
+        }
+      }
+    }
+    return;
+  }
+
+  /* Count the number of peers; the peer relation of the ghost layer is
+   * symmetric since quadrant adjacency is */
+  for (i = 0, num_peers = 0; i < num_procs; ++i) {
+    if (ghost->proc_offsets[i + 1] > ghost->proc_offsets[i]) {
+      ++num_peers;
+    }
+  }
+
+  requests = P4EST_ALLOC (MPI_Request, 2 * num_peers);
+  statuses = P4EST_ALLOC (MPI_Status, 2 * num_peers);
+
+  p4est_ghost_exchange_ensure_plan (p4est, ghost);
+
+  /* Pack the user data of the mirror quadrants contiguously per peer */
+  sendbuf = P4EST_ALLOC (char,
+                         (size_t) ghost->mirror_proc_offsets[num_procs] *
+                         data_size);
+  for (i = 0; i < num_procs; ++i) {
+    p4est_ghost_exchange_pack_peer (p4est, ghost, i, sendbuf);
+  }
+
+  /* Exchange the payload; receives land directly in the caller's array
+   * which is aligned with ghost->ghosts through proc_offsets. */
+  peer_ranks = P4EST_ALLOC (int, num_peers);
+  for (i = 0, peer = 0; i < num_procs; ++i) {
+    lcount = ghost->proc_offsets[i + 1] - ghost->proc_offsets[i];
+    mcount = ghost->mirror_proc_offsets[i + 1] -
+      ghost->mirror_proc_offsets[i];
+    if (lcount > 0) {
+      P4EST_ASSERT (mcount > 0);
+      peer_ranks[peer] = i;
+      mpiret = MPI_Irecv ((char *) ghost_data +
+                          (size_t) ghost->proc_offsets[i] * data_size,
+                          (int) ((size_t) lcount * data_size), MPI_BYTE, i,
+                          P4EST_COMM_GHOST_DATA_REPLY, p4est->mpicomm,
+                          requests + peer);
+      SC_CHECK_MPI (mpiret);
+      mpiret = MPI_Isend (sendbuf +
+                          (size_t) ghost->mirror_proc_offsets[i] * data_size,
+                          (int) ((size_t) mcount * data_size), MPI_BYTE, i,
+                          P4EST_COMM_GHOST_DATA_REPLY, p4est->mpicomm,
+                          requests + num_peers + peer);
+      SC_CHECK_MPI (mpiret);
+      ++peer;
+    }
+  }
+  P4EST_ASSERT (peer == num_peers);
+  if (ready_fn == NULL) {
+    mpiret = MPI_Waitall (2 * num_peers, requests, statuses);
+    SC_CHECK_MPI (mpiret);
+  }
+  else {
+    /* hand each peer's ghost range to the callback on arrival */
+    indices = P4EST_ALLOC (int, num_peers);
+    remaining = num_peers;
+    while (remaining > 0) {
+      mpiret = MPI_Waitsome (num_peers, requests, &outcount, indices,
+                             statuses);
+      SC_CHECK_MPI (mpiret);
+      P4EST_ASSERT (outcount != MPI_UNDEFINED && outcount > 0);
+      for (k = 0; k < outcount; ++k) {
+        i = peer_ranks[indices[k]];
+        ready_fn (p4est, ghost, i, ghost->proc_offsets[i],
+                  ghost->proc_offsets[i + 1], user);
+      }
+      remaining -= outcount;
+    }
+    P4EST_FREE (indices);
+
+    /* the send side completes independently of the deliveries */
+    mpiret = MPI_Waitall (num_peers, requests + num_peers, statuses);
+    SC_CHECK_MPI (mpiret);
+  }
+  P4EST_FREE (peer_ranks);
+
+  P4EST_FREE (sendbuf);
+  P4EST_FREE (requests);
+  P4EST_FREE (statuses);
+#endif /* P4EST_MPI */
+}
+
+void
+p4est_ghost_exchange_data (p4est_t * p4est, p4est_ghost_t * ghost,
+                           void *ghost_data)
+{
+  p4est_ghost_exchange_data_internal (p4est, ghost, ghost_data, NULL, NULL);
+}
+
+void
+p4est_ghost_exchange_data_notify (p4est_t * p4est, p4est_ghost_t * ghost,
+                                  void *ghost_data,
+                                  p4est_ghost_ready_t ready_fn, void *user)
+{
+  P4EST_ASSERT (ready_fn != NULL);
+
+  p4est_ghost_exchange_data_internal (p4est, ghost, ghost_data, ready_fn,
+                                      user);
+}
+
+/* the speculative exchange keeps persistent requests on the cached
+ * peer topology so that repeated halo exchanges over an unchanged
+ * ghost layer only start and complete them */
+struct p4est_ghost_exchange
+{
+  p4est_t            *p4est;
+  p4est_ghost_t      *ghost;
+  char               *ghost_data;
+  char               *sendbuf;
+  int                 num_peers;
+  int                 started;
+  int                *peer_ranks;
+  int                *peer_signaled;
+#ifdef P4EST_MPI
+  MPI_Request        *requests;       /* receives, then sends */
+#endif
+};
+
+p4est_ghost_exchange_t *
+p4est_ghost_exchange_new (p4est_t * p4est, p4est_ghost_t * ghost,
+                          void *ghost_data)
+{
+  const size_t        data_size = p4est->data_size;
+  p4est_ghost_exchange_t *exc;
+#ifdef P4EST_MPI
+  const int           num_procs = p4est->mpisize;
+  int                 i, peer;
+  int                 mpiret;
+  p4est_locidx_t      lcount, mcount;
+#endif
+
+  P4EST_ASSERT (ghost->mpisize == p4est->mpisize);
+  P4EST_ASSERT (data_size > 0);
+
+  exc = P4EST_ALLOC_ZERO (p4est_ghost_exchange_t, 1);
+  exc->p4est = p4est;
+  exc->ghost = ghost;
+  exc->ghost_data = (char *) ghost_data;
+
+#ifdef P4EST_MPI
+  p4est_ghost_exchange_ensure_plan (p4est, ghost);
+
+  for (i = 0, exc->num_peers = 0; i < num_procs; ++i) {
+    if (ghost->proc_offsets[i + 1] > ghost->proc_offsets[i]) {
+      ++exc->num_peers;
+    }
+  }
+  exc->sendbuf = P4EST_ALLOC (char,
+                              (size_t)
+                              ghost->mirror_proc_offsets[num_procs] *
+                              data_size);
+  exc->peer_ranks = P4EST_ALLOC (int, exc->num_peers);
+  exc->peer_signaled = P4EST_ALLOC_ZERO (int, exc->num_peers);
+  exc->requests = P4EST_ALLOC (MPI_Request, 2 * exc->num_peers);
+
+  for (i = 0, peer = 0; i < num_procs; ++i) {
+    lcount = ghost->proc_offsets[i + 1] - ghost->proc_offsets[i];
+    mcount = ghost->mirror_proc_offsets[i + 1] -
+      ghost->mirror_proc_offsets[i];
+    if (lcount > 0) {
+      P4EST_ASSERT (mcount > 0);
+      exc->peer_ranks[peer] = i;
+      mpiret = MPI_Recv_init (exc->ghost_data +
+                              (size_t) ghost->proc_offsets[i] * data_size,
+                              (int) ((size_t) lcount * data_size),
+                              MPI_BYTE, i, P4EST_COMM_GHOST_DATA_REPLY,
+                              p4est->mpicomm, exc->requests + peer);
+      SC_CHECK_MPI (mpiret);
+      mpiret = MPI_Send_init (exc->sendbuf +
+                              (size_t) ghost->mirror_proc_offsets[i] *
+                              data_size,
+                              (int) ((size_t) mcount * data_size),
+                              MPI_BYTE, i, P4EST_COMM_GHOST_DATA_REPLY,
+                              p4est->mpicomm,
+                              exc->requests + exc->num_peers + peer);
+      SC_CHECK_MPI (mpiret);
+      ++peer;
+    }
+  }
+  P4EST_ASSERT (peer == exc->num_peers);
+#endif
+
+  return exc;
+}
+
+void
+p4est_ghost_exchange_start (p4est_ghost_exchange_t * exc)
+{
+#ifdef P4EST_MPI
+  int                 mpiret;
+#endif
+
+  P4EST_ASSERT (!exc->started);
+
+#ifdef P4EST_MPI
+  /* the receives go up before any peer is signaled ready */
+  if (exc->num_peers > 0) {
+    mpiret = MPI_Startall (exc->num_peers, exc->requests);
+    SC_CHECK_MPI (mpiret);
+  }
+  memset (exc->peer_signaled, 0, exc->num_peers * sizeof (int));
+#endif
+  exc->started = 1;
+}
+
+void
+p4est_ghost_exchange_ready (p4est_ghost_exchange_t * exc, int peer)
+{
+#ifdef P4EST_MPI
+  int                 k;
+  int                 mpiret;
+#endif
+
+  P4EST_ASSERT (exc->started);
+
+#ifdef P4EST_MPI
+  for (k = 0; k < exc->num_peers; ++k) {
+    if (peer >= 0 && exc->peer_ranks[k] != peer) {
+      continue;
+    }
+    P4EST_ASSERT (!exc->peer_signaled[k]);
+    p4est_ghost_exchange_pack_peer (exc->p4est, exc->ghost,
+                                    exc->peer_ranks[k], exc->sendbuf);
+    mpiret = MPI_Start (exc->requests + exc->num_peers + k);
+    SC_CHECK_MPI (mpiret);
+    exc->peer_signaled[k] = 1;
+  }
+#endif
+}
+
+void
+p4est_ghost_exchange_end (p4est_ghost_exchange_t * exc)
+{
+#ifdef P4EST_MPI
+  int                 k;
+  int                 mpiret;
+#endif
+
+  P4EST_ASSERT (exc->started);
+
+#ifdef P4EST_MPI
+  for (k = 0; k < exc->num_peers; ++k) {
+    P4EST_ASSERT (exc->peer_signaled[k]);
+  }
+  if (exc->num_peers > 0) {
+    mpiret = MPI_Waitall (2 * exc->num_peers, exc->requests,
+                          MPI_STATUSES_IGNORE);
+    SC_CHECK_MPI (mpiret);
+  }
+#endif
+  exc->started = 0;
+}
+
+void
+p4est_ghost_exchange_destroy (p4est_ghost_exchange_t * exc)
+{
+#ifdef P4EST_MPI
+  int                 k;
+  int                 mpiret;
+#endif
+
+  P4EST_ASSERT (!exc->started);
+
+#ifdef P4EST_MPI
+  for (k = 0; k < 2 * exc->num_peers; ++k) {
+    mpiret = MPI_Request_free (exc->requests + k);
+    SC_CHECK_MPI (mpiret);
+  }
+  P4EST_FREE (exc->requests);
+#endif
+  P4EST_FREE (exc->sendbuf);
+  P4EST_FREE (exc->peer_ranks);
+  P4EST_FREE (exc->peer_signaled);
+  P4EST_FREE (exc);
+}
+
 unsigned
 p4est_ghost_checksum (p4est_t * p4est, p4est_ghost_t * ghost)
 {
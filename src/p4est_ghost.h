@@ -44,6 +44,33 @@ typedef struct
 
   p4est_locidx_t     *tree_offsets;     /* num_trees + 1 ghost indices */
   p4est_locidx_t     *proc_offsets;     /* mpisize + 1 ghost indices */
+
+  /** Pack plan for p4est_ghost_exchange_data: the local numbers of the
+   * quadrants that each processor holds as ghosts of this one.  Both
+   * members are NULL until the first exchange and are kept across calls.
+   */
+  p4est_locidx_t     *mirror_indices;
+  p4est_locidx_t     *mirror_proc_offsets;      /* mpisize + 1 indices */
+
+  /** Run-length compressed mirror lists recorded by p4est_ghost_new
+   * from its send buffers: per processor the local numbers of the
+   * quadrants it receives as ghosts, stored as (first, length) pairs
+   * of consecutive numbers.  The first data exchange expands them into
+   * the pack plan above without a query round trip.  NULL for layers
+   * that were expanded or restored from the compact form; then the
+   * exchange falls back to querying the peers.
+   */
+  p4est_locidx_t     *mirror_runs;      /* two entries per run */
+  p4est_locidx_t     *mirror_proc_run_offsets;  /* mpisize + 1 runs */
+
+  /** Adjacency among the ghost quadrants themselves, filled on demand
+   * by p4est_ghost_adjacency.  The neighbors of ghost \a g are the
+   * ghost indices \c ghost_to_ghost[ghost_to_ghost_offsets[g]] up to
+   * excluding \c ghost_to_ghost[ghost_to_ghost_offsets[g + 1]].  Both
+   * members are NULL until that call and after every rebuild.
+   */
+  p4est_locidx_t     *ghost_to_ghost_offsets;   /* ghost count + 1 */
+  p4est_locidx_t     *ghost_to_ghost;
 }
 p4est_ghost_t;
 
@@ -53,6 +80,63 @@ p4est_ghost_t;
  */
 size_t              p4est_ghost_memory_used (p4est_ghost_t * ghost);
 
+/** One ghost quadrant in packed form: coordinates and level only.
+ * The piggy3.local_num payload lives in the separate local_num array of
+ * \ref p4est_ghost_compact_t and piggy3.which_tree is not stored at all
+ * since it is implied by the tree_offsets ranges.
+ */
+typedef struct p4est_ghost_packed
+{
+  p4est_qcoord_t      x, y;
+#ifdef P4_TO_P8
+  p4est_qcoord_t      z;
+#endif
+  int8_t              level;
+}
+p4est_ghost_packed_t;
+
+/** A compact dormant form of a ghost layer.
+ * It holds the same information as \ref p4est_ghost_t minus the cached
+ * pack plans and adjacency, at a fraction of the memory, but cannot be
+ * passed to the ghost algorithms directly; restore the full layer with
+ * \ref p4est_ghost_compact_restore first.
+ */
+typedef struct p4est_ghost_compact
+{
+  int                 mpisize;
+  p4est_topidx_t      num_trees;
+  p4est_locidx_t      num_ghosts;
+  p4est_ghost_packed_t *ghosts;
+  p4est_locidx_t     *local_num;        /* owner-local number per ghost */
+  p4est_locidx_t     *tree_offsets;     /* num_trees + 1 ghost indices */
+  p4est_locidx_t     *proc_offsets;     /* mpisize + 1 ghost indices */
+}
+p4est_ghost_compact_t;
+
+/** Store a ghost layer in the compact dormant form.
+ * The input layer is unchanged; destroy it separately to realize the
+ * memory savings.
+ */
+p4est_ghost_compact_t *p4est_ghost_compact_new (p4est_ghost_t * ghost);
+
+/** Rebuild a full ghost layer from its compact form.
+ * The restored layer is identical to the original except that the
+ * lazily built pack plan and ghost adjacency start out empty again.
+ * The compact form is unchanged.
+ * \return  A ghost layer to free with \ref p4est_ghost_destroy.
+ */
+p4est_ghost_t      *p4est_ghost_compact_restore (p4est_ghost_compact_t *
+                                                 gc);
+
+/** Calculate the memory usage of the compact form.
+ */
+size_t              p4est_ghost_compact_memory_used (p4est_ghost_compact_t *
+                                                     gc);
+
+/** Free all memory held by the compact form.
+ */
+void                p4est_ghost_compact_destroy (p4est_ghost_compact_t * gc);
+
 /** Gets the processor id of a quadrant's owner.
  * The quadrant can lie outside of a tree across faces (and only faces).
  *
@@ -85,9 +169,238 @@ int                 p4est_quadrant_find_owner (p4est_t * p4est,
 p4est_ghost_t      *p4est_ghost_new (p4est_t * p4est,
                                      p4est_connect_type_t btype);
 
+/** Transient storage for the split ghost layer construction.
+ * Created by p4est_ghost_new_begin and destroyed by
+ * p4est_ghost_new_end; its contents are private.
+ */
+typedef struct p4est_ghost_context p4est_ghost_context_t;
+
+/** Start building the ghost layer without waiting for its completion.
+ *
+ * This performs all local work of p4est_ghost_new and posts the sends
+ * of the border quadrants.  The caller may then compute on interior
+ * quadrants while the messages are in flight and must finish the
+ * construction with p4est_ghost_new_end before using the ghost layer.
+ * The forest must not be modified between begin and end.
+ *
+ * \param [in] p4est            The forest for which the ghost layer will be
+ *                              generated.
+ * \param [in] btype            Which ghosts to include (across face, corner
+ *                              or default, full).
+ * \return  Returns a context to pass to p4est_ghost_new_end.
+ */
+p4est_ghost_context_t *p4est_ghost_new_begin (p4est_t * p4est,
+                                              p4est_connect_type_t btype);
+
+/** Finish the ghost layer construction begun by p4est_ghost_new_begin.
+ *
+ * Receives the ghost quadrants, completes all outstanding messages and
+ * assembles the ghost layer.
+ *
+ * \param [in] context  created by p4est_ghost_new_begin.
+ * \return              A fully initialized ghost layer.
+ */
+p4est_ghost_t      *p4est_ghost_new_end (p4est_ghost_context_t * context);
+
+/** Builds a ghost layer that is \a depth quadrants wide.
+ *
+ * A depth of 1 is equivalent to p4est_ghost_new.  Each further layer is
+ * gathered in one round of point-to-point messages among the processors
+ * already known from the previous layer, so no additional global
+ * communication is needed beyond one sc_notify per layer.
+ *
+ * \param [in] p4est            The forest for which the ghost layer will be
+ *                              generated.
+ * \param [in] btype            Which neighbors to follow (across face, corner
+ *                              or default, full).
+ * \param [in] depth            Number of layers to collect, at least 1.
+ * \return                      A fully initialized ghost layer.
+ */
+p4est_ghost_t      *p4est_ghost_new_depth (p4est_t * p4est,
+                                           p4est_connect_type_t btype,
+                                           int depth);
+
+/** A zero-communication summary of the parallel face boundary.
+ * It lists the ranks that own quadrants touching this process across a
+ * face, together with the number of local (quadrant, face) pairs facing
+ * each of them, without building any ghost quadrant lists.
+ */
+typedef struct p4est_boundary_summary
+{
+  int                 num_peers;        /* ranks facing this process */
+  int                *peer_ranks;       /* num_peers ranks, ascending */
+  p4est_locidx_t     *peer_counts;      /* local quadrant faces shared
+                                           with each peer */
+}
+p4est_boundary_summary_t;
+
+/** Determine the face-neighbor ranks without constructing a ghost layer.
+ * Only \a p4est->global_first_position is consulted, so the cost is one
+ * sweep over the local tree boundary plus owner searches and no messages
+ * are sent; use this instead of p4est_ghost_new when an algorithm needs
+ * to know its peers but not the remote quadrants themselves.  The peer
+ * set equals the face peers of p4est_ghost_new with P4EST_CONNECT_FACE;
+ * ranks adjacent only across a corner are not listed.
+ * \param [in] p4est    A valid forest; no ghost layer is required.
+ * \return              A summary to free with
+ *                      \ref p4est_boundary_summary_destroy.
+ */
+p4est_boundary_summary_t *p4est_boundary_summary_new (p4est_t * p4est);
+
+/** Free all memory of a boundary summary. */
+void                p4est_boundary_summary_destroy (p4est_boundary_summary_t
+                                                    * bs);
+
 /** Frees all memory used for the ghost layer. */
 void                p4est_ghost_destroy (p4est_ghost_t * ghost);
 
+/** Bring an existing ghost layer up to date after local adaptation.
+ *
+ * When no rank has changed any quadrants, which is established by a
+ * single allreduce over the \a changed_trees flags, the ghost layer is
+ * left untouched.  Otherwise the layer is rebuilt in place: the
+ * structure pointer stays valid while its arrays are replaced.
+ *
+ * \param [in] p4est            The forest; must match the communicator
+ *                              and connectivity that built \a ghost.
+ * \param [in] btype            Which ghosts to include (across face, corner
+ *                              or default, full).
+ * \param [in] changed_trees    Flags over all trees in the connectivity,
+ *                              nonzero where a tree's quadrants have been
+ *                              modified since \a ghost was built.  Pass
+ *                              NULL to force the rebuild, which is
+ *                              required after repartitioning.
+ * \param [in,out] ghost        Ghost layer built with the same \a btype.
+ */
+void                p4est_ghost_update (p4est_t * p4est,
+                                        p4est_connect_type_t btype,
+                                        const int8_t * changed_trees,
+                                        p4est_ghost_t * ghost);
+
+/** Compute the adjacency links among the ghost quadrants.
+ *
+ * Fills \c ghost_to_ghost_offsets and \c ghost_to_ghost of \a ghost
+ * with the second shell: for every ghost quadrant, the other ghosts
+ * that touch it across a face or corner.  All information is already
+ * present in the assembled layer, so this is a purely local pass with
+ * no further communication; call it right after p4est_ghost_new while
+ * the ghost array is still in cache.  The links become stale with the
+ * layer and are dropped by p4est_ghost_update.
+ *
+ * \param [in] p4est            The forest that built \a ghost.
+ * \param [in,out] ghost        Ghost layer to attach the links to.
+ * \return                      The total number of links computed.
+ */
+p4est_locidx_t      p4est_ghost_adjacency (p4est_t * p4est,
+                                           p4est_ghost_t * ghost);
+
+/** Fill an array with the user data of all ghost quadrants.
+ *
+ * On the first call the pack plan is negotiated with the peer
+ * processors and cached inside \a ghost, so repeated exchanges over an
+ * unchanged ghost layer cost a single message round.  The plan is
+ * dropped whenever the layer is rebuilt.
+ *
+ * \param [in] p4est            The forest that built \a ghost; its
+ *                              data_size must be positive.
+ * \param [in,out] ghost        Ghost layer; caches the pack plan.
+ * \param [out] ghost_data      Preallocated space for
+ *                              ghost->ghosts.elem_count * data_size
+ *                              bytes, filled aligned with ghost->ghosts.
+ */
+void                p4est_ghost_exchange_data (p4est_t * p4est,
+                                               p4est_ghost_t * ghost,
+                                               void *ghost_data);
+
+/** Callback invoked when one peer's ghost data has arrived.
+ * The range [\a ghost_begin, \a ghost_end) indexes into
+ * ghost->ghosts and the caller's ghost_data array; it equals the
+ * peer's slice of ghost->proc_offsets.
+ * \param [in] peer         The rank whose data is now complete.
+ * \param [in] ghost_begin  First ghost index owned by \a peer.
+ * \param [in] ghost_end    One past the last ghost index of \a peer.
+ * \param [in] user         Pointer passed through unchanged.
+ */
+typedef void        (*p4est_ghost_ready_t) (p4est_t * p4est,
+                                            p4est_ghost_t * ghost,
+                                            int peer,
+                                            p4est_locidx_t ghost_begin,
+                                            p4est_locidx_t ghost_end,
+                                            void *user);
+
+/** Exchange ghost data and deliver it incrementally per peer.
+ * Behaves like p4est_ghost_exchange_data except that \a ready_fn is
+ * called from within this function as soon as any peer's receive
+ * completes, so work depending only on that peer's ghosts can start
+ * before the last straggler arrives.  The callback is invoked exactly
+ * once per peer, in arrival order.
+ * \param [in] ready_fn     Callback, must not be NULL.
+ * \param [in] user         Passed to the callback unchanged.
+ */
+void                p4est_ghost_exchange_data_notify (p4est_t * p4est,
+                                                      p4est_ghost_t * ghost,
+                                                      void *ghost_data,
+                                                      p4est_ghost_ready_t
+                                                      ready_fn, void *user);
+
+/** An opaque speculative ghost data exchange over a fixed ghost layer.
+ * The peer topology and pack plan are cached and the messages use
+ * persistent MPI requests, so repeated exchanges only start and
+ * complete them.  The intended cycle per time step is: start posts
+ * the receives; as soon as the update of the quadrants a peer mirrors
+ * is finished, ready packs and sends to that peer; end completes the
+ * exchange.  Signaling peers right after their data is computed lets
+ * the halo of the next step travel while the remaining local work of
+ * the current step is still running.
+ */
+typedef struct p4est_ghost_exchange p4est_ghost_exchange_t;
+
+/** Create a speculative exchange bound to a forest and a ghost layer.
+ * Negotiates and caches the pack plan; the ghost layer, the forest,
+ * and the target array must stay unchanged and alive for the life of
+ * the object.  The forest's data_size must be positive.
+ * \param [in] ghost_data   Preallocated target for
+ *                          ghost->ghosts.elem_count * data_size bytes,
+ *                          filled aligned with ghost->ghosts on every
+ *                          completed exchange.
+ */
+p4est_ghost_exchange_t *p4est_ghost_exchange_new (p4est_t * p4est,
+                                                  p4est_ghost_t * ghost,
+                                                  void *ghost_data);
+
+/** Post the receives of the next exchange.
+ * Must be called before any peer is signaled ready.
+ */
+void                p4est_ghost_exchange_start (p4est_ghost_exchange_t *
+                                                exc);
+
+/** Signal that the data mirrored by one peer is ready and send it.
+ * The mirror quadrants' user data is packed at the time of this call.
+ * Every peer must be signaled exactly once between start and end.
+ * \param [in] peer     Rank whose mirror data is complete, or -1 to
+ *                      signal all peers not yet signaled.
+ */
+void                p4est_ghost_exchange_ready (p4est_ghost_exchange_t *
+                                                exc, int peer);
+
+/** Complete the exchange; afterwards the ghost data array is filled.
+ */
+void                p4est_ghost_exchange_end (p4est_ghost_exchange_t * exc);
+
+/** Free the persistent requests and buffers of a speculative exchange.
+ * Must not be called between start and end.
+ */
+void                p4est_ghost_exchange_destroy (p4est_ghost_exchange_t *
+                                                  exc);
+
+/** Free the neighborhood communicator cached in \a p4est->inspect.
+ * The cache is created by p4est_ghost_new when the inspect member
+ * use_ghost_neighborhood is set and MPI-3 neighborhood collectives are
+ * available.  Call this before the forest or its inspect structure is
+ * destroyed.  Safe to call when no cache exists.
+ */
+void                p4est_ghost_neighborhood_release (p4est_t * p4est);
+
 /** Conduct binary search for exact match on a range of the ghost layer.
  * \param [in] ghost            The ghost layer.
  * \param [in] which_proc       The owner of the searched quadrant.  Can be -1.
@@ -0,0 +1,177 @@
+/*
+  This file is part of p4est.
+  p4est is a C library to manage a collection (a forest) of multiple
+  connected adaptive quadtrees or octrees in parallel.
+
+  Copyright (C) 2010 The University of Texas System
+  Written by Carsten Burstedde, Lucas C. Wilcox, and Tobin Isaac
+
+  p4est is free software; you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation; either version 2 of the License, or
+  (at your option) any later version.
+
+  p4est is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with p4est; if not, write to the Free Software Foundation, Inc.,
+  51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
+*/
+
+#ifndef P4_TO_P8
+#include <p4est_bits.h>
+#include <p4est_hierarchy.h>
+#else
+#include <p8est_bits.h>
+#include <p8est_hierarchy.h>
+#endif
+
+p4est_hierarchy_t  *
+p4est_hierarchy_new (p4est_t * p4est)
+{
+  const p4est_topidx_t num_trees = p4est->connectivity->num_trees;
+  int                 nlevels;
+  p4est_topidx_t      jt;
+  p4est_locidx_t      ncur, ncoarse, il, jl;
+  p4est_locidx_t     *curtree, *nexttree, *choff, *parents;
+  p4est_quadrant_t   *cur, *next;
+  p4est_tree_t       *tree;
+  p4est_hierarchy_level_t *lv;
+  p4est_hierarchy_t  *hierarchy;
+
+  hierarchy = P4EST_ALLOC (p4est_hierarchy_t, 1);
+  hierarchy->p4est = p4est;
+  hierarchy->levels =
+    P4EST_ALLOC (p4est_hierarchy_level_t, P4EST_QMAXLEVEL + 1);
+
+  /* level 0 is the forest's leaves; copy them into one scratch array */
+  ncur = p4est->local_num_quadrants;
+  cur = P4EST_ALLOC (p4est_quadrant_t, ncur);
+  lv = &hierarchy->levels[0];
+  lv->num_quadrants = ncur;
+  lv->tree_offsets = P4EST_ALLOC (p4est_locidx_t, num_trees + 1);
+  lv->child_offsets = NULL;
+  lv->parents = NULL;
+  curtree = lv->tree_offsets;
+  curtree[0] = 0;
+  for (jt = 0; jt < num_trees; ++jt) {
+    curtree[jt + 1] = curtree[jt];
+    if (jt >= p4est->first_local_tree && jt <= p4est->last_local_tree) {
+      tree = p4est_tree_array_index (p4est->trees, jt);
+      memcpy (cur + curtree[jt], tree->quadrants.array,
+              tree->quadrants.elem_count * sizeof (p4est_quadrant_t));
+      curtree[jt + 1] += (p4est_locidx_t) tree->quadrants.elem_count;
+    }
+  }
+  P4EST_ASSERT (curtree[num_trees] == ncur);
+
+  nlevels = 1;
+  while (ncur > 0) {
+    /* one bottom-up pass: complete sibling families collapse into their
+     * parent, everything else is carried over unchanged */
+    next = P4EST_ALLOC (p4est_quadrant_t, ncur);
+    nexttree = P4EST_ALLOC (p4est_locidx_t, num_trees + 1);
+    choff = P4EST_ALLOC (p4est_locidx_t, ncur + 1);
+    parents = P4EST_ALLOC (p4est_locidx_t, ncur);
+    ncoarse = 0;
+    nexttree[0] = 0;
+    for (jt = 0; jt < num_trees; ++jt) {
+      il = curtree[jt];
+      while (il < curtree[jt + 1]) {
+        choff[ncoarse] = il;
+        if (cur[il].level > 0 && il + P4EST_CHILDREN <= curtree[jt + 1] &&
+            p4est_quadrant_is_familyv (&cur[il])) {
+          p4est_quadrant_parent (&cur[il], &next[ncoarse]);
+          for (jl = 0; jl < P4EST_CHILDREN; ++jl) {
+            parents[il + jl] = ncoarse;
+          }
+          il += P4EST_CHILDREN;
+        }
+        else {
+          next[ncoarse] = cur[il];
+          parents[il] = ncoarse;
+          ++il;
+        }
+        ++ncoarse;
+      }
+      nexttree[jt + 1] = ncoarse;
+    }
+    choff[ncoarse] = ncur;
+    P4EST_ASSERT (ncoarse <= ncur);
+
+    if (ncoarse == ncur) {
+      /* no family left to collapse: the hierarchy is complete */
+      P4EST_FREE (next);
+      P4EST_FREE (nexttree);
+      P4EST_FREE (choff);
+      P4EST_FREE (parents);
+      break;
+    }
+
+    /* record the new coarser level */
+    P4EST_ASSERT (nlevels <= P4EST_QMAXLEVEL);
+    hierarchy->levels[nlevels - 1].parents = parents;
+    lv = &hierarchy->levels[nlevels];
+    lv->num_quadrants = ncoarse;
+    lv->tree_offsets = nexttree;
+    lv->child_offsets = P4EST_REALLOC (choff, p4est_locidx_t, ncoarse + 1);
+    lv->parents = NULL;
+    ++nlevels;
+
+    P4EST_FREE (cur);
+    cur = next;
+    curtree = lv->tree_offsets;
+    ncur = ncoarse;
+  }
+  P4EST_FREE (cur);
+
+  hierarchy->num_levels = nlevels;
+  hierarchy->levels =
+    P4EST_REALLOC (hierarchy->levels, p4est_hierarchy_level_t, nlevels);
+
+  return hierarchy;
+}
+
+void
+p4est_hierarchy_destroy (p4est_hierarchy_t * hierarchy)
+{
+  int                 k;
+  p4est_hierarchy_level_t *lv;
+
+  for (k = 0; k < hierarchy->num_levels; ++k) {
+    lv = &hierarchy->levels[k];
+    P4EST_FREE (lv->tree_offsets);
+    P4EST_FREE (lv->child_offsets);
+    P4EST_FREE (lv->parents);
+  }
+  P4EST_FREE (hierarchy->levels);
+  P4EST_FREE (hierarchy);
+}
+
+size_t
+p4est_hierarchy_memory_used (p4est_hierarchy_t * hierarchy)
+{
+  int                 k;
+  size_t              size;
+  const size_t        ntrees =
+    (size_t) hierarchy->p4est->connectivity->num_trees;
+  p4est_hierarchy_level_t *lv;
+
+  size = sizeof (p4est_hierarchy_t) +
+    (size_t) hierarchy->num_levels * sizeof (p4est_hierarchy_level_t);
+  for (k = 0; k < hierarchy->num_levels; ++k) {
+    lv = &hierarchy->levels[k];
+    size += (ntrees + 1) * sizeof (p4est_locidx_t);
+    if (lv->child_offsets != NULL) {
+      size += ((size_t) lv->num_quadrants + 1) * sizeof (p4est_locidx_t);
+    }
+    if (lv->parents != NULL) {
+      size += (size_t) lv->num_quadrants * sizeof (p4est_locidx_t);
+    }
+  }
+
+  return size;
+}
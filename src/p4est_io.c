@@ -34,6 +34,7 @@
 #include <p8est_io.h>
 #endif
 #include <sc_search.h>
+#include <sc_zlib.h>
 
 sc_array_t         *
 p4est_deflate_quadrants (p4est_t * p4est, sc_array_t ** data)
@@ -84,6 +85,466 @@ p4est_deflate_quadrants (p4est_t * p4est, sc_array_t ** data)
   return qarr;
 }
 
+/** Append an unsigned number to a byte array in 7-bit groups.
+ * The lowest group comes first; all but the last have the top bit set.
+ */
+static void
+p4est_varint_append (sc_array_t * buffer, uint64_t value)
+{
+  uint8_t            *bp;
+
+  while (value >= 0x80) {
+    bp = (uint8_t *) sc_array_push (buffer);
+    *bp = (uint8_t) (value & 0x7F) | 0x80;
+    value >>= 7;
+  }
+  bp = (uint8_t *) sc_array_push (buffer);
+  *bp = (uint8_t) value;
+}
+
+/** Read a number encoded by p4est_varint_append and advance \a pos.
+ * Aborts when the encoding runs past \a end.
+ */
+static uint64_t
+p4est_varint_read (const uint8_t ** pos, const uint8_t * end)
+{
+  int                 shift = 0;
+  uint64_t            value = 0;
+  uint8_t             byte;
+
+  do {
+    SC_CHECK_ABORT (*pos < end && shift < 64, "invalid varint");
+    byte = *(*pos)++;
+    value |= (uint64_t) (byte & 0x7F) << shift;
+    shift += 7;
+  }
+  while (byte & 0x80);
+
+  return value;
+}
+
+/** Fold a signed number into an unsigned one of the same magnitude. */
+static uint64_t
+p4est_zigzag_encode (int64_t value)
+{
+  return ((uint64_t) value << 1) ^ (uint64_t) (value >> 63);
+}
+
+/** Invert p4est_zigzag_encode. */
+static int64_t
+p4est_zigzag_decode (uint64_t value)
+{
+  return (int64_t) (value >> 1) ^ -(int64_t) (value & 1);
+}
+
+sc_array_t         *
+p4est_compress_quadrants (sc_array_t * quadrants)
+{
+  size_t              zcount, zz;
+  sc_array_t         *buffer;
+  p4est_qcoord_t      px, py;
+#ifdef P4_TO_P8
+  p4est_qcoord_t      pz;
+#endif
+  p4est_qcoord_t     *qap;
+  uint8_t            *bp;
+
+  P4EST_ASSERT (quadrants != NULL);
+  P4EST_ASSERT (quadrants->elem_size == sizeof (p4est_qcoord_t));
+  P4EST_ASSERT (quadrants->elem_count % (P4EST_DIM + 1) == 0);
+
+  zcount = quadrants->elem_count / (P4EST_DIM + 1);
+  qap = (p4est_qcoord_t *) quadrants->array;
+
+  buffer = sc_array_new (sizeof (uint8_t));
+  p4est_varint_append (buffer, (uint64_t) zcount);
+
+  /* Morton order makes successive coordinate deltas small */
+  px = py = 0;
+#ifdef P4_TO_P8
+  pz = 0;
+#endif
+  for (zz = 0; zz < zcount; ++zz) {
+    p4est_varint_append (buffer,
+                         p4est_zigzag_encode ((int64_t) qap[0] -
+                                              (int64_t) px));
+    p4est_varint_append (buffer,
+                         p4est_zigzag_encode ((int64_t) qap[1] -
+                                              (int64_t) py));
+    px = qap[0];
+    py = qap[1];
+#ifdef P4_TO_P8
+    p4est_varint_append (buffer,
+                         p4est_zigzag_encode ((int64_t) qap[2] -
+                                              (int64_t) pz));
+    pz = qap[2];
+#endif
+    /* the level fits one byte as is */
+    P4EST_ASSERT (qap[P4EST_DIM] >= 0 && qap[P4EST_DIM] <= P4EST_QMAXLEVEL);
+    bp = (uint8_t *) sc_array_push (buffer);
+    *bp = (uint8_t) qap[P4EST_DIM];
+    qap += P4EST_DIM + 1;
+  }
+
+  return buffer;
+}
+
+sc_array_t         *
+p4est_uncompress_quadrants (sc_array_t * buffer)
+{
+  size_t              zcount, zz;
+  sc_array_t         *qarr;
+  const uint8_t      *pos, *end;
+  p4est_qcoord_t      px, py;
+#ifdef P4_TO_P8
+  p4est_qcoord_t      pz;
+#endif
+  p4est_qcoord_t     *qap;
+
+  P4EST_ASSERT (buffer != NULL);
+  P4EST_ASSERT (buffer->elem_size == sizeof (uint8_t));
+
+  pos = (const uint8_t *) buffer->array;
+  end = pos + buffer->elem_count;
+  zcount = (size_t) p4est_varint_read (&pos, end);
+
+  qarr = sc_array_new_size (sizeof (p4est_qcoord_t),
+                            (P4EST_DIM + 1) * zcount);
+  qap = (p4est_qcoord_t *) qarr->array;
+
+  px = py = 0;
+#ifdef P4_TO_P8
+  pz = 0;
+#endif
+  for (zz = 0; zz < zcount; ++zz) {
+    px = (p4est_qcoord_t)
+      ((int64_t) px + p4est_zigzag_decode (p4est_varint_read (&pos, end)));
+    *qap++ = px;
+    py = (p4est_qcoord_t)
+      ((int64_t) py + p4est_zigzag_decode (p4est_varint_read (&pos, end)));
+    *qap++ = py;
+#ifdef P4_TO_P8
+    pz = (p4est_qcoord_t)
+      ((int64_t) pz + p4est_zigzag_decode (p4est_varint_read (&pos, end)));
+    *qap++ = pz;
+#endif
+    SC_CHECK_ABORT (pos < end, "quadrant levels overrun");
+    *qap++ = (p4est_qcoord_t) * pos++;
+  }
+  SC_CHECK_ABORT (pos == end, "quadrant buffer not fully consumed");
+  P4EST_ASSERT ((void *) qap ==
+                qarr->array + qarr->elem_size * qarr->elem_count);
+
+  return qarr;
+}
+
+/** Encode one tree's quadrants into a fresh segment with one reference.
+ */
+static p4est_snapshot_segment_t *
+p4est_snapshot_segment_encode (p4est_tree_t * tree, long revision)
+{
+  size_t              zz;
+  const size_t        zcount = tree->quadrants.elem_count;
+  sc_array_t         *coords;
+  p4est_qcoord_t     *qap;
+  p4est_quadrant_t   *q;
+  p4est_snapshot_segment_t *segment;
+
+  coords = sc_array_new_size (sizeof (p4est_qcoord_t),
+                              (P4EST_DIM + 1) * zcount);
+  qap = (p4est_qcoord_t *) coords->array;
+  for (zz = 0; zz < zcount; ++zz) {
+    q = p4est_quadrant_array_index (&tree->quadrants, zz);
+    *qap++ = q->x;
+    *qap++ = q->y;
+#ifdef P4_TO_P8
+    *qap++ = q->z;
+#endif
+    *qap++ = (p4est_qcoord_t) q->level;
+  }
+
+  segment = P4EST_ALLOC (p4est_snapshot_segment_t, 1);
+  segment->refcount = 1;
+  segment->revision = revision;
+  segment->num_quadrants = (p4est_locidx_t) zcount;
+  segment->buffer = p4est_compress_quadrants (coords);
+  sc_array_destroy (coords);
+
+  return segment;
+}
+
+p4est_snapshot_t   *
+p4est_snapshot_new (p4est_t * p4est, p4est_snapshot_t * previous,
+                    sc_array_t * changes)
+{
+  int                 reuse;
+  size_t              zc;
+  const long          revision = p4est->revision;
+  p4est_topidx_t      tt;
+  p4est_topidx_t      shared, encoded;
+  p4est_tree_t       *tree;
+  p4est_change_t     *change;
+  p4est_snapshot_segment_t *segment;
+  p4est_snapshot_t   *snapshot;
+
+  P4EST_ASSERT (changes == NULL ||
+                changes->elem_size == sizeof (p4est_change_t));
+
+  snapshot = P4EST_ALLOC (p4est_snapshot_t, 1);
+  snapshot->num_trees = p4est->connectivity->num_trees;
+  snapshot->first_local_tree = p4est->first_local_tree;
+  snapshot->last_local_tree = p4est->last_local_tree;
+  snapshot->revision = revision;
+  snapshot->segments = P4EST_ALLOC_ZERO (p4est_snapshot_segment_t *,
+                                         snapshot->num_trees);
+
+  zc = 0;
+  shared = encoded = 0;
+  for (tt = p4est->first_local_tree; tt <= p4est->last_local_tree; ++tt) {
+    tree = p4est_tree_array_index (p4est->trees, tt);
+
+    /* decide whether the previous snapshot's segment is still valid */
+    reuse = 0;
+    segment = NULL;
+    if (previous != NULL &&
+        tt >= previous->first_local_tree &&
+        tt <= previous->last_local_tree) {
+      segment = previous->segments[tt];
+    }
+    if (segment != NULL &&
+        segment->num_quadrants ==
+        (p4est_locidx_t) tree->quadrants.elem_count) {
+      if (revision == previous->revision) {
+        reuse = 1;
+      }
+      else if (changes != NULL) {
+        /* both the trees and the change set are in ascending order */
+        reuse = 1;
+        while (zc < changes->elem_count) {
+          change = (p4est_change_t *) sc_array_index (changes, zc);
+          if (change->which_tree < tt) {
+            ++zc;
+            continue;
+          }
+          if (change->which_tree == tt) {
+            reuse = 0;
+          }
+          break;
+        }
+      }
+    }
+    if (reuse) {
+      ++segment->refcount;
+      snapshot->segments[tt] = segment;
+      ++shared;
+    }
+    else {
+      snapshot->segments[tt] = p4est_snapshot_segment_encode (tree,
+                                                              revision);
+      ++encoded;
+    }
+  }
+  P4EST_VERBOSEF ("Snapshot shared %lld re-encoded %lld tree segments\n",
+                  (long long) shared, (long long) encoded);
+
+  return snapshot;
+}
+
+sc_array_t         *
+p4est_snapshot_tree (p4est_snapshot_t * snapshot, p4est_topidx_t which_tree)
+{
+  P4EST_ASSERT (0 <= which_tree && which_tree < snapshot->num_trees);
+
+  return snapshot->segments[which_tree] == NULL ? NULL :
+    snapshot->segments[which_tree]->buffer;
+}
+
+void
+p4est_snapshot_destroy (p4est_snapshot_t * snapshot)
+{
+  p4est_topidx_t      tt;
+  p4est_snapshot_segment_t *segment;
+
+  for (tt = 0; tt < snapshot->num_trees; ++tt) {
+    segment = snapshot->segments[tt];
+    if (segment == NULL) {
+      continue;
+    }
+    P4EST_ASSERT (segment->refcount > 0);
+    if (--segment->refcount == 0) {
+      sc_array_destroy (segment->buffer);
+      P4EST_FREE (segment);
+    }
+  }
+  P4EST_FREE (snapshot->segments);
+  P4EST_FREE (snapshot);
+}
+
+/* one fixed run of quadrants' per-quadrant data: hot holds the raw
+ * bytes, cold the zlib stream written by the last sweep; at most one
+ * of the two is non-NULL and both NULL means never written (zero) */
+typedef struct p4est_paged_data_page
+{
+  char               *hot;      /* raw bytes or NULL */
+  sc_array_t         *cold;     /* compressed byte stream or NULL */
+  int                 touched;  /* accessed since the last sweep */
+}
+p4est_paged_data_page_t;
+
+struct p4est_paged_data
+{
+  p4est_t            *p4est;
+  long                revision; /* forest revision at creation */
+  size_t              data_size;        /* bytes per quadrant */
+  p4est_locidx_t      page_quadrants;   /* quadrants per page */
+  p4est_locidx_t      num_pages;
+  p4est_paged_data_page_t *pages;
+};
+
+/* the last page may cover fewer quadrants than the others */
+static size_t
+p4est_paged_data_bytes (p4est_paged_data_t * pd, p4est_locidx_t page)
+{
+  p4est_locidx_t      count;
+
+  count = SC_MIN (pd->page_quadrants, pd->p4est->local_num_quadrants -
+                  page * pd->page_quadrants);
+  P4EST_ASSERT (count > 0);
+
+  return (size_t) count * pd->data_size;
+}
+
+static void
+p4est_paged_data_heat (p4est_paged_data_t * pd, p4est_locidx_t page)
+{
+  int                 retval;
+  size_t              bytes = p4est_paged_data_bytes (pd, page);
+  uLongf              raw_length;
+  p4est_paged_data_page_t *p = pd->pages + page;
+
+  P4EST_ASSERT (p->hot == NULL);
+  p->hot = P4EST_ALLOC (char, bytes);
+  if (p->cold == NULL) {
+    memset (p->hot, 0, bytes);
+  }
+  else {
+    raw_length = (uLongf) bytes;
+    retval = uncompress ((Bytef *) p->hot, &raw_length,
+                         (const Bytef *) p->cold->array,
+                         (uLong) p->cold->elem_count);
+    SC_CHECK_ABORT (retval == Z_OK && raw_length == (uLongf) bytes,
+                    "paged data decompression");
+    sc_array_destroy (p->cold);
+    p->cold = NULL;
+  }
+}
+
+p4est_paged_data_t *
+p4est_paged_data_new (p4est_t * p4est, size_t data_size,
+                      p4est_locidx_t page_quadrants)
+{
+  p4est_paged_data_t *pd;
+
+  P4EST_ASSERT (data_size > 0);
+
+  pd = P4EST_ALLOC (p4est_paged_data_t, 1);
+  pd->p4est = p4est;
+  pd->revision = p4est->revision;
+  pd->data_size = data_size;
+  pd->page_quadrants = page_quadrants > 0 ? page_quadrants : 256;
+  pd->num_pages = (p4est->local_num_quadrants + pd->page_quadrants - 1) /
+    pd->page_quadrants;
+  pd->pages = P4EST_ALLOC_ZERO (p4est_paged_data_page_t, pd->num_pages);
+
+  return pd;
+}
+
+void               *
+p4est_paged_data_index (p4est_paged_data_t * pd, p4est_locidx_t local_num)
+{
+  p4est_locidx_t      page;
+  p4est_paged_data_page_t *p;
+
+  P4EST_ASSERT (pd->revision == pd->p4est->revision);
+  P4EST_ASSERT (0 <= local_num &&
+                local_num < pd->p4est->local_num_quadrants);
+
+  page = local_num / pd->page_quadrants;
+  p = pd->pages + page;
+  if (p->hot == NULL) {
+    p4est_paged_data_heat (pd, page);
+    /* p4est_iterate delivers the quadrants in ascending Morton order,
+     * so a sweeping consumer enters the pages in ascending order:
+     * decompress the following cold page now so that its cost is paid
+     * before the iterator arrives there */
+    if (page + 1 < pd->num_pages && pd->pages[page + 1].hot == NULL &&
+        pd->pages[page + 1].cold != NULL) {
+      p4est_paged_data_heat (pd, page + 1);
+    }
+  }
+  p->touched = 1;
+
+  return p->hot +
+    (size_t) (local_num - page * pd->page_quadrants) * pd->data_size;
+}
+
+void
+p4est_paged_data_sweep (p4est_paged_data_t * pd)
+{
+  int                 retval;
+  long long           kept = 0, cooled = 0;
+  size_t              bytes;
+  uLongf              comp_length;
+  Bytef              *comp_data;
+  p4est_locidx_t      page;
+  p4est_paged_data_page_t *p;
+
+  for (page = 0; page < pd->num_pages; ++page) {
+    p = pd->pages + page;
+    if (p->hot == NULL) {
+      continue;
+    }
+    if (p->touched) {
+      p->touched = 0;
+      ++kept;
+      continue;
+    }
+    bytes = p4est_paged_data_bytes (pd, page);
+    comp_length = compressBound ((uLong) bytes);
+    comp_data = (Bytef *) P4EST_ALLOC (char, comp_length);
+    retval = compress2 (comp_data, &comp_length, (const Bytef *) p->hot,
+                        (uLong) bytes, Z_BEST_SPEED);
+    SC_CHECK_ABORT (retval == Z_OK, "paged data compression");
+    p->cold = sc_array_new_size (sizeof (char), (size_t) comp_length);
+    memcpy (p->cold->array, comp_data, (size_t) comp_length);
+    P4EST_FREE (comp_data);
+    P4EST_FREE (p->hot);
+    p->hot = NULL;
+    ++cooled;
+  }
+  P4EST_VERBOSEF ("Paged data sweep kept %lld compressed %lld pages\n",
+                  kept, cooled);
+}
+
+void
+p4est_paged_data_destroy (p4est_paged_data_t * pd)
+{
+  p4est_locidx_t      page;
+  p4est_paged_data_page_t *p;
+
+  for (page = 0; page < pd->num_pages; ++page) {
+    p = pd->pages + page;
+    if (p->hot != NULL) {
+      P4EST_FREE (p->hot);
+    }
+    if (p->cold != NULL) {
+      sc_array_destroy (p->cold);
+    }
+  }
+  P4EST_FREE (pd->pages);
+  P4EST_FREE (pd);
+}
+
 p4est_t            *
 p4est_inflate (MPI_Comm mpicomm, p4est_connectivity_t * connectivity,
                const p4est_gloidx_t * global_first_quadrant,
@@ -265,3 +726,247 @@ p4est_inflate (MPI_Comm mpicomm, p4est_connectivity_t * connectivity,
 
   return p4est;
 }
+
+void
+p4est_transmit (p4est_t * p4est, MPI_Comm bridgecomm, int peer)
+{
+  int                 mpiret;
+  size_t              zmeta;
+  p4est_topidx_t      num_trees;
+  p4est_gloidx_t      header[4];
+  p4est_gloidx_t     *meta;
+  sc_array_t         *qarr, *darr;
+
+  P4EST_GLOBAL_PRODUCTION ("Into " P4EST_STRING "_transmit\n");
+
+  P4EST_ASSERT (p4est_is_valid (p4est));
+
+  /* describe the forest to the peer */
+  num_trees = p4est->connectivity->num_trees;
+  header[0] = (p4est_gloidx_t) p4est->mpisize;
+  header[1] = (p4est_gloidx_t) num_trees;
+  header[2] = (p4est_gloidx_t) p4est->data_size;
+  header[3] = (p4est_gloidx_t) p4est->local_num_quadrants;
+  mpiret = MPI_Send (header, 4, P4EST_MPI_GLOIDX, peer,
+                     P4EST_COMM_TRANSMIT_COUNT, bridgecomm);
+  SC_CHECK_MPI (mpiret);
+
+  /* ship the partition and the cumulative per-tree counts */
+  zmeta = (size_t) (p4est->mpisize + 1) + (size_t) (num_trees + 1);
+  meta = P4EST_ALLOC (p4est_gloidx_t, zmeta);
+  memcpy (meta, p4est->global_first_quadrant,
+          (p4est->mpisize + 1) * sizeof (p4est_gloidx_t));
+  p4est_comm_count_pertree (p4est, meta + p4est->mpisize + 1);
+  mpiret = MPI_Send (meta, (int) zmeta, P4EST_MPI_GLOIDX, peer,
+                     P4EST_COMM_TRANSMIT_LOAD, bridgecomm);
+  SC_CHECK_MPI (mpiret);
+  P4EST_FREE (meta);
+
+  /* ship the linear quadrant storage and optionally the quadrant data */
+  darr = NULL;
+  qarr = p4est_deflate_quadrants (p4est,
+                                  p4est->data_size > 0 ? &darr : NULL);
+  mpiret = MPI_Send (qarr->array,
+                     (int) (qarr->elem_count * qarr->elem_size), MPI_BYTE,
+                     peer, P4EST_COMM_TRANSMIT_LOAD, bridgecomm);
+  SC_CHECK_MPI (mpiret);
+  sc_array_destroy (qarr);
+  if (darr != NULL) {
+    mpiret = MPI_Send (darr->array,
+                       (int) (darr->elem_count * darr->elem_size), MPI_BYTE,
+                       peer, P4EST_COMM_TRANSMIT_LOAD, bridgecomm);
+    SC_CHECK_MPI (mpiret);
+    sc_array_destroy (darr);
+  }
+
+  P4EST_GLOBAL_PRODUCTION ("Done " P4EST_STRING "_transmit\n");
+}
+
+p4est_t            *
+p4est_receive (MPI_Comm mpicomm, MPI_Comm bridgecomm, int peer,
+               p4est_connectivity_t * connectivity, void *user_pointer)
+{
+  int                 mpiret;
+  int                 num_procs;
+  size_t              dsize, zmeta, zlocal;
+  p4est_topidx_t      num_trees;
+  p4est_gloidx_t      header[4];
+  p4est_gloidx_t     *meta;
+  p4est_t            *p4est;
+  sc_array_t         *qarr, *darr;
+  MPI_Status          mpistatus;
+
+  P4EST_GLOBAL_PRODUCTION ("Into " P4EST_STRING "_receive\n");
+
+  P4EST_ASSERT (p4est_connectivity_is_valid (connectivity));
+
+  /* the two communicators pair the processes of equal rank */
+  mpiret = MPI_Comm_size (mpicomm, &num_procs);
+  SC_CHECK_MPI (mpiret);
+  mpiret = MPI_Recv (header, 4, P4EST_MPI_GLOIDX, peer,
+                     P4EST_COMM_TRANSMIT_COUNT, bridgecomm, &mpistatus);
+  SC_CHECK_MPI (mpiret);
+  SC_CHECK_ABORT (header[0] == (p4est_gloidx_t) num_procs,
+                  "communicator size mismatch");
+  SC_CHECK_ABORT (header[1] == (p4est_gloidx_t) connectivity->num_trees,
+                  "connectivity mismatch");
+  num_trees = (p4est_topidx_t) header[1];
+  dsize = (size_t) header[2];
+  zlocal = (size_t) header[3];
+
+  /* receive the partition and the cumulative per-tree counts */
+  zmeta = (size_t) (num_procs + 1) + (size_t) (num_trees + 1);
+  meta = P4EST_ALLOC (p4est_gloidx_t, zmeta);
+  mpiret = MPI_Recv (meta, (int) zmeta, P4EST_MPI_GLOIDX, peer,
+                     P4EST_COMM_TRANSMIT_LOAD, bridgecomm, &mpistatus);
+  SC_CHECK_MPI (mpiret);
+
+  /* receive the linear quadrant storage and optionally the quadrant data */
+  qarr = sc_array_new_size (sizeof (p4est_qcoord_t),
+                            (P4EST_DIM + 1) * zlocal);
+  mpiret = MPI_Recv (qarr->array,
+                     (int) (qarr->elem_count * qarr->elem_size), MPI_BYTE,
+                     peer, P4EST_COMM_TRANSMIT_LOAD, bridgecomm,
+                     &mpistatus);
+  SC_CHECK_MPI (mpiret);
+  darr = NULL;
+  if (dsize > 0) {
+    darr = sc_array_new_size (dsize, zlocal);
+    mpiret = MPI_Recv (darr->array, (int) (dsize * zlocal), MPI_BYTE,
+                       peer, P4EST_COMM_TRANSMIT_LOAD, bridgecomm,
+                       &mpistatus);
+    SC_CHECK_MPI (mpiret);
+  }
+
+  /* build the forest from its own memory pools */
+  p4est = p4est_inflate (mpicomm, connectivity, meta,
+                         meta + num_procs + 1, qarr, darr, user_pointer);
+  sc_array_destroy (qarr);
+  if (darr != NULL) {
+    sc_array_destroy (darr);
+  }
+  P4EST_FREE (meta);
+
+  P4EST_GLOBAL_PRODUCTION ("Done " P4EST_STRING "_receive\n");
+
+  return p4est;
+}
+
+p4est_t            *
+p4est_replicate (p4est_t * p4est, MPI_Comm replcomm, int root,
+                 p4est_connectivity_t * connectivity, void *user_pointer)
+{
+  int                 mpiret;
+  int                 i, replrank;
+  int                *recvcounts, *displs;
+  p4est_topidx_t      num_trees;
+  p4est_gloidx_t      header[3];
+  p4est_gloidx_t      gfq[2];
+  p4est_gloidx_t     *pertree;
+  p4est_t            *replica;
+  sc_array_t         *qarr, *full, *carr;
+  MPI_Request         reqs[2];
+
+  P4EST_GLOBAL_PRODUCTION ("Into " P4EST_STRING "_replicate\n");
+
+  P4EST_ASSERT (p4est_connectivity_is_valid (connectivity));
+
+  /* gather the linear quadrant storage on the forest's first rank */
+  full = NULL;
+  pertree = NULL;
+  if (p4est != NULL) {
+    P4EST_ASSERT (p4est_is_valid (p4est));
+    qarr = p4est_deflate_quadrants (p4est, NULL);
+    recvcounts = displs = NULL;
+    if (p4est->mpirank == 0) {
+      full = sc_array_new_size (sizeof (p4est_qcoord_t),
+                                (P4EST_DIM + 1) *
+                                (size_t) p4est->global_num_quadrants);
+      recvcounts = P4EST_ALLOC (int, p4est->mpisize);
+      displs = P4EST_ALLOC (int, p4est->mpisize);
+      for (i = 0; i < p4est->mpisize; ++i) {
+        recvcounts[i] = (int) ((P4EST_DIM + 1) *
+                               (p4est->global_first_quadrant[i + 1] -
+                                p4est->global_first_quadrant[i]));
+        displs[i] = (int) ((P4EST_DIM + 1) *
+                           p4est->global_first_quadrant[i]);
+      }
+    }
+    mpiret = MPI_Gatherv (qarr->array, (int) qarr->elem_count,
+                          P4EST_MPI_QCOORD,
+                          full == NULL ? NULL : full->array,
+                          recvcounts, displs, P4EST_MPI_QCOORD, 0,
+                          p4est->mpicomm);
+    SC_CHECK_MPI (mpiret);
+    sc_array_destroy (qarr);
+    P4EST_FREE (recvcounts);
+    P4EST_FREE (displs);
+
+    /* the cumulative per-tree counts end up on the same rank */
+    pertree = P4EST_ALLOC (p4est_gloidx_t,
+                           p4est->connectivity->num_trees + 1);
+    p4est_comm_count_pertree_root (p4est, 0, pertree);
+    if (p4est->mpirank != 0) {
+      P4EST_FREE (pertree);
+      pertree = NULL;
+    }
+  }
+
+  if (replcomm == MPI_COMM_NULL) {
+    /* this process only feeds the gather above */
+    P4EST_ASSERT (full == NULL && pertree == NULL);
+    P4EST_GLOBAL_PRODUCTION ("Done " P4EST_STRING "_replicate\n");
+    return NULL;
+  }
+  mpiret = MPI_Comm_rank (replcomm, &replrank);
+  SC_CHECK_MPI (mpiret);
+
+  /* the root compresses the full stream and describes it to everybody */
+  carr = NULL;
+  if (replrank == root) {
+    SC_CHECK_ABORT (p4est != NULL && p4est->mpirank == 0,
+                    "replication root must be the forest's first rank");
+    carr = p4est_compress_quadrants (full);
+    header[0] = p4est->global_num_quadrants;
+    header[1] = (p4est_gloidx_t) p4est->connectivity->num_trees;
+    header[2] = (p4est_gloidx_t) carr->elem_count;
+  }
+  mpiret = MPI_Ibcast (header, 3, P4EST_MPI_GLOIDX, root, replcomm,
+                       &reqs[0]);
+  SC_CHECK_MPI (mpiret);
+  mpiret = MPI_Wait (&reqs[0], MPI_STATUS_IGNORE);
+  SC_CHECK_MPI (mpiret);
+  num_trees = (p4est_topidx_t) header[1];
+  SC_CHECK_ABORT (num_trees == connectivity->num_trees,
+                  "connectivity mismatch");
+
+  /* the per-tree counts and the compressed stream travel together */
+  if (replrank != root) {
+    pertree = P4EST_ALLOC (p4est_gloidx_t, num_trees + 1);
+    carr = sc_array_new_size (sizeof (uint8_t), (size_t) header[2]);
+  }
+  mpiret = MPI_Ibcast (pertree, (int) (num_trees + 1), P4EST_MPI_GLOIDX,
+                       root, replcomm, &reqs[0]);
+  SC_CHECK_MPI (mpiret);
+  mpiret = MPI_Ibcast (carr->array, (int) carr->elem_count, MPI_BYTE,
+                       root, replcomm, &reqs[1]);
+  SC_CHECK_MPI (mpiret);
+  mpiret = MPI_Waitall (2, reqs, MPI_STATUSES_IGNORE);
+  SC_CHECK_MPI (mpiret);
+
+  /* every replication rank inflates its own serial copy */
+  if (replrank != root) {
+    full = p4est_uncompress_quadrants (carr);
+  }
+  sc_array_destroy (carr);
+  gfq[0] = 0;
+  gfq[1] = header[0];
+  replica = p4est_inflate (MPI_COMM_SELF, connectivity, gfq, pertree,
+                           full, NULL, user_pointer);
+  sc_array_destroy (full);
+  P4EST_FREE (pertree);
+
+  P4EST_GLOBAL_PRODUCTION ("Done " P4EST_STRING "_replicate\n");
+
+  return replica;
+}
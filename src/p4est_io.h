@@ -40,6 +40,135 @@
 sc_array_t         *p4est_deflate_quadrants (p4est_t * p4est,
                                              sc_array_t ** data);
 
+/** Compress a quadrant array as returned by p4est_deflate_quadrants.
+ * Successive quadrants in Morton order differ little in their
+ * coordinates, so the deltas are folded to unsigned and stored in
+ * variable length encoding; the level takes one byte per quadrant.
+ * Typical forests shrink by a factor of five to ten.
+ * \param [in] quadrants  Array of type p4est_qcoord_t holding x y level
+ *                        for each quadrant; it is not modified.
+ * \return                Newly allocated byte array with the compressed
+ *                        stream, to be destroyed by the caller.
+ */
+sc_array_t         *p4est_compress_quadrants (sc_array_t * quadrants);
+
+/** Uncompress a buffer created by p4est_compress_quadrants.
+ * \param [in] buffer     Byte array with the compressed stream.
+ * \return                Newly allocated array of type p4est_qcoord_t as
+ *                        accepted by p4est_inflate.
+ * \note            Aborts when the stream is inconsistent.
+ */
+sc_array_t         *p4est_uncompress_quadrants (sc_array_t * buffer);
+
+/** One immutable per-tree compressed segment shared between snapshots.
+ * The buffer holds the p4est_compress_quadrants stream of one tree's
+ * quadrants and never changes after creation; snapshots that agree on
+ * the tree's content reference it jointly.
+ */
+typedef struct p4est_snapshot_segment
+{
+  int                 refcount; /**< number of snapshots referencing */
+  long                revision; /**< forest revision when encoded */
+  p4est_locidx_t      num_quadrants;    /**< quadrants in the tree */
+  sc_array_t         *buffer;   /**< compressed x y level byte stream */
+}
+p4est_snapshot_segment_t;
+
+/** A serialized view of the process-local forest with structural
+ * sharing.  Each local tree is encoded into an immutable segment;
+ * creating a new snapshot against a previous one re-encodes only the
+ * trees that changed in between and references the other segments,
+ * so repeated serialization costs track the change rate instead of
+ * the forest size.
+ */
+typedef struct p4est_snapshot
+{
+  p4est_topidx_t      num_trees;        /**< trees in the connectivity */
+  p4est_topidx_t      first_local_tree; /**< local range when taken */
+  p4est_topidx_t      last_local_tree;  /**< local range when taken */
+  long                revision; /**< forest revision when taken */
+  p4est_snapshot_segment_t **segments;  /**< one per tree, NULL where
+                                             the tree is not local */
+}
+p4est_snapshot_t;
+
+/** Serialize the local quadrants, sharing segments of unchanged trees.
+ * Without a previous snapshot every local tree is encoded fresh.  With
+ * one, a tree's segment is referenced instead of re-encoded when the
+ * tree is provably unchanged: either the forest revision still equals
+ * the previous snapshot's, or the tree is absent from \a changes.
+ * \param [in] p4est     The forest is not modified.
+ * \param [in] previous  A snapshot of the same forest taken earlier,
+ *                       or NULL to encode everything.
+ * \param [in] changes   Change set covering exactly the interval since
+ *                       \a previous was taken, from p4est_changes_end,
+ *                       or NULL to share only at equal revisions.
+ * \return               A snapshot to destroy with
+ *                       p4est_snapshot_destroy.
+ */
+p4est_snapshot_t   *p4est_snapshot_new (p4est_t * p4est,
+                                        p4est_snapshot_t * previous,
+                                        sc_array_t * changes);
+
+/** Access the compressed stream of one tree in a snapshot.
+ * \param [in] which_tree   Tree index in [0, num_trees).
+ * \return      Byte array owned by the snapshot, decodable with
+ *              p4est_uncompress_quadrants, or NULL if the tree was not
+ *              local when the snapshot was taken.
+ */
+sc_array_t         *p4est_snapshot_tree (p4est_snapshot_t * snapshot,
+                                         p4est_topidx_t which_tree);
+
+/** Destroy a snapshot and the segments no other snapshot references.
+ */
+void                p4est_snapshot_destroy (p4est_snapshot_t * snapshot);
+
+/** An opaque paged store of per-quadrant data with compressed cold
+ * pages.  The quadrants are grouped into fixed runs of Morton order;
+ * a page not accessed between two sweeps is compressed and takes only
+ * its zlib stream in memory until the next access decompresses it.
+ * Intended for wide per-quadrant state that is touched in a small
+ * working set per step. */
+typedef struct p4est_paged_data p4est_paged_data_t;
+
+/** Create a paged data store for the current local quadrants.
+ * All entries read as zero until first written.  The store is keyed to
+ * the forest revision: after refinement, coarsening, balance, or
+ * partition the local numbering changes and the store must be rebuilt.
+ * \param [in] p4est          The forest is not modified.
+ * \param [in] data_size      Bytes per quadrant; independent of the
+ *                            forest's own data_size.
+ * \param [in] page_quadrants Quadrants per page, or 0 for a default.
+ * \return      A store to destroy with p4est_paged_data_destroy.
+ */
+p4est_paged_data_t *p4est_paged_data_new (p4est_t * p4est,
+                                          size_t data_size,
+                                          p4est_locidx_t page_quadrants);
+
+/** Access the data of one quadrant, decompressing its page on demand.
+ * Since p4est_iterate delivers the quadrants in ascending Morton order,
+ * the accessor also decompresses the page following a newly heated one,
+ * so a sweeping iterate callback finds its next page already hot.
+ * \param [in] local_num  Cumulative local quadrant index, i.e.
+ *                        tree->quadrants_offset + quadid as available
+ *                        in the iterate callback info structures.
+ * \return      Pointer to the quadrant's data_size bytes, valid until
+ *              the next sweep or the destruction of the store.
+ */
+void               *p4est_paged_data_index (p4est_paged_data_t * pd,
+                                            p4est_locidx_t local_num);
+
+/** Compress the pages not accessed since the previous sweep.
+ * Call once per time step or similar unit of work: pages inside the
+ * active working set stay hot and pay nothing, the rest shrink to
+ * their compressed size.  Pointers returned earlier become invalid.
+ */
+void                p4est_paged_data_sweep (p4est_paged_data_t * pd);
+
+/** Destroy a paged data store and all its pages.
+ */
+void                p4est_paged_data_destroy (p4est_paged_data_t * pd);
+
 /** Create a new p4est based on serialized data.
  * See p4est.h and p4est_communication.h for more information on parameters.
  * \param [in] mpicomm       A valid MPI communicator.
@@ -65,4 +194,66 @@ p4est_t            *p4est_inflate (MPI_Comm mpicomm,
                                    sc_array_t * quadrants, sc_array_t * data,
                                    void *user_pointer);
 
+/** Hand the forest to a second code without touching disk.
+ * This call is collective over the forest's communicator.  Process k
+ * of the sender must pair with process k of a matching p4est_receive,
+ * so both communicators need the same number of processes; \a peer is
+ * the rank of the partner in \a bridgecomm, a communicator spanning
+ * both codes.  The partition, the cumulative per-tree counts and the
+ * linear quadrant storage including any quadrant data are sent as is.
+ * The forest is not modified and remains usable.
+ * \param [in] p4est       Valid forest structure.
+ * \param [in] bridgecomm  Communicator containing sender and receiver.
+ * \param [in] peer        Rank of the receiving process in bridgecomm.
+ */
+void                p4est_transmit (p4est_t * p4est,
+                                   MPI_Comm bridgecomm, int peer);
+
+/** Receive a forest sent by a matching p4est_transmit.
+ * See p4est_transmit for the pairing requirements.  The quadrants are
+ * filled into this communicator's own memory pools, so sender and
+ * receiver share no forest storage afterwards.
+ * \param [in] mpicomm      Communicator for the newly created forest;
+ *                          must match the sender's communicator size.
+ * \param [in] bridgecomm   Communicator containing sender and receiver.
+ * \param [in] peer         Rank of the sending process in bridgecomm.
+ * \param [in] connectivity Connectivity for the forest; both codes must
+ *                          use the same tree layout.  Note that p4est
+ *                          does not take ownership of the memory.
+ * \param [in] user_pointer Assign to the user_pointer member of the p4est.
+ * \return              The newly created forest holding a copy of the
+ *                      sender's quadrants and data.
+ */
+p4est_t            *p4est_receive (MPI_Comm mpicomm, MPI_Comm bridgecomm,
+                               int peer,
+                               p4est_connectivity_t * connectivity,
+                               void *user_pointer);
+
+/** Replicate the forest structure onto a set of processes by broadcast.
+ * The quadrants are gathered on the forest's first rank, compressed
+ * with p4est_compress_quadrants, shipped over \a replcomm in a single
+ * nonblocking broadcast, and inflated on arrival.  Each process of
+ * \a replcomm receives its own serial forest on MPI_COMM_SELF holding
+ * the complete structure without user data, replacing a save/load
+ * round-trip through the filesystem.  The call is collective over the
+ * forest's communicator and over \a replcomm; the process that is
+ * \a root in \a replcomm must be rank 0 of the forest's communicator.
+ * \param [in] p4est     The forest to replicate, not modified; NULL on
+ *                       processes outside the forest's communicator.
+ * \param [in] replcomm  Communicator receiving the replicas, or
+ *                       MPI_COMM_NULL on processes that only hold a
+ *                       part of the forest and receive no copy.
+ * \param [in] root      Rank of the forest's first process in replcomm.
+ * \param [in] connectivity Connectivity for the replicas; must describe
+ *                       the same tree layout as the forest's.  Note
+ *                       that p4est does not take ownership.
+ * \param [in] user_pointer Assign to the user_pointer of each replica.
+ * \return               The serial replica, or NULL where replcomm is
+ *                       MPI_COMM_NULL.
+ */
+p4est_t            *p4est_replicate (p4est_t * p4est, MPI_Comm replcomm,
+                                     int root,
+                                     p4est_connectivity_t * connectivity,
+                                     void *user_pointer);
+
 #endif /* !P4EST_IO_H */
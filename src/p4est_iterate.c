@@ -32,6 +32,9 @@
 #include <p4est_iterate.h>
 #include <p4est_search.h>
 #endif
+#ifdef P4EST_HAVE_PTHREAD_H
+#include <pthread.h>
+#endif
 
 /* tier ring functions:
  *
@@ -2364,8 +2367,15 @@ p4est_volume_iterate (p4est_iter_volume_args_t * args, void *user_data,
   P4EST_ASSERT (*Level == start_level);
 }
 
+/* compute the inter-tree boundaries each tree owns.  the edge and corner
+ * ownership scans are skipped unless the corresponding callbacks run, since
+ * their results would be discarded by the face-only traversal */
 static int32_t     *
-p4est_iter_get_boundaries (p4est_t * p4est, p4est_topidx_t * last_run_tree)
+p4est_iter_get_boundaries (p4est_t * p4est, p4est_topidx_t * last_run_tree,
+#ifdef P4_TO_P8
+                           int loop_edge,
+#endif
+                           int loop_corner)
 {
   p4est_topidx_t      ti;
   int                 i;
@@ -2459,7 +2469,7 @@ p4est_iter_get_boundaries (p4est_t * p4est, p4est_topidx_t * last_run_tree)
     }
 #ifdef P4_TO_P8
     for (e = 0; e < 12; e++, mask <<= 1) {
-      if ((touch & mask) && !(init[t] & mask)) {
+      if (loop_edge && (touch & mask) && !(init[t] & mask)) {
         if (tte != NULL) {
           edge = tte[t * 12 + e];
         }
@@ -2519,7 +2529,7 @@ p4est_iter_get_boundaries (p4est_t * p4est, p4est_topidx_t * last_run_tree)
     }
 #endif
     for (c = 0; c < P4EST_CHILDREN; c++, mask <<= 1) {
-      if ((touch & mask) && !(init[t] & mask)) {
+      if (loop_corner && (touch & mask) && !(init[t] & mask)) {
         if (ttc != NULL) {
           corner = ttc[t * P4EST_CHILDREN + c];
         }
@@ -2616,6 +2626,226 @@ p4est_iter_get_boundaries (p4est_t * p4est, p4est_topidx_t * last_run_tree)
   return owned;
 }
 
+/* the bits of the x coordinate in a Morton index; the other dimensions
+ * are the left-shifted copies of the same pattern */
+#ifndef P4_TO_P8
+#define P4EST_ITER_XBITS ((uint64_t) 0x5555555555555555ULL)
+#else
+#define P4EST_ITER_XBITS ((uint64_t) 0x1249249249249249ULL)
+#endif
+
+/* Check whether a tree can take the structured fast sweep below: all
+ * of its quadrants on one level and the complete tree on this process.
+ * Both tests are O(1) thanks to the per-level histogram. */
+static int
+p4est_iterate_tree_is_uniform (p4est_tree_t * tree)
+{
+  const int           level = (int) tree->maxlevel;
+  const size_t        count = tree->quadrants.elem_count;
+
+  return p4est_tree_is_uniform (tree) &&
+    P4EST_DIM * level < 64 &&
+    count == ((size_t) 1 << (P4EST_DIM * level));
+}
+
+/* Deliver the volume and intra-tree face callbacks of a uniformly
+ * refined, completely process-local tree at structured-grid speed.
+ * The quadrant array index equals the Morton index, so every interior
+ * neighbor is one masked Morton increment away, and no hanging
+ * configurations or ghost quadrants can occur.  Inter-tree boundaries
+ * are handled by the caller as usual. */
+static void
+p4est_iterate_tree_uniform (p4est_t * p4est, p4est_ghost_t * ghost_layer,
+                            p4est_topidx_t t, void *user_data,
+                            p4est_iter_volume_t iter_volume,
+                            p4est_iter_face_t iter_face)
+{
+  int                 dir;
+  int                 level;
+  size_t              zz, count;
+  uint64_t            mask, nm;
+  p4est_qcoord_t      qlen;
+  p4est_tree_t       *tree = p4est_tree_array_index (p4est->trees, t);
+  sc_array_t         *tquadrants = &tree->quadrants;
+  p4est_quadrant_t   *quads = (p4est_quadrant_t *) tquadrants->array;
+  p4est_quadrant_t   *q;
+  p4est_iter_volume_info_t vinfo;
+  p4est_iter_face_info_t finfo;
+  p4est_iter_face_side_t sides[2];
+
+  P4EST_ASSERT (p4est_iterate_tree_is_uniform (tree));
+
+  level = (int) tree->maxlevel;
+  count = tquadrants->elem_count;
+  qlen = P4EST_QUADRANT_LEN (level);
+
+  if (iter_volume != NULL) {
+    vinfo.p4est = p4est;
+    vinfo.ghost_layer = ghost_layer;
+    vinfo.treeid = t;
+    for (zz = 0; zz < count; zz++) {
+      vinfo.quad = quads + zz;
+      vinfo.quadid = (p4est_locidx_t) zz;
+      iter_volume (&vinfo, user_data);
+    }
+  }
+
+  if (iter_face == NULL) {
+    return;
+  }
+
+  finfo.p4est = p4est;
+  finfo.ghost_layer = ghost_layer;
+  finfo.orientation = 0;
+  finfo.tree_boundary = 0;
+  sc_array_init_data (&finfo.sides, sides,
+                      sizeof (p4est_iter_face_side_t), 2);
+  for (dir = 0; dir < 2; dir++) {
+    sides[dir].treeid = t;
+    sides[dir].is_hanging = 0;
+    sides[dir].is.full.is_ghost = 0;
+  }
+
+  for (zz = 0; zz < count; zz++) {
+    q = quads + zz;
+    for (dir = 0; dir < P4EST_DIM; dir++) {
+      switch (dir) {
+      case 0:
+        if (q->x + qlen >= P4EST_ROOT_LEN) {
+          continue;
+        }
+        break;
+      case 1:
+        if (q->y + qlen >= P4EST_ROOT_LEN) {
+          continue;
+        }
+        break;
+#ifdef P4_TO_P8
+      case 2:
+        if (q->z + qlen >= P4EST_ROOT_LEN) {
+          continue;
+        }
+        break;
+#endif
+      default:
+        SC_ABORT_NOT_REACHED ();
+      }
+
+      /* increment the dir bits of the Morton index with masked carry */
+      mask = P4EST_ITER_XBITS << dir;
+      nm = ((((uint64_t) zz | ~mask) + 1) & mask) | ((uint64_t) zz & ~mask);
+      P4EST_ASSERT (nm < (uint64_t) count);
+
+      sides[0].face = (int8_t) (2 * dir + 1);
+      sides[0].is.full.quad = q;
+      sides[0].is.full.quadid = (p4est_locidx_t) zz;
+      sides[1].face = (int8_t) (2 * dir);
+      sides[1].is.full.quad = quads + (size_t) nm;
+      sides[1].is.full.quadid = (p4est_locidx_t) nm;
+      iter_face (&finfo, user_data);
+    }
+  }
+}
+
+/* run the volume iterator and the inter-tree face, edge, and corner
+ * iterators for one tree.  \a touch is the mask of inter-tree boundaries
+ * owned by this tree as computed by p4est_iter_get_boundaries */
+static void
+p4est_iterate_tree (p4est_t * p4est, p4est_ghost_t * ghost_layer,
+                    p4est_iter_loop_args_t * loop_args, p4est_topidx_t t,
+                    int32_t touch, void *user_data,
+                    p4est_iter_volume_t iter_volume,
+                    p4est_iter_face_t iter_face,
+#ifdef P4_TO_P8
+                    p8est_iter_edge_t iter_edge,
+#endif
+                    p4est_iter_corner_t iter_corner)
+{
+  int                 f, c;
+  p4est_iter_face_args_t face_args;
+#ifdef P4_TO_P8
+  int                 e;
+  p8est_iter_edge_args_t edge_args;
+#endif
+  p4est_iter_corner_args_t corner_args;
+  p4est_iter_volume_args_t args;
+  int32_t             mask;
+
+  if (t >= p4est->first_local_tree && t <= p4est->last_local_tree) {
+    if (!loop_args->loop_corner &&
+#ifdef P4_TO_P8
+        !loop_args->loop_edge &&
+#endif
+        p4est_iterate_tree_is_uniform (p4est_tree_array_index
+                                       (p4est->trees, t))) {
+      /* the complete tree is on this process at one level: sweep it as
+       * a structured grid instead of recursing.  The inter-tree
+       * boundaries below are not affected by this shortcut. */
+      p4est_iterate_tree_uniform (p4est, ghost_layer, t, user_data,
+                                  iter_volume, iter_face);
+    }
+    else {
+      p4est_iter_init_volume (&args, p4est, ghost_layer, loop_args, t);
+
+      p4est_volume_iterate (&args, user_data, iter_volume, iter_face,
+#ifdef P4_TO_P8
+                            iter_edge,
+#endif
+                            iter_corner);
+
+      p4est_iter_reset_volume (&args);
+    }
+  }
+
+  if (!touch) {
+    return;
+  }
+  mask = 0x00000001;
+  /* Now we need to run face_iterate on the faces between trees */
+  for (f = 0; f < 2 * P4EST_DIM; f++, mask <<= 1) {
+    if ((touch & mask) == 0) {
+      continue;
+    }
+    p4est_iter_init_face (&face_args, p4est, ghost_layer, loop_args, t, f);
+    p4est_face_iterate (&face_args, user_data, iter_face,
+#ifdef P4_TO_P8
+                        iter_edge,
+#endif
+                        iter_corner);
+    p4est_iter_reset_face (&face_args);
+  }
+
+  /* if there is an edge or a corner callback, we need to run
+   * edge_iterate on the edges between trees */
+#ifdef P4_TO_P8
+  if (loop_args->loop_edge) {
+    for (e = 0; e < 12; e++, mask <<= 1) {
+      if ((touch & mask) == 0) {
+        continue;
+      }
+      p8est_iter_init_edge (&edge_args, p4est, ghost_layer, loop_args, t, e);
+      p8est_edge_iterate (&edge_args, user_data, iter_edge, iter_corner);
+      p8est_iter_reset_edge (&edge_args);
+    }
+  }
+  else {
+    mask <<= 12;
+  }
+#endif
+
+  if (loop_args->loop_corner) {
+    for (c = 0; c < P4EST_CHILDREN; c++, mask <<= 1) {
+      if ((touch & mask) == 0) {
+        continue;
+      }
+      p4est_iter_init_corner (&corner_args, p4est, ghost_layer, loop_args,
+                              t, c);
+      p4est_corner_iterate (&corner_args, user_data, iter_corner);
+      p4est_iter_reset_corner (&corner_args);
+    }
+  }
+}
+
 void
 p4est_iterate (p4est_t * p4est, p4est_ghost_t * Ghost_layer, void *user_data,
                p4est_iter_volume_t iter_volume, p4est_iter_face_t iter_face,
@@ -2624,7 +2854,6 @@ p4est_iterate (p4est_t * p4est, p4est_ghost_t * Ghost_layer, void *user_data,
 #endif
                p4est_iter_corner_t iter_corner)
 {
-  int                 f, c;
   p4est_topidx_t      t;
   p4est_ghost_t       empty_ghost_layer;
   p4est_ghost_t      *ghost_layer;
@@ -2632,20 +2861,18 @@ p4est_iterate (p4est_t * p4est, p4est_ghost_t * Ghost_layer, void *user_data,
   p4est_connectivity_t *conn = p4est->connectivity;
   size_t              global_num_trees = trees->elem_count;
   p4est_iter_loop_args_t *loop_args;
-  p4est_iter_face_args_t face_args;
-#ifdef P4_TO_P8
-  int                 e;
-  p8est_iter_edge_args_t edge_args;
-#endif
-  p4est_iter_corner_args_t corner_args;
-  p4est_iter_volume_args_t args;
   p4est_topidx_t      first_local_tree = p4est->first_local_tree;
   p4est_topidx_t      last_local_tree = p4est->last_local_tree;
   p4est_topidx_t      last_run_tree;
   int32_t            *owned;
-  int32_t             mask, touch;
 
   P4EST_ASSERT (p4est_is_valid (p4est));
+  p4est_profile_fire (p4est, P4EST_PROFILE_ITERATE, 0);
+
+  /* start timing */
+  if (p4est->inspect != NULL) {
+    p4est->inspect->iterate_time = -MPI_Wtime ();
+  }
 
   if (p4est->first_local_tree < 0 ||
       (iter_face == NULL && iter_corner == NULL &&
@@ -2653,6 +2880,10 @@ p4est_iterate (p4est_t * p4est, p4est_ghost_t * Ghost_layer, void *user_data,
        iter_edge == NULL &&
 #endif
        iter_volume == NULL)) {
+    if (p4est->inspect != NULL) {
+      p4est->inspect->iterate_time += MPI_Wtime ();
+    }
+    p4est_profile_fire (p4est, P4EST_PROFILE_ITERATE, 1);
     return;
   }
 
@@ -2679,6 +2910,10 @@ p4est_iterate (p4est_t * p4est, p4est_ghost_t * Ghost_layer, void *user_data,
       P4EST_FREE (empty_ghost_layer.tree_offsets);
       P4EST_FREE (empty_ghost_layer.proc_offsets);
     }
+    if (p4est->inspect != NULL) {
+      p4est->inspect->iterate_time += MPI_Wtime ();
+    }
+    p4est_profile_fire (p4est, P4EST_PROFILE_ITERATE, 1);
     return;
   }
 
@@ -2690,82 +2925,1731 @@ p4est_iterate (p4est_t * p4est, p4est_ghost_t * Ghost_layer, void *user_data,
                                         iter_corner, ghost_layer,
                                         p4est->mpisize);
 
-  owned = p4est_iter_get_boundaries (p4est, &last_run_tree);
+  owned = p4est_iter_get_boundaries (p4est, &last_run_tree,
+#ifdef P4_TO_P8
+                                     loop_args->loop_edge,
+#endif
+                                     loop_args->loop_corner);
   last_run_tree = (last_run_tree < last_local_tree) ? last_local_tree :
     last_run_tree;
 
   /** we have to loop over all trees and not just local trees because of the
    * ghost layer */
   for (t = first_local_tree; t <= last_run_tree; t++) {
-    if (t >= first_local_tree && t <= last_local_tree) {
-      p4est_iter_init_volume (&args, p4est, ghost_layer, loop_args, t);
+    p4est_iterate_tree (p4est, ghost_layer, loop_args, t, owned[t],
+                        user_data, iter_volume, iter_face,
+#ifdef P4_TO_P8
+                        iter_edge,
+#endif
+                        iter_corner);
+  }
 
-      p4est_volume_iterate (&args, user_data, iter_volume, iter_face,
+  if (Ghost_layer == NULL) {
+    P4EST_FREE (empty_ghost_layer.tree_offsets);
+    P4EST_FREE (empty_ghost_layer.proc_offsets);
+  }
+
+  P4EST_FREE (owned);
+  p4est_iter_loop_args_destroy (loop_args);
+
+  if (p4est->inspect != NULL) {
+    p4est->inspect->iterate_time += MPI_Wtime ();
+  }
+  p4est_profile_fire (p4est, P4EST_PROFILE_ITERATE, 1);
+}
+
+#ifdef P4EST_HAVE_PTHREAD_H
+
+/* a shared queue of work units claimed by atomic increments, so idle
+ * workers steal the remaining units instead of waiting on a static
+ * assignment */
+typedef struct p4est_iter_work
+{
+  volatile long       next;
+#ifndef __GNUC__
+  pthread_mutex_t     mutex;
+#endif
+}
+p4est_iter_work_t;
+
+static void
+p4est_iter_work_init (p4est_iter_work_t * w)
+{
+  w->next = 0;
+#ifndef __GNUC__
+  pthread_mutex_init (&w->mutex, NULL);
+#endif
+}
+
+static void
+p4est_iter_work_reset (p4est_iter_work_t * w)
+{
+  w->next = 0;
+#ifndef __GNUC__
+  pthread_mutex_destroy (&w->mutex);
+#endif
+}
+
+/* claim the next unit of work: a lock-free fetch-and-add where the
+ * compiler provides one, a mutex otherwise */
+static long
+p4est_iter_work_next (p4est_iter_work_t * w)
+{
+#ifdef __GNUC__
+  return __sync_fetch_and_add (&w->next, 1);
+#else
+  long                k;
+
+  pthread_mutex_lock (&w->mutex);
+  k = w->next++;
+  pthread_mutex_unlock (&w->mutex);
+  return k;
+#endif
+}
+
+typedef struct p4est_iter_thread
+{
+  p4est_t            *p4est;
+  p4est_ghost_t      *ghost_layer;
+  void               *user_data;
+  p4est_iter_volume_t iter_volume;
+  p4est_iter_face_t   iter_face;
 #ifdef P4_TO_P8
-                            iter_edge,
+  p8est_iter_edge_t   iter_edge;
 #endif
-                            iter_corner);
+  p4est_iter_corner_t iter_corner;
+  p4est_iter_loop_args_t *loop_args;
+  const int32_t      *owned;
+  const p4est_topidx_t *tree_list; /* the trees of the current color */
+  size_t              list_count;
+  p4est_iter_work_t  *work;
+  p4est_locidx_t      chunk_size;
+  int                 thread_num;
+  int                 num_threads;
+}
+p4est_iter_thread_t;
 
-      p4est_iter_reset_volume (&args);
+/* each worker claims trees of the current color until none are left; the
+ * list is sorted by descending quadrant count, so the expensive trees are
+ * claimed first and stragglers are filled in by idle workers */
+static void        *
+p4est_iterate_tree_thread (void *v)
+{
+  p4est_iter_thread_t *th = (p4est_iter_thread_t *) v;
+  long                k;
+  p4est_topidx_t      t;
+
+  for (;;) {
+    k = p4est_iter_work_next (th->work);
+    if ((size_t) k >= th->list_count) {
+      break;
     }
+    t = th->tree_list[k];
+    p4est_iterate_tree (th->p4est, th->ghost_layer, th->loop_args, t,
+                        th->owned[t], th->user_data, th->iter_volume,
+                        th->iter_face,
+#ifdef P4_TO_P8
+                        th->iter_edge,
+#endif
+                        th->iter_corner);
+  }
 
-    touch = owned[t];
-    if (!touch) {
-      continue;
+  return NULL;
+}
+
+/* deliver the volume callback for stolen chunks of the local quadrant
+ * range: chunk boundaries may fall in the middle of a tree, so each
+ * tree's quadrant range is partitioned among the workers */
+static void        *
+p4est_iterate_volume_thread (void *v)
+{
+  p4est_iter_thread_t *th = (p4est_iter_thread_t *) v;
+  p4est_t            *p4est = th->p4est;
+  p4est_locidx_t      num_local = p4est->local_num_quadrants;
+  p4est_locidx_t      begin, end, offset;
+  p4est_locidx_t      si, lo, hi, n_quads;
+  long                k;
+  p4est_topidx_t      t;
+  p4est_tree_t       *tree;
+  sc_array_t         *quadrants;
+  p4est_iter_volume_info_t info;
+
+  info.p4est = p4est;
+  info.ghost_layer = th->ghost_layer;
+
+  for (;;) {
+    k = p4est_iter_work_next (th->work);
+    begin = (p4est_locidx_t) k * th->chunk_size;
+    if (begin >= num_local) {
+      break;
     }
-    mask = 0x00000001;
-    /* Now we need to run face_iterate on the faces between trees */
-    for (f = 0; f < 2 * P4EST_DIM; f++, mask <<= 1) {
-      if ((touch & mask) == 0) {
+    end = begin + th->chunk_size;
+    end = (end < num_local) ? end : num_local;
+
+    for (t = p4est->first_local_tree; t <= p4est->last_local_tree; t++) {
+      tree = p4est_tree_array_index (p4est->trees, t);
+      offset = tree->quadrants_offset;
+      quadrants = &(tree->quadrants);
+      n_quads = (p4est_locidx_t) quadrants->elem_count;
+      if (offset + n_quads <= begin) {
         continue;
       }
-      p4est_iter_init_face (&face_args, p4est, ghost_layer, loop_args, t, f);
-      p4est_face_iterate (&face_args, user_data, iter_face,
+      if (offset >= end) {
+        break;
+      }
+      lo = (begin > offset) ? begin - offset : 0;
+      hi = (end - offset < n_quads) ? end - offset : n_quads;
+      info.treeid = t;
+      for (si = lo; si < hi; si++) {
+        info.quad = p4est_quadrant_array_index (quadrants, (size_t) si);
+        info.quadid = si;
+        th->iter_volume (&info, th->user_data);
+      }
+    }
+  }
+
+  return NULL;
+}
+
+/* sort helper: order the trees of one color by descending quadrant count */
+typedef struct p4est_iter_tree_load
+{
+  p4est_locidx_t      count;
+  p4est_topidx_t      tree;
+}
+p4est_iter_tree_load_t;
+
+static int
+p4est_iter_tree_load_compare (const void *a, const void *b)
+{
+  const p4est_iter_tree_load_t *A = (const p4est_iter_tree_load_t *) a;
+  const p4est_iter_tree_load_t *B = (const p4est_iter_tree_load_t *) b;
+
+  return (int) (B->count - A->count);
+}
+
+/* greedily color the tree adjacency graph so that no two trees sharing a
+ * face (or, when the respective callbacks run, an edge or a corner) receive
+ * the same color.  \a color must hold conn->num_trees entries; the number of
+ * colors used is returned */
+static int
+p4est_iterate_color_trees (p4est_connectivity_t * conn, int with_corners,
 #ifdef P4_TO_P8
-                          iter_edge,
+                           int with_edges,
 #endif
-                          iter_corner);
-      p4est_iter_reset_face (&face_args);
-    }
+                           int *color)
+{
+  int                 f, i, k, num_colors;
+  int                *used;
+  size_t              zz;
+  p4est_topidx_t      num_trees = conn->num_trees;
+  p4est_topidx_t      t, nt, c;
+#ifdef P4_TO_P8
+  p4est_topidx_t      e;
+#endif
+
+  used = P4EST_ALLOC (int, num_trees);
+  for (t = 0; t < num_trees; t++) {
+    used[t] = -1;
+  }
 
-    /* if there is an edge or a corner callback, we need to run
-     * edge_iterate on the edges between trees */
+  num_colors = 0;
+  for (t = 0; t < num_trees; t++) {
+    /* mark the colors taken by previously colored neighbors */
+    for (f = 0; f < 2 * P4EST_DIM; f++) {
+      nt = conn->tree_to_tree[t * 2 * P4EST_DIM + f];
+      if (nt < t) {
+        used[color[nt]] = (int) t;
+      }
+    }
 #ifdef P4_TO_P8
-    if (loop_args->loop_edge) {
-      for (e = 0; e < 12; e++, mask <<= 1) {
-        if ((touch & mask) == 0) {
-          continue;
+    if (with_edges && conn->tree_to_edge != NULL) {
+      for (i = 0; i < 12; i++) {
+        e = conn->tree_to_edge[t * 12 + i];
+        if (e >= 0) {
+          for (zz = (size_t) conn->ett_offset[e];
+               zz < (size_t) conn->ett_offset[e + 1]; zz++) {
+            nt = conn->edge_to_tree[zz];
+            if (nt < t) {
+              used[color[nt]] = (int) t;
+            }
+          }
         }
-        p8est_iter_init_edge (&edge_args, p4est, ghost_layer, loop_args, t,
-                              e);
-        p8est_edge_iterate (&edge_args, user_data, iter_edge, iter_corner);
-        p8est_iter_reset_edge (&edge_args);
       }
     }
-    else {
-      mask <<= 12;
-    }
 #endif
-
-    if (loop_args->loop_corner) {
-      for (c = 0; c < P4EST_CHILDREN; c++, mask <<= 1) {
-        if ((touch & mask) == 0) {
-          continue;
+    if (with_corners && conn->tree_to_corner != NULL) {
+      for (i = 0; i < P4EST_CHILDREN; i++) {
+        c = conn->tree_to_corner[t * P4EST_CHILDREN + i];
+        if (c >= 0) {
+          for (zz = (size_t) conn->ctt_offset[c];
+               zz < (size_t) conn->ctt_offset[c + 1]; zz++) {
+            nt = conn->corner_to_tree[zz];
+            if (nt < t) {
+              used[color[nt]] = (int) t;
+            }
+          }
         }
-        p4est_iter_init_corner (&corner_args, p4est, ghost_layer, loop_args,
-                                t, c);
-        p4est_corner_iterate (&corner_args, user_data, iter_corner);
-        p4est_iter_reset_corner (&corner_args);
       }
     }
-
+    /* assign the smallest free color */
+    for (k = 0; used[k] == (int) t; k++) {
+    }
+    color[t] = k;
+    num_colors = (k + 1 > num_colors) ? k + 1 : num_colors;
   }
 
-  if (Ghost_layer == NULL) {
-    P4EST_FREE (empty_ghost_layer.tree_offsets);
-    P4EST_FREE (empty_ghost_layer.proc_offsets);
+  P4EST_FREE (used);
+
+  return num_colors;
+}
+
+#endif /* P4EST_HAVE_PTHREAD_H */
+
+void
+p4est_iterate_threaded (p4est_t * p4est, p4est_ghost_t * Ghost_layer,
+                        void *user_data, p4est_iter_volume_t iter_volume,
+                        p4est_iter_face_t iter_face,
+#ifdef P4_TO_P8
+                        p8est_iter_edge_t iter_edge,
+#endif
+                        p4est_iter_corner_t iter_corner, int num_threads)
+{
+#ifdef P4EST_HAVE_PTHREAD_H
+  int                 i, k, num_colors;
+  int                 retval;
+  int                *color;
+  p4est_topidx_t      t;
+  p4est_ghost_t       empty_ghost_layer;
+  p4est_ghost_t      *ghost_layer;
+  p4est_connectivity_t *conn = p4est->connectivity;
+  size_t              global_num_trees = p4est->trees->elem_count;
+  size_t              num_in_list, zz;
+  p4est_topidx_t      first_local_tree = p4est->first_local_tree;
+  p4est_topidx_t      last_local_tree = p4est->last_local_tree;
+  p4est_topidx_t      last_run_tree;
+  p4est_topidx_t     *tree_list;
+  int32_t            *owned;
+  pthread_t          *threads;
+  p4est_iter_thread_t *th;
+  p4est_iter_work_t   work;
+  p4est_iter_tree_load_t *loads;
+  p4est_tree_t       *tree;
+  p4est_locidx_t      chunk_size;
+
+  P4EST_ASSERT (p4est_is_valid (p4est));
+  P4EST_ASSERT (num_threads >= 0);
+
+  if (num_threads == 0) {
+    /* use the hybrid execution width configured on the forest */
+    num_threads = p4est->num_threads;
+  }
+  if (num_threads <= 1) {
+    p4est_iterate (p4est, Ghost_layer, user_data, iter_volume, iter_face,
+#ifdef P4_TO_P8
+                   iter_edge,
+#endif
+                   iter_corner);
+    return;
   }
 
-  P4EST_FREE (owned);
-  p4est_iter_loop_args_destroy (loop_args);
+  if (p4est->first_local_tree < 0 ||
+      (iter_face == NULL && iter_corner == NULL &&
+#ifdef P4_TO_P8
+       iter_edge == NULL &&
+#endif
+       iter_volume == NULL)) {
+    return;
+  }
+
+  if (Ghost_layer == NULL) {
+    sc_array_init (&(empty_ghost_layer.ghosts), sizeof (p4est_quadrant_t));
+    empty_ghost_layer.tree_offsets = P4EST_ALLOC_ZERO (p4est_locidx_t,
+                                                       global_num_trees + 1);
+    empty_ghost_layer.proc_offsets = P4EST_ALLOC_ZERO (p4est_locidx_t,
+                                                       p4est->mpisize + 1);
+    ghost_layer = &empty_ghost_layer;
+  }
+  else {
+    ghost_layer = Ghost_layer;
+  }
+
+  threads = P4EST_ALLOC (pthread_t, num_threads);
+  th = P4EST_ALLOC (p4est_iter_thread_t, num_threads);
+  for (i = 0; i < num_threads; i++) {
+    th[i].p4est = p4est;
+    th[i].ghost_layer = ghost_layer;
+    th[i].user_data = user_data;
+    th[i].iter_volume = iter_volume;
+    th[i].iter_face = iter_face;
+#ifdef P4_TO_P8
+    th[i].iter_edge = iter_edge;
+#endif
+    th[i].iter_corner = iter_corner;
+    th[i].loop_args = NULL;
+    th[i].owned = NULL;
+    th[i].tree_list = NULL;
+    th[i].list_count = 0;
+    th[i].work = &work;
+    th[i].chunk_size = 0;
+    th[i].thread_num = i;
+    th[i].num_threads = num_threads;
+  }
+  p4est_iter_work_init (&work);
+
+  if (iter_face == NULL && iter_corner == NULL
+#ifdef P4_TO_P8
+      && iter_edge == NULL
+#endif
+    ) {
+    /* with only a volume callback there is no coordination necessary, so
+     * the local quadrant range is cut into chunks that the workers steal
+     * until none are left */
+    chunk_size = p4est->local_num_quadrants / (8 * num_threads);
+    chunk_size = SC_MAX (chunk_size, 64);
+    for (i = 0; i < num_threads; i++) {
+      th[i].chunk_size = chunk_size;
+    }
+    for (i = 0; i < num_threads; i++) {
+      retval = pthread_create (&threads[i], NULL,
+                               p4est_iterate_volume_thread, &th[i]);
+      SC_CHECK_ABORT (retval == 0, "p4est_iterate_threaded: pthread_create");
+    }
+    for (i = 0; i < num_threads; i++) {
+      retval = pthread_join (threads[i], NULL);
+      SC_CHECK_ABORT (retval == 0, "p4est_iterate_threaded: pthread_join");
+    }
+  }
+  else {
+    /* all of the mutable iteration state lives in the loop_args, so each
+     * worker gets its own set.  they are created and destroyed here to keep
+     * the workers free of memory bookkeeping */
+    for (i = 0; i < num_threads; i++) {
+      th[i].loop_args = p4est_iter_loop_args_new (conn,
+#ifdef P4_TO_P8
+                                                  iter_edge,
+#endif
+                                                  iter_corner, ghost_layer,
+                                                  p4est->mpisize);
+    }
+
+    owned = p4est_iter_get_boundaries (p4est, &last_run_tree,
+#ifdef P4_TO_P8
+                                       iter_edge != NULL ||
+                                       iter_corner != NULL,
+#endif
+                                       iter_corner != NULL);
+    last_run_tree = (last_run_tree < last_local_tree) ? last_local_tree :
+      last_run_tree;
+
+    /* trees of equal color share no boundary, so the trees within one color
+     * can run concurrently while the colors are processed in sequence */
+    color = P4EST_ALLOC (int, global_num_trees);
+    num_colors = p4est_iterate_color_trees (conn, iter_corner != NULL,
+#ifdef P4_TO_P8
+                                            iter_edge != NULL ||
+                                            iter_corner != NULL,
+#endif
+                                            color);
+
+    tree_list = P4EST_ALLOC (p4est_topidx_t,
+                             (size_t) (last_run_tree - first_local_tree + 1));
+    loads = P4EST_ALLOC (p4est_iter_tree_load_t,
+                         (size_t) (last_run_tree - first_local_tree + 1));
+    for (k = 0; k < num_colors; k++) {
+      num_in_list = 0;
+      for (t = first_local_tree; t <= last_run_tree; t++) {
+        if (color[t] == k && (t <= last_local_tree || owned[t])) {
+          loads[num_in_list].tree = t;
+          if (t <= last_local_tree) {
+            tree = p4est_tree_array_index (p4est->trees, t);
+            loads[num_in_list].count =
+              (p4est_locidx_t) tree->quadrants.elem_count;
+          }
+          else {
+            loads[num_in_list].count = 0;
+          }
+          num_in_list++;
+        }
+      }
+      if (num_in_list == 0) {
+        continue;
+      }
+      /* longest-processing-time-first: hand out the heavy trees early so
+       * the hot spots do not serialize the end of the sweep */
+      qsort (loads, num_in_list, sizeof (p4est_iter_tree_load_t),
+             p4est_iter_tree_load_compare);
+      for (zz = 0; zz < num_in_list; zz++) {
+        tree_list[zz] = loads[zz].tree;
+      }
+      work.next = 0;
+      for (i = 0; i < num_threads; i++) {
+        th[i].owned = owned;
+        th[i].tree_list = tree_list;
+        th[i].list_count = num_in_list;
+        retval = pthread_create (&threads[i], NULL,
+                                 p4est_iterate_tree_thread, &th[i]);
+        SC_CHECK_ABORT (retval == 0,
+                        "p4est_iterate_threaded: pthread_create");
+      }
+      for (i = 0; i < num_threads; i++) {
+        retval = pthread_join (threads[i], NULL);
+        SC_CHECK_ABORT (retval == 0, "p4est_iterate_threaded: pthread_join");
+      }
+    }
+
+    P4EST_FREE (loads);
+    P4EST_FREE (tree_list);
+    P4EST_FREE (color);
+    P4EST_FREE (owned);
+    for (i = 0; i < num_threads; i++) {
+      p4est_iter_loop_args_destroy (th[i].loop_args);
+    }
+  }
+
+  p4est_iter_work_reset (&work);
+  P4EST_FREE (th);
+  P4EST_FREE (threads);
+
+  if (Ghost_layer == NULL) {
+    P4EST_FREE (empty_ghost_layer.tree_offsets);
+    P4EST_FREE (empty_ghost_layer.proc_offsets);
+  }
+#else
+  /* without POSIX threads fall back to the serial implementation */
+  p4est_iterate (p4est, Ghost_layer, user_data, iter_volume, iter_face,
+#ifdef P4_TO_P8
+                 iter_edge,
+#endif
+                 iter_corner);
+#endif
+}
+
+#ifdef P4EST_HAVE_PTHREAD_H
+
+/* the per-worker state of the first-touch placement below */
+typedef struct p4est_numa_thread
+{
+  p4est_t            *p4est;
+  char              **fresh;    /* per-tree replacement storage */
+  int                 thread_num;
+  int                 num_threads;
+}
+p4est_numa_thread_t;
+
+/* copy this worker's contiguous share of the local quadrants into the
+ * fresh storage.  the copy is the first write to the pages behind the
+ * share, so a first-touch NUMA policy places them on the worker's socket.
+ * the split is static, not stolen: the pages must end up where the
+ * worker that owns the share will look for them */
+static void        *
+p4est_numa_touch_thread (void *v)
+{
+  p4est_numa_thread_t *th = (p4est_numa_thread_t *) v;
+  p4est_t            *p4est = th->p4est;
+  p4est_locidx_t      num_local = p4est->local_num_quadrants;
+  p4est_locidx_t      begin, end, offset;
+  p4est_locidx_t      lo, hi, n_quads;
+  p4est_topidx_t      t;
+  p4est_tree_t       *tree;
+  sc_array_t         *quadrants;
+
+  begin = (p4est_locidx_t)
+    (((int64_t) num_local * th->thread_num) / th->num_threads);
+  end = (p4est_locidx_t)
+    (((int64_t) num_local * (th->thread_num + 1)) / th->num_threads);
+
+  for (t = p4est->first_local_tree; t <= p4est->last_local_tree; t++) {
+    tree = p4est_tree_array_index (p4est->trees, t);
+    offset = tree->quadrants_offset;
+    quadrants = &(tree->quadrants);
+    n_quads = (p4est_locidx_t) quadrants->elem_count;
+    if (offset + n_quads <= begin) {
+      continue;
+    }
+    if (offset >= end) {
+      break;
+    }
+    lo = (begin > offset) ? begin - offset : 0;
+    hi = (end - offset < n_quads) ? end - offset : n_quads;
+    memcpy (th->fresh[t - p4est->first_local_tree] +
+            (size_t) lo * sizeof (p4est_quadrant_t),
+            sc_array_index (quadrants, (size_t) lo),
+            ((size_t) (hi - lo)) * sizeof (p4est_quadrant_t));
+  }
+
+  return NULL;
+}
+
+#endif /* P4EST_HAVE_PTHREAD_H */
+
+void
+p4est_numa_first_touch (p4est_t * p4est, int num_threads)
+{
+#ifdef P4EST_HAVE_PTHREAD_H
+  int                 i, retval;
+  size_t              nt, ntrees;
+  char              **fresh;
+  pthread_t          *threads;
+  p4est_numa_thread_t *th;
+  p4est_tree_t       *tree;
+  sc_array_t         *quadrants;
+
+  P4EST_ASSERT (p4est_is_valid (p4est));
+  P4EST_ASSERT (num_threads >= 0);
+
+  if (num_threads == 0) {
+    /* use the hybrid execution width configured on the forest */
+    num_threads = p4est->num_threads;
+  }
+  if (num_threads <= 1 || p4est->first_local_tree < 0) {
+    return;
+  }
+  ntrees = (size_t) (p4est->last_local_tree - p4est->first_local_tree + 1);
+
+  /* allocate the replacement storage but do not write to it: the pages
+   * must remain untouched until the workers copy into them below */
+  fresh = P4EST_ALLOC (char *, ntrees);
+  for (nt = 0; nt < ntrees; nt++) {
+    tree = p4est_tree_array_index (p4est->trees,
+                                   p4est->first_local_tree +
+                                   (p4est_topidx_t) nt);
+    /* allocate in sc's pool so the array's own teardown stays balanced */
+    fresh[nt] = SC_ALLOC (char, (size_t) tree->quadrants.byte_alloc);
+  }
+
+  threads = P4EST_ALLOC (pthread_t, num_threads);
+  th = P4EST_ALLOC (p4est_numa_thread_t, num_threads);
+  for (i = 0; i < num_threads; i++) {
+    th[i].p4est = p4est;
+    th[i].fresh = fresh;
+    th[i].thread_num = i;
+    th[i].num_threads = num_threads;
+    retval = pthread_create (&threads[i], NULL,
+                             p4est_numa_touch_thread, &th[i]);
+    SC_CHECK_ABORT (retval == 0, "p4est_numa_first_touch: pthread_create");
+  }
+  for (i = 0; i < num_threads; i++) {
+    retval = pthread_join (threads[i], NULL);
+    SC_CHECK_ABORT (retval == 0, "p4est_numa_first_touch: pthread_join");
+  }
+
+  /* install the placed storage; capacity and count are unchanged, only
+   * the backing pages move */
+  for (nt = 0; nt < ntrees; nt++) {
+    tree = p4est_tree_array_index (p4est->trees,
+                                   p4est->first_local_tree +
+                                   (p4est_topidx_t) nt);
+    quadrants = &(tree->quadrants);
+    P4EST_ASSERT (SC_ARRAY_IS_OWNER (quadrants));
+    SC_FREE (quadrants->array);
+    quadrants->array = fresh[nt];
+  }
+
+  P4EST_FREE (th);
+  P4EST_FREE (threads);
+  P4EST_FREE (fresh);
+#endif
+}
+
+/* the state shared by the batching adapter callbacks below */
+typedef struct p4est_iter_batch_data
+{
+  void               *user_data;
+  p4est_iter_volume_batch_t iter_volume;
+  p4est_iter_face_batch_t iter_face;
+  p4est_iter_volume_batch_info_t *volume_batch;
+  p4est_iter_face_batch_info_t *face_batch;
+}
+p4est_iter_batch_data_t;
+
+/* append one quadrant to the volume batch and flush a full batch */
+static void
+p4est_iter_batch_volume (p4est_iter_volume_info_t * info, void *user_data)
+{
+  p4est_iter_batch_data_t *d = (p4est_iter_batch_data_t *) user_data;
+  p4est_iter_volume_batch_info_t *b = d->volume_batch;
+  size_t              j = b->count;
+
+  b->treeid[j] = info->treeid;
+  b->quadid[j] = info->quadid;
+  if (++b->count == P4EST_ITER_BATCH_SIZE) {
+    d->iter_volume (b, d->user_data);
+    b->count = 0;
+  }
+}
+
+/* scatter one face into the structure-of-arrays batch and flush a full
+ * batch.  absent sides and halves are filled with -1 */
+static void
+p4est_iter_batch_face (p4est_iter_face_info_t * info, void *user_data)
+{
+  p4est_iter_batch_data_t *d = (p4est_iter_batch_data_t *) user_data;
+  p4est_iter_face_batch_info_t *b = d->face_batch;
+  size_t              j = b->count;
+  int                 limit = (int) info->sides.elem_count;
+  int                 s, h;
+  p4est_iter_face_side_t *side;
+
+  b->orientation[j] = info->orientation;
+  b->tree_boundary[j] = info->tree_boundary;
+  b->num_sides[j] = (int8_t) limit;
+  for (s = 0; s < 2; s++) {
+    if (s < limit) {
+      side = p4est_iter_fside_array_index_int (&info->sides, s);
+      b->treeid[s][j] = side->treeid;
+      b->face[s][j] = side->face;
+      b->is_hanging[s][j] = side->is_hanging;
+      if (side->is_hanging) {
+        for (h = 0; h < P4EST_HALF; h++) {
+          b->quadid[s][h][j] = side->is.hanging.quadid[h];
+          b->is_ghost[s][h][j] = side->is.hanging.is_ghost[h];
+        }
+      }
+      else {
+        b->quadid[s][0][j] = side->is.full.quadid;
+        b->is_ghost[s][0][j] = side->is.full.is_ghost;
+        for (h = 1; h < P4EST_HALF; h++) {
+          b->quadid[s][h][j] = -1;
+          b->is_ghost[s][h][j] = -1;
+        }
+      }
+    }
+    else {
+      b->treeid[s][j] = -1;
+      b->face[s][j] = -1;
+      b->is_hanging[s][j] = -1;
+      for (h = 0; h < P4EST_HALF; h++) {
+        b->quadid[s][h][j] = -1;
+        b->is_ghost[s][h][j] = -1;
+      }
+    }
+  }
+  if (++b->count == P4EST_ITER_BATCH_SIZE) {
+    d->iter_face (b, d->user_data);
+    b->count = 0;
+  }
+}
+
+void
+p4est_iterate_batched (p4est_t * p4est, p4est_ghost_t * ghost_layer,
+                       void *user_data,
+                       p4est_iter_volume_batch_t iter_volume,
+                       p4est_iter_face_batch_t iter_face)
+{
+  p4est_iter_batch_data_t d;
+
+  d.user_data = user_data;
+  d.iter_volume = iter_volume;
+  d.iter_face = iter_face;
+  d.volume_batch = NULL;
+  d.face_batch = NULL;
+  if (iter_volume != NULL) {
+    d.volume_batch = P4EST_ALLOC (p4est_iter_volume_batch_info_t, 1);
+    d.volume_batch->p4est = p4est;
+    d.volume_batch->ghost_layer = ghost_layer;
+    d.volume_batch->count = 0;
+  }
+  if (iter_face != NULL) {
+    d.face_batch = P4EST_ALLOC (p4est_iter_face_batch_info_t, 1);
+    d.face_batch->p4est = p4est;
+    d.face_batch->ghost_layer = ghost_layer;
+    d.face_batch->count = 0;
+  }
+
+  p4est_iterate (p4est, ghost_layer, &d,
+                 iter_volume != NULL ? p4est_iter_batch_volume : NULL,
+                 iter_face != NULL ? p4est_iter_batch_face : NULL,
+#ifdef P4_TO_P8
+                 NULL,
+#endif
+                 NULL);
+
+  /* deliver the final partial batches */
+  if (d.volume_batch != NULL) {
+    if (d.volume_batch->count > 0) {
+      iter_volume (d.volume_batch, user_data);
+    }
+    P4EST_FREE (d.volume_batch);
+  }
+  if (d.face_batch != NULL) {
+    if (d.face_batch->count > 0) {
+      iter_face (d.face_batch, user_data);
+    }
+    P4EST_FREE (d.face_batch);
+  }
+}
+
+/* the state shared by the ghost data resolving adapter callbacks below */
+typedef struct p4est_iter_gdata
+{
+  char               *ghost_data;
+  size_t              ghost_stride;
+  void               *user_data;
+  p4est_iter_volume_t iter_volume;
+  p4est_iter_face_t   iter_face;
+#ifdef P4_TO_P8
+  p8est_iter_edge_t   iter_edge;
+#endif
+  p4est_iter_corner_t iter_corner;
+}
+p4est_iter_gdata_t;
+
+/* compute the data pointer for one quadrant of a side struct */
+static void        *
+p4est_iter_gdata_resolve (p4est_iter_gdata_t * d, int8_t is_ghost,
+                          p4est_quadrant_t * quad, p4est_locidx_t quadid)
+{
+  if (!is_ghost) {
+    P4EST_ASSERT (quad != NULL);
+    return quad->p.user_data;
+  }
+  if (quadid == -1) {
+    /* the quadrant is missing from the ghost layer */
+    return NULL;
+  }
+  return d->ghost_data + d->ghost_stride * (size_t) quadid;
+}
+
+static void
+p4est_iter_gdata_volume (p4est_iter_volume_info_t * info, void *user_data)
+{
+  p4est_iter_gdata_t *d = (p4est_iter_gdata_t *) user_data;
+
+  d->iter_volume (info, d->user_data);
+}
+
+static void
+p4est_iter_gdata_face (p4est_iter_face_info_t * info, void *user_data)
+{
+  p4est_iter_gdata_t *d = (p4est_iter_gdata_t *) user_data;
+  size_t              zz;
+  int                 h;
+  p4est_iter_face_side_t *side;
+
+  for (zz = 0; zz < info->sides.elem_count; ++zz) {
+    side = p4est_iter_fside_array_index (&info->sides, zz);
+    if (side->is_hanging) {
+      for (h = 0; h < P4EST_HALF; ++h) {
+        side->is.hanging.data[h] =
+          p4est_iter_gdata_resolve (d, side->is.hanging.is_ghost[h],
+                                    side->is.hanging.quad[h],
+                                    side->is.hanging.quadid[h]);
+      }
+    }
+    else {
+      side->is.full.data =
+        p4est_iter_gdata_resolve (d, side->is.full.is_ghost,
+                                  side->is.full.quad, side->is.full.quadid);
+    }
+  }
+  d->iter_face (info, d->user_data);
+}
+
+#ifdef P4_TO_P8
+
+static void
+p8est_iter_gdata_edge (p8est_iter_edge_info_t * info, void *user_data)
+{
+  p4est_iter_gdata_t *d = (p4est_iter_gdata_t *) user_data;
+  size_t              zz;
+  int                 h;
+  p8est_iter_edge_side_t *side;
+
+  for (zz = 0; zz < info->sides.elem_count; ++zz) {
+    side = p8est_iter_eside_array_index (&info->sides, zz);
+    if (side->is_hanging) {
+      for (h = 0; h < 2; ++h) {
+        side->is.hanging.data[h] =
+          p4est_iter_gdata_resolve (d, side->is.hanging.is_ghost[h],
+                                    side->is.hanging.quad[h],
+                                    side->is.hanging.quadid[h]);
+      }
+    }
+    else {
+      side->is.full.data =
+        p4est_iter_gdata_resolve (d, side->is.full.is_ghost,
+                                  side->is.full.quad, side->is.full.quadid);
+    }
+  }
+  d->iter_edge (info, d->user_data);
+}
+
+#endif /* P4_TO_P8 */
+
+static void
+p4est_iter_gdata_corner (p4est_iter_corner_info_t * info, void *user_data)
+{
+  p4est_iter_gdata_t *d = (p4est_iter_gdata_t *) user_data;
+  size_t              zz;
+  p4est_iter_corner_side_t *side;
+
+  for (zz = 0; zz < info->sides.elem_count; ++zz) {
+    side = p4est_iter_cside_array_index (&info->sides, zz);
+    side->data = p4est_iter_gdata_resolve (d, side->is_ghost,
+                                           side->quad, side->quadid);
+  }
+  d->iter_corner (info, d->user_data);
+}
+
+void
+p4est_iterate_ghost_data (p4est_t * p4est, p4est_ghost_t * ghost_layer,
+                          void *ghost_data, size_t ghost_stride,
+                          void *user_data,
+                          p4est_iter_volume_t iter_volume,
+                          p4est_iter_face_t iter_face,
+#ifdef P4_TO_P8
+                          p8est_iter_edge_t iter_edge,
+#endif
+                          p4est_iter_corner_t iter_corner)
+{
+  p4est_iter_gdata_t  d;
+
+  d.ghost_data = (char *) ghost_data;
+  d.ghost_stride = ghost_stride;
+  d.user_data = user_data;
+  d.iter_volume = iter_volume;
+  d.iter_face = iter_face;
+#ifdef P4_TO_P8
+  d.iter_edge = iter_edge;
+#endif
+  d.iter_corner = iter_corner;
+
+  p4est_iterate (p4est, ghost_layer, &d,
+                 iter_volume != NULL ? p4est_iter_gdata_volume : NULL,
+                 iter_face != NULL ? p4est_iter_gdata_face : NULL,
+#ifdef P4_TO_P8
+                 iter_edge != NULL ? p8est_iter_gdata_edge : NULL,
+#endif
+                 iter_corner != NULL ? p4est_iter_gdata_corner : NULL);
+}
+
+/* the record types that make up an iteration plan script */
+#define P4EST_ITER_PLAN_VOLUME  0
+#define P4EST_ITER_PLAN_FACE    1
+#ifdef P4_TO_P8
+#define P4EST_ITER_PLAN_EDGE    2
+#endif
+#define P4EST_ITER_PLAN_CORNER  3
+
+/* one recorded face, edge, or corner callback: the sides are stored
+ * contiguously in the per-type side pool of the plan */
+typedef struct p4est_iter_plan_entry
+{
+  int8_t              orientation;      /* faces only */
+  int8_t              tree_boundary;
+  size_t              first_side;
+  size_t              num_sides;
+}
+p4est_iter_plan_entry_t;
+
+struct p4est_iter_plan
+{
+  p4est_t            *p4est;
+  p4est_ghost_t      *ghost_layer;
+  long                revision; /* forest revision at recording, -1 if none */
+  int8_t              have_volume, have_face;
+#ifdef P4_TO_P8
+  int8_t              have_edge;
+#endif
+  int8_t              have_corner;
+  sc_array_t         *script;   /* int8_t record types in traversal order */
+  sc_array_t         *volumes;  /* p4est_iter_volume_info_t */
+  sc_array_t         *faces;    /* p4est_iter_plan_entry_t */
+  sc_array_t         *face_sides;       /* p4est_iter_face_side_t */
+#ifdef P4_TO_P8
+  sc_array_t         *edges;    /* p4est_iter_plan_entry_t */
+  sc_array_t         *edge_sides;       /* p8est_iter_edge_side_t */
+#endif
+  sc_array_t         *corners;  /* p4est_iter_plan_entry_t */
+  sc_array_t         *corner_sides;     /* p4est_iter_corner_side_t */
+};
+
+/* the state shared by the recording adapter callbacks below */
+typedef struct p4est_iter_plan_record
+{
+  p4est_iter_plan_t  *plan;
+  void               *user_data;
+  p4est_iter_volume_t iter_volume;
+  p4est_iter_face_t   iter_face;
+#ifdef P4_TO_P8
+  p8est_iter_edge_t   iter_edge;
+#endif
+  p4est_iter_corner_t iter_corner;
+}
+p4est_iter_plan_record_t;
+
+static void
+p4est_iter_plan_push (sc_array_t * script, int type)
+{
+  *(int8_t *) sc_array_push (script) = (int8_t) type;
+}
+
+static void
+p4est_iter_plan_record_volume (p4est_iter_volume_info_t * info,
+                               void *user_data)
+{
+  p4est_iter_plan_record_t *r = (p4est_iter_plan_record_t *) user_data;
+  p4est_iter_plan_t  *plan = r->plan;
+
+  p4est_iter_plan_push (plan->script, P4EST_ITER_PLAN_VOLUME);
+  *(p4est_iter_volume_info_t *) sc_array_push (plan->volumes) = *info;
+  if (r->iter_volume != NULL) {
+    r->iter_volume (info, r->user_data);
+  }
+}
+
+static void
+p4est_iter_plan_record_face (p4est_iter_face_info_t * info, void *user_data)
+{
+  p4est_iter_plan_record_t *r = (p4est_iter_plan_record_t *) user_data;
+  p4est_iter_plan_t  *plan = r->plan;
+  p4est_iter_plan_entry_t *entry;
+  size_t              zz;
+
+  p4est_iter_plan_push (plan->script, P4EST_ITER_PLAN_FACE);
+  entry = (p4est_iter_plan_entry_t *) sc_array_push (plan->faces);
+  entry->orientation = info->orientation;
+  entry->tree_boundary = info->tree_boundary;
+  entry->first_side = plan->face_sides->elem_count;
+  entry->num_sides = info->sides.elem_count;
+  for (zz = 0; zz < info->sides.elem_count; zz++) {
+    *(p4est_iter_face_side_t *) sc_array_push (plan->face_sides) =
+      *p4est_iter_fside_array_index (&info->sides, zz);
+  }
+  if (r->iter_face != NULL) {
+    r->iter_face (info, r->user_data);
+  }
+}
+
+#ifdef P4_TO_P8
+static void
+p8est_iter_plan_record_edge (p8est_iter_edge_info_t * info, void *user_data)
+{
+  p4est_iter_plan_record_t *r = (p4est_iter_plan_record_t *) user_data;
+  p4est_iter_plan_t  *plan = r->plan;
+  p4est_iter_plan_entry_t *entry;
+  size_t              zz;
+
+  p4est_iter_plan_push (plan->script, P4EST_ITER_PLAN_EDGE);
+  entry = (p4est_iter_plan_entry_t *) sc_array_push (plan->edges);
+  entry->orientation = 0;
+  entry->tree_boundary = info->tree_boundary;
+  entry->first_side = plan->edge_sides->elem_count;
+  entry->num_sides = info->sides.elem_count;
+  for (zz = 0; zz < info->sides.elem_count; zz++) {
+    *(p8est_iter_edge_side_t *) sc_array_push (plan->edge_sides) =
+      *p8est_iter_eside_array_index (&info->sides, zz);
+  }
+  if (r->iter_edge != NULL) {
+    r->iter_edge (info, r->user_data);
+  }
+}
+#endif
+
+static void
+p4est_iter_plan_record_corner (p4est_iter_corner_info_t * info,
+                               void *user_data)
+{
+  p4est_iter_plan_record_t *r = (p4est_iter_plan_record_t *) user_data;
+  p4est_iter_plan_t  *plan = r->plan;
+  p4est_iter_plan_entry_t *entry;
+  size_t              zz;
+
+  p4est_iter_plan_push (plan->script, P4EST_ITER_PLAN_CORNER);
+  entry = (p4est_iter_plan_entry_t *) sc_array_push (plan->corners);
+  entry->orientation = 0;
+  entry->tree_boundary = info->tree_boundary;
+  entry->first_side = plan->corner_sides->elem_count;
+  entry->num_sides = info->sides.elem_count;
+  for (zz = 0; zz < info->sides.elem_count; zz++) {
+    *(p4est_iter_corner_side_t *) sc_array_push (plan->corner_sides) =
+      *p4est_iter_cside_array_index (&info->sides, zz);
+  }
+  if (r->iter_corner != NULL) {
+    r->iter_corner (info, r->user_data);
+  }
+}
+
+/* walk the recorded script and deliver the callbacks in the original
+ * traversal order, reconstructing the info structures from the flat
+ * record arrays */
+static void
+p4est_iter_plan_replay (p4est_iter_plan_t * plan, void *user_data,
+                        p4est_iter_volume_t iter_volume,
+                        p4est_iter_face_t iter_face,
+#ifdef P4_TO_P8
+                        p8est_iter_edge_t iter_edge,
+#endif
+                        p4est_iter_corner_t iter_corner)
+{
+  size_t              zz;
+  size_t              zv = 0, zf = 0, zc = 0;
+#ifdef P4_TO_P8
+  size_t              ze = 0;
+  p8est_iter_edge_info_t einfo;
+#endif
+  p4est_iter_volume_info_t *vinfo;
+  p4est_iter_face_info_t finfo;
+  p4est_iter_corner_info_t cinfo;
+  p4est_iter_plan_entry_t *entry;
+
+  finfo.p4est = plan->p4est;
+  finfo.ghost_layer = plan->ghost_layer;
+#ifdef P4_TO_P8
+  einfo.p4est = plan->p4est;
+  einfo.ghost_layer = plan->ghost_layer;
+#endif
+  cinfo.p4est = plan->p4est;
+  cinfo.ghost_layer = plan->ghost_layer;
+
+  for (zz = 0; zz < plan->script->elem_count; zz++) {
+    switch (*(int8_t *) sc_array_index (plan->script, zz)) {
+    case P4EST_ITER_PLAN_VOLUME:
+      vinfo = (p4est_iter_volume_info_t *) sc_array_index (plan->volumes,
+                                                           zv++);
+      if (iter_volume != NULL) {
+        iter_volume (vinfo, user_data);
+      }
+      break;
+    case P4EST_ITER_PLAN_FACE:
+      entry = (p4est_iter_plan_entry_t *) sc_array_index (plan->faces, zf++);
+      if (iter_face != NULL) {
+        finfo.orientation = entry->orientation;
+        finfo.tree_boundary = entry->tree_boundary;
+        sc_array_init_view (&finfo.sides, plan->face_sides,
+                            entry->first_side, entry->num_sides);
+        iter_face (&finfo, user_data);
+      }
+      break;
+#ifdef P4_TO_P8
+    case P4EST_ITER_PLAN_EDGE:
+      entry = (p4est_iter_plan_entry_t *) sc_array_index (plan->edges, ze++);
+      if (iter_edge != NULL) {
+        einfo.tree_boundary = entry->tree_boundary;
+        sc_array_init_view (&einfo.sides, plan->edge_sides,
+                            entry->first_side, entry->num_sides);
+        iter_edge (&einfo, user_data);
+      }
+      break;
+#endif
+    case P4EST_ITER_PLAN_CORNER:
+      entry = (p4est_iter_plan_entry_t *) sc_array_index (plan->corners,
+                                                          zc++);
+      if (iter_corner != NULL) {
+        cinfo.tree_boundary = entry->tree_boundary;
+        sc_array_init_view (&cinfo.sides, plan->corner_sides,
+                            entry->first_side, entry->num_sides);
+        iter_corner (&cinfo, user_data);
+      }
+      break;
+    default:
+      SC_ABORT_NOT_REACHED ();
+    }
+  }
+}
+
+p4est_iter_plan_t  *
+p4est_iter_plan_new (p4est_t * p4est, p4est_ghost_t * ghost_layer)
+{
+  p4est_iter_plan_t  *plan;
+
+  plan = P4EST_ALLOC (p4est_iter_plan_t, 1);
+  plan->p4est = p4est;
+  plan->ghost_layer = ghost_layer;
+  plan->revision = -1;
+  plan->have_volume = plan->have_face = 0;
+#ifdef P4_TO_P8
+  plan->have_edge = 0;
+#endif
+  plan->have_corner = 0;
+  plan->script = sc_array_new (sizeof (int8_t));
+  plan->volumes = sc_array_new (sizeof (p4est_iter_volume_info_t));
+  plan->faces = sc_array_new (sizeof (p4est_iter_plan_entry_t));
+  plan->face_sides = sc_array_new (sizeof (p4est_iter_face_side_t));
+#ifdef P4_TO_P8
+  plan->edges = sc_array_new (sizeof (p4est_iter_plan_entry_t));
+  plan->edge_sides = sc_array_new (sizeof (p8est_iter_edge_side_t));
+#endif
+  plan->corners = sc_array_new (sizeof (p4est_iter_plan_entry_t));
+  plan->corner_sides = sc_array_new (sizeof (p4est_iter_corner_side_t));
+
+  return plan;
+}
+
+void
+p4est_iterate_plan (p4est_iter_plan_t * plan, void *user_data,
+                    p4est_iter_volume_t iter_volume,
+                    p4est_iter_face_t iter_face,
+#ifdef P4_TO_P8
+                    p8est_iter_edge_t iter_edge,
+#endif
+                    p4est_iter_corner_t iter_corner)
+{
+  p4est_iter_plan_record_t r;
+
+  if (plan->revision == plan->p4est->revision &&
+      plan->have_volume == (int8_t) (iter_volume != NULL) &&
+      plan->have_face == (int8_t) (iter_face != NULL) &&
+#ifdef P4_TO_P8
+      plan->have_edge == (int8_t) (iter_edge != NULL) &&
+#endif
+      plan->have_corner == (int8_t) (iter_corner != NULL)) {
+    p4est_iter_plan_replay (plan, user_data, iter_volume, iter_face,
+#ifdef P4_TO_P8
+                            iter_edge,
+#endif
+                            iter_corner);
+    return;
+  }
+
+  /* the forest or the set of callbacks has changed: discard the previous
+   * plan and record anew, delivering the callbacks along the way */
+  sc_array_resize (plan->script, 0);
+  sc_array_resize (plan->volumes, 0);
+  sc_array_resize (plan->faces, 0);
+  sc_array_resize (plan->face_sides, 0);
+#ifdef P4_TO_P8
+  sc_array_resize (plan->edges, 0);
+  sc_array_resize (plan->edge_sides, 0);
+#endif
+  sc_array_resize (plan->corners, 0);
+  sc_array_resize (plan->corner_sides, 0);
+  plan->revision = plan->p4est->revision;
+  plan->have_volume = (int8_t) (iter_volume != NULL);
+  plan->have_face = (int8_t) (iter_face != NULL);
+#ifdef P4_TO_P8
+  plan->have_edge = (int8_t) (iter_edge != NULL);
+#endif
+  plan->have_corner = (int8_t) (iter_corner != NULL);
+
+  r.plan = plan;
+  r.user_data = user_data;
+  r.iter_volume = iter_volume;
+  r.iter_face = iter_face;
+#ifdef P4_TO_P8
+  r.iter_edge = iter_edge;
+#endif
+  r.iter_corner = iter_corner;
+
+  p4est_iterate (plan->p4est, plan->ghost_layer, &r,
+                 iter_volume != NULL ? p4est_iter_plan_record_volume : NULL,
+                 iter_face != NULL ? p4est_iter_plan_record_face : NULL,
+#ifdef P4_TO_P8
+                 iter_edge != NULL ? p8est_iter_plan_record_edge : NULL,
+#endif
+                 iter_corner != NULL ? p4est_iter_plan_record_corner : NULL);
+}
+
+sc_array_t         *
+p4est_iter_plan_color_faces (p4est_iter_plan_t * plan, int *num_colors)
+{
+  int                 k, nq;
+  int                 color, ncolors;
+  uint64_t            used;
+  uint64_t           *masks;
+  size_t              zz, zs, zh;
+  p4est_t            *p4est = plan->p4est;
+  p4est_tree_t       *tree;
+  p4est_locidx_t      lq[2 * P4EST_HALF];
+  p4est_iter_plan_entry_t *entry;
+  p4est_iter_face_side_t *side;
+  sc_array_t         *colors;
+
+  P4EST_ASSERT (plan->have_face);
+  P4EST_ASSERT (plan->revision == p4est->revision);
+
+  /* one bit per color already assigned to a face of this quadrant: a
+   * face touches at most 2 * P4EST_HALF local quadrants and a quadrant
+   * takes part in at most P4EST_FACES face callbacks, so the greedy
+   * choice below stays far below 64 colors */
+  masks = P4EST_ALLOC_ZERO (uint64_t, p4est->local_num_quadrants);
+  colors = sc_array_new_size (sizeof (int), plan->faces->elem_count);
+  ncolors = 0;
+  for (zz = 0; zz < plan->faces->elem_count; zz++) {
+    entry = (p4est_iter_plan_entry_t *) sc_array_index (plan->faces, zz);
+
+    /* collect the process-local quadrants this face callback may write;
+     * ghost quadrants are read-only on this process and do not conflict */
+    nq = 0;
+    for (zs = 0; zs < entry->num_sides; zs++) {
+      side = (p4est_iter_face_side_t *)
+        sc_array_index (plan->face_sides, entry->first_side + zs);
+      tree = p4est_tree_array_index (p4est->trees, side->treeid);
+      if (!side->is_hanging) {
+        if (!side->is.full.is_ghost) {
+          lq[nq++] = tree->quadrants_offset + side->is.full.quadid;
+        }
+      }
+      else {
+        for (zh = 0; zh < P4EST_HALF; zh++) {
+          if (!side->is.hanging.is_ghost[zh]) {
+            lq[nq++] = tree->quadrants_offset + side->is.hanging.quadid[zh];
+          }
+        }
+      }
+    }
+
+    /* assign the smallest color free on every quadrant of this face */
+    used = 0;
+    for (k = 0; k < nq; k++) {
+      P4EST_ASSERT (0 <= lq[k] && lq[k] < p4est->local_num_quadrants);
+      used |= masks[lq[k]];
+    }
+    color = 0;
+    while (used & ((uint64_t) 1 << color)) {
+      ++color;
+    }
+    P4EST_ASSERT (color < 64);
+    for (k = 0; k < nq; k++) {
+      masks[lq[k]] |= (uint64_t) 1 << color;
+    }
+    *(int *) sc_array_index (colors, zz) = color;
+    ncolors = SC_MAX (ncolors, color + 1);
+  }
+  P4EST_FREE (masks);
+
+  if (num_colors != NULL) {
+    *num_colors = ncolors;
+  }
+  return colors;
+}
+
+void
+p4est_iter_plan_destroy (p4est_iter_plan_t * plan)
+{
+  sc_array_destroy (plan->script);
+  sc_array_destroy (plan->volumes);
+  sc_array_destroy (plan->faces);
+  sc_array_destroy (plan->face_sides);
+#ifdef P4_TO_P8
+  sc_array_destroy (plan->edges);
+  sc_array_destroy (plan->edge_sides);
+#endif
+  sc_array_destroy (plan->corners);
+  sc_array_destroy (plan->corner_sides);
+  P4EST_FREE (plan);
+}
+
+/* the corner matching is the most branch-heavy part of the traversal and
+ * its outcome depends only on the mesh topology: the corner cache records
+ * the resolved participant sets once per forest revision so that repeated
+ * iterate calls between adaptations replay them instead of searching */
+struct p4est_iter_corner_cache
+{
+  p4est_t            *p4est;
+  p4est_ghost_t      *ghost_layer;
+  long                revision; /* forest revision at recording, -1 if none */
+  sc_array_t         *corners;  /* p4est_iter_plan_entry_t */
+  sc_array_t         *corner_sides;     /* p4est_iter_corner_side_t */
+};
+
+/* the state shared by the recording adapter callbacks below */
+typedef struct p4est_iter_ccache_record
+{
+  p4est_iter_corner_cache_t *cache;
+  void               *user_data;
+  p4est_iter_volume_t iter_volume;
+  p4est_iter_face_t   iter_face;
+#ifdef P4_TO_P8
+  p8est_iter_edge_t   iter_edge;
+#endif
+  p4est_iter_corner_t iter_corner;
+}
+p4est_iter_ccache_record_t;
+
+static void
+p4est_iter_ccache_volume (p4est_iter_volume_info_t * info, void *user_data)
+{
+  p4est_iter_ccache_record_t *r = (p4est_iter_ccache_record_t *) user_data;
+
+  r->iter_volume (info, r->user_data);
+}
+
+static void
+p4est_iter_ccache_face (p4est_iter_face_info_t * info, void *user_data)
+{
+  p4est_iter_ccache_record_t *r = (p4est_iter_ccache_record_t *) user_data;
+
+  r->iter_face (info, r->user_data);
+}
+
+#ifdef P4_TO_P8
+static void
+p8est_iter_ccache_edge (p8est_iter_edge_info_t * info, void *user_data)
+{
+  p4est_iter_ccache_record_t *r = (p4est_iter_ccache_record_t *) user_data;
+
+  r->iter_edge (info, r->user_data);
+}
+#endif
+
+static void
+p4est_iter_ccache_corner (p4est_iter_corner_info_t * info, void *user_data)
+{
+  p4est_iter_ccache_record_t *r = (p4est_iter_ccache_record_t *) user_data;
+  p4est_iter_corner_cache_t *cache = r->cache;
+  p4est_iter_plan_entry_t *entry;
+  size_t              zz;
+
+  entry = (p4est_iter_plan_entry_t *) sc_array_push (cache->corners);
+  entry->orientation = 0;
+  entry->tree_boundary = info->tree_boundary;
+  entry->first_side = cache->corner_sides->elem_count;
+  entry->num_sides = info->sides.elem_count;
+  for (zz = 0; zz < info->sides.elem_count; zz++) {
+    *(p4est_iter_corner_side_t *) sc_array_push (cache->corner_sides) =
+      *p4est_iter_cside_array_index (&info->sides, zz);
+  }
+  if (r->iter_corner != NULL) {
+    r->iter_corner (info, r->user_data);
+  }
+}
+
+p4est_iter_corner_cache_t *
+p4est_iter_corner_cache_new (p4est_t * p4est, p4est_ghost_t * ghost_layer)
+{
+  p4est_iter_corner_cache_t *cache;
+
+  cache = P4EST_ALLOC (p4est_iter_corner_cache_t, 1);
+  cache->p4est = p4est;
+  cache->ghost_layer = ghost_layer;
+  cache->revision = -1;
+  cache->corners = sc_array_new (sizeof (p4est_iter_plan_entry_t));
+  cache->corner_sides = sc_array_new (sizeof (p4est_iter_corner_side_t));
+
+  return cache;
+}
+
+void
+p4est_iterate_corner_cached (p4est_iter_corner_cache_t * cache,
+                             void *user_data,
+                             p4est_iter_volume_t iter_volume,
+                             p4est_iter_face_t iter_face,
+#ifdef P4_TO_P8
+                             p8est_iter_edge_t iter_edge,
+#endif
+                             p4est_iter_corner_t iter_corner)
+{
+  p4est_iter_ccache_record_t r;
+  p4est_iter_corner_info_t cinfo;
+  p4est_iter_plan_entry_t *entry;
+  size_t              zz;
+
+  if (cache->revision == cache->p4est->revision) {
+    /* run the traversal without the corner search, then deliver the
+     * cached corner callbacks in their recorded order */
+    p4est_iterate (cache->p4est, cache->ghost_layer, user_data,
+                   iter_volume, iter_face,
+#ifdef P4_TO_P8
+                   iter_edge,
+#endif
+                   NULL);
+    if (iter_corner != NULL) {
+      cinfo.p4est = cache->p4est;
+      cinfo.ghost_layer = cache->ghost_layer;
+      for (zz = 0; zz < cache->corners->elem_count; zz++) {
+        entry =
+          (p4est_iter_plan_entry_t *) sc_array_index (cache->corners, zz);
+        cinfo.tree_boundary = entry->tree_boundary;
+        sc_array_init_view (&cinfo.sides, cache->corner_sides,
+                            entry->first_side, entry->num_sides);
+        iter_corner (&cinfo, user_data);
+      }
+    }
+    return;
+  }
+
+  /* the forest has changed: discard the previous corner records and run
+   * the full corner matching once, recording the participant sets while
+   * the callbacks are delivered */
+  sc_array_resize (cache->corners, 0);
+  sc_array_resize (cache->corner_sides, 0);
+  cache->revision = cache->p4est->revision;
+
+  r.cache = cache;
+  r.user_data = user_data;
+  r.iter_volume = iter_volume;
+  r.iter_face = iter_face;
+#ifdef P4_TO_P8
+  r.iter_edge = iter_edge;
+#endif
+  r.iter_corner = iter_corner;
+
+  p4est_iterate (cache->p4est, cache->ghost_layer, &r,
+                 iter_volume != NULL ? p4est_iter_ccache_volume : NULL,
+                 iter_face != NULL ? p4est_iter_ccache_face : NULL,
+#ifdef P4_TO_P8
+                 iter_edge != NULL ? p8est_iter_ccache_edge : NULL,
+#endif
+                 p4est_iter_ccache_corner);
+}
+
+void
+p4est_iter_corner_cache_destroy (p4est_iter_corner_cache_t * cache)
+{
+  sc_array_destroy (cache->corners);
+  sc_array_destroy (cache->corner_sides);
+  P4EST_FREE (cache);
+}
+
+/* the level view buckets the local quadrants of every tree by level with
+ * a counting sort over quadrants_per_level, keeping the space filling
+ * curve order within each bucket */
+struct p4est_iter_level
+{
+  long                revision; /* matches p4est->revision when current */
+  p4est_topidx_t      first_local_tree, last_local_tree;
+  p4est_locidx_t     *offsets;  /* P4EST_QMAXLEVEL + 2 entries per tree */
+  p4est_locidx_t     *indices;  /* quadrant index within its tree */
+};
+
+static void
+p4est_iter_level_build (p4est_t * p4est, p4est_iter_level_t * lview)
+{
+  const int           nlev = P4EST_QMAXLEVEL + 1;
+  p4est_topidx_t      tt, ntrees;
+  p4est_tree_t       *tree;
+  p4est_locidx_t     *off;
+  p4est_locidx_t      next[P4EST_QMAXLEVEL + 1];
+  p4est_locidx_t      sum;
+  size_t              zz;
+  int                 l;
+
+  P4EST_FREE (lview->offsets);
+  P4EST_FREE (lview->indices);
+  lview->first_local_tree = p4est->first_local_tree;
+  lview->last_local_tree = p4est->last_local_tree;
+  ntrees = SC_MAX (lview->last_local_tree - lview->first_local_tree + 1, 0);
+  lview->offsets = P4EST_ALLOC (p4est_locidx_t,
+                                (size_t) ntrees * (size_t) (nlev + 1));
+  lview->indices = P4EST_ALLOC (p4est_locidx_t,
+                                p4est->local_num_quadrants);
+  for (tt = lview->first_local_tree; tt <= lview->last_local_tree; tt++) {
+    tree = p4est_tree_array_index (p4est->trees, tt);
+    off = lview->offsets +
+      (size_t) (tt - lview->first_local_tree) * (size_t) (nlev + 1);
+    sum = tree->quadrants_offset;
+    for (l = 0; l < nlev; l++) {
+      off[l] = next[l] = sum;
+      sum += tree->quadrants_per_level[l];
+    }
+    off[nlev] = sum;
+    P4EST_ASSERT (sum - tree->quadrants_offset ==
+                  (p4est_locidx_t) tree->quadrants.elem_count);
+    for (zz = 0; zz < tree->quadrants.elem_count; zz++) {
+      l = (int) p4est_quadrant_array_index (&tree->quadrants, zz)->level;
+      P4EST_ASSERT (0 <= l && l < nlev);
+      lview->indices[next[l]++] = (p4est_locidx_t) zz;
+    }
+  }
+  lview->revision = p4est->revision;
+}
+
+p4est_iter_level_t *
+p4est_iter_level_new (p4est_t * p4est)
+{
+  p4est_iter_level_t *lview = P4EST_ALLOC (p4est_iter_level_t, 1);
+
+  lview->offsets = NULL;
+  lview->indices = NULL;
+  p4est_iter_level_build (p4est, lview);
+
+  return lview;
+}
+
+void
+p4est_iter_level_update (p4est_t * p4est, p4est_iter_level_t * lview)
+{
+  if (lview->revision != p4est->revision) {
+    p4est_iter_level_build (p4est, lview);
+  }
+}
+
+void
+p4est_iterate_level (p4est_t * p4est, p4est_iter_level_t * lview,
+                     void *user_data, int level,
+                     p4est_iter_volume_t iter_volume)
+{
+  const int           nlev = P4EST_QMAXLEVEL + 1;
+  p4est_iter_volume_info_t info;
+  p4est_topidx_t      tt;
+  p4est_tree_t       *tree;
+  p4est_locidx_t     *off;
+  p4est_locidx_t      li;
+
+  P4EST_ASSERT (0 <= level && level <= P4EST_QMAXLEVEL);
+  P4EST_ASSERT (lview->revision == p4est->revision);
+  if (iter_volume == NULL) {
+    return;
+  }
+
+  info.p4est = p4est;
+  info.ghost_layer = NULL;
+  for (tt = lview->first_local_tree; tt <= lview->last_local_tree; tt++) {
+    tree = p4est_tree_array_index (p4est->trees, tt);
+    if (tree->quadrants_per_level[level] == 0) {
+      continue;
+    }
+    off = lview->offsets +
+      (size_t) (tt - lview->first_local_tree) * (size_t) (nlev + 1);
+    info.treeid = tt;
+    for (li = off[level]; li < off[level + 1]; li++) {
+      info.quadid = lview->indices[li];
+      info.quad = p4est_quadrant_array_index (&tree->quadrants,
+                                              (size_t) info.quadid);
+      P4EST_ASSERT ((int) info.quad->level == level);
+      iter_volume (&info, user_data);
+    }
+  }
+}
+
+void
+p4est_iter_level_destroy (p4est_iter_level_t * lview)
+{
+  P4EST_FREE (lview->offsets);
+  P4EST_FREE (lview->indices);
+  P4EST_FREE (lview);
+}
+
+void
+p4est_iterate_window (p4est_t * p4est, void *user_data, sc_array_t * roots,
+                      p4est_iter_volume_t iter_volume)
+{
+  p4est_iter_volume_info_t info;
+  p4est_quadrant_t    fd, ld;
+  p4est_quadrant_t   *root, *q;
+  p4est_tree_t       *tree;
+  p4est_topidx_t      nt;
+  ssize_t             lo, hi, anc, is;
+  size_t              zz;
+
+  P4EST_ASSERT (roots->elem_size == sizeof (p4est_quadrant_t));
+  if (iter_volume == NULL) {
+    return;
+  }
+
+  info.p4est = p4est;
+  info.ghost_layer = NULL;
+
+  for (zz = 0; zz < roots->elem_count; zz++) {
+    root = p4est_quadrant_array_index (roots, zz);
+    P4EST_ASSERT (p4est_quadrant_is_valid (root));
+    nt = root->p.which_tree;
+    if (nt < p4est->first_local_tree || nt > p4est->last_local_tree) {
+      continue;
+    }
+    tree = p4est_tree_array_index (p4est->trees, nt);
+    info.treeid = nt;
+
+    /* the descendants of the root occupy a contiguous range in the
+     * Morton order that is located by binary search */
+    p4est_quadrant_first_descendant (root, &fd, P4EST_QMAXLEVEL);
+    p4est_quadrant_last_descendant (root, &ld, P4EST_QMAXLEVEL);
+    lo = p4est_find_lower_bound (&tree->quadrants, &fd, 0);
+    hi = p4est_find_higher_bound (&tree->quadrants, &ld, 0);
+
+    /* a local quadrant that matches the root or is coarser overlaps the
+     * window and sits just before the descendant range */
+    anc = (lo == -1) ? (ssize_t) tree->quadrants.elem_count - 1 : lo - 1;
+    if (anc >= 0) {
+      q = p4est_quadrant_array_index (&tree->quadrants, (size_t) anc);
+      if (p4est_quadrant_is_equal (q, root) ||
+          p4est_quadrant_is_ancestor (q, root)) {
+        info.quadid = (p4est_locidx_t) anc;
+        info.quad = q;
+        iter_volume (&info, user_data);
+      }
+    }
+    if (lo >= 0) {
+      for (is = lo; is <= hi; ++is) {
+        info.quadid = (p4est_locidx_t) is;
+        info.quad =
+          p4est_quadrant_array_index (&tree->quadrants, (size_t) is);
+        iter_volume (&info, user_data);
+      }
+    }
+  }
+}
+
+/** Recurse towards one domain boundary face of a tree.
+ * Only the children touching \a face are descended, so the walk visits
+ * just the boundary-adjacent quadrant ranges instead of the full tree.
+ */
+static void
+p4est_iterate_boundary_recursion (p4est_t * p4est, p4est_topidx_t which_tree,
+                                  p4est_quadrant_t * quadrant,
+                                  sc_array_t * quadrants,
+                                  p4est_locidx_t offset, int face,
+                                  p4est_iter_boundary_face_t iter_fn,
+                                  void *user_data)
+{
+  int                 i;
+  size_t              split[P4EST_CHILDREN + 1];
+  p4est_quadrant_t   *q, children[P4EST_CHILDREN];
+  sc_array_t          child_quadrants;
+
+  if (quadrants->elem_count == 0) {
+    return;
+  }
+  q = p4est_quadrant_array_index (quadrants, 0);
+  if (quadrant->level == q->level) {
+    /* the branch is a single leaf touching the face */
+    P4EST_ASSERT (quadrants->elem_count == 1);
+    P4EST_ASSERT (p4est_quadrant_is_equal (quadrant, q));
+    iter_fn (p4est, which_tree, q, face, offset, user_data);
+    return;
+  }
+  P4EST_ASSERT (p4est_quadrant_is_ancestor (quadrant, q));
+
+  p4est_split_array (quadrants, (int) quadrant->level, split);
+  p4est_quadrant_childrenv (quadrant, children);
+  for (i = 0; i < P4EST_CHILDREN; ++i) {
+    /* a child touches the face iff its child index bit along the face
+     * normal matches the side of the face */
+    if (((i >> (face >> 1)) & 1) != (face & 1)) {
+      continue;
+    }
+    if (split[i] < split[i + 1]) {
+      sc_array_init_view (&child_quadrants, quadrants,
+                          split[i], split[i + 1] - split[i]);
+      p4est_iterate_boundary_recursion (p4est, which_tree, &children[i],
+                                        &child_quadrants,
+                                        offset + (p4est_locidx_t) split[i],
+                                        face, iter_fn, user_data);
+      sc_array_reset (&child_quadrants);
+    }
+  }
+}
+
+void
+p4est_iterate_boundary_faces (p4est_t * p4est, void *user_data,
+                              p4est_iter_boundary_face_t iter_fn)
+{
+  int                 face;
+  p4est_topidx_t      nt;
+  p4est_tree_t       *tree;
+  p4est_connectivity_t *conn = p4est->connectivity;
+  p4est_quadrant_t    root;
+
+  P4EST_ASSERT (iter_fn != NULL);
+
+  P4EST_QUADRANT_INIT (&root);
+  for (nt = p4est->first_local_tree; nt <= p4est->last_local_tree; ++nt) {
+    tree = p4est_tree_array_index (p4est->trees, nt);
+    if (tree->quadrants.elem_count == 0) {
+      continue;
+    }
+    for (face = 0; face < P4EST_FACES; ++face) {
+      /* a tree face lies on the domain boundary iff the connectivity
+       * connects it back to the same tree and face */
+      if (conn->tree_to_tree[P4EST_FACES * nt + face] != nt ||
+          (int) conn->tree_to_face[P4EST_FACES * nt + face] != face) {
+        continue;
+      }
+      p4est_quadrant_set_morton (&root, 0, 0);
+      p4est_iterate_boundary_recursion (p4est, nt, &root, &tree->quadrants,
+                                        0, face, iter_fn, user_data);
+    }
+  }
 }
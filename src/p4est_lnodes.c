@@ -39,6 +39,9 @@
 #include <sc_allgather.h>
 #define MPI_Allgather sc_allgather
 #endif
+#ifdef P4EST_HAVE_PTHREAD_H
+#include <pthread.h>
+#endif
 
 #ifndef P4_TO_P8
 #define P4EST_LN_C_OFFSET 4
@@ -210,6 +213,9 @@ typedef struct p4est_lnodes_data
   int                 corner_nodes[P4EST_CHILDREN];
   sc_array_t          send_requests;
   sc_array_t         *send_buf;
+  sc_array_t          inode_to_global;  /* maps inodes to local numbers */
+  p4est_locidx_t      owned_global_count;      /* -1 until the owned nodes
+                                                  have been numbered */
 }
 p4est_lnodes_data_t;
 
@@ -2270,6 +2276,115 @@ p8est_lnodes_hedge_fix (p4est_t * p4est, p8est_iter_edge_side_t * hedge,
 }
 #endif
 
+/* p4est_lnodes_fix_hanging:
+ *
+ * Resolve all hanging faces (and hanging edges in 3D) left behind by the
+ * iterate loop, in the order the serial algorithm has always used.
+ */
+static void
+p4est_lnodes_fix_hanging (p4est_t * p4est, p4est_lnodes_data_t * data)
+{
+  p4est_iter_face_side_t *hface;
+#ifdef P4_TO_P8
+  p8est_iter_edge_side_t *hedge;
+#endif
+
+  while (data->hfaces->elem_count) {
+    hface = (p4est_iter_face_side_t *) sc_array_pop (data->hfaces);
+    p4est_lnodes_hface_fix (p4est, hface, data);
+  }
+#ifdef P4_TO_P8
+  while (data->hedges->elem_count) {
+    hedge = (p8est_iter_edge_side_t *) sc_array_pop (data->hedges);
+    p8est_lnodes_hedge_fix (p4est, hedge, data);
+  }
+#endif
+}
+
+#ifdef P4EST_HAVE_PTHREAD_H
+
+/** The slice of the local work executed by one thread: a contiguous range
+ * of elements for the volume node fill and a contiguous range of the
+ * purely local hanging fixes.
+ */
+typedef struct p4est_lnodes_thread
+{
+  p4est_t            *p4est;
+  p4est_lnodes_data_t *data;
+  p4est_locidx_t      first_elem, last_elem;
+  p4est_locidx_t      inode_base;
+  size_t              first_fix, last_fix;
+}
+p4est_lnodes_thread_t;
+
+/* p4est_lnodes_volume_thread:
+ *
+ * The threaded replacement for p4est_lnodes_volume_callback: the volume
+ * nodes of element qid occupy the nodes_per_volume inodes starting at
+ * inode_base + qid * nodes_per_volume, so every thread writes to disjoint
+ * entries of preallocated arrays.
+ */
+static void        *
+p4est_lnodes_volume_thread (void *arg)
+{
+  p4est_lnodes_thread_t *th = (p4est_lnodes_thread_t *) arg;
+  p4est_lnodes_data_t *data = th->data;
+  p4est_locidx_t     *elem_nodes = data->local_elem_nodes;
+  sc_array_t         *inodes = data->inodes;
+  int                 nodes_per_volume = data->nodes_per_volume;
+  int                *volume_nodes = data->volume_nodes;
+  int                 nodes_per_elem = data->nodes_per_elem;
+  p4est_locidx_t      rankval =
+    -((p4est_locidx_t) th->p4est->mpirank + 1);
+  p4est_locidx_t      qid, nid, inidx;
+  p4est_locidx_t     *inode;
+  int                 i;
+
+  for (qid = th->first_elem; qid < th->last_elem; qid++) {
+    inidx = th->inode_base + qid * (p4est_locidx_t) nodes_per_volume;
+    for (i = 0; i < nodes_per_volume; i++) {
+      nid = qid * nodes_per_elem + volume_nodes[i];
+      P4EST_ASSERT (elem_nodes[nid] == -1);
+      elem_nodes[nid] = inidx;
+      inode = (p4est_locidx_t *) sc_array_index (inodes, (size_t) inidx++);
+      *inode = rankval;
+    }
+  }
+  return NULL;
+}
+
+static void        *
+p4est_lnodes_hface_thread (void *arg)
+{
+  p4est_lnodes_thread_t *th = (p4est_lnodes_thread_t *) arg;
+  p4est_iter_face_side_t *hface;
+  size_t              zz;
+
+  for (zz = th->first_fix; zz < th->last_fix; zz++) {
+    hface = (p4est_iter_face_side_t *) sc_array_index (th->data->hfaces, zz);
+    p4est_lnodes_hface_fix (th->p4est, hface, th->data);
+  }
+  return NULL;
+}
+
+#ifdef P4_TO_P8
+static void        *
+p8est_lnodes_hedge_thread (void *arg)
+{
+  p4est_lnodes_thread_t *th = (p4est_lnodes_thread_t *) arg;
+  p8est_iter_edge_side_t *hedge;
+  size_t              zz;
+
+  for (zz = th->first_fix; zz < th->last_fix; zz++) {
+    hedge = (p8est_iter_edge_side_t *) sc_array_index (th->data->hedges, zz);
+    p8est_lnodes_hedge_fix (th->p4est, hedge, th->data);
+  }
+  return NULL;
+}
+#endif
+
+#endif /* P4EST_HAVE_PTHREAD_H */
+
 static void
 p4est_lnodes_init_data (p4est_lnodes_data_t * data, int p, p4est_t * p4est,
                         p4est_ghost_t * ghost_layer, p4est_lnodes_t * lnodes)
@@ -2317,8 +2432,8 @@ p4est_lnodes_init_data (p4est_lnodes_data_t * data, int p, p4est_t * p4est,
   ecount[6] = ecount[7] = ecount[8] = ecount[9] = ecount[10] = ecount[11] = 0;
 #endif
   vcount = 0;
-  nlen = nlq * npel;
-  ngen = ngq * npel;
+  nlen = p4est_locidx_mult (nlq, (p4est_locidx_t) npel);
+  ngen = p4est_locidx_mult (ngq, (p4est_locidx_t) npel);
 
   data->volume_nodes = P4EST_ALLOC (int, npv);
   for (i = 0; i < P4EST_DIM * 2; i++) {
@@ -2468,6 +2583,8 @@ p4est_lnodes_init_data (p4est_lnodes_data_t * data, int p, p4est_t * p4est,
                    sizeof (p4est_lnodes_buf_info_t));
     sc_array_init (&(data->sorters[i]), sizeof (p4est_lnodes_sorter_t));
   }
+  sc_array_init (&(data->inode_to_global), sizeof (p4est_locidx_t));
+  data->owned_global_count = -1;
 
   data->face_codes = lnodes->face_code;
 }
@@ -2558,8 +2675,8 @@ p4est_lnodes_count_send (p4est_lnodes_data_t * data, p4est_t * p4est,
   int                 mpiret;
   size_t              countz;
 
-  nlen = ((p4est_locidx_t) data->nodes_per_elem) * nlq;
-  num_inodes = (p4est_locidx_t) inodes->elem_count;
+  nlen = p4est_locidx_mult ((p4est_locidx_t) data->nodes_per_elem, nlq);
+  num_inodes = p4est_locidx_from_size (inodes->elem_count);
   for (li = 0; li < nlen; li++) {
     inidx = local_en[li];
     if (inidx >= 0) {
@@ -2636,6 +2753,10 @@ p4est_lnodes_count_send (p4est_lnodes_data_t * data, p4est_t * p4est,
       total_sent += (send_count * sizeof (p4est_locidx_t));
     }
   }
+  if (p4est->inspect != NULL) {
+    p4est->inspect->lnodes_comm_sent += total_sent;
+    p4est->inspect->lnodes_nzpeers += (size_t) num_send_procs;
+  }
   P4EST_VERBOSEF ("Total of %lld bytes sent to %d processes\n",
                   (unsigned long long) total_sent, num_send_procs);
 }
@@ -2756,6 +2877,41 @@ p4est_lnodes_test_comm (p4est_t * p4est, p4est_lnodes_data_t * data)
 }
 #endif
 
+/* p4est_lnodes_number_owned:
+ *
+ * Assign the final local numbers to the nodes this process owns.  This
+ * depends on local information only, so it can run while the messages
+ * carrying the nonlocal numbers are still in flight.
+ */
+static void
+p4est_lnodes_number_owned (p4est_lnodes_data_t * data, p4est_t * p4est)
+{
+  sc_array_t         *s_array = &(data->sorters[p4est->mpirank]);
+  size_t              count = s_array->elem_count;
+  size_t              zz;
+  p4est_lnodes_sorter_t *sorter;
+  p4est_lnodes_sorter_t *prev = NULL;
+  p4est_locidx_t      gcount = 0;
+  p4est_locidx_t     *lp;
+
+  P4EST_ASSERT (data->owned_global_count == -1);
+  P4EST_ASSERT (sc_array_is_sorted (s_array, p4est_lnodes_sorter_compare));
+  sc_array_resize (&data->inode_to_global, data->inodes->elem_count);
+  for (zz = 0; zz < count; zz++) {
+    sorter = (p4est_lnodes_sorter_t *) sc_array_index (s_array, zz);
+    lp = (p4est_locidx_t *) sc_array_index (&data->inode_to_global,
+                                            sorter->inode_index);
+    if (zz == 0 || sorter->local_index > prev->local_index) {
+      *lp = gcount++;
+      prev = sorter;
+    }
+    else {
+      *lp = gcount - 1;
+    }
+  }
+  data->owned_global_count = gcount;
+}
+
 /* p4est_lnodes_recv:
  *
  * Each process has its sorted receive lists.
@@ -2780,6 +2936,7 @@ p4est_lnodes_recv (p4est_t * p4est, p4est_lnodes_data_t * data)
   size_t              total_recv = 0;
   int                *num_recv_expect = P4EST_ALLOC_ZERO (int, mpisize);
   int                 byte_count;
+  int                 flag;
   size_t              elem_count;
   p4est_lnodes_buf_info_t *binfo, *prev;
   size_t              zindex, prev_index;
@@ -2812,10 +2969,23 @@ p4est_lnodes_recv (p4est_t * p4est, p4est_lnodes_data_t * data)
     sc_array_init (&(recv_buf[i]), sizeof (p4est_locidx_t));
   }
   for (i = 0; i < num_recv_procs; i++) {
-    mpiret =
-      MPI_Probe (MPI_ANY_SOURCE, P4EST_COMM_LNODES_PASS, p4est->mpicomm,
-                 &probe_status);
-    SC_CHECK_MPI (mpiret);
+    flag = 0;
+    if (data->owned_global_count < 0) {
+      mpiret = MPI_Iprobe (MPI_ANY_SOURCE, P4EST_COMM_LNODES_PASS,
+                           p4est->mpicomm, &flag, &probe_status);
+      SC_CHECK_MPI (mpiret);
+      if (!flag) {
+        /* nothing has arrived yet: overlap the wait with the numbering of
+         * the owned nodes, which needs local information only */
+        p4est_lnodes_number_owned (data, p4est);
+      }
+    }
+    if (!flag) {
+      mpiret =
+        MPI_Probe (MPI_ANY_SOURCE, P4EST_COMM_LNODES_PASS, p4est->mpicomm,
+                   &probe_status);
+      SC_CHECK_MPI (mpiret);
+    }
     j = probe_status.MPI_SOURCE;
     P4EST_ASSERT (j != p4est->mpirank && num_recv_expect[j] == 1);
     recv = &(recv_buf[j]);
@@ -2896,6 +3066,11 @@ p4est_lnodes_recv (p4est_t * p4est, p4est_lnodes_data_t * data)
     sc_array_sort (sorter_array, p4est_lnodes_sorter_compare);
   }
 
+  if (data->owned_global_count < 0) {
+    /* every message was already waiting, or there were none */
+    p4est_lnodes_number_owned (data, p4est);
+  }
+
   if (data->send_requests.elem_count > 0) {
     mpiret = MPI_Waitall ((int) data->send_requests.elem_count,
                           (MPI_Request *) data->send_requests.array,
@@ -2929,7 +3104,7 @@ p4est_lnodes_global_and_sharers (p4est_lnodes_data_t * data,
 {
   int                 i, j, k, l;
   int                 mpisize = p4est->mpisize;
-  sc_array_t          inode_to_global;
+  sc_array_t         *inode_to_global = &data->inode_to_global;
   sc_array_t         *s_array;
   p4est_lnodes_sorter_t *sorter;
   p4est_lnodes_sorter_t *prev = NULL;
@@ -2939,7 +3114,9 @@ p4est_lnodes_global_and_sharers (p4est_lnodes_data_t * data,
   p4est_locidx_t      icount = 0, gcount = 0, gcount2 = 0;
   p4est_locidx_t     *lp, li;
   p4est_locidx_t     *elnodes = lnodes->element_nodes;
-  p4est_locidx_t      nlen = lnodes->num_local_elements * lnodes->vnodes;
+  p4est_locidx_t      nlen =
+    p4est_locidx_mult (lnodes->num_local_elements,
+                       (p4est_locidx_t) lnodes->vnodes);
   p4est_locidx_t      num_inodes = (p4est_locidx_t) data->inodes->elem_count;
   p4est_locidx_t      inidx;
   int                *comm_proc;
@@ -2978,29 +3155,14 @@ p4est_lnodes_global_and_sharers (p4est_lnodes_data_t * data,
   }
   lnodes->global_offset = global_offsets[p4est->mpirank];
 
-  sc_array_init (&inode_to_global, sizeof (p4est_locidx_t));
-  sc_array_resize (&inode_to_global, (size_t) num_inodes);
-
-  i = p4est->mpirank;
-  {
-    s_array = &(data->sorters[i]);
-    count = s_array->elem_count;
-    P4EST_ASSERT (sc_array_is_sorted (s_array, p4est_lnodes_sorter_compare));
-    P4EST_ASSERT (count == (size_t) lnodes->owned_count);
-    for (zz = 0; zz < count; zz++) {
-      sorter = (p4est_lnodes_sorter_t *) sc_array_index (s_array, zz);
-      lp = (p4est_locidx_t *) sc_array_index (&inode_to_global,
-                                              sorter->inode_index);
-      if (zz == 0 || sorter->local_index > prev->local_index) {
-        *lp = gcount++;
-        prev = sorter;
-      }
-      else {
-        *lp = gcount - 1;
-      }
-    }
-    icount += count;
-  }
+  /* the owned nodes have been numbered in p4est_lnodes_recv, overlapped
+   * with the wait for the messages carrying the nonlocal numbers */
+  P4EST_ASSERT (data->owned_global_count == lnodes->owned_count);
+  P4EST_ASSERT (inode_to_global->elem_count == (size_t) num_inodes);
+  P4EST_ASSERT (data->sorters[p4est->mpirank].elem_count ==
+                (size_t) lnodes->owned_count);
+  gcount = data->owned_global_count;
+  icount += (p4est_locidx_t) data->sorters[p4est->mpirank].elem_count;
   for (i = 0; i < mpisize; i++) {
     if (i == p4est->mpirank) {
       continue;
@@ -3010,7 +3172,7 @@ p4est_lnodes_global_and_sharers (p4est_lnodes_data_t * data,
     P4EST_ASSERT (sc_array_is_sorted (s_array, p4est_lnodes_sorter_compare));
     for (zz = 0; zz < count; zz++) {
       sorter = (p4est_lnodes_sorter_t *) sc_array_index (s_array, zz);
-      lp = (p4est_locidx_t *) sc_array_index (&inode_to_global,
+      lp = (p4est_locidx_t *) sc_array_index (inode_to_global,
                                               sorter->inode_index);
       if (zz == 0 || sorter->local_index > prev->local_index) {
         *lp = gcount++;
@@ -3053,7 +3215,7 @@ p4est_lnodes_global_and_sharers (p4est_lnodes_data_t * data,
   for (li = 0; li < nlen; li++) {
     inidx = elnodes[li];
     P4EST_ASSERT (0 <= inidx && inidx < num_inodes);
-    lp = (p4est_locidx_t *) sc_array_index (&inode_to_global, (size_t) inidx);
+    lp = (p4est_locidx_t *) sc_array_index (inode_to_global, (size_t) inidx);
     elnodes[li] = *lp;
   }
 
@@ -3114,7 +3276,7 @@ p4est_lnodes_global_and_sharers (p4est_lnodes_data_t * data,
         share_offset = binfo->share_offset;
         share_count = (int) binfo->share_count;
         for (k = 0; k < limit; k++) {
-          gidx = *((p4est_locidx_t *) sc_array_index (&inode_to_global,
+          gidx = *((p4est_locidx_t *) sc_array_index (inode_to_global,
                                                       zindex++));
           if (j == 0) {
             shareidx = comm_proc[i];
@@ -3221,13 +3383,26 @@ p4est_lnodes_global_and_sharers (p4est_lnodes_data_t * data,
                       p4est->mpirank, lrank->owned_count, lrank->rank);
     }
   }
-  sc_array_reset (&inode_to_global);
+  sc_array_reset (inode_to_global);
   P4EST_FREE (comm_proc);
   P4EST_FREE (global_offsets);
 }
 
-p4est_lnodes_t     *
-p4est_lnodes_new (p4est_t * p4est, p4est_ghost_t * ghost_layer, int degree)
+/** Everything the completion phase of the split lnodes construction
+ * needs to know about the local phase.  Allocated by
+ * p4est_lnodes_new_begin and consumed by p4est_lnodes_new_end.
+ */
+struct p4est_lnodes_context
+{
+  p4est_t            *p4est;
+  p4est_lnodes_data_t data;
+  p4est_lnodes_t     *lnodes;
+};
+
+static p4est_lnodes_context_t *
+p4est_lnodes_new_begin_internal (p4est_t * p4est,
+                                 p4est_ghost_t * ghost_layer,
+                                 int degree, int num_threads)
 {
   p4est_iter_face_t   fiter;
   p4est_iter_volume_t viter;
@@ -3235,20 +3410,52 @@ p4est_lnodes_new (p4est_t * p4est, p4est_ghost_t * ghost_layer, int degree)
 #ifdef P4_TO_P8
   p8est_iter_edge_t   eiter;
 #endif
-  p4est_lnodes_data_t data;
-  p4est_iter_face_side_t *hface;
-#ifdef P4_TO_P8
-  p8est_iter_edge_side_t *hedge;
-#endif
+  p4est_lnodes_data_t *data;
   p4est_locidx_t      nel;
   p4est_locidx_t      nlen;
 #ifdef P4EST_DEBUG
   p4est_locidx_t      lj;
+#endif
+#ifdef P4EST_HAVE_PTHREAD_H
+  int                 nth;
+  int                 tvol;
+  int                 i;
+  int                 retval;
+  size_t              zz, zw, nfix;
+  p4est_locidx_t      inode_base;
+  pthread_t          *threads;
+  p4est_lnodes_thread_t *th;
+  p4est_iter_face_side_t *hface;
+#ifdef P4_TO_P8
+  p8est_iter_edge_side_t *hedge;
+#endif
 #endif
   p4est_lnodes_t     *lnodes = P4EST_ALLOC (p4est_lnodes_t, 1);
+  p4est_lnodes_context_t *ctx = P4EST_ALLOC (p4est_lnodes_context_t, 1);
+
+  p4est_profile_fire (p4est, P4EST_PROFILE_LNODES, 0);
+  ctx->p4est = p4est;
+  ctx->lnodes = lnodes;
+  data = &ctx->data;
 
-  P4EST_GLOBAL_PRODUCTION ("Into " P4EST_STRING "_lnodes_new\n");
   P4EST_ASSERT (degree >= 1);
+  P4EST_ASSERT (num_threads >= 0);
+
+  if (num_threads == 0) {
+    /* use the hybrid execution width configured on the forest */
+    num_threads = p4est->num_threads;
+  }
+
+  /* start timing and reset the communication counters */
+  if (p4est->inspect != NULL) {
+    p4est->inspect->lnodes_time = -MPI_Wtime ();
+    p4est->inspect->lnodes_comm_sent = 0;
+    p4est->inspect->lnodes_nzpeers = 0;
+  }
+#ifdef P4EST_HAVE_PTHREAD_H
+  nth = (num_threads > 1) ? num_threads : 0;
+  tvol = 0;
+#endif
 
   lnodes->mpicomm = p4est->mpicomm;
   lnodes->degree = degree;
@@ -3259,11 +3466,11 @@ p4est_lnodes_new (p4est_t * p4est, p4est_ghost_t * ghost_layer, int degree)
   lnodes->vnodes = (degree + 1) * (degree + 1) * (degree + 1);
 #endif
   lnodes->face_code = P4EST_ALLOC_ZERO (p4est_lnodes_code_t, nel);
-  nlen = nel * lnodes->vnodes;
+  nlen = p4est_locidx_mult (nel, (p4est_locidx_t) lnodes->vnodes);
   lnodes->element_nodes = P4EST_ALLOC (p4est_locidx_t, nlen);
   memset (lnodes->element_nodes, -1, nlen * sizeof (p4est_locidx_t));
 
-  p4est_lnodes_init_data (&data, degree, p4est, ghost_layer, lnodes);
+  p4est_lnodes_init_data (data, degree, p4est, ghost_layer, lnodes);
   if (degree == 1) {
     viter = NULL;
     fiter = p4est_lnodes_face_simple_callback;
@@ -3280,40 +3487,158 @@ p4est_lnodes_new (p4est_t * p4est, p4est_ghost_t * ghost_layer, int degree)
   }
   citer = p4est_lnodes_corner_callback;
 
-  p4est_iterate (p4est, ghost_layer, &data, viter, fiter,
+#ifdef P4EST_HAVE_PTHREAD_H
+  if (nth > 0 && viter != NULL) {
+    /* the volume nodes do not interact with the boundary callbacks: skip
+     * them during the iteration and fill them with all threads afterwards.
+     * the final numbering is unchanged because p4est_lnodes_count_send
+     * numbers the owned nodes in element order, not in creation order */
+    viter = NULL;
+    tvol = 1;
+  }
+#endif
+
+  p4est_iterate (p4est, ghost_layer, data, viter, fiter,
 #ifdef P4_TO_P8
                  eiter,
 #endif
                  citer);
 
-  sc_recycle_array_reset (data.cdp_array);
-  P4EST_FREE (data.cdp_array);
-  P4EST_FREE (data.local_cdp);
-  P4EST_FREE (data.ghost_cdp);
-
-#ifdef P4_TO_P8
-  if (data.nodes_per_edge) {
-    sc_recycle_array_reset (data.edp_array);
-    P4EST_FREE (data.edp_array);
-    P4EST_FREE (data.local_edp);
-    P4EST_FREE (data.ghost_edp);
+#ifdef P4EST_HAVE_PTHREAD_H
+  if (tvol) {
+    inode_base = (p4est_locidx_t) data->inodes->elem_count;
+    sc_array_resize (data->inodes, (size_t) inode_base +
+                     (size_t) nel * (size_t) data->nodes_per_volume);
+    threads = P4EST_ALLOC (pthread_t, nth);
+    th = P4EST_ALLOC (p4est_lnodes_thread_t, nth);
+    for (i = 0; i < nth; i++) {
+      th[i].p4est = p4est;
+      th[i].data = data;
+      th[i].inode_base = inode_base;
+      th[i].first_elem = (p4est_locidx_t) (((p4est_gloidx_t) nel * i) / nth);
+      th[i].last_elem =
+        (p4est_locidx_t) (((p4est_gloidx_t) nel * (i + 1)) / nth);
+      th[i].first_fix = th[i].last_fix = 0;
+      retval = pthread_create (&threads[i], NULL,
+                               p4est_lnodes_volume_thread, &th[i]);
+      SC_CHECK_ABORT (retval == 0, "p4est_lnodes_new: pthread_create");
+    }
+    for (i = 0; i < nth; i++) {
+      retval = pthread_join (threads[i], NULL);
+      SC_CHECK_ABORT (retval == 0, "p4est_lnodes_new: pthread_join");
+    }
+    P4EST_FREE (th);
+    P4EST_FREE (threads);
   }
 #endif
 
-  p4est_lnodes_count_send (&data, p4est, lnodes);
+  sc_recycle_array_reset (data->cdp_array);
+  P4EST_FREE (data->cdp_array);
+  P4EST_FREE (data->local_cdp);
+  P4EST_FREE (data->ghost_cdp);
 
-  while (data.hfaces->elem_count) {
-    hface = (p4est_iter_face_side_t *) sc_array_pop (data.hfaces);
-    p4est_lnodes_hface_fix (p4est, hface, &data);
+#ifdef P4_TO_P8
+  if (data->nodes_per_edge) {
+    sc_recycle_array_reset (data->edp_array);
+    P4EST_FREE (data->edp_array);
+    P4EST_FREE (data->local_edp);
+    P4EST_FREE (data->ghost_edp);
   }
+#endif
+
+  p4est_lnodes_count_send (data, p4est, lnodes);
+
+#ifdef P4EST_HAVE_PTHREAD_H
+  if (nth > 0) {
+    /* hanging fixes that involve a ghost quadrant may create new nodes and
+     * touch the shared send structures: they run serially here.  the purely
+     * local fixes write disjoint element node entries and read only values
+     * set by the iteration, so they are spread across the threads */
+    threads = P4EST_ALLOC (pthread_t, nth);
+    th = P4EST_ALLOC (p4est_lnodes_thread_t, nth);
+    zw = 0;
+    for (zz = 0; zz < data->hfaces->elem_count; zz++) {
+      hface = (p4est_iter_face_side_t *) sc_array_index (data->hfaces, zz);
+      for (i = 0; i < P4EST_CHILDREN / 2; i++) {
+        if (hface->is.hanging.is_ghost[i]) {
+          break;
+        }
+      }
+      if (i < P4EST_CHILDREN / 2) {
+        p4est_lnodes_hface_fix (p4est, hface, data);
+      }
+      else {
+        if (zw < zz) {
+          memcpy (sc_array_index (data->hfaces, zw), hface,
+                  sizeof (p4est_iter_face_side_t));
+        }
+        zw++;
+      }
+    }
+    nfix = zw;
+    sc_array_resize (data->hfaces, nfix);
+    for (i = 0; i < nth; i++) {
+      th[i].p4est = p4est;
+      th[i].data = data;
+      th[i].inode_base = 0;
+      th[i].first_elem = th[i].last_elem = 0;
+      th[i].first_fix = (nfix * (size_t) i) / (size_t) nth;
+      th[i].last_fix = (nfix * (size_t) (i + 1)) / (size_t) nth;
+      retval = pthread_create (&threads[i], NULL,
+                               p4est_lnodes_hface_thread, &th[i]);
+      SC_CHECK_ABORT (retval == 0, "p4est_lnodes_new: pthread_create");
+    }
+    for (i = 0; i < nth; i++) {
+      retval = pthread_join (threads[i], NULL);
+      SC_CHECK_ABORT (retval == 0, "p4est_lnodes_new: pthread_join");
+    }
+    sc_array_resize (data->hfaces, 0);
 #ifdef P4_TO_P8
-  while (data.hedges->elem_count) {
-    hedge = (p8est_iter_edge_side_t *) sc_array_pop (data.hedges);
-    p8est_lnodes_hedge_fix (p4est, hedge, &data);
+    zw = 0;
+    for (zz = 0; zz < data->hedges->elem_count; zz++) {
+      hedge = (p8est_iter_edge_side_t *) sc_array_index (data->hedges, zz);
+      for (i = 0; i < 2; i++) {
+        if (hedge->is.hanging.is_ghost[i]) {
+          break;
+        }
+      }
+      if (i < 2) {
+        p8est_lnodes_hedge_fix (p4est, hedge, data);
+      }
+      else {
+        if (zw < zz) {
+          memcpy (sc_array_index (data->hedges, zw), hedge,
+                  sizeof (p8est_iter_edge_side_t));
+        }
+        zw++;
+      }
+    }
+    nfix = zw;
+    sc_array_resize (data->hedges, nfix);
+    for (i = 0; i < nth; i++) {
+      th[i].first_fix = (nfix * (size_t) i) / (size_t) nth;
+      th[i].last_fix = (nfix * (size_t) (i + 1)) / (size_t) nth;
+      retval = pthread_create (&threads[i], NULL,
+                               p8est_lnodes_hedge_thread, &th[i]);
+      SC_CHECK_ABORT (retval == 0, "p4est_lnodes_new: pthread_create");
+    }
+    for (i = 0; i < nth; i++) {
+      retval = pthread_join (threads[i], NULL);
+      SC_CHECK_ABORT (retval == 0, "p4est_lnodes_new: pthread_join");
+    }
+    sc_array_resize (data->hedges, 0);
+#endif
+    P4EST_FREE (th);
+    P4EST_FREE (threads);
   }
+  else {
+    p4est_lnodes_fix_hanging (p4est, data);
+  }
+#else
+  p4est_lnodes_fix_hanging (p4est, data);
 #endif
 
-  P4EST_FREE (data.ghost_elem_nodes);
+  P4EST_FREE (data->ghost_elem_nodes);
 
 #ifdef P4EST_DEBUG
   for (lj = 0; lj < nlen; lj++) {
@@ -3321,18 +3646,677 @@ p4est_lnodes_new (p4est_t * p4est, p4est_ghost_t * ghost_layer, int degree)
   }
 #endif
 
-  p4est_lnodes_recv (p4est, &data);
 
-  P4EST_ASSERT (p4est_lnodes_test_comm (p4est, &data));
+  return ctx;
+}
+
+static p4est_lnodes_t *
+p4est_lnodes_new_end_internal (p4est_lnodes_context_t * ctx)
+{
+  p4est_t            *p4est = ctx->p4est;
+  p4est_lnodes_data_t *data = &ctx->data;
+  p4est_lnodes_t     *lnodes = ctx->lnodes;
+  p4est_locidx_t      nel = lnodes->num_local_elements;
+  p4est_topidx_t      tt;
+  p4est_tree_t       *tree;
+  p4est_quadrant_t   *q;
+  size_t              zq;
 
-  p4est_lnodes_global_and_sharers (&data, lnodes, p4est);
+  p4est_lnodes_recv (p4est, data);
 
-  p4est_lnodes_reset_data (&data, p4est);
+  P4EST_ASSERT (p4est_lnodes_test_comm (p4est, data));
 
+  p4est_lnodes_global_and_sharers (data, lnodes, p4est);
+
+  p4est_lnodes_reset_data (data, p4est);
+
+  /* record the element quadrants so that p4est_lnodes_update can identify
+   * the elements that survive a later adaptation */
+  lnodes->elem_trees = P4EST_ALLOC (p4est_topidx_t, nel);
+  lnodes->elem_keys = P4EST_ALLOC (uint64_t, nel);
+  for (tt = p4est->first_local_tree; tt <= p4est->last_local_tree; tt++) {
+    tree = p4est_tree_array_index (p4est->trees, tt);
+    for (zq = 0; zq < tree->quadrants.elem_count; zq++) {
+      q = p4est_quadrant_array_index (&tree->quadrants, zq);
+      lnodes->elem_trees[tree->quadrants_offset + (p4est_locidx_t) zq] = tt;
+      lnodes->elem_keys[tree->quadrants_offset + (p4est_locidx_t) zq] =
+        p4est_quadrant_morton_key (q);
+    }
+  }
+
+  if (p4est->inspect != NULL) {
+    p4est->inspect->lnodes_time += MPI_Wtime ();
+  }
+
+  p4est_profile_fire (p4est, P4EST_PROFILE_LNODES, 1);
+  P4EST_FREE (ctx);
+
+  return lnodes;
+}
+
+static p4est_lnodes_t *
+p4est_lnodes_new_internal (p4est_t * p4est, p4est_ghost_t * ghost_layer,
+                           int degree, int num_threads)
+{
+  p4est_lnodes_context_t *ctx;
+  p4est_lnodes_t     *lnodes;
+
+  P4EST_GLOBAL_PRODUCTION ("Into " P4EST_STRING "_lnodes_new\n");
+  ctx = p4est_lnodes_new_begin_internal (p4est, ghost_layer,
+                                         degree, num_threads);
+  lnodes = p4est_lnodes_new_end_internal (ctx);
   P4EST_GLOBAL_PRODUCTION ("Done " P4EST_STRING "_lnodes_new\n");
   return lnodes;
 }
 
+p4est_lnodes_t     *
+p4est_lnodes_new (p4est_t * p4est, p4est_ghost_t * ghost_layer, int degree)
+{
+  return p4est_lnodes_new_internal (p4est, ghost_layer, degree, 0);
+}
+
+p4est_lnodes_t     *
+p4est_lnodes_new_threaded (p4est_t * p4est, p4est_ghost_t * ghost_layer,
+                           int degree, int num_threads)
+{
+  return p4est_lnodes_new_internal (p4est, ghost_layer, degree, num_threads);
+}
+
+p4est_lnodes_context_t *
+p4est_lnodes_new_begin (p4est_t * p4est, p4est_ghost_t * ghost_layer,
+                        int degree)
+{
+  P4EST_GLOBAL_PRODUCTION ("Into " P4EST_STRING "_lnodes_new_begin\n");
+  return p4est_lnodes_new_begin_internal (p4est, ghost_layer, degree, 0);
+}
+
+p4est_lnodes_t     *
+p4est_lnodes_new_end (p4est_lnodes_context_t * ctx)
+{
+  p4est_lnodes_t     *lnodes;
+
+  lnodes = p4est_lnodes_new_end_internal (ctx);
+  P4EST_GLOBAL_PRODUCTION ("Done " P4EST_STRING "_lnodes_new_end\n");
+  return lnodes;
+}
+
+p4est_lnodes_t     *
+p4est_lnodes_update (p4est_t * p4est, p4est_ghost_t * ghost_layer,
+                     int degree, p4est_lnodes_t * old_lnodes,
+                     p4est_gloidx_t ** old_global)
+{
+  p4est_lnodes_t     *lnodes;
+  p4est_gloidx_t     *map;
+  p4est_locidx_t      eo, en, neo, nen;
+  p4est_locidx_t      no, nn;
+  int                 k, vnodes;
+#ifdef P4EST_DEBUG
+  p4est_locidx_t      li, kept;
+#endif
+
+  P4EST_ASSERT (old_lnodes != NULL);
+  P4EST_ASSERT (old_lnodes->degree == degree);
+
+  lnodes = p4est_lnodes_new_internal (p4est, ghost_layer, degree, 0);
+  if (old_global == NULL) {
+    return lnodes;
+  }
+
+  vnodes = lnodes->vnodes;
+  map = P4EST_ALLOC (p4est_gloidx_t, lnodes->num_local_nodes);
+  memset (map, -1, lnodes->num_local_nodes * sizeof (p4est_gloidx_t));
+
+  /* both element lists are sorted by tree and Morton key, so one merge
+   * pass identifies the elements that survived the adaptation */
+  neo = old_lnodes->num_local_elements;
+  nen = lnodes->num_local_elements;
+  eo = en = 0;
+  while (eo < neo && en < nen) {
+    if (old_lnodes->elem_trees[eo] != lnodes->elem_trees[en]) {
+      if (old_lnodes->elem_trees[eo] < lnodes->elem_trees[en]) {
+        eo++;
+      }
+      else {
+        en++;
+      }
+      continue;
+    }
+    if (old_lnodes->elem_keys[eo] != lnodes->elem_keys[en]) {
+      if (old_lnodes->elem_keys[eo] < lnodes->elem_keys[en]) {
+        eo++;
+      }
+      else {
+        en++;
+      }
+      continue;
+    }
+    /* the element exists before and after: if its hanging status is also
+     * unchanged, every node it touches is the same geometric node */
+    if (old_lnodes->face_code[eo] == lnodes->face_code[en]) {
+      for (k = 0; k < vnodes; k++) {
+        no = old_lnodes->element_nodes[eo * vnodes + k];
+        nn = lnodes->element_nodes[en * vnodes + k];
+        map[nn] = p4est_lnodes_global_index (old_lnodes, no);
+      }
+    }
+    eo++;
+    en++;
+  }
+
+#ifdef P4EST_DEBUG
+  kept = 0;
+  for (li = 0; li < lnodes->num_local_nodes; li++) {
+    kept += (map[li] >= 0);
+  }
+  P4EST_VERBOSEF ("%lld of %lld local nodes carry over their"
+                  " previous global number\n", (long long) kept,
+                  (long long) lnodes->num_local_nodes);
+#endif
+
+  *old_global = map;
+  return lnodes;
+}
+
+void
+p4est_lnodes_adjacency (p4est_lnodes_t * lnodes, p4est_locidx_t ** rowptr,
+                        p4est_locidx_t ** cols)
+{
+  int                 vnodes = lnodes->vnodes;
+  p4est_locidx_t      nln = lnodes->num_local_nodes;
+  p4est_locidx_t      nel = lnodes->num_local_elements;
+  p4est_locidx_t      nlen =
+    p4est_locidx_mult (lnodes->num_local_elements,
+                       (p4est_locidx_t) lnodes->vnodes);
+  p4est_locidx_t     *en = lnodes->element_nodes;
+  p4est_locidx_t     *eoff, *next, *elist;
+  p4est_locidx_t     *rp, *scratch;
+  sc_array_t         *colarr;
+  p4est_locidx_t      li, el, n, prev;
+  p4est_locidx_t      count, max_row;
+  p4est_locidx_t      zz;
+  int                 k;
+
+  P4EST_ASSERT (rowptr != NULL && cols != NULL);
+
+  /* invert element_nodes into a node-to-element incidence with a counting
+   * sort: two passes over the elements, no hashing */
+  eoff = P4EST_ALLOC_ZERO (p4est_locidx_t, nln + 1);
+  for (li = 0; li < nlen; li++) {
+    P4EST_ASSERT (0 <= en[li] && en[li] < nln);
+    eoff[en[li] + 1]++;
+  }
+  for (n = 0; n < nln; n++) {
+    eoff[n + 1] += eoff[n];
+  }
+  next = P4EST_ALLOC (p4est_locidx_t, nln);
+  memcpy (next, eoff, nln * sizeof (p4est_locidx_t));
+  elist = P4EST_ALLOC (p4est_locidx_t, nlen);
+  for (el = 0; el < nel; el++) {
+    for (k = 0; k < vnodes; k++) {
+      elist[next[en[el * vnodes + k]]++] = el;
+    }
+  }
+  P4EST_FREE (next);
+
+  /* the columns of a row are the nodes of the row's elements: hanging
+   * couplings need no extra treatment because element_nodes already
+   * references the coarse nodes on hanging boundaries */
+  max_row = 0;
+  for (n = 0; n < nln; n++) {
+    max_row = SC_MAX (max_row, eoff[n + 1] - eoff[n]);
+  }
+  scratch = P4EST_ALLOC (p4est_locidx_t, max_row * vnodes);
+  rp = P4EST_ALLOC (p4est_locidx_t, nln + 1);
+  colarr = sc_array_new (sizeof (p4est_locidx_t));
+  rp[0] = 0;
+  for (n = 0; n < nln; n++) {
+    count = 0;
+    for (zz = eoff[n]; zz < eoff[n + 1]; zz++) {
+      memcpy (scratch + count, en + elist[zz] * vnodes,
+              vnodes * sizeof (p4est_locidx_t));
+      count += vnodes;
+    }
+    qsort (scratch, (size_t) count, sizeof (p4est_locidx_t),
+           p4est_locidx_compare);
+    prev = -1;
+    for (zz = 0; zz < count; zz++) {
+      if (scratch[zz] != prev) {
+        prev = scratch[zz];
+        *((p4est_locidx_t *) sc_array_push (colarr)) = prev;
+      }
+    }
+    rp[n + 1] = (p4est_locidx_t) colarr->elem_count;
+  }
+  P4EST_FREE (scratch);
+  P4EST_FREE (elist);
+  P4EST_FREE (eoff);
+
+  *rowptr = rp;
+  *cols = P4EST_ALLOC (p4est_locidx_t, colarr->elem_count);
+  memcpy (*cols, colarr->array,
+          colarr->elem_count * sizeof (p4est_locidx_t));
+  sc_array_destroy (colarr);
+}
+
+/** Express the vertex values of a degree 1 element in its element_nodes.
+ * For a corner that is not hanging the vertex value is the node entry
+ * itself.  For a hanging corner the entry references a coarse node and
+ * the conforming vertex value is the average over the coarse face or
+ * edge, all of whose corners appear among the element's own entries.
+ * \param [in] face_code  The hanging description of the element.
+ * \param [in,out] w      On output, the vertex value at corner \a j is
+ *                        sum_k w[j][k] * u[element_nodes[k]].
+ */
+static void
+p4est_lnodes_transfer_vertex_weights (p4est_lnodes_code_t face_code,
+                                      double w[P4EST_CHILDREN]
+                                      [P4EST_CHILDREN])
+{
+  const int           ones = P4EST_CHILDREN - 1;
+  int                 i, h;
+  int                 c, work;
+#ifdef P4_TO_P8
+  int                 j;
+#endif
+
+  memset (w, 0, P4EST_CHILDREN * P4EST_CHILDREN * sizeof (double));
+  for (i = 0; i < P4EST_CHILDREN; i++) {
+    w[i][i] = 1.;
+  }
+  if (!face_code) {
+    return;
+  }
+
+  /* the low bits store the corner that touches the coarse neighbors */
+  c = (int) (face_code & ones);
+  work = (int) (face_code >> P4EST_DIM);
+  for (i = 0; i < P4EST_DIM; ++i) {
+    if (work & 1) {
+      /* the face normal to axis i hangs */
+#ifndef P4_TO_P8
+      h = c ^ ones ^ (1 << i);
+      w[h][h] = w[h][c] = .5;
+#else
+      /* the midpoint of the coarse face averages its four corners */
+      h = c ^ ones ^ (1 << i);
+      w[h][h] = 0.;
+      for (j = 0; j < P4EST_CHILDREN; j++) {
+        if ((((j ^ c) >> i) & 1) == 0) {
+          w[h][j] = .25;
+        }
+      }
+      /* the edges of a hanging face hang as well */
+      for (j = 0; j < P4EST_DIM; j++) {
+        if (j != i) {
+          h = c ^ (1 << j);
+          w[h][h] = w[h][c] = .5;
+        }
+      }
+#endif
+    }
+    work >>= 1;
+  }
+#ifdef P4_TO_P8
+  for (i = 0; i < P4EST_DIM; ++i) {
+    if (work & 1) {
+      /* the edge parallel to axis i hangs on its own */
+      h = c ^ (1 << i);
+      w[h][h] = w[h][c] = .5;
+    }
+    work >>= 1;
+  }
+#endif
+}
+
+/** Mark the hanging corners of a degree 1 element.
+ * \param [in] face_code  The hanging description of the element.
+ * \param [in,out] hang   Entry \a j is set to nonzero iff corner \a j of
+ *                        the element is a hanging node.
+ */
+static void
+p4est_lnodes_transfer_hanging_corners (p4est_lnodes_code_t face_code,
+                                       int hang[P4EST_CHILDREN])
+{
+  const int           ones = P4EST_CHILDREN - 1;
+  int                 i;
+  int                 c, work;
+#ifdef P4_TO_P8
+  int                 j;
+#endif
+
+  memset (hang, 0, P4EST_CHILDREN * sizeof (int));
+  if (!face_code) {
+    return;
+  }
+
+  c = (int) (face_code & ones);
+  work = (int) (face_code >> P4EST_DIM);
+  for (i = 0; i < P4EST_DIM; ++i) {
+    if (work & 1) {
+      hang[c ^ ones ^ (1 << i)] = 1;
+#ifdef P4_TO_P8
+      for (j = 0; j < P4EST_DIM; j++) {
+        if (j != i) {
+          hang[c ^ (1 << j)] = 1;
+        }
+      }
+#endif
+    }
+    work >>= 1;
+  }
+#ifdef P4_TO_P8
+  for (i = 0; i < P4EST_DIM; ++i) {
+    if (work & 1) {
+      hang[c ^ (1 << i)] = 1;
+    }
+    work >>= 1;
+  }
+#endif
+}
+
+/** Recover the per-axis coordinates and the level from a Morton key.
+ * The coordinates are returned at P4EST_QMAXLEVEL resolution, matching
+ * the units used by p4est_quadrant_morton_key.
+ */
+static void
+p4est_lnodes_transfer_key_position (uint64_t key, int64_t xyz[P4EST_DIM],
+                                    int *level)
+{
+  const uint64_t      bits = key >> 6;
+  int                 i, d;
+
+  *level = (int) (key & 0x3F);
+  P4EST_ASSERT (0 <= *level && *level <= P4EST_QMAXLEVEL);
+  for (d = 0; d < P4EST_DIM; d++) {
+    xyz[d] = 0;
+  }
+  for (i = 0; i < P4EST_QMAXLEVEL; i++) {
+    for (d = 0; d < P4EST_DIM; d++) {
+      xyz[d] |= (int64_t) ((bits >> (P4EST_DIM * i + d)) & 1) << i;
+    }
+  }
+}
+
+/** Resolve the nodes of one new element against one old element.
+ * The old element is an ancestor, a descendant, or a copy of the new
+ * element.  Every non-hanging corner of the new element whose position
+ * can be evaluated on the old element receives either a direct index or
+ * an interpolation row; corners already resolved by an earlier pair are
+ * left alone.
+ */
+static void
+p4est_lnodes_transfer_pair (p4est_lnodes_t * old_lnodes,
+                            p4est_locidx_t eo, int64_t * xo, int lo,
+                            p4est_lnodes_t * lnodes,
+                            p4est_locidx_t en, int64_t * xn, int ln,
+                            p4est_lnodes_transfer_t * transfer,
+                            p4est_locidx_t * istart, int *icount,
+                            sc_array_t * inodes, sc_array_t * iweights)
+{
+  const int64_t       leno = INT64_C (1) << (P4EST_QMAXLEVEL - lo);
+  const int64_t       lenn = INT64_C (1) << (P4EST_QMAXLEVEL - ln);
+  int                 k, j, m, d;
+  int                 nhang[P4EST_CHILDREN];
+  int                 nonzero, single;
+  int64_t             pd;
+  double              vw[P4EST_CHILDREN][P4EST_CHILDREN];
+  double              t[P4EST_DIM], wj, out[P4EST_CHILDREN];
+  p4est_locidx_t      nn, no;
+
+  p4est_lnodes_transfer_hanging_corners (lnodes->face_code[en], nhang);
+  p4est_lnodes_transfer_vertex_weights (old_lnodes->face_code[eo], vw);
+
+  for (k = 0; k < P4EST_CHILDREN; k++) {
+    if (nhang[k]) {
+      /* the entry references a coarse node resolved by another element */
+      continue;
+    }
+    nn = lnodes->element_nodes[en * P4EST_CHILDREN + k];
+    if (transfer->direct[nn] >= 0 || istart[nn] >= 0) {
+      continue;
+    }
+
+    /* reference coordinates of the corner within the old element */
+    for (d = 0; d < P4EST_DIM; d++) {
+      pd = xn[d] + (((k >> d) & 1) ? lenn : 0);
+      if (pd < xo[d] || pd > xo[d] + leno) {
+        /* only possible under coarsening: the corner lies outside the
+         * old child and is served by one of its siblings instead */
+        break;
+      }
+      t[d] = (double) (pd - xo[d]) / (double) leno;
+    }
+    if (d < P4EST_DIM) {
+      continue;
+    }
+
+    /* multilinear interpolation on the old element, mapped through the
+     * hanging corner averages onto genuine old nodes */
+    for (m = 0; m < P4EST_CHILDREN; m++) {
+      out[m] = 0.;
+    }
+    for (j = 0; j < P4EST_CHILDREN; j++) {
+      wj = 1.;
+      for (d = 0; d < P4EST_DIM; d++) {
+        wj *= ((j >> d) & 1) ? t[d] : 1. - t[d];
+      }
+      if (wj > 0.) {
+        for (m = 0; m < P4EST_CHILDREN; m++) {
+          out[m] += wj * vw[j][m];
+        }
+      }
+    }
+
+    nonzero = 0;
+    single = -1;
+    for (m = 0; m < P4EST_CHILDREN; m++) {
+      if (out[m] > 0.) {
+        nonzero++;
+        single = m;
+      }
+    }
+    P4EST_ASSERT (nonzero > 0);
+    if (nonzero == 1 && out[single] == 1.) {
+      transfer->direct[nn] =
+        old_lnodes->element_nodes[eo * P4EST_CHILDREN + single];
+    }
+    else {
+      istart[nn] = (p4est_locidx_t) inodes->elem_count;
+      icount[nn] = nonzero;
+      for (m = 0; m < P4EST_CHILDREN; m++) {
+        if (out[m] > 0.) {
+          no = old_lnodes->element_nodes[eo * P4EST_CHILDREN + m];
+          *((p4est_locidx_t *) sc_array_push (inodes)) = no;
+          *((double *) sc_array_push (iweights)) = out[m];
+        }
+      }
+    }
+  }
+}
+
+p4est_lnodes_transfer_t *
+p4est_lnodes_transfer_new (p4est_lnodes_t * old_lnodes,
+                           p4est_lnodes_t * lnodes)
+{
+  p4est_lnodes_transfer_t *transfer;
+  p4est_locidx_t      neo, nen, eo, en, ee;
+  p4est_locidx_t      nln, nn, li, lz;
+  p4est_locidx_t     *istart;
+  int                *icount;
+  sc_array_t         *inodes, *iweights;
+  uint64_t            ko, kn;
+  int64_t             xo[P4EST_DIM], xn[P4EST_DIM];
+  int                 lo, ln, k;
+
+  P4EST_ASSERT (old_lnodes != NULL && lnodes != NULL);
+  SC_CHECK_ABORT (old_lnodes->degree == 1 && lnodes->degree == 1,
+                  P4EST_STRING "_lnodes_transfer_new requires degree 1");
+
+  nln = lnodes->num_local_nodes;
+  transfer = P4EST_ALLOC (p4est_lnodes_transfer_t, 1);
+  transfer->num_local_nodes = nln;
+  transfer->direct = P4EST_ALLOC (p4est_locidx_t, nln);
+  memset (transfer->direct, -1, nln * sizeof (p4est_locidx_t));
+
+  istart = P4EST_ALLOC (p4est_locidx_t, nln);
+  memset (istart, -1, nln * sizeof (p4est_locidx_t));
+  icount = P4EST_ALLOC_ZERO (int, nln);
+  inodes = sc_array_new (sizeof (p4est_locidx_t));
+  iweights = sc_array_new (sizeof (double));
+
+  /* both element lists are sorted by tree and Morton key and an ancestor
+   * key sorts before the keys of its descendants, so one merge pass pairs
+   * every new element with the old element covering the same region */
+  neo = old_lnodes->num_local_elements;
+  nen = lnodes->num_local_elements;
+  eo = en = 0;
+  while (eo < neo && en < nen) {
+    if (old_lnodes->elem_trees[eo] != lnodes->elem_trees[en]) {
+      if (old_lnodes->elem_trees[eo] < lnodes->elem_trees[en]) {
+        eo++;
+      }
+      else {
+        en++;
+      }
+      continue;
+    }
+    ko = old_lnodes->elem_keys[eo];
+    kn = lnodes->elem_keys[en];
+    if (ko == kn) {
+      /* the element survived: with an unchanged hanging status all of
+       * its entries carry over, otherwise resolve corner by corner */
+      if (old_lnodes->face_code[eo] == lnodes->face_code[en]) {
+        for (k = 0; k < P4EST_CHILDREN; k++) {
+          nn = lnodes->element_nodes[en * P4EST_CHILDREN + k];
+          if (transfer->direct[nn] < 0 && istart[nn] < 0) {
+            transfer->direct[nn] =
+              old_lnodes->element_nodes[eo * P4EST_CHILDREN + k];
+          }
+        }
+      }
+      else {
+        p4est_lnodes_transfer_key_position (ko, xo, &lo);
+        p4est_lnodes_transfer_key_position (kn, xn, &ln);
+        p4est_lnodes_transfer_pair (old_lnodes, eo, xo, lo,
+                                    lnodes, en, xn, ln,
+                                    transfer, istart, icount,
+                                    inodes, iweights);
+      }
+      eo++;
+      en++;
+    }
+    else if (p4est_morton_key_is_ancestor (ko, kn)) {
+      /* the old element was refined: interpolate all new descendants */
+      p4est_lnodes_transfer_key_position (ko, xo, &lo);
+      for (ee = en; ee < nen &&
+           lnodes->elem_trees[ee] == old_lnodes->elem_trees[eo] &&
+           p4est_morton_key_is_ancestor (ko, lnodes->elem_keys[ee]); ee++) {
+        p4est_lnodes_transfer_key_position (lnodes->elem_keys[ee], xn, &ln);
+        p4est_lnodes_transfer_pair (old_lnodes, eo, xo, lo,
+                                    lnodes, ee, xn, ln,
+                                    transfer, istart, icount,
+                                    inodes, iweights);
+      }
+      en = ee;
+      eo++;
+    }
+    else if (p4est_morton_key_is_ancestor (kn, ko)) {
+      /* old elements were coarsened: each corner of the new element is
+       * injected from the sibling that touches it */
+      p4est_lnodes_transfer_key_position (kn, xn, &ln);
+      for (ee = eo; ee < neo &&
+           old_lnodes->elem_trees[ee] == lnodes->elem_trees[en] &&
+           p4est_morton_key_is_ancestor (kn, old_lnodes->elem_keys[ee]);
+           ee++) {
+        p4est_lnodes_transfer_key_position (old_lnodes->elem_keys[ee],
+                                            xo, &lo);
+        p4est_lnodes_transfer_pair (old_lnodes, ee, xo, lo,
+                                    lnodes, en, xn, ln,
+                                    transfer, istart, icount,
+                                    inodes, iweights);
+      }
+      eo = ee;
+      en++;
+    }
+    else if (ko < kn) {
+      eo++;
+    }
+    else {
+      en++;
+    }
+  }
+
+  /* gather the scattered interpolation rows into CSR order */
+  transfer->interp_offsets = P4EST_ALLOC (p4est_locidx_t, nln + 1);
+  transfer->interp_offsets[0] = 0;
+  for (li = 0; li < nln; li++) {
+    transfer->interp_offsets[li + 1] = transfer->interp_offsets[li] +
+      (istart[li] >= 0 ? (p4est_locidx_t) icount[li] : 0);
+  }
+  lz = transfer->interp_offsets[nln];
+  transfer->interp_nodes = P4EST_ALLOC (p4est_locidx_t, lz);
+  transfer->interp_weights = P4EST_ALLOC (double, lz);
+  for (li = 0; li < nln; li++) {
+    if (istart[li] >= 0) {
+      memcpy (transfer->interp_nodes + transfer->interp_offsets[li],
+              (p4est_locidx_t *) inodes->array + istart[li],
+              icount[li] * sizeof (p4est_locidx_t));
+      memcpy (transfer->interp_weights + transfer->interp_offsets[li],
+              (double *) iweights->array + istart[li],
+              icount[li] * sizeof (double));
+    }
+  }
+
+#ifdef P4EST_DEBUG
+  lz = 0;
+  for (li = 0; li < nln; li++) {
+    lz += (transfer->direct[li] >= 0 || istart[li] >= 0);
+  }
+  P4EST_VERBOSEF ("%lld of %lld local nodes are resolved by the"
+                  " transfer map\n", (long long) lz, (long long) nln);
+#endif
+
+  sc_array_destroy (iweights);
+  sc_array_destroy (inodes);
+  P4EST_FREE (icount);
+  P4EST_FREE (istart);
+
+  return transfer;
+}
+
+void
+p4est_lnodes_transfer_apply (p4est_lnodes_transfer_t * transfer,
+                             const double *old_values, double *new_values)
+{
+  p4est_locidx_t      li, lz;
+  double              sum;
+
+  for (li = 0; li < transfer->num_local_nodes; li++) {
+    if (transfer->direct[li] >= 0) {
+      new_values[li] = old_values[transfer->direct[li]];
+    }
+    else if (transfer->interp_offsets[li] < transfer->interp_offsets[li + 1]) {
+      sum = 0.;
+      for (lz = transfer->interp_offsets[li];
+           lz < transfer->interp_offsets[li + 1]; lz++) {
+        sum += transfer->interp_weights[lz] *
+          old_values[transfer->interp_nodes[lz]];
+      }
+      new_values[li] = sum;
+    }
+  }
+}
+
+void
+p4est_lnodes_transfer_destroy (p4est_lnodes_transfer_t * transfer)
+{
+  P4EST_FREE (transfer->direct);
+  P4EST_FREE (transfer->interp_offsets);
+  P4EST_FREE (transfer->interp_nodes);
+  P4EST_FREE (transfer->interp_weights);
+  P4EST_FREE (transfer);
+}
+
 void
 p4est_lnodes_destroy (p4est_lnodes_t * lnodes)
 {
@@ -3343,6 +4327,8 @@ p4est_lnodes_destroy (p4est_lnodes_t * lnodes)
   P4EST_FREE (lnodes->nonlocal_nodes);
   P4EST_FREE (lnodes->global_owned_count);
   P4EST_FREE (lnodes->face_code);
+  P4EST_FREE (lnodes->elem_trees);
+  P4EST_FREE (lnodes->elem_keys);
 
   count = lnodes->sharers->elem_count;
   for (zz = 0; zz < count; zz++) {
@@ -3602,3 +4588,302 @@ p4est_lnodes_buffer_destroy (p4est_lnodes_buffer_t * buffer)
   }
   P4EST_FREE (buffer);
 }
+
+/* Precomputed hanging-node interpolation operators, indexed by the
+ * face_code of an element.  The tables only depend on the degree and
+ * the one-dimensional reference node positions, so one object serves
+ * any number of forests and node numberings of that degree. */
+struct p4est_lnodes_weights
+{
+  int                 degree;   /* element degree as in p4est_lnodes_new */
+  int                 vnodes;   /* number of nodes per element */
+  int                 num_codes;        /* possible face_code values */
+  double             *points;   /* degree + 1 reference positions */
+  double             *interp[2];        /* full edge onto first/second half */
+  double            **tables;   /* one operator per face code, lazy */
+};
+
+/** Fill \a points with the degree + 1 Gauss--Lobatto--Legendre node
+ * positions mapped to [0, 1].  The interior points are the roots of
+ * P_degree', found by Newton iteration from a Chebyshev guess.
+ */
+static void
+p4est_lnodes_weights_lobatto (int degree, double *points)
+{
+  const int           n = degree;
+  int                 i, j, k;
+  double              x, dx, pm, pn, pp, d1, d2;
+
+  points[0] = 0.;
+  points[n] = 1.;
+  for (i = 1; i < n; i++) {
+    x = -cos (M_PI * (double) i / (double) n);
+    for (k = 0; k < 100; k++) {
+      pm = 1.;
+      pn = x;
+      for (j = 2; j <= n; j++) {
+        pp = ((2. * j - 1.) * x * pn - (j - 1.) * pm) / (double) j;
+        pm = pn;
+        pn = pp;
+      }
+      d1 = n * (x * pn - pm) / (x * x - 1.);
+      d2 = (2. * x * d1 - n * (n + 1.) * pn) / (1. - x * x);
+      dx = d1 / d2;
+      x -= dx;
+      if (fabs (dx) < 1e-15) {
+        break;
+      }
+    }
+    points[i] = .5 * (1. + x);
+  }
+}
+
+/** Evaluate the \a b-th Lagrange basis polynomial of the reference
+ * points at position \a x.
+ */
+static double
+p4est_lnodes_weights_lagrange (int degree, const double *points, int b,
+                               double x)
+{
+  int                 m;
+  double              w = 1.;
+
+  for (m = 0; m <= degree; m++) {
+    if (m != b) {
+      w *= (x - points[m]) / (points[b] - points[m]);
+    }
+  }
+  return w;
+}
+
+/** Lattice index of an element node; the x coordinate counts fastest
+ * as in the element_nodes layout.
+ */
+static int
+p4est_lnodes_weights_node (int degree, const int xyz[P4EST_DIM])
+{
+#ifndef P4_TO_P8
+  return xyz[1] * (degree + 1) + xyz[0];
+#else
+  return (xyz[2] * (degree + 1) + xyz[1]) * (degree + 1) + xyz[0];
+#endif
+}
+
+/** Assemble the element operator of one hanging configuration.
+ * Rows start out as unit rows; the rows of all nodes in the closure of
+ * a hanging face (or on a hanging half edge) are replaced by the
+ * tensorized one-dimensional interpolation from the coarse side.
+ */
+static void
+p4est_lnodes_weights_build (p4est_lnodes_weights_t * weights,
+                            p4est_lnodes_code_t face_code)
+{
+  const int           d = weights->degree;
+  const int           n = d + 1;
+  const int           vnodes = weights->vnodes;
+  int                 f, h, a, b, r, col;
+  int                 xyz[P4EST_DIM];
+  int                 hanging_face[P4EST_FACES];
+  double             *m;
+#ifdef P4_TO_P8
+  int                 e, axis, fc, h2, a2, b2, t1, t2;
+  int                 hanging_edge[P8EST_EDGES];
+#endif
+
+  P4EST_ASSERT (weights->tables[face_code] == NULL);
+  m = weights->tables[face_code] =
+    P4EST_ALLOC_ZERO (double, (size_t) vnodes * (size_t) vnodes);
+  for (r = 0; r < vnodes; r++) {
+    m[r * vnodes + r] = 1.;
+  }
+  if (!face_code) {
+    return;
+  }
+
+#ifndef P4_TO_P8
+  (void) p4est_lnodes_decode (face_code, hanging_face);
+  for (f = 0; f < P4EST_FACES; f++) {
+    if ((h = hanging_face[f]) < 0) {
+      continue;
+    }
+    for (a = 0; a < n; a++) {
+      xyz[f / 2] = (f & 1) ? d : 0;
+      xyz[1 - f / 2] = a;
+      r = p4est_lnodes_weights_node (d, xyz);
+      memset (m + (size_t) r * vnodes, 0, vnodes * sizeof (double));
+      for (b = 0; b < n; b++) {
+        xyz[1 - f / 2] = b;
+        col = p4est_lnodes_weights_node (d, xyz);
+        m[r * vnodes + col] = weights->interp[h][a * n + b];
+      }
+    }
+  }
+#else
+  (void) p8est_lnodes_decode (face_code, hanging_face, hanging_edge);
+
+  /* half edges first: edge codes 2, 3 and 4 lie in the closure of a
+   * hanging face and are rewritten by the face loop below */
+  for (e = 0; e < P8EST_EDGES; e++) {
+    if ((h = hanging_edge[e]) != 0 && h != 1) {
+      continue;
+    }
+    axis = e / 4;
+    t1 = (axis == 0) ? 1 : 0;
+    t2 = (axis == 2) ? 1 : 2;
+    for (a = 0; a < n; a++) {
+      xyz[t1] = (e & 1) ? d : 0;
+      xyz[t2] = (e & 2) ? d : 0;
+      xyz[axis] = a;
+      r = p4est_lnodes_weights_node (d, xyz);
+      memset (m + (size_t) r * vnodes, 0, vnodes * sizeof (double));
+      for (b = 0; b < n; b++) {
+        xyz[axis] = b;
+        col = p4est_lnodes_weights_node (d, xyz);
+        m[r * vnodes + col] = weights->interp[h][a * n + b];
+      }
+    }
+  }
+
+  for (f = 0; f < P8EST_FACES; f++) {
+    if ((fc = hanging_face[f]) < 0) {
+      continue;
+    }
+    h = fc & 1;
+    h2 = (fc >> 1) & 1;
+    t1 = (f / 2 == 0) ? 1 : 0;
+    t2 = (f / 2 == 2) ? 1 : 2;
+    xyz[f / 2] = (f & 1) ? d : 0;
+    for (a2 = 0; a2 < n; a2++) {
+      for (a = 0; a < n; a++) {
+        xyz[t1] = a;
+        xyz[t2] = a2;
+        r = p4est_lnodes_weights_node (d, xyz);
+        memset (m + (size_t) r * vnodes, 0, vnodes * sizeof (double));
+        for (b2 = 0; b2 < n; b2++) {
+          for (b = 0; b < n; b++) {
+            xyz[t1] = b;
+            xyz[t2] = b2;
+            col = p4est_lnodes_weights_node (d, xyz);
+            m[r * vnodes + col] =
+              weights->interp[h][a * n + b] *
+              weights->interp[h2][a2 * n + b2];
+          }
+        }
+      }
+    }
+  }
+#endif
+}
+
+p4est_lnodes_weights_t *
+p4est_lnodes_weights_new (int degree, const double *points)
+{
+  const int           n = degree + 1;
+  int                 h, a, b;
+  p4est_lnodes_weights_t *weights;
+
+  P4EST_ASSERT (degree >= 1);
+
+  weights = P4EST_ALLOC_ZERO (p4est_lnodes_weights_t, 1);
+  weights->degree = degree;
+#ifndef P4_TO_P8
+  weights->vnodes = n * n;
+  weights->num_codes = 1 << 4;  /* two corner bits and one per face */
+#else
+  weights->vnodes = n * n * n;
+  weights->num_codes = 1 << 9;  /* three corner, face and edge bits */
+#endif
+  weights->points = P4EST_ALLOC (double, n);
+  if (points != NULL) {
+    memcpy (weights->points, points, n * sizeof (double));
+  }
+  else {
+    p4est_lnodes_weights_lobatto (degree, weights->points);
+  }
+
+  /* one-dimensional interpolation from a full edge onto its halves */
+  for (h = 0; h < 2; h++) {
+    weights->interp[h] = P4EST_ALLOC (double, n * n);
+    for (a = 0; a < n; a++) {
+      for (b = 0; b < n; b++) {
+        weights->interp[h][a * n + b] =
+          p4est_lnodes_weights_lagrange (degree, weights->points, b,
+                                         .5 * (weights->points[a] + h));
+      }
+    }
+  }
+  weights->tables = P4EST_ALLOC_ZERO (double *, weights->num_codes);
+
+  return weights;
+}
+
+const double       *
+p4est_lnodes_weights_table (p4est_lnodes_weights_t * weights,
+                            p4est_lnodes_code_t face_code)
+{
+  P4EST_ASSERT (0 <= face_code && (int) face_code < weights->num_codes);
+
+  if (weights->tables[face_code] == NULL) {
+    p4est_lnodes_weights_build (weights, face_code);
+  }
+  return weights->tables[face_code];
+}
+
+void
+p4est_lnodes_weights_apply (p4est_lnodes_weights_t * weights,
+                            p4est_lnodes_t * lnodes,
+                            const double *node_values,
+                            double *element_values)
+{
+  const int           vnodes = weights->vnodes;
+  int                 k, r;
+  p4est_locidx_t      el;
+  const p4est_locidx_t *enodes;
+  const double       *m, *row;
+  double             *u, *out;
+  double              s;
+
+  P4EST_ASSERT (weights->degree == lnodes->degree);
+  P4EST_ASSERT (weights->vnodes == lnodes->vnodes);
+
+  u = P4EST_ALLOC (double, vnodes);
+  enodes = lnodes->element_nodes;
+  for (el = 0; el < lnodes->num_local_elements; el++, enodes += vnodes) {
+    out = element_values + (size_t) el * vnodes;
+    if (!lnodes->face_code[el]) {
+      /* conforming element: the gather is the result */
+      for (k = 0; k < vnodes; k++) {
+        out[k] = node_values[enodes[k]];
+      }
+      continue;
+    }
+    m = p4est_lnodes_weights_table (weights, lnodes->face_code[el]);
+    for (k = 0; k < vnodes; k++) {
+      u[k] = node_values[enodes[k]];
+    }
+    for (r = 0; r < vnodes; r++) {
+      row = m + (size_t) r * vnodes;
+      s = 0.;
+      for (k = 0; k < vnodes; k++) {
+        s += row[k] * u[k];
+      }
+      out[r] = s;
+    }
+  }
+  P4EST_FREE (u);
+}
+
+void
+p4est_lnodes_weights_destroy (p4est_lnodes_weights_t * weights)
+{
+  int                 i;
+
+  for (i = 0; i < weights->num_codes; i++) {
+    P4EST_FREE (weights->tables[i]);
+  }
+  P4EST_FREE (weights->tables);
+  P4EST_FREE (weights->interp[0]);
+  P4EST_FREE (weights->interp[1]);
+  P4EST_FREE (weights->points);
+  P4EST_FREE (weights);
+}
@@ -94,6 +94,12 @@ typedef struct p4est_lnodes
   p4est_locidx_t      num_local_elements;
   p4est_lnodes_code_t *face_code;
   p4est_locidx_t     *element_nodes;
+  p4est_topidx_t     *elem_trees;       /* tree of each local element */
+  uint64_t           *elem_keys;        /* Morton key of each local element:
+                                           together these identify the
+                                           elements that survive an
+                                           adaptation, see
+                                           p4est_lnodes_update */
 }
 p4est_lnodes_t;
 
@@ -161,8 +167,224 @@ p4est_lnodes_t     *p4est_lnodes_new (p4est_t * p4est,
                                       p4est_ghost_t * ghost_layer,
                                       int degree);
 
+/** As p4est_lnodes_new, but fills the element nodes and resolves the
+ * hanging nodes with \a num_threads POSIX threads.  The node numbering is
+ * identical to the one produced by p4est_lnodes_new; the parallel
+ * numbering exchange is not affected.  A \a num_threads of zero selects
+ * the hybrid execution width configured with p4est_set_num_threads.
+ * Without pthread support or if the resulting thread count is less than
+ * two the serial code runs.
+ */
+p4est_lnodes_t     *p4est_lnodes_new_threaded (p4est_t * p4est,
+                                               p4est_ghost_t * ghost_layer,
+                                               int degree, int num_threads);
+
+/** Transient storage for the split lnodes construction.
+ * Created by p4est_lnodes_new_begin and destroyed by
+ * p4est_lnodes_new_end; its contents are private.
+ */
+typedef struct p4est_lnodes_context p4est_lnodes_context_t;
+
+/** Start building a node numbering without waiting for its completion.
+ *
+ * This performs all local work of p4est_lnodes_new and posts the sends
+ * of the parallel numbering exchange.  On return the element_nodes of
+ * the embedded lnodes structure are complete as local indices and the
+ * locally owned nodes carry their final positions, so the caller may
+ * assemble rows for interior nodes while the messages are in flight.
+ * The global ids of shared nodes, the sharer lists, and the global
+ * counts are valid only after p4est_lnodes_new_end.  The forest must
+ * not be modified between begin and end.
+ *
+ * \param [in] p4est        The forest for which nodes are numbered.
+ * \param [in] ghost_layer  Full ghost layer of the forest.
+ * \param [in] degree       Element degree as in p4est_lnodes_new.
+ * \return  Returns a context to pass to p4est_lnodes_new_end.
+ */
+p4est_lnodes_context_t *p4est_lnodes_new_begin (p4est_t * p4est,
+                                                p4est_ghost_t * ghost_layer,
+                                                int degree);
+
+/** Finish the node numbering begun by p4est_lnodes_new_begin.
+ *
+ * Receives the remote node queries and replies, assigns the global ids
+ * of shared and hanging nodes and builds the sharer lists.  The result
+ * is identical to a plain p4est_lnodes_new.
+ *
+ * \param [in] ctx      created by p4est_lnodes_new_begin.
+ * \return              A fully initialized node numbering.
+ */
+p4est_lnodes_t     *p4est_lnodes_new_end (p4est_lnodes_context_t * ctx);
+
+/** Rebuild the node numbering after the forest has been adapted or
+ * repartitioned and report which nodes survive from a previous numbering.
+ *
+ * The numbering produced is identical to a fresh p4est_lnodes_new.  In
+ * addition, the local elements of \a old_lnodes are matched against the
+ * current forest: a node carries over if one of its local elements and
+ * that element's hanging status are unchanged.  This allows a solver to
+ * copy values and keep its matrix allocation in the regions the
+ * adaptation did not touch instead of starting from scratch.
+ *
+ * \param [in] old_lnodes   The numbering of the previous forest.  It is
+ *                          not modified; the caller still destroys it.
+ * \param [out] old_global  If not NULL, *old_global is set to an array of
+ *                          num_local_nodes entries holding the previous
+ *                          global number of each new local node, or -1
+ *                          for nodes that did not survive.  The caller
+ *                          releases it with P4EST_FREE.
+ * \return                  The freshly constructed node numbering.
+ */
+p4est_lnodes_t     *p4est_lnodes_update (p4est_t * p4est,
+                                         p4est_ghost_t * ghost_layer,
+                                         int degree,
+                                         p4est_lnodes_t * old_lnodes,
+                                         p4est_gloidx_t ** old_global);
+
+/** Compute the node-to-node adjacency of a numbering in CSR format.
+ *
+ * Two nodes are adjacent if they touch a common element; every node is
+ * adjacent to itself.  Hanging boundaries need no special treatment
+ * because element_nodes already references the coarse nodes there.  The
+ * column indices of each row are sorted and unique, so the result can be
+ * passed to a solver as its sparsity pattern directly.
+ *
+ * \param [in] lnodes   A node numbering created by p4est_lnodes_new.
+ * \param [out] rowptr  *rowptr is set to an array of num_local_nodes + 1
+ *                      row offsets allocated by P4EST_ALLOC.
+ * \param [out] cols    *cols is set to an array of rowptr[num_local_nodes]
+ *                      local node indices allocated by P4EST_ALLOC.
+ *                      The caller releases both with P4EST_FREE.
+ */
+void                p4est_lnodes_adjacency (p4est_lnodes_t * lnodes,
+                                            p4est_locidx_t ** rowptr,
+                                            p4est_locidx_t ** cols);
+
+/** A transfer map between the numberings before and after an adaptation.
+ *
+ * Each new local node is resolved in exactly one of three ways.  If
+ * \a direct is non-negative it is the old local node holding the same
+ * value.  Otherwise, if the node's row in the CSR arrays is non-empty,
+ * the new value is the weighted sum of the listed old local nodes; this
+ * happens where the forest was refined and a new vertex interpolates the
+ * coarse element it was created in.  A node whose direct entry is -1 and
+ * whose row is empty cannot be resolved from the local old elements.
+ */
+typedef struct p4est_lnodes_transfer
+{
+  p4est_locidx_t      num_local_nodes;  /* of the new numbering */
+  p4est_locidx_t     *direct;   /* old local node per new node, or -1 */
+  p4est_locidx_t     *interp_offsets;   /* num_local_nodes + 1 rows */
+  p4est_locidx_t     *interp_nodes;     /* old local node indices */
+  double             *interp_weights;
+}
+p4est_lnodes_transfer_t;
+
+/** Build the transfer map from an old numbering onto a new one.
+ *
+ * Both numberings must come from the same forest before and after
+ * refinement, coarsening, and balancing, in any combination, but before
+ * repartitioning, so that every new local element descends from or
+ * contains a local old element.  The map is computed in one merge pass
+ * over the recorded element keys (see p4est_lnodes_update) without
+ * communication or hashing; the keys determine which elements were
+ * refined and which were coarsened, so no separate record of the
+ * adaptation is needed.  Only degree 1 is supported.
+ *
+ * \param [in] old_lnodes  The numbering of the previous forest.
+ * \param [in] lnodes      The numbering of the adapted forest.
+ * \return                 The transfer map, to be released with
+ *                         p4est_lnodes_transfer_destroy.
+ */
+p4est_lnodes_transfer_t *p4est_lnodes_transfer_new (p4est_lnodes_t
+                                                    * old_lnodes,
+                                                    p4est_lnodes_t * lnodes);
+
+/** Move a vector of node values through a transfer map.
+ *
+ * Ghost entries of \a old_values must be current, e.g. by a preceding
+ * p4est_lnodes_share_owned, so that values on hanging boundaries
+ * interpolate correctly.  Entries of \a new_values whose node is not
+ * resolved by the map are left untouched.
+ *
+ * \param [in] transfer     A map built by p4est_lnodes_transfer_new.
+ * \param [in] old_values   One value per old local node.
+ * \param [in,out] new_values   One value per new local node.
+ */
+void                p4est_lnodes_transfer_apply (p4est_lnodes_transfer_t
+                                                 * transfer,
+                                                 const double *old_values,
+                                                 double *new_values);
+
+void                p4est_lnodes_transfer_destroy (p4est_lnodes_transfer_t
+                                                   * transfer);
+
 void                p4est_lnodes_destroy (p4est_lnodes_t * lnodes);
 
+/** Precomputed hanging-node interpolation operators indexed by face_code.
+ * Created by p4est_lnodes_weights_new and destroyed by
+ * p4est_lnodes_weights_destroy; its contents are private.
+ */
+typedef struct p4est_lnodes_weights p4est_lnodes_weights_t;
+
+/** Precompute the hanging-node interpolation weights for one degree.
+ *
+ * For every possible face_code value this provides a dense operator of
+ * dimension vnodes * vnodes that maps the values gathered through
+ * element_nodes to the values at the element's own node positions:
+ * rows of conforming nodes are unit rows, and rows of hanging nodes
+ * hold the Lagrange weights that interpolate the coarse face they are
+ * constrained to.  Resolving hanging nodes thus becomes a table lookup
+ * and a small dense multiply instead of a per-element decode of the
+ * hanging configuration.
+ *
+ * \param [in] degree   Element degree as in p4est_lnodes_new.
+ * \param [in] points   Positions of the degree + 1 one-dimensional
+ *                      reference nodes in [0, 1] in ascending order,
+ *                      or NULL for the Gauss--Lobatto--Legendre points
+ *                      matching the layout documented above.
+ * \return              The weight tables for this degree; they are
+ *                      independent of any particular forest.
+ */
+p4est_lnodes_weights_t *p4est_lnodes_weights_new (int degree,
+                                                  const double *points);
+
+/** Look up the interpolation operator of one hanging configuration.
+ * Operators are built on first use and cached, so only the face codes
+ * that occur in a mesh take up memory.
+ * \param [in,out] weights  Created by p4est_lnodes_weights_new.
+ * \param [in] face_code    As in the p4est_lnodes_t structure.
+ * \return                  The vnodes * vnodes row-major operator,
+ *                          owned by \a weights and valid until it is
+ *                          destroyed.
+ */
+const double       *p4est_lnodes_weights_table (p4est_lnodes_weights_t *
+                                                weights,
+                                                p4est_lnodes_code_t
+                                                face_code);
+
+/** Gather node values into element order, resolving hanging nodes.
+ * For each local element the values referenced by its element_nodes
+ * are gathered and multiplied by the operator of its face_code; the
+ * multiply is skipped for conforming elements.
+ * \param [in,out] weights  Created by p4est_lnodes_weights_new with
+ *                          the same degree as \a lnodes.
+ * \param [in] lnodes       A node numbering of that degree.
+ * \param [in] node_values  One value per local node; ghost entries
+ *                          must be current, e.g. by a preceding
+ *                          p4est_lnodes_share_owned.
+ * \param [out] element_values  Filled with vnodes values per local
+ *                          element in lattice order.
+ */
+void                p4est_lnodes_weights_apply (p4est_lnodes_weights_t *
+                                                weights,
+                                                p4est_lnodes_t * lnodes,
+                                                const double *node_values,
+                                                double *element_values);
+
+void                p4est_lnodes_weights_destroy (p4est_lnodes_weights_t *
+                                                  weights);
+
 /** p4est_lnodes_buffer_t handles the communication of data associated with
  * nodes.
  *
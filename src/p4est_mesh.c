@@ -22,10 +22,12 @@
 */
 
 #ifndef P4_TO_P8
+#include <p4est_bits.h>
 #include <p4est_iterate.h>
 #include <p4est_mesh.h>
 #include <p4est_nodes.h>
 #else
+#include <p8est_bits.h>
 #include <p8est_iterate.h>
 #include <p8est_mesh.h>
 #include <p8est_nodes.h>
@@ -179,23 +181,28 @@ p4est_mesh_memory_used (p4est_mesh_t * mesh)
   return sizeof (p4est_mesh_t) +
     ((P4EST_CHILDREN + P4EST_FACES) * lqz + ngz) * sizeof (p4est_locidx_t) +
     ngz * sizeof (int) + (P4EST_FACES * lqz) * sizeof (int8_t) +
+    (lqz + ngz) * (sizeof (p4est_topidx_t) + sizeof (uint64_t)) +
+    ((mesh->quad_to_arena != NULL) ? lqz * sizeof (p4est_locidx_t) : 0) +
     3 * (size_t) mesh->local_num_vertices * sizeof (double) +
     sc_array_memory_used (mesh->quad_to_half, 1);
 }
 
-p4est_mesh_t       *
-p4est_mesh_new (p4est_t * p4est, p4est_ghost_t * ghost,
-                p4est_connect_type_t btype)
+/** Allocate a mesh and fill everything that does not require neighbor
+ * information: the ghost maps, the quadrant identification used by
+ * p4est_mesh_update, and the default values of the neighbor arrays. */
+static p4est_mesh_t *
+p4est_mesh_allocate (p4est_t * p4est, p4est_ghost_t * ghost)
 {
   int                 rank;
-  size_t              ncz, zz;
+  size_t              zz;
+  char               *data;
+  p4est_topidx_t      jt;
   p4est_locidx_t      lq, ng;
-  p4est_locidx_t      jl;
+  p4est_locidx_t      jl, abase;
   p4est_mesh_t       *mesh;
-  p4est_nodes_t      *nodes;
+  p4est_tree_t       *tree;
   p4est_quadrant_t   *quad;
-
-  P4EST_ASSERT (p4est_is_balanced (p4est, P4EST_CONNECT_FULL));
+  sc_array_t         *block;
 
   mesh = P4EST_ALLOC (p4est_mesh_t, 1);
 
@@ -211,6 +218,46 @@ p4est_mesh_new (p4est_t * p4est, p4est_ghost_t * ghost,
   mesh->quad_to_face = P4EST_ALLOC (int8_t, P4EST_FACES * lq);
   mesh->quad_to_half = sc_array_new (P4EST_HALF * sizeof (p4est_locidx_t));
 
+  mesh->revision = p4est->revision;
+  mesh->quad_trees = P4EST_ALLOC (p4est_topidx_t, lq);
+  mesh->quad_keys = P4EST_ALLOC (uint64_t, lq);
+  mesh->ghost_trees = P4EST_ALLOC (p4est_topidx_t, ng);
+  mesh->ghost_keys = P4EST_ALLOC (uint64_t, ng);
+  mesh->quad_to_arena = (p4est->user_data_arena != NULL) ?
+    P4EST_ALLOC (p4est_locidx_t, lq) : NULL;
+
+  /* Record the tree and Morton key of every local quadrant, and its
+   * arena slot if the user data lives in a compacted arena */
+  abase = 0;
+  for (jt = p4est->first_local_tree; jt <= p4est->last_local_tree; ++jt) {
+    tree = p4est_tree_array_index (p4est->trees, jt);
+    block = (p4est->user_data_arena != NULL) ? (sc_array_t *)
+      sc_array_index (p4est->user_data_arena, (size_t) jt) : NULL;
+    for (zz = 0; zz < tree->quadrants.elem_count; ++zz) {
+      quad = p4est_quadrant_array_index (&tree->quadrants, zz);
+      jl = tree->quadrants_offset + (p4est_locidx_t) zz;
+      mesh->quad_trees[jl] = jt;
+      mesh->quad_keys[jl] = p4est_quadrant_morton_key (quad);
+      if (block != NULL) {
+        data = (char *) quad->p.user_data;
+        if (data >= block->array &&
+            data < block->array + block->elem_count * p4est->data_size) {
+          /* quadrants created since the last compaction still draw
+           * their data from the memory pool and have no slot */
+          mesh->quad_to_arena[jl] = abase +
+            (p4est_locidx_t) ((data - block->array) / p4est->data_size);
+        }
+        else {
+          mesh->quad_to_arena[jl] = -1;
+        }
+      }
+    }
+    if (block != NULL) {
+      abase += (p4est_locidx_t) block->elem_count;
+    }
+  }
+  mesh->local_arena_slots = abase;
+
   /* Populate ghost information */
   rank = 0;
   for (jl = 0; jl < ng; ++jl) {
@@ -221,20 +268,26 @@ p4est_mesh_new (p4est_t * p4est, p4est_ghost_t * ghost,
     quad = p4est_quadrant_array_index (&ghost->ghosts, (size_t) jl);
     mesh->ghost_to_proc[jl] = rank;
     mesh->ghost_to_index[jl] = quad->p.piggy3.local_num;
+    mesh->ghost_trees[jl] = quad->p.piggy3.which_tree;
+    mesh->ghost_keys[jl] = p4est_quadrant_morton_key (quad);
   }
 
   /* Fill arrays with default values */
   memset (mesh->quad_to_quad, -1, P4EST_FACES * lq * sizeof (p4est_locidx_t));
   memset (mesh->quad_to_face, -25, P4EST_FACES * lq * sizeof (int8_t));
 
-  /* Call the forest iterator to collect face connectivity */
-  p4est_iterate (p4est, ghost, mesh, NULL, mesh_iter_face,
-#ifdef P4_TO_P8
-                 NULL,
-#endif
-                 NULL);
+  return mesh;
+}
+
+/** Construct non-unique vertex information if vertices are present. */
+static void
+p4est_mesh_vertex_info (p4est_t * p4est, p4est_mesh_t * mesh)
+{
+  size_t              ncz, zz;
+  p4est_locidx_t      lq = mesh->local_num_quadrants;
+  p4est_nodes_t      *nodes;
+  p4est_quadrant_t   *quad;
 
-  /* Construct non-unique vertex information if vertices are present */
   if (p4est->connectivity->num_vertices > 0) {
     P4EST_ASSERT (p4est->connectivity->vertices != NULL);
     nodes = p4est_nodes_new (p4est, NULL);      /* fast local version */
@@ -265,10 +318,523 @@ p4est_mesh_new (p4est_t * p4est, p4est_ghost_t * ghost,
     memset (mesh->quad_to_vertex, -1,
             P4EST_CHILDREN * lq * sizeof (p4est_locidx_t));
   }
+}
+
+p4est_mesh_t       *
+p4est_mesh_new (p4est_t * p4est, p4est_ghost_t * ghost,
+                p4est_connect_type_t btype)
+{
+  p4est_mesh_t       *mesh;
+
+  P4EST_ASSERT (p4est_is_balanced (p4est, P4EST_CONNECT_FULL));
+
+  mesh = p4est_mesh_allocate (p4est, ghost);
+
+  /* Call the forest iterator to collect face connectivity */
+  p4est_iterate (p4est, ghost, mesh, NULL, mesh_iter_face,
+#ifdef P4_TO_P8
+                 NULL,
+#endif
+                 NULL);
+
+  p4est_mesh_vertex_info (p4est, mesh);
+
+  return mesh;
+}
+
+/** Match two sequences of quadrants identified by tree and Morton key.
+ * Both sequences must be strictly ascending in (tree, key) order, which
+ * holds for the local quadrants and for the ghost layer alike.  Fills
+ * \a o2n and \a n2o with the index of the identical partner quadrant in
+ * the other sequence, or -1 where there is none. */
+static void
+p4est_mesh_match_keys (const p4est_topidx_t * ot, const uint64_t * ok,
+                       p4est_locidx_t no, const p4est_topidx_t * nt,
+                       const uint64_t * nk, p4est_locidx_t nn,
+                       p4est_locidx_t * o2n, p4est_locidx_t * n2o)
+{
+  p4est_locidx_t      io, in;
+
+  io = in = 0;
+  while (io < no && in < nn) {
+    if (ot[io] < nt[in] || (ot[io] == nt[in] && ok[io] < nk[in])) {
+      o2n[io++] = -1;
+    }
+    else if (nt[in] < ot[io] || (nt[in] == ot[io] && nk[in] < ok[io])) {
+      n2o[in++] = -1;
+    }
+    else {
+      o2n[io] = in;
+      n2o[in] = io;
+      ++io;
+      ++in;
+    }
+  }
+  while (io < no) {
+    o2n[io++] = -1;
+  }
+  while (in < nn) {
+    n2o[in++] = -1;
+  }
+}
+
+/** Find a quadrant in the local storage or in the ghost layer.
+ * \return          A value suitable for quad_to_quad, or -1 if the
+ *                  quadrant is neither local nor a ghost. */
+static p4est_locidx_t
+p4est_mesh_update_find (p4est_t * p4est, p4est_ghost_t * ghost,
+                        p4est_topidx_t nt, const p4est_quadrant_t * q)
+{
+  ssize_t             pos;
+  p4est_tree_t       *tree;
+
+  if (nt >= p4est->first_local_tree && nt <= p4est->last_local_tree) {
+    tree = p4est_tree_array_index (p4est->trees, nt);
+    pos = sc_array_bsearch (&tree->quadrants, q, p4est_quadrant_compare);
+    if (pos >= 0) {
+      return tree->quadrants_offset + (p4est_locidx_t) pos;
+    }
+  }
+  pos = p4est_ghost_bsearch (ghost, -1, nt, q);
+  if (pos >= 0) {
+    return p4est->local_num_quadrants + (p4est_locidx_t) pos;
+  }
+  return -1;
+}
+
+/** Recompute the neighbor information across one face of a local quadrant.
+ * Since the forest is 2:1 balanced, the neighbor is a same-size quadrant,
+ * a double-size quadrant, or P4EST_HALF half-size quadrants, and all of
+ * them are either local or contained in the ghost layer. */
+static void
+p4est_mesh_update_face (p4est_t * p4est, p4est_ghost_t * ghost,
+                        p4est_mesh_t * mesh, p4est_topidx_t jt,
+                        const p4est_quadrant_t * q, p4est_locidx_t jl, int f)
+{
+  int                 h, nf, o;
+  int                 ftransform[9];
+  p4est_topidx_t      nt;
+  int                 ttf;
+  p4est_locidx_t      jl2, jls[P4EST_HALF];
+  p4est_locidx_t      in_qtoq, halfindex;
+  p4est_locidx_t     *halfentries;
+  p4est_quadrant_t    tmp, nq, nc;
+  p4est_connectivity_t *conn = p4est->connectivity;
+
+  in_qtoq = P4EST_FACES * jl + f;
+  p4est_quadrant_face_neighbor (q, f, &tmp);
+  if (p4est_quadrant_is_inside_root (&tmp)) {
+    nt = jt;
+    nf = f ^ 1;
+    o = 0;
+    nq = tmp;
+  }
+  else {
+    nt = p4est_find_face_transform (conn, jt, f, ftransform);
+    if (nt == -1) {
+      /* this face is on an outside boundary of the forest */
+      mesh->quad_to_quad[in_qtoq] = jl;
+      mesh->quad_to_face[in_qtoq] = (int8_t) f;
+      return;
+    }
+    ttf = (int) conn->tree_to_face[P4EST_FACES * jt + f];
+    nf = ttf % P4EST_FACES;
+    o = ttf / P4EST_FACES;
+    p4est_quadrant_transform_face (&tmp, &nq, ftransform);
+  }
+
+  /* look for a same-size neighbor first */
+  jl2 = p4est_mesh_update_find (p4est, ghost, nt, &nq);
+  if (jl2 >= 0) {
+    mesh->quad_to_quad[in_qtoq] = jl2;
+    mesh->quad_to_face[in_qtoq] = (int8_t) (P4EST_FACES * o + nf);
+    return;
+  }
+
+  /* then for a double-size neighbor, which sees this quadrant hanging */
+  if (q->level > 0) {
+    p4est_quadrant_parent (&nq, &tmp);
+    jl2 = p4est_mesh_update_find (p4est, ghost, nt, &tmp);
+    if (jl2 >= 0) {
+      /* the subface index is this quadrant's position among the hanging
+       * quadrants of the face, which are siblings listed in z-order */
+      for (h = 0; h < P4EST_HALF; ++h) {
+        if (p4est_face_corners[f][h] == p4est_quadrant_child_id (q)) {
+          break;
+        }
+      }
+      P4EST_ASSERT (h < P4EST_HALF);
+      mesh->quad_to_quad[in_qtoq] = jl2;
+      mesh->quad_to_face[in_qtoq] =
+        (int8_t) (P4EST_FACES * (o + (h + 1) * P4EST_HALF) + nf);
+      return;
+    }
+  }
+
+  /* by balance the remaining possibility is half-size neighbors: the
+   * children of \a nq touching the shared face, in neighbor tree z-order */
+  P4EST_ASSERT (q->level < P4EST_QMAXLEVEL);
+  p4est_quadrant_first_descendant (&nq, &tmp, (int) nq.level + 1);
+  for (h = 0; h < P4EST_HALF; ++h) {
+    p4est_quadrant_sibling (&tmp, &nc, p4est_face_corners[nf][h]);
+    jls[h] = p4est_mesh_update_find (p4est, ghost, nt, &nc);
+    P4EST_ASSERT (jls[h] >= 0);
+  }
+  halfindex = (p4est_locidx_t) mesh->quad_to_half->elem_count;
+  halfentries = (p4est_locidx_t *) sc_array_push (mesh->quad_to_half);
+  for (h = 0; h < P4EST_HALF; ++h) {
+    halfentries[h] = jls[h];
+  }
+  mesh->quad_to_quad[in_qtoq] = halfindex;
+  mesh->quad_to_face[in_qtoq] =
+    (int8_t) (P4EST_FACES * (o - P4EST_HALF) + nf);
+}
+
+p4est_mesh_t       *
+p4est_mesh_update (p4est_t * p4est, p4est_ghost_t * ghost,
+                   p4est_connect_type_t btype, p4est_mesh_t * old_mesh)
+{
+  int                 f, h;
+  int                 translated;
+  int8_t              code;
+  size_t              zz;
+  p4est_topidx_t      jt;
+  p4est_locidx_t      lq, lq_old, ng_old;
+  p4est_locidx_t      jl, jl2, old_jl, e;
+  p4est_locidx_t     *old_to_new, *new_to_old, *ghost_old_to_new;
+  p4est_locidx_t     *ghost_new_to_old;
+  p4est_locidx_t     *halfentries, jls[P4EST_HALF];
+  p4est_locidx_t      halfindex;
+  p4est_locidx_t      kept;
+  p4est_mesh_t       *mesh;
+  p4est_tree_t       *tree;
+  p4est_quadrant_t   *quad;
+
+  P4EST_ASSERT (p4est_is_balanced (p4est, P4EST_CONNECT_FULL));
+  P4EST_ASSERT (old_mesh != NULL);
+
+  mesh = p4est_mesh_allocate (p4est, ghost);
+  lq = mesh->local_num_quadrants;
+  lq_old = old_mesh->local_num_quadrants;
+  ng_old = old_mesh->ghost_num_quadrants;
+
+  /* match the old mesh's quadrants and ghosts against the new ones */
+  old_to_new = P4EST_ALLOC (p4est_locidx_t, lq_old);
+  new_to_old = P4EST_ALLOC (p4est_locidx_t, lq);
+  p4est_mesh_match_keys (old_mesh->quad_trees, old_mesh->quad_keys, lq_old,
+                         mesh->quad_trees, mesh->quad_keys, lq,
+                         old_to_new, new_to_old);
+  ghost_old_to_new = P4EST_ALLOC (p4est_locidx_t, ng_old);
+  ghost_new_to_old = P4EST_ALLOC (p4est_locidx_t, mesh->ghost_num_quadrants);
+  p4est_mesh_match_keys (old_mesh->ghost_trees, old_mesh->ghost_keys, ng_old,
+                         mesh->ghost_trees, mesh->ghost_keys,
+                         mesh->ghost_num_quadrants,
+                         ghost_old_to_new, ghost_new_to_old);
+
+  /* translate every surviving row of the neighbor arrays and recompute
+   * the faces whose old neighborhood did not survive unchanged */
+  kept = 0;
+  for (jt = p4est->first_local_tree; jt <= p4est->last_local_tree; ++jt) {
+    tree = p4est_tree_array_index (p4est->trees, jt);
+    for (zz = 0; zz < tree->quadrants.elem_count; ++zz) {
+      quad = p4est_quadrant_array_index (&tree->quadrants, zz);
+      jl = tree->quadrants_offset + (p4est_locidx_t) zz;
+      old_jl = new_to_old[jl];
+      for (f = 0; f < P4EST_FACES; ++f) {
+        translated = 0;
+        if (old_jl >= 0) {
+          e = old_mesh->quad_to_quad[P4EST_FACES * old_jl + f];
+          code = old_mesh->quad_to_face[P4EST_FACES * old_jl + f];
+          if (code >= 0) {
+            /* boundary, same-size, or double-size: one referenced quadrant */
+            jl2 = (e < lq_old) ? old_to_new[e] :
+              ((ghost_old_to_new[e - lq_old] >= 0) ?
+               lq + ghost_old_to_new[e - lq_old] : -1);
+            if (jl2 >= 0) {
+              mesh->quad_to_quad[P4EST_FACES * jl + f] = jl2;
+              mesh->quad_to_face[P4EST_FACES * jl + f] = code;
+              translated = 1;
+            }
+          }
+          else {
+            /* half-size neighbors: all entries of the half row must map */
+            halfentries = (p4est_locidx_t *)
+              sc_array_index (old_mesh->quad_to_half, (size_t) e);
+            for (h = 0; h < P4EST_HALF; ++h) {
+              e = halfentries[h];
+              jls[h] = (e < lq_old) ? old_to_new[e] :
+                ((ghost_old_to_new[e - lq_old] >= 0) ?
+                 lq + ghost_old_to_new[e - lq_old] : -1);
+              if (jls[h] < 0) {
+                break;
+              }
+            }
+            if (h == P4EST_HALF) {
+              halfindex = (p4est_locidx_t) mesh->quad_to_half->elem_count;
+              halfentries = (p4est_locidx_t *)
+                sc_array_push (mesh->quad_to_half);
+              for (h = 0; h < P4EST_HALF; ++h) {
+                halfentries[h] = jls[h];
+              }
+              mesh->quad_to_quad[P4EST_FACES * jl + f] = halfindex;
+              mesh->quad_to_face[P4EST_FACES * jl + f] = code;
+              translated = 1;
+            }
+          }
+        }
+        if (translated) {
+          ++kept;
+        }
+        else {
+          p4est_mesh_update_face (p4est, ghost, mesh, jt, quad, jl, f);
+        }
+      }
+    }
+  }
+  P4EST_VERBOSEF ("Mesh update reused %lld of %lld face entries\n",
+                  (long long) kept,
+                  (long long) P4EST_FACES * (long long) lq);
+
+  P4EST_FREE (old_to_new);
+  P4EST_FREE (new_to_old);
+  P4EST_FREE (ghost_old_to_new);
+  P4EST_FREE (ghost_new_to_old);
+
+  p4est_mesh_vertex_info (p4est, mesh);
 
   return mesh;
 }
 
+void
+p4est_mesh_flatten (p4est_mesh_t * mesh,
+                    p4est_locidx_t ** flat_to_quad, int8_t ** flat_to_face)
+{
+  int                 f, h;
+  int8_t              code;
+  p4est_locidx_t      lq, jl, e;
+  p4est_locidx_t     *ftq, *halfentries;
+  int8_t             *ftf;
+
+  P4EST_ASSERT (flat_to_quad != NULL && flat_to_face != NULL);
+
+  lq = mesh->local_num_quadrants;
+  ftq = *flat_to_quad =
+    P4EST_ALLOC (p4est_locidx_t, P4EST_FACES * P4EST_HALF * lq);
+  ftf = *flat_to_face = P4EST_ALLOC (int8_t, P4EST_FACES * P4EST_HALF * lq);
+
+  /* initialize all slots as unused */
+  memset (ftq, -1, P4EST_FACES * P4EST_HALF * lq * sizeof (p4est_locidx_t));
+  memset (ftf, -25, P4EST_FACES * P4EST_HALF * lq * sizeof (int8_t));
+
+  /* each slice of length \a lq holds one neighbor slot of one face */
+  for (jl = 0; jl < lq; ++jl) {
+    for (f = 0; f < P4EST_FACES; ++f) {
+      e = mesh->quad_to_quad[P4EST_FACES * jl + f];
+      code = mesh->quad_to_face[P4EST_FACES * jl + f];
+      if (code >= 0) {
+        /* boundary, same-size, or double-size: a single neighbor */
+        ftq[(f * P4EST_HALF + 0) * lq + jl] = e;
+        ftf[(f * P4EST_HALF + 0) * lq + jl] = code;
+      }
+      else {
+        /* half-size neighbors occupy all slots of this face */
+        halfentries = (p4est_locidx_t *)
+          sc_array_index (mesh->quad_to_half, (size_t) e);
+        for (h = 0; h < P4EST_HALF; ++h) {
+          ftq[(f * P4EST_HALF + h) * lq + jl] = halfentries[h];
+          ftf[(f * P4EST_HALF + h) * lq + jl] = code;
+        }
+      }
+    }
+  }
+}
+
+void
+p4est_mesh_gather_slots (p4est_mesh_t * mesh, p4est_locidx_t ** gather_slots)
+{
+  int                 f, h;
+  int8_t              code;
+  p4est_locidx_t      lq, base, jl, e, s;
+  p4est_locidx_t     *gs, *halfentries;
+
+  P4EST_ASSERT (gather_slots != NULL);
+
+  lq = mesh->local_num_quadrants;
+  base = (mesh->quad_to_arena != NULL) ? mesh->local_arena_slots : lq;
+  gs = *gather_slots =
+    P4EST_ALLOC (p4est_locidx_t, P4EST_FACES * P4EST_HALF * lq);
+
+  /* each slice of length \a lq holds one neighbor slot of one face, so a
+   * kernel can gather every slice with unit-stride index vectors and no
+   * branching on the 2:1 status of the face */
+  for (jl = 0; jl < lq; ++jl) {
+    for (f = 0; f < P4EST_FACES; ++f) {
+      e = mesh->quad_to_quad[P4EST_FACES * jl + f];
+      code = mesh->quad_to_face[P4EST_FACES * jl + f];
+      if (code >= 0) {
+        /* boundary, same-size, or double-size: replicate the single
+         * neighbor (or the quadrant itself on the boundary) into all
+         * slots of this face */
+        s = (e < lq) ?
+          ((mesh->quad_to_arena != NULL) ? mesh->quad_to_arena[e] : e) :
+          base + (e - lq);
+        for (h = 0; h < P4EST_HALF; ++h) {
+          gs[(f * P4EST_HALF + h) * lq + jl] = s;
+        }
+      }
+      else {
+        /* half-size neighbors occupy one slot each */
+        halfentries = (p4est_locidx_t *)
+          sc_array_index (mesh->quad_to_half, (size_t) e);
+        for (h = 0; h < P4EST_HALF; ++h) {
+          e = halfentries[h];
+          gs[(f * P4EST_HALF + h) * lq + jl] = (e < lq) ?
+            ((mesh->quad_to_arena != NULL) ? mesh->quad_to_arena[e] : e) :
+            base + (e - lq);
+        }
+      }
+    }
+  }
+}
+
+/* runs of changed bytes separated by fewer equal bytes than this are
+ * fused so every upload amortizes its launch latency */
+#define P4EST_MESH_MIRROR_GAP   256
+
+/** Upload the byte ranges where \a fresh differs from \a shadow.
+ * The shadow is patched along the way so it matches the device again.
+ * \return              The number of bytes handed to the callback.
+ */
+static size_t
+p4est_mesh_mirror_ranges (p4est_mesh_mirror_t * mirror, void *device_array,
+                          char *shadow, const char *fresh, size_t num_bytes)
+{
+  size_t              pos, end, scan;
+  size_t              uploaded;
+
+  uploaded = 0;
+  pos = 0;
+  while (pos < num_bytes) {
+    if (shadow[pos] == fresh[pos]) {
+      ++pos;
+      continue;
+    }
+    /* extend the run past gaps smaller than the fuse distance */
+    end = pos + 1;
+    for (scan = end; scan < num_bytes &&
+         scan - end < P4EST_MESH_MIRROR_GAP; ++scan) {
+      if (shadow[scan] != fresh[scan]) {
+        end = scan + 1;
+      }
+    }
+    mirror->copy_fn (device_array, pos, fresh + pos, end - pos,
+                     mirror->user);
+    memcpy (shadow + pos, fresh + pos, end - pos);
+    uploaded += end - pos;
+    pos = end;
+  }
+
+  return uploaded;
+}
+
+p4est_mesh_mirror_t *
+p4est_mesh_mirror_new (p4est_t * p4est, p4est_mesh_mirror_copy_t copy_fn,
+                       void *user)
+{
+  p4est_mesh_mirror_t *mirror;
+
+  mirror = P4EST_ALLOC_ZERO (p4est_mesh_mirror_t, 1);
+  mirror->p4est = p4est;
+  mirror->copy_fn = copy_fn;
+  mirror->user = user;
+  mirror->revision = -1;
+
+  return mirror;
+}
+
+size_t
+p4est_mesh_mirror_sync (p4est_mesh_mirror_t * mirror, p4est_mesh_t * mesh,
+                        p4est_ghost_t * ghost, void *d_quad_to_quad,
+                        void *d_quad_to_face, void *d_proc_offsets)
+{
+  p4est_t            *p4est = mirror->p4est;
+  const size_t        qtq_bytes = P4EST_FACES *
+    (size_t) mesh->local_num_quadrants * sizeof (p4est_locidx_t);
+  const size_t        qtf_bytes = P4EST_FACES *
+    (size_t) mesh->local_num_quadrants * sizeof (int8_t);
+  const size_t        po_bytes =
+    (p4est->mpisize + 1) * sizeof (p4est_locidx_t);
+  size_t              uploaded;
+
+  P4EST_ASSERT (mesh->local_num_quadrants == p4est->local_num_quadrants);
+  P4EST_ASSERT (mesh->ghost_num_quadrants ==
+                (p4est_locidx_t) ghost->ghosts.elem_count);
+
+  if (mirror->revision == p4est->revision &&
+      mirror->quad_to_quad != NULL &&
+      mirror->ghost_num_quadrants == mesh->ghost_num_quadrants) {
+    /* the forest has not changed since the last sync */
+    return 0;
+  }
+
+  if (mirror->quad_to_quad == NULL ||
+      mirror->local_num_quadrants != mesh->local_num_quadrants) {
+    /* the device buffers have been (re)allocated: upload everything */
+    P4EST_FREE (mirror->quad_to_quad);
+    P4EST_FREE (mirror->quad_to_face);
+    if (mirror->proc_offsets == NULL) {
+      mirror->proc_offsets = P4EST_ALLOC (p4est_locidx_t,
+                                          p4est->mpisize + 1);
+    }
+    mirror->quad_to_quad = P4EST_ALLOC (p4est_locidx_t, P4EST_FACES *
+                                        (size_t)
+                                        mesh->local_num_quadrants);
+    mirror->quad_to_face = P4EST_ALLOC (int8_t, P4EST_FACES * (size_t)
+                                        mesh->local_num_quadrants);
+    memcpy (mirror->quad_to_quad, mesh->quad_to_quad, qtq_bytes);
+    memcpy (mirror->quad_to_face, mesh->quad_to_face, qtf_bytes);
+    memcpy (mirror->proc_offsets, ghost->proc_offsets, po_bytes);
+    mirror->copy_fn (d_quad_to_quad, 0, mirror->quad_to_quad, qtq_bytes,
+                     mirror->user);
+    mirror->copy_fn (d_quad_to_face, 0, mirror->quad_to_face, qtf_bytes,
+                     mirror->user);
+    mirror->copy_fn (d_proc_offsets, 0, mirror->proc_offsets, po_bytes,
+                     mirror->user);
+    uploaded = qtq_bytes + qtf_bytes + po_bytes;
+  }
+  else {
+    /* same shape: upload only the ranges that actually changed */
+    uploaded =
+      p4est_mesh_mirror_ranges (mirror, d_quad_to_quad,
+                                (char *) mirror->quad_to_quad,
+                                (const char *) mesh->quad_to_quad,
+                                qtq_bytes) +
+      p4est_mesh_mirror_ranges (mirror, d_quad_to_face,
+                                (char *) mirror->quad_to_face,
+                                (const char *) mesh->quad_to_face,
+                                qtf_bytes) +
+      p4est_mesh_mirror_ranges (mirror, d_proc_offsets,
+                                (char *) mirror->proc_offsets,
+                                (const char *) ghost->proc_offsets,
+                                po_bytes);
+  }
+
+  mirror->local_num_quadrants = mesh->local_num_quadrants;
+  mirror->ghost_num_quadrants = mesh->ghost_num_quadrants;
+  mirror->revision = p4est->revision;
+
+  return uploaded;
+}
+
+void
+p4est_mesh_mirror_destroy (p4est_mesh_mirror_t * mirror)
+{
+  P4EST_FREE (mirror->quad_to_quad);
+  P4EST_FREE (mirror->quad_to_face);
+  P4EST_FREE (mirror->proc_offsets);
+  P4EST_FREE (mirror);
+}
+
 void
 p4est_mesh_destroy (p4est_mesh_t * mesh)
 {
@@ -278,7 +844,12 @@ p4est_mesh_destroy (p4est_mesh_t * mesh)
   P4EST_FREE (mesh->ghost_to_index);
   P4EST_FREE (mesh->quad_to_quad);
   P4EST_FREE (mesh->quad_to_face);
+  P4EST_FREE (mesh->quad_to_arena);
   sc_array_destroy (mesh->quad_to_half);
+  P4EST_FREE (mesh->quad_trees);
+  P4EST_FREE (mesh->quad_keys);
+  P4EST_FREE (mesh->ghost_trees);
+  P4EST_FREE (mesh->ghost_keys);
   P4EST_FREE (mesh);
 }
 
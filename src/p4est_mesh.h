@@ -71,6 +71,22 @@ typedef struct
   p4est_locidx_t     *quad_to_quad;     /* 1 index for each of the 4 faces */
   int8_t             *quad_to_face;     /* encodes orientation/2:1 status */
   sc_array_t         *quad_to_half;     /* stores half-size neigbors */
+
+  /* arena slot of each local quadrant, counted across the local trees,
+   * when the user data lives in an arena from p4est_compact_data or
+   * p4est_compact_data_blocked; -1 for data still in the memory pool.
+   * NULL when no arena is active. */
+  p4est_locidx_t     *quad_to_arena;
+  p4est_locidx_t      local_arena_slots;        /* slots in all local trees'
+                                                   arenas including padding;
+                                                   0 without an arena */
+
+  /* identification of the underlying quadrants for p4est_mesh_update */
+  long                revision;         /* forest revision at creation */
+  p4est_topidx_t     *quad_trees;       /* tree of each local quadrant */
+  uint64_t           *quad_keys;        /* Morton key of each local quadrant */
+  p4est_topidx_t     *ghost_trees;      /* tree of each ghost quadrant */
+  uint64_t           *ghost_keys;       /* Morton key of each ghost quadrant */
 }
 p4est_mesh_t;
 
@@ -95,6 +111,45 @@ typedef struct
 }
 p4est_mesh_face_neighbor_t;
 
+/** Callback copying one changed byte range into a device buffer.
+ * It typically wraps cudaMemcpy, hipMemcpy, or an equivalent, so the
+ * library itself stays free of any device runtime dependency.
+ * \param [in] device_array Opaque device buffer as passed to
+ *                          p4est_mesh_mirror_sync.
+ * \param [in] offset       Byte offset of the range inside the buffer.
+ * \param [in] host_data    The \a num_bytes bytes to be copied.
+ * \param [in] num_bytes    Length of the range in bytes.
+ * \param [in] user         Passed through from the mirror.
+ */
+typedef void        (*p4est_mesh_mirror_copy_t) (void *device_array,
+                                                 size_t offset,
+                                                 const void *host_data,
+                                                 size_t num_bytes,
+                                                 void *user);
+
+/** Tracks a device-side copy of the mesh neighbor arrays.
+ * The mirror keeps a host shadow of what the device currently holds,
+ * keyed to the forest revision; synchronizing after an adaptation
+ * diffs the new arrays against the shadow and hands only the changed
+ * byte ranges to the copy callback.
+ */
+typedef struct p4est_mesh_mirror
+{
+  p4est_t            *p4est;    /**< the forest, not owned */
+  p4est_mesh_mirror_copy_t copy_fn;     /**< uploads one byte range */
+  void               *user;     /**< passed to \a copy_fn */
+  long                revision; /**< forest revision of the shadow,
+                                     -1 before the first sync */
+
+  /* host shadow of the device buffer contents */
+  p4est_locidx_t      local_num_quadrants;      /**< rows in the shadow */
+  p4est_locidx_t      ghost_num_quadrants;      /**< ghosts at last sync */
+  p4est_locidx_t     *quad_to_quad;     /**< 4 * local_num_quadrants */
+  int8_t             *quad_to_face;     /**< 4 * local_num_quadrants */
+  p4est_locidx_t     *proc_offsets;     /**< mpisize + 1 */
+}
+p4est_mesh_mirror_t;
+
 /** Calculate the memory usage of the mesh structure.
  * \param [in] mesh     Mesh structure.
  * \return              Memory used in bytes.
@@ -112,6 +167,114 @@ size_t              p4est_mesh_memory_used (p4est_mesh_t * mesh);
 p4est_mesh_t       *p4est_mesh_new (p4est_t * p4est, p4est_ghost_t * ghost,
                                     p4est_connect_type_t btype);
 
+/** Create a p4est_mesh structure by updating an existing one.
+ * The quadrants of the new forest are matched against those recorded in
+ * \a old_mesh; rows of the neighbor arrays whose quadrant and neighbors
+ * all survived the adaptation are copied with their indices translated,
+ * and only the remaining faces are recomputed by direct neighbor search.
+ * The result is identical to calling p4est_mesh_new on the new forest.
+ * \param [in] p4est    A forest that is fully 2:1 balanced, typically the
+ *                      \a old_mesh forest after adaptation and balancing.
+ * \param [in] ghost    The ghost layer created from the provided p4est.
+ * \param [in] btype    Currently ignored, only face neighbors are stored.
+ * \param [in] old_mesh A mesh created for an earlier state of the forest.
+ *                      It is not modified and must be destroyed separately.
+ * \return              A fully allocated mesh structure.
+ */
+p4est_mesh_t       *p4est_mesh_update (p4est_t * p4est,
+                                       p4est_ghost_t * ghost,
+                                       p4est_connect_type_t btype,
+                                       p4est_mesh_t * old_mesh);
+
+/** Flatten the face neighbor information into one rectangular table.
+ * The table stores P4EST_HALF neighbor slots for each of the 4 faces of
+ * every local quadrant, so it can be consumed without indirection through
+ * quad_to_half and without branching on the 2:1 status of a face.  The
+ * layout is structure-of-arrays: the neighbor in slot \a h across face
+ * \a f of quadrant \a q lives at index (f * P4EST_HALF + h) *
+ * local_num_quadrants + q, so each slot forms one contiguous slice.
+ * A conformal or double-size neighbor occupies slot 0 of its face and a
+ * boundary face stores the quadrant itself there, both exactly as in
+ * quad_to_quad; half-size neighbors fill all slots of their face.
+ * Unused slots hold -1 and the face entry -25.
+ * \param [in] mesh           A mesh created by p4est_mesh_new.
+ * \param [out] flat_to_quad  On output, a newly allocated array of
+ *                            4 * P4EST_HALF * local_num_quadrants
+ *                            neighbor ids encoded as in quad_to_quad.
+ *                            Free with P4EST_FREE.
+ * \param [out] flat_to_face  Same shape, holding the quad_to_face code of
+ *                            each used slot.  Free with P4EST_FREE.
+ */
+void                p4est_mesh_flatten (p4est_mesh_t * mesh,
+                                        p4est_locidx_t ** flat_to_quad,
+                                        int8_t ** flat_to_face);
+
+/** Build per-direction gather index lists for stencil kernels.
+ * The table has the shape and slice layout of p4est_mesh_flatten, but
+ * every slot is filled with a directly usable data index, so a kernel
+ * becomes a pure gather-compute-scatter over contiguous index vectors:
+ * the indices of one face slot form one unit-stride slice that SIMD
+ * gather instructions can consume without masking.
+ * A conformal or double-size neighbor is replicated into all P4EST_HALF
+ * slots of its face and a boundary face replicates the quadrant itself;
+ * kernels that weight hanging faces differently can branch on the codes
+ * from p4est_mesh_flatten, which shares the layout.
+ * When a user data arena is active, the indices are arena slots as in
+ * quad_to_arena, ghost quadrants follow at local_arena_slots + ghost id,
+ * and neighbors whose data still lives in the memory pool yield -1.
+ * Without an arena, the indices are local quadrant numbers with ghosts
+ * at local_num_quadrants + ghost id, as in quad_to_quad.
+ * \param [in] mesh            A mesh created by p4est_mesh_new.
+ * \param [out] gather_slots   On output, a newly allocated array of
+ *                             4 * P4EST_HALF * local_num_quadrants data
+ *                             indices.  Free with P4EST_FREE.
+ */
+void                p4est_mesh_gather_slots (p4est_mesh_t * mesh,
+                                             p4est_locidx_t ** gather_slots);
+
+/** Create an empty mirror of the mesh neighbor arrays.
+ * Nothing is copied yet; the first p4est_mesh_mirror_sync uploads the
+ * complete arrays.
+ * \param [in] p4est    A valid forest; it must survive the mirror.
+ * \param [in] copy_fn  Callback performing the device copies.
+ * \param [in] user     Passed to \a copy_fn unchanged.
+ * \return              A mirror without any device contents.
+ */
+p4est_mesh_mirror_t *p4est_mesh_mirror_new (p4est_t * p4est,
+                                            p4est_mesh_mirror_copy_t
+                                            copy_fn, void *user);
+
+/** Bring the device buffers up to date with the current mesh.
+ * If the forest revision matches the last sync, this returns without
+ * copying anything.  If the number of local quadrants changed, the
+ * caller must have resized the device buffers and the complete arrays
+ * are uploaded.  Otherwise the new arrays are diffed against the host
+ * shadow and only the changed byte ranges are handed to the copy
+ * callback; nearby ranges are fused so each upload amortizes its
+ * launch latency.
+ * \param [in,out] mirror   A mirror created for this forest.
+ * \param [in] mesh         The current mesh of the forest.
+ * \param [in] ghost        The ghost layer the mesh was built from.
+ * \param [in] d_quad_to_quad   Device buffer for quad_to_quad of
+ *                          4 * local_num_quadrants indices.
+ * \param [in] d_quad_to_face   Device buffer for quad_to_face of
+ *                          4 * local_num_quadrants bytes.
+ * \param [in] d_proc_offsets   Device buffer for the ghost layer's
+ *                          proc_offsets of mpisize + 1 indices.
+ * \return                  The number of bytes handed to the callback.
+ */
+size_t              p4est_mesh_mirror_sync (p4est_mesh_mirror_t * mirror,
+                                            p4est_mesh_t * mesh,
+                                            p4est_ghost_t * ghost,
+                                            void *d_quad_to_quad,
+                                            void *d_quad_to_face,
+                                            void *d_proc_offsets);
+
+/** Destroy a mirror and its host shadow.
+ * The device buffers themselves belong to the caller.
+ */
+void                p4est_mesh_mirror_destroy (p4est_mesh_mirror_t * mirror);
+
 /** Destroy a p4est_mesh structure.
  * \param [in] mesh     Mesh structure previously created by p4est_mesh_new.
  */
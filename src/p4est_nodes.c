@@ -145,7 +145,9 @@ p4est_nodes_new_local (p4est_t * p4est)
   sc_array_init (&nodes->face_hangings, sizeof (p8est_hang4_t));
   sc_array_init (&nodes->edge_hangings, sizeof (p8est_hang2_t));
 #endif
-  nodes->local_nodes = P4EST_ALLOC (p4est_locidx_t, P4EST_CHILDREN * Ncells);
+  nodes->local_nodes = P4EST_ALLOC (p4est_locidx_t,
+                                    p4est_locidx_mult (P4EST_CHILDREN,
+                                                       Ncells));
   sc_array_init (&nodes->shared_indeps, sizeof (sc_recycle_array_t));
   nodes->shared_offsets = NULL;
   nodes->nonlocal_ranks = NULL;
@@ -443,19 +445,6 @@ endfunction:
   P4EST_ASSERT (c->p.which_tree >= 0 && c->p.which_tree < conn->num_trees);
 }
 
-static int
-p4est_nodes_foreach (void **item, const void *u)
-{
-  const sc_hash_array_data_t *internal_data =
-    (const sc_hash_array_data_t *) u;
-  const p4est_locidx_t *new_node_number =
-    (const p4est_locidx_t *) internal_data->user_data;
-
-  *item = (void *) (long) new_node_number[(long) *item];
-
-  return 1;
-}
-
 #ifdef P4EST_MPI
 
 static p4est_locidx_t *
@@ -465,7 +454,7 @@ p4est_shared_offsets (sc_array_t * inda)
   p4est_locidx_t     *shared_offsets;
   p4est_indep_t      *in;
 
-  num_indep_nodes = (p4est_locidx_t) inda->elem_count;
+  num_indep_nodes = p4est_locidx_from_size (inda->elem_count);
   shared_offsets = P4EST_ALLOC (p4est_locidx_t, num_indep_nodes);
 
   for (il = 0; il < num_indep_nodes; ++il) {
@@ -496,9 +485,9 @@ p4est_nodes_new (p4est_t * p4est, p4est_ghost_t * ghost)
   int                *procs, *all_ranges;
   int                *old_sharers, *new_sharers;
   char               *this_base;
-  int                 found;
   size_t              first_size, second_size, this_size;
   size_t              num_sharers, old_position, new_position;
+  ssize_t             lresult;
   p4est_qcoord_t     *xyz;
   p4est_topidx_t     *ttt;
   p4est_locidx_t      end_owned_indeps;
@@ -517,7 +506,6 @@ p4est_nodes_new (p4est_t * p4est, p4est_ghost_t * ghost)
   int                 qcid, face;
   int                *nonlocal_ranks;
   int                 clamped = 1;
-  void               *save_user_data;
   size_t              zz, position;
   int8_t             *local_status, *quad_status;
   p4est_topidx_t      jt;
@@ -528,7 +516,6 @@ p4est_nodes_new (p4est_t * p4est, p4est_ghost_t * ghost)
   p4est_locidx_t      num_indep_nodes, dup_indep_nodes, all_face_hangings;
   p4est_locidx_t      num_face_hangings, dup_face_hangings;
   p4est_locidx_t     *local_nodes, *quad_nodes, *shared_offsets;
-  p4est_locidx_t     *new_node_number;
   p4est_tree_t       *tree;
   p4est_nodes_t      *nodes;
   p4est_quadrant_t    c, n, p;
@@ -537,7 +524,6 @@ p4est_nodes_new (p4est_t * p4est, p4est_ghost_t * ghost)
   sc_array_t         *quadrants;
   sc_array_t         *inda, *faha;
   sc_array_t         *shared_indeps;
-  sc_hash_array_t    *indep_nodes;
   sc_hash_array_t    *face_hangings;
 #ifndef P4_TO_P8
   p4est_hang2_t      *fh;
@@ -580,13 +566,15 @@ p4est_nodes_new (p4est_t * p4est, p4est_ghost_t * ghost)
 
   /* compute number of local quadrant corners */
   nodes->num_local_quadrants = p4est->local_num_quadrants;
-  num_local_nodes =             /* same type */
-    P4EST_CHILDREN * nodes->num_local_quadrants;
+  num_local_nodes =             /* aborts on overflow */
+    p4est_locidx_mult (P4EST_CHILDREN, nodes->num_local_quadrants);
 
   /* Store hanging node status:
    * 0 for independent, 1 for face hanging, 2 for edge hanging.
    */
-  local_status = P4EST_ALLOC (int8_t, num_local_nodes);
+  local_status = (int8_t *)
+    p4est_workspace_get (p4est, P4EST_WORKSPACE_NODES_STATUS,
+                         num_local_nodes * sizeof (int8_t));
   memset (local_status, -1, num_local_nodes * sizeof (*local_status));
 
   /* Store the local node index for each corner of the elements.
@@ -595,9 +583,10 @@ p4est_nodes_new (p4est_t * p4est, p4est_ghost_t * ghost)
     P4EST_ALLOC (p4est_locidx_t, num_local_nodes);
   memset (local_nodes, -1, num_local_nodes * sizeof (*local_nodes));
 
-  indep_nodes = sc_hash_array_new (sizeof (p4est_indep_t),
-                                   p4est_node_hash_piggy_fn,
-                                   p4est_node_equal_piggy_fn, &clamped);
+  /* Independent nodes are deduplicated by sorting, not by hashing:
+   * all candidates are generated into a flat array first. */
+  inda = &nodes->indep_nodes;
+  sc_array_init (inda, sizeof (p4est_indep_t));
 #ifndef P4_TO_P8
   face_hangings = sc_hash_array_new (sizeof (p4est_hang2_t),
                                      p4est_node_hash_piggy_fn,
@@ -688,55 +677,51 @@ p4est_nodes_new (p4est_t * p4est, p4est_ghost_t * ghost)
         P4EST_ASSERT (quad_status[k] >= 0 || quad_status[k] <= 2);
         p4est_quadrant_corner_node (qpp[quad_status[k]], k, &n);
         p4est_node_canonicalize (p4est, jt, &n, &c);
-        r =
-          (p4est_quadrant_t *) sc_hash_array_insert_unique (indep_nodes, &c,
-                                                            &position);
-        if (r != NULL) {
-          *r = c;
-          P4EST_ASSERT (num_indep_nodes == (p4est_locidx_t) position);
-          ++num_indep_nodes;
-        }
-        else {
-          ++dup_indep_nodes;
-        }
-        P4EST_ASSERT ((p4est_locidx_t) position < num_indep_nodes);
-        quad_nodes[k] = (p4est_locidx_t) position;
+        in = (p4est_indep_t *) sc_array_push (inda);
+        *(p4est_quadrant_t *) in = c;
+        /* remember where the node number must be written back */
+        in->p.piggy3.local_num =
+          (p4est_locidx_t) (quad_nodes - local_nodes) + k;
       }
     }
   }
-  P4EST_ASSERT (num_indep_nodes + dup_indep_nodes == num_local_nodes);
+  P4EST_ASSERT ((size_t) num_local_nodes == inda->elem_count);
 #ifdef P4_TO_P8
   sc_array_reset (&exist_array);
 #endif
-  inda = &indep_nodes->a;
-  P4EST_ASSERT (num_indep_nodes == (p4est_locidx_t) inda->elem_count);
 
-  /* Reorder independent nodes by their global treeid and z-order index. */
-  new_node_number = P4EST_ALLOC (p4est_locidx_t, num_indep_nodes);
+  /* Sort all candidates by their global treeid and z-order index and
+   * remove duplicates in place.  These are two streaming passes and the
+   * surviving nodes come out in the final ordering right away. */
+  sc_array_sort (inda, p4est_quadrant_compare_piggy);
+  for (zz = 0; zz < (size_t) num_local_nodes; ++zz) {
+    in = (p4est_indep_t *) sc_array_index (inda, zz);
+    il = in->p.piggy3.local_num;
+    if (num_indep_nodes == 0 ||
+        p4est_quadrant_compare_piggy
+        (sc_array_index (inda, (size_t) (num_indep_nodes - 1)), in) != 0) {
+      if ((size_t) num_indep_nodes != zz) {
+        *(p4est_indep_t *) sc_array_index (inda,
+                                           (size_t) num_indep_nodes) = *in;
+      }
+      ++num_indep_nodes;
+    }
+    else {
+      ++dup_indep_nodes;
+    }
+    P4EST_ASSERT (il >= 0 && il < num_local_nodes);
+    local_nodes[il] = num_indep_nodes - 1;
+  }
+  P4EST_ASSERT (num_indep_nodes + dup_indep_nodes == num_local_nodes);
+  sc_array_resize (inda, (size_t) num_indep_nodes);
+
+  /* Initialize sharer information of the unique nodes. */
   for (il = 0; il < num_indep_nodes; ++il) {
     in = (p4est_indep_t *) sc_array_index (inda, (size_t) il);
     in->pad8 = 0;               /* shared by 0 other processors so far */
     in->pad16 = (int16_t) (-1);
     in->p.piggy3.local_num = il;
   }
-  sc_array_sort (inda, p4est_quadrant_compare_piggy);
-  for (il = 0; il < num_indep_nodes; ++il) {
-    in = (p4est_indep_t *) sc_array_index (inda, (size_t) il);
-    new_node_number[in->p.piggy3.local_num] = il;
-#ifndef P4EST_MPI
-    in->p.piggy3.local_num = il;
-#endif
-  }
-
-  /* Re-synchronize hash array and local nodes */
-  save_user_data = indep_nodes->internal_data.user_data;
-  indep_nodes->internal_data.user_data = new_node_number;
-  sc_hash_foreach (indep_nodes->h, p4est_nodes_foreach);
-  indep_nodes->internal_data.user_data = save_user_data;
-  for (il = 0; il < num_local_nodes; ++il) {
-    P4EST_ASSERT (local_nodes[il] >= 0 && local_nodes[il] < num_indep_nodes);
-    local_nodes[il] = new_node_number[local_nodes[il]];
-  }
 #ifndef P4EST_MPI
   num_owned_indeps = num_indep_nodes;
   offset_owned_indeps = 0;
@@ -745,14 +730,18 @@ p4est_nodes_new (p4est_t * p4est, p4est_ghost_t * ghost)
   offset_owned_indeps = -1;     /* will be computed below */
 #endif
   num_owned_shared = 0;
-  P4EST_FREE (new_node_number);
 
 #ifdef P4EST_MPI
   /* Fill send buffers and number owned nodes. */
   first_size = P4EST_DIM * sizeof (p4est_qcoord_t) + sizeof (p4est_topidx_t);
   first_size = SC_MAX (first_size, sizeof (p4est_locidx_t));
-  procs = P4EST_ALLOC_ZERO (int, num_procs);
-  peers = P4EST_ALLOC (p4est_node_peer_t, num_procs);
+  procs = (int *)
+    p4est_workspace_get (p4est, P4EST_WORKSPACE_NODES_PROCS,
+                         num_procs * sizeof (int));
+  memset (procs, 0, num_procs * sizeof (int));
+  peers = (p4est_node_peer_t *)
+    p4est_workspace_get (p4est, P4EST_WORKSPACE_NODES_PEERS,
+                         num_procs * sizeof (p4est_node_peer_t));
   sc_array_init (&send_requests, sizeof (MPI_Request));
   for (k = 0; k < num_procs; ++k) {
     peer = peers + k;
@@ -895,8 +884,9 @@ p4est_nodes_new (p4est_t * p4est, p4est_ghost_t * ghost)
 #endif
       ttt = (p4est_topidx_t *) (&xyz[P4EST_DIM]);
       inkey.p.which_tree = *ttt;
-      found = sc_hash_array_lookup (indep_nodes, &inkey, &position);
-      P4EST_ASSERT (found);
+      lresult = sc_array_bsearch (inda, &inkey, p4est_quadrant_compare_piggy);
+      P4EST_ASSERT (lresult >= 0);
+      position = (size_t) lresult;
       P4EST_ASSERT ((p4est_locidx_t) position >= offset_owned_indeps &&
                     (p4est_locidx_t) position < end_owned_indeps);
       node_number = (p4est_locidx_t *) xyz;
@@ -1113,7 +1103,8 @@ p4est_nodes_new (p4est_t * p4est, p4est_ghost_t * ghost)
     }
   }
   P4EST_ASSERT (num_face_hangings + dup_face_hangings == all_face_hangings);
-  P4EST_FREE (local_status);
+  p4est_workspace_release (p4est, P4EST_WORKSPACE_NODES_STATUS,
+                           local_status);
   sc_hash_array_rip (face_hangings, faha);
   P4EST_ASSERT (num_face_hangings == (p4est_locidx_t) faha->elem_count);
 #ifdef P4_TO_P8
@@ -1140,12 +1131,10 @@ p4est_nodes_new (p4est_t * p4est, p4est_ghost_t * ghost)
   nodes->num_owned_indeps = num_owned_indeps;
   nodes->num_owned_shared = num_owned_shared;
   nodes->offset_owned_indeps = offset_owned_indeps;
-  sc_hash_array_rip (indep_nodes, inda = &nodes->indep_nodes);
   nonlocal_ranks = nodes->nonlocal_ranks =
     P4EST_ALLOC (int, num_indep_nodes - num_owned_indeps);
   nodes->global_owned_indeps = P4EST_ALLOC (p4est_locidx_t, num_procs);
   nodes->global_owned_indeps[rank] = num_owned_indeps;
-  indep_nodes = NULL;
 
 #ifdef P4EST_MPI
   /* Receive the replies. */
@@ -1268,8 +1257,8 @@ p4est_nodes_new (p4est_t * p4est, p4est_ghost_t * ghost)
     sc_array_reset (&peer->send_second);
     sc_array_reset (&peer->recv_second);
   }
-  P4EST_FREE (peers);
-  P4EST_FREE (procs);
+  p4est_workspace_release (p4est, P4EST_WORKSPACE_NODES_PEERS, peers);
+  p4est_workspace_release (p4est, P4EST_WORKSPACE_NODES_PROCS, procs);
 
   mpiret = MPI_Allgather (&num_owned_indeps, 1, P4EST_MPI_LOCIDX,
                           nodes->global_owned_indeps, 1, P4EST_MPI_LOCIDX,
@@ -21,14 +21,6 @@
   51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
 */
 
-/********************************************************************
- *                          IMPORTANT NOTE                          *
- *                                                                  *
- * The p4est_points functionality depends on sc/src/sc_sort.        *
- * That parallel bitonic sort is still buggy (see sc/bugs).         *
- * If you want to use this code you have to fix the sort first.     *
- ********************************************************************/
-
 #ifdef P4_TO_P8
 #include <p8est_algorithms.h>
 #include <p8est_bits.h>
@@ -43,13 +35,15 @@
 #include <p4est_points.h>
 #endif /* !P4_TO_P8 */
 #include <sc_allgather.h>
-#include <sc_sort.h>
 
 #ifdef SC_ALLGATHER
 #include <sc_allgather.h>
 #define MPI_Allgather sc_allgather
 #endif
 
+/** Number of splitter samples each process contributes to the sort. */
+#define P4EST_POINTS_OVERSAMPLE 32
+
 typedef struct
 {
   p4est_quadrant_t   *points;
@@ -58,6 +52,115 @@ typedef struct
 }
 p4est_points_state_t;
 
+/** Sort distributed points globally by tree and Morton index.
+ * The points are sorted locally, splitters are selected from a regular
+ * oversampling of every process and the points are redistributed in one
+ * all-to-all so that the concatenation over the ranks is sorted.
+ * \param [in,out] num_points   On output, the number of points that this
+ *                              process holds after the redistribution.
+ * \return          A newly allocated sorted buffer, or \a points itself
+ *                  when no redistribution was necessary.
+ */
+static p4est_quadrant_t *
+p4est_points_sample_sort (MPI_Comm mpicomm, int num_procs, int rank,
+                          p4est_quadrant_t * points,
+                          p4est_locidx_t * num_points)
+{
+  int                 mpiret;
+  int                 i, r, total;
+  int                 nsamples = P4EST_POINTS_OVERSAMPLE;
+  int                *scnts, *sdispls, *rcnts, *rdispls;
+  size_t              zz, np;
+  p4est_quadrant_t   *samples, *gathered, *splitters, *recv;
+
+  np = (size_t) *num_points;
+
+  /* sort the local points */
+  qsort (points, np, sizeof (p4est_quadrant_t),
+         p4est_quadrant_compare_piggy);
+  if (num_procs == 1) {
+    return points;
+  }
+
+  /* contribute a fixed number of regularly spaced samples per process,
+   * padding short point sets with a sentinel that sorts last */
+  samples = P4EST_ALLOC (p4est_quadrant_t, nsamples);
+  for (i = 0; i < nsamples; ++i) {
+    if ((size_t) i < np) {
+      samples[i] = points[np * (size_t) i / (size_t) nsamples];
+    }
+    else {
+      P4EST_QUADRANT_INIT (&samples[i]);
+      p4est_quadrant_set_morton (&samples[i], 0, 0);
+      samples[i].p.which_tree = P4EST_TOPIDX_MAX;
+    }
+  }
+  gathered = P4EST_ALLOC (p4est_quadrant_t, (size_t) num_procs * nsamples);
+  mpiret = MPI_Allgather (samples, (int) (nsamples *
+                                          sizeof (p4est_quadrant_t)),
+                          MPI_BYTE, gathered, (int) (nsamples *
+                                                     sizeof
+                                                     (p4est_quadrant_t)),
+                          MPI_BYTE, mpicomm);
+  SC_CHECK_MPI (mpiret);
+  P4EST_FREE (samples);
+
+  /* select one splitter per process boundary from the gathered samples */
+  qsort (gathered, (size_t) num_procs * nsamples,
+         sizeof (p4est_quadrant_t), p4est_quadrant_compare_piggy);
+  splitters = P4EST_ALLOC (p4est_quadrant_t, num_procs - 1);
+  for (r = 0; r < num_procs - 1; ++r) {
+    splitters[r] = gathered[(size_t) (r + 1) * nsamples];
+  }
+  P4EST_FREE (gathered);
+
+  /* count the points that go to each process in one merge pass */
+  scnts = P4EST_ALLOC_ZERO (int, num_procs);
+  sdispls = P4EST_ALLOC (int, num_procs);
+  rcnts = P4EST_ALLOC (int, num_procs);
+  rdispls = P4EST_ALLOC (int, num_procs);
+  r = 0;
+  for (zz = 0; zz < np; ++zz) {
+    while (r < num_procs - 1 &&
+           p4est_quadrant_compare_piggy (&splitters[r], &points[zz]) < 0) {
+      ++r;
+    }
+    ++scnts[r];
+  }
+  P4EST_FREE (splitters);
+  mpiret = MPI_Alltoall (scnts, 1, MPI_INT, rcnts, 1, MPI_INT, mpicomm);
+  SC_CHECK_MPI (mpiret);
+  total = 0;
+  for (r = 0; r < num_procs; ++r) {
+    sdispls[r] = (r == 0) ? 0 : sdispls[r - 1] + scnts[r - 1];
+    rdispls[r] = total;
+    total += rcnts[r];
+  }
+
+  /* redistribute the points and convert the counts to bytes in place */
+  for (r = 0; r < num_procs; ++r) {
+    scnts[r] *= (int) sizeof (p4est_quadrant_t);
+    sdispls[r] *= (int) sizeof (p4est_quadrant_t);
+    rcnts[r] *= (int) sizeof (p4est_quadrant_t);
+    rdispls[r] *= (int) sizeof (p4est_quadrant_t);
+  }
+  recv = P4EST_ALLOC (p4est_quadrant_t, total);
+  mpiret = MPI_Alltoallv (points, scnts, sdispls, MPI_BYTE,
+                          recv, rcnts, rdispls, MPI_BYTE, mpicomm);
+  SC_CHECK_MPI (mpiret);
+  P4EST_FREE (scnts);
+  P4EST_FREE (sdispls);
+  P4EST_FREE (rcnts);
+  P4EST_FREE (rdispls);
+
+  /* merge the per-sender sorted runs by one more local sort */
+  qsort (recv, (size_t) total, sizeof (p4est_quadrant_t),
+         p4est_quadrant_compare_piggy);
+  *num_points = (p4est_locidx_t) total;
+
+  return recv;
+}
+
 static void
 p4est_points_init (p4est_t * p4est, p4est_topidx_t which_tree,
                    p4est_quadrant_t * quadrant)
@@ -108,15 +211,14 @@ p4est_new_points (MPI_Comm mpicomm, p4est_connectivity_t * connectivity,
 {
   int                 mpiret;
   int                 num_procs, rank;
-  int                 i, isizet;
-  size_t              lcount;
-  size_t             *nmemb;
+  int                 i;
 #ifdef P4EST_DEBUG
   size_t              zz;
 #endif
   p4est_topidx_t      jt, num_trees;
   p4est_topidx_t      first_tree, last_tree, next_tree;
   p4est_quadrant_t   *first_quad, *next_quad, *quad;
+  p4est_quadrant_t   *orig_points = points;
   p4est_quadrant_t    a, b, c, f, l, n;
   p4est_tree_t       *tree;
   p4est_t            *p4est;
@@ -143,19 +245,12 @@ p4est_new_points (MPI_Comm mpicomm, p4est_connectivity_t * connectivity,
    *    with N the total number of quadrants.
    */
 
-  /* parallel sort the incoming points */
-  lcount = (size_t) num_points;
-  nmemb = P4EST_ALLOC_ZERO (size_t, num_procs);
-  isizet = (int) sizeof (size_t);
-  mpiret = MPI_Allgather (&lcount, isizet, MPI_BYTE,
-                          nmemb, isizet, MPI_BYTE, mpicomm);
-  SC_CHECK_MPI (mpiret);
-  sc_psort (mpicomm, points, nmemb, sizeof (p4est_quadrant_t),
-            p4est_quadrant_compare_piggy);
-  P4EST_FREE (nmemb);
+  /* sample sort the incoming points; this may redistribute them */
+  points = p4est_points_sample_sort (mpicomm, num_procs, rank,
+                                     points, &num_points);
 #ifdef P4EST_DEBUG
   first_quad = points;
-  for (zz = 1; zz < lcount; ++zz) {
+  for (zz = 1; zz < (size_t) num_points; ++zz) {
     next_quad = points + zz;
     P4EST_ASSERT (p4est_quadrant_compare_piggy (first_quad, next_quad) <= 0);
     first_quad = next_quad;
@@ -332,8 +427,8 @@ p4est_new_points (MPI_Comm mpicomm, p4est_connectivity_t * connectivity,
       ++tree->quadrants_per_level[a.level];
     }
     else {
-      p4est_complete_region (p4est, &a, 1, &b, includeb,
-                             tree, jt, p4est_points_init);
+      p4est_complete_region_counted (p4est, &a, 1, &b, includeb,
+                                     tree, jt, p4est_points_init);
       quad = p4est_quadrant_array_index (&tree->quadrants,
                                          tree->quadrants.elem_count - 1);
     }
@@ -352,12 +447,6 @@ p4est_new_points (MPI_Comm mpicomm, p4est_connectivity_t * connectivity,
     }
 #endif
   }
-  if (last_tree >= 0) {
-    for (; jt < num_trees; ++jt) {
-      tree = p4est_tree_array_index (p4est->trees, jt);
-      tree->quadrants_offset = p4est->local_num_quadrants;
-    }
-  }
 
   /* compute some member variables */
   p4est->global_first_quadrant = P4EST_ALLOC (p4est_gloidx_t, num_procs + 1);
@@ -375,7 +464,7 @@ p4est_new_points (MPI_Comm mpicomm, p4est_connectivity_t * connectivity,
   /* refine to have one point per quadrant */
   if (max_points >= 0) {
     p4est_refine_ext (p4est, 1, maxlevel,
-                      p4est_points_refine, NULL, p4est_points_init);
+                      p4est_points_refine, NULL, p4est_points_init, NULL);
 #ifdef P4EST_DEBUG
     for (jt = first_tree; jt <= last_tree; ++jt) {
       tree = p4est_tree_array_index (p4est->trees, jt);
@@ -393,5 +482,128 @@ p4est_new_points (MPI_Comm mpicomm, p4est_connectivity_t * connectivity,
   /* initialize user pointer and data size */
   p4est_reset_data (p4est, data_size, init_fn, user_pointer);
 
+  /* drop the redistributed point buffer if the sort created one */
+  if (points != orig_points) {
+    P4EST_FREE (points);
+  }
+
   return p4est;
 }
+
+p4est_points_buffer_t *
+p4est_points_buffer_new (p4est_t * p4est, int maxlevel,
+                         p4est_locidx_t max_points)
+{
+  void               *prev_pointer;
+  p4est_points_buffer_t *buffer;
+  p4est_points_state_t ppstate;
+
+  P4EST_ASSERT (0 <= maxlevel && maxlevel <= P4EST_QMAXLEVEL);
+  P4EST_ASSERT (max_points >= 0);
+
+  buffer = P4EST_ALLOC (p4est_points_buffer_t, 1);
+  buffer->p4est = p4est;
+  buffer->maxlevel = maxlevel;
+  buffer->max_points = max_points;
+  buffer->num_points = 0;
+  buffer->points = NULL;
+
+  /* take over the quadrant data to hold per-quadrant point ranges */
+  ppstate.points = NULL;
+  ppstate.num_points = 0;
+  ppstate.max_points = max_points;
+  ppstate.current = 0;
+  ppstate.maxlevel = maxlevel;
+  prev_pointer = p4est->user_pointer;
+  p4est_reset_data (p4est, 2 * sizeof (p4est_locidx_t),
+                    p4est_points_init, &ppstate);
+  p4est->user_pointer = prev_pointer;
+
+  return buffer;
+}
+
+void
+p4est_points_buffer_add (p4est_points_buffer_t * buffer,
+                         const p4est_quadrant_t * points,
+                         p4est_locidx_t num_points)
+{
+  void               *prev_pointer;
+  size_t              zz, zn, zo, nnew, nold, nkept;
+  p4est_t            *p4est = buffer->p4est;
+  p4est_tree_t       *tree;
+  p4est_topidx_t      jt;
+  p4est_quadrant_t   *batch, *merged, *quad;
+  p4est_quadrant_t   *gfp = p4est->global_first_position;
+  p4est_points_state_t ppstate;
+
+  P4EST_ASSERT (num_points >= 0);
+
+  /* sort the incoming batch and drop points outside the local partition */
+  nnew = (size_t) num_points;
+  batch = P4EST_ALLOC (p4est_quadrant_t, nnew);
+  nkept = 0;
+  for (zz = 0; zz < nnew; ++zz) {
+    P4EST_ASSERT (p4est_quadrant_is_node (&points[zz], 1));
+    if (p4est_quadrant_compare_piggy (&gfp[p4est->mpirank],
+                                      &points[zz]) <= 0 &&
+        p4est_quadrant_compare_piggy (&points[zz],
+                                      &gfp[p4est->mpirank + 1]) < 0) {
+      batch[nkept++] = points[zz];
+    }
+  }
+  P4EST_VERBOSEF ("Points buffer add %lld of %lld locally\n",
+                  (long long) nkept, (long long) num_points);
+  qsort (batch, nkept, sizeof (p4est_quadrant_t),
+         p4est_quadrant_compare_piggy);
+
+  /* merge the batch into the retained sorted point array */
+  nold = (size_t) buffer->num_points;
+  merged = P4EST_ALLOC (p4est_quadrant_t, nold + nkept);
+  zn = zo = 0;
+  for (zz = 0; zz < nold + nkept; ++zz) {
+    if (zo < nold && (zn >= nkept ||
+                      p4est_quadrant_compare_piggy (&buffer->points[zo],
+                                                    &batch[zn]) <= 0)) {
+      merged[zz] = buffer->points[zo++];
+    }
+    else {
+      merged[zz] = batch[zn++];
+    }
+  }
+  P4EST_FREE (batch);
+  P4EST_FREE (buffer->points);
+  buffer->points = merged;
+  buffer->num_points = (p4est_locidx_t) (nold + nkept);
+
+  /* rebind the per-quadrant point ranges in one sweep */
+  ppstate.points = buffer->points;
+  ppstate.num_points = buffer->num_points;
+  ppstate.max_points = buffer->max_points;
+  ppstate.current = 0;
+  ppstate.maxlevel = buffer->maxlevel;
+  prev_pointer = p4est->user_pointer;
+  p4est->user_pointer = &ppstate;
+  for (jt = p4est->first_local_tree; jt <= p4est->last_local_tree; ++jt) {
+    tree = p4est_tree_array_index (p4est->trees, jt);
+    for (zz = 0; zz < tree->quadrants.elem_count; ++zz) {
+      quad = p4est_quadrant_array_index (&tree->quadrants, zz);
+      p4est_points_init (p4est, jt, quad);
+    }
+  }
+  P4EST_ASSERT (ppstate.current == ppstate.num_points);
+
+  /* split the quadrants whose point count exceeds the threshold */
+  p4est_refine_ext (p4est, 1, buffer->maxlevel,
+                    p4est_points_refine, NULL, p4est_points_init, NULL);
+  p4est->user_pointer = prev_pointer;
+}
+
+void
+p4est_points_buffer_destroy (p4est_points_buffer_t * buffer)
+{
+  p4est_t            *p4est = buffer->p4est;
+
+  p4est_reset_data (p4est, 0, NULL, p4est->user_pointer);
+  P4EST_FREE (buffer->points);
+  P4EST_FREE (buffer);
+}
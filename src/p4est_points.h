@@ -21,14 +21,6 @@
   51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
 */
 
-/********************************************************************
- *                          IMPORTANT NOTE                          *
- *                                                                  *
- * The p4est_points functionality depends on sc/src/sc_sort.        *
- * That parallel bitonic sort is still buggy (see sc/bugs).         *
- * If you want to use this code you have to fix the sort first.     *
- ********************************************************************/
-
 #ifndef P4EST_POINTS_H
 #define P4EST_POINTS_H
 
@@ -69,6 +61,58 @@ p4est_t            *p4est_new_points (MPI_Comm mpicomm,
                                       size_t data_size, p4est_init_t init_fn,
                                       void *user_pointer);
 
+/** Context for streaming points into an existing forest.
+ * Between p4est_points_buffer_new and p4est_points_buffer_destroy the
+ * buffer owns the forest's quadrant user data, which holds the range of
+ * retained points per quadrant as two p4est_locidx_t entries.
+ */
+typedef struct p4est_points_buffer
+{
+  p4est_t            *p4est;
+  int                 maxlevel;
+  p4est_locidx_t      max_points;
+  p4est_locidx_t      num_points;
+  p4est_quadrant_t   *points;    /* retained points in partition order */
+}
+p4est_points_buffer_t;
+
+/** Prepare an existing forest for incremental point ingestion.
+ * The forest's quadrant data is reset to hold per-quadrant point ranges,
+ * so any previous user data is released; it is restored to size zero by
+ * p4est_points_buffer_destroy.
+ * \param [in] p4est         The forest to ingest points into.
+ * \param [in] maxlevel      Level of the smallest possible quadrants.
+ * \param [in] max_points    Maximum number of points per quadrant.
+ *                           Applies to quadrants above maxlevel, so 0 is ok.
+ * \return                   A buffer to be passed to the add function.
+ */
+p4est_points_buffer_t *p4est_points_buffer_new (p4est_t * p4est,
+                                                int maxlevel,
+                                                p4est_locidx_t max_points);
+
+/** Ingest a batch of points and refine where they accumulate.
+ * The points are merged into the buffer's retained set and the quadrants
+ * whose point count exceeds max_points are refined recursively, without
+ * rebuilding the forest.  Points outside the local partition are dropped;
+ * route them to their owner first, e.g. with p4est_search_owners_global.
+ * Rebalancing, ghost creation and repartitioning are left to the caller.
+ * \param [in,out] buffer    Buffer created by p4est_points_buffer_new.
+ * \param [in] points        Collection of clamped quadrant nodes.
+ *                           The tree id must be stored in p.which_tree.
+ * \param [in] num_points    Number of points provided in the array.
+ */
+void                p4est_points_buffer_add (p4est_points_buffer_t * buffer,
+                                             const p4est_quadrant_t * points,
+                                             p4est_locidx_t num_points);
+
+/** Release a point buffer and return the quadrant data to the caller.
+ * The forest itself is not modified except that its quadrant data size
+ * is reset to zero.
+ * \param [in] buffer        Buffer created by p4est_points_buffer_new.
+ */
+void                p4est_points_buffer_destroy (p4est_points_buffer_t *
+                                                 buffer);
+
 SC_EXTERN_C_END;
 
 #endif /* !P4EST_POINTS_H */
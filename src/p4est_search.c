@@ -22,12 +22,17 @@
 */
 
 #ifndef P4_TO_P8
+#include <p4est_algorithms.h>
 #include <p4est_bits.h>
+#include <p4est_communication.h>
 #include <p4est_search.h>
 #else
+#include <p8est_algorithms.h>
 #include <p8est_bits.h>
+#include <p8est_communication.h>
 #include <p8est_search.h>
 #endif
+#include <sc_notify.h>
 
 ssize_t
 p4est_find_lower_bound (sc_array_t * array,
@@ -131,6 +136,33 @@ p4est_find_higher_bound (sc_array_t * array,
   return (ssize_t) guess;
 }
 
+ssize_t
+p4est_find_lower_bound_key (const uint64_t * keys, size_t count,
+                            uint64_t key)
+{
+  size_t              guess;
+
+  if (count == 0)
+    return -1;
+
+  guess = p4est_morton_key_lower_bound (keys, count, key);
+
+  return (guess == count) ? -1 : (ssize_t) guess;
+}
+
+ssize_t
+p4est_find_higher_bound_key (const uint64_t * keys, size_t count,
+                             uint64_t key)
+{
+  size_t              guess;
+
+  /* keys are unique and their level bits stay below 63,
+   * so key + 1 neither wraps nor skips an existing key */
+  guess = p4est_morton_key_lower_bound (keys, count, key + 1);
+
+  return (guess == 0) ? -1 : (ssize_t) (guess - 1);
+}
+
 static              size_t
 p4est_array_split_ancestor_id (sc_array_t * array, size_t zindex, void *data)
 {
@@ -452,9 +484,11 @@ find_range_boundaries_exit:
 static void
 p4est_search_recursion (p4est_t * p4est, p4est_topidx_t which_tree,
                         p4est_quadrant_t * quadrant,
+                        p4est_search_quadrant_t quadrant_fn,
                         p4est_search_query_t search_fn,
                         sc_array_t * quadrants,
-                        sc_array_t * points, sc_array_t * actives)
+                        sc_array_t * points, sc_array_t * actives,
+                        void *user_data)
 {
   int                 i;
   int                 is_leaf, is_match;
@@ -469,10 +503,12 @@ p4est_search_recursion (p4est_t * p4est, p4est_topidx_t which_tree,
    * 2. quadrant is identical to or an ancestor of those in the array.
    */
 
-  P4EST_ASSERT (actives->elem_count <= points->elem_count);
+  P4EST_ASSERT (points == NULL ||
+                actives->elem_count <= points->elem_count);
 
   /* return if there are no quadrants or active points */
-  if (quadrants->elem_count == 0 || actives->elem_count == 0)
+  if (quadrants->elem_count == 0 ||
+      (points != NULL && actives->elem_count == 0))
     return;
 
   /* determine leaf situation */
@@ -498,22 +534,31 @@ p4est_search_recursion (p4est_t * p4est, p4est_topidx_t which_tree,
     quadrant->p.piggy3.local_num = tree->quadrants_offset + offset;
   }
 
-  /* query callback for all points and return if none remain */
+  /* query the quadrant callback first: it may prune the whole branch */
+  if (quadrant_fn != NULL &&
+      !quadrant_fn (p4est, which_tree, quadrant, is_leaf, user_data)) {
+    return;
+  }
+
   sc_array_init (&child_actives, sizeof (size_t));
-  for (zz = 0; zz < actives->elem_count; ++zz) {
-    pz = (size_t *) sc_array_index (actives, zz);
-    is_match = search_fn (p4est, which_tree, quadrant, is_leaf,
-                          sc_array_index (points, *pz));
-    if (!is_leaf && is_match) {
-      qz = (size_t *) sc_array_push (&child_actives);
-      *qz = *pz;
+  if (points != NULL) {
+    /* query callback for all points and return if none remain */
+    for (zz = 0; zz < actives->elem_count; ++zz) {
+      pz = (size_t *) sc_array_index (actives, zz);
+      is_match = search_fn (p4est, which_tree, quadrant, is_leaf,
+                            sc_array_index (points, *pz));
+      if (!is_leaf && is_match) {
+        qz = (size_t *) sc_array_push (&child_actives);
+        *qz = *pz;
+      }
     }
+    if (child_actives.elem_count == 0)
+      return;
   }
-  if (child_actives.elem_count == 0)
-    return;
 
-  /* leaf situation has returned above */
-  P4EST_ASSERT (!is_leaf);
+  /* the leaf situation has returned above when points are present */
+  if (is_leaf)
+    return;
 
   /* split quadrant array and run recursion */
   p4est_split_array (quadrants, (int) quadrant->level, split);
@@ -523,8 +568,10 @@ p4est_search_recursion (p4est_t * p4est, p4est_topidx_t which_tree,
       sc_array_init_view (&child_quadrants, quadrants,
                           split[i], split[i + 1] - split[i]);
       p4est_search_recursion (p4est, which_tree, &children[i],
-                              search_fn, &child_quadrants,
-                              points, &child_actives);
+                              quadrant_fn, search_fn, &child_quadrants,
+                              points,
+                              points != NULL ? &child_actives : NULL,
+                              user_data);
       sc_array_reset (&child_quadrants);
     }
   }
@@ -557,8 +604,587 @@ p4est_search (p4est_t * p4est, p4est_search_query_t search_fn,
 
     /* start recursion with root quadrant */
     p4est_quadrant_set_morton (&root, 0, 0);
-    p4est_search_recursion (p4est, jt, &root, search_fn,
-                            tquadrants, points, &actives);
+    p4est_search_recursion (p4est, jt, &root, NULL, search_fn,
+                            tquadrants, points, &actives, NULL);
     sc_array_reset (&actives);
   }
 }
+
+void
+p4est_search_quadrants (p4est_t * p4est,
+                        p4est_search_quadrant_t quadrant_fn,
+                        p4est_search_query_t point_fn,
+                        sc_array_t * points, void *user_data)
+{
+  p4est_topidx_t      jt;
+  p4est_tree_t       *tree;
+  p4est_quadrant_t    root;
+  sc_array_t          actives;
+  sc_array_t         *tquadrants;
+  size_t              zz, *pz;
+
+  P4EST_ASSERT (points == NULL || point_fn != NULL);
+
+  P4EST_QUADRANT_INIT (&root);
+  for (jt = p4est->first_local_tree; jt <= p4est->last_local_tree; ++jt) {
+    /* grab complete tree quadrant array */
+    tree = p4est_tree_array_index (p4est->trees, jt);
+    tquadrants = &tree->quadrants;
+
+    /* mark all points as active */
+    sc_array_init (&actives, sizeof (size_t));
+    if (points != NULL) {
+      sc_array_resize (&actives, points->elem_count);
+      for (zz = 0; zz < points->elem_count; ++zz) {
+        pz = (size_t *) sc_array_index (&actives, zz);
+        *pz = zz;
+      }
+    }
+
+    /* start recursion with root quadrant */
+    p4est_quadrant_set_morton (&root, 0, 0);
+    p4est_search_recursion (p4est, jt, &root, quadrant_fn, point_fn,
+                            tquadrants, points,
+                            points != NULL ? &actives : NULL, user_data);
+    sc_array_reset (&actives);
+  }
+}
+
+void
+p4est_search_owners (p4est_t * p4est, sc_array_t * points,
+                     int *owners, p4est_locidx_t * local_ids)
+{
+  int                 rank;
+  size_t              zz, zq, np;
+  size_t              orig;
+  p4est_topidx_t      jt, nt;
+  p4est_tree_t       *tree;
+  p4est_quadrant_t   *p, *copy, *q;
+  p4est_quadrant_t   *gfp = p4est->global_first_position;
+  sc_array_t         *sorted;
+
+  P4EST_ASSERT (points->elem_size == sizeof (p4est_quadrant_t));
+
+  np = points->elem_count;
+  if (np == 0) {
+    return;
+  }
+
+  /* sort a copy of the queries into partition order, remembering the
+   * original position of each point in its piggy3.local_num */
+  sorted = sc_array_new_size (sizeof (p4est_quadrant_t), np);
+  for (zz = 0; zz < np; ++zz) {
+    p = p4est_quadrant_array_index (points, zz);
+    P4EST_ASSERT (p4est_quadrant_is_valid (p));
+    P4EST_ASSERT (0 <= p->p.which_tree &&
+                  p->p.which_tree < p4est->connectivity->num_trees);
+    copy = p4est_quadrant_array_index (sorted, zz);
+    /* represent every query by its first descendant so that coarse
+     * queries compare consistently with the partition markers */
+    p4est_quadrant_first_descendant (p, copy, P4EST_QMAXLEVEL);
+    copy->p.piggy3.which_tree = p->p.which_tree;
+    copy->p.piggy3.local_num = (p4est_locidx_t) zz;
+  }
+  p4est_quadrant_array_sort_piggy (sorted);
+
+  /* co-ordered sweep over the partition markers and the local quadrants */
+  rank = 0;
+  jt = p4est->first_local_tree;
+  zq = 0;
+  for (zz = 0; zz < np; ++zz) {
+    copy = p4est_quadrant_array_index (sorted, zz);
+    orig = (size_t) copy->p.piggy3.local_num;
+    while (p4est_quadrant_compare_piggy (&gfp[rank + 1], copy) <= 0) {
+      ++rank;
+      P4EST_ASSERT (rank < p4est->mpisize);
+    }
+    if (owners != NULL) {
+      owners[orig] = rank;
+    }
+    if (local_ids == NULL) {
+      continue;
+    }
+    if (rank != p4est->mpirank) {
+      local_ids[orig] = -1;
+      continue;
+    }
+    nt = copy->p.piggy3.which_tree;
+    P4EST_ASSERT (p4est->first_local_tree <= nt &&
+                  nt <= p4est->last_local_tree);
+    if (jt < nt) {
+      jt = nt;
+      zq = 0;
+    }
+    P4EST_ASSERT (jt == nt);
+    tree = p4est_tree_array_index (p4est->trees, jt);
+    /* advance to the last local quadrant that is not beyond the point */
+    while (zq + 1 < tree->quadrants.elem_count &&
+           p4est_quadrant_compare (p4est_quadrant_array_index
+                                   (&tree->quadrants, zq + 1), copy) <= 0) {
+      ++zq;
+    }
+    q = p4est_quadrant_array_index (&tree->quadrants, zq);
+    P4EST_ASSERT (p4est_quadrant_is_equal (q, copy) ||
+                  p4est_quadrant_is_ancestor (q, copy));
+    local_ids[orig] = tree->quadrants_offset + (p4est_locidx_t) zq;
+  }
+  sc_array_destroy (sorted);
+}
+
+/** Resolve a partition-ordered run of locally owned queries.
+ * Each query must be a first descendant at P4EST_QMAXLEVEL with its
+ * piggy3.which_tree member set, as produced by the owner search sort.
+ * \param [out] ids     Filled with the cumulative local index of the
+ *                      leaf containing each query, in query order.
+ */
+static void
+p4est_search_resolve_local (p4est_t * p4est,
+                            const p4est_quadrant_t * queries, size_t count,
+                            p4est_locidx_t * ids)
+{
+  size_t              zz, zq;
+  p4est_topidx_t      jt, nt;
+  p4est_tree_t       *tree;
+  const p4est_quadrant_t *c;
+#ifdef P4EST_DEBUG
+  p4est_quadrant_t   *q;
+#endif
+
+  jt = p4est->first_local_tree;
+  zq = 0;
+  for (zz = 0; zz < count; ++zz) {
+    c = queries + zz;
+    nt = c->p.piggy3.which_tree;
+    P4EST_ASSERT (p4est->first_local_tree <= nt &&
+                  nt <= p4est->last_local_tree);
+    if (jt < nt) {
+      jt = nt;
+      zq = 0;
+    }
+    P4EST_ASSERT (jt == nt);
+    tree = p4est_tree_array_index (p4est->trees, jt);
+    while (zq + 1 < tree->quadrants.elem_count &&
+           p4est_quadrant_compare (p4est_quadrant_array_index
+                                   (&tree->quadrants, zq + 1), c) <= 0) {
+      ++zq;
+    }
+#ifdef P4EST_DEBUG
+    q = p4est_quadrant_array_index (&tree->quadrants, zq);
+    P4EST_ASSERT (p4est_quadrant_is_equal (q, c) ||
+                  p4est_quadrant_is_ancestor (q, c));
+#endif
+    ids[zz] = tree->quadrants_offset + (p4est_locidx_t) zq;
+  }
+}
+
+void
+p4est_search_owners_global (p4est_t * p4est, sc_array_t * points,
+                            int *owners, p4est_locidx_t * remote_ids)
+{
+  int                 mpiret;
+  int                 owner;
+  int                 i, j, s;
+  int                 nsegs, num_queried, num_queriers;
+  int                *seg_ranks, *querier_ranks;
+  int                *queried_ranks, *queried_seg;
+  size_t              zz, np, cnt;
+  size_t             *seg_begin;
+  p4est_locidx_t     *in_counts, *out_counts;
+  p4est_locidx_t    **in_replies, **out_replies;
+  p4est_quadrant_t  **in_queries;
+  p4est_quadrant_t   *p, *copy;
+  p4est_quadrant_t   *gfp = p4est->global_first_position;
+  sc_array_t         *sorted;
+  MPI_Request        *requests;
+  MPI_Status         *statuses;
+
+  P4EST_ASSERT (points->elem_size == sizeof (p4est_quadrant_t));
+  P4EST_ASSERT (remote_ids != NULL);
+
+  np = points->elem_count;
+
+  /* sort a copy of the queries into partition order, remembering the
+   * original position of each point in its piggy3.local_num */
+  sorted = sc_array_new_size (sizeof (p4est_quadrant_t), np);
+  for (zz = 0; zz < np; ++zz) {
+    p = p4est_quadrant_array_index (points, zz);
+    P4EST_ASSERT (p4est_quadrant_is_valid (p));
+    P4EST_ASSERT (0 <= p->p.which_tree &&
+                  p->p.which_tree < p4est->connectivity->num_trees);
+    copy = p4est_quadrant_array_index (sorted, zz);
+    p4est_quadrant_first_descendant (p, copy, P4EST_QMAXLEVEL);
+    copy->p.piggy3.which_tree = p->p.which_tree;
+    copy->p.piggy3.local_num = (p4est_locidx_t) zz;
+  }
+  p4est_quadrant_array_sort_piggy (sorted);
+
+  /* determine the owner of every query and the per-owner segments */
+  seg_ranks = P4EST_ALLOC (int, p4est->mpisize);
+  seg_begin = P4EST_ALLOC (size_t, (size_t) p4est->mpisize + 1);
+  nsegs = 0;
+  owner = 0;
+  for (zz = 0; zz < np; ++zz) {
+    copy = p4est_quadrant_array_index (sorted, zz);
+    while (p4est_quadrant_compare_piggy (&gfp[owner + 1], copy) <= 0) {
+      ++owner;
+      P4EST_ASSERT (owner < p4est->mpisize);
+    }
+    if (owners != NULL) {
+      owners[copy->p.piggy3.local_num] = owner;
+    }
+    if (nsegs == 0 || seg_ranks[nsegs - 1] != owner) {
+      seg_ranks[nsegs] = owner;
+      seg_begin[nsegs] = zz;
+      ++nsegs;
+    }
+  }
+  seg_begin[nsegs] = np;
+
+  /* resolve the locally owned segment without any communication and
+   * collect the remote ranks that have to be queried */
+  queried_ranks = P4EST_ALLOC (int, nsegs);
+  queried_seg = P4EST_ALLOC (int, nsegs);
+  num_queried = 0;
+  for (s = 0; s < nsegs; ++s) {
+    cnt = seg_begin[s + 1] - seg_begin[s];
+    if (seg_ranks[s] == p4est->mpirank) {
+      p4est_locidx_t     *ids = P4EST_ALLOC (p4est_locidx_t, cnt);
+
+      p4est_search_resolve_local (p4est, (p4est_quadrant_t *)
+                                  sc_array_index (sorted, seg_begin[s]),
+                                  cnt, ids);
+      for (zz = 0; zz < cnt; ++zz) {
+        copy = p4est_quadrant_array_index (sorted, seg_begin[s] + zz);
+        remote_ids[copy->p.piggy3.local_num] = ids[zz];
+      }
+      P4EST_FREE (ids);
+    }
+    else {
+      queried_ranks[num_queried] = seg_ranks[s];
+      queried_seg[num_queried] = s;
+      ++num_queried;
+    }
+  }
+
+  /* learn which processors will query this one */
+  querier_ranks = P4EST_ALLOC (int, p4est->mpisize);
+  num_queriers = 0;
+  mpiret = sc_notify (queried_ranks, num_queried,
+                      querier_ranks, &num_queriers, p4est->mpicomm);
+  SC_CHECK_MPI (mpiret);
+
+  requests = P4EST_ALLOC (MPI_Request, num_queried + num_queriers);
+  statuses = P4EST_ALLOC (MPI_Status, num_queried + num_queriers);
+
+  /* exchange the query counts */
+  in_counts = P4EST_ALLOC (p4est_locidx_t, num_queriers);
+  out_counts = P4EST_ALLOC (p4est_locidx_t, num_queried);
+  for (j = 0; j < num_queriers; ++j) {
+    mpiret = MPI_Irecv (in_counts + j, 1, P4EST_MPI_LOCIDX,
+                        querier_ranks[j], P4EST_COMM_SEARCH_COUNT,
+                        p4est->mpicomm, requests + j);
+    SC_CHECK_MPI (mpiret);
+  }
+  for (i = 0; i < num_queried; ++i) {
+    s = queried_seg[i];
+    out_counts[i] = (p4est_locidx_t) (seg_begin[s + 1] - seg_begin[s]);
+    mpiret = MPI_Isend (out_counts + i, 1, P4EST_MPI_LOCIDX,
+                        queried_ranks[i], P4EST_COMM_SEARCH_COUNT,
+                        p4est->mpicomm, requests + num_queriers + i);
+    SC_CHECK_MPI (mpiret);
+  }
+  mpiret = MPI_Waitall (num_queried + num_queriers, requests, statuses);
+  SC_CHECK_MPI (mpiret);
+
+  /* route each query segment directly to its candidate owner */
+  in_queries = P4EST_ALLOC (p4est_quadrant_t *, num_queriers);
+  for (j = 0; j < num_queriers; ++j) {
+    in_queries[j] = P4EST_ALLOC (p4est_quadrant_t, in_counts[j]);
+    mpiret = MPI_Irecv (in_queries[j], (int)
+                        (in_counts[j] * sizeof (p4est_quadrant_t)),
+                        MPI_BYTE, querier_ranks[j], P4EST_COMM_SEARCH_QUERY,
+                        p4est->mpicomm, requests + j);
+    SC_CHECK_MPI (mpiret);
+  }
+  for (i = 0; i < num_queried; ++i) {
+    s = queried_seg[i];
+    mpiret = MPI_Isend (sc_array_index (sorted, seg_begin[s]), (int)
+                        ((size_t) out_counts[i] *
+                         sizeof (p4est_quadrant_t)),
+                        MPI_BYTE, queried_ranks[i], P4EST_COMM_SEARCH_QUERY,
+                        p4est->mpicomm, requests + num_queriers + i);
+    SC_CHECK_MPI (mpiret);
+  }
+  mpiret = MPI_Waitall (num_queried + num_queriers, requests, statuses);
+  SC_CHECK_MPI (mpiret);
+
+  /* answer the incoming queries from the local quadrant arrays */
+  out_replies = P4EST_ALLOC (p4est_locidx_t *, num_queriers);
+  for (j = 0; j < num_queriers; ++j) {
+    out_replies[j] = P4EST_ALLOC (p4est_locidx_t, in_counts[j]);
+    p4est_search_resolve_local (p4est, in_queries[j],
+                                (size_t) in_counts[j], out_replies[j]);
+  }
+
+  /* return the local indices to the queriers */
+  in_replies = P4EST_ALLOC (p4est_locidx_t *, num_queried);
+  for (i = 0; i < num_queried; ++i) {
+    in_replies[i] = P4EST_ALLOC (p4est_locidx_t, out_counts[i]);
+    mpiret = MPI_Irecv (in_replies[i], (int) out_counts[i],
+                        P4EST_MPI_LOCIDX, queried_ranks[i],
+                        P4EST_COMM_SEARCH_REPLY, p4est->mpicomm,
+                        requests + i);
+    SC_CHECK_MPI (mpiret);
+  }
+  for (j = 0; j < num_queriers; ++j) {
+    mpiret = MPI_Isend (out_replies[j], (int) in_counts[j],
+                        P4EST_MPI_LOCIDX, querier_ranks[j],
+                        P4EST_COMM_SEARCH_REPLY, p4est->mpicomm,
+                        requests + num_queried + j);
+    SC_CHECK_MPI (mpiret);
+  }
+  mpiret = MPI_Waitall (num_queried + num_queriers, requests, statuses);
+  SC_CHECK_MPI (mpiret);
+
+  /* scatter the answers back into the caller's original query order */
+  for (i = 0; i < num_queried; ++i) {
+    s = queried_seg[i];
+    for (zz = 0; zz < (size_t) out_counts[i]; ++zz) {
+      copy = p4est_quadrant_array_index (sorted, seg_begin[s] + zz);
+      remote_ids[copy->p.piggy3.local_num] = in_replies[i][zz];
+    }
+    P4EST_FREE (in_replies[i]);
+  }
+  for (j = 0; j < num_queriers; ++j) {
+    P4EST_FREE (in_queries[j]);
+    P4EST_FREE (out_replies[j]);
+  }
+  P4EST_FREE (in_replies);
+  P4EST_FREE (in_queries);
+  P4EST_FREE (out_replies);
+  P4EST_FREE (in_counts);
+  P4EST_FREE (out_counts);
+  P4EST_FREE (requests);
+  P4EST_FREE (statuses);
+  P4EST_FREE (querier_ranks);
+  P4EST_FREE (queried_ranks);
+  P4EST_FREE (queried_seg);
+  P4EST_FREE (seg_ranks);
+  P4EST_FREE (seg_begin);
+  sc_array_destroy (sorted);
+}
+
+void
+p4est_interior_postorder (p4est_t * p4est, p4est_interior_node_t node_fn,
+                          void *user_data)
+{
+  int                 l, top;
+  size_t              zz, incount;
+  p4est_topidx_t      nt;
+  p4est_tree_t       *tree;
+  sc_array_t         *tquadrants;
+  p4est_quadrant_t   *q;
+  p4est_quadrant_t    nca, prev;
+  p4est_quadrant_t    anc[P4EST_QMAXLEVEL + 1];
+  p4est_locidx_t      abegin[P4EST_QMAXLEVEL + 1];
+
+  P4EST_ASSERT (p4est_is_valid (p4est));
+  P4EST_ASSERT (node_fn != NULL);
+
+  for (nt = p4est->first_local_tree; nt <= p4est->last_local_tree; ++nt) {
+    tree = p4est_tree_array_index (p4est->trees, nt);
+    tquadrants = &tree->quadrants;
+    incount = tquadrants->elem_count;
+    if (incount == 0) {
+      continue;
+    }
+
+    /* open all ancestors of the first leaf */
+    q = p4est_quadrant_array_index (tquadrants, 0);
+    prev = *q;
+    top = (int) q->level - 1;
+    for (l = 0; l <= top; ++l) {
+      p4est_quadrant_ancestor (q, l, &anc[l]);
+      abegin[l] = 0;
+    }
+
+    for (zz = 1; zz < incount; ++zz) {
+      q = p4est_quadrant_array_index (tquadrants, zz);
+      p4est_nearest_common_ancestor (&prev, q, &nca);
+      P4EST_ASSERT ((int) nca.level < (int) q->level);
+
+      /* ancestors deeper than the common one are complete: close them
+       * from the deepest up, which yields the post-order */
+      for (l = top; l > (int) nca.level; --l) {
+        node_fn (p4est, nt, &anc[l], abegin[l], (p4est_locidx_t) zz,
+                 user_data);
+      }
+
+      /* open the new ancestors introduced by this leaf */
+      for (l = (int) nca.level + 1; l < (int) q->level; ++l) {
+        p4est_quadrant_ancestor (q, l, &anc[l]);
+        abegin[l] = (p4est_locidx_t) zz;
+      }
+      top = (int) q->level - 1;
+      prev = *q;
+    }
+
+    /* close the ancestors of the last leaf, ending with the root */
+    for (l = top; l >= 0; --l) {
+      node_fn (p4est, nt, &anc[l], abegin[l], (p4est_locidx_t) incount,
+               user_data);
+    }
+  }
+}
+
+/** Pick the bucket level of a tree's lookup table.
+ * The level grows while the table stays within twice the number of
+ * leaves, so the average bucket holds only a handful of leaves and the
+ * table costs a small constant factor of the leaf storage.
+ */
+static int
+p4est_search_index_level (size_t count)
+{
+  int                 k;
+
+  k = 0;
+  while (k < P4EST_QMAXLEVEL &&
+         ((size_t) 1 << (P4EST_DIM * (k + 1))) <= 2 * count) {
+    ++k;
+  }
+  return k;
+}
+
+p4est_search_index_t *
+p4est_search_index_new (p4est_t * p4est)
+{
+  int                 k;
+  size_t              zz, incount, nb, pos;
+  uint64_t            cell;
+  uint64_t           *keys;
+  p4est_topidx_t      nt, num_local_trees;
+  p4est_tree_t       *tree;
+  p4est_locidx_t     *table;
+  p4est_search_index_t *sindex;
+
+  sindex = P4EST_ALLOC (p4est_search_index_t, 1);
+  sindex->first_local_tree = p4est->first_local_tree;
+  sindex->last_local_tree = p4est->last_local_tree;
+  sindex->revision = p4est->revision;
+  num_local_trees = SC_MAX (sindex->last_local_tree -
+                            sindex->first_local_tree + 1, 0);
+  sindex->tree_levels = P4EST_ALLOC (int, num_local_trees);
+  sindex->tree_tables = P4EST_ALLOC (p4est_locidx_t *, num_local_trees);
+  sindex->tree_keys = P4EST_ALLOC (uint64_t *, num_local_trees);
+
+  for (nt = 0; nt < num_local_trees; ++nt) {
+    tree = p4est_tree_array_index (p4est->trees,
+                                   sindex->first_local_tree + nt);
+    incount = tree->quadrants.elem_count;
+    keys = p4est_quadrant_array_morton_keys (&tree->quadrants);
+    k = p4est_search_index_level (incount);
+    nb = (size_t) 1 << (P4EST_DIM * k);
+    table = P4EST_ALLOC (p4est_locidx_t, nb + 1);
+
+    /* one sweep over the sorted keys: bucket b receives the index of
+     * the first leaf whose level-k cell is not before b */
+    pos = 0;
+    for (zz = 0; zz < incount; ++zz) {
+      cell = (keys[zz] >> 6) >> (P4EST_DIM * (P4EST_QMAXLEVEL - k));
+      P4EST_ASSERT (cell < (uint64_t) nb);
+      while (pos <= (size_t) cell) {
+        table[pos++] = (p4est_locidx_t) zz;
+      }
+    }
+    while (pos <= nb) {
+      table[pos++] = (p4est_locidx_t) incount;
+    }
+
+    sindex->tree_levels[nt] = k;
+    sindex->tree_tables[nt] = table;
+    sindex->tree_keys[nt] = keys;
+  }
+
+  return sindex;
+}
+
+p4est_locidx_t
+p4est_search_index_query (p4est_search_index_t * sindex, p4est_t * p4est,
+                          p4est_topidx_t which_tree,
+                          const p4est_quadrant_t * point)
+{
+  int                 k;
+  size_t              lo, hi;
+  ssize_t             sz;
+  uint64_t            pkey, cell;
+  const uint64_t     *keys;
+  const p4est_locidx_t *table;
+  p4est_topidx_t      jt;
+  p4est_tree_t       *tree;
+  p4est_quadrant_t    fd;
+
+  P4EST_ASSERT (sindex->revision == p4est->revision);
+  P4EST_ASSERT (p4est_quadrant_is_valid (point));
+  P4EST_ASSERT (0 <= which_tree &&
+                which_tree < p4est->connectivity->num_trees);
+
+  if (which_tree < sindex->first_local_tree ||
+      which_tree > sindex->last_local_tree) {
+    return -1;
+  }
+  jt = which_tree - sindex->first_local_tree;
+  k = sindex->tree_levels[jt];
+  table = sindex->tree_tables[jt];
+  keys = sindex->tree_keys[jt];
+
+  /* the queried position is the point's first descendant, i.e. its
+   * lower left corner, exactly as in p4est_search_owners; its key has
+   * the maximal level bits, so every leaf covering the position
+   * compares less equal to it */
+  p4est_quadrant_first_descendant (point, &fd, P4EST_QMAXLEVEL);
+  pkey = p4est_quadrant_morton_key (&fd);
+
+  /* one table lookup narrows the candidates to the leaves starting in
+   * the point's level-k cell plus the one leaf that may span into the
+   * cell from before */
+  cell = (pkey >> 6) >> (P4EST_DIM * (P4EST_QMAXLEVEL - k));
+  lo = (table[cell] > 0) ? (size_t) table[cell] - 1 : 0;
+  hi = (size_t) table[cell + 1];
+
+  sz = p4est_find_higher_bound_key (keys + lo, hi - lo, pkey);
+  if (sz < 0) {
+    /* the position lies before this processor's first leaf */
+    return -1;
+  }
+  lo += (size_t) sz;
+
+  /* the candidate is the last leaf not beyond the position; it misses
+   * the point only when the position lies beyond the local range of a
+   * partially owned tree */
+  if (keys[lo] != pkey &&
+      !p4est_morton_key_is_ancestor (keys[lo], pkey)) {
+    return -1;
+  }
+
+  tree = p4est_tree_array_index (p4est->trees, which_tree);
+  P4EST_ASSERT (lo < tree->quadrants.elem_count);
+
+  return tree->quadrants_offset + (p4est_locidx_t) lo;
+}
+
+void
+p4est_search_index_destroy (p4est_search_index_t * sindex)
+{
+  p4est_topidx_t      nt, num_local_trees;
+
+  num_local_trees = SC_MAX (sindex->last_local_tree -
+                            sindex->first_local_tree + 1, 0);
+  for (nt = 0; nt < num_local_trees; ++nt) {
+    P4EST_FREE (sindex->tree_tables[nt]);
+    P4EST_FREE (sindex->tree_keys[nt]);
+  }
+  P4EST_FREE (sindex->tree_levels);
+  P4EST_FREE (sindex->tree_tables);
+  P4EST_FREE (sindex->tree_keys);
+  P4EST_FREE (sindex);
+}
@@ -31,6 +31,7 @@
 
 /* redefine macros */
 #define P4EST_ONDISK_FORMAT             P8EST_ONDISK_FORMAT
+#define P4EST_ONDISK_FORMAT_MAPPED      P8EST_ONDISK_FORMAT_MAPPED
 #define P4EST_DIM                       P8EST_DIM
 #define P4EST_FACES                     P8EST_FACES
 #define P4EST_CHILDREN                  P8EST_CHILDREN
@@ -57,13 +58,50 @@
 #define P4EST_COMM_PARTITION_CORRECTION P8EST_COMM_PARTITION_CORRECTION
 #define P4EST_COMM_GHOST_COUNT          P8EST_COMM_GHOST_COUNT
 #define P4EST_COMM_GHOST_LOAD           P8EST_COMM_GHOST_LOAD
+#define P4EST_COMM_GHOST_DATA_COUNT     P8EST_COMM_GHOST_DATA_COUNT
+#define P4EST_COMM_GHOST_DATA_QUERY     P8EST_COMM_GHOST_DATA_QUERY
+#define P4EST_COMM_GHOST_DATA_REPLY     P8EST_COMM_GHOST_DATA_REPLY
+#define P4EST_COMM_GHOST_EXPAND_COUNT   P8EST_COMM_GHOST_EXPAND_COUNT
+#define P4EST_COMM_GHOST_EXPAND_QUERY   P8EST_COMM_GHOST_EXPAND_QUERY
+#define P4EST_COMM_GHOST_EXPAND_REPLY_COUNT P8EST_COMM_GHOST_EXPAND_REPLY_COUNT
+#define P4EST_COMM_GHOST_EXPAND_REPLY   P8EST_COMM_GHOST_EXPAND_REPLY
 #define P4EST_COMM_NODES_QUERY          P8EST_COMM_NODES_QUERY
 #define P4EST_COMM_NODES_REPLY          P8EST_COMM_NODES_REPLY
 #define P4EST_COMM_SAVE                 P8EST_COMM_SAVE
+#define P4EST_COMM_TRANSMIT_COUNT       P8EST_COMM_TRANSMIT_COUNT
+#define P4EST_COMM_TRANSMIT_LOAD        P8EST_COMM_TRANSMIT_LOAD
 #define P4EST_COMM_LNODES_TEST          P8EST_COMM_LNODES_TEST
 #define P4EST_COMM_LNODES_PASS          P8EST_COMM_LNODES_PASS
 #define P4EST_COMM_LNODES_OWNED         P8EST_COMM_LNODES_OWNED
 #define P4EST_COMM_LNODES_ALL           P8EST_COMM_LNODES_ALL
+#define P4EST_COMM_SEARCH_COUNT         P8EST_COMM_SEARCH_COUNT
+#define P4EST_COMM_SEARCH_QUERY         P8EST_COMM_SEARCH_QUERY
+#define P4EST_COMM_SEARCH_REPLY         P8EST_COMM_SEARCH_REPLY
+#define P4EST_COMM_NOTIFY_PAYLOAD       P8EST_COMM_NOTIFY_PAYLOAD
+#define P4EST_COMM_NOTIFY_PAYLOAD2      P8EST_COMM_NOTIFY_PAYLOAD2
+#define P4EST_COMM_VTK                  P8EST_COMM_VTK
+#define P4EST_COMM_FIELDS               P8EST_COMM_FIELDS
+#define P4EST_PROFILE_REFINE            P8EST_PROFILE_REFINE
+#define P4EST_PROFILE_BALANCE           P8EST_PROFILE_BALANCE
+#define P4EST_PROFILE_PARTITION         P8EST_PROFILE_PARTITION
+#define P4EST_PROFILE_GHOST             P8EST_PROFILE_GHOST
+#define P4EST_PROFILE_ITERATE           P8EST_PROFILE_ITERATE
+#define P4EST_PROFILE_LNODES            P8EST_PROFILE_LNODES
+#define P4EST_PROFILE_NUM_PHASES        P8EST_PROFILE_NUM_PHASES
+#define P4EST_WORKSPACE_BALANCE_REQUESTS P8EST_WORKSPACE_BALANCE_REQUESTS
+#define P4EST_WORKSPACE_BALANCE_STATUSES P8EST_WORKSPACE_BALANCE_STATUSES
+#define P4EST_WORKSPACE_BALANCE_INDICES P8EST_WORKSPACE_BALANCE_INDICES
+#define P4EST_WORKSPACE_BALANCE_PEERS   P8EST_WORKSPACE_BALANCE_PEERS
+#define P4EST_WORKSPACE_GHOST_RECV_REQUESTS P8EST_WORKSPACE_GHOST_RECV_REQUESTS
+#define P4EST_WORKSPACE_GHOST_RECV_STATUSES P8EST_WORKSPACE_GHOST_RECV_STATUSES
+#define P4EST_WORKSPACE_GHOST_SEND_REQUESTS P8EST_WORKSPACE_GHOST_SEND_REQUESTS
+#define P4EST_WORKSPACE_GHOST_SEND_STATUSES P8EST_WORKSPACE_GHOST_SEND_STATUSES
+#define P4EST_WORKSPACE_GHOST_COUNTS    P8EST_WORKSPACE_GHOST_COUNTS
+#define P4EST_WORKSPACE_GHOST_HEADERS   P8EST_WORKSPACE_GHOST_HEADERS
+#define P4EST_WORKSPACE_NODES_STATUS    P8EST_WORKSPACE_NODES_STATUS
+#define P4EST_WORKSPACE_NODES_PROCS     P8EST_WORKSPACE_NODES_PROCS
+#define P4EST_WORKSPACE_NODES_PEERS     P8EST_WORKSPACE_NODES_PEERS
+#define P4EST_WORKSPACE_NUM_SLOTS       P8EST_WORKSPACE_NUM_SLOTS
 #define P4EST_CONNECT_DEFAULT           P8EST_CONNECT_DEFAULT
 #define P4EST_CONNECT_FULL              P8EST_CONNECT_FULL
 #define P4EST_CONN_ENCODE_NONE          P8EST_CONN_ENCODE_NONE
@@ -74,6 +112,9 @@
 #define p4est_connect_type_t            p8est_connect_type_t
 #define p4est_connectivity_encode_t     p8est_connectivity_encode_t
 #define p4est_connectivity_t            p8est_connectivity_t
+#define p4est_connectivity_window       p8est_connectivity_window
+#define p4est_connectivity_window_t     p8est_connectivity_window_t
+#define p4est_brick_t                   p8est_brick_t
 #define p4est_corner_transform_t        p8est_corner_transform_t
 #define p4est_corner_info_t             p8est_corner_info_t
 #define p4est_geometry_t                p8est_geometry_t
@@ -81,19 +122,49 @@
 #define p4est_tree_t                    p8est_tree_t
 #define p4est_quadrant_t                p8est_quadrant_t
 #define p4est_inspect_t                 p8est_inspect_t
+#define p4est_profile_phase             p8est_profile_phase
+#define p4est_profile_phase_t           p8est_profile_phase_t
+#define p4est_profile_t                 p8est_profile_t
+#define p4est_workspace                 p8est_workspace
+#define p4est_workspace_t               p8est_workspace_t
+#define p4est_workspace_slot            p8est_workspace_slot
+#define p4est_workspace_slot_t          p8est_workspace_slot_t
+#define p4est_view                      p8est_view
+#define p4est_view_t                    p8est_view_t
+#define p4est_snapshot_segment          p8est_snapshot_segment
+#define p4est_snapshot_segment_t        p8est_snapshot_segment_t
+#define p4est_snapshot                  p8est_snapshot
+#define p4est_snapshot_t                p8est_snapshot_t
+#define p4est_paged_data                p8est_paged_data
+#define p4est_paged_data_t              p8est_paged_data_t
+#define p4est_context                   p8est_context
+#define p4est_context_t                 p8est_context_t
 #define p4est_position_t                p8est_position_t
 #define p4est_init_t                    p8est_init_t
+#define p4est_pack_data_t               p8est_pack_data_t
+#define p4est_unpack_data_t             p8est_unpack_data_t
 #define p4est_refine_t                  p8est_refine_t
 #define p4est_refine_ext_t              p8est_refine_ext_t
+#define p4est_replace_t                 p8est_replace_t
 #define p4est_coarsen_t                 p8est_coarsen_t
 #define p4est_weight_t                  p8est_weight_t
 #define p4est_ghost_t                   p8est_ghost_t
+#define p4est_ghost_packed              p8est_ghost_packed
+#define p4est_ghost_packed_t            p8est_ghost_packed_t
+#define p4est_ghost_compact             p8est_ghost_compact
+#define p4est_ghost_compact_t           p8est_ghost_compact_t
 #define p4est_indep_t                   p8est_indep_t
 #define p4est_nodes_t                   p8est_nodes_t
 #define p4est_lnodes_t                  p8est_lnodes_t
 #define p4est_lnodes_code_t             p8est_lnodes_code_t
 #define p4est_lnodes_rank_t             p8est_lnodes_rank_t
 #define p4est_lnodes_buffer_t           p8est_lnodes_buffer_t
+#define p4est_lnodes_transfer           p8est_lnodes_transfer
+#define p4est_lnodes_context            p8est_lnodes_context
+#define p4est_lnodes_context_t          p8est_lnodes_context_t
+#define p4est_lnodes_transfer_t         p8est_lnodes_transfer_t
+#define p4est_lnodes_weights            p8est_lnodes_weights
+#define p4est_lnodes_weights_t          p8est_lnodes_weights_t
 #define p4est_iter_volume_t             p8est_iter_volume_t
 #define p4est_iter_volume_info_t        p8est_iter_volume_info_t
 #define p4est_iter_face_t               p8est_iter_face_t
@@ -102,9 +173,35 @@
 #define p4est_iter_corner_t             p8est_iter_corner_t
 #define p4est_iter_corner_side_t        p8est_iter_corner_side_t
 #define p4est_iter_corner_info_t        p8est_iter_corner_info_t
+#define P4EST_ITER_BATCH_SIZE           P8EST_ITER_BATCH_SIZE
+#define p4est_iter_volume_batch_t       p8est_iter_volume_batch_t
+#define p4est_iter_boundary_face_t      p8est_iter_boundary_face_t
+#define p4est_iter_volume_batch_info_t  p8est_iter_volume_batch_info_t
+#define p4est_iter_face_batch_t         p8est_iter_face_batch_t
+#define p4est_iter_face_batch_info_t    p8est_iter_face_batch_info_t
+#define p4est_iter_plan                 p8est_iter_plan
+#define p4est_iter_plan_t               p8est_iter_plan_t
+#define p4est_iter_corner_cache         p8est_iter_corner_cache
+#define p4est_iter_corner_cache_t       p8est_iter_corner_cache_t
+#define p4est_iter_level                p8est_iter_level
+#define p4est_iter_level_t              p8est_iter_level_t
 #define p4est_search_query_t            p8est_search_query_t
+#define p4est_search_quadrant_t         p8est_search_quadrant_t
+#define p4est_search_index              p8est_search_index
+#define p4est_search_index_t            p8est_search_index_t
 #define p4est_mesh_t                    p8est_mesh_t
 #define p4est_mesh_face_neighbor_t      p8est_mesh_face_neighbor_t
+#define p4est_mesh_mirror               p8est_mesh_mirror
+#define p4est_mesh_mirror_t             p8est_mesh_mirror_t
+#define p4est_mesh_mirror_copy_t        p8est_mesh_mirror_copy_t
+#define p4est_field                     p8est_field
+#define p4est_field_t                   p8est_field_t
+#define p4est_fields                    p8est_fields
+#define p4est_fields_t                  p8est_fields_t
+#define p4est_hierarchy_level           p8est_hierarchy_level
+#define p4est_hierarchy_level_t         p8est_hierarchy_level_t
+#define p4est_hierarchy                 p8est_hierarchy
+#define p4est_hierarchy_t               p8est_hierarchy_t
 #define p4est_wrap_t                    p8est_wrap_t
 #define p4est_wrap_leaf_t               p8est_wrap_leaf_t
 #define p4est_wrap_flags_t              p8est_wrap_flags_t
@@ -122,62 +219,169 @@
 #define p4est_connectivity_memory_used  p8est_connectivity_memory_used
 #define p4est_connectivity_new          p8est_connectivity_new
 #define p4est_connectivity_new_brick    p8est_connectivity_new_brick
+#define p4est_brick_tree_coordinates    p8est_brick_tree_coordinates
+#define p4est_brick_tree_index          p8est_brick_tree_index
+#define p4est_brick_face_neighbor       p8est_brick_face_neighbor
 #define p4est_connectivity_new_copy     p8est_connectivity_new_copy
 #define p4est_connectivity_destroy      p8est_connectivity_destroy
+#define p4est_connectivity_share        p8est_connectivity_share
 #define p4est_connectivity_set_attr     p8est_connectivity_set_attr
 #define p4est_connectivity_is_valid     p8est_connectivity_is_valid
 #define p4est_connectivity_is_equal     p8est_connectivity_is_equal
 #define p4est_connectivity_sink         p8est_connectivity_sink
 #define p4est_connectivity_deflate      p8est_connectivity_deflate
 #define p4est_connectivity_save         p8est_connectivity_save
+#define p4est_connectivity_save_mapped  p8est_connectivity_save_mapped
 #define p4est_connectivity_source       p8est_connectivity_source
 #define p4est_connectivity_inflate      p8est_connectivity_inflate
 #define p4est_connectivity_load         p8est_connectivity_load
+#define p4est_connectivity_load_mapped  p8est_connectivity_load_mapped
+#define p4est_connectivity_window_open  p8est_connectivity_window_open
+#define p4est_connectivity_window_tree_to_tree \
+                                        p8est_connectivity_window_tree_to_tree
+#define p4est_connectivity_window_tree_to_face \
+                                        p8est_connectivity_window_tree_to_face
+#define p4est_connectivity_window_tree_to_vertex \
+                                        p8est_connectivity_window_tree_to_vertex
+#define p4est_connectivity_window_close p8est_connectivity_window_close
 #define p4est_connectivity_complete     p8est_connectivity_complete
 #define p4est_find_face_transform       p8est_find_face_transform
 #define p4est_find_corner_transform     p8est_find_corner_transform
 #define p4est_corner_array_index        p8est_corner_array_index
 #define p4est_connectivity_reorder      p8est_connectivity_reorder
 #define p4est_connectivity_permute      p8est_connectivity_permute
+#define p4est_connectivity_reorder_sfc  p8est_connectivity_reorder_sfc
 
 /* functions in p4est */
 #define p4est_qcoord_to_vertex          p8est_qcoord_to_vertex
 #define p4est_memory_used               p8est_memory_used
+#define p4est_inspect_print             p8est_inspect_print
+#define p4est_view_new                  p8est_view_new
+#define p4est_view_tree                 p8est_view_tree
+#define p4est_view_destroy              p8est_view_destroy
+#define p4est_view_preserve             p8est_view_preserve
+#define p4est_view_preserve_all         p8est_view_preserve_all
 #define p4est_new                       p8est_new
 #define p4est_destroy                   p8est_destroy
 #define p4est_copy                      p8est_copy
 #define p4est_reset_data                p8est_reset_data
+#define p4est_set_data_serializer       p8est_set_data_serializer
+#define p4est_set_num_threads           p8est_set_num_threads
+#define p4est_set_profile_hook          p8est_set_profile_hook
+#define p4est_profile_fire              p8est_profile_fire
+#define p4est_workspace_new             p8est_workspace_new
+#define p4est_workspace_destroy         p8est_workspace_destroy
+#define p4est_workspace_attach          p8est_workspace_attach
+#define p4est_workspace_get             p8est_workspace_get
+#define p4est_workspace_release         p8est_workspace_release
+#define p4est_set_balance_chunk         p8est_set_balance_chunk
 #define p4est_refine                    p8est_refine
 #define p4est_coarsen                   p8est_coarsen
 #define p4est_balance                   p8est_balance
 #define p4est_partition                 p8est_partition
+#define p4est_shrink                    p8est_shrink
+#define p4est_expand                    p8est_expand
 #define p4est_checksum                  p8est_checksum
+#define p4est_checksum_cache            p8est_checksum_cache
+#define p4est_checksum_cache_t          p8est_checksum_cache_t
+#define p4est_checksum_cache_new        p8est_checksum_cache_new
+#define p4est_checksum_cache_mark       p8est_checksum_cache_mark
+#define p4est_checksum_cached           p8est_checksum_cached
+#define p4est_checksum_cache_destroy    p8est_checksum_cache_destroy
+#define p4est_revision                  p8est_revision
+#define p4est_change                    p8est_change
+#define p4est_change_t                  p8est_change_t
+#define p4est_changes_begin             p8est_changes_begin
+#define p4est_changes_end               p8est_changes_end
 #define p4est_save                      p8est_save
+#define p4est_checkpoint                p8est_checkpoint
+#define p4est_checkpoint_t              p8est_checkpoint_t
+#define p4est_checkpoint_begin          p8est_checkpoint_begin
+#define p4est_checkpoint_end            p8est_checkpoint_end
 #define p4est_load                      p8est_load
 #define p4est_connect_type_int          p8est_connect_type_int
 #define p4est_connect_type_string       p8est_connect_type_string
 #define p4est_tree_array_index          p8est_tree_array_index
+#define p4est_tree_quadrants_offset     p8est_tree_quadrants_offset
 #define p4est_quadrant_array_index      p8est_quadrant_array_index
+#define p4est_tree_quadrants_base       p8est_tree_quadrants_base
+#define p4est_tree_num_quadrants        p8est_tree_num_quadrants
+#define p4est_tree_is_uniform           p8est_tree_is_uniform
 #define p4est_quadrant_array_push       p8est_quadrant_array_push
 #define p4est_quadrant_mempool_alloc    p8est_quadrant_mempool_alloc
 #define p4est_quadrant_list_pop         p8est_quadrant_list_pop
 
 /* functions in p4est_extended */
 #define p4est_new_ext                   p8est_new_ext
+#define p4est_new_brick                 p8est_new_brick
+#define p4est_compact_data              p8est_compact_data
+#define p4est_compact_data_blocked      p8est_compact_data_blocked
+#define p4est_uncompact_data            p8est_uncompact_data
+#define p4est_balance_incremental       p8est_balance_incremental
 #define p4est_refine_ext                p8est_refine_ext
+#define p4est_refine_balance            p8est_refine_balance
+#define p4est_context_new               p8est_context_new
+#define p4est_context_destroy           p8est_context_destroy
+#define p4est_new_context               p8est_new_context
+#define p4est_coarsen_ext               p8est_coarsen_ext
 #define p4est_partition_ext             p8est_partition_ext
+#define p4est_weight_channel_t          p8est_weight_channel_t
+#define p4est_partition_weighted        p8est_partition_weighted
+#define p4est_data_bytes_t              p8est_data_bytes_t
+#define p4est_partition_bytes           p8est_partition_bytes
+#define p4est_partition_advisor         p8est_partition_advisor
+#define p4est_partition_advisor_t       p8est_partition_advisor_t
+#define p4est_partition_advisor_new     p8est_partition_advisor_new
+#define p4est_partition_advisor_destroy p8est_partition_advisor_destroy
+#define p4est_partition_advisor_step    p8est_partition_advisor_step
+#define p4est_partition_advisor_record  p8est_partition_advisor_record
+#define p4est_partition_advisor_recommend p8est_partition_advisor_recommend
+#define p4est_partition_diffusive       p8est_partition_diffusive
+#define p4est_journal                   p8est_journal
+#define p4est_journal_t                 p8est_journal_t
+#define p4est_journal_new               p8est_journal_new
+#define p4est_journal_destroy           p8est_journal_destroy
+#define p4est_refine_journal            p8est_refine_journal
+#define p4est_coarsen_journal           p8est_coarsen_journal
+#define p4est_balance_journal           p8est_balance_journal
+#define p4est_partition_journal         p8est_partition_journal
+#define p4est_journal_replay            p8est_journal_replay
 #define p4est_save_ext                  p8est_save_ext
 #define p4est_load_ext                  p8est_load_ext
+#define p4est_load_window               p8est_load_window
+#define p4est_save_mixed                p8est_save_mixed
+#define p4est_load_mixed                p8est_load_mixed
 
 /* functions in p4est_iterate */
 #define p4est_iterate                   p8est_iterate
+#define p4est_iterate_threaded          p8est_iterate_threaded
+#define p4est_numa_first_touch          p8est_numa_first_touch
+#define p4est_iterate_batched           p8est_iterate_batched
+#define p4est_iterate_ghost_data        p8est_iterate_ghost_data
+#define p4est_iter_plan_new             p8est_iter_plan_new
+#define p4est_iterate_plan              p8est_iterate_plan
+#define p4est_iter_plan_color_faces     p8est_iter_plan_color_faces
+#define p4est_iter_plan_destroy         p8est_iter_plan_destroy
+#define p4est_iter_corner_cache_new     p8est_iter_corner_cache_new
+#define p4est_iterate_corner_cached     p8est_iterate_corner_cached
+#define p4est_iter_corner_cache_destroy p8est_iter_corner_cache_destroy
+#define p4est_iter_level_new            p8est_iter_level_new
+#define p4est_iter_level_update         p8est_iter_level_update
+#define p4est_iterate_level             p8est_iterate_level
+#define p4est_iter_level_destroy        p8est_iter_level_destroy
+#define p4est_iterate_window            p8est_iterate_window
+#define p4est_iterate_boundary_faces    p8est_iterate_boundary_faces
 #define p4est_iter_fside_array_index    p8est_iter_fside_array_index
 #define p4est_iter_fside_array_index_int p8est_iter_fside_array_index_int
 #define p4est_iter_cside_array_index    p8est_iter_cside_array_index
 #define p4est_iter_cside_array_index_int p8est_iter_cside_array_index_int
 
 /* functions in p4est_points */
+#define p4est_points_buffer_t           p8est_points_buffer_t
 #define p4est_new_points                p8est_new_points
+#define p4est_points_buffer_new         p8est_points_buffer_new
+#define p4est_points_buffer_add         p8est_points_buffer_add
+#define p4est_points_buffer_destroy     p8est_points_buffer_destroy
 
 /* functions in p4est_bits */
 #define p4est_quadrant_print            p8est_quadrant_print
@@ -221,10 +425,14 @@
 #define p4est_quadrant_parent           p8est_quadrant_parent
 #define p4est_quadrant_sibling          p8est_quadrant_sibling
 #define p4est_quadrant_face_neighbor    p8est_quadrant_face_neighbor
+#define p4est_quadrant_face_neighbors_batch \
+                                        p8est_quadrant_face_neighbors_batch
 #define p4est_quadrant_face_neighbor_extra p8est_quadrant_face_neighbor_extra
 #define p4est_quadrant_half_face_neighbors p8est_quadrant_half_face_neighbors
 #define p4est_quadrant_all_face_neighbors p8est_quadrant_all_face_neighbors
 #define p4est_quadrant_corner_neighbor  p8est_quadrant_corner_neighbor
+#define p4est_quadrant_corner_neighbors_batch \
+                                        p8est_quadrant_corner_neighbors_batch
 #define p4est_quadrant_corner_neighbor_extra \
                                         p8est_quadrant_corner_neighbor_extra
 #define p4est_quadrant_half_corner_neighbor \
@@ -239,18 +447,42 @@
 #define p4est_nearest_common_ancestor   p8est_nearest_common_ancestor
 #define p4est_nearest_common_ancestor_D p8est_nearest_common_ancestor_D
 #define p4est_quadrant_transform_face   p8est_quadrant_transform_face
+#define p4est_quadrant_transform_face_fast \
+                                        p8est_quadrant_transform_face_fast
 #define p4est_quadrant_touches_corner   p8est_quadrant_touches_corner
 #define p4est_quadrant_transform_corner p8est_quadrant_transform_corner
 #define p4est_quadrant_shift_corner     p8est_quadrant_shift_corner
 #define p4est_quadrant_linear_id        p8est_quadrant_linear_id
 #define p4est_quadrant_set_morton       p8est_quadrant_set_morton
+#define p4est_quadrant_morton_key       p8est_quadrant_morton_key
+#define p4est_quadrant_array_morton_keys p8est_quadrant_array_morton_keys
+#define p4est_morton_key_is_ancestor    p8est_morton_key_is_ancestor
+#define p4est_morton_key_lower_bound    p8est_morton_key_lower_bound
+#define p4est_interval                  p8est_interval
+#define p4est_interval_t                p8est_interval_t
+#define p4est_interval_from_quadrant    p8est_interval_from_quadrant
+#define p4est_interval_set_is_valid     p8est_interval_set_is_valid
+#define p4est_interval_set_union        p8est_interval_set_union
+#define p4est_interval_set_intersection p8est_interval_set_intersection
+#define p4est_interval_set_difference   p8est_interval_set_difference
+#define p4est_interval_set_contains     p8est_interval_set_contains
 
 /* functions in p4est_search */
 #define p4est_find_lower_bound          p8est_find_lower_bound
 #define p4est_find_higher_bound         p8est_find_higher_bound
+#define p4est_find_lower_bound_key      p8est_find_lower_bound_key
+#define p4est_find_higher_bound_key     p8est_find_higher_bound_key
 #define p4est_split_array               p8est_split_array
 #define p4est_find_range_boundaries     p8est_find_range_boundaries
 #define p4est_search                    p8est_search
+#define p4est_search_quadrants          p8est_search_quadrants
+#define p4est_search_owners             p8est_search_owners
+#define p4est_search_owners_global      p8est_search_owners_global
+#define p4est_interior_node_t           p8est_interior_node_t
+#define p4est_interior_postorder        p8est_interior_postorder
+#define p4est_search_index_new          p8est_search_index_new
+#define p4est_search_index_query        p8est_search_index_query
+#define p4est_search_index_destroy      p8est_search_index_destroy
 
 /* functions in p4est_algorithms */
 #define p4est_quadrant_init_data        p8est_quadrant_init_data
@@ -262,46 +494,138 @@
 #define p4est_tree_is_complete          p8est_tree_is_complete
 #define p4est_tree_print                p8est_tree_print
 #define p4est_is_equal                  p8est_is_equal
+#define p4est_diff_type                 p8est_diff_type
+#define p4est_diff_type_t               p8est_diff_type_t
+#define P4EST_DIFF_REFINED              P8EST_DIFF_REFINED
+#define P4EST_DIFF_COARSENED            P8EST_DIFF_COARSENED
+#define P4EST_DIFF_MOVED                P8EST_DIFF_MOVED
+#define p4est_diff_t                    p8est_diff_t
+#define p4est_diff                      p8est_diff
+#define p4est_traversal_key_t           p8est_traversal_key_t
+#define p4est_traversal_pair            p8est_traversal_pair
+#define p4est_traversal_pair_t          p8est_traversal_pair_t
+#define p4est_traversal_pair_compare    p8est_traversal_pair_compare
+#define p4est_traversal_level_order     p8est_traversal_level_order
+#define p4est_traversal_key_order       p8est_traversal_key_order
 #define p4est_is_valid                  p8est_is_valid
+#define p4est_is_coherent               p8est_is_coherent
 #define p4est_tree_compute_overlap      p8est_tree_compute_overlap
 #define p4est_tree_uniqify_overlap      p8est_tree_uniqify_overlap
 #define p4est_tree_remove_nonowned      p8est_tree_remove_nonowned
 #define p4est_complete_region           p8est_complete_region
+#define p4est_complete_region_counted   p8est_complete_region_counted
 #define p4est_complete_subtree          p8est_complete_subtree
 #define p4est_balance_subtree           p8est_balance_subtree
 #define p4est_balance_border            p8est_balance_border
 #define p4est_linearize_tree            p8est_linearize_tree
+#define p4est_quadrant_run              p8est_quadrant_run
+#define p4est_quadrant_run_t            p8est_quadrant_run_t
+#define p4est_quadrant_array_compress   p8est_quadrant_array_compress
+#define p4est_quadrant_array_uncompress p8est_quadrant_array_uncompress
+#define p4est_quadrant_array_reserve    p8est_quadrant_array_reserve
+#define p4est_quadrant_array_swap       p8est_quadrant_array_swap
+#define p4est_quadrant_array_sort       p8est_quadrant_array_sort
+#define p4est_quadrant_array_sort_piggy p8est_quadrant_array_sort_piggy
 #define p4est_next_nonempty_process     p8est_next_nonempty_process
 #define p4est_partition_correction      p8est_partition_correction
 #define p4est_partition_given           p8est_partition_given
+#define p4est_partition_context         p8est_partition_context
+#define p4est_partition_context_t       p8est_partition_context_t
+#define p4est_partition_given_begin     p8est_partition_given_begin
+#define p4est_partition_given_end       p8est_partition_given_end
 
 /* functions in p4est_communication */
 #define p4est_comm_count_quadrants      p8est_comm_count_quadrants
 #define p4est_comm_global_partition     p8est_comm_global_partition
 #define p4est_comm_count_pertree        p8est_comm_count_pertree
+#define p4est_comm_count_pertree_root   p8est_comm_count_pertree_root
 #define p4est_comm_find_owner           p8est_comm_find_owner
+#define p4est_comm_tree_owner_range     p8est_comm_tree_owner_range
 #define p4est_comm_tree_info            p8est_comm_tree_info
 #define p4est_comm_neighborhood_owned   p8est_comm_neighborhood_owned
 #define p4est_comm_sync_flag            p8est_comm_sync_flag
+#define p4est_comm_flag_context_t       p8est_comm_flag_context_t
+#define p4est_comm_flag_context         p8est_comm_flag_context
+#define p4est_comm_sync_flag_begin      p8est_comm_sync_flag_begin
+#define p4est_comm_sync_flag_end        p8est_comm_sync_flag_end
+#define p4est_comm_notify_payload       p8est_comm_notify_payload
 #define p4est_comm_checksum             p8est_comm_checksum
+#define p4est_reduce_op                 p8est_reduce_op
+#define p4est_reduce_op_t               p8est_reduce_op_t
+#define P4EST_REDUCE_SUM                P8EST_REDUCE_SUM
+#define P4EST_REDUCE_MIN                P8EST_REDUCE_MIN
+#define P4EST_REDUCE_MAX                P8EST_REDUCE_MAX
+#define p4est_reduce_fold_t             p8est_reduce_fold_t
+#define p4est_comm_reduce_channels      p8est_comm_reduce_channels
 
 /* functions in p4est_io */
 #define p4est_deflate_quadrants         p8est_deflate_quadrants
+#define p4est_compress_quadrants        p8est_compress_quadrants
+#define p4est_uncompress_quadrants      p8est_uncompress_quadrants
+#define p4est_snapshot_new              p8est_snapshot_new
+#define p4est_snapshot_tree             p8est_snapshot_tree
+#define p4est_snapshot_destroy          p8est_snapshot_destroy
+#define p4est_paged_data_new            p8est_paged_data_new
+#define p4est_paged_data_index          p8est_paged_data_index
+#define p4est_paged_data_sweep          p8est_paged_data_sweep
+#define p4est_paged_data_destroy        p8est_paged_data_destroy
 #define p4est_inflate                   p8est_inflate
+#define p4est_transmit                  p8est_transmit
+#define p4est_receive                   p8est_receive
+#define p4est_replicate                 p8est_replicate
 
 /* functions in p4est_vtk */
+#define p4est_vtk_set_coordinate_precision p8est_vtk_set_coordinate_precision
 #define p4est_vtk_write_file            p8est_vtk_write_file
+#define p4est_vtk_write_file_shared     p8est_vtk_write_file_shared
+#define p4est_vtk_write_file_stream     p8est_vtk_write_file_stream
+#define p4est_vtk_write_file_nodes      p8est_vtk_write_file_nodes
+#define p4est_vtk_write_file_aggregate  p8est_vtk_write_file_aggregate
 #define p4est_vtk_write_all             p8est_vtk_write_all
 #define p4est_vtk_write_header          p8est_vtk_write_header
+#define p4est_vtk_write_header_nodes    p8est_vtk_write_header_nodes
 #define p4est_vtk_write_point_scalar    p8est_vtk_write_point_scalar
 #define p4est_vtk_write_point_vector    p8est_vtk_write_point_vector
 #define p4est_vtk_write_footer          p8est_vtk_write_footer
+#define p4est_vtk_pipeline              p8est_vtk_pipeline
+#define p4est_vtk_pipeline_t            p8est_vtk_pipeline_t
+#define p4est_vtk_pipeline_new          p8est_vtk_pipeline_new
+#define p4est_vtk_pipeline_add_field    p8est_vtk_pipeline_add_field
+#define p4est_vtk_pipeline_snapshot     p8est_vtk_pipeline_snapshot
+#define p4est_vtk_pipeline_write        p8est_vtk_pipeline_write
+#define p4est_vtk_pipeline_destroy      p8est_vtk_pipeline_destroy
 
 /* functions in p4est_ghost */
 #define p4est_quadrant_find_owner       p8est_quadrant_find_owner
 #define p4est_ghost_memory_used         p8est_ghost_memory_used
+#define p4est_ghost_compact_new         p8est_ghost_compact_new
+#define p4est_ghost_compact_restore     p8est_ghost_compact_restore
+#define p4est_ghost_compact_memory_used p8est_ghost_compact_memory_used
+#define p4est_ghost_compact_destroy     p8est_ghost_compact_destroy
 #define p4est_ghost_new                 p8est_ghost_new
+#define p4est_ghost_context             p8est_ghost_context
+#define p4est_ghost_context_t           p8est_ghost_context_t
+#define p4est_ghost_new_begin           p8est_ghost_new_begin
+#define p4est_ghost_new_end             p8est_ghost_new_end
+#define p4est_ghost_new_depth           p8est_ghost_new_depth
+#define p4est_boundary_summary          p8est_boundary_summary
+#define p4est_boundary_summary_t        p8est_boundary_summary_t
+#define p4est_boundary_summary_new      p8est_boundary_summary_new
+#define p4est_boundary_summary_destroy  p8est_boundary_summary_destroy
 #define p4est_ghost_destroy             p8est_ghost_destroy
+#define p4est_ghost_update              p8est_ghost_update
+#define p4est_ghost_adjacency           p8est_ghost_adjacency
+#define p4est_ghost_exchange_data       p8est_ghost_exchange_data
+#define p4est_ghost_ready_t             p8est_ghost_ready_t
+#define p4est_ghost_exchange_data_notify p8est_ghost_exchange_data_notify
+#define p4est_ghost_exchange            p8est_ghost_exchange
+#define p4est_ghost_exchange_t          p8est_ghost_exchange_t
+#define p4est_ghost_exchange_new        p8est_ghost_exchange_new
+#define p4est_ghost_exchange_start      p8est_ghost_exchange_start
+#define p4est_ghost_exchange_ready      p8est_ghost_exchange_ready
+#define p4est_ghost_exchange_end        p8est_ghost_exchange_end
+#define p4est_ghost_exchange_destroy    p8est_ghost_exchange_destroy
+#define p4est_ghost_neighborhood_release p8est_ghost_neighborhood_release
 #define p4est_ghost_bsearch             p8est_ghost_bsearch
 #define p4est_ghost_contains            p8est_ghost_contains
 #define p4est_face_quadrant_exists      p8est_face_quadrant_exists
@@ -316,7 +640,19 @@
 
 /* functions in p4est_lnodes */
 #define p4est_lnodes_new                p8est_lnodes_new
+#define p4est_lnodes_new_threaded       p8est_lnodes_new_threaded
+#define p4est_lnodes_new_begin          p8est_lnodes_new_begin
+#define p4est_lnodes_new_end            p8est_lnodes_new_end
+#define p4est_lnodes_update             p8est_lnodes_update
+#define p4est_lnodes_adjacency          p8est_lnodes_adjacency
+#define p4est_lnodes_transfer_new       p8est_lnodes_transfer_new
+#define p4est_lnodes_transfer_apply     p8est_lnodes_transfer_apply
+#define p4est_lnodes_transfer_destroy   p8est_lnodes_transfer_destroy
 #define p4est_lnodes_destroy            p8est_lnodes_destroy
+#define p4est_lnodes_weights_new        p8est_lnodes_weights_new
+#define p4est_lnodes_weights_table      p8est_lnodes_weights_table
+#define p4est_lnodes_weights_apply      p8est_lnodes_weights_apply
+#define p4est_lnodes_weights_destroy    p8est_lnodes_weights_destroy
 #define p4est_lnodes_decode             p8est_lnodes_decode
 #define p4est_lnodes_share_owned_begin  p8est_lnodes_share_owned_begin
 #define p4est_lnodes_share_owned_end    p8est_lnodes_share_owned_end
@@ -329,9 +665,31 @@
 #define p4est_lnodes_rank_array_index_int p8est_lnodes_rank_array_index_int
 #define p4est_lnodes_global_index       p8est_lnodes_global_index
 
+/* functions in p4est_fields */
+#define p4est_fields_new                p8est_fields_new
+#define p4est_fields_register           p8est_fields_register
+#define p4est_fields_lookup             p8est_fields_lookup
+#define p4est_fields_view               p8est_fields_view
+#define p4est_fields_quadrant           p8est_fields_quadrant
+#define p4est_fields_adapt              p8est_fields_adapt
+#define p4est_fields_partition          p8est_fields_partition
+#define p4est_fields_destroy            p8est_fields_destroy
+#define p4est_fields_memory_used        p8est_fields_memory_used
+
+/* functions in p4est_hierarchy */
+#define p4est_hierarchy_new             p8est_hierarchy_new
+#define p4est_hierarchy_destroy         p8est_hierarchy_destroy
+#define p4est_hierarchy_memory_used     p8est_hierarchy_memory_used
+
 /* functions in p4est_mesh */
 #define p4est_mesh_memory_used          p8est_mesh_memory_used
 #define p4est_mesh_new                  p8est_mesh_new
+#define p4est_mesh_update               p8est_mesh_update
+#define p4est_mesh_flatten              p8est_mesh_flatten
+#define p4est_mesh_gather_slots         p8est_mesh_gather_slots
+#define p4est_mesh_mirror_new           p8est_mesh_mirror_new
+#define p4est_mesh_mirror_sync          p8est_mesh_mirror_sync
+#define p4est_mesh_mirror_destroy       p8est_mesh_mirror_destroy
 #define p4est_mesh_destroy              p8est_mesh_destroy
 #define p4est_mesh_quadrant_cumulative  p8est_mesh_quadrant_cumulative
 #define p4est_mesh_face_neighbor_init   p8est_mesh_face_neighbor_init
@@ -349,6 +707,7 @@
 #define p4est_wrap_destroy              p8est_wrap_destroy
 #define p4est_wrap_refine               p8est_wrap_refine
 #define p4est_wrap_partition            p8est_wrap_partition
+#define p4est_wrap_revert               p8est_wrap_revert
 #define p4est_wrap_complete             p8est_wrap_complete
 #define p4est_wrap_leaf_next            p8est_wrap_leaf_next
 #define p4est_wrap_leaf_first           p8est_wrap_leaf_first
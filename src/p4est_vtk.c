@@ -32,15 +32,27 @@
 #ifdef P4_TO_P8
 #include <p8est_vtk.h>
 #include <p8est_nodes.h>
+#include <p8est_communication.h>
 #define P4EST_VTK_CELL_TYPE     11      /* VTK_VOXEL */
 #else
 #include <p4est_vtk.h>
 #include <p4est_nodes.h>
+#include <p4est_communication.h>
 #define P4EST_VTK_CELL_TYPE      8      /* VTK_PIXEL */
 #endif /* !P4_TO_P8 */
 
 #include <sc_io.h>
 
+#ifdef P4EST_MPIIO
+#define P4EST_MPIIO_WRITE
+#endif
+
+/* the aggregation writer funnels per-node payloads through MPI-3
+ * shared memory communicators to one writer rank per node */
+#if defined P4EST_MPI && defined P4EST_HAVE_MPI_COMM_SPLIT_TYPE
+#define P4EST_VTK_AGGREGATE
+#endif
+
 static const double p4est_vtk_scale = 0.95;
 static const int    p4est_vtk_write_tree = 1;
 static const int    p4est_vtk_write_rank = 1;
@@ -54,10 +66,147 @@ static const int    p4est_vtk_wrap_rank = 0;
 #define P4EST_VTK_FLOAT_TYPE double
 #endif
 
+/** The runtime precision of the Position arrays, 32 or 64 bits.
+ * The default follows the compile-time P4EST_VTK_DOUBLES setting; it is
+ * changed by p4est_vtk_set_coordinate_precision.  The point and cell
+ * fields keep the compiled P4EST_VTK_FLOAT_TYPE regardless.
+ */
+static int          p4est_vtk_coordinate_precision =
+  8 * sizeof (P4EST_VTK_FLOAT_TYPE);
+
+void
+p4est_vtk_set_coordinate_precision (int precision)
+{
+  SC_CHECK_ABORT (precision == 32 || precision == 64,
+                  P4EST_STRING "_vtk coordinate precision must be 32 or 64");
+
+  p4est_vtk_coordinate_precision = precision;
+}
+
+/** The VTK type name matching the runtime coordinate precision. */
+static const char  *
+p4est_vtk_coord_name (void)
+{
+  return p4est_vtk_coordinate_precision == 32 ? "Float32" : "Float64";
+}
+
+/** The size in bytes of one coordinate at the runtime precision. */
+static size_t
+p4est_vtk_coord_size (void)
+{
+  return p4est_vtk_coordinate_precision == 32 ?
+    sizeof (float) : sizeof (double);
+}
+
+/** Return \a float_data converted to the runtime coordinate precision.
+ * When the requested precision matches the compiled float type this is
+ * \a float_data itself, otherwise a newly allocated buffer of \a
+ * ncoords entries that the caller must free.
+ */
+static char        *
+p4est_vtk_coord_bytes (P4EST_VTK_FLOAT_TYPE * float_data, size_t ncoords)
+{
+  size_t              zz;
+
+  if (p4est_vtk_coord_size () == sizeof (P4EST_VTK_FLOAT_TYPE)) {
+    return (char *) float_data;
+  }
+  if (p4est_vtk_coordinate_precision == 32) {
+    float              *fbuf = P4EST_ALLOC (float, ncoords);
+
+    for (zz = 0; zz < ncoords; ++zz) {
+      fbuf[zz] = (float) float_data[zz];
+    }
+    return (char *) fbuf;
+  }
+  else {
+    double             *dbuf = P4EST_ALLOC (double, ncoords);
+
+    for (zz = 0; zz < ncoords; ++zz) {
+      dbuf[zz] = (double) float_data[zz];
+    }
+    return (char *) dbuf;
+  }
+}
+
+/* Defining P4EST_VTK_APPENDED in addition to P4EST_VTK_BINARY stores
+ * the data arrays as raw bytes in an appended data section instead of
+ * base64-encoding them inline, which shrinks the files and skips the
+ * encoding pass; P4EST_VTK_COMPRESSION then zlib-compresses each block.
+ */
 #ifndef P4EST_VTK_BINARY
 #define P4EST_VTK_ASCII 1
 #define P4EST_VTK_FORMAT_STRING "ascii"
 #else
+#ifdef P4EST_VTK_APPENDED
+#define P4EST_VTK_FORMAT_STRING "appended"
+#ifdef P4EST_VTK_COMPRESSION
+#include <sc_zlib.h>
+#endif
+
+/** The appended data blocks of the vtu file currently being written.
+ * They are collected over the multiple passes that assemble one file
+ * and written out in one piece by p4est_vtk_write_footer.
+ */
+static sc_array_t  *p4est_vtk_appended = NULL;
+
+static int
+p4est_vtk_write_appended (char *numeric_data, size_t byte_length)
+{
+  size_t              old;
+#ifndef P4EST_VTK_COMPRESSION
+  uint32_t            header[1];
+
+  P4EST_ASSERT (p4est_vtk_appended != NULL);
+
+  /* one UInt32 byte count followed by the raw bytes */
+  header[0] = (uint32_t) byte_length;
+  old = p4est_vtk_appended->elem_count;
+  sc_array_resize (p4est_vtk_appended,
+                   old + sizeof (header) + byte_length);
+  memcpy (sc_array_index (p4est_vtk_appended, old),
+          header, sizeof (header));
+  memcpy (sc_array_index (p4est_vtk_appended, old + sizeof (header)),
+          numeric_data, byte_length);
+
+  return 0;
+#else
+  int                 retval;
+  uint32_t            header[4];
+  uLongf              comp_length;
+  Bytef              *comp_data;
+
+  P4EST_ASSERT (p4est_vtk_appended != NULL);
+
+  /* the vtkZLibDataCompressor layout with one block per data array:
+   * UInt32 {number of blocks, block size, last block size, compressed
+   * size} followed by the zlib stream */
+  comp_length = compressBound ((uLong) byte_length);
+  comp_data = (Bytef *) P4EST_ALLOC (char, comp_length);
+  retval = compress2 (comp_data, &comp_length, (const Bytef *) numeric_data,
+                      (uLong) byte_length, Z_BEST_SPEED);
+  if (retval != Z_OK) {
+    P4EST_FREE (comp_data);
+    return -1;
+  }
+  header[0] = 1;
+  header[1] = (uint32_t) byte_length;
+  header[2] = (uint32_t) byte_length;
+  header[3] = (uint32_t) comp_length;
+  old = p4est_vtk_appended->elem_count;
+  sc_array_resize (p4est_vtk_appended,
+                   old + sizeof (header) + (size_t) comp_length);
+  memcpy (sc_array_index (p4est_vtk_appended, old),
+          header, sizeof (header));
+  memcpy (sc_array_index (p4est_vtk_appended, old + sizeof (header)),
+          comp_data, (size_t) comp_length);
+  P4EST_FREE (comp_data);
+
+  return 0;
+#endif /* P4EST_VTK_COMPRESSION */
+}
+
+#else /* !P4EST_VTK_APPENDED */
 #define P4EST_VTK_FORMAT_STRING "binary"
 
 static int
@@ -70,9 +219,165 @@ p4est_vtk_write_binary (FILE * vtkfile, char *numeric_data,
   return sc_vtk_write_compressed (vtkfile, numeric_data, byte_length);
 #endif /* P4EST_VTK_COMPRESSION */
 }
+#endif /* !P4EST_VTK_APPENDED */
+
+/** Write the payload of one data array in the configured binary format.
+ * For inline binary this base64-encodes the bytes into the XML body.
+ * For appended output the bytes are queued instead and the XML element
+ * carries only the offset attribute printed by p4est_vtk_print_format.
+ */
+static int
+p4est_vtk_write_block (FILE * vtkfile, char *numeric_data,
+                       size_t byte_length)
+{
+#ifdef P4EST_VTK_APPENDED
+  return p4est_vtk_write_appended (numeric_data, byte_length);
+#else
+  int                 retval;
+
+  fprintf (vtkfile, "          ");
+  retval = p4est_vtk_write_binary (vtkfile, numeric_data, byte_length);
+  fprintf (vtkfile, "\n");
+
+  return retval;
+#endif /* !P4EST_VTK_APPENDED */
+}
 
 #endif /* P4EST_VTK_BINARY */
 
+/** Print the format attributes of a DataArray element.
+ * The appended format additionally needs the byte offset of the array's
+ * block, which is the current length of the queued appended data.
+ */
+static void
+p4est_vtk_print_format (FILE * vtkfile)
+{
+#ifdef P4EST_VTK_APPENDED
+  fprintf (vtkfile, " format=\"appended\" offset=\"%llu\"",
+           (unsigned long long) p4est_vtk_appended->elem_count);
+#else
+  fprintf (vtkfile, " format=\"%s\"", P4EST_VTK_FORMAT_STRING);
+#endif
+}
+
+/** Compute the scaled corner coordinates of one quadrant.
+ * The \a vt array holds the vertex numbers of the quadrant's tree \a jt
+ * and \a float_data must provide room for 3 * P4EST_CHILDREN entries.
+ */
+static void
+p4est_vtk_quadrant_positions (p4est_geometry_t * geom, const double *v,
+                              const p4est_topidx_t * vt, p4est_topidx_t jt,
+                              const p4est_quadrant_t * quad, double scale,
+                              P4EST_VTK_FLOAT_TYPE * float_data)
+{
+  const double        intsize = 1.0 / P4EST_ROOT_LEN;
+  int                 xi, yi, j, k;
+#ifdef P4_TO_P8
+  int                 zi;
+  double              XYZ[3];   /* 3 not P4EST_DIM */
+#endif
+  double              h2, eta_x, eta_y, eta_z = 0.;
+  double              xyz[3];   /* 3 not P4EST_DIM */
+
+  h2 = .5 * intsize * P4EST_QUADRANT_LEN (quad->level);
+  k = 0;
+#ifdef P4_TO_P8
+  for (zi = 0; zi < 2; ++zi) {
+#endif
+    for (yi = 0; yi < 2; ++yi) {
+      for (xi = 0; xi < 2; ++xi) {
+        P4EST_ASSERT (0 <= k && k < P4EST_CHILDREN);
+        eta_x = intsize * quad->x + h2 * (1. + (xi * 2 - 1) * scale);
+        eta_y = intsize * quad->y + h2 * (1. + (yi * 2 - 1) * scale);
+#ifdef P4_TO_P8
+        eta_z = intsize * quad->z + h2 * (1. + (zi * 2 - 1) * scale);
+#endif
+        for (j = 0; j < 3; ++j) {
+          /* *INDENT-OFF* */
+          xyz[j] =
+      ((1. - eta_z) * ((1. - eta_y) * ((1. - eta_x) * v[3 * vt[0] + j] +
+                                             eta_x  * v[3 * vt[1] + j]) +
+                             eta_y  * ((1. - eta_x) * v[3 * vt[2] + j] +
+                                             eta_x  * v[3 * vt[3] + j]))
+#ifdef P4_TO_P8
+       +     eta_z  * ((1. - eta_y) * ((1. - eta_x) * v[3 * vt[4] + j] +
+                                             eta_x  * v[3 * vt[5] + j]) +
+                             eta_y  * ((1. - eta_x) * v[3 * vt[6] + j] +
+                                             eta_x  * v[3 * vt[7] + j]))
+#endif
+      );
+          /* *INDENT-ON* */
+        }
+        if (geom != NULL) {
+#ifdef P4_TO_P8
+          geom->X (geom, jt, xyz, XYZ);
+          for (j = 0; j < 3; ++j) {
+            float_data[3 * k + j] = (P4EST_VTK_FLOAT_TYPE) XYZ[j];
+          }
+#else
+          SC_ABORT ("Geometry in 2D not implemented");
+#endif
+        }
+        else {
+          for (j = 0; j < 3; ++j) {
+            float_data[3 * k + j] = (P4EST_VTK_FLOAT_TYPE) xyz[j];
+          }
+        }
+        ++k;
+      }
+    }
+#ifdef P4_TO_P8
+  }
+#endif
+  P4EST_ASSERT (k == P4EST_CHILDREN);
+}
+
+/** Compute the P4EST_CHILDREN scaled corner coordinates of every local
+ * quadrant in quadrant order.  The \a float_data array must provide
+ * room for 3 * P4EST_CHILDREN entries per local quadrant.
+ */
+static void
+p4est_vtk_fill_positions (p4est_t * p4est, p4est_geometry_t * geom,
+                          double scale, P4EST_VTK_FLOAT_TYPE * float_data)
+{
+  p4est_connectivity_t *connectivity = p4est->connectivity;
+  sc_array_t         *trees = p4est->trees;
+  const double       *v = connectivity->vertices;
+  const p4est_topidx_t first_local_tree = p4est->first_local_tree;
+  const p4est_topidx_t last_local_tree = p4est->last_local_tree;
+  const p4est_topidx_t *tree_to_vertex = connectivity->tree_to_vertex;
+  int                 k;
+  size_t              num_quads, zz;
+  p4est_topidx_t      jt;
+  p4est_topidx_t      vt[P4EST_CHILDREN];
+  p4est_locidx_t      quad_count;
+  sc_array_t         *quadrants;
+  p4est_tree_t       *tree;
+  p4est_quadrant_t   *quad;
+
+  P4EST_ASSERT (v != NULL && tree_to_vertex != NULL);
+
+  /* loop over the trees */
+  for (jt = first_local_tree, quad_count = 0; jt <= last_local_tree; ++jt) {
+    tree = p4est_tree_array_index (trees, jt);
+    quadrants = &tree->quadrants;
+    num_quads = quadrants->elem_count;
+
+    /* retrieve corners of the tree */
+    for (k = 0; k < P4EST_CHILDREN; ++k)
+      vt[k] = tree_to_vertex[jt * P4EST_CHILDREN + k];
+
+    /* loop over the elements in tree and calculated vertex coordinates */
+    for (zz = 0; zz < num_quads; ++zz, ++quad_count) {
+      quad = p4est_quadrant_array_index (quadrants, zz);
+      p4est_vtk_quadrant_positions (geom, v, vt, jt, quad, scale,
+                                    float_data +
+                                    3 * P4EST_CHILDREN * quad_count);
+    }
+  }
+  P4EST_ASSERT (quad_count == p4est->local_num_quadrants);
+}
+
 void
 p4est_vtk_write_file (p4est_t * p4est, p4est_geometry_t * geom,
                       const char *filename)
@@ -83,6 +388,23 @@ p4est_vtk_write_file (p4est_t * p4est, p4est_geometry_t * geom,
                        0, 0, filename);
 }
 
+void
+p4est_vtk_write_file_nodes (p4est_t * p4est, p4est_geometry_t * geom,
+                            p4est_nodes_t * nodes, const char *filename)
+{
+  int                 retval;
+
+  retval = p4est_vtk_write_header_nodes (p4est, geom, nodes, 1.,
+                                         p4est_vtk_write_tree,
+                                         p4est_vtk_write_rank,
+                                         p4est_vtk_wrap_rank,
+                                         NULL, NULL, filename);
+  SC_CHECK_ABORT (!retval, P4EST_STRING "_vtk: Error writing header");
+
+  retval = p4est_vtk_write_footer (p4est, filename);
+  SC_CHECK_ABORT (!retval, P4EST_STRING "_vtk: Error writing footer");
+}
+
 void
 p4est_vtk_write_all (p4est_t * p4est, p4est_geometry_t * geom,
                      double scale, int write_tree,
@@ -158,10 +480,12 @@ p4est_vtk_write_all (p4est_t * p4est, p4est_geometry_t * geom,
 }
 
 int
-p4est_vtk_write_header (p4est_t * p4est, p4est_geometry_t * geom,
-                        double scale, int write_tree, int write_rank,
-                        int wrap_rank, const char *point_scalars,
-                        const char *point_vectors, const char *filename)
+p4est_vtk_write_header_nodes (p4est_t * p4est, p4est_geometry_t * geom,
+                              p4est_nodes_t * nodes, double scale,
+                              int write_tree, int write_rank,
+                              int wrap_rank, const char *point_scalars,
+                              const char *point_vectors,
+                              const char *filename)
 {
   p4est_connectivity_t *connectivity = p4est->connectivity;
   sc_array_t         *trees = p4est->trees;
@@ -180,24 +504,23 @@ p4est_vtk_write_header (p4est_t * p4est, p4est_geometry_t * geom,
   int                 retval;
   uint8_t            *uint8_data;
   p4est_locidx_t     *locidx_data;
+  char               *coord_data;
 #endif
-  int                 xi, yi, j, k;
+  int                 j, k;
 #ifdef P4_TO_P8
-  int                 zi;
   double              XYZ[3];   /* 3 not P4EST_DIM */
 #endif
-  double              h2, eta_x, eta_y, eta_z = 0.;
+  double              eta_x, eta_y, eta_z = 0.;
   double              xyz[3];   /* 3 not P4EST_DIM */
   size_t              num_quads, zz;
   p4est_topidx_t      jt;
   p4est_topidx_t      vt[P4EST_CHILDREN];
-  p4est_locidx_t      quad_count, Ntotal;
+  p4est_locidx_t      Ntotal;
   p4est_locidx_t      il;
+  int                 nodes_owned = 0;
   P4EST_VTK_FLOAT_TYPE *float_data;
-  sc_array_t         *quadrants, *indeps;
+  sc_array_t         *indeps;
   p4est_tree_t       *tree;
-  p4est_quadrant_t   *quad;
-  p4est_nodes_t      *nodes;
   p4est_indep_t      *in;
   char                vtufilename[BUFSIZ];
   FILE               *vtufile;
@@ -208,15 +531,22 @@ p4est_vtk_write_header (p4est_t * p4est, p4est_geometry_t * geom,
   P4EST_ASSERT (0. <= scale && scale <= 1. && wrap_rank >= 0);
   P4EST_ASSERT (v != NULL && tree_to_vertex != NULL);
 
-  if (scale < 1.) {
+  if (nodes != NULL) {
+    /* reuse the caller's deduplicated node set; the quadrant corners
+       coincide with the nodes only for unscaled quadrants */
+    P4EST_ASSERT (scale == 1.);
+    indeps = &nodes->indep_nodes;
+    Ntotal = (p4est_locidx_t) indeps->elem_count;
+  }
+  else if (scale < 1.) {
     /* when we scale the quadrants we need each corner separately */
-    nodes = NULL;
     indeps = NULL;
     Ntotal = Ncorners;
   }
   else {
     /* when scale == 1. we can reuse shared quadrant corners */
     nodes = p4est_nodes_new (p4est, NULL);
+    nodes_owned = 1;
     indeps = &nodes->indep_nodes;
     Ntotal = nodes->num_owned_indeps;
     P4EST_ASSERT ((size_t) Ntotal == indeps->elem_count);
@@ -233,6 +563,12 @@ p4est_vtk_write_header (p4est_t * p4est, p4est_geometry_t * geom,
     return -1;
   }
 
+#ifdef P4EST_VTK_APPENDED
+  /* start collecting the appended data blocks for this file */
+  P4EST_ASSERT (p4est_vtk_appended == NULL);
+  p4est_vtk_appended = sc_array_new (sizeof (char));
+#endif
+
   fprintf (vtufile, "<?xml version=\"1.0\"?>\n");
   fprintf (vtufile, "<VTKFile type=\"UnstructuredGrid\" version=\"0.1\"");
 #if defined P4EST_VTK_BINARY && defined P4EST_VTK_COMPRESSION
@@ -253,79 +589,12 @@ p4est_vtk_write_header (p4est_t * p4est, p4est_geometry_t * geom,
 
   /* write point position data */
   fprintf (vtufile, "        <DataArray type=\"%s\" Name=\"Position\""
-           " NumberOfComponents=\"3\" format=\"%s\">\n",
-           P4EST_VTK_FLOAT_NAME, P4EST_VTK_FORMAT_STRING);
+           " NumberOfComponents=\"3\"", p4est_vtk_coord_name ());
+  p4est_vtk_print_format (vtufile);
+  fprintf (vtufile, ">\n");
 
   if (nodes == NULL) {
-    /* loop over the trees */
-    for (jt = first_local_tree, quad_count = 0; jt <= last_local_tree; ++jt) {
-      tree = p4est_tree_array_index (trees, jt);
-      quadrants = &tree->quadrants;
-      num_quads = quadrants->elem_count;
-
-      /* retrieve corners of the tree */
-      for (k = 0; k < P4EST_CHILDREN; ++k)
-        vt[k] = tree_to_vertex[jt * P4EST_CHILDREN + k];
-
-      /* loop over the elements in tree and calculated vertex coordinates */
-      for (zz = 0; zz < num_quads; ++zz, ++quad_count) {
-        quad = p4est_quadrant_array_index (quadrants, zz);
-        h2 = .5 * intsize * P4EST_QUADRANT_LEN (quad->level);
-        k = 0;
-#ifdef P4_TO_P8
-        for (zi = 0; zi < 2; ++zi) {
-#endif
-          for (yi = 0; yi < 2; ++yi) {
-            for (xi = 0; xi < 2; ++xi) {
-              P4EST_ASSERT (0 <= k && k < P4EST_CHILDREN);
-              eta_x = intsize * quad->x + h2 * (1. + (xi * 2 - 1) * scale);
-              eta_y = intsize * quad->y + h2 * (1. + (yi * 2 - 1) * scale);
-#ifdef P4_TO_P8
-              eta_z = intsize * quad->z + h2 * (1. + (zi * 2 - 1) * scale);
-#endif
-              for (j = 0; j < 3; ++j) {
-                /* *INDENT-OFF* */
-              xyz[j] =
-          ((1. - eta_z) * ((1. - eta_y) * ((1. - eta_x) * v[3 * vt[0] + j] +
-                                                 eta_x  * v[3 * vt[1] + j]) +
-                                 eta_y  * ((1. - eta_x) * v[3 * vt[2] + j] +
-                                                 eta_x  * v[3 * vt[3] + j]))
-#ifdef P4_TO_P8
-           +     eta_z  * ((1. - eta_y) * ((1. - eta_x) * v[3 * vt[4] + j] +
-                                                 eta_x  * v[3 * vt[5] + j]) +
-                                 eta_y  * ((1. - eta_x) * v[3 * vt[6] + j] +
-                                                 eta_x  * v[3 * vt[7] + j]))
-#endif
-          );
-                /* *INDENT-ON* */
-              }
-              if (geom != NULL) {
-#ifdef P4_TO_P8
-                geom->X (geom, jt, xyz, XYZ);
-                for (j = 0; j < 3; ++j) {
-                  float_data[3 * (P4EST_CHILDREN * quad_count + k) +
-                             j] = (P4EST_VTK_FLOAT_TYPE) XYZ[j];
-                }
-#else
-                SC_ABORT ("Geometry in 2D not implemented");
-#endif
-              }
-              else {
-                for (j = 0; j < 3; ++j) {
-                  float_data[3 * (P4EST_CHILDREN * quad_count + k) +
-                             j] = (P4EST_VTK_FLOAT_TYPE) xyz[j];
-                }
-              }
-              ++k;
-            }
-          }
-#ifdef P4_TO_P8
-        }
-#endif
-        P4EST_ASSERT (k == P4EST_CHILDREN);
-      }
-    }
-    P4EST_ASSERT (P4EST_CHILDREN * quad_count == Ntotal);
+    p4est_vtk_fill_positions (p4est, geom, scale, float_data);
   }
   else {
     for (zz = 0; zz < indeps->elem_count; ++zz) {
@@ -382,21 +651,24 @@ p4est_vtk_write_header (p4est_t * p4est, p4est_geometry_t * geom,
     wy = float_data[3 * il + 1];
     wz = float_data[3 * il + 2];
 
-#ifdef P4EST_VTK_DOUBLES
-    fprintf (vtufile, "     %24.16e %24.16e %24.16e\n", wx, wy, wz);
-#else
-    fprintf (vtufile, "          %16.8e %16.8e %16.8e\n", wx, wy, wz);
-#endif
+    if (p4est_vtk_coordinate_precision == 64) {
+      fprintf (vtufile, "     %24.16e %24.16e %24.16e\n", wx, wy, wz);
+    }
+    else {
+      fprintf (vtufile, "          %16.8e %16.8e %16.8e\n", wx, wy, wz);
+    }
   }
 #else
-  fprintf (vtufile, "          ");
   /* TODO: Don't allocate the full size of the array, only allocate
    * the chunk that will be passed to zlib and do this a chunk
    * at a time.
    */
-  retval = p4est_vtk_write_binary (vtufile, (char *) float_data,
-                                   sizeof (*float_data) * 3 * Ntotal);
-  fprintf (vtufile, "\n");
+  coord_data = p4est_vtk_coord_bytes (float_data, 3 * (size_t) Ntotal);
+  retval = p4est_vtk_write_block (vtufile, coord_data,
+                                  p4est_vtk_coord_size () * 3 * Ntotal);
+  if (coord_data != (char *) float_data) {
+    P4EST_FREE (coord_data);
+  }
   if (retval) {
     P4EST_LERROR (P4EST_STRING "_vtk: Error encoding points\n");
     fclose (vtufile);
@@ -409,8 +681,10 @@ p4est_vtk_write_header (p4est_t * p4est, p4est_geometry_t * geom,
   fprintf (vtufile, "      <Cells>\n");
 
   /* write connectivity data */
-  fprintf (vtufile, "        <DataArray type=\"%s\" Name=\"connectivity\""
-           " format=\"%s\">\n", P4EST_VTK_LOCIDX, P4EST_VTK_FORMAT_STRING);
+  fprintf (vtufile, "        <DataArray type=\"%s\" Name=\"connectivity\"",
+           P4EST_VTK_LOCIDX);
+  p4est_vtk_print_format (vtufile);
+  fprintf (vtufile, ">\n");
 #ifdef P4EST_VTK_ASCII
   for (sk = 0, il = 0; il < Ncells; ++il) {
     fprintf (vtufile, "         ");
@@ -422,21 +696,19 @@ p4est_vtk_write_header (p4est_t * p4est, p4est_geometry_t * geom,
   }
 #else
   locidx_data = P4EST_ALLOC (p4est_locidx_t, Ncorners);
-  fprintf (vtufile, "          ");
   if (nodes == NULL) {
     for (il = 0; il < Ncorners; ++il) {
       locidx_data[il] = il;
     }
     retval =
-      p4est_vtk_write_binary (vtufile, (char *) locidx_data,
-                              sizeof (*locidx_data) * Ncorners);
+      p4est_vtk_write_block (vtufile, (char *) locidx_data,
+                             sizeof (*locidx_data) * Ncorners);
   }
   else {
     retval =
-      p4est_vtk_write_binary (vtufile, (char *) nodes->local_nodes,
-                              sizeof (*locidx_data) * Ncorners);
+      p4est_vtk_write_block (vtufile, (char *) nodes->local_nodes,
+                             sizeof (*locidx_data) * Ncorners);
   }
-  fprintf (vtufile, "\n");
   if (retval) {
     P4EST_LERROR (P4EST_STRING "_vtk: Error encoding connectivity\n");
     fclose (vtufile);
@@ -446,8 +718,10 @@ p4est_vtk_write_header (p4est_t * p4est, p4est_geometry_t * geom,
   fprintf (vtufile, "        </DataArray>\n");
 
   /* write offset data */
-  fprintf (vtufile, "        <DataArray type=\"%s\" Name=\"offsets\""
-           " format=\"%s\">\n", P4EST_VTK_LOCIDX, P4EST_VTK_FORMAT_STRING);
+  fprintf (vtufile, "        <DataArray type=\"%s\" Name=\"offsets\"",
+           P4EST_VTK_LOCIDX);
+  p4est_vtk_print_format (vtufile);
+  fprintf (vtufile, ">\n");
 #ifdef P4EST_VTK_ASCII
   fprintf (vtufile, "         ");
   for (il = 1, sk = 1; il <= Ncells; ++il, ++sk) {
@@ -460,10 +734,8 @@ p4est_vtk_write_header (p4est_t * p4est, p4est_geometry_t * geom,
   for (il = 1; il <= Ncells; ++il)
     locidx_data[il - 1] = P4EST_CHILDREN * il;  /* same type */
 
-  fprintf (vtufile, "          ");
-  retval = p4est_vtk_write_binary (vtufile, (char *) locidx_data,
-                                   sizeof (*locidx_data) * Ncells);
-  fprintf (vtufile, "\n");
+  retval = p4est_vtk_write_block (vtufile, (char *) locidx_data,
+                                  sizeof (*locidx_data) * Ncells);
   if (retval) {
     P4EST_LERROR (P4EST_STRING "_vtk: Error encoding offsets\n");
     fclose (vtufile);
@@ -473,8 +745,9 @@ p4est_vtk_write_header (p4est_t * p4est, p4est_geometry_t * geom,
   fprintf (vtufile, "        </DataArray>\n");
 
   /* write type data */
-  fprintf (vtufile, "        <DataArray type=\"UInt8\" Name=\"types\""
-           " format=\"%s\">\n", P4EST_VTK_FORMAT_STRING);
+  fprintf (vtufile, "        <DataArray type=\"UInt8\" Name=\"types\"");
+  p4est_vtk_print_format (vtufile);
+  fprintf (vtufile, ">\n");
 #ifdef P4EST_VTK_ASCII
   fprintf (vtufile, "         ");
   for (il = 0, sk = 1; il < Ncells; ++il, ++sk) {
@@ -488,11 +761,9 @@ p4est_vtk_write_header (p4est_t * p4est, p4est_geometry_t * geom,
   for (il = 0; il < Ncells; ++il)
     uint8_data[il] = P4EST_VTK_CELL_TYPE;
 
-  fprintf (vtufile, "          ");
-  retval = p4est_vtk_write_binary (vtufile, (char *) uint8_data,
-                                   sizeof (*uint8_data) * Ncells);
+  retval = p4est_vtk_write_block (vtufile, (char *) uint8_data,
+                                  sizeof (*uint8_data) * Ncells);
   P4EST_FREE (uint8_data);
-  fprintf (vtufile, "\n");
   if (retval) {
     P4EST_LERROR (P4EST_STRING "_vtk: Error encoding types\n");
     fclose (vtufile);
@@ -511,8 +782,10 @@ p4est_vtk_write_header (p4est_t * p4est, p4est_geometry_t * geom,
     const int           wrapped_rank =
       wrap_rank > 0 ? mpirank % wrap_rank : mpirank;
 
-    fprintf (vtufile, "        <DataArray type=\"%s\" Name=\"mpirank\""
-             " format=\"%s\">\n", P4EST_VTK_LOCIDX, P4EST_VTK_FORMAT_STRING);
+    fprintf (vtufile, "        <DataArray type=\"%s\" Name=\"mpirank\"",
+             P4EST_VTK_LOCIDX);
+    p4est_vtk_print_format (vtufile);
+    fprintf (vtufile, ">\n");
 #ifdef P4EST_VTK_ASCII
     fprintf (vtufile, "         ");
     for (il = 0, sk = 1; il < Ncells; ++il, ++sk) {
@@ -525,10 +798,8 @@ p4est_vtk_write_header (p4est_t * p4est, p4est_geometry_t * geom,
     for (il = 0; il < Ncells; ++il)
       locidx_data[il] = (p4est_locidx_t) wrapped_rank;
 
-    fprintf (vtufile, "          ");
-    retval = p4est_vtk_write_binary (vtufile, (char *) locidx_data,
-                                     sizeof (*locidx_data) * Ncells);
-    fprintf (vtufile, "\n");
+    retval = p4est_vtk_write_block (vtufile, (char *) locidx_data,
+                                    sizeof (*locidx_data) * Ncells);
     if (retval) {
       P4EST_LERROR (P4EST_STRING "_vtk: Error encoding types\n");
       fclose (vtufile);
@@ -538,8 +809,10 @@ p4est_vtk_write_header (p4est_t * p4est, p4est_geometry_t * geom,
     fprintf (vtufile, "        </DataArray>\n");
   }
   if (write_tree) {
-    fprintf (vtufile, "        <DataArray type=\"%s\" Name=\"treeid\""
-             " format=\"%s\">\n", P4EST_VTK_LOCIDX, P4EST_VTK_FORMAT_STRING);
+    fprintf (vtufile, "        <DataArray type=\"%s\" Name=\"treeid\"",
+             P4EST_VTK_LOCIDX);
+    p4est_vtk_print_format (vtufile);
+    fprintf (vtufile, ">\n");
 #ifdef P4EST_VTK_ASCII
     fprintf (vtufile, "         ");
     for (il = 0, sk = 1, jt = first_local_tree; jt <= last_local_tree; ++jt) {
@@ -560,10 +833,8 @@ p4est_vtk_write_header (p4est_t * p4est, p4est_geometry_t * geom,
         locidx_data[il] = (p4est_locidx_t) jt;
       }
     }
-    fprintf (vtufile, "          ");
-    retval = p4est_vtk_write_binary (vtufile, (char *) locidx_data,
-                                     sizeof (*locidx_data) * Ncells);
-    fprintf (vtufile, "\n");
+    retval = p4est_vtk_write_block (vtufile, (char *) locidx_data,
+                                    sizeof (*locidx_data) * Ncells);
     if (retval) {
       P4EST_LERROR (P4EST_STRING "_vtk: Error encoding types\n");
       fclose (vtufile);
@@ -579,7 +850,7 @@ p4est_vtk_write_header (p4est_t * p4est, p4est_geometry_t * geom,
 #ifndef P4EST_VTK_ASCII
   P4EST_FREE (locidx_data);
 #endif
-  if (nodes != NULL) {
+  if (nodes_owned) {
     p4est_nodes_destroy (nodes);
   }
 
@@ -665,6 +936,18 @@ p4est_vtk_write_header (p4est_t * p4est, p4est_geometry_t * geom,
   return 0;
 }
 
+int
+p4est_vtk_write_header (p4est_t * p4est, p4est_geometry_t * geom,
+                        double scale, int write_tree, int write_rank,
+                        int wrap_rank, const char *point_scalars,
+                        const char *point_vectors, const char *filename)
+{
+  return p4est_vtk_write_header_nodes (p4est, geom, NULL, scale,
+                                       write_tree, write_rank, wrap_rank,
+                                       point_scalars, point_vectors,
+                                       filename);
+}
+
 int
 p4est_vtk_write_point_scalar (p4est_t * p4est, p4est_geometry_t * geom,
                               const char *filename,
@@ -699,9 +982,10 @@ p4est_vtk_write_point_scalar (p4est_t * p4est, p4est_geometry_t * geom,
   }
 
   /* write point position data */
-  fprintf (vtufile, "        <DataArray type=\"%s\" Name=\"%s\""
-           " format=\"%s\">\n",
-           P4EST_VTK_FLOAT_NAME, scalar_name, P4EST_VTK_FORMAT_STRING);
+  fprintf (vtufile, "        <DataArray type=\"%s\" Name=\"%s\"",
+           P4EST_VTK_FLOAT_NAME, scalar_name);
+  p4est_vtk_print_format (vtufile);
+  fprintf (vtufile, ">\n");
 
 #ifdef P4EST_VTK_ASCII
   for (il = 0; il < Ncorners; ++il) {
@@ -717,14 +1001,12 @@ p4est_vtk_write_point_scalar (p4est_t * p4est, p4est_geometry_t * geom,
     float_data[il] = (P4EST_VTK_FLOAT_TYPE) values[il];
   }
 
-  fprintf (vtufile, "          ");
   /* TODO: Don't allocate the full size of the array, only allocate
    * the chunk that will be passed to zlib and do this a chunk
    * at a time.
    */
-  retval = p4est_vtk_write_binary (vtufile, (char *) float_data,
-                                   sizeof (*float_data) * Ncorners);
-  fprintf (vtufile, "\n");
+  retval = p4est_vtk_write_block (vtufile, (char *) float_data,
+                                  sizeof (*float_data) * Ncorners);
   if (retval) {
     P4EST_LERROR (P4EST_STRING "_vtk: Error encoding points\n");
     fclose (vtufile);
@@ -805,6 +1087,24 @@ p4est_vtk_write_footer (p4est_t * p4est, const char *filename)
   fprintf (vtufile, "      </PointData>\n");
   fprintf (vtufile, "    </Piece>\n");
   fprintf (vtufile, "  </UnstructuredGrid>\n");
+#ifdef P4EST_VTK_APPENDED
+  /* write the queued binary blocks in one piece */
+  P4EST_ASSERT (p4est_vtk_appended != NULL);
+  fprintf (vtufile, "  <AppendedData encoding=\"raw\">\n   _");
+  if (p4est_vtk_appended->elem_count > 0 &&
+      fwrite (p4est_vtk_appended->array, 1,
+              p4est_vtk_appended->elem_count, vtufile) !=
+      p4est_vtk_appended->elem_count) {
+    P4EST_LERROR ("p4est_vtk: Error writing appended data\n");
+    sc_array_destroy (p4est_vtk_appended);
+    p4est_vtk_appended = NULL;
+    fclose (vtufile);
+    return -1;
+  }
+  fprintf (vtufile, "\n  </AppendedData>\n");
+  sc_array_destroy (p4est_vtk_appended);
+  p4est_vtk_appended = NULL;
+#endif
   fprintf (vtufile, "</VTKFile>\n");
 
   if (ferror (vtufile)) {
@@ -879,3 +1179,1004 @@ p4est_vtk_write_footer (p4est_t * p4est, const char *filename)
 
   return 0;
 }
+
+void
+p4est_vtk_write_file_shared (p4est_t * p4est, p4est_geometry_t * geom,
+                             const char *filename)
+{
+  const int           num_procs = p4est->mpisize;
+  const int           rank = p4est->mpirank;
+  const p4est_gloidx_t *gq = p4est->global_first_quadrant;
+  const p4est_gloidx_t gtotal = gq[num_procs];
+  const p4est_gloidx_t gbefore = gq[rank];
+  const p4est_locidx_t Ncells = p4est->local_num_quadrants;
+  const p4est_locidx_t Ncorners = P4EST_CHILDREN * Ncells;
+#ifdef SC_WORDS_BIGENDIAN
+  const char         *byte_order = "BigEndian";
+#else
+  const char         *byte_order = "LittleEndian";
+#endif
+  const char         *trailer = "\n  </AppendedData>\n</VTKFile>\n";
+  int                 i, hlen;
+  int                 retval;
+#ifdef P4EST_MPI
+  int                 mpiret;
+  MPI_Status          mpistatus;
+#endif
+#ifdef P4EST_MPIIO_WRITE
+  MPI_File            mpifile;
+  MPI_Offset          mpithis;
+#else
+#ifdef P4EST_MPI
+  long                token = 0;
+#endif
+  long                fthis;
+#endif
+  FILE               *file;
+  size_t              num_quads, zz;
+  size_t              lbytes;
+  char               *lbuf;
+  uint64_t            bsize[6], boffset[7], goffset;
+  uint8_t            *uint8_data;
+  p4est_locidx_t     *locidx_data;
+  p4est_gloidx_t     *gloidx_data;
+  P4EST_VTK_FLOAT_TYPE *float_data;
+  p4est_topidx_t      jt;
+  p4est_tree_t       *tree;
+  p4est_locidx_t      il;
+  char                header[BUFSIZ];
+  char                vtufilename[BUFSIZ];
+
+  P4EST_GLOBAL_PRODUCTIONF ("Into " P4EST_STRING
+                            "_vtk_write_file_shared %s\n", filename);
+  SC_CHECK_ABORT (p4est->connectivity->num_vertices > 0,
+                  "Must provide connectivity with vertex information");
+
+  snprintf (vtufilename, BUFSIZ, "%s.vtu", filename);
+
+  /* the sizes of the six appended blocks are known on every process */
+  bsize[0] = (uint64_t) (3 * P4EST_CHILDREN * gtotal) *
+    p4est_vtk_coord_size ();
+  bsize[1] = (uint64_t) (P4EST_CHILDREN * gtotal) * sizeof (p4est_gloidx_t);
+  bsize[2] = (uint64_t) gtotal * sizeof (p4est_gloidx_t);
+  bsize[3] = (uint64_t) gtotal;
+  bsize[4] = (uint64_t) gtotal * sizeof (p4est_locidx_t);
+  bsize[5] = (uint64_t) gtotal * sizeof (p4est_locidx_t);
+  boffset[0] = 0;
+  for (i = 0; i < 6; ++i) {
+    boffset[i + 1] = boffset[i] + sizeof (uint64_t) + bsize[i];
+  }
+
+  /* every process composes the same header to know all file offsets */
+  hlen = snprintf
+    (header, BUFSIZ,
+     "<?xml version=\"1.0\"?>\n"
+     "<VTKFile type=\"UnstructuredGrid\" version=\"1.0\""
+     " byte_order=\"%s\" header_type=\"UInt64\">\n"
+     "  <UnstructuredGrid>\n"
+     "    <Piece NumberOfPoints=\"%lld\" NumberOfCells=\"%lld\">\n"
+     "      <Points>\n"
+     "        <DataArray type=\"%s\" Name=\"Position\""
+     " NumberOfComponents=\"3\" format=\"appended\" offset=\"%llu\"/>\n"
+     "      </Points>\n"
+     "      <Cells>\n"
+     "        <DataArray type=\"%s\" Name=\"connectivity\""
+     " format=\"appended\" offset=\"%llu\"/>\n"
+     "        <DataArray type=\"%s\" Name=\"offsets\""
+     " format=\"appended\" offset=\"%llu\"/>\n"
+     "        <DataArray type=\"UInt8\" Name=\"types\""
+     " format=\"appended\" offset=\"%llu\"/>\n"
+     "      </Cells>\n"
+     "      <CellData Scalars=\"mpirank,treeid\">\n"
+     "        <DataArray type=\"%s\" Name=\"mpirank\""
+     " format=\"appended\" offset=\"%llu\"/>\n"
+     "        <DataArray type=\"%s\" Name=\"treeid\""
+     " format=\"appended\" offset=\"%llu\"/>\n"
+     "      </CellData>\n"
+     "    </Piece>\n"
+     "  </UnstructuredGrid>\n"
+     "  <AppendedData encoding=\"raw\">\n"
+     "   _",
+     byte_order,
+     (long long) (P4EST_CHILDREN * gtotal), (long long) gtotal,
+     p4est_vtk_coord_name (), (unsigned long long) boffset[0],
+     P4EST_VTK_GLOIDX, (unsigned long long) boffset[1],
+     P4EST_VTK_GLOIDX, (unsigned long long) boffset[2],
+     (unsigned long long) boffset[3],
+     P4EST_VTK_LOCIDX, (unsigned long long) boffset[4],
+     P4EST_VTK_LOCIDX, (unsigned long long) boffset[5]);
+  SC_CHECK_ABORT (0 < hlen && hlen < BUFSIZ, "compose vtu header");
+
+  /* processor zero creates the file and writes the header, the sizes
+     of the appended blocks and the trailer, which fixes all offsets */
+  if (rank == 0) {
+    file = fopen (vtufilename, "wb");
+    SC_CHECK_ABORT (file != NULL, "file open");
+    sc_fwrite (header, 1, (size_t) hlen, file, "write vtu header");
+    for (i = 0; i < 6; ++i) {
+      retval = fseek (file, (long) (hlen + boffset[i]), SEEK_SET);
+      SC_CHECK_ABORT (retval == 0, "seek block size");
+      sc_fwrite (&bsize[i], sizeof (uint64_t), 1, file,
+                 "write block size");
+    }
+    retval = fseek (file, (long) (hlen + boffset[6]), SEEK_SET);
+    SC_CHECK_ABORT (retval == 0, "seek trailer");
+    sc_fwrite (trailer, 1, strlen (trailer), file, "write vtu trailer");
+
+    /* best attempt to flush file to disk */
+    retval = fflush (file);
+    SC_CHECK_ABORT (retval == 0, "file flush");
+#ifdef P4EST_HAVE_FSYNC
+    retval = fsync (fileno (file));
+    SC_CHECK_ABORT (retval == 0, "file fsync");
+#endif
+    retval = fclose (file);
+    SC_CHECK_ABORT (retval == 0, "file close");
+    file = NULL;
+  }
+
+#ifdef P4EST_MPIIO_WRITE
+  /* every core opens the file at its precomputed offsets */
+  mpiret = MPI_File_open (p4est->mpicomm, (char *) vtufilename,
+                          MPI_MODE_WRONLY | MPI_MODE_UNIQUE_OPEN,
+                          MPI_INFO_NULL, &mpifile);
+  SC_CHECK_MPI (mpiret);
+#else
+  if (rank > 0) {
+    /* wait for sequential synchronization */
+#ifdef P4EST_MPI
+    mpiret = MPI_Recv (&token, 1, MPI_LONG, rank - 1, P4EST_COMM_VTK,
+                       p4est->mpicomm, &mpistatus);
+    SC_CHECK_MPI (mpiret);
+#endif
+  }
+
+  /* open file after all previous processors have written to it */
+  file = fopen (vtufilename, "rb+");
+  SC_CHECK_ABORT (file != NULL, "file open");
+#endif
+
+  /* write this processor's slice of each of the six blocks */
+  for (i = 0; i < 6; ++i) {
+    switch (i) {
+    case 0:
+      float_data = P4EST_ALLOC (P4EST_VTK_FLOAT_TYPE, 3 * Ncorners);
+      p4est_vtk_fill_positions (p4est, geom, p4est_vtk_scale, float_data);
+      lbuf = p4est_vtk_coord_bytes (float_data, 3 * (size_t) Ncorners);
+      if (lbuf != (char *) float_data) {
+        P4EST_FREE (float_data);
+      }
+      lbytes = 3 * (size_t) Ncorners * p4est_vtk_coord_size ();
+      goffset = (uint64_t) (3 * P4EST_CHILDREN * gbefore) *
+        p4est_vtk_coord_size ();
+      break;
+    case 1:
+      gloidx_data = P4EST_ALLOC (p4est_gloidx_t, Ncorners);
+      for (il = 0; il < Ncorners; ++il) {
+        gloidx_data[il] = P4EST_CHILDREN * gbefore + il;
+      }
+      lbuf = (char *) gloidx_data;
+      lbytes = (size_t) Ncorners * sizeof (p4est_gloidx_t);
+      goffset = (uint64_t) (P4EST_CHILDREN * gbefore) *
+        sizeof (p4est_gloidx_t);
+      break;
+    case 2:
+      gloidx_data = P4EST_ALLOC (p4est_gloidx_t, Ncells);
+      for (il = 0; il < Ncells; ++il) {
+        gloidx_data[il] = P4EST_CHILDREN * (gbefore + il + 1);
+      }
+      lbuf = (char *) gloidx_data;
+      lbytes = (size_t) Ncells * sizeof (p4est_gloidx_t);
+      goffset = (uint64_t) gbefore * sizeof (p4est_gloidx_t);
+      break;
+    case 3:
+      uint8_data = P4EST_ALLOC (uint8_t, Ncells);
+      for (il = 0; il < Ncells; ++il) {
+        uint8_data[il] = P4EST_VTK_CELL_TYPE;
+      }
+      lbuf = (char *) uint8_data;
+      lbytes = (size_t) Ncells;
+      goffset = (uint64_t) gbefore;
+      break;
+    case 4:
+      locidx_data = P4EST_ALLOC (p4est_locidx_t, Ncells);
+      for (il = 0; il < Ncells; ++il) {
+        locidx_data[il] = (p4est_locidx_t) rank;
+      }
+      lbuf = (char *) locidx_data;
+      lbytes = (size_t) Ncells * sizeof (p4est_locidx_t);
+      goffset = (uint64_t) gbefore * sizeof (p4est_locidx_t);
+      break;
+    default:
+      P4EST_ASSERT (i == 5);
+      locidx_data = P4EST_ALLOC (p4est_locidx_t, Ncells);
+      for (il = 0, jt = p4est->first_local_tree;
+           jt <= p4est->last_local_tree; ++jt) {
+        tree = p4est_tree_array_index (p4est->trees, jt);
+        num_quads = tree->quadrants.elem_count;
+        for (zz = 0; zz < num_quads; ++zz, ++il) {
+          locidx_data[il] = (p4est_locidx_t) jt;
+        }
+      }
+      P4EST_ASSERT (il == Ncells);
+      lbuf = (char *) locidx_data;
+      lbytes = (size_t) Ncells * sizeof (p4est_locidx_t);
+      goffset = (uint64_t) gbefore * sizeof (p4est_locidx_t);
+      break;
+    }
+
+#ifdef P4EST_MPIIO_WRITE
+    mpithis = (MPI_Offset) ((uint64_t) hlen + boffset[i] +
+                            sizeof (uint64_t) + goffset);
+    mpiret = MPI_File_write_at_all (mpifile, mpithis, lbuf,
+                                    (int) lbytes, MPI_BYTE, &mpistatus);
+    SC_CHECK_MPI (mpiret);
+#else
+    fthis = (long) ((uint64_t) hlen + boffset[i] +
+                    sizeof (uint64_t) + goffset);
+    retval = fseek (file, fthis, SEEK_SET);
+    SC_CHECK_ABORT (retval == 0, "seek block data");
+    sc_fwrite (lbuf, 1, lbytes, file, "write block data");
+#endif
+    P4EST_FREE (lbuf);
+  }
+
+#ifdef P4EST_MPIIO_WRITE
+  mpiret = MPI_File_close (&mpifile);
+  SC_CHECK_MPI (mpiret);
+#else
+  /* best attempt to flush file to disk */
+  retval = fflush (file);
+  SC_CHECK_ABORT (retval == 0, "file flush");
+#ifdef P4EST_HAVE_FSYNC
+  retval = fsync (fileno (file));
+  SC_CHECK_ABORT (retval == 0, "file fsync");
+#endif
+  retval = fclose (file);
+  SC_CHECK_ABORT (retval == 0, "file close");
+  file = NULL;
+
+  /* initiate sequential synchronization */
+#ifdef P4EST_MPI
+  if (rank < num_procs - 1) {
+    mpiret = MPI_Send (&token, 1, MPI_LONG, rank + 1, P4EST_COMM_VTK,
+                       p4est->mpicomm);
+    SC_CHECK_MPI (mpiret);
+  }
+#endif
+#endif
+
+  P4EST_GLOBAL_PRODUCTION ("Done " P4EST_STRING
+                           "_vtk_write_file_shared\n");
+}
+
+void
+p4est_vtk_write_file_stream (p4est_t * p4est, p4est_geometry_t * geom,
+                             p4est_locidx_t chunk_quadrants,
+                             const char *filename)
+{
+  const int           rank = p4est->mpirank;
+  const double        scale = p4est_vtk_scale;
+  const double       *v = p4est->connectivity->vertices;
+  const p4est_topidx_t *tree_to_vertex = p4est->connectivity->tree_to_vertex;
+  const p4est_locidx_t Ncells = p4est->local_num_quadrants;
+  const p4est_locidx_t Ncorners = P4EST_CHILDREN * Ncells;
+#ifdef SC_WORDS_BIGENDIAN
+  const char         *byte_order = "BigEndian";
+#else
+  const char         *byte_order = "LittleEndian";
+#endif
+  int                 i, k;
+  int                 retval;
+  size_t              num_quads, zz;
+  size_t              nfill;
+  char               *chunk_buffer;
+  char               *cbuf;
+  uint64_t            bsize[6], boffset[6];
+  uint8_t            *uint8_data;
+  p4est_locidx_t     *locidx_data;
+  P4EST_VTK_FLOAT_TYPE *float_data;
+  p4est_topidx_t      jt;
+  p4est_topidx_t      vt[P4EST_CHILDREN];
+  p4est_locidx_t      il, chunk;
+  p4est_tree_t       *tree;
+  p4est_quadrant_t   *quad;
+  FILE               *vtufile;
+  char                vtufilename[BUFSIZ];
+
+  P4EST_GLOBAL_PRODUCTIONF ("Into " P4EST_STRING
+                            "_vtk_write_file_stream %s\n", filename);
+  SC_CHECK_ABORT (p4est->connectivity->num_vertices > 0,
+                  "Must provide connectivity with vertex information");
+  P4EST_ASSERT (chunk_quadrants > 0);
+  chunk = chunk_quadrants;
+
+  /* one buffer sized for the widest per-quadrant record, the corner
+     coordinates, bounds the memory of all six passes */
+  chunk_buffer = P4EST_ALLOC (char, (size_t) chunk * 3 * P4EST_CHILDREN *
+                              sizeof (P4EST_VTK_FLOAT_TYPE));
+  float_data = (P4EST_VTK_FLOAT_TYPE *) chunk_buffer;
+  locidx_data = (p4est_locidx_t *) chunk_buffer;
+  uint8_data = (uint8_t *) chunk_buffer;
+
+  /* the sizes of the six appended blocks are known in advance, which
+     allows the header to go out before any block data is generated */
+  bsize[0] = (uint64_t) (3 * Ncorners) * p4est_vtk_coord_size ();
+  bsize[1] = (uint64_t) Ncorners * sizeof (p4est_locidx_t);
+  bsize[2] = (uint64_t) Ncells * sizeof (p4est_locidx_t);
+  bsize[3] = (uint64_t) Ncells;
+  bsize[4] = (uint64_t) Ncells * sizeof (p4est_locidx_t);
+  bsize[5] = (uint64_t) Ncells * sizeof (p4est_locidx_t);
+  boffset[0] = 0;
+  for (i = 0; i < 5; ++i) {
+    boffset[i + 1] = boffset[i] + sizeof (uint64_t) + bsize[i];
+  }
+
+  snprintf (vtufilename, BUFSIZ, "%s_%04d.vtu", filename, rank);
+  vtufile = fopen (vtufilename, "wb");
+  SC_CHECK_ABORT (vtufile != NULL, "file open");
+
+  fprintf (vtufile,
+           "<?xml version=\"1.0\"?>\n"
+           "<VTKFile type=\"UnstructuredGrid\" version=\"1.0\""
+           " byte_order=\"%s\" header_type=\"UInt64\">\n"
+           "  <UnstructuredGrid>\n"
+           "    <Piece NumberOfPoints=\"%lld\" NumberOfCells=\"%lld\">\n"
+           "      <Points>\n"
+           "        <DataArray type=\"%s\" Name=\"Position\""
+           " NumberOfComponents=\"3\" format=\"appended\""
+           " offset=\"%llu\"/>\n"
+           "      </Points>\n"
+           "      <Cells>\n"
+           "        <DataArray type=\"%s\" Name=\"connectivity\""
+           " format=\"appended\" offset=\"%llu\"/>\n"
+           "        <DataArray type=\"%s\" Name=\"offsets\""
+           " format=\"appended\" offset=\"%llu\"/>\n"
+           "        <DataArray type=\"UInt8\" Name=\"types\""
+           " format=\"appended\" offset=\"%llu\"/>\n"
+           "      </Cells>\n"
+           "      <CellData Scalars=\"mpirank,treeid\">\n"
+           "        <DataArray type=\"%s\" Name=\"mpirank\""
+           " format=\"appended\" offset=\"%llu\"/>\n"
+           "        <DataArray type=\"%s\" Name=\"treeid\""
+           " format=\"appended\" offset=\"%llu\"/>\n"
+           "      </CellData>\n"
+           "    </Piece>\n"
+           "  </UnstructuredGrid>\n"
+           "  <AppendedData encoding=\"raw\">\n"
+           "   _",
+           byte_order, (long long) Ncorners, (long long) Ncells,
+           p4est_vtk_coord_name (), (unsigned long long) boffset[0],
+           P4EST_VTK_LOCIDX, (unsigned long long) boffset[1],
+           P4EST_VTK_LOCIDX, (unsigned long long) boffset[2],
+           (unsigned long long) boffset[3],
+           P4EST_VTK_LOCIDX, (unsigned long long) boffset[4],
+           P4EST_VTK_LOCIDX, (unsigned long long) boffset[5]);
+
+  /* corner positions, generated per tree and flushed per chunk */
+  sc_fwrite (&bsize[0], sizeof (uint64_t), 1, vtufile,
+             "write position size");
+  nfill = 0;
+  for (jt = p4est->first_local_tree; jt <= p4est->last_local_tree; ++jt) {
+    tree = p4est_tree_array_index (p4est->trees, jt);
+    for (k = 0; k < P4EST_CHILDREN; ++k) {
+      vt[k] = tree_to_vertex[jt * P4EST_CHILDREN + k];
+    }
+    num_quads = tree->quadrants.elem_count;
+    for (zz = 0; zz < num_quads; ++zz) {
+      quad = p4est_quadrant_array_index (&tree->quadrants, zz);
+      p4est_vtk_quadrant_positions (geom, v, vt, jt, quad, scale,
+                                    float_data + 3 * P4EST_CHILDREN * nfill);
+      if ((p4est_locidx_t) ++nfill == chunk) {
+        cbuf = p4est_vtk_coord_bytes (float_data,
+                                      3 * P4EST_CHILDREN * nfill);
+        sc_fwrite (cbuf, p4est_vtk_coord_size (),
+                   3 * P4EST_CHILDREN * nfill, vtufile, "write positions");
+        if (cbuf != (char *) float_data) {
+          P4EST_FREE (cbuf);
+        }
+        nfill = 0;
+      }
+    }
+  }
+  if (nfill > 0) {
+    cbuf = p4est_vtk_coord_bytes (float_data, 3 * P4EST_CHILDREN * nfill);
+    sc_fwrite (cbuf, p4est_vtk_coord_size (),
+               3 * P4EST_CHILDREN * nfill, vtufile, "write positions");
+    if (cbuf != (char *) float_data) {
+      P4EST_FREE (cbuf);
+    }
+  }
+
+  /* connectivity: the corners are numbered in quadrant order */
+  sc_fwrite (&bsize[1], sizeof (uint64_t), 1, vtufile,
+             "write connectivity size");
+  for (il = 0; il < Ncorners; il += (p4est_locidx_t) nfill) {
+    nfill = SC_MIN ((size_t) (Ncorners - il),
+                    (size_t) chunk * P4EST_CHILDREN);
+    for (zz = 0; zz < nfill; ++zz) {
+      locidx_data[zz] = il + (p4est_locidx_t) zz;
+    }
+    sc_fwrite (locidx_data, sizeof (p4est_locidx_t), nfill, vtufile,
+               "write connectivity");
+  }
+
+  /* cell offsets */
+  sc_fwrite (&bsize[2], sizeof (uint64_t), 1, vtufile,
+             "write offset size");
+  for (il = 0; il < Ncells; il += (p4est_locidx_t) nfill) {
+    nfill = SC_MIN ((size_t) (Ncells - il), (size_t) chunk);
+    for (zz = 0; zz < nfill; ++zz) {
+      locidx_data[zz] = P4EST_CHILDREN * (il + (p4est_locidx_t) zz + 1);
+    }
+    sc_fwrite (locidx_data, sizeof (p4est_locidx_t), nfill, vtufile,
+               "write offsets");
+  }
+
+  /* cell types */
+  sc_fwrite (&bsize[3], sizeof (uint64_t), 1, vtufile, "write type size");
+  for (il = 0; il < Ncells; il += (p4est_locidx_t) nfill) {
+    nfill = SC_MIN ((size_t) (Ncells - il), (size_t) chunk);
+    memset (uint8_data, P4EST_VTK_CELL_TYPE, nfill);
+    sc_fwrite (uint8_data, 1, nfill, vtufile, "write types");
+  }
+
+  /* the MPI rank of every cell */
+  sc_fwrite (&bsize[4], sizeof (uint64_t), 1, vtufile, "write rank size");
+  for (il = 0; il < Ncells; il += (p4est_locidx_t) nfill) {
+    nfill = SC_MIN ((size_t) (Ncells - il), (size_t) chunk);
+    for (zz = 0; zz < nfill; ++zz) {
+      locidx_data[zz] = (p4est_locidx_t) rank;
+    }
+    sc_fwrite (locidx_data, sizeof (p4est_locidx_t), nfill, vtufile,
+               "write mpirank");
+  }
+
+  /* the tree id of every cell, generated per tree like the positions */
+  sc_fwrite (&bsize[5], sizeof (uint64_t), 1, vtufile, "write tree size");
+  nfill = 0;
+  for (jt = p4est->first_local_tree; jt <= p4est->last_local_tree; ++jt) {
+    tree = p4est_tree_array_index (p4est->trees, jt);
+    num_quads = tree->quadrants.elem_count;
+    for (zz = 0; zz < num_quads; ++zz) {
+      locidx_data[nfill] = (p4est_locidx_t) jt;
+      if ((p4est_locidx_t) ++nfill == chunk) {
+        sc_fwrite (locidx_data, sizeof (p4est_locidx_t), nfill, vtufile,
+                   "write treeid");
+        nfill = 0;
+      }
+    }
+  }
+  if (nfill > 0) {
+    sc_fwrite (locidx_data, sizeof (p4est_locidx_t), nfill, vtufile,
+               "write treeid");
+  }
+  P4EST_FREE (chunk_buffer);
+
+  fprintf (vtufile, "\n  </AppendedData>\n</VTKFile>\n");
+  SC_CHECK_ABORT (!ferror (vtufile), "write vtu file");
+  retval = fclose (vtufile);
+  SC_CHECK_ABORT (retval == 0, "file close");
+  vtufile = NULL;
+
+  /* only the root writes the meta files, which are small */
+  if (rank == 0) {
+    int                 p;
+    char                visitfilename[BUFSIZ];
+    char                pvtufilename[BUFSIZ];
+    FILE               *pvtufile, *visitfile;
+
+    snprintf (pvtufilename, BUFSIZ, "%s.pvtu", filename);
+    pvtufile = fopen (pvtufilename, "wb");
+    SC_CHECK_ABORT (pvtufile != NULL, "pvtu file open");
+
+    snprintf (visitfilename, BUFSIZ, "%s.visit", filename);
+    visitfile = fopen (visitfilename, "wb");
+    SC_CHECK_ABORT (visitfile != NULL, "visit file open");
+    fprintf (visitfile, "!NBLOCKS %d\n", p4est->mpisize);
+
+    fprintf (pvtufile,
+             "<?xml version=\"1.0\"?>\n"
+             "<VTKFile type=\"PUnstructuredGrid\" version=\"0.1\""
+             " byte_order=\"%s\">\n"
+             "  <PUnstructuredGrid GhostLevel=\"0\">\n"
+             "    <PPoints>\n"
+             "      <PDataArray type=\"%s\" Name=\"Position\""
+             " NumberOfComponents=\"3\" format=\"appended\"/>\n"
+             "    </PPoints>\n"
+             "    <PCellData Scalars=\"mpirank,treeid\">\n"
+             "      <PDataArray type=\"%s\" Name=\"mpirank\""
+             " format=\"appended\"/>\n"
+             "      <PDataArray type=\"%s\" Name=\"treeid\""
+             " format=\"appended\"/>\n"
+             "    </PCellData>\n",
+             byte_order, p4est_vtk_coord_name (),
+             P4EST_VTK_LOCIDX, P4EST_VTK_LOCIDX);
+    for (p = 0; p < p4est->mpisize; ++p) {
+      fprintf (pvtufile,
+               "    <Piece Source=\"%s_%04d.vtu\"/>\n", filename, p);
+      fprintf (visitfile, "%s_%04d.vtu\n", filename, p);
+    }
+    fprintf (pvtufile, "  </PUnstructuredGrid>\n</VTKFile>\n");
+
+    SC_CHECK_ABORT (!ferror (pvtufile), "write pvtu file");
+    retval = fclose (pvtufile);
+    SC_CHECK_ABORT (retval == 0, "pvtu file close");
+    SC_CHECK_ABORT (!ferror (visitfile), "write visit file");
+    retval = fclose (visitfile);
+    SC_CHECK_ABORT (retval == 0, "visit file close");
+  }
+
+  P4EST_GLOBAL_PRODUCTION ("Done " P4EST_STRING
+                           "_vtk_write_file_stream\n");
+}
+
+void
+p4est_vtk_write_file_aggregate (p4est_t * p4est, p4est_geometry_t * geom,
+                                const char *filename)
+{
+#ifndef P4EST_VTK_AGGREGATE
+  /* without node communicators every rank writes for itself */
+  p4est_vtk_write_file (p4est, geom, filename);
+#else
+  const p4est_locidx_t Ncells = p4est->local_num_quadrants;
+  const p4est_locidx_t Ncorners = P4EST_CHILDREN * Ncells;
+#ifdef SC_WORDS_BIGENDIAN
+  const char         *byte_order = "BigEndian";
+#else
+  const char         *byte_order = "LittleEndian";
+#endif
+  int                 mpiret;
+  int                 i, p;
+  int                 retval;
+  int                 noderank, nodesize;
+  int                 leader_rank, myrank_int;
+  int                *cell_counts, *node_ranks;
+  int                *byte_counts, *byte_displs;
+  size_t              lbytes;
+  size_t              num_quads, zz;
+  char               *cbuf, *gpos;
+  uint64_t            bsize[6], boffset[6];
+  uint64_t            total_cells, total_bytes;
+  uint8_t            *uint8_data;
+  p4est_locidx_t      il, ntotal;
+  p4est_locidx_t     *treeid_data, *gtree, *locidx_data;
+  p4est_topidx_t      jt;
+  p4est_tree_t       *tree;
+  P4EST_VTK_FLOAT_TYPE *float_data;
+  MPI_Comm            nodecomm;
+  FILE               *vtufile;
+  char                vtufilename[BUFSIZ];
+
+  P4EST_GLOBAL_PRODUCTIONF ("Into " P4EST_STRING
+                            "_vtk_write_file_aggregate %s\n", filename);
+  SC_CHECK_ABORT (p4est->connectivity->num_vertices > 0,
+                  "Must provide connectivity with vertex information");
+
+  /* co-located ranks talk over shared memory; the key keeps the parent
+     rank order within each node */
+  mpiret = MPI_Comm_split_type (p4est->mpicomm, MPI_COMM_TYPE_SHARED,
+                                p4est->mpirank, MPI_INFO_NULL, &nodecomm);
+  SC_CHECK_MPI (mpiret);
+  mpiret = MPI_Comm_rank (nodecomm, &noderank);
+  SC_CHECK_MPI (mpiret);
+  mpiret = MPI_Comm_size (nodecomm, &nodesize);
+  SC_CHECK_MPI (mpiret);
+
+  /* the node file is named after the parent rank of its writer */
+  leader_rank = p4est->mpirank;
+  mpiret = MPI_Bcast (&leader_rank, 1, MPI_INT, 0, nodecomm);
+  SC_CHECK_MPI (mpiret);
+
+  /* every rank renders its coordinates at the output precision */
+  float_data = P4EST_ALLOC (P4EST_VTK_FLOAT_TYPE, 3 * Ncorners);
+  p4est_vtk_fill_positions (p4est, geom, p4est_vtk_scale, float_data);
+  cbuf = p4est_vtk_coord_bytes (float_data, 3 * (size_t) Ncorners);
+  if (cbuf != (char *) float_data) {
+    P4EST_FREE (float_data);
+    float_data = NULL;
+  }
+  lbytes = 3 * (size_t) Ncorners * p4est_vtk_coord_size ();
+
+  /* and its per-cell tree ids */
+  treeid_data = P4EST_ALLOC (p4est_locidx_t, Ncells);
+  for (il = 0, jt = p4est->first_local_tree;
+       jt <= p4est->last_local_tree; ++jt) {
+    tree = p4est_tree_array_index (p4est->trees, jt);
+    num_quads = tree->quadrants.elem_count;
+    for (zz = 0; zz < num_quads; ++zz, ++il) {
+      treeid_data[il] = (p4est_locidx_t) jt;
+    }
+  }
+  P4EST_ASSERT (il == Ncells);
+
+  /* the writer learns the composition of its node */
+  cell_counts = noderank == 0 ? P4EST_ALLOC (int, nodesize) : NULL;
+  node_ranks = noderank == 0 ? P4EST_ALLOC (int, nodesize) : NULL;
+  byte_counts = noderank == 0 ? P4EST_ALLOC (int, nodesize) : NULL;
+  byte_displs = noderank == 0 ? P4EST_ALLOC (int, nodesize) : NULL;
+  i = (int) Ncells;
+  mpiret = MPI_Gather (&i, 1, MPI_INT, cell_counts, 1, MPI_INT,
+                       0, nodecomm);
+  SC_CHECK_MPI (mpiret);
+  myrank_int = p4est->mpirank;
+  mpiret = MPI_Gather (&myrank_int, 1, MPI_INT, node_ranks, 1, MPI_INT,
+                       0, nodecomm);
+  SC_CHECK_MPI (mpiret);
+
+  total_cells = 0;
+  gpos = NULL;
+  gtree = NULL;
+  if (noderank == 0) {
+    for (i = 0; i < nodesize; ++i) {
+      total_cells += (uint64_t) cell_counts[i];
+    }
+    SC_CHECK_ABORT ((uint64_t) P4EST_CHILDREN * total_cells <=
+                    (uint64_t) P4EST_LOCIDX_MAX,
+                    "aggregated node cell count overflow");
+
+    /* funnel the coordinate payload of the node over shared memory */
+    total_bytes = 0;
+    for (i = 0; i < nodesize; ++i) {
+      byte_counts[i] = cell_counts[i] * 3 * P4EST_CHILDREN *
+        (int) p4est_vtk_coord_size ();
+      byte_displs[i] = (int) total_bytes;
+      total_bytes += (uint64_t) byte_counts[i];
+    }
+    SC_CHECK_ABORT (total_bytes <= (uint64_t) INT_MAX,
+                    "aggregated node coordinate payload overflow");
+    gpos = P4EST_ALLOC (char, (size_t) total_bytes);
+  }
+  mpiret = MPI_Gatherv (cbuf, (int) lbytes, MPI_BYTE, gpos,
+                        byte_counts, byte_displs, MPI_BYTE, 0, nodecomm);
+  SC_CHECK_MPI (mpiret);
+  /* cbuf aliases float_data when no conversion took place */
+  P4EST_FREE (cbuf);
+
+  /* funnel the tree ids the same way */
+  if (noderank == 0) {
+    total_bytes = 0;
+    for (i = 0; i < nodesize; ++i) {
+      byte_counts[i] = cell_counts[i] * (int) sizeof (p4est_locidx_t);
+      byte_displs[i] = (int) total_bytes;
+      total_bytes += (uint64_t) byte_counts[i];
+    }
+    gtree = P4EST_ALLOC (p4est_locidx_t, (size_t) total_cells);
+  }
+  mpiret = MPI_Gatherv (treeid_data,
+                        (int) ((size_t) Ncells * sizeof (p4est_locidx_t)),
+                        MPI_BYTE, gtree, byte_counts, byte_displs,
+                        MPI_BYTE, 0, nodecomm);
+  SC_CHECK_MPI (mpiret);
+  P4EST_FREE (treeid_data);
+
+  if (noderank == 0) {
+    /* one raw appended vtu file per node, in the stream writer layout */
+    ntotal = (p4est_locidx_t) total_cells;
+    bsize[0] = (uint64_t) (3 * P4EST_CHILDREN) * total_cells *
+      p4est_vtk_coord_size ();
+    bsize[1] = (uint64_t) P4EST_CHILDREN * total_cells *
+      sizeof (p4est_locidx_t);
+    bsize[2] = total_cells * sizeof (p4est_locidx_t);
+    bsize[3] = total_cells;
+    bsize[4] = total_cells * sizeof (p4est_locidx_t);
+    bsize[5] = total_cells * sizeof (p4est_locidx_t);
+    boffset[0] = 0;
+    for (i = 0; i < 5; ++i) {
+      boffset[i + 1] = boffset[i] + sizeof (uint64_t) + bsize[i];
+    }
+
+    snprintf (vtufilename, BUFSIZ, "%s_%04d.vtu", filename, leader_rank);
+    vtufile = fopen (vtufilename, "wb");
+    SC_CHECK_ABORT (vtufile != NULL, "file open");
+
+    fprintf (vtufile,
+             "<?xml version=\"1.0\"?>\n"
+             "<VTKFile type=\"UnstructuredGrid\" version=\"1.0\""
+             " byte_order=\"%s\" header_type=\"UInt64\">\n"
+             "  <UnstructuredGrid>\n"
+             "    <Piece NumberOfPoints=\"%lld\" NumberOfCells=\"%lld\">\n"
+             "      <Points>\n"
+             "        <DataArray type=\"%s\" Name=\"Position\""
+             " NumberOfComponents=\"3\" format=\"appended\""
+             " offset=\"%llu\"/>\n"
+             "      </Points>\n"
+             "      <Cells>\n"
+             "        <DataArray type=\"%s\" Name=\"connectivity\""
+             " format=\"appended\" offset=\"%llu\"/>\n"
+             "        <DataArray type=\"%s\" Name=\"offsets\""
+             " format=\"appended\" offset=\"%llu\"/>\n"
+             "        <DataArray type=\"UInt8\" Name=\"types\""
+             " format=\"appended\" offset=\"%llu\"/>\n"
+             "      </Cells>\n"
+             "      <CellData Scalars=\"mpirank,treeid\">\n"
+             "        <DataArray type=\"%s\" Name=\"mpirank\""
+             " format=\"appended\" offset=\"%llu\"/>\n"
+             "        <DataArray type=\"%s\" Name=\"treeid\""
+             " format=\"appended\" offset=\"%llu\"/>\n"
+             "      </CellData>\n"
+             "    </Piece>\n"
+             "  </UnstructuredGrid>\n"
+             "  <AppendedData encoding=\"raw\">\n"
+             "   _",
+             byte_order,
+             (long long) (P4EST_CHILDREN * (uint64_t) ntotal),
+             (long long) ntotal,
+             p4est_vtk_coord_name (), (unsigned long long) boffset[0],
+             P4EST_VTK_LOCIDX, (unsigned long long) boffset[1],
+             P4EST_VTK_LOCIDX, (unsigned long long) boffset[2],
+             (unsigned long long) boffset[3],
+             P4EST_VTK_LOCIDX, (unsigned long long) boffset[4],
+             P4EST_VTK_LOCIDX, (unsigned long long) boffset[5]);
+
+    /* the gathered corner positions */
+    sc_fwrite (&bsize[0], sizeof (uint64_t), 1, vtufile,
+               "write position size");
+    sc_fwrite (gpos, 1, (size_t) bsize[0], vtufile, "write positions");
+    P4EST_FREE (gpos);
+
+    /* connectivity: the corners are numbered in cell order */
+    locidx_data = P4EST_ALLOC (p4est_locidx_t, P4EST_CHILDREN * ntotal);
+    sc_fwrite (&bsize[1], sizeof (uint64_t), 1, vtufile,
+               "write connectivity size");
+    for (il = 0; il < P4EST_CHILDREN * ntotal; ++il) {
+      locidx_data[il] = il;
+    }
+    sc_fwrite (locidx_data, sizeof (p4est_locidx_t),
+               (size_t) (P4EST_CHILDREN * ntotal), vtufile,
+               "write connectivity");
+
+    /* cell offsets */
+    sc_fwrite (&bsize[2], sizeof (uint64_t), 1, vtufile,
+               "write offset size");
+    for (il = 0; il < ntotal; ++il) {
+      locidx_data[il] = P4EST_CHILDREN * (il + 1);
+    }
+    sc_fwrite (locidx_data, sizeof (p4est_locidx_t), (size_t) ntotal,
+               vtufile, "write offsets");
+
+    /* cell types */
+    uint8_data = (uint8_t *) locidx_data;
+    memset (uint8_data, P4EST_VTK_CELL_TYPE, (size_t) ntotal);
+    sc_fwrite (&bsize[3], sizeof (uint64_t), 1, vtufile,
+               "write type size");
+    sc_fwrite (uint8_data, 1, (size_t) ntotal, vtufile, "write types");
+
+    /* the parent rank of every contributing cell */
+    sc_fwrite (&bsize[4], sizeof (uint64_t), 1, vtufile,
+               "write rank size");
+    for (il = 0, i = 0; i < nodesize; ++i) {
+      for (p = 0; p < cell_counts[i]; ++p) {
+        locidx_data[il++] = (p4est_locidx_t) node_ranks[i];
+      }
+    }
+    P4EST_ASSERT (il == ntotal);
+    sc_fwrite (locidx_data, sizeof (p4est_locidx_t), (size_t) ntotal,
+               vtufile, "write mpirank");
+    P4EST_FREE (locidx_data);
+
+    /* the gathered tree ids */
+    sc_fwrite (&bsize[5], sizeof (uint64_t), 1, vtufile,
+               "write tree size");
+    sc_fwrite (gtree, sizeof (p4est_locidx_t), (size_t) ntotal, vtufile,
+               "write treeid");
+    P4EST_FREE (gtree);
+
+    fprintf (vtufile, "\n  </AppendedData>\n</VTKFile>\n");
+    SC_CHECK_ABORT (!ferror (vtufile), "write vtu file");
+    retval = fclose (vtufile);
+    SC_CHECK_ABORT (retval == 0, "file close");
+    vtufile = NULL;
+  }
+  P4EST_FREE (cell_counts);
+  P4EST_FREE (node_ranks);
+  P4EST_FREE (byte_counts);
+  P4EST_FREE (byte_displs);
+  mpiret = MPI_Comm_free (&nodecomm);
+  SC_CHECK_MPI (mpiret);
+
+  /* the root learns all writer ranks and creates the meta files */
+  node_ranks = p4est->mpirank == 0 ?
+    P4EST_ALLOC (int, p4est->mpisize) : NULL;
+  mpiret = MPI_Gather (&leader_rank, 1, MPI_INT, node_ranks, 1, MPI_INT,
+                       0, p4est->mpicomm);
+  SC_CHECK_MPI (mpiret);
+  if (p4est->mpirank == 0) {
+    int                 num_nodes;
+    char                visitfilename[BUFSIZ];
+    char                pvtufilename[BUFSIZ];
+    FILE               *pvtufile, *visitfile;
+
+    /* a rank writes a file iff it leads its own node */
+    num_nodes = 0;
+    for (p = 0; p < p4est->mpisize; ++p) {
+      num_nodes += (node_ranks[p] == p);
+    }
+
+    snprintf (pvtufilename, BUFSIZ, "%s.pvtu", filename);
+    pvtufile = fopen (pvtufilename, "wb");
+    SC_CHECK_ABORT (pvtufile != NULL, "pvtu file open");
+
+    snprintf (visitfilename, BUFSIZ, "%s.visit", filename);
+    visitfile = fopen (visitfilename, "wb");
+    SC_CHECK_ABORT (visitfile != NULL, "visit file open");
+    fprintf (visitfile, "!NBLOCKS %d\n", num_nodes);
+
+    fprintf (pvtufile,
+             "<?xml version=\"1.0\"?>\n"
+             "<VTKFile type=\"PUnstructuredGrid\" version=\"0.1\""
+             " byte_order=\"%s\">\n"
+             "  <PUnstructuredGrid GhostLevel=\"0\">\n"
+             "    <PPoints>\n"
+             "      <PDataArray type=\"%s\" Name=\"Position\""
+             " NumberOfComponents=\"3\" format=\"appended\"/>\n"
+             "    </PPoints>\n"
+             "    <PCellData Scalars=\"mpirank,treeid\">\n"
+             "      <PDataArray type=\"%s\" Name=\"mpirank\""
+             " format=\"appended\"/>\n"
+             "      <PDataArray type=\"%s\" Name=\"treeid\""
+             " format=\"appended\"/>\n"
+             "    </PCellData>\n",
+             byte_order, p4est_vtk_coord_name (),
+             P4EST_VTK_LOCIDX, P4EST_VTK_LOCIDX);
+    for (p = 0; p < p4est->mpisize; ++p) {
+      if (node_ranks[p] == p) {
+        fprintf (pvtufile,
+                 "    <Piece Source=\"%s_%04d.vtu\"/>\n", filename, p);
+        fprintf (visitfile, "%s_%04d.vtu\n", filename, p);
+      }
+    }
+    fprintf (pvtufile, "  </PUnstructuredGrid>\n</VTKFile>\n");
+
+    SC_CHECK_ABORT (!ferror (pvtufile), "write pvtu file");
+    retval = fclose (pvtufile);
+    SC_CHECK_ABORT (retval == 0, "pvtu file close");
+    SC_CHECK_ABORT (!ferror (visitfile), "write visit file");
+    retval = fclose (visitfile);
+    SC_CHECK_ABORT (retval == 0, "visit file close");
+  }
+  P4EST_FREE (node_ranks);
+
+  P4EST_GLOBAL_PRODUCTION ("Done " P4EST_STRING
+                           "_vtk_write_file_aggregate\n");
+#endif /* P4EST_VTK_AGGREGATE */
+}
+
+p4est_vtk_pipeline_t *
+p4est_vtk_pipeline_new (p4est_t * p4est, p4est_geometry_t * geom,
+                        const char *filename)
+{
+  p4est_vtk_pipeline_t *pipeline;
+
+  pipeline = P4EST_ALLOC_ZERO (p4est_vtk_pipeline_t, 1);
+  pipeline->p4est = p4est;
+  pipeline->geom = geom;
+  pipeline->filename = P4EST_STRDUP (filename);
+
+  return pipeline;
+}
+
+void
+p4est_vtk_pipeline_add_field (p4est_vtk_pipeline_t * pipeline,
+                              const char *name, size_t offset, size_t stride)
+{
+  const int           nf = pipeline->num_fields;
+
+  pipeline->names = P4EST_REALLOC (pipeline->names, char *, nf + 1);
+  pipeline->offsets = P4EST_REALLOC (pipeline->offsets, size_t, nf + 1);
+  pipeline->strides = P4EST_REALLOC (pipeline->strides, size_t, nf + 1);
+  pipeline->names[nf] = P4EST_STRDUP (name);
+  pipeline->offsets[nf] = offset;
+  pipeline->strides[nf] = stride;
+  pipeline->num_fields = nf + 1;
+}
+
+void
+p4est_vtk_pipeline_snapshot (p4est_vtk_pipeline_t * pipeline)
+{
+  p4est_t            *p4est = pipeline->p4est;
+  const p4est_locidx_t Ncorners =
+    P4EST_CHILDREN * p4est->local_num_quadrants;
+  int                 nf, k;
+  size_t              zz;
+  double             *field;
+  const char         *data;
+  sc_array_t         *quadrants;
+  p4est_topidx_t      jt;
+  p4est_tree_t       *tree;
+  p4est_quadrant_t   *quad;
+  p4est_locidx_t      quad_count;
+
+  P4EST_ASSERT (p4est->data_size > 0);
+
+  pipeline->buffer = P4EST_REALLOC (pipeline->buffer, double,
+                                    (size_t) pipeline->num_fields *
+                                    (size_t) Ncorners);
+  pipeline->num_corners = Ncorners;
+
+  /* copy the registered fields out of the quadrant user data so the
+   * solver may overwrite them while the dump is still pending */
+  for (nf = 0; nf < pipeline->num_fields; ++nf) {
+    field = pipeline->buffer + (size_t) nf * (size_t) Ncorners;
+    quad_count = 0;
+    for (jt = p4est->first_local_tree; jt <= p4est->last_local_tree; ++jt) {
+      tree = p4est_tree_array_index (p4est->trees, jt);
+      quadrants = &tree->quadrants;
+      for (zz = 0; zz < quadrants->elem_count; ++zz, ++quad_count) {
+        quad = p4est_quadrant_array_index (quadrants, zz);
+        data = (const char *) quad->p.user_data + pipeline->offsets[nf];
+        for (k = 0; k < P4EST_CHILDREN; ++k) {
+          field[P4EST_CHILDREN * quad_count + k] =
+            *(const double *) (data + (size_t) k * pipeline->strides[nf]);
+        }
+      }
+    }
+    P4EST_ASSERT (quad_count == p4est->local_num_quadrants);
+  }
+}
+
+void
+p4est_vtk_pipeline_write (p4est_vtk_pipeline_t * pipeline)
+{
+  p4est_t            *p4est = pipeline->p4est;
+  const p4est_locidx_t Ncorners =
+    P4EST_CHILDREN * p4est->local_num_quadrants;
+  int                 nf;
+  int                 retval;
+  int                 scalar_strlen;
+  char                point_scalars[BUFSIZ];
+  char                stepname[BUFSIZ];
+
+  SC_CHECK_ABORT (pipeline->buffer != NULL &&
+                  pipeline->num_corners == Ncorners,
+                  P4EST_STRING "_vtk: Snapshot does not match the forest");
+
+  snprintf (stepname, BUFSIZ, "%s_%06d", pipeline->filename,
+            pipeline->num_writes++);
+
+  scalar_strlen = 0;
+  point_scalars[0] = '\0';
+  for (nf = 0; nf < pipeline->num_fields; ++nf) {
+    retval = snprintf (point_scalars + scalar_strlen, BUFSIZ - scalar_strlen,
+                       "%s%s", nf == 0 ? "" : ",", pipeline->names[nf]);
+    SC_CHECK_ABORT (retval > 0,
+                    P4EST_STRING "_vtk: Error collecting point scalars");
+    scalar_strlen += retval;
+  }
+
+  retval = p4est_vtk_write_header (p4est, pipeline->geom, p4est_vtk_scale,
+                                   p4est_vtk_write_tree,
+                                   p4est_vtk_write_rank,
+                                   p4est_vtk_wrap_rank,
+                                   pipeline->num_fields > 0 ?
+                                   point_scalars : NULL, NULL, stepname);
+  SC_CHECK_ABORT (!retval, P4EST_STRING "_vtk: Error writing header");
+
+  for (nf = 0; nf < pipeline->num_fields; ++nf) {
+    retval = p4est_vtk_write_point_scalar (p4est, pipeline->geom, stepname,
+                                           pipeline->names[nf],
+                                           pipeline->buffer +
+                                           (size_t) nf * (size_t) Ncorners);
+    SC_CHECK_ABORT (!retval,
+                    P4EST_STRING "_vtk: Error writing point scalars");
+  }
+
+  retval = p4est_vtk_write_footer (p4est, stepname);
+  SC_CHECK_ABORT (!retval, P4EST_STRING "_vtk: Error writing footer");
+}
+
+void
+p4est_vtk_pipeline_destroy (p4est_vtk_pipeline_t * pipeline)
+{
+  int                 nf;
+
+  for (nf = 0; nf < pipeline->num_fields; ++nf) {
+    P4EST_FREE (pipeline->names[nf]);
+  }
+  P4EST_FREE (pipeline->names);
+  P4EST_FREE (pipeline->offsets);
+  P4EST_FREE (pipeline->strides);
+  P4EST_FREE (pipeline->buffer);
+  P4EST_FREE (pipeline->filename);
+  P4EST_FREE (pipeline);
+}
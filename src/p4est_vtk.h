@@ -33,9 +33,39 @@
  ********************************************************************/
 
 #include <p4est_geometry.h>
+#include <p4est_nodes.h>
 
 SC_EXTERN_C_BEGIN;
 
+/** Gathers the fields that are dumped together for in-situ output. */
+typedef struct p4est_vtk_pipeline
+{
+  p4est_t            *p4est;    /**< the forest being visualized */
+  p4est_geometry_t   *geom;     /**< the geometry used for the dumps */
+  char               *filename; /**< prefix of the output file series */
+  int                 num_fields;       /**< number of registered fields */
+  char              **names;    /**< the VTK name of each field */
+  size_t             *offsets;  /**< byte offset into the user data */
+  size_t             *strides;  /**< byte distance between corner values */
+  p4est_locidx_t      num_corners;      /**< corners in the snapshot */
+  double             *buffer;   /**< back buffer of snapshotted values */
+  int                 num_writes;       /**< dumps written so far */
+}
+p4est_vtk_pipeline_t;
+
+/** Select the precision of the point coordinates in all VTK output.
+ *
+ * The coordinates are computed in double precision, including the
+ * p4est_geometry mapping, and converted to the selected width only
+ * when they are written, so a \a precision of 32 halves the Position
+ * payload of every writer in this file without touching the transform.
+ * Point and cell data fields keep the compile-time float type.
+ * The default matches the compile-time P4EST_VTK_DOUBLES setting.
+ *
+ * \param [in] precision    Bits per coordinate, 32 or 64.
+ */
+void                p4est_vtk_set_coordinate_precision (int precision);
+
 /** This writes out the p4est in VTK format.
  *
  * This is a convenience function for the special
@@ -53,6 +83,94 @@ void                p4est_vtk_write_file (p4est_t * p4est,
                                           p4est_geometry_t * geom,
                                           const char *filename);
 
+/** This writes out the p4est into one shared VTK file for all ranks.
+ *
+ * Only the single file filename.vtu is created, so the metadata load on
+ * the file system does not grow with the number of processes.  Every
+ * process writes its quadrants at precomputed offsets derived from
+ * p4est->global_first_quadrant; with --enable-mpiio this happens through
+ * collective MPI-IO writes, otherwise the processes write sequentially.
+ * The file stores the cell corners, the tree id and the MPI rank, like
+ * p4est_vtk_write_file, as raw appended data with 64-bit headers.
+ * This function will abort if there is a file error.
+ *
+ * \param [in] p4est    The p4est to be written.
+ * \param [in] geom     A p4est_geometry_t structure or NULL for identity.
+ * \param [in] filename The file name without the .vtu extension.
+ */
+void                p4est_vtk_write_file_shared (p4est_t * p4est,
+                                                 p4est_geometry_t * geom,
+                                                 const char *filename);
+
+/** This writes out the p4est in VTK format with bounded memory.
+ *
+ * The file contents match p4est_vtk_write_file, but instead of
+ * materializing the full coordinate and connectivity arrays, the data
+ * is generated and written in chunks of at most \a chunk_quadrants
+ * quadrants, so the writer needs memory proportional to the chunk and
+ * not to the local forest.  The raw appended data format is used
+ * regardless of the compile-time output options, since it is the only
+ * layout whose file offsets are known before the data is generated.
+ * This function will abort if there is a file error.
+ *
+ * \param [in] p4est    The p4est to be written.
+ * \param [in] geom     A p4est_geometry_t structure or NULL for identity.
+ * \param [in] chunk_quadrants  Positive bound on the quadrants buffered
+ *                      at any one time; the peak buffer size is
+ *                      3 * P4EST_CHILDREN coordinates per quadrant.
+ * \param [in] filename The first part of the file name, as in
+ *                      p4est_vtk_write_file.
+ */
+void                p4est_vtk_write_file_stream (p4est_t * p4est,
+                                                 p4est_geometry_t * geom,
+                                                 p4est_locidx_t
+                                                 chunk_quadrants,
+                                                 const char *filename);
+
+/** This writes out the p4est with one file per compute node.
+ *
+ * The ranks of each shared-memory node, discovered through
+ * MPI_Comm_split_type, funnel their corner coordinates and cell data to
+ * the first rank of the node, which writes them as a single vtu file in
+ * the raw appended layout of p4est_vtk_write_file_stream.  The file
+ * system therefore sees one write stream and one file per node instead
+ * of one per rank, while the cell payload stays identical to
+ * p4est_vtk_write_file; the mpirank cell field still records the
+ * original owner of every quadrant.  The meta files on rank 0 list the
+ * per-node pieces.  Without MPI-3 support this falls back to
+ * p4est_vtk_write_file.  This function will abort on a file error.
+ *
+ * \param [in] p4est    The p4est to be written.
+ * \param [in] geom     A p4est_geometry_t structure or NULL for identity.
+ * \param [in] filename The first part of the file name; one file
+ *                      filename_rank.vtu is written per node, named
+ *                      after the node's first rank.
+ */
+void                p4est_vtk_write_file_aggregate (p4est_t * p4est,
+                                                    p4est_geometry_t * geom,
+                                                    const char *filename);
+
+/** This writes out the p4est with a deduplicated set of points.
+ *
+ * Instead of emitting P4EST_CHILDREN corner coordinates per quadrant,
+ * the shared vertices are written once and referenced through the
+ * connectivity array, which shrinks the point payload accordingly.
+ * A caller-provided \a nodes avoids recomputing the numbering on every
+ * dump; it must match the current forest and is not destroyed here.
+ * This function will abort if there is a file error.
+ *
+ * \param [in] p4est    The p4est to be written.
+ * \param [in] geom     A p4est_geometry_t structure or NULL for identity.
+ * \param [in] nodes    The node numbering to reuse, or NULL to compute
+ *                      a temporary one internally.
+ * \param [in] filename The first part of the file name, as in
+ *                      p4est_vtk_write_file.
+ */
+void                p4est_vtk_write_file_nodes (p4est_t * p4est,
+                                                p4est_geometry_t * geom,
+                                                p4est_nodes_t * nodes,
+                                                const char *filename);
+
 /** This writes out the p4est and any number of point fields in VTK format.
  *
  * This is a convenience function that will abort if there is a file error.
@@ -114,6 +232,29 @@ int                 p4est_vtk_write_header (p4est_t * p4est,
                                             const char *point_vectors,
                                             const char *filename);
 
+/** This will write the header of the vtu file with deduplicated points.
+ *
+ * This behaves like p4est_vtk_write_header, except that the shared
+ * vertices are written once each, indexed by the connectivity array.
+ * If \a nodes is non-NULL it is reused and left untouched, which
+ * requires \a scale == 1.; otherwise the choice between duplicated
+ * corners and an internally computed numbering follows \a scale as in
+ * p4est_vtk_write_header.  Point fields written afterwards assume the
+ * duplicated corner layout and are not supported in this mode.
+ *
+ * \return          This returns 0 if no error and -1 if there is an error.
+ */
+int                 p4est_vtk_write_header_nodes (p4est_t * p4est,
+                                                  p4est_geometry_t * geom,
+                                                  p4est_nodes_t * nodes,
+                                                  double scale,
+                                                  int write_tree,
+                                                  int write_rank,
+                                                  int wrap_rank,
+                                                  const char *point_scalars,
+                                                  const char *point_vectors,
+                                                  const char *filename);
+
 /** This will write a scalar field to the vtu file.
  *
  * It is good practice to make sure that the scalar field also
@@ -164,6 +305,61 @@ int                 p4est_vtk_write_point_vector (p4est_t * p4est,
                                                   const char *vector_name,
                                                   const double *values);
 
+/** Create a pipeline for repeated dumps of quadrant user data fields.
+ *
+ * The pipeline separates the capture of the field values from the file
+ * output: p4est_vtk_pipeline_snapshot copies the registered fields into
+ * a back buffer with plain memory reads, after which the solver may
+ * overwrite its user data, and p4est_vtk_pipeline_write performs the
+ * file system traffic from the buffer at a convenient later time.
+ * Each write produces the file series member filename_NNNNNN.
+ *
+ * \param [in] p4est    The forest whose fields will be dumped.
+ *                      It must not be adapted or repartitioned between
+ *                      a snapshot and the write that consumes it.
+ * \param [in] geom     A p4est_geometry_t structure or NULL for identity.
+ * \param [in] filename The prefix of the output file series.
+ * \return              A pipeline without any registered fields.
+ */
+p4est_vtk_pipeline_t *p4est_vtk_pipeline_new (p4est_t * p4est,
+                                              p4est_geometry_t * geom,
+                                              const char *filename);
+
+/** Register one scalar field stored in the quadrant user data.
+ *
+ * \param [in,out] pipeline The pipeline to extend.
+ * \param [in] name     The name of the field inside the VTK files.
+ * \param [in] offset   Byte offset of the first value in the user data.
+ * \param [in] stride   Byte distance between the P4EST_CHILDREN corner
+ *                      values of a quadrant, or 0 to replicate one
+ *                      cell value to all of its corners.
+ */
+void                p4est_vtk_pipeline_add_field (p4est_vtk_pipeline_t *
+                                                  pipeline,
+                                                  const char *name,
+                                                  size_t offset,
+                                                  size_t stride);
+
+/** Copy the registered fields into the pipeline's back buffer.
+ * This only reads memory and returns without touching the file system.
+ * \param [in,out] pipeline The pipeline holding the registered fields.
+ */
+void                p4est_vtk_pipeline_snapshot (p4est_vtk_pipeline_t *
+                                                 pipeline);
+
+/** Write the buffered snapshot and advance the file series.
+ * This aborts if no snapshot was taken or the forest changed since.
+ * \param [in,out] pipeline The pipeline holding a valid snapshot.
+ */
+void                p4est_vtk_pipeline_write (p4est_vtk_pipeline_t *
+                                              pipeline);
+
+/** Free a pipeline and its buffers without writing anything.
+ * \param [in,out] pipeline The pipeline to be freed.
+ */
+void                p4est_vtk_pipeline_destroy (p4est_vtk_pipeline_t *
+                                                pipeline);
+
 /** This will write the footer of the vtu file.
  *
  * Writing a VTK file is split into a couple of routines.
@@ -21,11 +21,15 @@
 */
 
 #ifndef P4_TO_P8
+#include <p4est_algorithms.h>
 #include <p4est_bits.h>
+#include <p4est_communication.h>
 #include <p4est_extended.h>
 #include <p4est_wrap.h>
 #else
+#include <p8est_algorithms.h>
 #include <p8est_bits.h>
+#include <p8est_communication.h>
 #include <p8est_extended.h>
 #include <p8est_wrap.h>
 #endif
@@ -81,6 +85,12 @@ p4est_wrap_new_conn (MPI_Comm mpicomm, p4est_connectivity_t *conn,
   pp->mesh_aux = NULL;
   pp->match_aux = 0;
 
+  pp->journal_num_quadrants = 0;
+  pp->journal_tree_offsets = NULL;
+  pp->journal_first_quads = NULL;
+  pp->journal_levels = NULL;
+  pp->journal_flags = NULL;
+
   return pp;
 }
 
@@ -140,9 +150,71 @@ p4est_wrap_new_world (int initial_level)
 #endif
 }
 
+/** Free the adaptation journal and mark it empty. */
+static void
+p4est_wrap_journal_reset (p4est_wrap_t * pp)
+{
+  P4EST_FREE (pp->journal_tree_offsets);
+  P4EST_FREE (pp->journal_first_quads);
+  P4EST_FREE (pp->journal_levels);
+  P4EST_FREE (pp->journal_flags);
+  pp->journal_num_quadrants = 0;
+  pp->journal_tree_offsets = NULL;
+  pp->journal_first_quads = NULL;
+  pp->journal_levels = NULL;
+  pp->journal_flags = NULL;
+}
+
+/** Record the current leaves and flags into the adaptation journal.
+ * Two bytes per leaf plus one quadrant per local tree suffice: the
+ * position of every leaf after the first follows from the levels.
+ */
+static void
+p4est_wrap_journal_capture (p4est_wrap_t * pp)
+{
+  size_t              qz;
+  p4est_topidx_t      tt, k, num_local_trees;
+  p4est_locidx_t      all;
+  p4est_t            *p4est = pp->p4est;
+  p4est_tree_t       *tree;
+
+  p4est_wrap_journal_reset (pp);
+
+  num_local_trees = (p4est->last_local_tree >= p4est->first_local_tree) ?
+    p4est->last_local_tree - p4est->first_local_tree + 1 : 0;
+  pp->journal_num_quadrants = p4est->local_num_quadrants;
+  pp->journal_tree_offsets =
+    P4EST_ALLOC (p4est_locidx_t, num_local_trees + 1);
+  pp->journal_first_quads =
+    P4EST_ALLOC (p4est_quadrant_t, num_local_trees);
+  pp->journal_levels = P4EST_ALLOC (int8_t, p4est->local_num_quadrants);
+  pp->journal_flags = P4EST_ALLOC (int8_t, p4est->local_num_quadrants);
+  memcpy (pp->journal_flags, pp->flags,
+          (size_t) p4est->local_num_quadrants * sizeof (int8_t));
+
+  all = 0;
+  k = 0;
+  pp->journal_tree_offsets[0] = 0;
+  for (tt = p4est->first_local_tree; tt <= p4est->last_local_tree;
+       ++tt, ++k) {
+    tree = p4est_tree_array_index (p4est->trees, tt);
+    P4EST_ASSERT (tree->quadrants.elem_count > 0);
+    pp->journal_first_quads[k] =
+      *p4est_quadrant_array_index (&tree->quadrants, 0);
+    for (qz = 0; qz < tree->quadrants.elem_count; ++qz) {
+      pp->journal_levels[all++] =
+        p4est_quadrant_array_index (&tree->quadrants, qz)->level;
+    }
+    pp->journal_tree_offsets[k + 1] = all;
+  }
+  P4EST_ASSERT (all == p4est->local_num_quadrants);
+}
+
 void
 p4est_wrap_destroy (p4est_wrap_t * pp)
 {
+  p4est_wrap_journal_reset (pp);
+
   if (pp->mesh_aux != NULL) {
     p4est_mesh_destroy (pp->mesh_aux);
   }
@@ -164,38 +236,61 @@ int
 p4est_wrap_refine (p4est_wrap_t * pp)
 {
   int                 changed;
+  int                 mpiret;
+  int                 anyflag[2], globalflag[2];
   size_t              allz, qz;
   p4est_locidx_t      tt;
   p4est_gloidx_t      global_num;
   p4est_t            *p4est = pp->p4est;
   p4est_tree_t       *tree;
   p4est_quadrant_t   *q;
-  
+
   P4EST_ASSERT (pp->mesh != NULL);
   P4EST_ASSERT (pp->ghost != NULL);
   P4EST_ASSERT (pp->mesh_aux == NULL);
   P4EST_ASSERT (pp->ghost_aux == NULL);
   P4EST_ASSERT (pp->match_aux == 0);
 
-  allz = 0;
-  for (tt = p4est->first_local_tree; tt <= p4est->last_local_tree; ++tt)
-  {
-    tree = p4est_tree_array_index (p4est->trees, tt);
-    for (qz = 0; qz < tree->quadrants.elem_count; ++qz)
-    {
-      q = p4est_quadrant_array_index (&tree->quadrants, qz);
-      q->p.user_int = (int) pp->flags[allz++];
-    }
+  /* one fused pass over the flags decides which traversals are needed
+   * at all; the decision must be collective since refine and coarsen
+   * update the global quadrant counts on all processors */
+  anyflag[0] = anyflag[1] = 0;
+  for (allz = 0; allz < (size_t) p4est->local_num_quadrants; ++allz) {
+    anyflag[0] |= pp->flags[allz] == P4EST_WRAP_REFINE;
+    anyflag[1] |= pp->flags[allz] == P4EST_WRAP_COARSEN;
   }
-  P4EST_ASSERT (allz == (size_t) p4est->local_num_quadrants);
+  mpiret = MPI_Allreduce (anyflag, globalflag, 2, MPI_INT, MPI_MAX,
+                          p4est->mpicomm);
+  SC_CHECK_MPI (mpiret);
 
-  global_num = p4est->global_num_quadrants;
-  p4est_refine (p4est, 0, refine_callback, init_callback);
-  changed = global_num != p4est->global_num_quadrants;
+  changed = 0;
+  if (globalflag[0] || globalflag[1]) {
+    /* remember the previous leaves instead of copying the forest */
+    p4est_wrap_journal_capture (pp);
 
-  global_num = p4est->global_num_quadrants;
-  p4est_coarsen (p4est, 0, coarsen_callback, init_callback);
-  changed = changed || global_num != p4est->global_num_quadrants;
+    allz = 0;
+    for (tt = p4est->first_local_tree; tt <= p4est->last_local_tree; ++tt)
+    {
+      tree = p4est_tree_array_index (p4est->trees, tt);
+      for (qz = 0; qz < tree->quadrants.elem_count; ++qz)
+      {
+        q = p4est_quadrant_array_index (&tree->quadrants, qz);
+        q->p.user_int = (int) pp->flags[allz++];
+      }
+    }
+    P4EST_ASSERT (allz == (size_t) p4est->local_num_quadrants);
+
+    if (globalflag[0]) {
+      global_num = p4est->global_num_quadrants;
+      p4est_refine (p4est, 0, refine_callback, init_callback);
+      changed = global_num != p4est->global_num_quadrants;
+    }
+    if (globalflag[1]) {
+      global_num = p4est->global_num_quadrants;
+      p4est_coarsen (p4est, 0, coarsen_callback, init_callback);
+      changed = changed || global_num != p4est->global_num_quadrants;
+    }
+  }
 
   if (changed) {
     P4EST_FREE (pp->flags);
@@ -206,6 +301,10 @@ p4est_wrap_refine (p4est_wrap_t * pp)
     pp->mesh_aux = p4est_mesh_new (p4est, pp->ghost_aux, P4EST_CONNECT_FULL);
     pp->match_aux = 1;
   }
+  else {
+    /* the forest is unchanged so there is nothing to journal */
+    p4est_wrap_journal_reset (pp);
+  }
 
   return changed;
 }
@@ -224,7 +323,10 @@ p4est_wrap_partition (p4est_wrap_t * pp)
   p4est_mesh_destroy (pp->mesh);
   p4est_ghost_destroy (pp->ghost);
   pp->match_aux = 0;
-  
+
+  /* the adaptation can no longer be reverted once leaves migrate */
+  p4est_wrap_journal_reset (pp);
+
   /* In the future the flags could be used to pass partition weights */
   changed = p4est_partition_ext (pp->p4est, 1, NULL) > 0;
 
@@ -245,6 +347,83 @@ p4est_wrap_partition (p4est_wrap_t * pp)
   return changed;
 }
 
+void
+p4est_wrap_revert (p4est_wrap_t * pp)
+{
+  int                 l, maxl;
+  uint64_t            id;
+  p4est_topidx_t      tt, k;
+  p4est_locidx_t      il, n_old, offset;
+  p4est_t            *p4est = pp->p4est;
+  p4est_tree_t       *tree;
+  p4est_quadrant_t   *q, *prev;
+  p4est_quadrant_t    ld;
+
+  P4EST_ASSERT (pp->journal_levels != NULL);
+  P4EST_ASSERT (pp->ghost_aux != NULL);
+  P4EST_ASSERT (pp->mesh_aux != NULL);
+  P4EST_ASSERT (pp->match_aux == 1);
+  P4EST_ASSERT (p4est->data_size == 0);
+
+  /* rebuild the previous leaves of every local tree from the journal;
+   * refine, coarsen and balance do not move the partition boundaries,
+   * so the local tree range is the same as when the journal was taken */
+  p4est->local_num_quadrants = 0;
+  k = 0;
+  for (tt = p4est->first_local_tree; tt <= p4est->last_local_tree;
+       ++tt, ++k) {
+    tree = p4est_tree_array_index (p4est->trees, tt);
+    offset = pp->journal_tree_offsets[k];
+    n_old = pp->journal_tree_offsets[k + 1] - offset;
+    tree->quadrants_offset = p4est->local_num_quadrants;
+    sc_array_resize (&tree->quadrants, (size_t) n_old);
+    for (l = 0; l <= P4EST_QMAXLEVEL; ++l) {
+      tree->quadrants_per_level[l] = 0;
+    }
+    maxl = 0;
+    prev = NULL;
+    for (il = 0; il < n_old; ++il) {
+      l = (int) pp->journal_levels[offset + il];
+      q = p4est_quadrant_array_index (&tree->quadrants, (size_t) il);
+      if (prev == NULL) {
+        *q = pp->journal_first_quads[k];
+        P4EST_ASSERT ((int) q->level == l);
+      }
+      else {
+        /* the next leaf starts right behind the previous one */
+        p4est_quadrant_last_descendant (prev, &ld, P4EST_QMAXLEVEL);
+        id = p4est_quadrant_linear_id (&ld, P4EST_QMAXLEVEL) + 1;
+        p4est_quadrant_set_morton (q, l,
+                                   id >> (P4EST_DIM *
+                                          (P4EST_QMAXLEVEL - l)));
+      }
+      q->p.user_int = 0;
+      ++tree->quadrants_per_level[l];
+      maxl = SC_MAX (maxl, l);
+      prev = q;
+    }
+    tree->maxlevel = (int8_t) maxl;
+    p4est->local_num_quadrants += n_old;
+    P4EST_ASSERT (p4est_tree_is_complete (tree));
+  }
+  ++p4est->revision;
+  p4est_comm_count_quadrants (p4est);
+  P4EST_ASSERT (p4est_is_valid (p4est));
+
+  /* the ghost and mesh of the previous forest are still in place */
+  p4est_mesh_destroy (pp->mesh_aux);
+  p4est_ghost_destroy (pp->ghost_aux);
+  pp->mesh_aux = NULL;
+  pp->ghost_aux = NULL;
+  pp->match_aux = 0;
+
+  /* restore the previous flags so the adaptation can be repeated */
+  P4EST_FREE (pp->flags);
+  pp->flags = pp->journal_flags;
+  pp->journal_flags = NULL;
+  p4est_wrap_journal_reset (pp);
+}
+
 void
 p4est_wrap_complete (p4est_wrap_t * pp)
 {
@@ -105,6 +105,94 @@ void                p8est_tree_print (int log_priority, p8est_tree_t * tree);
 int                 p8est_is_equal (p8est_t * p8est1, p8est_t * p8est2,
                                     int compare_data);
 
+/** The kinds of change reported by p8est_diff. */
+typedef enum p8est_diff_type
+{
+  P8EST_DIFF_REFINED,   /**< one octant replaced by descendants */
+  P8EST_DIFF_COARSENED, /**< several octants replaced by an ancestor */
+  P8EST_DIFF_MOVED      /**< present in only one forest, e.g. after
+                             a shifted partition boundary */
+}
+p8est_diff_type_t;
+
+/** Callback reporting one changed range between two forests.
+ * The ranges index into the respective tree's octant array; one of
+ * them may be empty for P8EST_DIFF_MOVED.
+ * \param [in] which_tree   The tree containing the change.
+ * \param [in] type         The kind of change; see p8est_diff_type_t.
+ * \param [in] begin1, end1 Changed octants [begin1, end1) in the
+ *                          tree of \a p8est1.
+ * \param [in] begin2, end2 Corresponding range in \a p8est2.
+ * \param [in] user         Pointer passed through unchanged.
+ */
+typedef void        (*p8est_diff_t) (p8est_t * p8est1, p8est_t * p8est2,
+                                     p4est_topidx_t which_tree,
+                                     p8est_diff_type_t type,
+                                     p4est_locidx_t begin1,
+                                     p4est_locidx_t end1,
+                                     p4est_locidx_t begin2,
+                                     p4est_locidx_t end2, void *user);
+
+/** Report the differences between two Morton-sorted forests.
+ * Both local octant sequences are walked in a single merge pass;
+ * runs of identical octants are passed over silently and each
+ * refined, coarsened or moved range triggers one callback, so the
+ * cost is one sweep plus work proportional to the changes.  Both
+ * forests must be defined on connectivities with the same tree count;
+ * octant data is not compared.
+ * \param [in] p8est1   The earlier forest, e.g. before p8est_balance.
+ * \param [in] p8est2   The later forest.
+ * \param [in] diff_fn  Called once per changed range, in Morton order.
+ * \param [in] user     Passed to the callback unchanged.
+ */
+void                p8est_diff (p8est_t * p8est1, p8est_t * p8est2,
+                                p8est_diff_t diff_fn, void *user);
+
+/** Callback returning a traversal sort key for a local octant.
+ * \param [in] p8est       The forest being indexed.
+ * \param [in] which_tree  The tree containing \a quadrant.
+ * \param [in] quadrant    A local octant of \a which_tree.
+ * \param [in] user        Passed through from the index builder.
+ * \return                 Key to order the traversal by, ascending.
+ */
+typedef uint64_t    (*p8est_traversal_key_t) (p8est_t * p8est,
+                                              p4est_topidx_t which_tree,
+                                              const p8est_quadrant_t *
+                                              quadrant, void *user);
+
+/** Build a traversal index over the local octants in level order.
+ *
+ * The index orders octants by (level, tree, Morton) using a counting
+ * sort over the per-tree \a quadrants_per_level bucket sizes, so no
+ * comparisons are made.  Build it once per adaptation and iterate the
+ * local octants through it for wavefront-style sweeps.
+ *
+ * \param [in] p8est    The forest to be indexed.
+ * \return              Array of \a local_num_quadrants cumulative local
+ *                      octant indices, allocated with P4EST_ALLOC;
+ *                      it is owned by the caller and freed with
+ *                      P4EST_FREE.  Stale after the forest changes.
+ */
+p4est_locidx_t     *p8est_traversal_level_order (p8est_t * p8est);
+
+/** Build a traversal index over the local octants by a user key.
+ *
+ * Like \ref p8est_traversal_level_order with the order given by a
+ * caller-provided key, e.g. a diagonal sweep direction.  Ties keep the
+ * (tree, Morton) order.
+ *
+ * \param [in] p8est    The forest to be indexed.
+ * \param [in] key_fn   Called once per local octant.
+ * \param [in] user     Passed to \a key_fn unchanged.
+ * \return              Array of \a local_num_quadrants cumulative local
+ *                      octant indices, allocated with P4EST_ALLOC;
+ *                      it is owned by the caller and freed with
+ *                      P4EST_FREE.  Stale after the forest changes.
+ */
+p4est_locidx_t     *p8est_traversal_key_order (p8est_t * p8est,
+                                               p8est_traversal_key_t key_fn,
+                                               void *user);
+
 /** Check a forest for validity and allreduce the result.
  * Some properties of a valid forest are:
  *    the quadrant counters are consistent
@@ -115,6 +203,20 @@ int                 p8est_is_equal (p8est_t * p8est1, p8est_t * p8est2,
  */
 int                 p8est_is_valid (p8est_t * p8est);
 
+/** Check the cheap structural invariants of a forest.
+ * This is the production companion of p8est_is_valid: it verifies the
+ * counters against global_first_quadrant, the tree offsets, the level
+ * histogram at maxlevel, and the Morton order and descendants at the
+ * tree boundaries, in constant time per local tree and without
+ * communication or a pass over the quadrants.  Calling it after every
+ * step costs a negligible fraction of a checksum while catching the
+ * common corruption classes; a false result on any process indicates
+ * a damaged forest even though the other processes may return true.
+ * \param [in] p8est    The forest to be tested.
+ * \return              Returns true if the invariants hold locally.
+ */
+int                 p8est_is_coherent (p8est_t * p8est);
+
 /** Compute the overlap of a number of insulation layers with a tree.
  * Every quadrant out of the insulation layer of the quadrants in \a in
  * except the quadrant itself is checked for overlap of quadrants
@@ -182,6 +284,36 @@ void                p8est_complete_region (p8est_t * p8est,
                                            p4est_topidx_t which_tree,
                                            p8est_init_t init_fn);
 
+/** Constructs a minimal linear octree between two octants, counted.
+ *
+ * Produces exactly the same tree as \ref p8est_complete_region.
+ * The output count is computed analytically from the child id ladders
+ * of \a q1 and \a q2 above their nearest common ancestor, the octant
+ * array is resized once, and the octants are generated in level runs
+ * without touching the quadrant mempool or a work list.
+ *
+ * \pre \a q1 < \a q2 in the Morton ordering.
+ *
+ * \param [in]  p8est      Used for the memory pools and quadrant init.
+ * \param [in]  q1         First input quadrant.  Data init'ed if included.
+ * \param [in]  include_q1 Flag to specify whether q1 is included.
+ * \param [in]  q2         Second input quadrant.  Data init'ed if included.
+ * \param [in]  include_q2 Flag to specify whether q2 is included.
+ * \param [out] tree       Initialized tree with zero elements.
+ * \param [in]  which_tree The 0-based index of \a tree which is needed for
+ *                         the \c p8est_quadrant_init_data routine.
+ * \param [in]  init_fn    Callback function to initialize the user_data
+ *                         which is already allocated automatically.
+ */
+void                p8est_complete_region_counted (p8est_t * p8est,
+                                                   const p8est_quadrant_t *
+                                                   q1, int include_q1,
+                                                   const p8est_quadrant_t *
+                                                   q2, int include_q2,
+                                                   p8est_tree_t * tree,
+                                                   p4est_topidx_t which_tree,
+                                                   p8est_init_t init_fn);
+
 /** Completes a sorted tree within a p8est. It may have exterior quadrants.
  * The completed tree will have only owned quadrants and no overlap.
  * \param [in,out] p8est      The p8est to work on.
@@ -224,6 +356,80 @@ void                p8est_balance_border (p8est_t * p8est,
 size_t              p8est_linearize_tree (p8est_t * p8est,
                                           p8est_tree_t * tree);
 
+/** A maximal run of same-level octants consecutive in Morton order. */
+typedef struct p8est_quadrant_run
+{
+  p8est_quadrant_t    first;    /**< first octant of the run */
+  p4est_locidx_t      count;    /**< number of octants in the run */
+}
+p8est_quadrant_run_t;
+
+/** Compress a sorted quadrant array into uniform-level Morton runs.
+ * Uniformly refined regions collapse into one run each, so large
+ * inactive portions of a forest can be held or stored at a small
+ * fraction of their expanded size.  The user data pointers are not
+ * represented; they must be reestablished after uncompressing.
+ *
+ * \param [in] quadrants   Sorted array of p8est_quadrant_t.
+ * \param [in,out] runs    Array of p8est_quadrant_run_t.  Its previous
+ *                         contents are overwritten with the encoding.
+ * \return                 The number of runs created.
+ */
+size_t              p8est_quadrant_array_compress (sc_array_t * quadrants,
+                                                   sc_array_t * runs);
+
+/** Expand an array of Morton runs back into individual quadrants.
+ * This is the inverse of \ref p8est_quadrant_array_compress.
+ *
+ * \param [in] runs        Array of p8est_quadrant_run_t.
+ * \param [in,out] quadrants    Array of p8est_quadrant_t.  Its previous
+ *                         contents are overwritten with the expansion;
+ *                         all user data pointers are set to NULL.
+ */
+void                p8est_quadrant_array_uncompress (sc_array_t * runs,
+                                                     sc_array_t * quadrants);
+
+/** Preallocate storage for a quadrant array without changing its count.
+ * Callers that know the final number of quadrants up front can use this
+ * to replace the doubling reallocations of repeated pushes with a single
+ * allocation.  Shrinking requests are ignored.
+ *
+ * \param [in,out] quadrants    Array of p8est_quadrant_t owning its
+ *                              storage; must not be a view.
+ * \param [in] count       Number of quadrants to make room for.
+ */
+void                p8est_quadrant_array_reserve (sc_array_t * quadrants,
+                                                  size_t count);
+
+/** Exchange the contents of two quadrant arrays in constant time.
+ * This transfers ownership of the storage instead of copying elements,
+ * so a freshly built array can be handed to a tree for the price of a
+ * struct assignment.
+ *
+ * \param [in,out] a       Array of p8est_quadrant_t owning its storage.
+ * \param [in,out] b       Array of p8est_quadrant_t owning its storage.
+ */
+void                p8est_quadrant_array_swap (sc_array_t * a,
+                                               sc_array_t * b);
+
+/** Sort a quadrant array into the order of p8est_quadrant_compare.
+ * Large arrays go through a radix sort on the interleaved Morton key
+ * instead of a comparison sort, which removes the indirect call per
+ * comparison at the price of temporary storage proportional to the
+ * array; small arrays fall back to sc_array_sort.
+ *
+ * \param [in,out] quadrants    Array of p8est_quadrant_t.
+ */
+void                p8est_quadrant_array_sort (sc_array_t * quadrants);
+
+/** Sort a quadrant array as p8est_quadrant_compare_piggy does.
+ * Same algorithm as \ref p8est_quadrant_array_sort with the owner tree
+ * p.piggy3.which_tree, which must be valid, as the primary key.
+ *
+ * \param [in,out] quadrants    Array of p8est_quadrant_t.
+ */
+void                p8est_quadrant_array_sort_piggy (sc_array_t * quadrants);
+
 /** Compute correction of partition for a process.
  *
  * The correction denotes how many quadrants the process with id \a rank takes
@@ -281,6 +487,41 @@ p4est_gloidx_t      p8est_partition_given (p8est_t * p8est,
                                            const p4est_locidx_t *
                                            num_quadrants_in_proc);
 
+/** Transient state of a split quadrant migration.
+ * Created by p8est_partition_given_begin and destroyed by
+ * p8est_partition_given_end; its contents are private.
+ */
+typedef struct p8est_partition_context p8est_partition_context_t;
+
+/** Start the quadrant migration of p8est_partition_given.
+ *
+ * This posts the receives and sends for the quadrants and their user
+ * data and returns without waiting for them, so computation that does
+ * not touch the forest contents can overlap the message transfer.
+ * The forest may be read but must not be modified until
+ * p8est_partition_given_end has completed the migration.
+ *
+ * \param [in,out] p8est the forest that is partitioned.
+ * \param [in]     num_quadrants_in_proc  an integer array of the number of
+ *                                        quadrants desired per processor.
+ * \return  Returns a context to pass to p8est_partition_given_end.
+ */
+p8est_partition_context_t *p8est_partition_given_begin (p8est_t * p8est,
+                                                        const p4est_locidx_t
+                                                        *
+                                                        num_quadrants_in_proc);
+
+/** Finish the quadrant migration begun by p8est_partition_given_begin.
+ *
+ * Waits for the posted messages, fills the received quadrants and their
+ * user data into the forest and frees the context.
+ *
+ * \param [in] context   created by p8est_partition_given_begin.
+ * \return  Returns the global count of shipped quadrants.
+ */
+p4est_gloidx_t      p8est_partition_given_end (p8est_partition_context_t *
+                                               context);
+
 SC_EXTERN_C_END;
 
 #endif /* !P8EST_ALGORITHMS_H */
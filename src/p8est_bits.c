@@ -149,6 +149,45 @@ p8est_quadrant_edge_neighbor (const p4est_quadrant_t * q,
   P4EST_ASSERT (p4est_quadrant_is_extended (r));
 }
 
+void
+p8est_quadrant_edge_neighbors_batch (const p4est_quadrant_t qs[],
+                                     size_t num_quadrants, int edge,
+                                     p4est_qcoord_t nx[], p4est_qcoord_t ny[],
+                                     p4est_qcoord_t nz[], int8_t nlevel[],
+                                     int8_t outside[])
+{
+  const int           axis = edge / 4;
+  const p4est_qcoord_t d1 = 2 * (edge & 0x01) - 1;
+  const p4est_qcoord_t d2 = (edge & 0x02) - 1;
+  const p4est_qcoord_t dx = (axis == 0) ? 0 : d1;
+  const p4est_qcoord_t dy = (axis == 0) ? d1 : (axis == 1) ? 0 : d2;
+  const p4est_qcoord_t dz = (axis == 2) ? 0 : d2;
+  size_t              zz;
+  p4est_qcoord_t      qh;
+
+  P4EST_ASSERT (0 <= edge && edge < 12);
+
+  for (zz = 0; zz < num_quadrants; ++zz) {
+    P4EST_ASSERT (p4est_quadrant_is_valid (&qs[zz]));
+    qh = P4EST_QUADRANT_LEN (qs[zz].level);
+    nx[zz] = qs[zz].x + dx * qh;
+    ny[zz] = qs[zz].y + dy * qh;
+    nz[zz] = qs[zz].z + dz * qh;
+    nlevel[zz] = qs[zz].level;
+  }
+
+  if (outside != NULL) {
+    /* Only the two coordinates transversal to the edge can leave the
+     * unit tree; the third offset is zero so its test never fires. */
+    for (zz = 0; zz < num_quadrants; ++zz) {
+      outside[zz] = (int8_t)
+        (nx[zz] < 0 || nx[zz] >= P4EST_ROOT_LEN ||
+         ny[zz] < 0 || ny[zz] >= P4EST_ROOT_LEN ||
+         nz[zz] < 0 || nz[zz] >= P4EST_ROOT_LEN);
+    }
+  }
+}
+
 void
 p8est_quadrant_edge_neighbor_extra (const p4est_quadrant_t * q, p4est_topidx_t
                                     t, int edge, sc_array_t * quads,
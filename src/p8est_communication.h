@@ -41,13 +41,29 @@ typedef enum
   P8EST_COMM_PARTITION_CORRECTION,
   P8EST_COMM_GHOST_COUNT,
   P8EST_COMM_GHOST_LOAD,
+  P8EST_COMM_GHOST_DATA_COUNT,
+  P8EST_COMM_GHOST_DATA_QUERY,
+  P8EST_COMM_GHOST_DATA_REPLY,
+  P8EST_COMM_GHOST_EXPAND_COUNT,
+  P8EST_COMM_GHOST_EXPAND_QUERY,
+  P8EST_COMM_GHOST_EXPAND_REPLY_COUNT,
+  P8EST_COMM_GHOST_EXPAND_REPLY,
   P8EST_COMM_NODES_QUERY,
   P8EST_COMM_NODES_REPLY,
   P8EST_COMM_SAVE,
+  P8EST_COMM_TRANSMIT_COUNT,
+  P8EST_COMM_TRANSMIT_LOAD,
   P8EST_COMM_LNODES_TEST,
   P8EST_COMM_LNODES_PASS,
   P8EST_COMM_LNODES_OWNED,
-  P8EST_COMM_LNODES_ALL
+  P8EST_COMM_LNODES_ALL,
+  P8EST_COMM_SEARCH_COUNT,
+  P8EST_COMM_SEARCH_QUERY,
+  P8EST_COMM_SEARCH_REPLY,
+  P8EST_COMM_NOTIFY_PAYLOAD,
+  P8EST_COMM_NOTIFY_PAYLOAD2,
+  P8EST_COMM_VTK,
+  P8EST_COMM_FIELDS
 }
 p8est_comm_tag_t;
 
@@ -78,6 +94,24 @@ void                p8est_comm_global_partition (p8est_t * p8est,
 void                p8est_comm_count_pertree (p8est_t * p8est,
                                               p4est_gloidx_t * pertree);
 
+/** Compute the cumulative number of octants per tree on one rank.
+ * Collective like p8est_comm_count_pertree, but only rank \a root
+ * receives the counts; every other rank contributes just the trees
+ * whose first octant it owns, so its cost does not grow with the
+ * total number of trees.  Preferred when the result is consumed by a
+ * single writer as in p8est_save.
+ * \param [in] p8est    This p8est needs to have correct values for
+ *                      global_first_quadrant and global_first_position.
+ * \param [in] root     The rank that receives the counts.
+ * \param [in,out] pertree      On rank \a root memory for num_trees + 1
+ *                              numbers, filled with the cumulative
+ *                              counts; ignored and may be NULL on the
+ *                              other ranks.
+ */
+void                p8est_comm_count_pertree_root (p8est_t * p8est,
+                                                   int root,
+                                                   p4est_gloidx_t * pertree);
+
 /** Searches the owner of a quadrant via p8est->global_first_position.
  * Assumes a tree with no overlaps.
  * \param [in] guess   Initial guess for the search.
@@ -88,6 +122,20 @@ int                 p8est_comm_find_owner (p8est_t * p8est,
                                            const p8est_quadrant_t * q,
                                            int guess);
 
+/** Retrieve the interval of processors that own part of a tree.
+ * The intervals are derived from p8est->global_first_position on first
+ * use and cached in the forest; the cache is keyed to the revision
+ * counter, so it is rebuilt only after the forest has changed.
+ * \param [in] p8est          The forest to work on.
+ * \param [in] which_tree     Any valid tree number.
+ * \param [out] first_owner   Lowest rank owning part of \a which_tree.
+ * \param [out] last_owner    Highest rank owning part of \a which_tree.
+ */
+void                p8est_comm_tree_owner_range (p8est_t * p8est,
+                                                 p4est_topidx_t which_tree,
+                                                 int *first_owner,
+                                                 int *last_owner);
+
 /** Computes information about a tree being fully owned.
  * This is determined separately for the beginning and end of the tree.
  * \param [in] p8est            The p8est to work on.
@@ -128,16 +176,124 @@ int                 p8est_comm_neighborhood_owned (p8est_t * p8est,
 int                 p8est_comm_sync_flag (p8est_t * p8est,
                                           int flag, MPI_Op operation);
 
+/** A flag reduction in progress; see p8est_comm_sync_flag_begin. */
+typedef struct p8est_comm_flag_context p8est_comm_flag_context_t;
+
+/** Start a split flag reduction that overlaps with local work.
+ * When MPI supports nonblocking reductions the collective proceeds in
+ * the background, so an adaptation loop can start its next local sweep
+ * optimistically and only then check whether the previous iteration
+ * converged; this hides one network latency per iteration.  Without
+ * that support the reduction completes inside this call.
+ * \param [in] p8est        The MPI communicator of this p8est will be used.
+ * \param [in] flag         The variable to communicate.
+ * \param [in] operation    Either MPI_BAND or MPI_BOR (not used bitwise).
+ * \return          A context to pass to p8est_comm_sync_flag_end.
+ */
+p8est_comm_flag_context_t *p8est_comm_sync_flag_begin (p8est_t * p8est,
+                                                       int flag,
+                                                       MPI_Op operation);
+
+/** Complete a split flag reduction and destroy its context.
+ * \param [in] ctx      Context from p8est_comm_sync_flag_begin.
+ * \return          Returns the logical AND resp. OR of all processors'
+ *                  flags as in p8est_comm_sync_flag.
+ */
+int                 p8est_comm_sync_flag_end (p8est_comm_flag_context_t *
+                                              ctx);
+
+/** Discover the senders of a sparse exchange and receive their payloads.
+ * This fuses the sc_notify peer discovery with the payload delivery:
+ * when MPI provides a nonblocking barrier, the payloads travel with the
+ * discovery messages themselves, so one latency-bound round replaces
+ * the usual notify-then-send pair.  Without that support the function
+ * falls back to sc_notify followed by one point-to-point round, with
+ * identical results.  Intended for small payloads such as the border
+ * lists of the balance exchange; large payloads gain nothing since
+ * their cost is bandwidth bound.
+ * This function is collective over \a mpicomm.
+ * \param [in] mpicomm        The communicator of the exchange.
+ * \param [in] num_receivers  Number of processes this one sends to.
+ * \param [in] receiver_ranks The receiving ranks, strictly ascending.
+ * \param [in] send_bufs      Array of \a num_receivers sc_array_t of
+ *                            bytes (elem_size 1), one payload per
+ *                            receiver in matching order; a payload may
+ *                            be empty to act as a pure notification.
+ * \param [out] num_senders   Number of processes sending to this one.
+ * \param [out] sender_ranks  Allocated with P4EST_ALLOC and filled with
+ *                            \a num_senders ranks in ascending order;
+ *                            owned by the caller.
+ * \param [in,out] recv_bufs  Empty array of sc_array_t on input; on
+ *                            output one byte array per sender, aligned
+ *                            with \a sender_ranks.  The caller resets
+ *                            the entries and the array.
+ */
+void                p8est_comm_notify_payload (MPI_Comm mpicomm,
+                                               int num_receivers,
+                                               const int *receiver_ranks,
+                                               sc_array_t * send_bufs,
+                                               int *num_senders,
+                                               int **sender_ranks,
+                                               sc_array_t * recv_bufs);
+
 /** Compute a parallel checksum out of local checksums.
+ * The local pieces are combined with a non-commutative MPI reduction,
+ * so the call completes in O(log P) and the result is available on
+ * every processor.
  * \param [in] p8est       The MPI information of this p8est will be used.
  * \param [in] local_crc   Locally computed adler32 checksum.
  * \param [in] local_bytes Number of bytes used for local checksum.
- * \return                 Parallel checksum on rank 0, 0 otherwise.
+ * \return                 Parallel checksum on all processors.
  */
 unsigned            p8est_comm_checksum (p8est_t * p8est,
                                          unsigned local_crc,
                                          size_t local_bytes);
 
+/** Per-channel combine operators for p8est_comm_reduce_channels. */
+typedef enum p8est_reduce_op
+{
+  P8EST_REDUCE_SUM,
+  P8EST_REDUCE_MIN,
+  P8EST_REDUCE_MAX
+}
+p8est_reduce_op_t;
+
+/** Callback folding one octant into the channel accumulators.
+ * \param [in]     p8est       The forest being reduced over.
+ * \param [in]     which_tree  The tree containing \a quadrant.
+ * \param [in]     quadrant    A local octant of \a which_tree.
+ * \param [in,out] accum       The channel accumulators; the callback
+ *                             updates each channel consistently with
+ *                             the operator declared for it.
+ * \param [in]     user        Passed through from the reduction call.
+ */
+typedef void        (*p8est_reduce_fold_t) (p8est_t * p8est,
+                                            p4est_topidx_t which_tree,
+                                            p8est_quadrant_t * quadrant,
+                                            double accum[], void *user);
+
+/** Fused multi-channel reduction over the local octants.
+ * The accumulators are initialized to the identity of their operators,
+ * the fold callback runs once per octant in one pass over the
+ * contiguous tree arrays, and channels sharing an operator finish in
+ * one typed MPI_Allreduce, so any number of diagnostics costs at most
+ * one collective per distinct operator.
+ * \param [in]  p8est        The forest whose octants are reduced over.
+ * \param [in]  num_channels Number of reduction channels, at least 1.
+ * \param [in]  ops          Array of \a num_channels combine operators.
+ * \param [in]  fold_fn      Called once per local octant.
+ * \param [in]  user         Passed to \a fold_fn unchanged.
+ * \param [out] results      Array of \a num_channels globally reduced
+ *                           values, identical on all processors.
+ */
+void                p8est_comm_reduce_channels (p8est_t * p8est,
+                                                int num_channels,
+                                                const p8est_reduce_op_t *
+                                                ops,
+                                                p8est_reduce_fold_t fold_fn,
+                                                void *user,
+                                                double results[]);
+
 SC_EXTERN_C_END;
 
 #endif /* !P8EST_COMMUNICATION_H */
@@ -981,6 +981,50 @@ p8est_find_edge_transform (p4est_connectivity_t * conn,
   /* check if this edge exists at all */
   ei->iedge = (int8_t) iedge;
   sc_array_resize (ta, 0);
+  if (conn->brick != NULL) {
+    const p8est_brick_t *brick = conn->brick;
+    int                 axis, j, k, dir1, dir2;
+    p4est_topidx_t      coord[P8EST_DIM], ncoord[P8EST_DIM];
+    p4est_topidx_t      vert1, vert2;
+    p4est_topidx_t      bett[4];
+    int8_t              bete[4];
+
+    /* determine the grid line underneath this tree edge */
+    axis = iedge / 4;
+    j = iedge % 4;
+    dir1 = (axis == 0) ? 1 : 0;
+    dir2 = (axis == 2) ? 1 : 2;
+    p8est_brick_tree_coordinates (conn, itree, coord);
+    vert1 = coord[dir1] + (j & 1);
+    vert2 = coord[dir2] + (j / 2);
+    if ((!brick->periodic[dir1] &&
+         (vert1 == 0 || vert1 == brick->nxyz[dir1])) ||
+        (!brick->periodic[dir2] &&
+         (vert2 == 0 || vert2 == brick->nxyz[dir2]))) {
+      /* this edge lies on the physical domain boundary */
+      return;
+    }
+
+    /* enumerate the trees around the grid line in edge_to_tree order */
+    ncoord[axis] = coord[axis];
+    for (k = 0; k < 4; k++) {
+      ncoord[dir1] = (vert1 - 1 + (k & 1) +
+                      brick->nxyz[dir1]) % brick->nxyz[dir1];
+      ncoord[dir2] = (vert2 - 1 + (k / 2) +
+                      brick->nxyz[dir2]) % brick->nxyz[dir2];
+      bett[k] = p8est_brick_tree_index (conn, ncoord);
+      bete[k] = (int8_t) (4 * axis + (3 - k));
+    }
+    edge_trees = 4;
+
+    /* loop through all edge neighbors and find edge connections */
+    flipped = p8est_find_edge_transform_internal (conn, itree, iedge, ei,
+                                                  bett, bete, edge_trees,
+                                                  ntrees);
+    P4EST_ASSERT (edge_trees == (p4est_topidx_t) ta->elem_count
+                  + 1 + (ntrees[0] != -1) + (ntrees[1] != -1) - flipped);
+    return;
+  }
   if (conn->num_edges == 0) {
     return;
   }
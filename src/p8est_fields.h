@@ -0,0 +1,146 @@
+/*
+  This file is part of p4est.
+  p4est is a C library to manage a collection (a forest) of multiple
+  connected adaptive quadtrees or octrees in parallel.
+
+  Copyright (C) 2010 The University of Texas System
+  Written by Carsten Burstedde, Lucas C. Wilcox, and Tobin Isaac
+
+  p4est is free software; you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation; either version 2 of the License, or
+  (at your option) any later version.
+
+  p4est is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with p4est; if not, write to the Free Software Foundation, Inc.,
+  51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
+*/
+
+#ifndef P8EST_FIELDS_H
+#define P8EST_FIELDS_H
+
+#include <p8est.h>
+
+SC_EXTERN_C_BEGIN;
+
+/** One registered per-octant field in its own contiguous array. */
+typedef struct p8est_field
+{
+  char               *name;     /**< lookup key, owned by the registry */
+  size_t              type_size;        /**< bytes of one value */
+  int                 count;    /**< values per octant */
+  char               *data;     /**< local_num_quadrants * count values
+                                     in octant order */
+}
+p8est_field_t;
+
+/** A registry of per-octant fields in structure-of-arrays layout.
+ *
+ * Instead of interleaving all fields in one octant user_data blob,
+ * each registered field occupies its own contiguous array across the
+ * local octants, so a kernel reading one field streams only that
+ * field's bytes.  The registry remembers the leaves and the partition
+ * of the forest it was synchronized with; after the forest changes,
+ * exactly one of p8est_fields_adapt or p8est_fields_partition brings
+ * the arrays along.
+ */
+typedef struct p8est_fields
+{
+  p8est_t            *p4est;    /**< the forest, not owned */
+  int                 num_fields;       /**< registered fields */
+  p8est_field_t      *fields;   /**< array of \a num_fields entries */
+
+  /* snapshot of the forest state that the field arrays match */
+  p4est_locidx_t      num_quadrants;    /**< previous local leaf count */
+  p4est_topidx_t      first_local_tree; /**< previous first local tree */
+  p4est_topidx_t      last_local_tree;  /**< previous last local tree */
+  p4est_locidx_t     *tree_offsets;     /**< local trees + 1 */
+  p8est_quadrant_t   *first_quads;      /**< one per local tree */
+  int8_t             *levels;   /**< one per previous leaf */
+  p4est_gloidx_t     *global_first_quadrant;    /**< mpisize + 1 */
+}
+p8est_fields_t;
+
+/** Create an empty field registry synchronized with a forest.
+ * \param [in] p8est    A valid forest; it must survive the registry.
+ * \return              A registry without any registered fields.
+ */
+p8est_fields_t     *p8est_fields_new (p8est_t * p8est);
+
+/** Register one field and allocate its zero-initialized array.
+ * \param [in,out] fields   A registry synchronized with its forest.
+ * \param [in] name         The lookup name; it is copied and must not
+ *                          be registered already.
+ * \param [in] type_size    Bytes of one value, for example
+ *                          sizeof (double).
+ * \param [in] count        Positive number of values per octant.
+ * \return                  The id of the new field.
+ */
+int                 p8est_fields_register (p8est_fields_t * fields,
+                                           const char *name,
+                                           size_t type_size, int count);
+
+/** Find a field id by name.
+ * \param [in] fields   A field registry.
+ * \param [in] name     The name passed to p8est_fields_register.
+ * \return              The field id, or -1 if no such field exists.
+ */
+int                 p8est_fields_lookup (p8est_fields_t * fields,
+                                         const char *name);
+
+/** Access the contiguous array of one field.
+ * The pointer is valid until the next register, adapt, or partition
+ * call and indexes count values per octant in octant order.
+ * \param [in] fields   A registry synchronized with its forest.
+ * \param [in] fid      A valid field id.
+ * \return              The start of the field's array.
+ */
+void               *p8est_fields_view (p8est_fields_t * fields, int fid);
+
+/** Access the values of one field for one local octant.
+ * \param [in] fields       A registry synchronized with its forest.
+ * \param [in] fid          A valid field id.
+ * \param [in] local_quad   Octant number relative to the process,
+ *                          that is, tree->quadrants_offset plus the
+ *                          index within the tree.
+ * \return                  Pointer to the octant's count values.
+ */
+void               *p8est_fields_quadrant (p8est_fields_t * fields, int fid,
+                                           p4est_locidx_t local_quad);
+
+/** Carry all field arrays through refinement and coarsening.
+ * Must be called after any sequence of p8est_refine, p8est_coarsen,
+ * and p8est_balance and before p8est_partition.  A refined octant's
+ * values are replicated to each of its children; a coarsened family
+ * keeps the values of its first child.  Purely local, no
+ * communication.
+ * \param [in,out] fields   A registry whose forest has been adapted.
+ */
+void                p8est_fields_adapt (p8est_fields_t * fields);
+
+/** Carry all field arrays through repartitioning.
+ * Must be called collectively right after p8est_partition; the values
+ * travel to the new owner of their octant.
+ * \param [in,out] fields   A registry whose forest has been
+ *                          repartitioned.
+ */
+void                p8est_fields_partition (p8est_fields_t * fields);
+
+/** Destroy a field registry and all field arrays.
+ */
+void                p8est_fields_destroy (p8est_fields_t * fields);
+
+/** Calculate the memory usage of the registry and its arrays.
+ * \param [in] fields   A field registry.
+ * \return              Memory used in bytes.
+ */
+size_t              p8est_fields_memory_used (p8est_fields_t * fields);
+
+SC_EXTERN_C_END;
+
+#endif /* !P8EST_FIELDS_H */
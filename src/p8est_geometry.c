@@ -229,6 +229,23 @@ p8est_geometry_R (p8est_geometry_t * geom, p4est_topidx_t which_tree,
   return k;
 }
 
+void
+p8est_geometry_Xv (p8est_geometry_t * geom, p4est_topidx_t which_tree,
+                   size_t num_points, const double *abc, double *xyz)
+{
+  size_t              iz;
+
+  if (geom->Xv != NULL) {
+    geom->Xv (geom, which_tree, num_points, abc, xyz);
+    return;
+  }
+
+  /* fall back to one call per point */
+  for (iz = 0; iz < num_points; ++iz) {
+    geom->X (geom, which_tree, abc + 3 * iz, xyz + 3 * iz);
+  }
+}
+
 void
 p8est_geometry_identity_X (p8est_geometry_t * geom,
                            p4est_topidx_t which_tree,
@@ -237,6 +254,15 @@ p8est_geometry_identity_X (p8est_geometry_t * geom,
   memcpy (xyz, abc, 3 * sizeof (double));
 }
 
+void
+p8est_geometry_identity_Xv (p8est_geometry_t * geom,
+                            p4est_topidx_t which_tree,
+                            size_t num_points, const double *abc,
+                            double *xyz)
+{
+  memcpy (xyz, abc, 3 * num_points * sizeof (double));
+}
+
 double
 p8est_geometry_identity_D (p8est_geometry_t * geom,
                            p4est_topidx_t which_tree, const double abc[3])
@@ -265,6 +291,7 @@ p8est_geometry_new_identity (void)
 
   geom->name = "p8est:identity";
   geom->X = p8est_geometry_identity_X;
+  geom->Xv = p8est_geometry_identity_Xv;
   geom->D = p8est_geometry_identity_D;
   geom->J = geom->Jit = p8est_geometry_identity_J;      /* identical here */
   geom->R = p8est_geometry_R;
@@ -333,6 +360,57 @@ p8est_geometry_shell_X (p8est_geometry_t * geom,
   }
 }
 
+static void
+p8est_geometry_shell_Xv (p8est_geometry_t * geom,
+                         p4est_topidx_t which_tree,
+                         size_t num_points, const double *abc, double *xyz)
+{
+  const struct p8est_geometry_builtin_shell *shell
+    = &((p8est_geometry_builtin_t *) geom)->p.shell;
+  /* which of (q, q x, q y) goes into each output per patch, and its sign */
+  static const int    sel[6][3] = {
+    {0, 1, 2}, {2, 1, 0}, {0, 1, 2},
+    {2, 1, 0}, {1, 0, 2}, {1, 0, 2}
+  };
+  static const double sgn[6][3] = {
+    {+1., -1., -1.}, {-1., -1., -1.}, {-1., -1., +1.},
+    {+1., -1., +1.}, {-1., +1., +1.}, {+1., -1., +1.}
+  };
+  const int           pid = (int) (which_tree / 4);
+  const int           s0 = sel[pid][0], s1 = sel[pid][1], s2 = sel[pid][2];
+  const double        m0 = sgn[pid][0], m1 = sgn[pid][1], m2 = sgn[pid][2];
+  size_t              iz;
+
+  P4EST_ASSERT (shell->type == P8EST_GEOMETRY_BUILTIN_SHELL);
+  P4EST_ASSERT (0 <= which_tree && which_tree < 24);
+
+  /* the patch id is fixed per call so the loop body is branch free */
+  for (iz = 0; iz < num_points; ++iz) {
+    const double       *a = abc + 3 * iz;
+    double              v[3], x, y, R;
+
+    /* assert that input points are in the expected range */
+    P4EST_ASSERT (a[0] < 1.0 + SC_1000_EPS && a[0] > -1.0 - SC_1000_EPS);
+    P4EST_ASSERT (a[1] < 1.0 + SC_1000_EPS && a[1] > -1.0 - SC_1000_EPS);
+    P4EST_ASSERT (a[2] < 2.0 + SC_1000_EPS && a[2] > 1.0 - SC_1000_EPS);
+
+    /* transform a[0] and a[1] in-place for nicer grading */
+    x = tan (a[0] * M_PI_4);
+    y = tan (a[1] * M_PI_4);
+
+    /* compute transformation ingredients */
+    R = shell->R1sqrbyR2 * pow (shell->R2byR1, a[2]);
+    v[0] = R / sqrt (x * x + y * y + 1.);
+    v[1] = v[0] * x;
+    v[2] = v[0] * y;
+
+    /* assign correct coordinates based on patch id */
+    xyz[3 * iz + 0] = m0 * v[s0];
+    xyz[3 * iz + 1] = m1 * v[s1];
+    xyz[3 * iz + 2] = m2 * v[s2];
+  }
+}
+
 static double
 p8est_geometry_shell_D (p8est_geometry_t * geom,
                         p4est_topidx_t which_tree, const double abc[3])
@@ -517,6 +595,7 @@ p8est_geometry_new_shell (double R2, double R1)
 
   builtin->geom.name = "p8est:shell";
   builtin->geom.X = p8est_geometry_shell_X;
+  builtin->geom.Xv = p8est_geometry_shell_Xv;
   builtin->geom.D = p8est_geometry_shell_D;
   builtin->geom.J = p8est_geometry_shell_J;
   builtin->geom.Jit = p8est_geometry_Jit;
@@ -625,6 +704,113 @@ p8est_geometry_sphere_X (p8est_geometry_t * geom,
   }
 }
 
+static void
+p8est_geometry_sphere_Xv (p8est_geometry_t * geom,
+                          p4est_topidx_t which_tree,
+                          size_t num_points, const double *abc, double *xyz)
+{
+  const struct p8est_geometry_builtin_sphere *sphere
+    = &((p8est_geometry_builtin_t *) geom)->p.sphere;
+  /* which of (q, q x, q y) goes into each output per patch, and its sign */
+  static const int    sel[6][3] = {
+    {1, 0, 2}, {1, 2, 0}, {1, 0, 2},
+    {0, 1, 2}, {2, 1, 0}, {0, 1, 2}
+  };
+  static const double sgn[6][3] = {
+    {+1., -1., +1.}, {+1., +1., +1.}, {+1., +1., -1.},
+    {+1., -1., -1.}, {-1., -1., -1.}, {-1., -1., +1.}
+  };
+  int                 pid, s0, s1, s2;
+  double              m0, m1, m2;
+  size_t              iz;
+
+  P4EST_ASSERT (sphere->type == P8EST_GEOMETRY_BUILTIN_SPHERE);
+  P4EST_ASSERT (0 <= which_tree && which_tree < 13);
+
+  if (which_tree >= 12) {       /* center cube */
+    const double        Clength = sphere->Clength;
+
+    for (iz = 0; iz < 3 * num_points; ++iz) {
+      P4EST_ASSERT (abc[iz] < 1.0 + SC_1000_EPS &&
+                    abc[iz] > -1.0 - SC_1000_EPS);
+      xyz[iz] = abc[iz] * Clength;
+    }
+    return;
+  }
+
+  pid = (int) (which_tree % 6);
+  s0 = sel[pid][0];
+  s1 = sel[pid][1];
+  s2 = sel[pid][2];
+  m0 = sgn[pid][0];
+  m1 = sgn[pid][1];
+  m2 = sgn[pid][2];
+
+  /* the patch id is fixed per call so the shell loops are branch free */
+  if (which_tree < 6) {         /* outer shell */
+    const double        dist = 1. / 8.; /* keep it inside the tree */
+
+    for (iz = 0; iz < num_points; ++iz) {
+      const double       *a = abc + 3 * iz;
+      const double        z_cmb = a[2] - (1. + 5. / 8.);
+      double              v[3], x, y, R;
+
+      /* assert that input points are in the expected range */
+      P4EST_ASSERT (a[0] < 1.0 + SC_1000_EPS && a[0] > -1.0 - SC_1000_EPS);
+      P4EST_ASSERT (a[1] < 1.0 + SC_1000_EPS && a[1] > -1.0 - SC_1000_EPS);
+      P4EST_ASSERT (a[2] < 2.0 + SC_1000_EPS && a[2] > 1.0 - SC_1000_EPS);
+
+      x = tan (a[0] * M_PI_4);
+      y = tan (a[1] * M_PI_4);
+      if (fabs (z_cmb) < dist) {
+        /* correct z grading for the PREM model */
+        const double        correction = 0.008873;
+
+        R = sphere->R1sqrbyR2 * pow (sphere->R2byR1,
+                                     a[2] + correction *
+                                     exp (1. / (dist * dist) -
+                                          1. / ((z_cmb + dist) *
+                                                (dist - z_cmb))));
+      }
+      else {
+        R = sphere->R1sqrbyR2 * pow (sphere->R2byR1, a[2]);
+      }
+      v[0] = R / sqrt (x * x + y * y + 1.);
+      v[1] = v[0] * x;
+      v[2] = v[0] * y;
+
+      xyz[3 * iz + 0] = m0 * v[s0];
+      xyz[3 * iz + 1] = m1 * v[s1];
+      xyz[3 * iz + 2] = m2 * v[s2];
+    }
+  }
+  else {                        /* inner shell */
+    for (iz = 0; iz < num_points; ++iz) {
+      const double       *a = abc + 3 * iz;
+      double              v[3], x, y, R, p, tanx, tany;
+
+      /* assert that input points are in the expected range */
+      P4EST_ASSERT (a[0] < 1.0 + SC_1000_EPS && a[0] > -1.0 - SC_1000_EPS);
+      P4EST_ASSERT (a[1] < 1.0 + SC_1000_EPS && a[1] > -1.0 - SC_1000_EPS);
+      P4EST_ASSERT (a[2] < 2.0 + SC_1000_EPS && a[2] > 1.0 - SC_1000_EPS);
+
+      p = 2. - a[2];
+      tanx = tan (a[0] * M_PI_4);
+      tany = tan (a[1] * M_PI_4);
+      x = p * a[0] + (1. - p) * tanx;
+      y = p * a[1] + (1. - p) * tany;
+      R = sphere->R0sqrbyR1 * pow (sphere->R1byR0, a[2]);
+      v[0] = R / sqrt (1. + (1. - p) * (tanx * tanx + tany * tany) + 2. * p);
+      v[1] = v[0] * x;
+      v[2] = v[0] * y;
+
+      xyz[3 * iz + 0] = m0 * v[s0];
+      xyz[3 * iz + 1] = m1 * v[s1];
+      xyz[3 * iz + 2] = m2 * v[s2];
+    }
+  }
+}
+
 static double
 p8est_geometry_sphere_D (p8est_geometry_t * geom,
                          p4est_topidx_t which_tree, const double abc[3])
@@ -922,6 +1108,7 @@ p8est_geometry_new_sphere (double R2, double R1, double R0)
 
   builtin->geom.name = "p8est:sphere";
   builtin->geom.X = p8est_geometry_sphere_X;
+  builtin->geom.Xv = p8est_geometry_sphere_Xv;
   builtin->geom.D = p8est_geometry_sphere_D;
   builtin->geom.J = p8est_geometry_sphere_J;
   builtin->geom.Jit = p8est_geometry_Jit;
@@ -929,3 +1116,201 @@ p8est_geometry_new_sphere (double R2, double R1, double R0)
 
   return (p8est_geometry_t *) builtin;
 }
+
+/** Rebuild the cache layout for the forest's current partition.
+ * When \a changes is not NULL, cached values of quadrants in front of
+ * the first recorded change of their tree keep their arena slots.
+ */
+static void
+p8est_geometry_cache_sync (p8est_geometry_cache_t * cache,
+                           sc_array_t * changes)
+{
+  p8est_t            *p8est = cache->p8est;
+  const p4est_topidx_t first = p8est->first_local_tree;
+  const p4est_topidx_t last = p8est->last_local_tree;
+  const p4est_locidx_t ncount = p8est->local_num_quadrants;
+  const p4est_locidx_t ocount = cache->local_num_quadrants;
+  p4est_topidx_t      jt, num_trees;
+  p4est_locidx_t     *noffsets;
+  int8_t             *nfilled;
+  double             *ndetJ, *nJ;
+  p8est_tree_t       *tree;
+  p8est_change_t     *ch;
+  size_t              zc;
+  int                 c;
+
+  num_trees = SC_MAX (last - first + 1, 0);
+  noffsets = P4EST_ALLOC (p4est_locidx_t, num_trees + 1);
+  nfilled = P4EST_ALLOC_ZERO (int8_t, ncount);
+  ndetJ = P4EST_ALLOC (double, ncount);
+  nJ = P4EST_ALLOC (double, 9 * (size_t) ncount);
+
+  for (jt = first; jt <= last; ++jt) {
+    tree = p8est_tree_array_index (p8est->trees, jt);
+    noffsets[jt - first] = tree->quadrants_offset;
+  }
+  noffsets[num_trees] = ncount;
+
+  if (changes != NULL && cache->filled != NULL) {
+    /* retain cached values in front of the first change of each tree */
+    zc = 0;
+    for (jt = first; jt <= last; ++jt) {
+      p4est_locidx_t      keep, ooff, noff;
+
+      if (jt < cache->first_local_tree || jt > cache->last_local_tree) {
+        continue;
+      }
+      ooff = cache->offsets[jt - cache->first_local_tree];
+      noff = noffsets[jt - first];
+      keep = SC_MIN (cache->offsets[jt - cache->first_local_tree + 1] - ooff,
+                     noffsets[jt - first + 1] - noff);
+      while (zc < changes->elem_count) {
+        ch = (p8est_change_t *) sc_array_index (changes, zc);
+        if (ch->which_tree > jt) {
+          break;
+        }
+        if (ch->which_tree == jt) {
+          keep = SC_MIN (keep, ch->begin);
+        }
+        ++zc;
+      }
+      if (keep > 0) {
+        memcpy (nfilled + noff, cache->filled + ooff,
+                (size_t) keep * sizeof (int8_t));
+        memcpy (ndetJ + noff, cache->detJ + ooff,
+                (size_t) keep * sizeof (double));
+        for (c = 0; c < 9; ++c) {
+          memcpy (nJ + (size_t) c * ncount + noff,
+                  cache->J + (size_t) c * ocount + ooff,
+                  (size_t) keep * sizeof (double));
+        }
+      }
+    }
+  }
+
+  P4EST_FREE (cache->offsets);
+  P4EST_FREE (cache->filled);
+  P4EST_FREE (cache->detJ);
+  P4EST_FREE (cache->J);
+  cache->offsets = noffsets;
+  cache->filled = nfilled;
+  cache->detJ = ndetJ;
+  cache->J = nJ;
+  cache->first_local_tree = first;
+  cache->last_local_tree = last;
+  cache->local_num_quadrants = ncount;
+  cache->revision = p8est->revision;
+}
+
+p8est_geometry_cache_t *
+p8est_geometry_cache_new (p8est_t * p8est, p8est_geometry_t * geom)
+{
+  p8est_geometry_cache_t *cache;
+
+  P4EST_ASSERT (p8est->connectivity->vertices != NULL);
+  P4EST_ASSERT (p8est->connectivity->tree_to_vertex != NULL);
+
+  cache = P4EST_ALLOC_ZERO (p8est_geometry_cache_t, 1);
+  cache->geom = geom;
+  cache->p8est = p8est;
+  cache->revision = -1;
+  p8est_geometry_cache_sync (cache, NULL);
+
+  return cache;
+}
+
+void
+p8est_geometry_cache_update (p8est_geometry_cache_t * cache,
+                             sc_array_t * changes)
+{
+  P4EST_ASSERT (changes == NULL ||
+                changes->elem_size == sizeof (p8est_change_t));
+
+  if (cache->revision == cache->p8est->revision) {
+    /* the forest has not been modified since the last sync */
+    return;
+  }
+  p8est_geometry_cache_sync (cache, changes);
+}
+
+double
+p8est_geometry_cache_get (p8est_geometry_cache_t * cache,
+                          p4est_topidx_t which_tree,
+                          p4est_locidx_t quadid, double J[3][3])
+{
+  p8est_t            *p8est = cache->p8est;
+  p4est_locidx_t      idx;
+  int                 i, j;
+
+  P4EST_ASSERT (cache->revision == p8est->revision);
+  P4EST_ASSERT (cache->first_local_tree <= which_tree &&
+                which_tree <= cache->last_local_tree);
+
+  idx = cache->offsets[which_tree - cache->first_local_tree] + quadid;
+  P4EST_ASSERT (0 <= quadid && idx <
+                cache->offsets[which_tree - cache->first_local_tree + 1]);
+
+  if (!cache->filled[idx]) {
+    const p8est_connectivity_t *conn = p8est->connectivity;
+    const double       *v = conn->vertices;
+    const double        intsize = 1. / P8EST_ROOT_LEN;
+    p8est_tree_t       *tree;
+    p8est_quadrant_t   *q;
+    p4est_topidx_t      vt[P8EST_CHILDREN];
+    double              h2, eta_x, eta_y, eta_z;
+    double              abc[3], Jq[3][3];
+    int                 k;
+
+    tree = p8est_tree_array_index (p8est->trees, which_tree);
+    q = p8est_quadrant_array_index (&tree->quadrants, (size_t) quadid);
+
+    /* evaluate the geometry at the quadrant midpoint */
+    for (k = 0; k < P8EST_CHILDREN; ++k) {
+      vt[k] = conn->tree_to_vertex[which_tree * P8EST_CHILDREN + k];
+    }
+    h2 = .5 * intsize * P8EST_QUADRANT_LEN (q->level);
+    eta_x = intsize * q->x + h2;
+    eta_y = intsize * q->y + h2;
+    eta_z = intsize * q->z + h2;
+    for (j = 0; j < 3; ++j) {
+      abc[j] =
+        ((1. - eta_z) * ((1. - eta_y) * ((1. - eta_x) * v[3 * vt[0] + j] +
+                                         eta_x * v[3 * vt[1] + j]) +
+                         eta_y * ((1. - eta_x) * v[3 * vt[2] + j] +
+                                  eta_x * v[3 * vt[3] + j])) +
+         eta_z * ((1. - eta_y) * ((1. - eta_x) * v[3 * vt[4] + j] +
+                                  eta_x * v[3 * vt[5] + j]) +
+                  eta_y * ((1. - eta_x) * v[3 * vt[6] + j] +
+                           eta_x * v[3 * vt[7] + j])));
+    }
+    cache->detJ[idx] = cache->geom->J (cache->geom, which_tree, abc, Jq);
+    for (i = 0; i < 3; ++i) {
+      for (j = 0; j < 3; ++j) {
+        cache->J[(size_t) (3 * i + j) * cache->local_num_quadrants + idx] =
+          Jq[i][j];
+      }
+    }
+    cache->filled[idx] = 1;
+  }
+
+  if (J != NULL) {
+    for (i = 0; i < 3; ++i) {
+      for (j = 0; j < 3; ++j) {
+        J[i][j] =
+          cache->J[(size_t) (3 * i + j) * cache->local_num_quadrants + idx];
+      }
+    }
+  }
+
+  return cache->detJ[idx];
+}
+
+void
+p8est_geometry_cache_destroy (p8est_geometry_cache_t * cache)
+{
+  P4EST_FREE (cache->offsets);
+  P4EST_FREE (cache->filled);
+  P4EST_FREE (cache->detJ);
+  P4EST_FREE (cache->J);
+  P4EST_FREE (cache);
+}
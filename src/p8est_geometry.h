@@ -49,6 +49,13 @@ typedef void        (*p8est_geometry_X_t) (p8est_geometry_t * geom,
                                            p4est_topidx_t which_tree,
                                            const double abc[3],
                                            double xyz[3]);
+
+/* Batched forward transformation of num_points points stored
+ * contiguously as xyz triples; equivalent to num_points calls to X */
+typedef void        (*p8est_geometry_Xv_t) (p8est_geometry_t * geom,
+                                            p4est_topidx_t which_tree,
+                                            size_t num_points,
+                                            const double *abc, double *xyz);
 typedef double      (*p8est_geometry_D_t) (p8est_geometry_t * geom,
                                            p4est_topidx_t which_tree,
                                            const double abc[3]);
@@ -68,6 +75,8 @@ struct p8est_geometry
 {
   const char         *name;     /* use prefixes to be namespace clean */
   p8est_geometry_X_t  X;
+  p8est_geometry_Xv_t Xv;       /* batched version of X, may be NULL;
+                                   use p8est_geometry_Xv for dispatch */
   p8est_geometry_D_t  D;
   p8est_geometry_J_t  J, Jit;   /* both return the determinant of J */
   p8est_geometry_R_t  R;        /* returns -1 on error */
@@ -85,6 +94,19 @@ double              p8est_geometry_Jit (p8est_geometry_t * geom,
                                         const double abc[3],
                                         double Jit[3][3]);
 
+/** Transform a batch of points through the geometry.
+ * Uses the geom->Xv implementation when available and falls back to
+ * calling geom->X once per point otherwise.  The built-in geometries
+ * provide loop implementations that a compiler can vectorize.
+ * \param [in] num_points   Number of points to transform.
+ * \param [in] abc          3 * num_points vertex domain coordinates.
+ * \param [out] xyz         3 * num_points computational coordinates.
+ */
+void                p8est_geometry_Xv (p8est_geometry_t * geom,
+                                       p4est_topidx_t which_tree,
+                                       size_t num_points,
+                                       const double *abc, double *xyz);
+
 /** Approximate the inverse transformation by Newton iterations.
  * The number of allowed Newton steps is p8est_geometry_max_newton.
  * \param [in] txyz Computational domain target coordinates.
@@ -106,6 +128,14 @@ void                p8est_geometry_identity_X (p8est_geometry_t * geom,
                                                const double abc[3],
                                                double xyz[3]);
 
+/** The identity transformation for a batch of points.
+ */
+void                p8est_geometry_identity_Xv (p8est_geometry_t * geom,
+                                                p4est_topidx_t which_tree,
+                                                size_t num_points,
+                                                const double *abc,
+                                                double *xyz);
+
 /** The Jacobi determinant of the identity transformation.
  * \return          The determinant of the Jacobian.
  */
@@ -144,6 +174,71 @@ p8est_geometry_t   *p8est_geometry_new_shell (double R2, double R1);
 p8est_geometry_t   *p8est_geometry_new_sphere (double R2, double R1,
                                                double R0);
 
+/** Cache of per-quadrant geometry Jacobians keyed to the forest revision.
+ * The Jacobian and its determinant are evaluated at each local
+ * quadrant's midpoint and stored in structure-of-arrays arenas, one
+ * plane per Jacobian entry, that are filled lazily on first access.
+ * After adapting the forest, call \ref p8est_geometry_cache_update
+ * with the change set obtained from p8est_changes_end so that only
+ * the quadrants an adaptation touched lose their cached values.
+ */
+typedef struct p8est_geometry_cache
+{
+  p8est_geometry_t   *geom;     /**< geometry used to fill, not owned */
+  p8est_t            *p8est;    /**< forest the cache mirrors, not owned */
+  long                revision; /**< forest revision the layout matches */
+  p4est_topidx_t      first_local_tree;  /**< captured at last update */
+  p4est_topidx_t      last_local_tree;   /**< captured at last update */
+  p4est_locidx_t      local_num_quadrants;       /**< arena plane size */
+  p4est_locidx_t     *offsets;  /**< per-tree start into the arenas */
+  int8_t             *filled;   /**< per-quadrant lazily filled flag */
+  double             *detJ;     /**< determinant arena */
+  double             *J;        /**< 9 planes of local_num_quadrants */
+}
+p8est_geometry_cache_t;
+
+/** Create an empty geometry cache for the current state of a forest.
+ * The forest's connectivity must provide vertex coordinates.
+ * \param [in] p8est    Forest to be mirrored; not owned by the cache.
+ * \param [in] geom     Geometry used to fill; not owned by the cache.
+ * \return              Cache to free with p8est_geometry_cache_destroy.
+ */
+p8est_geometry_cache_t *p8est_geometry_cache_new (p8est_t * p8est,
+                                                  p8est_geometry_t * geom);
+
+/** Bring the cache layout in sync with the forest after adaptation.
+ * \param [in,out] cache        The cache to be updated.
+ * \param [in] changes  Change set recorded between p8est_changes_begin
+ *                      and p8est_changes_end covering all operations
+ *                      since the last update, or NULL to invalidate
+ *                      every quadrant.  Within each changed tree the
+ *                      cached values in front of the first modified
+ *                      quadrant are retained; the remaining quadrants
+ *                      are refilled lazily since their positions may
+ *                      have shifted.
+ */
+void                p8est_geometry_cache_update (p8est_geometry_cache_t *
+                                                 cache, sc_array_t * changes);
+
+/** Access the cached Jacobian of a local quadrant, filling it on demand.
+ * \param [in,out] cache        Cache in sync with the forest revision.
+ * \param [in] which_tree       A process-local tree number.
+ * \param [in] quadid   Quadrant number relative to the tree.
+ * \param [out] J       If not NULL, filled with the Jacobian evaluated
+ *                      at the quadrant midpoint.
+ * \return              The determinant of the Jacobian.
+ */
+double              p8est_geometry_cache_get (p8est_geometry_cache_t * cache,
+                                              p4est_topidx_t which_tree,
+                                              p4est_locidx_t quadid,
+                                              double J[3][3]);
+
+/** Free a geometry cache.  The forest and geometry are left alone.
+ * \param [in,out] cache        The cache to be freed.
+ */
+void                p8est_geometry_cache_destroy (p8est_geometry_cache_t *
+                                                  cache);
+
 SC_EXTERN_C_END;
 
 #endif /* !P8EST_GEOMETRY_H */
@@ -0,0 +1,98 @@
+/*
+  This file is part of p4est.
+  p4est is a C library to manage a collection (a forest) of multiple
+  connected adaptive quadtrees or octrees in parallel.
+
+  Copyright (C) 2010 The University of Texas System
+  Written by Carsten Burstedde, Lucas C. Wilcox, and Tobin Isaac
+
+  p4est is free software; you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation; either version 2 of the License, or
+  (at your option) any later version.
+
+  p4est is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with p4est; if not, write to the Free Software Foundation, Inc.,
+  51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
+*/
+
+#ifndef P8EST_HIERARCHY_H
+#define P8EST_HIERARCHY_H
+
+#include <p8est.h>
+
+SC_EXTERN_C_BEGIN;
+
+/** One member of a multilevel hierarchy of coarsened forests.
+ *
+ * The octants themselves are not stored: the structure of each coarser
+ * level is implicit in the Morton order of the forest's leaves and is
+ * described entirely by index offsets into the next finer level.
+ */
+typedef struct p8est_hierarchy_level
+{
+  p4est_locidx_t      num_quadrants;    /**< octants on this level */
+  p4est_locidx_t     *tree_offsets;     /**< num_trees + 1 cumulative
+                                             per-tree octant counts */
+  p4est_locidx_t     *child_offsets;    /**< num_quadrants + 1 entries;
+                                             octant i covers the finer
+                                             level's range child_offsets[i]
+                                             .. child_offsets[i+1] - 1,
+                                             which has one entry for a
+                                             copied octant and
+                                             P8EST_CHILDREN for a coarsened
+                                             family.  NULL on the finest
+                                             level. */
+  p4est_locidx_t     *parents;          /**< num_quadrants entries mapping
+                                             each octant to its covering
+                                             octant on the next coarser
+                                             level.  NULL on the coarsest
+                                             level. */
+}
+p8est_hierarchy_level_t;
+
+/** A multilevel hierarchy of coarsened copies of a forest.
+ *
+ * Level 0 are the forest's leaves.  Each coarser level replaces every
+ * complete sibling family of the finer level by its parent and copies
+ * all remaining octants, until no family is left.  Restriction loops
+ * over a coarse level and gathers from \a child_offsets; prolongation
+ * scatters along the same map or follows \a parents upward.
+ */
+typedef struct p8est_hierarchy
+{
+  p8est_t            *p4est;            /**< the fine forest, not owned */
+  int                 num_levels;       /**< number of levels, at least 1 */
+  p8est_hierarchy_level_t *levels;      /**< levels[0] is the finest */
+}
+p8est_hierarchy_t;
+
+/** Create the hierarchy of all coarser levels of a forest.
+ *
+ * Works bottom-up in one linear pass per level over each tree's
+ * octant array; no intermediate forest copies are created.
+ *
+ * \param [in] p8est    A valid forest; it must survive the hierarchy.
+ * \return              A fully populated hierarchy structure.
+ */
+p8est_hierarchy_t  *p8est_hierarchy_new (p8est_t * p8est);
+
+/** Destroy a hierarchy structure created with p8est_hierarchy_new.
+ */
+void                p8est_hierarchy_destroy (p8est_hierarchy_t * hierarchy);
+
+/** Calculate the memory usage of the hierarchy structure.
+ * \param [in] hierarchy    Hierarchy structure.
+ * \return                  Memory used in bytes.
+ */
+size_t              p8est_hierarchy_memory_used (p8est_hierarchy_t *
+                                                 hierarchy);
+
+SC_EXTERN_C_END;
+
+#endif /* !P8EST_HIERARCHY_H */
@@ -58,6 +58,9 @@ typedef void        (*p8est_iter_volume_t) (p8est_iter_volume_info_t * info,
  * quadrants are listed in z-order. If a quadrant should be present, but it is
  * not included in the ghost layer, then quad = NULL, is_ghost is true, and
  * quadid = -1.
+ * The \a data pointers are only valid under p8est_iterate_ghost_data, which
+ * resolves them to the quadrant's user data for local quadrants and into the
+ * caller's ghost data array for ghosts; a missing ghost has data = NULL.
  */
 typedef struct p8est_iter_face_side
 {
@@ -71,6 +74,7 @@ typedef struct p8est_iter_face_side
       int8_t              is_ghost;
       p8est_quadrant_t   *quad;
       p4est_locidx_t      quadid;
+      void               *data;
     }
     full;
     struct
@@ -78,6 +82,7 @@ typedef struct p8est_iter_face_side
       int8_t              is_ghost[4];
       p8est_quadrant_t   *quad[4];
       p4est_locidx_t      quadid[4];
+      void               *data[4];
     }
     hanging;
   }
@@ -121,6 +126,8 @@ typedef void        (*p8est_iter_face_t) (p8est_iter_face_info_t * info,
  * as edge orientation in the connectivity. If a quadrant should be present,
  * but it is not included in the ghost layer, then quad = NULL, is_ghost is
  * true, and quadid = -1.
+ * The \a data pointers are only valid under p8est_iterate_ghost_data; see
+ * p8est_iter_face_side_t.
  */
 typedef struct p8est_iter_edge_side
 {
@@ -135,6 +142,7 @@ typedef struct p8est_iter_edge_side
       int8_t              is_ghost;
       p8est_quadrant_t   *quad;
       p4est_locidx_t      quadid;
+      void               *data;
     }
     full;
     struct
@@ -142,6 +150,7 @@ typedef struct p8est_iter_edge_side
       int8_t              is_ghost[2];
       p8est_quadrant_t   *quad[2];
       p4est_locidx_t      quadid[2];
+      void               *data[2];
     }
     hanging;
   }
@@ -184,6 +193,8 @@ typedef struct p8est_iter_corner_side
   int8_t              is_ghost;
   p8est_quadrant_t   *quad;
   p4est_locidx_t      quadid;
+  void               *data;     /* only valid under
+                                   p8est_iterate_ghost_data */
 }
 p8est_iter_corner_side_t;
 
@@ -211,6 +222,63 @@ p8est_iter_corner_info_t;
 typedef void        (*p8est_iter_corner_t) (p8est_iter_corner_info_t * info,
                                             void *user_data);
 
+/** The number of entities gathered into one batch by
+ * p8est_iterate_batched before the batch callback is invoked. */
+#define P8EST_ITER_BATCH_SIZE 1024
+
+/** A batch of volume callback data in structure-of-arrays form.  The
+ * entries 0 <= j < \a count describe one local quadrant each: \a treeid[j]
+ * indexes p4est->trees and \a quadid[j] the tree's quadrants array.
+ */
+typedef struct p8est_iter_volume_batch_info
+{
+  p8est_t            *p4est;
+  p8est_ghost_t      *ghost_layer;
+  size_t              count;
+  p4est_topidx_t      treeid[P8EST_ITER_BATCH_SIZE];
+  p4est_locidx_t      quadid[P8EST_ITER_BATCH_SIZE];
+}
+p8est_iter_volume_batch_info_t;
+
+/** The prototype for a function that p8est_iterate_batched executes on
+ * every full batch of local quadrants and once on the final partial batch.
+ */
+typedef void        (*p8est_iter_volume_batch_t)
+  (p8est_iter_volume_batch_info_t * info, void *user_data);
+
+/** A batch of face callback data in structure-of-arrays form.  The entries
+ * 0 <= j < \a count describe one face each, with the same conventions as
+ * p8est_iter_face_info_t and p8est_iter_face_side_t: \a num_sides[j] is 1
+ * on the outer forest boundary and 2 otherwise, and the first array index
+ * s selects the side.  A hanging side stores its four quadrants in z-order
+ * in the halves h = 0, ..., 3 of \a quadid[s][h][j] and
+ * \a is_ghost[s][h][j]; a full side uses half 0 only.  \a quadid indexes
+ * the tree's quadrants array or, when \a is_ghost is set, the ghosts
+ * array.  A quadrant that is missing from the ghost layer has quadid -1
+ * and is_ghost 1; all entries of an absent side or half are set to -1.
+ */
+typedef struct p8est_iter_face_batch_info
+{
+  p8est_t            *p4est;
+  p8est_ghost_t      *ghost_layer;
+  size_t              count;
+  int8_t              orientation[P8EST_ITER_BATCH_SIZE];
+  int8_t              tree_boundary[P8EST_ITER_BATCH_SIZE];
+  int8_t              num_sides[P8EST_ITER_BATCH_SIZE];
+  p4est_topidx_t      treeid[2][P8EST_ITER_BATCH_SIZE];
+  int8_t              face[2][P8EST_ITER_BATCH_SIZE];
+  int8_t              is_hanging[2][P8EST_ITER_BATCH_SIZE];
+  p4est_locidx_t      quadid[2][4][P8EST_ITER_BATCH_SIZE];
+  int8_t              is_ghost[2][4][P8EST_ITER_BATCH_SIZE];
+}
+p8est_iter_face_batch_info_t;
+
+/** The prototype for a function that p8est_iterate_batched executes on
+ * every full batch of faces and once on the final partial batch.
+ */
+typedef void        (*p8est_iter_face_batch_t)
+  (p8est_iter_face_batch_info_t * info, void *user_data);
+
 /** p8est_iterate executes the user-supplied callback functions at every
  * volume, face, edge and corner in the local forest. The ghost_layer may be
  * NULL. The \a user_data pointer is not touched by p4est_iterate, but is
@@ -242,6 +310,250 @@ void                p8est_iterate (p8est_t * p4est,
                                    p8est_iter_edge_t iter_edge,
                                    p8est_iter_corner_t iter_corner);
 
+/** p8est_iterate_ghost_data traverses like p8est_iterate and additionally
+ * fills the \a data pointers of the face, edge, and corner side structs
+ * before each callback, so user code no longer performs its own indexed
+ * lookup for ghost quadrants.  For a local quadrant, data is
+ * quad->p.user_data; for a ghost, it is \a ghost_data + \a ghost_stride
+ * times the ghost index, matching an array in ghost layer order such as
+ * one filled by p8est_ghost_exchange_data with ghost_stride equal to the
+ * data size; for a quadrant missing from the ghost layer it is NULL.
+ * \param [in] ghost_data     Base of the caller's per-ghost data array.
+ * \param [in] ghost_stride   Bytes between consecutive entries.
+ */
+void                p8est_iterate_ghost_data (p8est_t * p4est,
+                                              p8est_ghost_t * ghost_layer,
+                                              void *ghost_data,
+                                              size_t ghost_stride,
+                                              void *user_data,
+                                              p8est_iter_volume_t iter_volume,
+                                              p8est_iter_face_t iter_face,
+                                              p8est_iter_edge_t iter_edge,
+                                              p8est_iter_corner_t
+                                              iter_corner);
+
+/** p8est_iterate_threaded executes the same callbacks as p8est_iterate,
+ * spreading the work over \a num_threads POSIX threads.  When only a volume
+ * callback is given, each tree's quadrant range is cut into chunks that
+ * idle workers steal until none are left.  Otherwise the trees are colored so that no two trees sharing
+ * a face, edge, or corner receive the same color; the colors are processed
+ * one after another and the trees within one color are distributed among the
+ * workers.  Every face, edge, and corner callback is thus delivered exactly
+ * once, and no two workers concurrently run callbacks on the interior of the
+ * same tree or on the same inter-tree boundary.  Callbacks on different
+ * boundaries of a common neighbor tree may still run concurrently, so
+ * callbacks that accumulate into shared data must do so atomically.  The
+ * ordering guarantees of p8est_iterate hold within each tree, but not
+ * across trees.  A \a num_threads of zero selects the hybrid execution
+ * width configured with p8est_set_num_threads.  If p4est was configured
+ * without pthread.h, or if the resulting thread count is less than two,
+ * this is equivalent to p8est_iterate.
+ */
+void                p8est_iterate_threaded (p8est_t * p4est,
+                                            p8est_ghost_t * ghost_layer,
+                                            void *user_data,
+                                            p8est_iter_volume_t iter_volume,
+                                            p8est_iter_face_t iter_face,
+                                            p8est_iter_edge_t iter_edge,
+                                            p8est_iter_corner_t iter_corner,
+                                            int num_threads);
+
+/** Rewrite the local quadrant storage so that on a first-touch NUMA
+ * policy each page lands on the socket of the worker that processes it.
+ * The local quadrant range is split into \a num_threads contiguous
+ * shares, mirroring the partitioning of p8est_iterate_threaded, and
+ * each worker performs the first write to the pages backing its share.
+ * Only the quadrant structs move; any user data stays where it is.
+ * Call this after adaptation or partition has rebuilt the quadrant
+ * arrays on one thread.  A \a num_threads of zero selects the hybrid
+ * execution width configured with p8est_set_num_threads.  If p4est was
+ * configured without pthread.h, or if the resulting thread count is
+ * less than two, this is a noop.
+ */
+void                p8est_numa_first_touch (p8est_t * p8est,
+                                            int num_threads);
+
+/** p8est_iterate_batched traverses the local forest like p8est_iterate,
+ * but gathers P8EST_ITER_BATCH_SIZE entities into structure-of-arrays
+ * buffers and invokes the callbacks once per batch, so that the per-entity
+ * function call and side-struct setup are amortized and the callback can
+ * vectorize across the batch.  Either callback may be NULL.  A batch is
+ * delivered as soon as it is full and any remainder at the end of the
+ * traversal, so the interleaving guarantees of p8est_iterate between
+ * volume and face callbacks do not carry over to the batches.
+ */
+void                p8est_iterate_batched (p8est_t * p4est,
+                                           p8est_ghost_t * ghost_layer,
+                                           void *user_data,
+                                           p8est_iter_volume_batch_t
+                                           iter_volume,
+                                           p8est_iter_face_batch_t
+                                           iter_face);
+
+/** An opaque recording of one p8est_iterate traversal that can be
+ * replayed as long as the forest does not change. */
+typedef struct p8est_iter_plan p8est_iter_plan_t;
+
+/** Create an empty iteration plan bound to a forest and a ghost layer.
+ * The ghost_layer may be NULL.  The plan does not take ownership of
+ * either; both must stay alive while the plan is in use.
+ */
+p8est_iter_plan_t  *p8est_iter_plan_new (p8est_t * p4est,
+                                         p8est_ghost_t * ghost_layer);
+
+/** Execute the callbacks like p8est_iterate, caching the traversal.
+ * On the first call, and whenever the forest revision or the set of
+ * non-NULL callbacks has changed since the last recording, the full
+ * traversal runs through p8est_iterate and every volume, face, edge, and
+ * corner callback is recorded into a flat replayable plan while it is
+ * delivered.  Otherwise the plan is replayed, which skips the adjacency
+ * search entirely and delivers the callbacks with the recorded quadrant
+ * indices in the original traversal order.  The forest must not be
+ * refined, coarsened, balanced, or repartitioned between recording and
+ * replay except through the p8est routines, which advance the revision
+ * counter.
+ */
+void                p8est_iterate_plan (p8est_iter_plan_t * plan,
+                                        void *user_data,
+                                        p8est_iter_volume_t iter_volume,
+                                        p8est_iter_face_t iter_face,
+                                        p8est_iter_edge_t iter_edge,
+                                        p8est_iter_corner_t iter_corner);
+
+/** Partition the recorded face callbacks into conflict-free batches.
+ * Two faces conflict when they touch a common process-local octant;
+ * ghost octants are read-only here and impose no conflict.  All faces
+ * of one color may therefore be processed concurrently without atomic
+ * updates, e.g. one accelerator kernel launch per color.  The plan must
+ * hold a recording of the current forest revision that includes the
+ * face callback, i.e. p8est_iterate_plan must have run before.
+ * \param [in] plan         A plan with a current face recording.
+ * \param [out] num_colors  If not NULL, set to the number of colors.
+ * \return      Newly allocated array of int with one color per recorded
+ *              face, in the plan's face order; colors are consecutive
+ *              starting from zero.  Destroy with sc_array_destroy.
+ */
+sc_array_t         *p8est_iter_plan_color_faces (p8est_iter_plan_t * plan,
+                                                 int *num_colors);
+
+/** Free all memory held by an iteration plan.
+ */
+void                p8est_iter_plan_destroy (p8est_iter_plan_t * plan);
+
+/** An opaque cache of the corner participant sets resolved by one
+ * p8est_iterate traversal, keyed by the forest revision. */
+typedef struct p8est_iter_corner_cache p8est_iter_corner_cache_t;
+
+/** Create an empty corner cache bound to a forest and a ghost layer.
+ * The ghost_layer may be NULL.  The cache does not take ownership of
+ * either; both must stay alive while the cache is in use.
+ */
+p8est_iter_corner_cache_t *p8est_iter_corner_cache_new (p8est_t * p4est,
+                                                        p8est_ghost_t *
+                                                        ghost_layer);
+
+/** Execute the callbacks like p8est_iterate, caching the corner search.
+ * On the first call, and whenever the forest revision has changed since
+ * the cache was filled, this runs a full traversal and records the corner
+ * participant sets along the way.  On subsequent calls the traversal runs
+ * without the corner matching and the cached corner callbacks are
+ * delivered afterwards in their recorded order, so ordering guarantee 3
+ * of p8est_iterate does not hold on replays: all corner callbacks come
+ * after the volume, face, and edge callbacks.  The forest must not be
+ * refined, coarsened, balanced, or repartitioned between recording and
+ * replay except through the p8est routines, which advance the revision
+ * counter.
+ */
+void                p8est_iterate_corner_cached (p8est_iter_corner_cache_t *
+                                                 cache, void *user_data,
+                                                 p8est_iter_volume_t
+                                                 iter_volume,
+                                                 p8est_iter_face_t iter_face,
+                                                 p8est_iter_edge_t iter_edge,
+                                                 p8est_iter_corner_t
+                                                 iter_corner);
+
+/** Free all memory held by a corner cache.
+ */
+void                p8est_iter_corner_cache_destroy (p8est_iter_corner_cache_t
+                                                     * cache);
+
+/** A level-bucketed view of the local quadrants, so that a traversal of
+ * one level touches only matching quadrants instead of scanning the full
+ * Morton-sorted quadrant arrays.  The view becomes stale when the local
+ * forest changes; p8est_iter_level_update rebuilds it lazily based on the
+ * forest revision. */
+typedef struct p8est_iter_level p8est_iter_level_t;
+
+/** Build a level view of the current local forest.
+ */
+p8est_iter_level_t *p8est_iter_level_new (p8est_t * p8est);
+
+/** Rebuild a level view if the forest has changed since it was built.
+ * Does nothing when the view is still current.
+ */
+void                p8est_iter_level_update (p8est_t * p8est,
+                                             p8est_iter_level_t * lview);
+
+/** Execute a callback on every local octant of one level, in the order
+ * of the space filling curve.  The view must be current, i.e. the forest
+ * must not have changed since p8est_iter_level_new or _update.  The
+ * ghost_layer member of the callback information is NULL.
+ */
+void                p8est_iterate_level (p8est_t * p8est,
+                                         p8est_iter_level_t * lview,
+                                         void *user_data, int level,
+                                         p8est_iter_volume_t iter_volume);
+
+/** Free all memory held by a level view.
+ */
+void                p8est_iter_level_destroy (p8est_iter_level_t * lview);
+
+/** Execute a callback on the local octants inside a spatial window.
+ * The window is given as an array of subtree roots: each element of
+ * \a roots is a p8est_quadrant_t whose p.which_tree member holds the
+ * tree it lives in.  For every root the local descendants (or the one
+ * local octant containing the root, if the forest is coarser there)
+ * are located by binary search on the Morton order and visited in the
+ * order of the space filling curve, so only the windowed octants are
+ * touched instead of the full forest.  Roots on other processes are
+ * skipped; overlapping roots deliver shared octants more than once.
+ * The ghost_layer member of the callback information is NULL.
+ */
+void                p8est_iterate_window (p8est_t * p4est, void *user_data,
+                                          sc_array_t * roots,
+                                          p8est_iter_volume_t iter_volume);
+
+/** Callback executed for one local octant face on the domain boundary.
+ * \param [in] p8est        The forest being traversed.
+ * \param [in] which_tree   The tree containing \a quadrant.
+ * \param [in] quadrant     The local octant touching the boundary.
+ * \param [in] face         The octant face lying on the boundary.
+ * \param [in] quadid       Index of \a quadrant in the tree's array.
+ * \param [in] user_data    The pointer passed to the traversal.
+ */
+typedef void        (*p8est_iter_boundary_face_t) (p8est_t * p8est,
+                                                   p4est_topidx_t which_tree,
+                                                   p8est_quadrant_t *
+                                                   quadrant, int face,
+                                                   p4est_locidx_t quadid,
+                                                   void *user_data);
+
+/** Execute a callback on exactly the faces of the domain boundary.
+ * A tree face lies on the domain boundary when the connectivity has no
+ * neighbor across it.  For each such face of a local tree the implicit
+ * tree is descended with only the face-touching children expanded, so
+ * the traversal enumerates the boundary faces directly in the order of
+ * the space filling curve instead of filtering them out of a full
+ * p8est_iterate pass; the cost is proportional to the number of
+ * boundary faces times the tree depth.  An octant in an edge or corner
+ * of its tree is reported once per boundary face it touches.
+ */
+void                p8est_iterate_boundary_faces (p8est_t * p8est,
+                                                  void *user_data,
+                                                  p8est_iter_boundary_face_t
+                                                  iter_fn);
+
 /** Return a pointer to a iter_corner_side array element indexed by a int.
  */
 /*@unused@*/
@@ -21,14 +21,6 @@
   51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
 */
 
-/********************************************************************
- *                          IMPORTANT NOTE                          *
- *                                                                  *
- * The p4est_points functionality depends on sc/src/sc_sort.        *
- * That parallel bitonic sort is still buggy (see sc/bugs).         *
- * If you want to use this code you have to fix the sort first.     *
- ********************************************************************/
-
 #ifndef P8EST_POINTS_H
 #define P8EST_POINTS_H
 
@@ -69,6 +61,58 @@ p8est_t            *p8est_new_points (MPI_Comm mpicomm,
                                       size_t data_size, p8est_init_t init_fn,
                                       void *user_pointer);
 
+/** Context for streaming points into an existing forest.
+ * Between p8est_points_buffer_new and p8est_points_buffer_destroy the
+ * buffer owns the forest's octant user data, which holds the range of
+ * retained points per octant as two p4est_locidx_t entries.
+ */
+typedef struct p8est_points_buffer
+{
+  p8est_t            *p4est;
+  int                 maxlevel;
+  p4est_locidx_t      max_points;
+  p4est_locidx_t      num_points;
+  p8est_quadrant_t   *points;    /* retained points in partition order */
+}
+p8est_points_buffer_t;
+
+/** Prepare an existing forest for incremental point ingestion.
+ * The forest's octant data is reset to hold per-octant point ranges,
+ * so any previous user data is released; it is restored to size zero by
+ * p8est_points_buffer_destroy.
+ * \param [in] p8est         The forest to ingest points into.
+ * \param [in] maxlevel      Level of the smallest possible octants.
+ * \param [in] max_points    Maximum number of points per octant.
+ *                           Applies to octants above maxlevel, so 0 is ok.
+ * \return                   A buffer to be passed to the add function.
+ */
+p8est_points_buffer_t *p8est_points_buffer_new (p8est_t * p8est,
+                                                int maxlevel,
+                                                p4est_locidx_t max_points);
+
+/** Ingest a batch of points and refine where they accumulate.
+ * The points are merged into the buffer's retained set and the octants
+ * whose point count exceeds max_points are refined recursively, without
+ * rebuilding the forest.  Points outside the local partition are dropped;
+ * route them to their owner first, e.g. with p8est_search_owners_global.
+ * Rebalancing, ghost creation and repartitioning are left to the caller.
+ * \param [in,out] buffer    Buffer created by p8est_points_buffer_new.
+ * \param [in] points        Collection of clamped octant nodes.
+ *                           The tree id must be stored in p.which_tree.
+ * \param [in] num_points    Number of points provided in the array.
+ */
+void                p8est_points_buffer_add (p8est_points_buffer_t * buffer,
+                                             const p8est_quadrant_t * points,
+                                             p4est_locidx_t num_points);
+
+/** Release a point buffer and return the octant data to the caller.
+ * The forest itself is not modified except that its octant data size
+ * is reset to zero.
+ * \param [in] buffer        Buffer created by p8est_points_buffer_new.
+ */
+void                p8est_points_buffer_destroy (p8est_points_buffer_t *
+                                                 buffer);
+
 SC_EXTERN_C_END;
 
 #endif /* !P8EST_POINTS_H */
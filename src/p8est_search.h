@@ -44,6 +44,24 @@ ssize_t             p8est_find_higher_bound (sc_array_t * array,
                                              const p8est_quadrant_t * q,
                                              size_t guess);
 
+/** Find the lowest position tq in a key array such that tq >= key.
+ * This is the branch-free equivalent of p8est_find_lower_bound operating
+ * on Morton keys precomputed by p8est_quadrant_array_morton_keys.
+ * \return  Returns the id of the matching key
+ *                  or -1 if keys < key or the array is empty.
+ */
+ssize_t             p8est_find_lower_bound_key (const uint64_t * keys,
+                                                size_t count, uint64_t key);
+
+/** Find the highest position tq in a key array such that tq <= key.
+ * This is the branch-free equivalent of p8est_find_higher_bound operating
+ * on Morton keys precomputed by p8est_quadrant_array_morton_keys.
+ * \return  Returns the id of the matching key
+ *                  or -1 if keys > key or the array is empty.
+ */
+ssize_t             p8est_find_higher_bound_key (const uint64_t * keys,
+                                                 size_t count, uint64_t key);
+
 /** Given a sorted \a array of quadrants that have a common ancestor at level
  * \a level, compute the \a indices of the first quadrant in each of the common
  * ancestor's children at level \a level + 1;
@@ -129,6 +147,201 @@ void                p8est_search (p8est_t * p8est,
                                   p8est_search_query_t search_fn,
                                   sc_array_t * points);
 
+/** Callback function to query an octant during a hierarchical search.
+ *
+ * \param [in] p8est        The forest to be queried.
+ * \param [in] which_tree   The tree id under consideration.
+ * \param [in] quadrant     The octant under consideration.
+ *                          This octant may be coarser than the octants
+ *                          that are contained in the forest (an ancestor).
+ * \param [in] is_leaf      Specify if the octant is an ancestor or a leaf.
+ *                          When is_leaf is true, quadrant->p.piggy3.local_num
+ *                          contains the local index of the matched octant.
+ * \param [in] user_data    The pointer passed to p8est_search_quadrants.
+ * \return                  False to prune this branch of the implicit tree:
+ *                          neither the point callback nor deeper octants
+ *                          will be visited below it.  True to continue.
+ */
+typedef int         (*p8est_search_quadrant_t) (p8est_t * p8est,
+                                                p4est_topidx_t which_tree,
+                                                p8est_quadrant_t * quadrant,
+                                                int is_leaf,
+                                                void *user_data);
+
+/** Search the forest top-down with octant-driven pruning.
+ *
+ * The search descends the implicit tree from each local tree root just
+ * like p8est_search, but additionally queries \a quadrant_fn on every
+ * octant visited, before any points are examined.  Returning false from
+ * \a quadrant_fn prunes the entire branch, so geometric range queries
+ * cost on the order of the answer size times the depth instead of a scan
+ * over all local leaves.  The \a points array and \a point_fn may be NULL
+ * together, in which case the traversal is driven by \a quadrant_fn
+ * alone; otherwise points are filtered exactly as in p8est_search.
+ *
+ * \param [in] p8est        The forest to be searched.
+ * \param [in] quadrant_fn  Callback to prune branches; may be NULL, which
+ *                          is equivalent to always returning true.
+ * \param [in] point_fn     Function to return true for a possible match;
+ *                          must not be NULL if \a points is given.
+ * \param [in] points       User-defined array of "points"; may be NULL.
+ * \param [in] user_data    Arbitrary pointer passed to \a quadrant_fn.
+ */
+void                p8est_search_quadrants (p8est_t * p8est,
+                                            p8est_search_quadrant_t
+                                            quadrant_fn,
+                                            p8est_search_query_t point_fn,
+                                            sc_array_t * points,
+                                            void *user_data);
+
+/** Locate the owners of a batch of points in one sweep.
+ *
+ * Each point is a valid octant with its p.which_tree member set; the
+ * queried position is the point's first descendant, i.e. its lower left
+ * corner, so a smallest-level octant queries exactly one position.
+ * The points are sorted into partition order internally and then matched
+ * against the partition markers and the local octant arrays in a single
+ * co-ordered sweep, which amortizes the tree descent over neighboring
+ * queries instead of running one binary search per point.
+ * The input array is not modified and may be in any order.
+ *
+ * \param [in] p8est        The forest to be queried.
+ * \param [in] points       Array of p8est_quadrant_t queries as above.
+ * \param [out] owners      If not NULL, filled with the rank that owns
+ *                          each point, indexed like \a points.
+ * \param [out] local_ids   If not NULL, filled with the cumulative local
+ *                          index of the leaf containing each locally owned
+ *                          point, and -1 for points owned elsewhere.
+ */
+void                p8est_search_owners (p8est_t * p8est,
+                                         sc_array_t * points,
+                                         int *owners,
+                                         p4est_locidx_t * local_ids);
+
+/** Locate the owners of a batch of points across all processes.
+ *
+ * This function is collective over the forest's communicator.  Every
+ * process passes its own array of query octants, formatted exactly as
+ * for p8est_search_owners.  The owner rank of each query is determined
+ * locally from p8est->global_first_position; the queries are then routed
+ * directly to their owner ranks in one sparse exchange, where each owner
+ * resolves them against its local octant arrays and replies with the
+ * containing leaf's index.  No query data is replicated on all ranks, so
+ * the cost scales with the number of communicating pairs rather than
+ * with the process count.
+ *
+ * \param [in] p8est        The forest to be queried.
+ * \param [in] points       Array of p8est_quadrant_t queries as in
+ *                          p8est_search_owners; not modified.
+ * \param [out] owners      If not NULL, filled with the rank that owns
+ *                          each point, indexed like \a points.
+ * \param [out] remote_ids  Filled with the cumulative local index of the
+ *                          containing leaf on the owner rank, for every
+ *                          point.  Must not be NULL.
+ */
+void                p8est_search_owners_global (p8est_t * p8est,
+                                                sc_array_t * points,
+                                                int *owners,
+                                                p4est_locidx_t *
+                                                remote_ids);
+
+/** Callback function to visit one virtual interior node.
+ *
+ * \param [in] p8est        The forest being traversed.
+ * \param [in] which_tree   The tree id under consideration.
+ * \param [in] ancestor     The implied ancestor octant.  It is not
+ *                          stored in the forest, so its user data is
+ *                          invalid and the octant must be copied if
+ *                          it is needed after the callback returns.
+ * \param [in] first_leaf   Index into the tree's octant array of the
+ *                          first leaf below \a ancestor.
+ * \param [in] end_leaf     Index one beyond the last leaf below
+ *                          \a ancestor.
+ * \param [in] user_data    The pointer passed to the traversal.
+ */
+typedef void        (*p8est_interior_node_t) (p8est_t * p8est,
+                                              p4est_topidx_t which_tree,
+                                              p8est_quadrant_t * ancestor,
+                                              p4est_locidx_t first_leaf,
+                                              p4est_locidx_t end_leaf,
+                                              void *user_data);
+
+/** Visit the virtual interior nodes implied by the leaf arrays.
+ *
+ * Every ancestor of the local leaves is visited exactly once per tree,
+ * in post-order: an interior node is reported only after all leaves it
+ * contains have been passed, deepest nodes first.  This delivers the
+ * parent-child families needed for coarse-to-fine projections without
+ * any hashing; the traversal is a single linear sweep over each
+ * Morton-sorted octant array with one nearest_common_ancestor call
+ * per consecutive leaf pair.
+ * The leaf index range passed to the callback identifies exactly the
+ * descendants of the interior node in the tree's octant array.
+ *
+ * \param [in] p8est        The forest to be traversed.
+ * \param [in] node_fn      Callback executed for each interior node.
+ * \param [in] user_data    Arbitrary pointer passed to \a node_fn.
+ */
+void                p8est_interior_postorder (p8est_t * p8est,
+                                              p8est_interior_node_t node_fn,
+                                              void *user_data);
+
+/** A build-once index for repeated point location in a fixed forest.
+ * For every local tree it stores the Morton keys of the leaves and a
+ * flat table over the cells of a shallow uniform level, mapping the top
+ * bits of a position directly to the narrow range of leaves that can
+ * contain it.  The index is valid as long as the forest does not
+ * change; this is checked against the revision counter in debug mode.
+ */
+typedef struct p8est_search_index
+{
+  p4est_topidx_t      first_local_tree; /**< copied from the forest */
+  p4est_topidx_t      last_local_tree;  /**< copied from the forest */
+  long                revision; /**< forest revision at build time */
+  int                *tree_levels;      /**< bucket level per local tree */
+  p4est_locidx_t    **tree_tables;      /**< per tree 2^(dim*level) + 1
+                                             bucket start indices */
+  uint64_t          **tree_keys;        /**< per tree one key per leaf */
+}
+p8est_search_index_t;
+
+/** Build a point location index over the local leaves.
+ * One linear sweep per tree materializes the leaf keys and fills the
+ * bucket table; the bucket level is chosen per tree so that the table
+ * size stays proportional to the number of leaves.
+ * \param [in] p8est    The forest to be indexed; it must not be adapted
+ *                      or repartitioned while the index is in use.
+ * \return              The index, to be destroyed by the caller with
+ *                      p8est_search_index_destroy.
+ */
+p8est_search_index_t *p8est_search_index_new (p8est_t * p8est);
+
+/** Locate the local leaf containing a point.
+ * The query costs one table lookup plus a bounded search among the few
+ * leaves of one bucket, without any per-tree binary search; it is meant
+ * for locating many points against the same unchanged forest.
+ * The queried position is the point's first descendant, i.e. its lower
+ * left front corner, as in p8est_search_owners.
+ * \param [in] sindex      Index created from \a p8est by
+ *                         p8est_search_index_new.
+ * \param [in] p8est       The forest the index was built from.
+ * \param [in] which_tree  The tree the point refers to.
+ * \param [in] point       A valid octant marking the queried position.
+ * \return      The cumulative local index of the containing leaf, or -1
+ *              if the position is not owned by this processor.
+ */
+p4est_locidx_t      p8est_search_index_query (p8est_search_index_t * sindex,
+                                              p8est_t * p8est,
+                                              p4est_topidx_t which_tree,
+                                              const p8est_quadrant_t *
+                                              point);
+
+/** Destroy a point location index.
+ * \param [in] sindex   Index created by p8est_search_index_new.
+ */
+void                p8est_search_index_destroy (p8est_search_index_t *
+                                                sindex);
+
 SC_EXTERN_C_END;
 
 #endif
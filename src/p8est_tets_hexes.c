@@ -292,6 +292,210 @@ dead:
   return NULL;
 }
 
+/** Read a contiguous range of tetrahedra from a tetgen .ele file.
+ * Works like \ref p8est_tets_read_ele except that only the tets
+ * numbered [ first_tet, last_tet ) are stored; the preceding ones are
+ * skipped and the file is closed once the range has been read.
+ */
+static sc_array_t  *
+p8est_tets_read_ele_part (const char *elefilename, p4est_topidx_t num_nodes,
+                          long first_tet, long last_tet,
+                          sc_array_t ** attributes)
+{
+  int                 retval;
+  int                 k;
+  int                 nodespertet, region;
+  long                jl, lnum_tets, lmax_nodes;
+  long                nl[4];
+  size_t              iz, znum_part;
+  int                *pi;
+  p4est_topidx_t     *pt;
+  FILE               *elefile;
+  sc_array_t         *tets, *attr;
+
+  P4EST_ASSERT (0 <= first_tet && first_tet <= last_tet);
+
+  /* prepare cleanup on error */
+  elefile = NULL;
+  tets = NULL;
+  attr = NULL;
+  if (attributes != NULL) {
+    *attributes = NULL;
+  }
+  lmax_nodes = (num_nodes >= 0 ? (long) num_nodes : P4EST_TOPIDX_MAX);
+
+  /* open ele file */
+  elefile = fopen (elefilename, "rb");
+  if (elefile == NULL) {
+    P4EST_LERRORF ("Failed to open %s\n", elefilename);
+    goto dead;
+  }
+
+  /* read header information */
+  retval = fscanf (elefile, "%ld %d %d",
+                   &lnum_tets, &nodespertet, &region) - 3;
+  if (retval || lnum_tets < 0 || lnum_tets > P4EST_TOPIDX_MAX
+      || nodespertet != 4 || last_tet > lnum_tets) {
+    P4EST_LERROR ("Failed to read tet header\n");
+    goto dead;
+  }
+
+  /* skip the tets in front of the requested range */
+  for (jl = 0; jl < first_tet; ++jl) {
+    retval = fscanf (elefile, "%*d %*d %*d %*d %*d");
+    if (retval != 0) {
+      P4EST_LERRORF ("Failed to skip tet %ld\n", jl);
+      goto dead;
+    }
+    if (region) {
+      retval = fscanf (elefile, "%*d");
+      if (retval != 0) {
+        P4EST_LERRORF ("Failed to skip tet %ld region attribute\n", jl);
+        goto dead;
+      }
+    }
+  }
+
+  /* read the tets in the requested range */
+  znum_part = (size_t) (last_tet - first_tet);
+  tets = sc_array_new_size (sizeof (p4est_topidx_t), 4 * znum_part);
+  if (region && attributes != NULL) {
+    attr = *attributes = sc_array_new_size (sizeof (int), znum_part);
+  }
+  for (iz = 0; iz < znum_part; ++iz) {
+    pt = (p4est_topidx_t *) sc_array_index (tets, 4 * iz);
+    retval = fscanf (elefile, "%ld %ld %ld %ld %ld",
+                     &jl, nl, nl + 1, nl + 2, nl + 3) - 5;
+    if (retval || (long) iz + first_tet != jl) {
+      P4EST_LERRORF ("Failed to read tet %ld node numbers\n",
+                     (long) iz + first_tet);
+      goto dead;
+    }
+    for (k = 0; k < 4; ++k) {
+      if (nl[k] < 0 || nl[k] > lmax_nodes) {
+        P4EST_LERRORF ("Tet %ld has invalid node number %d\n",
+                       (long) iz + first_tet, k);
+        goto dead;
+      }
+      pt[k] = (p4est_topidx_t) nl[k];
+    }
+    if (region) {
+      if (attr != NULL) {
+        pi = (int *) sc_array_index (attr, iz);
+        retval = fscanf (elefile, "%d", pi) - 1;
+      }
+      else {
+        retval = fscanf (elefile, "%*d");
+      }
+      if (retval != 0) {
+        P4EST_LERRORF ("Failed to read tet %ld region attribute\n",
+                       (long) iz + first_tet);
+        goto dead;
+      }
+    }
+  }
+
+  /* close ele file without reading the remaining tets */
+  retval = fclose (elefile);
+  elefile = NULL;
+  if (retval) {
+    P4EST_LERRORF ("Failed to close %s\n", elefilename);
+    goto dead;
+  }
+  return tets;
+
+dead:
+  /* clean up on error */
+  if (elefile != NULL) {
+    fclose (elefile);
+  }
+  if (tets != NULL) {
+    sc_array_destroy (tets);
+  }
+  if (attr != NULL) {
+    sc_array_destroy (attr);
+    *attributes = NULL;
+  }
+  return NULL;
+}
+
+p8est_tets_t       *
+p8est_tets_read_part (const char *tetgenbasename, MPI_Comm mpicomm)
+{
+  int                 mpiret;
+  int                 num_procs, rank;
+  int                 retval;
+  long                lnum_tets;
+  p4est_topidx_t      num_nodes;
+  char                nodefilename[BUFSIZ];
+  char                elefilename[BUFSIZ];
+  FILE               *elefile;
+  sc_array_t         *nodes, *tets, *attr;
+  p8est_tets_t       *ptg;
+
+  mpiret = MPI_Comm_size (mpicomm, &num_procs);
+  SC_CHECK_MPI (mpiret);
+  mpiret = MPI_Comm_rank (mpicomm, &rank);
+  SC_CHECK_MPI (mpiret);
+
+  /* prepare cleanup */
+  nodes = tets = attr = NULL;
+  ptg = P4EST_ALLOC (p8est_tets_t, 1);
+
+  /* the nodes stay replicated since every rank interpolates from them */
+  snprintf (nodefilename, BUFSIZ, "%s.node", tetgenbasename);
+  nodes = ptg->nodes = p8est_tets_read_node (nodefilename);
+  if (nodes == NULL) {
+    P4EST_LERRORF ("Failed to read nodes for %s\n", tetgenbasename);
+    goto dead;
+  }
+  num_nodes = (p4est_topidx_t) (nodes->elem_count / 3);
+
+  /* read the tet count from the element header */
+  snprintf (elefilename, BUFSIZ, "%s.ele", tetgenbasename);
+  elefile = fopen (elefilename, "rb");
+  if (elefile == NULL) {
+    P4EST_LERRORF ("Failed to open %s\n", elefilename);
+    goto dead;
+  }
+  retval = fscanf (elefile, "%ld", &lnum_tets) - 1;
+  fclose (elefile);
+  if (retval || lnum_tets < 0 || lnum_tets > P4EST_TOPIDX_MAX) {
+    P4EST_LERROR ("Failed to read tet header\n");
+    goto dead;
+  }
+
+  /* read this rank's share of an equal split of the tets */
+  tets = ptg->tets =
+    p8est_tets_read_ele_part (elefilename, num_nodes,
+                              (lnum_tets * (long) rank) / num_procs,
+                              (lnum_tets * ((long) rank + 1)) / num_procs,
+                              &attr);
+  if (tets == NULL) {
+    P4EST_ASSERT (attr == NULL);
+    P4EST_LERRORF ("Failed to read tetrahedra for %s\n", tetgenbasename);
+    goto dead;
+  }
+  ptg->tet_attributes = attr;
+
+  /* we are successful */
+  return ptg;
+
+dead:
+  /* clean up on error */
+  if (nodes != NULL) {
+    sc_array_destroy (nodes);
+  }
+  if (tets != NULL) {
+    sc_array_destroy (tets);
+  }
+  if (attr != NULL) {
+    sc_array_destroy (attr);
+  }
+  P4EST_FREE (ptg);
+  return NULL;
+}
+
 void
 p8est_tets_destroy (p8est_tets_t * ptg)
 {
@@ -364,13 +568,13 @@ p8est_tets_make_righthanded (p8est_tets_t * ptg)
   return tnum_flips;
 }
 
-typedef struct p8est_tet_edge_info
+typedef struct p8est_tet_edge_rec
 {
   p4est_topidx_t      ek[2];
-  sc_array_t          tets;
-  sc_array_t          tet_edges;
+  p4est_topidx_t      tet;
+  int                 edge;
 }
-p8est_tet_edge_info_t;
+p8est_tet_edge_rec_t;
 
 /** Create unique edge key for a given edge of a tetrahedron.
  * \param [out] ek      The edge key consists of two node numbers.
@@ -389,80 +593,87 @@ p8est_tet_edge_key (p4est_topidx_t * ek, p4est_topidx_t * tet, int edge)
   p4est_topidx_bsort (ek, 2);
 }
 
-static unsigned
-p8est_tet_edge_hash (const void *v, const void *u)
-{
-  const p8est_tet_edge_info_t *ei = (p8est_tet_edge_info_t *) v;
-
-  return p4est_topidx_hash2 (ei->ek);
-}
-
 static int
-p8est_tet_edge_equal (const void *v1, const void *v2, const void *u)
+p8est_tet_edge_rec_compare (const void *v1, const void *v2)
 {
-  const p8est_tet_edge_info_t *ei1 = (p8est_tet_edge_info_t *) v1;
-  const p8est_tet_edge_info_t *ei2 = (p8est_tet_edge_info_t *) v2;
+  const p8est_tet_edge_rec_t *er1 = (p8est_tet_edge_rec_t *) v1;
+  const p8est_tet_edge_rec_t *er2 = (p8est_tet_edge_rec_t *) v2;
 
-  return !memcmp (ei1->ek, ei2->ek, 2 * sizeof (p4est_topidx_t));
+  if (er1->ek[0] != er2->ek[0]) {
+    return er1->ek[0] < er2->ek[0] ? -1 : 1;
+  }
+  if (er1->ek[1] != er2->ek[1]) {
+    return er1->ek[1] < er2->ek[1] ? -1 : 1;
+  }
+  /* break ties by traversal order so the representative is deterministic */
+  if (er1->tet != er2->tet) {
+    return er1->tet < er2->tet ? -1 : 1;
+  }
+  return er1->edge - er2->edge;
 }
 
-static sc_hash_array_t *
-p8est_tets_identify_edges (p8est_tets_t * ptg)
+/** Identify the unique edges of a tetrahedral mesh by sorting.
+ * All tet edges are expanded into key records and sorted, so that
+ * coincident edges form runs; both the expansion and the run scan are
+ * bulk passes over flat arrays instead of hash table operations.
+ * \param [in] ptg              Tetrahedral mesh with nodes and tets.
+ * \param [out] tet_edge_index  Array of 6 * num_tets entries mapping
+ *                              each (tet, edge) pair to its unique edge
+ *                              number; to be freed with P4EST_FREE.
+ * \return          Array of one representative record per unique edge.
+ */
+static sc_array_t  *
+p8est_tets_identify_edges (p8est_tets_t * ptg,
+                           p4est_topidx_t ** tet_edge_index)
 {
-  int                 edge, *pi;
-  size_t              iz, znum_tets, pz;
-  sc_hash_array_t    *edge_ha;
-  p4est_topidx_t     *tet, *pt;
-  p8est_tet_edge_info_t eikey, *ei;
-
-  /* create hash array for shared edges */
-  edge_ha = sc_hash_array_new (sizeof (p8est_tet_edge_info_t),
-                               p8est_tet_edge_hash, p8est_tet_edge_equal,
-                               NULL);
-
-  /* loop through all edges and identify edge-neighbor tet groups */
+  int                 edge;
+  size_t              iz, jz, znum_tets, znum_recs;
+  p4est_topidx_t     *tet, *teind, unique;
+  sc_array_t         *recs, *uniques;
+  p8est_tet_edge_rec_t *er, *eu;
+
+  /* expand all tetrahedron edges into sortable key records */
   znum_tets = ptg->tets->elem_count / 4;
+  znum_recs = 6 * znum_tets;
+  recs = sc_array_new_size (sizeof (p8est_tet_edge_rec_t), znum_recs);
   for (iz = 0; iz < znum_tets; ++iz) {
     tet = p8est_tets_tet_index (ptg, iz);
     for (edge = 0; edge < 6; ++edge) {
-      p8est_tet_edge_key (eikey.ek, tet, edge);
-      ei = (p8est_tet_edge_info_t *)
-        sc_hash_array_insert_unique (edge_ha, &eikey, &pz);
-      if (ei != NULL) {
-        /* added new edge group ei to hash array */
-        P4EST_ASSERT (sc_array_position (&edge_ha->a, ei) == pz);
-        memcpy (ei->ek, eikey.ek, 2 * sizeof (p4est_topidx_t));
-        sc_array_init (&ei->tets, sizeof (p4est_topidx_t));
-        pt = (p4est_topidx_t *) sc_array_push (&ei->tets);
-        *pt = (p4est_topidx_t) iz;
-        sc_array_init (&ei->tet_edges, sizeof (int));
-        pi = (int *) sc_array_push (&ei->tet_edges);
-        *pi = edge;
-      }
-      else {
-        /* found existing entry from earlier edge */
-        ei = (p8est_tet_edge_info_t *) sc_array_index (&edge_ha->a, pz);
-        P4EST_ASSERT (p8est_tet_edge_equal (ei->ek, eikey.ek, NULL));
-        P4EST_ASSERT (ei->tets.elem_count > 0);
-        pt = (p4est_topidx_t *) sc_array_push (&ei->tets);
-        *pt = (p4est_topidx_t) iz;
-        P4EST_ASSERT (ei->tet_edges.elem_count > 0);
-        pi = (int *) sc_array_push (&ei->tet_edges);
-        *pi = edge;
-      }
+      er = (p8est_tet_edge_rec_t *) sc_array_index (recs, 6 * iz + edge);
+      p8est_tet_edge_key (er->ek, tet, edge);
+      er->tet = (p4est_topidx_t) iz;
+      er->edge = edge;
+    }
+  }
+  sc_array_sort (recs, p8est_tet_edge_rec_compare);
+
+  /* scan runs of equal keys and assign unique edge numbers */
+  teind = *tet_edge_index = P4EST_ALLOC (p4est_topidx_t, znum_recs);
+  uniques = sc_array_new (sizeof (p8est_tet_edge_rec_t));
+  eu = NULL;
+  unique = -1;
+  for (jz = 0; jz < znum_recs; ++jz) {
+    er = (p8est_tet_edge_rec_t *) sc_array_index (recs, jz);
+    if (eu == NULL || memcmp (eu->ek, er->ek, 2 * sizeof (p4est_topidx_t))) {
+      eu = (p8est_tet_edge_rec_t *) sc_array_push (uniques);
+      memcpy (eu, er, sizeof (p8est_tet_edge_rec_t));
+      ++unique;
     }
+    teind[6 * (size_t) er->tet + er->edge] = unique;
   }
+  P4EST_ASSERT ((size_t) (unique + 1) == uniques->elem_count);
+  sc_array_destroy (recs);
 
-  return edge_ha;
+  return uniques;
 }
 
-typedef struct p8est_tet_face_info
+typedef struct p8est_tet_face_rec
 {
   p4est_topidx_t      fk[3];
-  p4est_topidx_t      tets[2];
-  int                 tet_faces[2];
+  p4est_topidx_t      tet;
+  int                 face;
 }
-p8est_tet_face_info_t;
+p8est_tet_face_rec_t;
 
 /** Create unique face key for a given face of a tetrahedron.
  * \param [out] fk      The face key consists of three node numbers.
@@ -482,92 +693,103 @@ p8est_tet_face_key (p4est_topidx_t * fk, p4est_topidx_t * tet, int face)
   p4est_topidx_bsort (fk, 3);
 }
 
-static unsigned
-p8est_tet_face_hash (const void *v, const void *u)
-{
-  const p8est_tet_face_info_t *fi = (p8est_tet_face_info_t *) v;
-
-  return p4est_topidx_hash3 (fi->fk);
-}
-
 static int
-p8est_tet_face_equal (const void *v1, const void *v2, const void *u)
+p8est_tet_face_rec_compare (const void *v1, const void *v2)
 {
-  const p8est_tet_face_info_t *fi1 = (p8est_tet_face_info_t *) v1;
-  const p8est_tet_face_info_t *fi2 = (p8est_tet_face_info_t *) v2;
+  const p8est_tet_face_rec_t *fr1 = (p8est_tet_face_rec_t *) v1;
+  const p8est_tet_face_rec_t *fr2 = (p8est_tet_face_rec_t *) v2;
+  int                 k;
 
-  return !memcmp (fi1->fk, fi2->fk, 3 * sizeof (p4est_topidx_t));
+  for (k = 0; k < 3; ++k) {
+    if (fr1->fk[k] != fr2->fk[k]) {
+      return fr1->fk[k] < fr2->fk[k] ? -1 : 1;
+    }
+  }
+  /* break ties by traversal order so the representative is deterministic */
+  if (fr1->tet != fr2->tet) {
+    return fr1->tet < fr2->tet ? -1 : 1;
+  }
+  return fr1->face - fr2->face;
 }
 
-static sc_hash_array_t *
-p8est_tets_identify_faces (p8est_tets_t * ptg)
+/** Identify the unique faces of a tetrahedral mesh by sorting.
+ * This works just like \ref p8est_tets_identify_edges for face keys.
+ * \param [in] ptg              Tetrahedral mesh with nodes and tets.
+ * \param [out] tet_face_index  Array of 4 * num_tets entries mapping
+ *                              each (tet, face) pair to its unique face
+ *                              number; to be freed with P4EST_FREE.
+ * \return          Array of one representative record per unique face.
+ */
+static sc_array_t  *
+p8est_tets_identify_faces (p8est_tets_t * ptg,
+                           p4est_topidx_t ** tet_face_index)
 {
   int                 face;
-  size_t              iz, znum_tets, pz;
-  sc_hash_array_t    *face_ha;
-  p4est_topidx_t     *tet;
-  p8est_tet_face_info_t fikey, *fi;
+  size_t              iz, jz, znum_tets, znum_recs;
+  p4est_topidx_t     *tet, *tfind, unique;
+  sc_array_t         *recs, *uniques;
+  p8est_tet_face_rec_t *fr, *fu;
 
-  /* create hash array for shared faces */
-  face_ha = sc_hash_array_new (sizeof (p8est_tet_face_info_t),
-                               p8est_tet_face_hash, p8est_tet_face_equal,
-                               NULL);
-
-  /* loop through all faces and identify face-neighbor tet pairs */
+  /* expand all tetrahedron faces into sortable key records */
   znum_tets = ptg->tets->elem_count / 4;
+  znum_recs = 4 * znum_tets;
+  recs = sc_array_new_size (sizeof (p8est_tet_face_rec_t), znum_recs);
   for (iz = 0; iz < znum_tets; ++iz) {
     tet = p8est_tets_tet_index (ptg, iz);
     for (face = 0; face < 4; ++face) {
-      p8est_tet_face_key (fikey.fk, tet, face);
-      fi = (p8est_tet_face_info_t *)
-        sc_hash_array_insert_unique (face_ha, &fikey, &pz);
-      if (fi != NULL) {
-        /* added fi to hash array as the first of two tets */
-        P4EST_ASSERT (sc_array_position (&face_ha->a, fi) == pz);
-        memcpy (fi->fk, fikey.fk, 3 * sizeof (p4est_topidx_t));
-        fi->tets[0] = (p4est_topidx_t) iz;
-        fi->tets[1] = -1;
-        fi->tet_faces[0] = face;
-        fi->tet_faces[1] = -1;
-      }
-      else {
-        /* found existing entry from the first face */
-        fi = (p8est_tet_face_info_t *) sc_array_index (&face_ha->a, pz);
-        P4EST_ASSERT (p8est_tet_face_equal (fi->fk, fikey.fk, NULL));
-        P4EST_ASSERT (fi->tets[0] >= 0 && fi->tet_faces[0] >= 0);
-        P4EST_ASSERT (fi->tets[1] == -1 && fi->tet_faces[1] == -1);
-        fi->tets[1] = (p4est_topidx_t) iz;
-        fi->tet_faces[1] = face;
-      }
+      fr = (p8est_tet_face_rec_t *) sc_array_index (recs, 4 * iz + face);
+      p8est_tet_face_key (fr->fk, tet, face);
+      fr->tet = (p4est_topidx_t) iz;
+      fr->face = face;
     }
   }
+  sc_array_sort (recs, p8est_tet_face_rec_compare);
+
+  /* scan runs of equal keys and assign unique face numbers */
+  tfind = *tet_face_index = P4EST_ALLOC (p4est_topidx_t, znum_recs);
+  uniques = sc_array_new (sizeof (p8est_tet_face_rec_t));
+  fu = NULL;
+  unique = -1;
+  for (jz = 0; jz < znum_recs; ++jz) {
+    fr = (p8est_tet_face_rec_t *) sc_array_index (recs, jz);
+    if (fu == NULL || memcmp (fu->fk, fr->fk, 3 * sizeof (p4est_topidx_t))) {
+      fu = (p8est_tet_face_rec_t *) sc_array_push (uniques);
+      memcpy (fu, fr, sizeof (p8est_tet_face_rec_t));
+      ++unique;
+    }
+    tfind[4 * (size_t) fr->tet + fr->face] = unique;
+  }
+  P4EST_ASSERT ((size_t) (unique + 1) == uniques->elem_count);
+  sc_array_destroy (recs);
 
-  return face_ha;
+  return uniques;
 }
 
 /** Create a connectivity where the trees are not connected to each other. */
 static p8est_connectivity_t *
 p8est_tets_connectivity_new (p8est_tets_t * ptg,
-                             sc_hash_array_t * edge_ha,
-                             sc_hash_array_t * face_ha)
+                             sc_array_t * edge_uniques,
+                             const p4est_topidx_t * tet_edge_index,
+                             sc_array_t * face_uniques,
+                             const p4est_topidx_t * tet_face_index)
 {
   int                 j, k;
-  int                 edge, face, found;
+  int                 edge, face;
   size_t              nvz, evzoffset, fvzoffset, vvzoffset;
-  size_t              iz, pz;
+  size_t              iz;
   double             *vp, *n[4];
   int8_t             *ttf;
   p4est_topidx_t      tt, *tet, node;
   p4est_topidx_t     *ttv, *ttt;
   p4est_topidx_t      nid[15];
   p8est_connectivity_t *conn;
-  p8est_tet_edge_info_t *ei, eikey;
-  p8est_tet_face_info_t *fi, fikey;
+  p8est_tet_edge_rec_t *er;
+  p8est_tet_face_rec_t *fr;
 
   /* arrange vertices by tet corners, edges, faces, and volumes */
   evzoffset = ptg->nodes->elem_count / 3;
-  fvzoffset = evzoffset + edge_ha->a.elem_count;
-  vvzoffset = fvzoffset + face_ha->a.elem_count;
+  fvzoffset = evzoffset + edge_uniques->elem_count;
+  vvzoffset = fvzoffset + face_uniques->elem_count;
   nvz = vvzoffset + ptg->tets->elem_count / 4;
 
   /* allocate connectivity */
@@ -576,11 +798,10 @@ p8est_tets_connectivity_new (p8est_tets_t * ptg,
   /* populate vertices */
   memcpy (conn->vertices, ptg->nodes->array, 3 * evzoffset * sizeof (double));
   vp = conn->vertices + 3 * evzoffset;
-  for (iz = 0; iz < edge_ha->a.elem_count; ++iz) {
-    ei = (p8est_tet_edge_info_t *) sc_array_index (&edge_ha->a, iz);
-    tt = *((p4est_topidx_t *) sc_array_index (&ei->tets, 0));
-    edge = *((int *) sc_array_index (&ei->tet_edges, 0));
-    tet = p8est_tets_tet_index (ptg, tt);
+  for (iz = 0; iz < edge_uniques->elem_count; ++iz) {
+    er = (p8est_tet_edge_rec_t *) sc_array_index (edge_uniques, iz);
+    edge = er->edge;
+    tet = p8est_tets_tet_index (ptg, er->tet);
     for (j = 0; j < 2; ++j) {
       node = tet[p8est_tet_edge_corners[edge][j]];
       n[j] = p8est_tets_node_index (ptg, node);
@@ -590,11 +811,10 @@ p8est_tets_connectivity_new (p8est_tets_t * ptg,
     vp[2] = .5 * (n[0][2] + n[1][2]);
     vp += 3;
   }
-  for (iz = 0; iz < face_ha->a.elem_count; ++iz) {
-    fi = (p8est_tet_face_info_t *) sc_array_index (&face_ha->a, iz);
-    tt = fi->tets[0];
-    face = fi->tet_faces[0];
-    tet = p8est_tets_tet_index (ptg, tt);
+  for (iz = 0; iz < face_uniques->elem_count; ++iz) {
+    fr = (p8est_tet_face_rec_t *) sc_array_index (face_uniques, iz);
+    face = fr->face;
+    tet = p8est_tets_tet_index (ptg, fr->tet);
     for (j = 0; j < 3; ++j) {
       node = tet[p8est_tet_face_corners[face][j]];
       n[j] = p8est_tets_node_index (ptg, node);
@@ -625,16 +845,12 @@ p8est_tets_connectivity_new (p8est_tets_t * ptg,
       nid[j] = tet[j];
     }
     for (edge = 0; edge < 6; ++edge) {
-      p8est_tet_edge_key (eikey.ek, tet, edge);
-      found = sc_hash_array_lookup (edge_ha, &eikey, &pz);
-      P4EST_ASSERT (found);
-      nid[4 + edge] = (p4est_topidx_t) (evzoffset + pz);
+      nid[4 + edge] =
+        (p4est_topidx_t) evzoffset + tet_edge_index[6 * iz + edge];
     }
     for (face = 0; face < 4; ++face) {
-      p8est_tet_face_key (fikey.fk, tet, face);
-      found = sc_hash_array_lookup (face_ha, &fikey, &pz);
-      P4EST_ASSERT (found);
-      nid[10 + face] = (p4est_topidx_t) (fvzoffset + pz);
+      nid[10 + face] =
+        (p4est_topidx_t) fvzoffset + tet_face_index[4 * iz + face];
     }
     nid[14] = (p4est_topidx_t) (vvzoffset + iz);
 
@@ -666,37 +882,31 @@ p8est_connectivity_new_tets (p8est_tets_t * ptg)
 {
   int                *pint, i;
   int8_t              attr;
-  size_t              ez, znum_edges;
   size_t              tz, znum_tets;
-  sc_hash_array_t    *edge_ha, *face_ha;
-  sc_array_t          edge_array;
-  p8est_tet_edge_info_t *ei;
+  p4est_topidx_t     *tet_edge_index, *tet_face_index;
+  sc_array_t         *edge_uniques, *face_uniques;
   p8est_connectivity_t *conn;
 
   /* identify unique edges and faces */
-  edge_ha = p8est_tets_identify_edges (ptg);
+  edge_uniques = p8est_tets_identify_edges (ptg, &tet_edge_index);
   P4EST_GLOBAL_LDEBUGF ("Added %ld unique tetrahedron edges\n",
-                        (long) edge_ha->a.elem_count);
+                        (long) edge_uniques->elem_count);
 
-  face_ha = p8est_tets_identify_faces (ptg);
+  face_uniques = p8est_tets_identify_faces (ptg, &tet_face_index);
   P4EST_GLOBAL_LDEBUGF ("Added %ld unique tetrahedron faces\n",
-                        (long) face_ha->a.elem_count);
+                        (long) face_uniques->elem_count);
 
   /* add vertex information to connectivity */
-  conn = p8est_tets_connectivity_new (ptg, edge_ha, face_ha);
+  conn = p8est_tets_connectivity_new (ptg, edge_uniques, tet_edge_index,
+                                      face_uniques, tet_face_index);
   P4EST_GLOBAL_LDEBUGF ("Connectivity has %ld vertices and %ld trees\n",
                         (long) conn->num_vertices, (long) conn->num_trees);
 
   /* clean unique edges and faces */
-  sc_hash_array_rip (edge_ha, &edge_array);
-  znum_edges = edge_array.elem_count;
-  for (ez = 0; ez < znum_edges; ++ez) {
-    ei = (p8est_tet_edge_info_t *) sc_array_index (&edge_array, ez);
-    sc_array_reset (&ei->tets);
-    sc_array_reset (&ei->tet_edges);
-  }
-  sc_array_reset (&edge_array);
-  sc_hash_array_destroy (face_ha);
+  sc_array_destroy (edge_uniques);
+  sc_array_destroy (face_uniques);
+  P4EST_FREE (tet_edge_index);
+  P4EST_FREE (tet_face_index);
 
   /* transfer tree tags */
   if (ptg->tet_attributes != NULL) {
@@ -719,3 +929,405 @@ p8est_connectivity_new_tets (p8est_tets_t * ptg)
 
   return conn;
 }
+
+/** Assign global numbers to unique keys of a distributed record set.
+ * Each record starts with key_count sorted p4est_topidx_t node numbers
+ * followed by arbitrary payload.  The owner of a key is determined by
+ * an equal split of the node number range, which is monotone in the
+ * leading key entry, so sorting the records also groups them by owner.
+ * Records with equal keys receive one global number that counts the
+ * unique keys in owner-major, key-sorted order.
+ * \param [in,out] recs Local records; sorted by \b compar on output.
+ * \param [in] key_count        Number of leading key entries, 2 or 3.
+ * \param [in] num_nodes        Global number of mesh nodes.
+ * \param [in] compar   Orders records by their key lexicographically.
+ * \param [in] mpicomm  Communicator over which the keys are shared.
+ * \param [out] owned_uniques   One representative record for each
+ *                      unique key owned by this rank, in key order;
+ *                      to be destroyed by the caller.
+ * \param [out] counts_per_rank Number of uniques owned by each rank;
+ *                      to be freed with P4EST_FREE.
+ * \return              Array of one global number per record in recs,
+ *                      aligned with the sorted order; P4EST_FREE it.
+ */
+static p4est_topidx_t *
+p8est_tets_exchange_uniques (sc_array_t * recs, size_t key_count,
+                             p4est_topidx_t num_nodes,
+                             int (*compar) (const void *, const void *),
+                             MPI_Comm mpicomm, sc_array_t ** owned_uniques,
+                             p4est_topidx_t ** counts_per_rank)
+{
+  int                 mpiret;
+  int                 num_procs, r;
+  int                *scnts, *sdispls, *rcnts, *rdispls;
+  int                 rank;
+  size_t              ez, esize, kbytes;
+  size_t              zz, znum_recs, znum_recv;
+  char               *crecv, *cthis, *cprev;
+  p4est_topidx_t      unique, uoffset, *pcounts;
+  p4est_topidx_t     *rnumbers, *numbers;
+  sc_array_t         *uniques;
+
+  mpiret = MPI_Comm_size (mpicomm, &num_procs);
+  SC_CHECK_MPI (mpiret);
+  mpiret = MPI_Comm_rank (mpicomm, &rank);
+  SC_CHECK_MPI (mpiret);
+  esize = recs->elem_size;
+  kbytes = key_count * sizeof (p4est_topidx_t);
+  znum_recs = recs->elem_count;
+  P4EST_ASSERT (znum_recs == 0 || num_nodes > 0);
+
+  /* sorting by key also sorts by the owner of the key */
+  sc_array_sort (recs, compar);
+  scnts = P4EST_ALLOC_ZERO (int, num_procs);
+  sdispls = P4EST_ALLOC (int, num_procs);
+  rcnts = P4EST_ALLOC (int, num_procs);
+  rdispls = P4EST_ALLOC (int, num_procs);
+  for (zz = 0; zz < znum_recs; ++zz) {
+    r = (int) ((*(p4est_topidx_t *) sc_array_index (recs, zz) *
+                (long long) num_procs) / num_nodes);
+    P4EST_ASSERT (0 <= r && r < num_procs);
+    ++scnts[r];
+  }
+  mpiret = MPI_Alltoall (scnts, 1, MPI_INT, rcnts, 1, MPI_INT, mpicomm);
+  SC_CHECK_MPI (mpiret);
+  znum_recv = 0;
+  for (r = 0; r < num_procs; ++r) {
+    sdispls[r] = (r == 0) ? 0 : sdispls[r - 1] + scnts[r - 1];
+    rdispls[r] = (int) znum_recv;
+    znum_recv += (size_t) rcnts[r];
+  }
+
+  /* move every record to the rank that owns its key */
+  for (r = 0; r < num_procs; ++r) {
+    scnts[r] *= (int) esize;
+    sdispls[r] *= (int) esize;
+    rcnts[r] *= (int) esize;
+    rdispls[r] *= (int) esize;
+  }
+  crecv = P4EST_ALLOC (char, znum_recv * esize);
+  mpiret = MPI_Alltoallv (recs->array, scnts, sdispls, MPI_BYTE,
+                          crecv, rcnts, rdispls, MPI_BYTE, mpicomm);
+  SC_CHECK_MPI (mpiret);
+
+  /* scan runs of equal keys and assign local unique numbers */
+  qsort (crecv, znum_recv, esize, compar);
+  uniques = *owned_uniques = sc_array_new (esize);
+  rnumbers = P4EST_ALLOC (p4est_topidx_t, znum_recv);
+  cprev = NULL;
+  unique = -1;
+  for (ez = 0; ez < znum_recv; ++ez) {
+    cthis = crecv + ez * esize;
+    if (cprev == NULL || memcmp (cprev, cthis, kbytes)) {
+      cprev = (char *) sc_array_push (uniques);
+      memcpy (cprev, cthis, esize);
+      ++unique;
+    }
+    rnumbers[ez] = unique;
+  }
+  P4EST_ASSERT ((size_t) (unique + 1) == uniques->elem_count);
+
+  /* shift the local numbers by the unique counts of lower ranks */
+  pcounts = *counts_per_rank = P4EST_ALLOC (p4est_topidx_t, num_procs);
+  unique = (p4est_topidx_t) uniques->elem_count;
+  mpiret = MPI_Allgather (&unique, 1, P4EST_MPI_TOPIDX,
+                          pcounts, 1, P4EST_MPI_TOPIDX, mpicomm);
+  SC_CHECK_MPI (mpiret);
+  uoffset = 0;
+  for (r = 0; r < rank; ++r) {
+    uoffset += pcounts[r];
+  }
+  for (ez = 0; ez < znum_recv; ++ez) {
+    rnumbers[ez] += uoffset;
+  }
+  P4EST_FREE (crecv);
+
+  /* return the global numbers to the ranks that sent the records */
+  for (r = 0; r < num_procs; ++r) {
+    scnts[r] = (int) ((scnts[r] / esize) * sizeof (p4est_topidx_t));
+    sdispls[r] = (int) ((sdispls[r] / esize) * sizeof (p4est_topidx_t));
+    rcnts[r] = (int) ((rcnts[r] / esize) * sizeof (p4est_topidx_t));
+    rdispls[r] = (int) ((rdispls[r] / esize) * sizeof (p4est_topidx_t));
+  }
+  numbers = P4EST_ALLOC (p4est_topidx_t, znum_recs);
+  mpiret = MPI_Alltoallv (rnumbers, rcnts, rdispls, MPI_BYTE,
+                          numbers, scnts, sdispls, MPI_BYTE, mpicomm);
+  SC_CHECK_MPI (mpiret);
+  P4EST_FREE (rnumbers);
+  P4EST_FREE (scnts);
+  P4EST_FREE (sdispls);
+  P4EST_FREE (rcnts);
+  P4EST_FREE (rdispls);
+
+  return numbers;
+}
+
+p8est_connectivity_t *
+p8est_connectivity_new_tets_part (p8est_tets_t * ptg, MPI_Comm mpicomm)
+{
+  int                 mpiret;
+  int                 num_procs, rank, r;
+  int                 i, j, k, edge, face, has_attr;
+  int                *pint, *gcnts, *gdispls;
+  int8_t             *attr8, *ttf;
+  size_t              iz, zz, znum_tets;
+  double             *vp, *n[4], *ecoord, *fcoord, *vcoord;
+  p4est_topidx_t      num_nodes, num_gtets, tet_goffset, tt;
+  p4est_topidx_t      unique, num_gedges, num_gfaces;
+  p4est_topidx_t      evzoffset, fvzoffset, vvzoffset;
+  p4est_topidx_t     *tet, *ttv, *ttt, *ltv;
+  p4est_topidx_t     *tcounts, *ecounts, *fcounts;
+  p4est_topidx_t     *enumbers, *fnumbers;
+  p4est_topidx_t     *teind, *tfind;
+  p4est_topidx_t      nid[15];
+  sc_array_t         *erecs, *frecs, *euniques, *funiques;
+  p8est_tet_edge_rec_t *er;
+  p8est_tet_face_rec_t *fr;
+  p8est_connectivity_t *conn;
+
+  mpiret = MPI_Comm_size (mpicomm, &num_procs);
+  SC_CHECK_MPI (mpiret);
+  mpiret = MPI_Comm_rank (mpicomm, &rank);
+  SC_CHECK_MPI (mpiret);
+  num_nodes = (p4est_topidx_t) (ptg->nodes->elem_count / 3);
+  znum_tets = ptg->tets->elem_count / 4;
+
+  /* establish the global tet numbering from the local counts */
+  tcounts = P4EST_ALLOC (p4est_topidx_t, num_procs);
+  unique = (p4est_topidx_t) znum_tets;
+  mpiret = MPI_Allgather (&unique, 1, P4EST_MPI_TOPIDX,
+                          tcounts, 1, P4EST_MPI_TOPIDX, mpicomm);
+  SC_CHECK_MPI (mpiret);
+  tet_goffset = num_gtets = 0;
+  for (r = 0; r < num_procs; ++r) {
+    if (r == rank) {
+      tet_goffset = num_gtets;
+    }
+    num_gtets += tcounts[r];
+  }
+
+  /* number the unique edges and faces across all ranks */
+  erecs = sc_array_new_size (sizeof (p8est_tet_edge_rec_t), 6 * znum_tets);
+  frecs = sc_array_new_size (sizeof (p8est_tet_face_rec_t), 4 * znum_tets);
+  for (iz = 0; iz < znum_tets; ++iz) {
+    tet = p8est_tets_tet_index (ptg, iz);
+    for (edge = 0; edge < 6; ++edge) {
+      er = (p8est_tet_edge_rec_t *) sc_array_index (erecs, 6 * iz + edge);
+      p8est_tet_edge_key (er->ek, tet, edge);
+      er->tet = tet_goffset + (p4est_topidx_t) iz;
+      er->edge = edge;
+    }
+    for (face = 0; face < 4; ++face) {
+      fr = (p8est_tet_face_rec_t *) sc_array_index (frecs, 4 * iz + face);
+      p8est_tet_face_key (fr->fk, tet, face);
+      fr->tet = tet_goffset + (p4est_topidx_t) iz;
+      fr->face = face;
+    }
+  }
+  enumbers = p8est_tets_exchange_uniques (erecs, 2, num_nodes,
+                                          p8est_tet_edge_rec_compare,
+                                          mpicomm, &euniques, &ecounts);
+  fnumbers = p8est_tets_exchange_uniques (frecs, 3, num_nodes,
+                                          p8est_tet_face_rec_compare,
+                                          mpicomm, &funiques, &fcounts);
+  num_gedges = num_gfaces = 0;
+  for (r = 0; r < num_procs; ++r) {
+    num_gedges += ecounts[r];
+    num_gfaces += fcounts[r];
+  }
+  P4EST_GLOBAL_LDEBUGF ("Added %ld unique tetrahedron edges\n",
+                        (long) num_gedges);
+  P4EST_GLOBAL_LDEBUGF ("Added %ld unique tetrahedron faces\n",
+                        (long) num_gfaces);
+
+  /* arrange vertices by tet corners, edges, faces, and volumes */
+  evzoffset = num_nodes;
+  fvzoffset = evzoffset + num_gedges;
+  vvzoffset = fvzoffset + num_gfaces;
+  conn = p8est_connectivity_new (vvzoffset + num_gtets, 4 * num_gtets,
+                                 0, 0, 0, 0);
+
+  /* the corner vertices are the replicated mesh nodes */
+  memcpy (conn->vertices, ptg->nodes->array,
+          3 * (size_t) num_nodes * sizeof (double));
+
+  /* compute the coordinates of the owned edge and face vertices */
+  gcnts = P4EST_ALLOC (int, num_procs);
+  gdispls = P4EST_ALLOC (int, num_procs + 1);
+  ecoord = P4EST_ALLOC (double, 3 * euniques->elem_count);
+  vp = ecoord;
+  for (zz = 0; zz < euniques->elem_count; ++zz) {
+    er = (p8est_tet_edge_rec_t *) sc_array_index (euniques, zz);
+    for (j = 0; j < 2; ++j) {
+      n[j] = p8est_tets_node_index (ptg, er->ek[j]);
+    }
+    vp[0] = .5 * (n[0][0] + n[1][0]);
+    vp[1] = .5 * (n[0][1] + n[1][1]);
+    vp[2] = .5 * (n[0][2] + n[1][2]);
+    vp += 3;
+  }
+  gdispls[0] = 0;
+  for (r = 0; r < num_procs; ++r) {
+    gcnts[r] = (int) (3 * ecounts[r]);
+    gdispls[r + 1] = gdispls[r] + gcnts[r];
+  }
+  mpiret = MPI_Allgatherv (ecoord, (int) (3 * euniques->elem_count),
+                           MPI_DOUBLE, conn->vertices + 3 * evzoffset,
+                           gcnts, gdispls, MPI_DOUBLE, mpicomm);
+  SC_CHECK_MPI (mpiret);
+  P4EST_FREE (ecoord);
+  fcoord = P4EST_ALLOC (double, 3 * funiques->elem_count);
+  vp = fcoord;
+  for (zz = 0; zz < funiques->elem_count; ++zz) {
+    fr = (p8est_tet_face_rec_t *) sc_array_index (funiques, zz);
+    for (j = 0; j < 3; ++j) {
+      n[j] = p8est_tets_node_index (ptg, fr->fk[j]);
+    }
+    vp[0] = (1. / 3.) * (n[0][0] + n[1][0] + n[2][0]);
+    vp[1] = (1. / 3.) * (n[0][1] + n[1][1] + n[2][1]);
+    vp[2] = (1. / 3.) * (n[0][2] + n[1][2] + n[2][2]);
+    vp += 3;
+  }
+  gdispls[0] = 0;
+  for (r = 0; r < num_procs; ++r) {
+    gcnts[r] = (int) (3 * fcounts[r]);
+    gdispls[r + 1] = gdispls[r] + gcnts[r];
+  }
+  mpiret = MPI_Allgatherv (fcoord, (int) (3 * funiques->elem_count),
+                           MPI_DOUBLE, conn->vertices + 3 * fvzoffset,
+                           gcnts, gdispls, MPI_DOUBLE, mpicomm);
+  SC_CHECK_MPI (mpiret);
+  P4EST_FREE (fcoord);
+  sc_array_destroy (euniques);
+  sc_array_destroy (funiques);
+
+  /* compute the coordinates of the local volume vertices */
+  vcoord = P4EST_ALLOC (double, 3 * znum_tets);
+  vp = vcoord;
+  for (iz = 0; iz < znum_tets; ++iz) {
+    tet = p8est_tets_tet_index (ptg, iz);
+    for (j = 0; j < 4; ++j) {
+      n[j] = p8est_tets_node_index (ptg, tet[j]);
+    }
+    vp[0] = .25 * (n[0][0] + n[1][0] + n[2][0] + n[3][0]);
+    vp[1] = .25 * (n[0][1] + n[1][1] + n[2][1] + n[3][1]);
+    vp[2] = .25 * (n[0][2] + n[1][2] + n[2][2] + n[3][2]);
+    vp += 3;
+  }
+  gdispls[0] = 0;
+  for (r = 0; r < num_procs; ++r) {
+    gcnts[r] = (int) (3 * tcounts[r]);
+    gdispls[r + 1] = gdispls[r] + gcnts[r];
+  }
+  mpiret = MPI_Allgatherv (vcoord, (int) (3 * znum_tets), MPI_DOUBLE,
+                           conn->vertices + 3 * vvzoffset,
+                           gcnts, gdispls, MPI_DOUBLE, mpicomm);
+  SC_CHECK_MPI (mpiret);
+  P4EST_FREE (vcoord);
+
+  /* scatter the returned global numbers into per-tet index maps */
+  teind = P4EST_ALLOC (p4est_topidx_t, 6 * znum_tets);
+  for (zz = 0; zz < erecs->elem_count; ++zz) {
+    er = (p8est_tet_edge_rec_t *) sc_array_index (erecs, zz);
+    teind[6 * (size_t) (er->tet - tet_goffset) + er->edge] = enumbers[zz];
+  }
+  sc_array_destroy (erecs);
+  P4EST_FREE (enumbers);
+  tfind = P4EST_ALLOC (p4est_topidx_t, 4 * znum_tets);
+  for (zz = 0; zz < frecs->elem_count; ++zz) {
+    fr = (p8est_tet_face_rec_t *) sc_array_index (frecs, zz);
+    tfind[4 * (size_t) (fr->tet - tet_goffset) + fr->face] = fnumbers[zz];
+  }
+  sc_array_destroy (frecs);
+  P4EST_FREE (fnumbers);
+
+  /* associate the local share of forest trees with vertices */
+  ltv = P4EST_ALLOC (p4est_topidx_t, 32 * znum_tets);
+  ttv = ltv;
+  for (iz = 0; iz < znum_tets; ++iz) {
+    tet = p8est_tets_tet_index (ptg, iz);
+
+    /* look up node numbers for all vertices in this tetrahedron */
+    for (j = 0; j < 4; ++j) {
+      nid[j] = tet[j];
+    }
+    for (edge = 0; edge < 6; ++edge) {
+      nid[4 + edge] = evzoffset + teind[6 * iz + edge];
+    }
+    for (face = 0; face < 4; ++face) {
+      nid[10 + face] = fvzoffset + tfind[4 * iz + face];
+    }
+    nid[14] = vvzoffset + tet_goffset + (p4est_topidx_t) iz;
+
+    /* create four trees from this tetrahedron */
+    for (j = 0; j < 4; ++j) {
+      for (k = 0; k < P8EST_CHILDREN; ++k) {
+        *ttv++ = nid[p8est_tet_tree_nodes[j][k]];
+      }
+    }
+  }
+  P4EST_FREE (teind);
+  P4EST_FREE (tfind);
+  gdispls[0] = 0;
+  for (r = 0; r < num_procs; ++r) {
+    gcnts[r] = (int) (32 * tcounts[r]);
+    gdispls[r + 1] = gdispls[r] + gcnts[r];
+  }
+  mpiret = MPI_Allgatherv (ltv, (int) (32 * znum_tets), P4EST_MPI_TOPIDX,
+                           conn->tree_to_vertex, gcnts, gdispls,
+                           P4EST_MPI_TOPIDX, mpicomm);
+  SC_CHECK_MPI (mpiret);
+  P4EST_FREE (ltv);
+  P4EST_GLOBAL_LDEBUGF ("Connectivity has %ld vertices and %ld trees\n",
+                        (long) conn->num_vertices, (long) conn->num_trees);
+
+  /* create neighborhood information for isolated trees */
+  ttt = conn->tree_to_tree;
+  ttf = conn->tree_to_face;
+  for (tt = 0; tt < conn->num_trees; ++tt) {
+    for (face = 0; face < P8EST_FACES; ++face) {
+      ttt[face] = tt;
+      ttf[face] = (int8_t) face;
+    }
+    ttt += P8EST_FACES;
+    ttf += P8EST_FACES;
+  }
+
+  /* transfer tree tags when all ranks carry attributes */
+  i = (ptg->tet_attributes != NULL);
+  mpiret = MPI_Allreduce (&i, &has_attr, 1, MPI_INT, MPI_MIN, mpicomm);
+  SC_CHECK_MPI (mpiret);
+  if (has_attr) {
+    p8est_connectivity_set_attr (conn, 1);
+    attr8 = P4EST_ALLOC (int8_t, 4 * znum_tets);
+    P4EST_ASSERT (ptg->tet_attributes->elem_count == znum_tets);
+    for (iz = 0; iz < znum_tets; ++iz) {
+      pint = (int *) sc_array_index (ptg->tet_attributes, iz);
+      for (i = 0; i < 4; ++i) {
+        attr8[4 * iz + i] = (int8_t) pint[0];
+      }
+    }
+    gdispls[0] = 0;
+    for (r = 0; r < num_procs; ++r) {
+      gcnts[r] = (int) (4 * tcounts[r]);
+      gdispls[r + 1] = gdispls[r] + gcnts[r];
+    }
+    mpiret = MPI_Allgatherv (attr8, (int) (4 * znum_tets), MPI_BYTE,
+                             conn->tree_to_attr, gcnts, gdispls,
+                             MPI_BYTE, mpicomm);
+    SC_CHECK_MPI (mpiret);
+    P4EST_FREE (attr8);
+  }
+  P4EST_FREE (tcounts);
+  P4EST_FREE (ecounts);
+  P4EST_FREE (fcounts);
+  P4EST_FREE (gcnts);
+  P4EST_FREE (gdispls);
+
+  /* connect p4est tree through faces, edges, and corners */
+  p8est_connectivity_complete (conn);
+  P4EST_GLOBAL_LDEBUGF ("Connectivity has %ld edges and %ld corners\n",
+                        (long) conn->num_edges, (long) conn->num_corners);
+
+  return conn;
+}
@@ -66,6 +66,20 @@ sc_array_t         *p8est_tets_read_ele (const char *elefile,
  */
 p8est_tets_t       *p8est_tets_read (const char *tetgenbasename);
 
+/** Read a rank's share of the tetrahedra from a tetgen base name.
+ * This function is collective over the communicator.  The nodes are
+ * read completely on every rank since they are needed to interpolate
+ * vertex coordinates; the tets are split into equal contiguous ranges
+ * so that no rank ever holds the whole element list.  The result is
+ * suitable for \ref p8est_connectivity_new_tets_part.
+ * \param [in] tetgenbasename   Base name for tetgen files (without suffix).
+ * \param [in] mpicomm          Communicator over which the tets are split.
+ * \return                      A p8est_tets_t structure holding this
+ *                              rank's tets, or NULL on file error.
+ */
+p8est_tets_t       *p8est_tets_read_part (const char *tetgenbasename,
+                                          MPI_Comm mpicomm);
+
 /** Destroy all memory associated with a p8est_tets_t structure.
  * \param [in] ptg          Allocated p8est_tets_t structure.
  */
@@ -84,4 +98,19 @@ p4est_topidx_t      p8est_tets_make_righthanded (p8est_tets_t * ptg);
  */
 p8est_connectivity_t *p8est_connectivity_new_tets (p8est_tets_t * ptg);
 
+/** Create a connectivity from tets that are distributed over all ranks.
+ * This function is collective over the communicator.  Each rank
+ * contributes the contiguous tet range read by \ref
+ * p8est_tets_read_part; shared edges and faces are identified by a
+ * sort-by-key exchange so that no rank ever deduplicates the whole
+ * mesh.  The resulting connectivity is replicated on every rank as
+ * usual.  Attributes are transferred when present on all ranks.
+ * \param [in] ptg      This rank's share of node and tet information.
+ *                      Node numbers refer to the replicated node array.
+ * \param [in] mpicomm  Communicator over which the tets are split.
+ * \return          Connectivity (free with p8est_connectivity_destroy).
+ */
+p8est_connectivity_t *p8est_connectivity_new_tets_part (p8est_tets_t * ptg,
+                                                        MPI_Comm mpicomm);
+
 #endif /* !P8EST_TETS_HEXES */
@@ -36,7 +36,7 @@ p8est_trilinear_mesh_new_from_nodes (p4est_t * p4est, p4est_nodes_t * nodes)
   int64_t             prev_fvnid = -1;
 #endif
   int                *sharers;
-  size_t              current, zz, num_sharers;
+  size_t              zz, num_sharers;
   int32_t             e, n, local_owned_end;
   int64_t             global_borrowed, global_shared;
   int64_t             local_counts[5], global_counts[5];
@@ -115,35 +115,33 @@ p8est_trilinear_mesh_new_from_nodes (p4est_t * p4est, p4est_nodes_t * nodes)
   mesh->global_fvnid_end = mesh->global_fvnid_num - 1;
   P4EST_ASSERT (mesh->global_fvnid_num == mesh->total_anode_num);
 
-  /* Assign element information. */
+  /* Assign element information streaming one tree block at a time.
+   * The trees are independent of each other once the node numbering
+   * exists, and within a tree the fill runs over consecutive
+   * quadrants and consecutive table entries. */
   local_node = nodes->local_nodes;
-  which_tree = p4est->first_local_tree;
   elem_pids = mesh->elem_pids;
-  if (which_tree >= 0) {
-    tree = p4est_tree_array_index (p4est->trees, which_tree);
-    current = 0;
-    for (e = 0; e < mesh->local_elem_num; ++e) {
-      if (current == tree->quadrants.elem_count) {
-        ++which_tree;
-        tree = p4est_tree_array_index (p4est->trees, which_tree);
-        current = 0;
+  elem = mesh->elem_table;
+  e = 0;
+  if (p4est->first_local_tree >= 0) {
+    for (which_tree = p4est->first_local_tree;
+         which_tree <= p4est->last_local_tree; ++which_tree) {
+      tree = p4est_tree_array_index (p4est->trees, which_tree);
+      q = (p4est_quadrant_t *) tree->quadrants.array;
+      for (zz = 0; zz < tree->quadrants.elem_count; ++zz, ++q, ++elem) {
+        for (k = 0; k < P4EST_CHILDREN; ++k) {
+          elem->local_node_id[k] = *local_node++;
+        }
+        elem->lx = (tick_t) q->x;
+        elem->ly = (tick_t) q->y;
+        elem->lz = (tick_t) q->z;
+        elem->size = P4EST_QUADRANT_LEN (q->level);
+        elem->data = q->p.user_data;
+        elem_pids[e++] = (trilinear_mesh_pid_t) which_tree;
       }
-      q = p4est_quadrant_array_index (&tree->quadrants, current);
-      elem = mesh->elem_table + e;
-      for (k = 0; k < P4EST_CHILDREN; ++k) {
-        elem->local_node_id[k] = *local_node++;
-      }
-      elem->lx = (tick_t) q->x;
-      elem->ly = (tick_t) q->y;
-      elem->lz = (tick_t) q->z;
-      elem->size = P4EST_QUADRANT_LEN (q->level);
-      elem->data = q->p.user_data;
-      elem_pids[e] = (trilinear_mesh_pid_t) which_tree;
-      ++current;
     }
-    P4EST_ASSERT (which_tree == p4est->last_local_tree);
-    P4EST_ASSERT (current == tree->quadrants.elem_count);
   }
+  P4EST_ASSERT (e == mesh->local_elem_num);
 
   /* Assign anchored node information. */
   mesh->anode_table = mesh->node_table;
@@ -33,9 +33,39 @@
  ********************************************************************/
 
 #include <p8est_geometry.h>
+#include <p8est_nodes.h>
 
 SC_EXTERN_C_BEGIN;
 
+/** Gathers the fields that are dumped together for in-situ output. */
+typedef struct p8est_vtk_pipeline
+{
+  p8est_t            *p4est;    /**< the forest being visualized */
+  p8est_geometry_t   *geom;     /**< the geometry used for the dumps */
+  char               *filename; /**< prefix of the output file series */
+  int                 num_fields;       /**< number of registered fields */
+  char              **names;    /**< the VTK name of each field */
+  size_t             *offsets;  /**< byte offset into the user data */
+  size_t             *strides;  /**< byte distance between corner values */
+  p4est_locidx_t      num_corners;      /**< corners in the snapshot */
+  double             *buffer;   /**< back buffer of snapshotted values */
+  int                 num_writes;       /**< dumps written so far */
+}
+p8est_vtk_pipeline_t;
+
+/** Select the precision of the point coordinates in all VTK output.
+ *
+ * The coordinates are computed in double precision, including the
+ * p8est_geometry mapping, and converted to the selected width only
+ * when they are written, so a \a precision of 32 halves the Position
+ * payload of every writer in this file without touching the transform.
+ * Point and cell data fields keep the compile-time float type.
+ * The default matches the compile-time P4EST_VTK_DOUBLES setting.
+ *
+ * \param [in] precision    Bits per coordinate, 32 or 64.
+ */
+void                p8est_vtk_set_coordinate_precision (int precision);
+
 /** This writes out the p8est in VTK format.
  *
  * This is a convenience function for the special
@@ -53,6 +83,94 @@ void                p8est_vtk_write_file (p8est_t * p8est,
                                           p8est_geometry_t * geom,
                                           const char *filename);
 
+/** This writes out the p8est into one shared VTK file for all ranks.
+ *
+ * Only the single file filename.vtu is created, so the metadata load on
+ * the file system does not grow with the number of processes.  Every
+ * process writes its octants at precomputed offsets derived from
+ * p8est->global_first_quadrant; with --enable-mpiio this happens through
+ * collective MPI-IO writes, otherwise the processes write sequentially.
+ * The file stores the cell corners, the tree id and the MPI rank, like
+ * p8est_vtk_write_file, as raw appended data with 64-bit headers.
+ * This function will abort if there is a file error.
+ *
+ * \param [in] p8est    The p8est to be written.
+ * \param [in] geom     A p8est_geometry_t structure or NULL for identity.
+ * \param [in] filename The file name without the .vtu extension.
+ */
+void                p8est_vtk_write_file_shared (p8est_t * p8est,
+                                                 p8est_geometry_t * geom,
+                                                 const char *filename);
+
+/** This writes out the p8est in VTK format with bounded memory.
+ *
+ * The file contents match p8est_vtk_write_file, but instead of
+ * materializing the full coordinate and connectivity arrays, the data
+ * is generated and written in chunks of at most \a chunk_quadrants
+ * octants, so the writer needs memory proportional to the chunk and
+ * not to the local forest.  The raw appended data format is used
+ * regardless of the compile-time output options, since it is the only
+ * layout whose file offsets are known before the data is generated.
+ * This function will abort if there is a file error.
+ *
+ * \param [in] p8est    The p8est to be written.
+ * \param [in] geom     A p8est_geometry_t structure or NULL for identity.
+ * \param [in] chunk_quadrants  Positive bound on the octants buffered
+ *                      at any one time; the peak buffer size is
+ *                      3 * P8EST_CHILDREN coordinates per octant.
+ * \param [in] filename The first part of the file name, as in
+ *                      p8est_vtk_write_file.
+ */
+void                p8est_vtk_write_file_stream (p8est_t * p8est,
+                                                 p8est_geometry_t * geom,
+                                                 p4est_locidx_t
+                                                 chunk_quadrants,
+                                                 const char *filename);
+
+/** This writes out the p8est with one file per compute node.
+ *
+ * The ranks of each shared-memory node, discovered through
+ * MPI_Comm_split_type, funnel their corner coordinates and cell data to
+ * the first rank of the node, which writes them as a single vtu file in
+ * the raw appended layout of p8est_vtk_write_file_stream.  The file
+ * system therefore sees one write stream and one file per node instead
+ * of one per rank, while the cell payload stays identical to
+ * p8est_vtk_write_file; the mpirank cell field still records the
+ * original owner of every octant.  The meta files on rank 0 list the
+ * per-node pieces.  Without MPI-3 support this falls back to
+ * p8est_vtk_write_file.  This function will abort on a file error.
+ *
+ * \param [in] p8est    The p8est to be written.
+ * \param [in] geom     A p8est_geometry_t structure or NULL for identity.
+ * \param [in] filename The first part of the file name; one file
+ *                      filename_rank.vtu is written per node, named
+ *                      after the node's first rank.
+ */
+void                p8est_vtk_write_file_aggregate (p8est_t * p8est,
+                                                    p8est_geometry_t * geom,
+                                                    const char *filename);
+
+/** This writes out the p8est with a deduplicated set of points.
+ *
+ * Instead of emitting P8EST_CHILDREN corner coordinates per octant,
+ * the shared vertices are written once and referenced through the
+ * connectivity array, which shrinks the point payload accordingly.
+ * A caller-provided \a nodes avoids recomputing the numbering on every
+ * dump; it must match the current forest and is not destroyed here.
+ * This function will abort if there is a file error.
+ *
+ * \param [in] p8est    The p8est to be written.
+ * \param [in] geom     A p8est_geometry_t structure or NULL for identity.
+ * \param [in] nodes    The node numbering to reuse, or NULL to compute
+ *                      a temporary one internally.
+ * \param [in] filename The first part of the file name, as in
+ *                      p8est_vtk_write_file.
+ */
+void                p8est_vtk_write_file_nodes (p8est_t * p8est,
+                                                p8est_geometry_t * geom,
+                                                p8est_nodes_t * nodes,
+                                                const char *filename);
+
 /** This writes out the p8est and any number of point fields in VTK format.
  *
  * This is a convenience function that will abort if there is a file error.
@@ -114,6 +232,29 @@ int                 p8est_vtk_write_header (p8est_t * p8est,
                                             const char *point_vectors,
                                             const char *filename);
 
+/** This will write the header of the vtu file with deduplicated points.
+ *
+ * This behaves like p8est_vtk_write_header, except that the shared
+ * vertices are written once each, indexed by the connectivity array.
+ * If \a nodes is non-NULL it is reused and left untouched, which
+ * requires \a scale == 1.; otherwise the choice between duplicated
+ * corners and an internally computed numbering follows \a scale as in
+ * p8est_vtk_write_header.  Point fields written afterwards assume the
+ * duplicated corner layout and are not supported in this mode.
+ *
+ * \return          This returns 0 if no error and -1 if there is an error.
+ */
+int                 p8est_vtk_write_header_nodes (p8est_t * p8est,
+                                                  p8est_geometry_t * geom,
+                                                  p8est_nodes_t * nodes,
+                                                  double scale,
+                                                  int write_tree,
+                                                  int write_rank,
+                                                  int wrap_rank,
+                                                  const char *point_scalars,
+                                                  const char *point_vectors,
+                                                  const char *filename);
+
 /** This will write a scalar field to the vtu file.
  *
  * It is good practice to make sure that the scalar field also
@@ -164,6 +305,61 @@ int                 p8est_vtk_write_point_vector (p8est_t * p8est,
                                                   const char *vector_name,
                                                   const double *values);
 
+/** Create a pipeline for repeated dumps of octant user data fields.
+ *
+ * The pipeline separates the capture of the field values from the file
+ * output: p8est_vtk_pipeline_snapshot copies the registered fields into
+ * a back buffer with plain memory reads, after which the solver may
+ * overwrite its user data, and p8est_vtk_pipeline_write performs the
+ * file system traffic from the buffer at a convenient later time.
+ * Each write produces the file series member filename_NNNNNN.
+ *
+ * \param [in] p8est    The forest whose fields will be dumped.
+ *                      It must not be adapted or repartitioned between
+ *                      a snapshot and the write that consumes it.
+ * \param [in] geom     A p8est_geometry_t structure or NULL for identity.
+ * \param [in] filename The prefix of the output file series.
+ * \return              A pipeline without any registered fields.
+ */
+p8est_vtk_pipeline_t *p8est_vtk_pipeline_new (p8est_t * p8est,
+                                              p8est_geometry_t * geom,
+                                              const char *filename);
+
+/** Register one scalar field stored in the octant user data.
+ *
+ * \param [in,out] pipeline The pipeline to extend.
+ * \param [in] name     The name of the field inside the VTK files.
+ * \param [in] offset   Byte offset of the first value in the user data.
+ * \param [in] stride   Byte distance between the P8EST_CHILDREN corner
+ *                      values of an octant, or 0 to replicate one
+ *                      cell value to all of its corners.
+ */
+void                p8est_vtk_pipeline_add_field (p8est_vtk_pipeline_t *
+                                                  pipeline,
+                                                  const char *name,
+                                                  size_t offset,
+                                                  size_t stride);
+
+/** Copy the registered fields into the pipeline's back buffer.
+ * This only reads memory and returns without touching the file system.
+ * \param [in,out] pipeline The pipeline holding the registered fields.
+ */
+void                p8est_vtk_pipeline_snapshot (p8est_vtk_pipeline_t *
+                                                 pipeline);
+
+/** Write the buffered snapshot and advance the file series.
+ * This aborts if no snapshot was taken or the forest changed since.
+ * \param [in,out] pipeline The pipeline holding a valid snapshot.
+ */
+void                p8est_vtk_pipeline_write (p8est_vtk_pipeline_t *
+                                              pipeline);
+
+/** Free a pipeline and its buffers without writing anything.
+ * \param [in,out] pipeline The pipeline to be freed.
+ */
+void                p8est_vtk_pipeline_destroy (p8est_vtk_pipeline_t *
+                                                pipeline);
+
 /** This will write the footer of the vtu file.
  *
  * Writing a VTK file is split into a couple of routines.
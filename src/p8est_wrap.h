@@ -46,6 +46,20 @@ typedef struct p8est_wrap
   p8est_ghost_t      *ghost_aux;
   p8est_mesh_t       *mesh_aux;
   int                 match_aux;
+
+  /** Compact journal of the forest before the last changed adaptation.
+   * Instead of keeping a copy of the p8est for matching old against
+   * new leaves, only the level and flag of every previous leaf are
+   * recorded in forest order, together with the first previous leaf of
+   * each local tree; the position of every other leaf follows from the
+   * levels.  The arrays are NULL until p8est_wrap_refine changes the
+   * forest and are consumed by partition and revert.
+   */
+  p4est_locidx_t      journal_num_quadrants;
+  p4est_locidx_t     *journal_tree_offsets;     /* local trees + 1 */
+  p8est_quadrant_t   *journal_first_quads;      /* one per local tree */
+  int8_t             *journal_levels;
+  int8_t             *journal_flags;
 }
 p8est_wrap_t;
 
@@ -79,6 +93,16 @@ int                 p8est_wrap_refine (p8est_wrap_t * pp);
  */
 int                 p8est_wrap_partition (p8est_wrap_t * pp);
 
+/** Undo the last changed call to p8est_wrap_refine.
+ * The previous leaves are rebuilt from the journal, the intermediate
+ * ghost and mesh are freed, and pp->flags is restored to its previous
+ * contents so the adaptation can be adjusted and repeated.  The ghost
+ * and mesh of the previous forest are still in place afterwards.
+ * Must be called collectively after a changed p8est_wrap_refine and
+ * before p8est_wrap_partition.
+ */
+void                p8est_wrap_revert (p8est_wrap_t * pp);
+
 /** Free memory for the intermediate mesh.
  * Sets mesh_aux and ghost_aux to NULL.
  */
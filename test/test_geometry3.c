@@ -38,7 +38,7 @@ test_tree (p8est_geometry_t * geom, p4est_topidx_t which_tree,
   const double        epsilon = 1e-8;
   int                 i, j, k, l, m;
   double              h[3];
-  double              xyz[4][3], XYZ[4][3];
+  double              xyz[4][3], XYZ[4][3], XYZb[4][3];
   double              Jgeom[3][3], Jdisc[3][3];
   double              detD, detJ, fd, fg;
   double              diffD, diffJ, maxJ;
@@ -67,6 +67,18 @@ test_tree (p8est_geometry_t * geom, p4est_topidx_t which_tree,
             Jdisc[m][l] = (XYZ[l][m] - XYZ[3][m]) / (epsilon * h[l]);
           }
         }
+        /* the batched transform must match the pointwise results */
+        p8est_geometry_Xv (geom, which_tree, 4, xyz[0], XYZb[0]);
+        for (l = 0; l < 4; ++l) {
+          for (m = 0; m < 3; ++m) {
+            SC_CHECK_ABORTF (fabs (XYZb[l][m] - XYZ[l][m]) <=
+                             1e-12 * (1. + fabs (XYZ[l][m])),
+                             "Batch transform mismatch %lld %g %g %g",
+                             (long long) which_tree, xyz[l][0], xyz[l][1],
+                             xyz[l][2]);
+          }
+        }
+
         detJ = geom->J (geom, which_tree, xyz[3], Jgeom);
         detD = geom->D (geom, which_tree, xyz[3]);
 
@@ -310,6 +310,28 @@ main (int argc, char **argv)
   (void) p4est_linearize_tree (p4est2, t2);
   SC_CHECK_ABORT (incount == t2->quadrants.elem_count, "linearize");
 
+  /* test run compression of the linear quadrant array */
+  {
+    sc_array_t          runs, expanded;
+    size_t              num_runs;
+
+    sc_array_init (&runs, sizeof (p4est_quadrant_run_t));
+    sc_array_init (&expanded, sizeof (p4est_quadrant_t));
+    num_runs = p4est_quadrant_array_compress (&t2->quadrants, &runs);
+    SC_CHECK_ABORT (0 < num_runs && num_runs <= t2->quadrants.elem_count,
+                    "compress");
+    p4est_quadrant_array_uncompress (&runs, &expanded);
+    SC_CHECK_ABORT (expanded.elem_count == t2->quadrants.elem_count,
+                    "uncompress count");
+    for (iz = 0; iz < expanded.elem_count; ++iz) {
+      q1 = p4est_quadrant_array_index (&expanded, iz);
+      q2 = p4est_quadrant_array_index (&t2->quadrants, iz);
+      SC_CHECK_ABORT (p4est_quadrant_is_equal (q1, q2), "uncompress");
+    }
+    sc_array_reset (&runs);
+    sc_array_reset (&expanded);
+  }
+
   /* this is user_data neutral only when p4est1->data_size == 0 */
   sc_array_init (&tree.quadrants, sizeof (p4est_quadrant_t));
   sc_array_resize (&tree.quadrants, 18);
@@ -134,6 +134,18 @@ check_all (MPI_Comm mpicomm, p4est_connectivity_t * conn,
                     "Ghost checksum mismatch");
   }
 
+  /* the split construction must produce the identical ghost layer */
+  {
+    p4est_ghost_context_t *gctx;
+    p4est_ghost_t      *ghost2;
+
+    gctx = p4est_ghost_new_begin (p4est, P4EST_CONNECT_FULL);
+    ghost2 = p4est_ghost_new_end (gctx);
+    SC_CHECK_ABORT (p4est_ghost_checksum (p4est, ghost2) == gcrc_computed,
+                    "Split ghost checksum mismatch");
+    p4est_ghost_destroy (ghost2);
+  }
+
   nodes = p4est_nodes_new (p4est, ghost);
 #ifdef P4_TO_P8
   mesh = p8est_trilinear_mesh_new_from_nodes (p4est, nodes);